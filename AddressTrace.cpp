@@ -0,0 +1,158 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <sstream>
+#include "AddressTrace.hpp"
+
+
+using namespace WdRiscv;
+
+
+AddressTraceSink::AddressTraceSink(FILE* out, unsigned xlen,
+				   BlockWriter::WriteFn writeFn)
+  : writer_(out, writeFn, 64*1024)
+{
+  uint8_t header[8];
+  uint32_t magic = WHISPER_ADDR_MAGIC;
+  uint16_t version = WHISPER_ADDR_VERSION;
+  memcpy(header, &magic, 4);      // Little endian host assumed.
+  memcpy(header + 4, &version, 2);
+  header[6] = xlen;
+  header[7] = 0;
+  auto& block = writer_.buffer();
+  block.insert(block.end(), header, header + sizeof(header));
+}
+
+
+AddressTraceSink::~AddressTraceSink()
+{
+  WhisperAddrRecord end;
+  memset(&end, 0, sizeof(end));
+  end.type = WhisperAddrEnd;
+  append({end});
+  writer_.flush();
+}
+
+
+void
+AddressTraceSink::append(const std::vector<WhisperAddrRecord>& records)
+{
+  const char* data = reinterpret_cast<const char*>(records.data());
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& block = writer_.buffer();
+  block.insert(block.end(), data, data + records.size()*sizeof(records[0]));
+  writer_.checkFull();
+}
+
+
+AddressTrace::AddressTrace(AddressTraceSink& sink, unsigned hartId)
+  : sink_(sink), hart_(hartId)
+{
+  buffer_.reserve(chunkSize_);
+}
+
+
+AddressTrace::~AddressTrace()
+{
+  flush();
+}
+
+
+void
+AddressTrace::flush()
+{
+  if (buffer_.empty())
+    return;
+  sink_.append(buffer_);
+  buffer_.clear();
+}
+
+
+bool
+AddressTrace::dataAccess(uint32_t inst, bool rv64, unsigned& type,
+			 unsigned& size)
+{
+  unsigned f3 = (inst >> 12) & 7;
+
+  switch (inst & 3)
+    {
+    case 3:   // 32-bit instruction.
+      switch (inst & 0x7f)
+	{
+	case 0x03:  type = WhisperAddrLoad;  size = 1 << (f3 & 3); return true;
+	case 0x23:  type = WhisperAddrStore; size = 1 << (f3 & 3); return true;
+
+	case 0x07:  // Floating point load/store (flh to flq).
+	case 0x27:
+	  if (f3 < 1 or f3 > 4)
+	    return false;
+	  type = (inst & 0x20) ? WhisperAddrStore : WhisperAddrLoad;
+	  size = 1 << f3;
+	  return true;
+
+	case 0x2f:  // Atomic.
+	  {
+	    unsigned f5 = inst >> 27;
+	    type = (f5 == 2 ? WhisperAddrLoad :
+		    f5 == 3 ? WhisperAddrStore : WhisperAddrAmo);
+	    size = f3 == 3 ? 8 : 4;
+	    return true;
+	  }
+	}
+      return false;
+
+    case 0:   // Compressed loads/stores relative to a register.
+    case 2:   // Compressed loads/stores relative to the stack pointer.
+      {
+	unsigned cf3 = (inst >> 13) & 7;
+	unsigned wordOrDouble = rv64 ? 8 : 4;   // c.ld/c.sd or c.flw/c.fsw
+	switch (cf3)
+	  {
+	  case 1: type = WhisperAddrLoad;  size = 8;            return true;
+	  case 2: type = WhisperAddrLoad;  size = 4;            return true;
+	  case 3: type = WhisperAddrLoad;  size = wordOrDouble; return true;
+	  case 5: type = WhisperAddrStore; size = 8;            return true;
+	  case 6: type = WhisperAddrStore; size = 4;            return true;
+	  case 7: type = WhisperAddrStore; size = wordOrDouble; return true;
+	  }
+	return false;
+      }
+    }
+
+  return false;
+}
+
+
+bool
+AddressTrace::parseTypes(const std::string& list, unsigned& mask)
+{
+  mask = 0;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, ','))
+    {
+      if (item == "fetch")      mask |= FetchBit;
+      else if (item == "load")  mask |= LoadBit;
+      else if (item == "store") mask |= StoreBit;
+      else if (item == "amo")   mask |= AmoBit;
+      else
+	return false;
+    }
+  return mask != 0;
+}
@@ -0,0 +1,142 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "BlockWriter.hpp"
+#include "WhisperAddrTrace.h"
+
+
+namespace WdRiscv
+{
+
+  /// Destination of a memory address trace (see WhisperAddrTrace.h):
+  /// A file, a named pipe or any byte stream accepting blocks. Shared
+  /// by the AddressTrace objects of all the harts.
+  class AddressTraceSink
+  {
+  public:
+
+    /// Constructor: Write the trace of harts of the given xlen to the
+    /// given file which must be open for writing (blocks are written
+    /// by a background thread with the given function if not empty).
+    AddressTraceSink(FILE* out, unsigned xlen,
+		     BlockWriter::WriteFn writeFn = BlockWriter::WriteFn());
+
+    /// Destructor: Write the end record and pending records.
+    ~AddressTraceSink();
+
+    /// Append the given records. Thread safe.
+    void append(const std::vector<WhisperAddrRecord>& records);
+
+  private:
+
+    std::mutex mutex_;
+    BlockWriter writer_;
+  };
+
+
+  /// Filter and collect the memory accesses of one hart for an
+  /// address trace sink.
+  class AddressTrace
+  {
+  public:
+
+    /// Access type mask bits (see setTypes).
+    enum TypeBits : unsigned
+      {
+	FetchBit = 1 << WhisperAddrFetch,
+	LoadBit  = 1 << WhisperAddrLoad,
+	StoreBit = 1 << WhisperAddrStore,
+	AmoBit   = 1 << WhisperAddrAmo,
+	AllBits  = FetchBit | LoadBit | StoreBit | AmoBit
+      };
+
+    /// Constructor: Send the records of the hart with the given id to
+    /// the given sink.
+    AddressTrace(AddressTraceSink& sink, unsigned hartId);
+
+    /// Destructor: Send pending records to the sink.
+    ~AddressTrace();
+
+    /// Only record the accesses of the types in the given mask of
+    /// TypeBits (all by default).
+    void setTypes(unsigned mask)
+    { types_ = mask; }
+
+    /// Only record the accesses in the given ranges (after this call,
+    /// the accesses in [begin, end)). All addresses are recorded if
+    /// no range is defined.
+    void addRange(uint64_t begin, uint64_t end)
+    { ranges_.push_back({begin, end}); }
+
+    /// Record an access of the given type (WhisperAddrType) and size
+    /// at the given address by the instruction at the given pc
+    /// preceded by count instructions.
+    void record(uint64_t count, uint64_t pc, unsigned type,
+		uint64_t address, unsigned size)
+    {
+      if (((types_ >> type) & 1) == 0 or not inRange(address))
+	return;
+      WhisperAddrRecord rec = { count, pc, address, uint8_t(type),
+				uint8_t(size), hart_, 0 };
+      buffer_.push_back(rec);
+      if (buffer_.size() >= chunkSize_)
+	flush();
+    }
+
+    /// Send pending records to the sink.
+    void flush();
+
+    /// Set type to the type (WhisperAddrType) and size to the byte
+    /// count of the data access of the given instruction. Return
+    /// false if the instruction does not access data memory.
+    static bool dataAccess(uint32_t inst, bool rv64, unsigned& type,
+			   unsigned& size);
+
+    /// Parse the given comma separated list of access types (fetch,
+    /// load, store, amo) into a mask of TypeBits. Return false if a
+    /// type is not valid.
+    static bool parseTypes(const std::string& list, unsigned& mask);
+
+  private:
+
+    bool inRange(uint64_t address) const
+    {
+      if (ranges_.empty())
+	return true;
+      for (const auto& range : ranges_)
+	if (address >= range.first and address < range.second)
+	  return true;
+      return false;
+    }
+
+    static constexpr size_t chunkSize_ = 4096;   // Records.
+
+    AddressTraceSink& sink_;
+    uint16_t hart_ = 0;
+    unsigned types_ = AllBits;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges_;
+    std::vector<WhisperAddrRecord> buffer_;
+  };
+}
@@ -0,0 +1,67 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cinttypes>
+#include "BasicBlockVector.hpp"
+
+
+using namespace WdRiscv;
+
+
+BasicBlockVector::BasicBlockVector(FILE* out, uint64_t intervalSize)
+  : out_(out), intervalSize_(std::max(intervalSize, uint64_t(1)))
+{
+  intervalEnd_ = intervalSize_;
+}
+
+
+void
+BasicBlockVector::endInterval(uint64_t retired)
+{
+  // Blocks are numbered from 1 in the file.
+  std::sort(touched_.begin(), touched_.end());
+  fputc('T', out_);
+  for (unsigned id : touched_)
+    {
+      fprintf(out_, ":%u:%" PRIu64 " ", id + 1, counts_[id]);
+      counts_[id] = 0;
+    }
+  fputc('\n', out_);
+  touched_.clear();
+
+  intervals_++;
+  intervalEnd_ = (retired / intervalSize_ + 1) * intervalSize_;
+}
+
+
+void
+BasicBlockVector::finish(uint64_t retired)
+{
+  if (pending_)
+    {
+      unsigned id = blockId(blockPc_);
+      if (counts_[id] == 0)
+	touched_.push_back(id);
+      counts_[id] += pending_;
+      pending_ = 0;
+    }
+  if (not touched_.empty())
+    endInterval(retired);
+  fflush(out_);
+}
@@ -0,0 +1,123 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  /// Basic block vector (BBV) profile of a hart written in the format
+  /// read by the SimPoint tool: The retired instructions are split
+  /// into intervals of a fixed instruction count (interval i covers
+  /// the instructions numbered i*size to (i+1)*size-1) and, at the end
+  /// of each interval, a line
+  ///
+  ///   T:id:count :id:count ...
+  ///
+  /// gives the number of instructions retired in each basic block
+  /// executed during the interval. Blocks are numbered from 1 in
+  /// order of first execution. Interval ends are checked at basic
+  /// block boundaries: an interval may be a few instructions longer
+  /// than the interval size.
+  class BasicBlockVector
+  {
+  public:
+
+    /// Constructor: Write intervals of the given instruction count
+    /// (one if zero) to the given file which must be open for writing.
+    BasicBlockVector(FILE* out, uint64_t intervalSize);
+
+    /// Return the number of the basic block starting at the given
+    /// address assigning one on first call.
+    unsigned blockId(uint64_t pc)
+    {
+      auto iter = ids_.find(pc);
+      if (iter != ids_.end())
+	return iter->second;
+      unsigned id = counts_.size();
+      ids_[pc] = id;
+      counts_.push_back(0);
+      return id;
+    }
+
+    /// Count instCount instructions retired in the block of the given
+    /// number (see blockId). Retired is the count of instructions
+    /// retired by the hart so far.
+    void record(unsigned id, uint64_t instCount, uint64_t retired)
+    {
+      if (counts_[id] == 0)
+	touched_.push_back(id);
+      counts_[id] += instCount;
+      if (retired >= intervalEnd_)
+	endInterval(retired);
+    }
+
+    /// Count the retired instruction of the given size at the given
+    /// PC. This is for the per-instruction run loop: A block starts
+    /// at each instruction that does not sequentially follow the
+    /// preceding one.
+    void recordInst(uint64_t pc, unsigned size, uint64_t retired)
+    {
+      if (pc != nextPc_)
+	{
+	  if (pending_)
+	    record(blockId(blockPc_), pending_, retired - 1);
+	  blockPc_ = pc;
+	  pending_ = 0;
+	}
+      pending_++;
+      nextPc_ = pc + size;
+      if (retired >= intervalEnd_)
+	{
+	  record(blockId(blockPc_), pending_, retired);
+	  pending_ = 0;
+	}
+    }
+
+    /// Write the last (partial) interval, if any, and flush the file.
+    void finish(uint64_t retired);
+
+    /// Return the count of intervals written so far.
+    uint64_t intervalCount() const
+    { return intervals_; }
+
+  private:
+
+    /// Write the current interval and start the next one.
+    void endInterval(uint64_t retired);
+
+    FILE* out_ = nullptr;
+    uint64_t intervalSize_ = 1;
+    uint64_t intervalEnd_ = 1;
+    uint64_t intervals_ = 0;
+
+    std::unordered_map<uint64_t, unsigned> ids_;  // Block address to number.
+    std::vector<uint64_t> counts_;     // Indexed by block number.
+    std::vector<unsigned> touched_;    // Blocks with non-zero count.
+
+    uint64_t blockPc_ = 0;             // See recordInst.
+    uint64_t nextPc_ = ~uint64_t(0);
+    uint64_t pending_ = 0;
+  };
+}
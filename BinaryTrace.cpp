@@ -0,0 +1,349 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <iostream>
+#include <cstring>
+#ifdef WHISPER_ZSTD
+#include <zstd.h>
+#endif
+#include "BinaryTrace.hpp"
+
+
+using namespace WdRiscv;
+
+
+static constexpr uint32_t binaryTraceMagic = 0x42525457;  // "WTRB"
+static constexpr unsigned binaryTraceVersion = 1;
+
+enum BlockCodec { RawCodec = 0, ZstdCodec = 1 };
+
+
+static void
+putU32(uint8_t* p, uint32_t x)
+{
+  for (unsigned i = 0; i < 4; ++i)
+    p[i] = uint8_t(x >> (8*i));
+}
+
+
+static uint32_t
+getU32(const uint8_t* p)
+{
+  uint32_t x = 0;
+  for (unsigned i = 0; i < 4; ++i)
+    x |= uint32_t(p[i]) << (8*i);
+  return x;
+}
+
+
+BinaryTraceWriter::BinaryTraceWriter(FILE* out, unsigned xlen,
+				     uint32_t extensions, unsigned flags,
+				     bool compress)
+  : compress_(compress and zstdSupported()),
+    writer_(out, [this] (FILE* out, const std::vector<char>& block) {
+	writeBlock(out, block); })
+{
+  uint8_t header[12];
+  putU32(header, binaryTraceMagic);
+  header[4] = binaryTraceVersion;
+  header[5] = xlen;
+  header[6] = flags;
+  header[7] = 0;
+  putU32(header + 8, extensions & 0x3ffffff);
+  fwrite(header, sizeof(header), 1, out);
+}
+
+
+bool
+BinaryTraceWriter::zstdSupported()
+{
+#ifdef WHISPER_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void
+BinaryTraceWriter::encode(const TraceRecord& rec)
+{
+  auto& block = writer_.buffer();
+  size_t count = rec.changes.size();
+
+  unsigned head = count < 15 ? count << 4 : 15 << 4;
+  if (rec.interrupted)
+    head |= 1;
+  if (rec.hasLoadAddr)
+    head |= 2;
+  if (rec.hartId != prevHart_)
+    head |= 4;
+
+  block.push_back(char(head));
+  putSvarint(int64_t(rec.tag - prevTag_));
+  prevTag_ = rec.tag;
+
+  if (rec.hartId != prevHart_)
+    {
+      putVarint(rec.hartId);
+      prevHart_ = rec.hartId;
+    }
+
+  putSvarint(int64_t(rec.pc - nextPc_));
+
+  bool compressed = (rec.inst & 3) != 3;
+  block.push_back(char(rec.inst));
+  block.push_back(char(rec.inst >> 8));
+  if (not compressed)
+    {
+      block.push_back(char(rec.inst >> 16));
+      block.push_back(char(rec.inst >> 24));
+    }
+  nextPc_ = rec.pc + (compressed ? 2 : 4);
+
+  if (count >= 15)
+    putVarint(count);
+
+  if (rec.hasLoadAddr)
+    {
+      putSvarint(int64_t(rec.loadAddr - prevLoad_));
+      prevLoad_ = rec.loadAddr;
+    }
+
+  for (const auto& change : rec.changes)
+    {
+      block.push_back(char(change.resource));
+      if (change.resource == 'm')
+	{
+	  putSvarint(int64_t(change.addr - prevMem_));
+	  prevMem_ = change.addr;
+	}
+      else
+	putVarint(change.addr);
+      putVarint(change.value);
+    }
+}
+
+
+void
+BinaryTraceWriter::writeBlock(FILE* out, const std::vector<char>& block)
+{
+  uint8_t codec = RawCodec;
+  const char* data = block.data();
+  size_t size = block.size();
+
+#ifdef WHISPER_ZSTD
+  if (compress_)
+    {
+      stored_.resize(ZSTD_compressBound(block.size()));
+      size_t n = ZSTD_compress(stored_.data(), stored_.size(), block.data(),
+			       block.size(), 3);
+      if (not ZSTD_isError(n) and n < block.size())
+	{
+	  codec = ZstdCodec;
+	  data = stored_.data();
+	  size = n;
+	}
+    }
+#endif
+
+  uint8_t header[9];
+  putU32(header, block.size());
+  putU32(header + 4, size);
+  header[8] = codec;
+  if (fwrite(header, sizeof(header), 1, out) != 1 or
+      fwrite(data, size, 1, out) != 1)
+    std::cerr << "Failed to write binary trace block\n";
+}
+
+
+BinaryTraceReader::BinaryTraceReader(FILE* in)
+  : in_(in)
+{
+  uint8_t header[12];
+  if (fread(header, sizeof(header), 1, in_) != 1)
+    return;
+
+  if (getU32(header) != binaryTraceMagic or header[4] != binaryTraceVersion)
+    return;
+
+  xlen_ = header[5];
+  flags_ = header[6];
+  extensions_ = getU32(header + 8);
+  valid_ = xlen_ == 32 or xlen_ == 64;
+}
+
+
+bool
+BinaryTraceReader::readBlock()
+{
+  uint8_t header[9];
+  size_t n = fread(header, 1, sizeof(header), in_);
+  if (n == 0)
+    return false;
+  if (n != sizeof(header))
+    {
+      error_ = true;
+      return false;
+    }
+
+  uint32_t rawSize = getU32(header), storedSize = getU32(header + 4);
+  unsigned codec = header[8];
+
+  if (codec == RawCodec)
+    {
+      block_.resize(rawSize);
+      if (rawSize != storedSize or
+	  fread(block_.data(), rawSize, 1, in_) != 1)
+	{
+	  error_ = true;
+	  return false;
+	}
+    }
+  else if (codec == ZstdCodec)
+    {
+#ifdef WHISPER_ZSTD
+      stored_.resize(storedSize);
+      block_.resize(rawSize);
+      if (fread(stored_.data(), storedSize, 1, in_) != 1)
+	{
+	  error_ = true;
+	  return false;
+	}
+      size_t size = ZSTD_decompress(block_.data(), rawSize, stored_.data(),
+				    storedSize);
+      if (ZSTD_isError(size) or size != rawSize)
+	{
+	  error_ = true;
+	  return false;
+	}
+#else
+      std::cerr << "Binary trace is compressed: need whisper-tracedump "
+		<< "compiled with zstd support (make ZSTD=1)\n";
+      error_ = true;
+      return false;
+#endif
+    }
+  else
+    {
+      error_ = true;
+      return false;
+    }
+
+  pos_ = 0;
+  prevTag_ = 0;
+  prevHart_ = 0;
+  nextPc_ = 0;
+  prevLoad_ = 0;
+  prevMem_ = 0;
+  return true;
+}
+
+
+uint64_t
+BinaryTraceReader::getVarint()
+{
+  uint64_t x = 0;
+  for (unsigned shift = 0; pos_ < block_.size() and shift < 64; shift += 7)
+    {
+      uint8_t byte = block_[pos_++];
+      x |= uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+	return x;
+    }
+  error_ = true;
+  return x;
+}
+
+
+bool
+BinaryTraceReader::read(TraceRecord& rec)
+{
+  if (not valid_ or error_)
+    return false;
+
+  while (pos_ >= block_.size())
+    if (not readBlock())
+      return false;
+
+  unsigned head = block_[pos_++];
+  rec.interrupted = head & 1;
+  rec.hasLoadAddr = head & 2;
+
+  rec.tag = prevTag_ + getSvarint();
+  prevTag_ = rec.tag;
+
+  if (head & 4)
+    prevHart_ = getVarint();
+  rec.hartId = prevHart_;
+
+  rec.pc = nextPc_ + getSvarint();
+
+  if (pos_ + 2 > block_.size())
+    {
+      error_ = true;
+      return false;
+    }
+  rec.inst = block_[pos_] | (uint32_t(block_[pos_ + 1]) << 8);
+  pos_ += 2;
+  bool compressed = (rec.inst & 3) != 3;
+  if (not compressed)
+    {
+      if (pos_ + 2 > block_.size())
+	{
+	  error_ = true;
+	  return false;
+	}
+      rec.inst |= (uint32_t(block_[pos_]) << 16) |
+	(uint32_t(block_[pos_ + 1]) << 24);
+      pos_ += 2;
+    }
+  nextPc_ = rec.pc + (compressed ? 2 : 4);
+
+  size_t count = head >> 4;
+  if (count == 15)
+    count = getVarint();
+
+  rec.loadAddr = 0;
+  if (rec.hasLoadAddr)
+    {
+      rec.loadAddr = prevLoad_ + getSvarint();
+      prevLoad_ = rec.loadAddr;
+    }
+
+  rec.changes.resize(count);
+  for (auto& change : rec.changes)
+    {
+      if (pos_ >= block_.size())
+	{
+	  error_ = true;
+	  return false;
+	}
+      change.resource = block_[pos_++];
+      if (change.resource == 'm')
+	{
+	  change.addr = prevMem_ + getSvarint();
+	  prevMem_ = change.addr;
+	}
+      else
+	change.addr = getVarint();
+      change.value = getVarint();
+    }
+
+  return not error_;
+}
@@ -0,0 +1,191 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "BlockWriter.hpp"
+#include "TraceRecord.hpp"
+
+
+namespace WdRiscv
+{
+
+  // Binary trace file layout (all fixed size integers little endian):
+  //
+  //   Header:  u32 magic ("WTRB"), u8 version, u8 xlen, u8 flags, u8 0,
+  //            u32 extensions (MISA bits 0 to 25)
+  //   Blocks:  u32 rawSize, u32 storedSize, u8 codec, storedSize bytes
+  //
+  // Codec 0 is raw, codec 1 is zstd (see BinaryTraceWriter). A block
+  // holds whole records. Delta coding restarts at each block so that a
+  // block can be decoded on its own. A record is:
+  //
+  //   u8      head     bit 0: interrupted, bit 1: load address present,
+  //                    bit 2: hart id present, bits 4-7: change count
+  //                    (15 means a varint count follows)
+  //   svarint tag      Delta from previous tag.
+  //   varint  hart     If head bit 2: Hart id (else same as previous).
+  //   svarint pc       Delta from previous pc plus previous inst size.
+  //   u16/u32 inst     u16 if inst is compressed (low 2 bits not 11).
+  //   varint  count    If change count field is 15.
+  //   svarint load     If head bit 1: Delta from previous load address.
+  //   changes          u8 resource ('r', 'f', 'c' or 'm'), then varint
+  //                    number (svarint delta from previous memory
+  //                    address for 'm') and varint value.
+  //
+  // Varints are little endian base-128, svarints are zigzag encoded
+  // varints.
+
+  /// Header flag: Disassemble using ABI register names.
+  constexpr unsigned BinaryTraceAbiNames = 1;
+
+
+  /// Write binary instruction trace records to a file. Records are
+  /// encoded into large blocks on the simulation thread. Full blocks
+  /// are compressed (if enabled) and written to the file by a
+  /// background thread (see BlockWriter).
+  class BinaryTraceWriter
+  {
+  public:
+
+    /// Constructor: Write a trace of harts of the given xlen (32 or
+    /// 64) and the given extensions (MISA value) to the given file
+    /// which must be open for writing. The xlen, extensions and flags
+    /// are needed to disassemble the traced instructions. Compress
+    /// blocks using zstd if compress is true (ignored if whisper is
+    /// compiled without zstd support: see zstdSupported).
+    BinaryTraceWriter(FILE* out, unsigned xlen, uint32_t extensions,
+		      unsigned flags, bool compress = false);
+
+    /// Encode the given record.
+    void write(const TraceRecord& rec)
+    {
+      encode(rec);
+      if (writer_.checkFull())
+	resetDeltas();
+    }
+
+    /// Write pending records to the file.
+    void flush()
+    { writer_.flush(); resetDeltas(); }
+
+    /// Return true if compiled with zstd support (make ZSTD=1).
+    static bool zstdSupported();
+
+  private:
+
+    void encode(const TraceRecord& rec);
+
+    void putVarint(uint64_t x)
+    {
+      auto& block = writer_.buffer();
+      while (x >= 0x80)
+	{
+	  block.push_back(char(x | 0x80));
+	  x >>= 7;
+	}
+      block.push_back(char(x));
+    }
+
+    void putSvarint(int64_t x)
+    { putVarint((uint64_t(x) << 1) ^ uint64_t(x >> 63)); }
+
+    /// Delta coding restarts at each block.
+    void resetDeltas()
+    { prevTag_ = 0; prevHart_ = 0; nextPc_ = 0; prevLoad_ = 0; prevMem_ = 0; }
+
+    /// Write given block to given file: called by the background
+    /// thread.
+    void writeBlock(FILE* out, const std::vector<char>& block);
+
+    bool compress_ = false;
+    std::vector<char> stored_;   // Compressed block.
+
+    uint64_t prevTag_ = 0;
+    unsigned prevHart_ = 0;
+    uint64_t nextPc_ = 0;
+    uint64_t prevLoad_ = 0;
+    uint64_t prevMem_ = 0;
+
+    BlockWriter writer_;  // Last member: its thread uses the others.
+  };
+
+
+  /// Read the records of a binary instruction trace file.
+  class BinaryTraceReader
+  {
+  public:
+
+    /// Constructor: Read from the given file which must be open for
+    /// reading.
+    BinaryTraceReader(FILE* in);
+
+    /// Return true if the file header was successfully read.
+    bool isValid() const
+    { return valid_; }
+
+    /// Return the xlen of the traced harts.
+    unsigned xlen() const
+    { return xlen_; }
+
+    /// Return the header flags.
+    unsigned flags() const
+    { return flags_; }
+
+    /// Return the extensions (MISA bits) of the traced harts.
+    uint32_t extensions() const
+    { return extensions_; }
+
+    /// Read the next record into rec. Return true on success and false
+    /// at end of file or on error (see hasError).
+    bool read(TraceRecord& rec);
+
+    /// Return true if a malformed or truncated file was detected.
+    bool hasError() const
+    { return error_; }
+
+  private:
+
+    bool readBlock();
+
+    uint64_t getVarint();
+
+    int64_t getSvarint()
+    { uint64_t x = getVarint(); return int64_t(x >> 1) ^ -int64_t(x & 1); }
+
+    FILE* in_;
+    bool valid_ = false;
+    bool error_ = false;
+    unsigned xlen_ = 32;
+    unsigned flags_ = 0;
+    uint32_t extensions_ = 0;
+
+    std::vector<uint8_t> block_;
+    std::vector<uint8_t> stored_;
+    size_t pos_ = 0;
+
+    uint64_t prevTag_ = 0;
+    unsigned prevHart_ = 0;
+    uint64_t nextPc_ = 0;
+    uint64_t prevLoad_ = 0;
+    uint64_t prevMem_ = 0;
+  };
+}
@@ -0,0 +1,112 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <iostream>
+#include "BlockWriter.hpp"
+
+
+using namespace WdRiscv;
+
+
+BlockWriter::BlockWriter(FILE* out, WriteFn writeFn, size_t blockSize)
+  : out_(out), writeFn_(writeFn), blockSize_(blockSize)
+{
+  block_.reserve(blockSize_ + 4096);
+  thread_ = std::thread([this] { writeBlocks(); });
+}
+
+
+BlockWriter::~BlockWriter()
+{
+  flush();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+
+void
+BlockWriter::submit()
+{
+  if (block_.empty())
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return queue_.size() < maxQueued_; });
+
+  queue_.push_back(std::move(block_));
+  block_ = std::vector<char>();
+  if (not free_.empty())
+    {
+      block_ = std::move(free_.back());
+      free_.pop_back();
+    }
+  lock.unlock();
+  cv_.notify_all();
+
+  block_.clear();
+  block_.reserve(blockSize_ + 4096);
+}
+
+
+void
+BlockWriter::flush()
+{
+  submit();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return queue_.empty() and not busy_; });
+  if (out_)
+    fflush(out_);
+}
+
+
+void
+BlockWriter::writeBlocks()
+{
+  while (true)
+    {
+      std::vector<char> block;
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this] { return stop_ or not queue_.empty(); });
+	if (queue_.empty())
+	  return;
+	block = std::move(queue_.front());
+	queue_.pop_front();
+	busy_ = true;
+      }
+      cv_.notify_all();
+
+      if (writeFn_)
+	writeFn_(out_, block);
+      else if (fwrite(block.data(), block.size(), 1, out_) != 1)
+	std::cerr << "Failed to write trace file\n";
+
+      {
+	std::lock_guard<std::mutex> lock(mutex_);
+	free_.push_back(std::move(block));
+	busy_ = false;
+      }
+      cv_.notify_all();
+    }
+}
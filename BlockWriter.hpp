@@ -0,0 +1,99 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+namespace WdRiscv
+{
+
+  /// Write data to a file from a background thread. The producer
+  /// appends to a large block (see buffer). Full blocks are handed to
+  /// the background thread which writes them in order. The producer
+  /// blocks if the background thread falls more than a few blocks
+  /// behind. Block buffers are recycled.
+  class BlockWriter
+  {
+  public:
+
+    /// Function used by the background thread to write a block to the
+    /// file.
+    typedef std::function<void(FILE*, const std::vector<char>&)> WriteFn;
+
+    /// Constructor: Write to the given file which must be open for
+    /// writing and must not be written by anything else while this
+    /// writer exists. Blocks are written with the given function
+    /// (fwrite if empty) once they reach the given size. The file may
+    /// be null if the function does not use it.
+    BlockWriter(FILE* out, WriteFn writeFn = WriteFn(),
+		size_t blockSize = 1024*1024);
+
+    /// Destructor: Write pending data.
+    ~BlockWriter();
+
+    /// Return the block being filled. The caller appends to it and
+    /// then calls checkFull.
+    std::vector<char>& buffer()
+    { return block_; }
+
+    /// Hand the current block to the background thread if it has
+    /// reached the block size. Return true if a new block was started.
+    bool checkFull()
+    {
+      if (block_.size() < blockSize_)
+	return false;
+      submit();
+      return true;
+    }
+
+    /// Hand the current block (if not empty) to the background thread
+    /// and start a new block.
+    void submit();
+
+    /// Write all pending data to the file and flush the file.
+    void flush();
+
+  private:
+
+    /// Body of the background thread.
+    void writeBlocks();
+
+    FILE* out_;
+    WriteFn writeFn_;
+    size_t blockSize_;
+    static constexpr size_t maxQueued_ = 4;  // Blocks before back-pressure.
+
+    std::vector<char> block_;              // Block being filled.
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::vector<char>> queue_;  // Blocks to write.
+    std::vector<std::vector<char>> free_;  // Recycled block buffers.
+    bool busy_ = false;                    // Background thread has a block.
+    bool stop_ = false;
+    std::thread thread_;
+  };
+}
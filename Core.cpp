@@ -22,6 +22,10 @@
 #include <cfenv>
 #include <cmath>
 #include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <boost/format.hpp>
 #include <string.h>
 #include <time.h>
@@ -31,9 +35,20 @@
 #include <sys/uio.h>
 #include <sys/utsname.h>
 #include <assert.h>
-#include <signal.h>
 #include "Core.hpp"
 #include "instforms.hpp"
+#include "BinaryTrace.hpp"
+#include "Profiler.hpp"
+#include "SymbolIndex.hpp"
+#include "Coverage.hpp"
+#include "BasicBlockVector.hpp"
+#include "Plugin.hpp"
+#include "Metrics.hpp"
+#include "Numa.hpp"
+#include "AddressTrace.hpp"
+#ifdef WHISPER_JIT
+#include "Jit.hpp"
+#endif
 
 using namespace WdRiscv;
 
@@ -66,15 +81,44 @@ parseNumber(const std::string& numberStr, TYPE& number)
 
 template <typename URV>
 Core<URV>::Core(unsigned hartId, size_t memorySize, unsigned intRegCount)
-  : hartId_(hartId), memory_(memorySize), intRegs_(intRegCount), fpRegs_(32)
+  : Core(hartId, *new Memory(memorySize), intRegCount)
+{
+  ownMemory_.reset(&memory_);
+}
+
+
+template <typename URV>
+Core<URV>::Core(unsigned hartId, Memory& memory, unsigned intRegCount)
+  : hartId_(hartId), memory_(memory), arch_(),
+    intRegs_(arch_.intRegs, std::min(intRegCount, 32u)),
+    csRegs_(arch_.csrs, arch_.perfCounters), fpRegs_(arch_.fpRegs, 32),
+    deviceBus_(memory)
 {
+  deviceBus_.setWakeup(&eventTime_);
+
+  arch_.privMode = PrivilegeMode::Machine;
+  arch_.nmiCause = NmiCause::UNKNOWN;
+
   regionHasLocalMem_.resize(16);
+  decodeCache_.resize(decodeCacheSize_);
+  blockCache_.resize(blockCacheSize_);
+  rvcTable_.resize(size_t(1) << 16);
+  disassCache_.resize(disassCacheSize_);
+
+#ifdef WHISPER_JIT
+  if constexpr (sizeof(URV) == 4)
+    {
+      jit_ = std::make_unique<Jit>();
+      if (not jit_->isValid())
+	jit_.reset();
+    }
+#endif
 
   // Tie the retired instruction and cycle counter CSRs to variable
   // held in the core.
   if constexpr (sizeof(URV) == 4)
     {
-      URV* low = reinterpret_cast<URV*> (&retiredInsts_);
+      URV* low = reinterpret_cast<URV*> (&arch_.retiredInsts);
       URV* high = low + 1;
 
       auto& mirLow = csRegs_.regs_.at(size_t(CsrNumber::MINSTRET));
@@ -83,7 +127,7 @@ Core<URV>::Core(unsigned hartId, size_t memorySize, unsigned intRegCount)
       auto& mirHigh = csRegs_.regs_.at(size_t(CsrNumber::MINSTRETH));
       mirHigh.tie(high);
 
-      low = reinterpret_cast<URV*> (&cycleCount_);
+      low = reinterpret_cast<URV*> (&arch_.cycleCount);
       high = low + 1;
 
       auto& mcycleLow = csRegs_.regs_.at(size_t(CsrNumber::MCYCLE));
@@ -94,9 +138,14 @@ Core<URV>::Core(unsigned hartId, size_t memorySize, unsigned intRegCount)
     }
   else
     {
-      csRegs_.regs_.at(size_t(CsrNumber::MINSTRET)).tie(&retiredInsts_);
-      csRegs_.regs_.at(size_t(CsrNumber::MCYCLE)).tie(&cycleCount_);
+      csRegs_.regs_.at(size_t(CsrNumber::MINSTRET)).tie(&arch_.retiredInsts);
+      csRegs_.regs_.at(size_t(CsrNumber::MCYCLE)).tie(&arch_.cycleCount);
     }
+
+  // Each hart reads its own id from the mhartid CSR.
+  auto& mhartid = csRegs_.regs_.at(size_t(CsrNumber::MHARTID));
+  mhartid.setInitialValue(hartId);
+  mhartid.pokeNoMask(hartId);
 }
 
 
@@ -127,11 +176,13 @@ Core<URV>::reset()
 {
   intRegs_.reset();
   csRegs_.reset();
+  if (timer_)
+    timer_->reset();
 
   // Suppress resetting memory mapped register on initial resets sent
   // by the test bench. Otherwise, initial resets obliterate memory
   // mapped register data loaded from the ELF file.
-  if (counter_ > 0)
+  if (arch_.counter > 0)
     memory_.resetMemoryMappedRegisters();
 
   clearTraceData();
@@ -139,9 +190,16 @@ Core<URV>::reset()
 
   storeQueue_.clear();
   loadQueue_.clear();
+  recountLoadQueueRegs();
 
-  pc_ = resetPc_;
-  currPc_ = resetPc_;
+  // Decoding depends on the enabled extensions.
+  invalidateDecodeCache();
+  for (auto& entry : rvcTable_)
+    entry.fn_ = nullptr;
+  clearDisassCache();
+
+  arch_.pc = resetPc_;
+  arch_.currPc = resetPc_;
 
   // Enable M (multiply/divide) and C (compressed-instruction), F
   // (single precision floating point) and D (double precision
@@ -215,16 +273,285 @@ Core<URV>::reset()
       prevCountersCsrOn_ = countersCsrOn_;
     }
 
-  debugMode_ = false;
-  debugStepMode_ = false;
+  arch_.debugMode = false;
+  arch_.debugStepMode = false;
 
-  dcsrStepIe_ = false;
-  dcsrStep_ = false;
+  arch_.dcsrStepIe = false;
+  arch_.dcsrStep = false;
 
   if (csRegs_.peek(CsrNumber::DCSR, value))
     {
-      dcsrStep_ = (value >> 2) & 1;
-      dcsrStepIe_ = (value >> 11) & 1;
+      arch_.dcsrStep = (value >> 2) & 1;
+      arch_.dcsrStepIe = (value >> 11) & 1;
+    }
+}
+
+
+template <typename URV>
+void
+Core<URV>::resetProgramState()
+{
+  clearToHostAddress();
+  clearStopAddress();
+  arch_.progBreak = 0;
+  arch_.mmapTop = 0;
+
+  arch_.counter = 0;
+  arch_.exceptionCount = 0;
+  arch_.interruptCount = 0;
+  exceptionCauses_.fill(0);
+  interruptCauses_.fill(0);
+  triggerTrips_ = 0;
+  arch_.consecutiveIllegalCount = 0;
+  arch_.counterAtLastIllegal = 0;
+
+  arch_.hasLr = false;
+  arch_.privMode = PrivilegeMode::Machine;
+  arch_.targetProgFinished = false;
+}
+
+
+template <typename URV>
+void
+Core<URV>::saveState(HartState& state) const
+{
+  // Registers, CSR values and counters: one copy of the block. Copied
+  // as bytes so that padding is kept (see ArchState).
+  csRegs_.mPerfRegs_.sync();
+  memcpy(static_cast<void*>(&state.arch), &arch_, sizeof(arch_));
+
+  state.triggers = csRegs_.triggers_;
+  state.interruptEnable = csRegs_.interruptEnable_;
+  state.hasActiveTrigger = csRegs_.hasActiveTrigger_;
+  state.hasActiveInstTrigger = csRegs_.hasActiveInstTrigger_;
+  state.mdseacLocked = csRegs_.mdseacLocked_;
+
+  const auto& perfRegs = csRegs_.mPerfRegs_;
+  state.eventOfCounter = perfRegs.eventOfCounter_;
+  state.countersOfEvent = perfRegs.countersOfEvent_;
+
+  storeQueue_.copyTo(state.storeQueue);
+  loadQueue_.copyTo(state.loadQueue);
+
+  state.exceptionCauses = exceptionCauses_;
+  state.interruptCauses = interruptCauses_;
+  state.triggerTrips = triggerTrips_;
+}
+
+
+template <typename URV>
+void
+Core<URV>::loadState(const HartState& state)
+{
+  memcpy(static_cast<void*>(&arch_), &state.arch, sizeof(arch_));
+
+  auto& perfRegs = csRegs_.mPerfRegs_;
+  perfRegs.eventOfCounter_ = state.eventOfCounter;
+  perfRegs.countersOfEvent_ = state.countersOfEvent;
+  perfRegs.discardEvents();
+
+  csRegs_.triggers_ = state.triggers;
+  csRegs_.interruptEnable_ = state.interruptEnable;
+  csRegs_.updateInterruptCache();
+  csRegs_.hasActiveTrigger_ = state.hasActiveTrigger;
+  csRegs_.hasActiveInstTrigger_ = state.hasActiveInstTrigger;
+  csRegs_.mdseacLocked_ = state.mdseacLocked;
+
+  storeQueue_.assign(state.storeQueue);
+  loadQueue_.assign(state.loadQueue);
+  recountLoadQueueRegs();
+
+  exceptionCauses_ = state.exceptionCauses;
+  interruptCauses_ = state.interruptCauses;
+  triggerTrips_ = state.triggerTrips;
+
+  invalidateDecodeCache();
+  eventTime_ = 0;
+}
+
+
+template <typename URV>
+void
+Core<URV>::takeSnapshot(bool withMemory)
+{
+  if (not snapshot_)
+    snapshot_ = std::make_unique<HartState>();
+  saveState(*snapshot_);
+  if (withMemory)
+    memory_.takeSnapshot();
+}
+
+
+template <typename URV>
+bool
+Core<URV>::restoreSnapshot(bool withMemory)
+{
+  if (not snapshot_)
+    return false;
+  if (withMemory and not memory_.restoreSnapshot())
+    return false;
+  loadState(*snapshot_);
+  return true;
+}
+
+
+template <typename URV>
+void
+Core<URV>::dropSnapshot()
+{
+  snapshot_.reset();
+  memory_.dropSnapshot();
+}
+
+
+template <typename URV>
+void
+Core<URV>::enableReverse(uint64_t interval, size_t journalBytes)
+{
+  reversePoints_.clear();
+  reverseInterval_ = interval;
+  reverseTime_ = ~uint64_t(0);
+  if (interval == 0)
+    {
+      memory_.disableJournal();
+      return;
+    }
+  memory_.enableJournal(journalBytes);
+  saveReversePoint();
+}
+
+
+template <typename URV>
+void
+Core<URV>::saveReversePoint()
+{
+  dropStaleReversePoints();
+  if (reversePoints_.size() >= maxReversePoints_)
+    reversePoints_.pop_front();
+
+  reversePoints_.emplace_back();
+  ReversePoint& point = reversePoints_.back();
+  saveState(point.state);
+  point.journalPos = memory_.journalPosition();
+  reverseTime_ = arch_.counter + reverseInterval_;
+}
+
+
+template <typename URV>
+void
+Core<URV>::dropStaleReversePoints()
+{
+  while (not reversePoints_.empty() and
+	 reversePoints_.front().journalPos < memory_.journalStart())
+    reversePoints_.pop_front();
+}
+
+
+template <typename URV>
+void
+Core<URV>::restoreReversePoint(size_t i)
+{
+  const ReversePoint& point = reversePoints_.at(i);
+  memory_.undoJournal(point.journalPos);
+  loadState(point.state);
+  reversePoints_.resize(i + 1);
+  reverseTime_ = arch_.counter + reverseInterval_;
+}
+
+
+template <typename URV>
+void
+Core<URV>::replayTo(uint64_t target, uint64_t* lastStop)
+{
+  // Console output was produced by the original execution. Gdb must
+  // not be entered at an ebreak.
+  FILE* consoleOut = consoleOut_;
+  setConsoleOutput(nullptr);
+  bool gdb = enableGdb_;
+  enableGdb_ = false;
+
+  while (arch_.counter < target and not arch_.targetProgFinished)
+    {
+      if (lastStop and stopPoints_.hasBreakpoints() and
+	  stopPoints_.isBreakpoint(arch_.pc))
+	*lastStop = arch_.counter;
+      stopPoints_.clearWatchHit();
+      singleStep(nullptr);
+      clearTraceData();
+      if (lastStop and stopPoints_.hasWatchHit() and arch_.counter < target)
+	*lastStop = arch_.counter;
+    }
+  stopPoints_.clearWatchHit();
+
+  enableGdb_ = gdb;
+  consoleOut_ = consoleOut;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::reverseTo(uint64_t target)
+{
+  // Most recent state not after the target that can be restored.
+  dropStaleReversePoints();
+  if (reversePoints_.empty())
+    return false;
+
+  size_t ix = reversePoints_.size() - 1;
+  while (ix > 0 and reversePoints_.at(ix).state.arch.counter > target)
+    --ix;
+  bool reached = reversePoints_.at(ix).state.arch.counter <= target;
+
+  restoreReversePoint(ix);
+  if (reached)
+    replayTo(target);
+  return reached;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::reverseStep(uint64_t count)
+{
+  if (not reverseInterval_)
+    return false;
+  uint64_t now = arch_.counter;
+  return reverseTo(count < now ? now - count : 0);
+}
+
+
+template <typename URV>
+bool
+Core<URV>::reverseContinue()
+{
+  if (not reverseInterval_)
+    return false;
+
+  // Replay the intervals between saved states from the most recent
+  // one back looking for the last stop before the current point.
+  uint64_t end = arch_.counter;
+  while (true)
+    {
+      dropStaleReversePoints();
+      if (reversePoints_.empty())
+	return false;
+
+      size_t ix = reversePoints_.size() - 1;
+      while (ix > 0 and reversePoints_.at(ix).state.arch.counter >= end)
+	--ix;
+      uint64_t start = reversePoints_.at(ix).state.arch.counter;
+      if (start >= end)
+	{
+	  restoreReversePoint(ix);  // Oldest state.
+	  return false;
+	}
+
+      uint64_t lastStop = ~uint64_t(0);
+      restoreReversePoint(ix);
+      replayTo(end, &lastStop);
+      if (lastStop != ~uint64_t(0))
+	return reverseTo(lastStop);
+      end = start;
     }
 }
 
@@ -233,6 +560,7 @@ template <typename URV>
 bool
 Core<URV>::loadHexFile(const std::string& file)
 {
+  invalidateDecodeCache();
   return memory_.loadHexFile(file);
 }
 
@@ -243,10 +571,43 @@ Core<URV>::loadElfFile(const std::string& file, size_t& entryPoint,
 		       size_t& exitPoint,
 		       std::unordered_map<std::string, ElfSymbol >& symbols)
 {
+  invalidateDecodeCache();
   return memory_.loadElfFile(file, entryPoint, exitPoint, symbols);
 }
 
 
+template <typename URV>
+bool
+Core<URV>::loadElfFile(const ElfFile& elf, size_t& entryPoint,
+		       size_t& exitPoint)
+{
+  invalidateDecodeCache();
+  return memory_.loadElfFile(elf, entryPoint, exitPoint);
+}
+
+
+template <typename URV>
+void
+Core<URV>::invalidateDecodeCache()
+{
+  for (auto& di : decodeCache_)
+    di = DecodedInst();
+
+  for (auto& block : blockCache_)
+    {
+      block.insts_.clear();
+#ifdef WHISPER_JIT
+      block.jitCode_ = nullptr;
+#endif
+    }
+
+#ifdef WHISPER_JIT
+  if (jit_)
+    jit_->reset();
+#endif
+}
+
+
 template <typename URV>
 bool
 Core<URV>::peekMemory(size_t address, uint8_t& val) const
@@ -342,13 +703,13 @@ template <typename URV>
 void
 Core<URV>::setPendingNmi(NmiCause cause)
 {
-  nmiPending_ = true;
+  arch_.nmiPending = true;
 
-  if (nmiCause_ == NmiCause::STORE_EXCEPTION or
-      nmiCause_ == NmiCause::LOAD_EXCEPTION)
+  if (arch_.nmiCause == NmiCause::STORE_EXCEPTION or
+      arch_.nmiCause == NmiCause::LOAD_EXCEPTION)
     ;  // Load/store exception is sticky -- do not over-write it.
   else
-    nmiCause_ = cause;
+    arch_.nmiCause = cause;
 
   URV val = 0;  // DCSR value
   if (peekCsr(CsrNumber::DCSR, val))
@@ -364,8 +725,8 @@ template <typename URV>
 void
 Core<URV>::clearPendingNmi()
 {
-  nmiPending_ = false;
-  nmiCause_ = NmiCause::UNKNOWN;
+  arch_.nmiPending = false;
+  arch_.nmiCause = NmiCause::UNKNOWN;
 
   URV val = 0;  // DCSR value
   if (peekCsr(CsrNumber::DCSR, val))
@@ -383,6 +744,11 @@ Core<URV>::setToHostAddress(size_t address)
 {
   toHost_ = address;
   toHostValid_ = true;
+
+  // Stores look for the to-host address only in watched pages. The
+  // page stays watched when the address is cleared or changed: A
+  // write to it only costs the exact check.
+  memory_.watchPage(address);
 }
 
 
@@ -403,15 +769,7 @@ Core<URV>::putInStoreQueue(unsigned size, size_t addr, uint64_t data,
   if (maxStoreQueueSize_ == 0 or memory_.isLastWriteToDccm())
     return;
 
-  if (storeQueue_.size() >= maxStoreQueueSize_)
-    {
-      for (size_t i = 1; i < maxStoreQueueSize_; ++i)
-	storeQueue_[i-1] = storeQueue_[i];
-      storeQueue_[maxStoreQueueSize_-1] = StoreInfo(size, addr, data,
-						    prevData);
-    }
-  else
-    storeQueue_.push_back(StoreInfo(size, addr, data, prevData));
+  storeQueue_.push(StoreInfo(size, addr, data, prevData));
 }
 
 
@@ -431,14 +789,13 @@ Core<URV>::putInLoadQueue(unsigned size, size_t addr, unsigned regIx,
       return;
     }
 
-  if (loadQueue_.size() >= maxLoadQueueSize_)
-    {
-      for (size_t i = 1; i < maxLoadQueueSize_; ++i)
-	loadQueue_[i-1] = loadQueue_[i];
-      loadQueue_[maxLoadQueueSize_-1] = LoadInfo(size, addr, regIx, data);
-    }
-  else
-    loadQueue_.push_back(LoadInfo(size, addr, regIx, data));
+  if (loadQueue_.capacity() == 0)
+    return;
+
+  if (loadQueue_.full())
+    loadQueueRegCount_[loadQueue_.front().regIx_]--;
+  loadQueue_.push(LoadInfo(size, addr, regIx, data));
+  loadQueueRegCount_[regIx]++;
 }
 
 
@@ -446,11 +803,27 @@ template <typename URV>
 void
 Core<URV>::invalidateInLoadQueue(unsigned regIx)
 {
+  if (regIx == 0 or loadQueueRegCount_[regIx] == 0)
+    return;
+
   // Replace entry containing target register with x0 so that load exception
   // matching entry will not revert target register.
-  for (unsigned i = 0; i < loadQueue_.size(); ++i)
-    if (loadQueue_[i].regIx_ == regIx)
-      loadQueue_[i].regIx_ = RegX0;
+  for (auto& entry : loadQueue_)
+    if (entry.regIx_ == regIx)
+      entry.regIx_ = RegX0;
+  loadQueueRegCount_[RegX0] += loadQueueRegCount_[regIx];
+  loadQueueRegCount_[regIx] = 0;
+}
+
+
+template <typename URV>
+void
+Core<URV>::recountLoadQueueRegs()
+{
+  for (auto& count : loadQueueRegCount_)
+    count = 0;
+  for (const auto& entry : loadQueue_)
+    loadQueueRegCount_[entry.regIx_]++;
 }
 
 
@@ -458,7 +831,7 @@ template <typename URV>
 void
 Core<URV>::removeFromLoadQueue(unsigned regIx)
 {
-  if (regIx == 0)
+  if (regIx == 0 or loadQueueRegCount_[regIx] == 0)
     return;
 
   // Last (most recent) matching entry is removed. Subsequent entries
@@ -467,7 +840,7 @@ Core<URV>::removeFromLoadQueue(unsigned regIx)
   size_t removeIx = loadQueue_.size();
   for (size_t i = loadQueue_.size(); i > 0; --i)
     {
-      auto& entry = loadQueue_.at(i-1);
+      auto& entry = loadQueue_[i-1];
       if (entry.regIx_ == regIx)
 	{
 	  if (last)
@@ -481,7 +854,8 @@ Core<URV>::removeFromLoadQueue(unsigned regIx)
     }
 
   if (removeIx < loadQueue_.size())
-    loadQueue_.erase(loadQueue_.begin() + removeIx);
+    loadQueue_.erase(removeIx);
+  recountLoadQueueRegs();
 }
 
 
@@ -492,8 +866,8 @@ Core<URV>::execBeq(uint32_t rs1, uint32_t rs2, int32_t offset)
 {
   if (intRegs_.read(rs1) != intRegs_.read(rs2))
     return;
-  pc_ = currPc_ + SRV(offset);
-  pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+  arch_.pc = arch_.currPc + SRV(offset);
+  arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
   lastBranchTaken_ = true;
 }
 
@@ -505,8 +879,8 @@ Core<URV>::execBne(uint32_t rs1, uint32_t rs2, int32_t offset)
 {
   if (intRegs_.read(rs1) == intRegs_.read(rs2))
     return;
-  pc_ = currPc_ + SRV(offset);
-  pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+  arch_.pc = arch_.currPc + SRV(offset);
+  arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
   lastBranchTaken_ = true;
 }
 
@@ -547,7 +921,7 @@ Core<URV>::isIdempotentRegion(size_t addr) const
 {
   unsigned region = addr >> (sizeof(URV)*8 - 4);
   URV mracVal = 0;
-  if (csRegs_.read(CsrNumber::MRAC, PrivilegeMode::Machine, debugMode_,
+  if (csRegs_.read(CsrNumber::MRAC, PrivilegeMode::Machine, arch_.debugMode,
 		   mracVal))
     {
       unsigned bit = (mracVal >> (region*2 + 1)) & 1;
@@ -602,7 +976,7 @@ Core<URV>::applyStoreException(URV addr, unsigned& matches)
   size_t removeIx = storeQueue_.size();
   for (size_t ix = 0; ix < storeQueue_.size(); ++ix)
     {
-      auto& entry = storeQueue_.at(ix);
+      auto& entry = storeQueue_[ix];
 
       size_t entryEnd = entry.addr_ + entry.size_;
       if (hit)
@@ -640,11 +1014,7 @@ Core<URV>::applyStoreException(URV addr, unsigned& matches)
     }
 
   if (removeIx < storeQueue_.size())
-    {
-      for (size_t i = removeIx + 1; i < storeQueue_.size(); ++i)
-	storeQueue_.at(i-1) = storeQueue_.at(i);
-      storeQueue_.resize(storeQueue_.size() - 1);
-    }
+    storeQueue_.erase(removeIx);
 
   return true;
 }
@@ -719,7 +1089,7 @@ Core<URV>::applyLoadException(URV addr, unsigned& matches)
   size_t removeIx = loadQueue_.size();
   for (size_t ix = 0; ix < loadQueue_.size(); ++ix)
     {
-      auto& entry = loadQueue_.at(ix);
+      auto& entry = loadQueue_[ix];
       size_t entryEnd = entry.addr_ + entry.size_;
       bool match = entry.regIx_ and addr >= entry.addr_ and addr < entryEnd;
       if (not match)
@@ -733,7 +1103,7 @@ Core<URV>::applyLoadException(URV addr, unsigned& matches)
       // entries with same target reg.
       for (size_t ix2 = removeIx; ix2 > 0; --ix2)
 	{
-	  auto& entry2 = loadQueue_.at(ix2-1);
+	  auto& entry2 = loadQueue_[ix2-1];
 	  if (entry2.regIx_ == entry.regIx_)
 	    {
 	      prev = entry2.prevData_;
@@ -747,7 +1117,7 @@ Core<URV>::applyLoadException(URV addr, unsigned& matches)
       // Update prev-data of 1st younger item with same target reg.
       for (size_t ix2 = removeIx + 1; ix2 < loadQueue_.size(); ++ix2)
 	{
-	  auto& entry2 = loadQueue_.at(ix2);
+	  auto& entry2 = loadQueue_[ix2];
  	  if (entry2.regIx_ == entry.regIx_)
  	    {
 	      entry2.prevData_ = entry.prevData_;
@@ -759,11 +1129,8 @@ Core<URV>::applyLoadException(URV addr, unsigned& matches)
     }
 
   if (removeIx < loadQueue_.size())
-    {
-      for (size_t i = removeIx + 1; i < loadQueue_.size(); ++i)
-	loadQueue_.at(i-1) = loadQueue_.at(i);
-      loadQueue_.resize(loadQueue_.size() - 1);
-    }
+    loadQueue_.erase(removeIx);
+  recountLoadQueueRegs();
 
   return true;
 }
@@ -814,7 +1181,7 @@ Core<URV>::applyLoadFinished(URV addr, unsigned& matches)
   for (size_t ii = size; ii > 0; --ii)
     {
       size_t i = ii - 1;
-      LoadInfo& entry = loadQueue_.at(i);
+      LoadInfo& entry = loadQueue_[i];
       if (entry.addr_ != addr or entry.regIx_ == 0)
 	continue;
 
@@ -825,7 +1192,7 @@ Core<URV>::applyLoadFinished(URV addr, unsigned& matches)
       URV prev = entry.prevData_;  // Previous value of target reg.
       for (size_t j = 0; j < i; ++j)
 	{
-	  LoadInfo& li = loadQueue_.at(j);
+	  LoadInfo& li = loadQueue_[j];
 	  if (li.regIx_ != targetReg)
 	    continue;
 
@@ -840,9 +1207,9 @@ Core<URV>::applyLoadFinished(URV addr, unsigned& matches)
       // Update prev-data of 1st subsequent entry with same target.
       for (size_t j = i + 1; j < size; ++j)
 	{
-	  if (loadQueue_.at(j).regIx_ == targetReg)
+	  if (loadQueue_[j].regIx_ == targetReg)
 	    {
-	      loadQueue_.at(j).prevData_ = prev;
+	      loadQueue_[j].prevData_ = prev;
 	      break;
 	    }
 	}
@@ -852,78 +1219,53 @@ Core<URV>::applyLoadFinished(URV addr, unsigned& matches)
   size_t newSize = 0;
   for (size_t i = 0; i < size; ++i)
     {
-      if (loadQueue_.at(i).addr_ != addr)
+      if (loadQueue_[i].addr_ != addr)
 	{
 	  if (newSize != i)
-	    loadQueue_.at(newSize) = loadQueue_.at(i);
+	    loadQueue_[newSize] = loadQueue_[i];
 	  newSize++;
 	}
     }
-  loadQueue_.resize(newSize);
+  loadQueue_.truncate(newSize);
+  recountLoadQueueRegs();
 
   return true;
 }
 
 
+/// Print the non-empty bins of the given unsigned value histogram
+/// (InstProfile::histoSize bins, the first 7 used) multiplying counts
+/// by the given scale.
 static
 void
-printUnsignedHisto(const char* tag, const std::vector<uint64_t>& histo,
+printUnsignedHisto(const char* tag, const uint64_t* histo, uint64_t scale,
 		   FILE* file)
 {
-  if (histo.size() < 7)
-    return;
-
-  if (histo.at(0))
-    fprintf(file, "    %s  0          %ld\n", tag, histo.at(0));
-  if (histo.at(1))
-    fprintf(file, "    %s  1          %ld\n", tag, histo.at(1));
-  if (histo.at(2))
-    fprintf(file, "    %s  2          %ld\n", tag, histo.at(2));
-  if (histo.at(3))
-    fprintf(file, "    %s  (2,   16]  %ld\n", tag, histo.at(3));
-  if (histo.at(4))
-    fprintf(file, "    %s  (16,  1k]  %ld\n", tag, histo.at(4));
-  if (histo.at(5))
-    fprintf(file, "    %s  (1k, 64k]  %ld\n", tag, histo.at(5));
-  if (histo.at(6))
-    fprintf(file, "    %s  > 64k      %ld\n", tag, histo.at(6));
+  static const char* bins[] = { " 0         ", " 1         ",
+				" 2         ", " (2,   16] ", " (16,  1k] ",
+				" (1k, 64k] ", " > 64k     " };
+  for (unsigned i = 0; i < 7; ++i)
+    if (histo[i])
+      fprintf(file, "    %s %s %ld\n", tag, bins[i], histo[i]*scale);
 }
 
 
+/// Print the non-empty bins of the given signed value histogram
+/// (InstProfile::histoSize bins) multiplying counts by the given
+/// scale.
 static
 void
-printSignedHisto(const char* tag, const std::vector<uint64_t>& histo,
+printSignedHisto(const char* tag, const uint64_t* histo, uint64_t scale,
 		 FILE* file)
 {
-  if (histo.size() < 13)
-    return;
-
-  if (histo.at(0))
-    fprintf(file, "    %s <= 64k      %ld\n", tag, histo.at(0));
-  if (histo.at(1))
-    fprintf(file, "    %s (-64k, -1k] %ld\n", tag, histo.at(1));
-  if (histo.at(2))
-    fprintf(file, "    %s (-1k,  -16] %ld\n", tag, histo.at(2));
-  if (histo.at(3))
-    fprintf(file, "    %s (-16,   -3] %ld\n", tag, histo.at(3));
-  if (histo.at(4))
-    fprintf(file, "    %s -2          %ld\n", tag, histo.at(4));
-  if (histo.at(5))
-    fprintf(file, "    %s -1          %ld\n", tag, histo.at(5));
-  if (histo.at(6))
-    fprintf(file, "    %s 0           %ld\n", tag, histo.at(6));
-  if (histo.at(7))
-    fprintf(file, "    %s 1           %ld\n", tag, histo.at(7));
-  if (histo.at(8))
-    fprintf(file, "    %s 2           %ld\n", tag, histo.at(8));
-  if (histo.at(9))
-    fprintf(file, "    %s (2,     16] %ld\n", tag, histo.at(9));
-  if (histo.at(10))
-    fprintf(file, "    %s (16,    1k] %ld\n", tag, histo.at(10));
-  if (histo.at(11))	              
-    fprintf(file, "    %s (1k,   64k] %ld\n", tag, histo.at(11));
-  if (histo.at(12))	              
-    fprintf(file, "    %s > 64k       %ld\n", tag, histo.at(12));
+  static const char* bins[] = { "<= 64k     ", "(-64k, -1k]", "(-1k,  -16]",
+				"(-16,   -3]", "-2         ", "-1         ",
+				"0          ", "1          ", "2          ",
+				"(2,     16]", "(16,    1k]", "(1k,   64k]",
+				"> 64k      " };
+  for (unsigned i = 0; i < InstProfile::histoSize; ++i)
+    if (histo[i])
+      fprintf(file, "    %s %s %ld\n", tag, bins[i], histo[i]*scale);
 }
 
 
@@ -932,87 +1274,75 @@ inline
 void
 Core<URV>::reportInstructionFrequency(FILE* file) const
 {
-  struct CompareFreq
-  {
-    CompareFreq(const std::vector<InstProfile>& profileVec)
-      : profileVec(profileVec)
-    { }
-
-    bool operator()(size_t a, size_t b) const
-    { return profileVec.at(a).freq_ < profileVec.at(b).freq_; }
-
-    const std::vector<InstProfile>& profileVec;
+  const InstProfile& prof = instProfile_;
+  uint64_t scale = prof.samplePeriod();
+
+  std::vector<InstId> ids(prof.idCount());
+  for (size_t i = 0; i < ids.size(); ++i)
+    ids.at(i) = InstId(i);
+  std::sort(ids.begin(), ids.end(), [&prof] (InstId a, InstId b) {
+      return prof.freq(a) < prof.freq(b);
+    });
+
+  unsigned regCount = prof.regCount();
+
+  auto printRegUse = [file, regCount, scale] (const char* tag,
+					      const uint64_t* use) {
+    fprintf(file, "  %s", tag);
+    for (unsigned i = 0; i < regCount; ++i)
+      if (use[i])
+	fprintf(file, " %d:%ld", i, use[i]*scale);
+    fprintf(file, "\n");
   };
 
-  std::vector<size_t> indices(instProfileVec_.size());
-  for (size_t i = 0; i < indices.size(); ++i)
-    indices.at(i) = i;
-  std::sort(indices.begin(), indices.end(), CompareFreq(instProfileVec_));
+  auto hasUse = [regCount] (const uint64_t* use) {
+    return std::any_of(use, use + regCount, [] (uint64_t n) { return n; });
+  };
 
-  for (size_t i = 0; i < indices.size(); ++i)
+  for (InstId id : ids)
     {
-      size_t ix = indices.at(i);
-      InstId id = InstId(ix);
-
-      const InstInfo& info = instTable_.getInstInfo(id);
-      const InstProfile& prof = instProfileVec_.at(ix);
-      uint64_t freq = prof.freq_;
+      uint64_t freq = prof.freq(id);
       if (not freq)
 	continue;
 
-      fprintf(file, "%s %ld\n", info.name().c_str(), freq);
+      const InstInfo& info = instTable_.getInstInfo(id);
+      fprintf(file, "%s %ld\n", info.name().c_str(), freq*scale);
 
-      unsigned regCount = intRegCount();
+      if (prof.countOnly())
+	continue;
 
-      uint64_t count = 0;
-      for (auto n : prof.rd_) count += n;
-      if (count)
-	{
-	  fprintf(file, "  +rd");
-	  for (unsigned i = 0; i < regCount; ++i)
-	    if (prof.rd_.at(i))
-	      fprintf(file, " %d:%ld", i, prof.rd_.at(i));
-	  fprintf(file, "\n");
-	}
+      const uint64_t* rd = prof.regUse(id, InstProfile::Rd);
+      if (hasUse(rd))
+	printRegUse("+rd", rd);
 
-      uint64_t count1 = 0;
-      for (auto n : prof.rs1_) count1 += n;
-      if (count1)
+      const uint64_t* rs1 = prof.regUse(id, InstProfile::Rs1);
+      if (hasUse(rs1))
 	{
-	  fprintf(file, "  +rs1");
-	  for (unsigned i = 0; i < regCount; ++i)
-	    if (prof.rs1_.at(i))
-	      fprintf(file, " %d:%ld", i, prof.rs1_.at(i));
-	  fprintf(file, "\n");
-
-	  const auto& histo = prof.rs1Histo_;
+	  printRegUse("+rs1", rs1);
+	  const uint64_t* histo = prof.histo(id, InstProfile::Rs1Histo);
 	  if (info.isUnsigned())
-	    printUnsignedHisto("+hist1", histo, file);
+	    printUnsignedHisto("+hist1", histo, scale, file);
 	  else
-	    printSignedHisto("+hist1", histo, file);
+	    printSignedHisto("+hist1", histo, scale, file);
 	}
 
-      uint64_t count2 = 0;
-      for (auto n : prof.rs2_) count2 += n;
-      if (count2)
+      const uint64_t* rs2 = prof.regUse(id, InstProfile::Rs2);
+      if (hasUse(rs2))
 	{
-	  fprintf(file, "  +rs2");
-	  for (unsigned i = 0; i < regCount; ++i)
-	    if (prof.rs2_.at(i))
-	      fprintf(file, " %d:%ld", i, prof.rs2_.at(i));
-	  fprintf(file, "\n");
-
-	  const auto& histo = prof.rs2Histo_;
+	  printRegUse("+rs2", rs2);
+	  const uint64_t* histo = prof.histo(id, InstProfile::Rs2Histo);
 	  if (info.isUnsigned())
-	    printUnsignedHisto("+hist2", histo, file);
+	    printUnsignedHisto("+hist2", histo, scale, file);
 	  else
-	    printSignedHisto("+hist2", histo, file);
+	    printSignedHisto("+hist2", histo, scale, file);
 	}
 
-      if (prof.hasImm_)
+      int32_t minImm = 0, maxImm = 0;
+      if (prof.immRange(id, minImm, maxImm))
 	{
-	  fprintf(file, "  +imm  min:%d max:%d\n", prof.minImm_, prof.maxImm_);
-	  printSignedHisto("+hist ", prof.immHisto_, file);
+	  fprintf(file, "  +imm  min:%d max:%d\n", minImm, maxImm);
+	  printSignedHisto("+hist ", prof.histo(id, InstProfile::ImmHisto),
+			   scale, file);
 	}
     }
 }
@@ -1075,6 +1405,7 @@ Core<URV>::load(uint32_t rd, uint32_t rs1, int32_t imm)
       // from standard input.
       if (conIoValid_ and addr == conIo_)
 	{
+	  flushConsole();  // Show pending prompt.
 	  int c = fgetc(stdin);
 	  SRV val = c;
 	  intRegs_.write(rd, val);
@@ -1094,13 +1425,16 @@ Core<URV>::load(uint32_t rd, uint32_t rs1, int32_t imm)
 	putInLoadQueue(sizeof(LOAD_TYPE), addr, 0, 0);
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::LOAD_ADDR_MISAL, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ADDR_MISAL, arch_.currPc, addr);
       return;
     }
 
   ULT uval = 0;
   if (not forceAccessFail_ and memory_.read(addr, uval))
     {
+      if (stopPoints_.hasWatchpoints())
+	stopPoints_.checkAccess(addr, sizeof(LOAD_TYPE), false);
+
       URV value;
       if constexpr (std::is_same<ULT, LOAD_TYPE>::value)
         value = uval;
@@ -1123,7 +1457,7 @@ Core<URV>::load(uint32_t rd, uint32_t rs1, int32_t imm)
 	putInLoadQueue(sizeof(LOAD_TYPE), addr, 0, 0);
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::LOAD_ACC_FAULT, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ACC_FAULT, arch_.currPc, addr);
     }
 }
 
@@ -1186,7 +1520,10 @@ template <typename URV>
 bool
 Core<URV>::defineIccm(size_t region, size_t offset, size_t size)
 {
-  bool ok = memory_.defineIccm(region, offset, size);
+  invalidateDecodeCache();
+  bool ok = true;
+  if (ownsMemoryLayout())
+    ok = memory_.defineIccm(region, offset, size);
   if (ok)
     regionHasLocalMem_.at(region) = true;
   return ok;
@@ -1197,7 +1534,10 @@ template <typename URV>
 bool
 Core<URV>::defineDccm(size_t region, size_t offset, size_t size)
 {
-  bool ok = memory_.defineDccm(region, offset, size);
+  invalidateDecodeCache();
+  bool ok = true;
+  if (ownsMemoryLayout())
+    ok = memory_.defineDccm(region, offset, size);
   if (ok)
     regionHasLocalMem_.at(region) = true;
   return ok;
@@ -1209,7 +1549,10 @@ bool
 Core<URV>::defineMemoryMappedRegisterRegion(size_t region, size_t offset,
 					  size_t size)
 {
-  bool ok = memory_.defineMemoryMappedRegisterRegion(region, offset, size);
+  invalidateDecodeCache();
+  bool ok = true;
+  if (ownsMemoryLayout())
+    ok = memory_.defineMemoryMappedRegisterRegion(region, offset, size);
   if (ok)
     regionHasLocalMem_.at(region) = true;
   return ok;
@@ -1224,12 +1567,49 @@ Core<URV>::defineMemoryMappedRegisterWriteMask(size_t region,
 					       size_t registerIx,
 					       uint32_t mask)
 {
+  if (not ownsMemoryLayout())
+    return true;
   return memory_.defineMemoryMappedRegisterWriteMask(region, regionOffset,
 						     registerBlockOffset,
 						     registerIx, mask);
 }
 
 
+template <typename URV>
+bool
+Core<URV>::defineTimer(size_t region, size_t offset, size_t size)
+{
+  if (not defineMemoryMappedRegisterRegion(region, offset, size))
+    return false;
+
+  if ((hartId_ + 1) * Timer::registerBytes > size)
+    {
+      std::cerr << "Timer region of size 0x" << std::hex << size << std::dec
+		<< " too small for hart " << hartId_ << '\n';
+      return false;
+    }
+
+  size_t addr = region * memory_.regionSize() + offset;
+  addr += hartId_ * Timer::registerBytes;
+
+  auto timeFn = [this] () { return arch_.retiredInsts; };
+  auto interruptFn = [this] (bool pending) {
+    URV mip = 0, bit = URV(1) << unsigned(InterruptCause::M_TIMER);
+    csRegs_.peek(CsrNumber::MIP, mip);
+    csRegs_.poke(CsrNumber::MIP, pending ? mip | bit : mip & ~bit);
+  };
+
+  timer_ = std::make_unique<Timer>(addr, deviceBus_, timeFn, interruptFn);
+  if (not deviceBus_.attach(*timer_))
+    {
+      timer_.reset();
+      return false;
+    }
+  timer_->reset();
+  return true;
+}
+
+
 template <typename URV>
 inline
 bool
@@ -1270,6 +1650,60 @@ Core<URV>::fetchInst(size_t addr, uint32_t& inst)
 }
 
 
+template <typename URV>
+inline
+const typename Core<URV>::DecodedInst*
+Core<URV>::fetchDecoded(URV addr, uint32_t& inst)
+{
+  DecodedInst& di = decodeCache_[(addr >> 1) & (decodeCacheSize_ - 1)];
+
+  if (di.pc_ == addr)
+    {
+      // Hit: Entry is good if memory still holds the decoded code.
+      // Read only the bytes of the instruction: a compressed one may
+      // end the memory.
+      const uint8_t* data = memory_.data_ + addr;
+      uint32_t word = (di.size_ == 4 ?
+		       *(reinterpret_cast<const uint32_t*>(data)) :
+		       *(reinterpret_cast<const uint16_t*>(data)));
+      if ((word & di.mask_) == di.inst_)
+	{
+	  inst = di.inst_;
+	  return &di;
+	}
+    }
+
+  if (not fetchInst(addr, inst))
+    return nullptr;
+
+  if (isFullSizeInst(inst))
+    {
+      decode32Exec(inst, di);
+      di.mask_ = ~uint32_t(0);
+      di.size_ = 4;
+    }
+  else
+    {
+      inst = inst & 0xffff;
+      decode16Table(inst, di);
+      di.mask_ = 0xffff;
+      di.size_ = 2;
+    }
+  di.inst_ = inst;
+  di.pc_ = addr;
+
+  // Do not cache instructions that cannot be validated with a word
+  // read (end of memory).
+  if (size_t(addr) + 4 > memory_.size())
+    {
+      di.inst_ = 1;
+      di.mask_ = 0;
+    }
+
+  return &di;
+}
+
+
 template <typename URV>
 bool
 Core<URV>::fetchInstPostTrigger(size_t addr, uint32_t& inst, FILE* traceFile)
@@ -1297,7 +1731,7 @@ Core<URV>::fetchInstPostTrigger(size_t addr, uint32_t& inst, FILE* traceFile)
     }
 
   // Fetch failed: take pending trigger-exception.
-  takeTriggerAction(traceFile, addr, info, counter_, true);
+  takeTriggerAction(traceFile, addr, info, arch_.counter, true);
   return false;
 }
 
@@ -1310,25 +1744,25 @@ Core<URV>::illegalInst()
     return;
 
   // Check if stuck because of lack of illegal instruction exception handler.
-  if (counterAtLastIllegal_ + 1 == retiredInsts_)
-    consecutiveIllegalCount_++;
+  if (arch_.counterAtLastIllegal + 1 == arch_.retiredInsts)
+    arch_.consecutiveIllegalCount++;
   else
-    consecutiveIllegalCount_ = 0;
+    arch_.consecutiveIllegalCount = 0;
 
-  if (consecutiveIllegalCount_ > 64)  // FIX: Make a parameter
+  if (arch_.consecutiveIllegalCount > 64)  // FIX: Make a parameter
     {
       throw CoreException(CoreException::Stop,
 			  "64 consecutive illegal instructions",
 			  0, 0);
     }
 
-  counterAtLastIllegal_ = retiredInsts_;
+  arch_.counterAtLastIllegal = arch_.retiredInsts;
 
   uint32_t currInst;
-  if (not readInst(currPc_, currInst))
+  if (not readInst(arch_.currPc, currInst))
     assert(0 and "Failed to re-read current instruction");
 
-  initiateException(ExceptionCause::ILLEGAL_INST, currPc_, currInst);
+  initiateException(ExceptionCause::ILLEGAL_INST, arch_.currPc, currInst);
 }
 
 
@@ -1347,7 +1781,8 @@ Core<URV>::initiateInterrupt(InterruptCause cause, URV pc)
 {
   bool interrupt = true;
   URV info = 0;  // This goes into mtval.
-  interruptCount_++;
+  arch_.interruptCount++;
+  interruptCauses_[std::min(unsigned(cause), maxTrapCause)]++;
   initiateTrap(interrupt, URV(cause), pc, info);
 
   PerfRegs& pregs = csRegs_.mPerfRegs_;
@@ -1364,7 +1799,8 @@ void
 Core<URV>::initiateException(ExceptionCause cause, URV pc, URV info)
 {
   bool interrupt = false;
-  exceptionCount_++;
+  arch_.exceptionCount++;
+  exceptionCauses_[std::min(unsigned(cause), maxTrapCause)]++;
   initiateTrap(interrupt, URV(cause), pc, info);
 
   PerfRegs& pregs = csRegs_.mPerfRegs_;
@@ -1376,10 +1812,13 @@ template <typename URV>
 void
 Core<URV>::initiateTrap(bool interrupt, URV cause, URV pcToSave, URV info)
 {
-  PrivilegeMode origMode = privMode_;
+  if (plugins_)
+    plugins_->trap(hartId_, pcToSave, cause, interrupt);
+
+  PrivilegeMode origMode = arch_.privMode;
 
   // Exceptions are taken in machine mode.
-  privMode_ = PrivilegeMode::Machine;
+  arch_.privMode = PrivilegeMode::Machine;
   PrivilegeMode nextMode = PrivilegeMode::Machine;
 
   // But they can be delegated. TBD: handle delegation to S/U modes
@@ -1405,26 +1844,35 @@ Core<URV>::initiateTrap(bool interrupt, URV cause, URV pcToSave, URV info)
       tvecNum = CsrNumber::UTVEC;
     }
 
+  typedef typename CsRegs<URV>::HotCsr HotCsr;
+  bool machine = nextMode == PrivilegeMode::Machine;
+
   // Save address of instruction that caused the exception or address
-  // of interrupted instruction.
-  if (not csRegs_.write(epcNum, privMode_, debugMode_, pcToSave & ~(URV(1))))
+  // of interrupted instruction. Machine mode trap CSRs are written
+  // directly (no lookup/access checks): this is on the trap fast path.
+  URV epc = pcToSave & ~(URV(1));
+  if (not (machine ? csRegs_.writeHot(HotCsr::Mepc, epc) :
+	   csRegs_.write(epcNum, arch_.privMode, arch_.debugMode, epc)))
     assert(0 and "Failed to write EPC register");
 
   // Save the exception cause.
   URV causeRegVal = cause;
   if (interrupt)
     causeRegVal |= 1 << (mxlen_ - 1);
-  if (not csRegs_.write(causeNum, privMode_, debugMode_, causeRegVal))
+  if (not (machine ? csRegs_.writeHot(HotCsr::Mcause, causeRegVal) :
+	   csRegs_.write(causeNum, arch_.privMode, arch_.debugMode,
+			 causeRegVal)))
     assert(0 and "Failed to write CAUSE register");
 
   // Clear mtval on interrupts. Save synchronous exception info.
-  if (not csRegs_.write(tvalNum, privMode_, debugMode_, info))
+  if (not (machine ? csRegs_.writeHot(HotCsr::Mtval, info) :
+	   csRegs_.write(tvalNum, arch_.privMode, arch_.debugMode, info)))
     assert(0 and "Failed to write TVAL register");
 
   // Update status register saving xIE in xPIE and previous privilege
   // mode in xPP by getting current value of mstatus ...
   URV status = 0;
-  if (not csRegs_.read(CsrNumber::MSTATUS, privMode_, debugMode_, status))
+  if (not csRegs_.readHot(HotCsr::Mstatus, status))
     assert(0 and "Failed to read MSTATUS register");
 
   // ... updating its fields
@@ -1449,12 +1897,13 @@ Core<URV>::initiateTrap(bool interrupt, URV cause, URV pcToSave, URV info)
     }
 
   // ... and putting it back
-  if (not csRegs_.write(CsrNumber::MSTATUS, privMode_, debugMode_, msf.value_))
+  if (not csRegs_.writeHot(HotCsr::Mstatus, msf.value_))
     assert(0 and "Failed to write MSTATUS register");
   
   // Set program counter to trap handler address.
   URV tvec = 0;
-  if (not csRegs_.read(tvecNum, privMode_, debugMode_, tvec))
+  if (not (machine ? csRegs_.readHot(HotCsr::Mtvec, tvec) :
+	   csRegs_.read(tvecNum, arch_.privMode, arch_.debugMode, tvec)))
     assert(0 and "Failed to read TVEC register");
 
   URV base = (tvec >> 2) << 2;  // Clear least sig 2 bits.
@@ -1463,10 +1912,10 @@ Core<URV>::initiateTrap(bool interrupt, URV cause, URV pcToSave, URV info)
   if (tvecMode == 1 and interrupt)
     base = base + 4*cause;
 
-  pc_ = (base >> 1) << 1;  // Clear least sig bit
+  arch_.pc = (base >> 1) << 1;  // Clear least sig bit
 
   // Change privilege mode.
-  privMode_ = nextMode;
+  arch_.privMode = nextMode;
 }
 
 
@@ -1474,29 +1923,30 @@ template <typename URV>
 void
 Core<URV>::initiateNmi(URV cause, URV pcToSave)
 {
-  PrivilegeMode origMode = privMode_;
+  PrivilegeMode origMode = arch_.privMode;
 
   // NMI is taken in machine mode.
-  privMode_ = PrivilegeMode::Machine;
+  arch_.privMode = PrivilegeMode::Machine;
+
+  typedef typename CsRegs<URV>::HotCsr HotCsr;
 
   // Save address of instruction that caused the exception or address
   // of interrupted instruction.
-  if (not csRegs_.write(CsrNumber::MEPC, privMode_, debugMode_,
-			pcToSave & ~(URV(1))))
+  if (not csRegs_.writeHot(HotCsr::Mepc, pcToSave & ~(URV(1))))
     assert(0 and "Failed to write EPC register");
 
   // Save the exception cause.
-  if (not csRegs_.write(CsrNumber::MCAUSE, privMode_, debugMode_, cause))
+  if (not csRegs_.writeHot(HotCsr::Mcause, cause))
     assert(0 and "Failed to write CAUSE register");
 
   // Clear mtval
-  if (not csRegs_.write(CsrNumber::MTVAL, privMode_, debugMode_, 0))
+  if (not csRegs_.writeHot(HotCsr::Mtval, 0))
     assert(0 and "Failed to write MTVAL register");
 
   // Update status register saving xIE in xPIE and previous privilege
   // mode in xPP by getting current value of mstatus ...
   URV status = 0;
-  if (not csRegs_.read(CsrNumber::MSTATUS, privMode_, debugMode_, status))
+  if (not csRegs_.readHot(HotCsr::Mstatus, status))
     assert(0 and "Failed to read MSTATUS register");
   // ... updating its fields
   MstatusFields<URV> msf(status);
@@ -1506,19 +1956,19 @@ Core<URV>::initiateNmi(URV cause, URV pcToSave)
   msf.bits_.MIE = 0;
 
   // ... and putting it back
-  if (not csRegs_.write(CsrNumber::MSTATUS, privMode_, debugMode_, msf.value_))
+  if (not csRegs_.writeHot(HotCsr::Mstatus, msf.value_))
     assert(0 and "Failed to write MSTATUS register");
   
   // Clear pending nmi bit in dcsr
   URV dcsrVal = 0;
-  if (peekCsr(CsrNumber::DCSR, dcsrVal))
+  if (csRegs_.readHot(HotCsr::Dcsr, dcsrVal))
     {
       dcsrVal &= ~(URV(1) << 3);
       pokeCsr(CsrNumber::DCSR, dcsrVal);
       recordCsrWrite(CsrNumber::DCSR);
     }
 
-  pc_ = (nmiPc_ >> 1) << 1;  // Clear least sig bit
+  arch_.pc = (nmiPc_ >> 1) << 1;  // Clear least sig bit
 }
 
 
@@ -1650,7 +2100,7 @@ Core<URV>::pokeCsr(CsrNumber csr, URV val)
       URV claimIdMask = 0x3fc;
       URV prev = 0;
       if (not csRegs_.read(CsrNumber::MEIHAP, PrivilegeMode::Machine,
-			   debugMode_, prev))
+			   arch_.debugMode, prev))
 	return false;
       URV newVal = (prev & ~claimIdMask) | (val & claimIdMask);
       csRegs_.poke(CsrNumber::MEIHAP, newVal);
@@ -1664,8 +2114,8 @@ Core<URV>::pokeCsr(CsrNumber csr, URV val)
 
   if (csr == CsrNumber::DCSR)
     {
-      dcsrStep_ = (val >> 2) & 1;
-      dcsrStepIe_ = (val >> 11) & 1;
+      arch_.dcsrStep = (val >> 2) & 1;
+      arch_.dcsrStepIe = (val >> 11) & 1;
     }
   else if (csr == CsrNumber::MGPMC)
     {
@@ -1685,7 +2135,7 @@ template <typename URV>
 URV
 Core<URV>::peekPc() const
 {
-  return pc_;
+  return arch_.pc;
 }
 
 
@@ -1693,7 +2143,7 @@ template <typename URV>
 void
 Core<URV>::pokePc(URV address)
 {
-  pc_ = (address >> 1) << 1; // Clear least sig big
+  arch_.pc = (address >> 1) << 1; // Clear least sig big
 }
 
 
@@ -1795,229 +2245,363 @@ Core<URV>::configMachineModePerfCounters(unsigned numCounters)
 
 template <typename URV>
 void
-formatInstTrace(FILE* out, uint64_t tag, unsigned hartId, URV currPc,
-		const char* opcode, char resource, URV addr,
-		URV value, const char* assembly)
+Core<URV>::collectInstTrace(uint32_t inst, uint64_t tag, bool interrupt,
+			    TraceRecord& rec)
 {
-  if constexpr (sizeof(URV) == 4)
-    {
-      if (resource == 'r')
-	fprintf(out, "#%ld %d %08x %8s r %02x         %08x  %s",
-		tag, hartId, currPc, opcode, addr, value, assembly);
+  if ((inst & 0x3) != 3)
+    inst = uint16_t(inst);  // 2-byte instruction: Clear top 16 bits
 
-      else
-	fprintf(out, "#%ld %d %08x %8s %c %08x   %08x  %s", tag, hartId,
-		currPc, opcode, resource, addr, value, assembly);
-    }
-  else
-    fprintf(out, "#%ld %d %016lx %8s %c %016lx %016lx  %s",
-	    tag, hartId, currPc, opcode, resource, addr, value, assembly);
+  rec.tag = tag;
+  rec.hartId = hartId_;
+  rec.pc = arch_.currPc;
+  rec.inst = inst;
+  rec.interrupted = interrupt;
+  rec.hasLoadAddr = traceLoad_ and loadAddrValid_;
+  rec.loadAddr = loadAddr_;
+  rec.changes.clear();
+  collectChanges(rec.changes, false);
+
+  // Memory value is truncated to URV as in the text trace.
+  for (auto& change : rec.changes)
+    if (change.resource == 'm')
+      change.value = URV(change.value);
 }
 
 
 template <typename URV>
 void
-formatFpInstTrace(FILE* out, uint64_t tag, unsigned hartId, URV currPc,
-		  const char* opcode, unsigned fpReg,
-		  uint64_t fpVal, const char* assembly)
+Core<URV>::collectChanges(std::vector<TraceChange>& changes,
+			  bool withDebugCsrs) const
 {
-  if constexpr (sizeof(URV) == 4)
-    fprintf(out, "#%ld %d %08x %8s f %02x %016lx  %s",
-	    tag, hartId, currPc, opcode, fpReg, fpVal, assembly);
+  // Process integer register diff.
+  int reg = intRegs_.getLastWrittenReg();
+  if (reg > 0)
+    changes.push_back({'r', uint64_t(reg), intRegs_.read(reg)});
 
-  else
-    fprintf(out, "#%ld %d %016lx %8s f %016lx %016lx  %s",
-	    tag, hartId, currPc, opcode, uint64_t(fpReg), fpVal, assembly);
-}
+  // Process floating point register diff.
+  int fpReg = fpRegs_.getLastWrittenReg();
+  if (fpReg >= 0)
+    changes.push_back({'f', uint64_t(fpReg), fpRegs_.readBits(fpReg)});
 
+  // Process CSR diffs. Trigger components (TDATA1 to TDATA3) are
+  // reported per modified trigger below.
+  size_t csrBegin = changes.size();
+  bool tdataChanged[3] = { false, false, false };
+  bool debug = arch_.debugMode or withDebugCsrs;
 
-template <typename URV>
-void
-Core<URV>::printInstTrace(uint32_t inst, uint64_t tag, std::string& tmp,
+  for (CsrNumber csr : csRegs_.lastWrittenRegs())
+    {
+      URV value = 0;
+      if (not csRegs_.read(csr, PrivilegeMode::Machine, debug, value))
+	continue;
+
+      if (csr >= CsrNumber::TDATA1 and csr <= CsrNumber::TDATA3)
+	tdataChanged[size_t(csr) - size_t(CsrNumber::TDATA1)] = true;
+      else
+	changes.push_back({'c', uint64_t(csr), value});
+    }
+
+  // Process trigger register diffs.
+  if (tdataChanged[0] or tdataChanged[1] or tdataChanged[2])
+    for (unsigned trigger = 0; trigger < csRegs_.triggerCount(); ++trigger)
+      {
+	URV data[3] = { 0, 0, 0 };
+	if (not csRegs_.isTriggerModified(trigger) or
+	    not peekTrigger(trigger, data[0], data[1], data[2]))
+	  continue;
+	for (unsigned i = 0; i < 3; ++i)
+	  if (tdataChanged[i])
+	    {
+	      URV ecsr = (URV(trigger) << 16) | (URV(CsrNumber::TDATA1) + i);
+	      changes.push_back({'c', uint64_t(ecsr), data[i]});
+	    }
+      }
+
+  // CSR changes are reported in CSR number order. Numbers are unique.
+  std::sort(changes.begin() + csrBegin, changes.end(),
+	    [] (const TraceChange& a, const TraceChange& b) {
+	      return a.addr < b.addr; });
+
+  // Process memory diff.
+  size_t address = 0;
+  uint64_t memValue = 0;
+  unsigned writeSize = memory_.getLastWriteNewValue(address, memValue);
+  if (writeSize > 0)
+    changes.push_back({'m', address, memValue, writeSize});
+}
+
+
+template <typename URV>
+void
+Core<URV>::printInstTrace(uint32_t inst, uint64_t tag, std::string& tmp,
 			  FILE* out, bool interrupt)
 {
-  disassembleInst(inst, tmp);
-  if (interrupt)
-    tmp += " (interrupted)";
+  collectInstTrace(inst, tag, interrupt, traceRecord_);
 
-  if (traceLoad_ and loadAddrValid_)
+  if (binaryTrace_)
     {
-      std::ostringstream oss;
-      oss << "0x" << std::hex << loadAddr_;
-      tmp += " [" + oss.str() + "]";
+      binaryTrace_->write(traceRecord_);
+      return;
     }
 
-  char instBuff[128];
-  if ((inst & 0x3) == 3)
-    sprintf(instBuff, "%08x", inst);
-  else
+  disassembleInst(URV(traceRecord_.pc), inst, tmp);
+  if (interrupt)
+    tmp += " (interrupted)";
+
+  if (traceRecord_.hasLoadAddr)
     {
-      // 2-byte instruction: Clear top 16 bits
-      uint16_t low = inst;
-      inst = low;
-      sprintf(instBuff, "%04x", inst);
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), " [0x%lx]", uint64_t(loadAddr_));
+      tmp += buffer;
     }
 
-  bool pending = false;  // True if a printed line need to be terminated.
-
-  // Process integer register diff.
-  int reg = intRegs_.getLastWrittenReg();
-  URV value = 0;
-  if (reg > 0)
+  if (traceSymbols_)
     {
-      value = intRegs_.read(reg);
-      formatInstTrace<URV>(out, tag, hartId_, currPc_, instBuff, 'r', reg,
-			   value, tmp.c_str());
-      pending = true;
+      std::string location = traceSymbols_->location(traceRecord_.pc);
+      if (not location.empty())
+	tmp += " <" + location + ">";
     }
 
-  // Process floating point register diff.
-  int fpReg = fpRegs_.getLastWrittenReg();
-  if (fpReg >= 0)
+  if (asyncTrace_)
     {
-      uint64_t val = fpRegs_.readBits(fpReg);
-      if (pending) fprintf(out, "  +\n");
-      formatFpInstTrace<URV>(out, tag, hartId_, currPc_, instBuff, fpReg,
-			     val, tmp.c_str());
-      pending = true;
+      printTraceRecord<URV>(asyncTrace_->buffer(), traceRecord_, tmp.c_str());
+      asyncTrace_->checkFull();
     }
+  else
+    printTraceRecord<URV>(out, traceRecord_, tmp.c_str());
+}
 
-  // Process CSR diffs.
-  std::vector<CsrNumber> csrs;
-  std::vector<unsigned> triggers;
-  csRegs_.getLastWrittenRegs(csrs, triggers);
 
-  std::vector<bool> tdataChanged(3);
+template <typename URV>
+void
+Core<URV>::undoForTrigger()
+{
+  unsigned regIx = 0;
+  URV value = 0;
+  if (intRegs_.getLastWrittenReg(regIx, value))
+    pokeIntReg(regIx, value);
 
-  std::map<URV, URV> csrMap; // Map csr-number to its value.
+  intRegs_.clearLastWrittenReg();
 
-  for (CsrNumber csr : csrs)
-    {
-      if (not csRegs_.read(csr, PrivilegeMode::Machine, debugMode_, value))
-	continue;
+  arch_.pc = arch_.currPc;
+}
 
-      if (csr >= CsrNumber::TDATA1 and csr <= CsrNumber::TDATA3)
-	{
-	  size_t ix = size_t(csr) - size_t(CsrNumber::TDATA1);
-	  tdataChanged.at(ix) = true;
-	  continue; // Debug triggers printed separately below
-	}
-      csrMap[URV(csr)] = value;
-    }
 
-  // Process trigger register diffs.
-  for (unsigned trigger : triggers)
+/// Count the given value in the given signed histogram
+/// (InstProfile::histoSize bins).
+static
+void
+addToSignedHistogram(uint64_t* histo, int64_t val)
+{
+  if (val < 0)
     {
-      URV data1(0), data2(0), data3(0);
-      if (not peekTrigger(trigger, data1, data2, data3))
-	continue;
-      if (tdataChanged.at(0))
-	{
-	  URV ecsr = (trigger << 16) | URV(CsrNumber::TDATA1);
-	  csrMap[ecsr] = data1;
-	}
-      if (tdataChanged.at(1))
-	{
-	  URV ecsr = (trigger << 16) | URV(CsrNumber::TDATA2);
-	  csrMap[ecsr] = data2;
-	}
-      if (tdataChanged.at(2))
-	{
-	  URV ecsr = (trigger << 16) | URV(CsrNumber::TDATA3);
-	  csrMap[ecsr] = data3;
-	}
+      if      (val <= -64*1024) histo[0]++;
+      else if (val <= -1024)    histo[1]++;
+      else if (val <= -16)      histo[2]++;
+      else if (val < -2)        histo[3]++;
+      else if (val == -2)       histo[4]++;
+      else if (val == -1)       histo[5]++;
     }
-
-  for (const auto& [key, val] : csrMap)
+  else
     {
-      if (pending) fprintf(out, "  +\n");
-      formatInstTrace<URV>(out, tag, hartId_, currPc_, instBuff, 'c',
-			   key, val, tmp.c_str());
-      pending = true;
+      if      (val == 0)       histo[6]++;
+      else if (val == 1)       histo[7]++;
+      else if (val == 2)       histo[8]++;
+      else if (val <= 16)      histo[9]++;
+      else if (val <= 1024)    histo[10]++;
+      else if (val <= 64*1024) histo[11]++;
+      else                     histo[12]++;
     }
+}
 
-  // Process memory diff.
-  size_t address = 0;
-  uint64_t memValue = 0;
-  unsigned writeSize = memory_.getLastWriteNewValue(address, memValue);
-  if (writeSize > 0)
+
+/// Count the given value in the given unsigned histogram (first 7
+/// bins of InstProfile::histoSize).
+static
+void
+addToUnsignedHistogram(uint64_t* histo, uint64_t val)
+{
+  if      (val == 0)       histo[0]++;
+  else if (val == 1)       histo[1]++;
+  else if (val == 2)       histo[2]++;
+  else if (val <= 16)      histo[3]++;
+  else if (val <= 1024)    histo[4]++;
+  else if (val <= 64*1024) histo[5]++;
+  else                     histo[6]++;
+}
+
+
+template <typename URV>
+TimingModel::Kind
+Core<URV>::timingKind(const InstInfo& info)
+{
+  using Kind = TimingModel::Kind;
+
+  switch (info.type())
     {
-      if (pending)
-	fprintf(out, "  +\n");
+    case InstType::Load:     return Kind::Load;
+    case InstType::Store:    return Kind::Store;
+    case InstType::Multiply: return Kind::Multiply;
+    case InstType::Divide:   return Kind::Divide;
+
+    case InstType::Branch:
+      {
+	// Direct jumps are always predicted.
+	InstId id = info.instId();
+	if (id == InstId::jalr or id == InstId::c_jr or id == InstId::c_jalr)
+	  return Kind::IndirectJump;
+	if (id == InstId::jal or id == InstId::c_j or id == InstId::c_jal)
+	  return Kind::Other;
+	return Kind::Branch;
+      }
 
-      formatInstTrace<URV>(out, tag, hartId_, currPc_, instBuff, 'm',
-			   address, memValue, tmp.c_str());
-      pending = true;
+    default:
+      return Kind::Other;
     }
+}
 
-  if (pending) 
-    fprintf(out, "\n");
-  else
+
+template <typename URV>
+void
+Core<URV>::timeInstruction(uint32_t inst)
+{
+  TimingModel::Inst ti;
+  ti.pc = arch_.currPc;
+  ti.size = instructionSize(inst);
+  ti.kind = timingKind(decodeForCounters(inst));
+  ti.iccm = memory_.getAttrib(arch_.currPc).isIccm();
+  timeInstruction(ti);
+
+  if (enableCounters_ and countersCsrOn_)
     {
-      // No diffs: Generate an x0 record.
-      formatInstTrace<URV>(out, tag, hartId_, currPc_, instBuff, 'r', 0, 0,
-			  tmp.c_str());
-      fprintf(out, "\n");
+      PerfRegs& pregs = csRegs_.mPerfRegs_;
+      if (timing_->icacheLookedUp())
+	pregs.updateCounters(timing_->icacheMissed() ? EventNumber::ICacheMisses :
+			     EventNumber::ICacheHits);
+      if (timing_->branchMissed())
+	pregs.updateCounters(EventNumber::BranchMiss);
     }
 }
 
 
 template <typename URV>
+inline
 void
-Core<URV>::undoForTrigger()
+Core<URV>::timeInstruction(TimingModel::Inst& ti)
 {
-  unsigned regIx = 0;
-  URV value = 0;
-  if (intRegs_.getLastWrittenReg(regIx, value))
-    pokeIntReg(regIx, value);
+  using Kind = TimingModel::Kind;
 
-  intRegs_.clearLastWrittenReg();
+  ti.nextPc = arch_.pc;
+  if (ti.kind == Kind::Load)
+    {
+      ti.dataAddr = loadAddr_;
+      ti.dccm = memory_.getAttrib(loadAddr_).isDccm();
+    }
+  else if (ti.kind == Kind::Store)
+    {
+      ti.dataAddr = memory_.lastWriteAddr_;
+      ti.dccm = memory_.lastWriteIsDccm_;
+    }
 
-  pc_ = currPc_;
+  arch_.cycleCount += timing_->retire(ti);
 }
 
 
+template <typename URV>
 void
-addToSignedHistogram(std::vector<uint64_t>& histo, int64_t val)
+Core<URV>::traceAddresses(uint32_t inst)
 {
-  if (histo.size() < 13)
-    histo.resize(13);
+  uint64_t count = arch_.retiredInsts - 1;
+  addrTrace_->record(count, arch_.currPc, WhisperAddrFetch, arch_.currPc,
+		     instructionSize(inst));
 
-  if (val < 0)
+  unsigned type = 0, size = 0;
+  uint64_t addr = 0;
+  if (lastDataAccess(inst, type, addr, size))
+    addrTrace_->record(count, arch_.currPc, type, addr, size);
+}
+
+
+template <typename URV>
+bool
+Core<URV>::lastDataAccess(uint32_t inst, unsigned& type, uint64_t& address,
+			  unsigned& size) const
+{
+  if (not AddressTrace::dataAccess(inst, sizeof(URV) == 8, type, size))
+    return false;
+
+  address = loadAddr_;
+  if (type == WhisperAddrStore)
     {
-      if      (val <= -64*1024) histo.at(0)++;
-      else if (val <= -1024)    histo.at(1)++;
-      else if (val <= -16)      histo.at(2)++;
-      else if (val < -2)        histo.at(3)++;
-      else if (val == -2)       histo.at(4)++;
-      else if (val == -1)       histo.at(5)++;
+      // A failed store-conditional (non-zero rd) does not write.
+      unsigned rd = (inst >> 7) & 0x1f;
+      if ((inst & 0x7f) == 0x2f and rd != 0 and intRegs_.read(rd) != 0)
+	return false;
+      address = memory_.lastWriteAddr_;
     }
-  else
+  return true;
+}
+
+
+template <typename URV>
+void
+Core<URV>::notifyPlugins(uint32_t inst)
+{
+  if (plugins_->hasRetire())
+    plugins_->retire(hartId_, arch_.retiredInsts - 1, arch_.currPc, inst);
+
+  unsigned type = 0, size = 0;
+  uint64_t addr = 0;
+  if (plugins_->hasMemAccess() and lastDataAccess(inst, type, addr, size))
+    plugins_->memAccess(hartId_, arch_.currPc, addr, size, type);
+}
+
+
+template <typename URV>
+void
+Core<URV>::publishMetrics()
+{
+  // Without metrics, the retired count may still reach the update
+  // time when the program writes minstret.
+  if (not metrics_)
     {
-      if      (val == 0)       histo.at(6)++;
-      else if (val == 1)       histo.at(7)++;
-      else if (val == 2)       histo.at(8)++;
-      else if (val <= 16)      histo.at(9)++;
-      else if (val <= 1024)    histo.at(10)++;
-      else if (val <= 64*1024) histo.at(11)++;
-      else                     histo.at(12)++;
+      metricsTime_ = ~uint64_t(0);
+      return;
     }
+  metrics_->publish(arch_.retiredInsts, arch_.cycleCount, arch_.pc,
+		    arch_.exceptionCount, arch_.interruptCount);
+  metricsTime_ = arch_.retiredInsts + HartMetrics::period;
 }
 
 
-void
-addToUnsignedHistogram(std::vector<uint64_t>& histo, uint64_t val)
+template <typename URV>
+uint64_t
+Core<URV>::serviceEvents(uint64_t maxCount)
 {
-  if (histo.size() < 13)
-    histo.resize(13);
+  uint64_t now = arch_.retiredInsts;
+  if (now >= deviceBus_.nextEventTime())
+    deviceBus_.dispatch(now);
+  if (now >= metricsTime_)
+    publishMetrics();
+
+  // Both are timed in retired instructions which advance at most by
+  // one per executed instruction.
+  uint64_t count = std::min(maxCount, eventPeriod_);
 
-  if      (val == 0)       histo.at(0)++;
-  else if (val == 1)       histo.at(1)++;
-  else if (val == 2)       histo.at(2)++;
-  else if (val <= 16)      histo.at(3)++;
-  else if (val <= 1024)    histo.at(4)++;
-  else if (val <= 64*1024) histo.at(5)++;
-  else                     histo.at(6)++;
+  // Interrupts raised by devices: Taken here since the run loops do
+  // not look at interrupts. One pending but not enabled is looked at
+  // again at the next instruction.
+  if (not deviceBus_.empty())
+    {
+      InterruptCause cause;
+      if (isInterruptPossible(cause))
+	initiateInterrupt(cause, arch_.pc);
+      URV mip = 0;
+      if (csRegs_.peek(CsrNumber::MIP, mip) and mip != 0)
+	count = std::min(count, uint64_t(1));
+    }
+  count = std::min(count, deviceBus_.nextEventTime() - now);
+  return std::min(count, metricsTime_ - now);
 }
 
 
@@ -2025,8 +2609,13 @@ template <typename URV>
 void
 Core<URV>::accumulateInstructionStats(uint32_t inst)
 {
+  // Only a sampled instruction of an operand profile needs the full
+  // decode: Otherwise the instruction class is enough.
+  bool profileOperands = (instFreq_ and not instProfile_.countOnly() and
+			  instProfile_.sample());
   uint32_t op0 = 0, op1 = 0; int32_t op2 = 0;
-  const InstInfo& info = decode(inst, op0, op1, op2);
+  const InstInfo& info = (profileOperands ? decode(inst, op0, op1, op2) :
+			  decodeForCounters(inst));
   InstId id = info.instId();
 
   if (enableCounters_ and prevCountersCsrOn_)
@@ -2039,7 +2628,7 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
       else
 	pregs.updateCounters(EventNumber::Inst32Commited);
 
-      if ((currPc_ & 3) == 0)
+      if ((arch_.currPc & 3) == 0)
 	pregs.updateCounters(EventNumber::InstAligned);
 
       if (info.type() == InstType::Int)
@@ -2075,46 +2664,31 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
 	}
       else if (info.isCsr() and not csrException_)
 	{
+	  // Operands rd (bits 7-11) and rs1/uimm (bits 15-19).
+	  unsigned rd = (inst >> 7) & 0x1f, rs1 = (inst >> 15) & 0x1f;
 	  if ((id == InstId::csrrw or id == InstId::csrrwi))
 	    {
-	      if (op0 == 0)
+	      if (rd == 0)
 		pregs.updateCounters(EventNumber::CsrWrite);
 	      else
 		pregs.updateCounters(EventNumber::CsrReadWrite);
 	    }
 	  else
 	    {
-	      if (op1 == 0)
+	      if (rs1 == 0)
 		pregs.updateCounters(EventNumber::CsrRead);
 	      else
 		pregs.updateCounters(EventNumber::CsrReadWrite);
 	    }
 
-	  // Counter modified by csr instruction is not updated.
-	  std::vector<CsrNumber> csrs;
-	  std::vector<unsigned> triggers;
-	  csRegs_.getLastWrittenRegs(csrs, triggers);
-	  for (auto& csr : csrs)
-	    if (pregs.isModified(unsigned(csr) - unsigned(CsrNumber::MHPMCOUNTER3)))
-	      {
-		URV val;
-		peekCsr(csr, val);
-		pokeCsr(csr, val - 1);
-	      }
+	  // Counter modified by csr instruction is not updated: Drop
+	  // the events of this instruction (the write synced the
+	  // counter).
+	  for (auto csr : csRegs_.lastWrittenRegs())
+	    if (csr >= CsrNumber::MHPMCOUNTER3 and csr <= CsrNumber::MHPMCOUNTER31)
+	      pregs.discardEvents(unsigned(csr) - unsigned(CsrNumber::MHPMCOUNTER3));
 	    else if (csr >= CsrNumber::MHPMEVENT3 and csr <= CsrNumber::MHPMEVENT31)
-	      {
-		unsigned id = unsigned(csr) - unsigned(CsrNumber::MHPMEVENT3);
-		if (pregs.isModified(id))
-		  {
-		    URV val;
-		    CsrNumber csr2 = CsrNumber(id + unsigned(CsrNumber::MHPMCOUNTER3));
-		    if (pregs.isModified(unsigned(csr2) - unsigned(CsrNumber::MHPMCOUNTER3)))
-		      {
-			peekCsr(csr2, val);
-			pokeCsr(csr2, val - 1);
-		      }
-		  }
-	      }
+	      pregs.discardEvents(unsigned(csr) - unsigned(CsrNumber::MHPMEVENT3));
 	}
       else if (info.isBranch())
 	{
@@ -2122,8 +2696,6 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
 	  if (lastBranchTaken_)
 	    pregs.updateCounters(EventNumber::BranchTaken);
 	}
-
-      pregs.clearModified();
     }
 
   prevCountersCsrOn_ = countersCsrOn_;
@@ -2134,9 +2706,17 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
   if (not instFreq_)
     return;
 
-  InstProfile& entry = instProfileVec_.at(size_t(id));
+  if (instProfile_.countOnly())
+    {
+      instProfile_.count(id);
+      return;
+    }
+
+  if (not profileOperands)
+    return;
 
-  entry.freq_++;
+  InstProfile& prof = instProfile_;
+  prof.count(id);
 
   bool hasRd = false;
 
@@ -2147,11 +2727,11 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
     {
       hasRd = info.isIthOperandWrite(0);
       if (hasRd)
-	entry.rd_.at(op0)++;
+	prof.regUse(id, InstProfile::Rd)[op0]++;
       else
 	{
 	  rs1 = op0;
-	  entry.rs1_.at(rs1)++;
+	  prof.regUse(id, InstProfile::Rs1)[rs1]++;
 	  hasRs1 = true;
 	}
     }
@@ -2164,13 +2744,13 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
       if (hasRd)
 	{
 	  rs1 = op1;
-	  entry.rs1_.at(rs1)++;
+	  prof.regUse(id, InstProfile::Rs1)[rs1]++;
 	  hasRs1 = true;
 	}
       else
 	{
 	  rs2 = op1;
-	  entry.rs2_.at(rs2)++;
+	  prof.regUse(id, InstProfile::Rs2)[rs2]++;
 	  hasRs2 = true;
 	}
     }
@@ -2185,7 +2765,7 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
       if (hasRd)
 	{
 	  rs2 = op2;
-	  entry.rs2_.at(rs2)++;
+	  prof.regUse(id, InstProfile::Rs2)[rs2]++;
 	  hasRs2 = true;
 	}
       else
@@ -2199,18 +2779,8 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
 
   if (hasImm)
     {
-      entry.hasImm_ = true;
-
-      if (entry.freq_ == 1)
-	{
-	  entry.minImm_ = entry.maxImm_ = imm;
-	}
-      else
-	{
-	  entry.minImm_ = std::min(entry.minImm_, imm);
-	  entry.maxImm_ = std::max(entry.maxImm_, imm);
-	}
-      addToSignedHistogram(entry.immHisto_, imm);
+      prof.addImm(id, imm);
+      addToSignedHistogram(prof.histo(id, InstProfile::ImmHisto), imm);
     }
 
   unsigned rd = intRegCount() + 1;
@@ -2222,10 +2792,11 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
       URV val1 = intRegs_.read(rs1);
       if (rs1 == rd)
 	val1 = rdOrigVal;
+      uint64_t* histo = prof.histo(id, InstProfile::Rs1Histo);
       if (info.isUnsigned())
-	addToUnsignedHistogram(entry.rs1Histo_, val1);
+	addToUnsignedHistogram(histo, val1);
       else
-	addToSignedHistogram(entry.rs1Histo_, SRV(val1));
+	addToSignedHistogram(histo, SRV(val1));
     }
 
   if (hasRs2)
@@ -2233,10 +2804,11 @@ Core<URV>::accumulateInstructionStats(uint32_t inst)
       URV val2 = intRegs_.read(rs2);
       if (rs2 == rd)
 	val2 = rdOrigVal;
+      uint64_t* histo = prof.histo(id, InstProfile::Rs2Histo);
       if (info.isUnsigned())
-	addToUnsignedHistogram(entry.rs2Histo_, val2);
+	addToUnsignedHistogram(histo, val2);
       else
-	addToSignedHistogram(entry.rs2Histo_, SRV(val2));
+	addToSignedHistogram(histo, SRV(val2));
     }
 }
 
@@ -2258,11 +2830,11 @@ inline
 void
 Core<URV>::setTargetProgramBreak(URV addr)
 {
-  progBreak_ = addr;
+  arch_.progBreak = addr;
 
   size_t pageAddr = memory_.getPageStartAddr(addr);
   if (pageAddr != addr)
-    progBreak_ = pageAddr + memory_.pageSize();
+    arch_.progBreak = pageAddr + memory_.pageSize();
 }
 
 
@@ -2328,7 +2900,7 @@ template <typename URV>
 URV
 Core<URV>::lastPc() const
 {
-  return currPc_;
+  return arch_.currPc;
 }
 
 
@@ -2400,6 +2972,7 @@ Core<URV>::takeTriggerAction(FILE* traceFile, URV pc, URV info,
   // exception or enter debugger.
 
   bool enteredDebug = false;
+  triggerTrips_++;
 
   if (csRegs_.hasEnterDebugModeTripped())
     {
@@ -2409,14 +2982,14 @@ Core<URV>::takeTriggerAction(FILE* traceFile, URV pc, URV info,
   else
     {
       initiateException(ExceptionCause::BREAKP, pc, info);
-      if (dcsrStep_)
-	enterDebugMode(DebugModeCause::STEP, pc_);  // WRONG to match RTL, should be TRIGGER instad of STEP.
+      if (arch_.dcsrStep)
+	enterDebugMode(DebugModeCause::STEP, arch_.pc);  // WRONG to match RTL, should be TRIGGER instad of STEP.
     }
 
   if (beforeTiming and traceFile)
     {
       uint32_t inst = 0;
-      readInst(currPc_, inst);
+      readInst(arch_.currPc, inst);
 
       std::string instStr;
       printInstTrace(inst, counter, instStr, traceFile);
@@ -2426,17 +2999,6 @@ Core<URV>::takeTriggerAction(FILE* traceFile, URV pc, URV info,
 }
 
 
-// This is set to false when user hits control-c to interrupt a long
-// run.
-volatile static bool userOk = true;
-
-static
-void keyboardInterruptHandler(int)
-{
-  userOk = false;
-}
-
-
 
 template <typename URV>
 bool
@@ -2448,24 +3010,71 @@ Core<URV>::untilAddress(URV address, FILE* traceFile)
   // Need csr history when tracing or for triggers
   bool trace = traceFile != nullptr or enableTriggers_;
   clearTraceData();
+  deviceBus_.enter();
 
-  uint64_t counter = counter_;
+  // A reference: gdb requests served within the loop may step or
+  // reverse the hart.
+  uint64_t& counter = arch_.counter;
   uint64_t limit = instCountLim_;
   bool success = true;
   bool doStats = instFreq_ or enableCounters_;
 
-  if (enableGdb_)
+  // Report the initial stop to gdb unless resuming a run that gdb
+  // moved here from simpleRun.
+  if (enableGdb_ and not leaveSimpleRun_)
     handleExceptionForGdb(*this);
+  leaveSimpleRun_ = false;
 
   uint32_t inst = 0;
 
-  while (pc_ != address and counter < limit and userOk)
+  // A breakpoint at the PC where execution resumes does not stop it.
+  bool resumed = true;
+  stopPoints_.clearWatchHit();
+
+  eventTime_ = 0;
+  while (arch_.pc != address)
     {
       inst = 0;
 
+      // Instruction limit, stop token, device events, live
+      // metrics and reverse execution: Looked at only when the
+      // earliest of them may be due (see eventTime_).
+      if (counter >= eventTime_)
+	{
+	  if (counter >= limit or stopToken_->requested())
+	    break;
+	  if (counter >= reverseTime_)
+	    saveReversePoint();
+	  uint64_t count = serviceEvents(limit - counter);
+	  eventTime_ = counter + std::min(count, reverseTime_ - counter);
+	}
+
+      // Trace windows: Let runWindowed switch engines when the next
+      // instruction enters or leaves them.
+      if (windowed_ and inTraceWindow() != (traceFile != nullptr))
+	{
+	  windowExit_ = true;
+	  break;
+	}
+
+      if (stopPoints_.hasBreakpoints() and not resumed and
+	  stopPoints_.isBreakpoint(arch_.pc))
+	{
+	  if (not enableGdb_)
+	    {
+	      std::cerr << "Stopped -- Reached breakpoint 0x" << std::hex
+			<< arch_.pc << std::dec << '\n';
+	      break;
+	    }
+	  handleExceptionForGdb(*this);
+	  resumed = true;
+	  continue;
+	}
+      resumed = false;
+
       try
 	{
-	  currPc_ = pc_;
+	  arch_.currPc = arch_.pc;
 
 	  loadAddrValid_ = false;
 	  triggerTripped_ = false;
@@ -2476,19 +3085,21 @@ Core<URV>::untilAddress(URV address, FILE* traceFile)
 
 	  // Process pre-execute address trigger and fetch instruction.
 	  bool hasTrig = hasActiveInstTrigger();
-	  if (hasTrig and instAddrTriggerHit(currPc_, TriggerTiming::Before,
+	  if (hasTrig and instAddrTriggerHit(arch_.currPc,
+					     TriggerTiming::Before,
 					     isInterruptEnabled()))
 	    triggerTripped_ = true;
 
 	  // Fetch instruction.
+	  const DecodedInst* di = nullptr;
 	  bool fetchOk = true;
 	  if (triggerTripped_)
-	    fetchOk = fetchInstPostTrigger(pc_, inst, traceFile);
+	    fetchOk = fetchInstPostTrigger(arch_.pc, inst, traceFile);
 	  else
-	    fetchOk = fetchInst(pc_, inst);
+	    fetchOk = (di = fetchDecoded(arch_.pc, inst)) != nullptr;
 	  if (not fetchOk)
 	    {
-	      cycleCount_++;
+	      arch_.cycleCount++;
 	      continue;  // Next instruction in trap handler.
 	    }
 
@@ -2498,20 +3109,22 @@ Core<URV>::untilAddress(URV address, FILE* traceFile)
 	    triggerTripped_ = true;
 
 	  // Increment pc and execute instruction
-	  if (isFullSizeInst(inst))
+	  if (di)
+	    executeDecoded(*di);
+	  else if (isFullSizeInst(inst))
 	    {
 	      // 4-byte instruction
-	      pc_ += 4;
+	      arch_.pc += 4;
 	      execute32(inst);
 	    }
 	  else
 	    {
 	      // Compressed (2-byte) instruction.
-	      pc_ += 2;
+	      arch_.pc += 2;
 	      execute16(inst);
 	    }
 
-	  cycleCount_++;
+	  arch_.cycleCount++;
 
 	  if (ldStException_)
 	    {
@@ -2526,15 +3139,28 @@ Core<URV>::untilAddress(URV address, FILE* traceFile)
 	  if (triggerTripped_)
 	    {
 	      undoForTrigger();
-	      if (takeTriggerAction(traceFile, currPc_, currPc_,
+	      if (takeTriggerAction(traceFile, arch_.currPc, arch_.currPc,
 				    counter, true))
 		return true;
 	      continue;
 	    }
 
-	  ++retiredInsts_;
+	  ++arch_.retiredInsts;
 	  if (doStats)
 	    accumulateInstructionStats(inst);
+	  if (pcProfiler_)
+	    pcProfiler_->record(arch_.currPc, inst);
+	  if (coverage_)
+	    coverage_->record(arch_.currPc, inst, arch_.pc);
+	  if (timing_)
+	    timeInstruction(inst);
+	  if (addrTrace_)
+	    traceAddresses(inst);
+	  if (bbv_)
+	    bbv_->recordInst(arch_.currPc, isCompressedInst(inst) ? 2 : 4,
+			   arch_.retiredInsts);
+	  if (plugins_)
+	    notifyPlugins(inst);
 
 	  bool icountHit = (enableTriggers_ and isInterruptEnabled() and
 			    icountTriggerHit());
@@ -2546,8 +3172,26 @@ Core<URV>::untilAddress(URV address, FILE* traceFile)
 	      clearTraceData();
 	    }
 
+	  if (stopPoints_.hasWatchHit())
+	    {
+	      if (not enableGdb_)
+		{
+		  StopPoints::Watch watch;
+		  uint64_t watchAddr = 0;
+		  stopPoints_.watchHit(watch, watchAddr);
+		  stopPoints_.clearWatchHit();
+		  std::cerr << "Stopped -- Watchpoint hit by access to 0x"
+			    << std::hex << watchAddr << " at pc 0x"
+			    << arch_.currPc << std::dec << '\n';
+		  break;
+		}
+	      handleExceptionForGdb(*this);
+	      stopPoints_.clearWatchHit();
+	    }
+
 	  if (icountHit)
-	    if (takeTriggerAction(traceFile, pc_, pc_, counter, false))
+	    if (takeTriggerAction(traceFile, arch_.pc, arch_.pc, counter,
+				  false))
 	      return true;
 	}
       catch (const CoreException& ce)
@@ -2557,29 +3201,33 @@ Core<URV>::untilAddress(URV address, FILE* traceFile)
 	      if (trace)
 		{
 		  uint32_t inst = 0;
-		  readInst(currPc_, inst);
+		  readInst(arch_.currPc, inst);
 		  if (traceFile)
 		    printInstTrace(inst, counter, instStr, traceFile);
 		  clearTraceData();
 		}
 	      success = ce.value() == 1; // Anything besides 1 is a fail.
-	      std::cerr << (success? "Successful " : "Error: Failed ")
-			<< "stop: " << std::dec << ce.what() << "\n";
+	      if (stopMessages_)
+		std::cerr << (success? "Successful " : "Error: Failed ")
+			  << "stop: " << std::dec << ce.what() << "\n";
 	      setTargetProgramFinished(true);
 	      break;
 	    }
 	  if (ce.type() == CoreException::Exit)
 	    {
-	      std::cerr << "Target program exited with code " << ce.value() << '\n';
+	      if (stopMessages_)
+		std::cerr << "Target program exited with code " << ce.value()
+			  << '\n';
 	      setTargetProgramFinished(true);
 	      break;
 	    }
-	  std::cerr << "Stopped -- unexpected exception\n";
+	  if (stopMessages_)
+	    std::cerr << "Stopped -- unexpected exception\n";
 	}
     }
 
-  // Update retired-instruction and cycle count registers.
-  counter_ = counter;
+  if (metrics_)
+    publishMetrics();
 
   return success;
 }
@@ -2593,160 +3241,1361 @@ Core<URV>::runUntilAddress(URV address, FILE* traceFile)
   gettimeofday(&t0, nullptr);
 
   uint64_t limit = instCountLim_;
-  uint64_t counter0 = counter_;
+  uint64_t counter0 = arch_.counter;
+
+  std::feclearexcept(FE_ALL_EXCEPT);  // Drop flags raised by host code.
+  leaveSimpleRun_ = false;
+  bool success = untilAddress(address, traceFile);
+  restoreHostRoundingMode();
+
+  if (arch_.counter == limit)
+    std::cerr << "Stopped -- Reached instruction limit\n";
+  else if (arch_.pc == address)
+    std::cerr << "Stopped -- Reached end address\n";
+
+  // Simulator stats.
+  struct timeval t1;
+  gettimeofday(&t1, nullptr);
+  double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
+
+  uint64_t numInsts = arch_.counter - counter0;
+  accountRun(RunMode::Until, numInsts, elapsed);
+
+  flushConsole();
+  std::cout.flush();
+  if (stopToken_->requested())
+    std::cerr << "Stopped -- Interrupted\n";
+  std::cerr << "Retired " << numInsts << " instruction"
+	    << (numInsts > 1? "s" : "") << " in "
+	    << (boost::format("%.2fs") % elapsed);
+  if (elapsed > 0)
+    std::cerr << "  " << size_t(numInsts/elapsed) << " inst/s";
+  std::cerr << '\n';
+
+  return success;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::endsBlock(const DecodedInst& di) const
+{
+  ExecFn fn = di.fn_;
+
+  if (fn == &Core::execBeq or fn == &Core::execBne or fn == &Core::execBlt or
+      fn == &Core::execBge or fn == &Core::execBltu or
+      fn == &Core::execBgeu or fn == &Core::execJal or
+      fn == &Core::execJalr or fn == &Core::execEbreak or
+      fn == &Core::execIllegal)
+    return true;
+
+  if (fn == &Core::execUndecoded32)
+    {
+      unsigned opcode = (di.inst_ & 0x7f) >> 2;
+      return opcode == 3 or opcode == 28;  // Fence or system/CSR.
+    }
+
+  return false;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::buildBlock(URV addr, DecodedBlock& block)
+{
+  block.pc_ = addr;
+  block.accel_ = LibcRoutine::None;
+  if (not accelRoutines_.empty())
+    {
+      auto iter = accelRoutines_.find(addr);
+      if (iter != accelRoutines_.end())
+	block.accel_ = iter->second;
+    }
+  block.insts_.clear();
+  block.ids_.clear();
+  block.timingInsts_.clear();
+  if (bbv_)
+    block.bbvId_ = bbv_->blockId(addr);
+  block.idleSafe_ = idleSkip_;
+#ifdef WHISPER_JIT
+  block.execCount_ = 0;
+  block.jitCode_ = nullptr;
+#endif
+
+  uint32_t inst = 0;
+  if (not fetchInst(addr, inst))
+    return false;
+
+  URV pc = addr;
+  while (true)
+    {
+      DecodedInst di;
+      if (isFullSizeInst(inst))
+	{
+	  decode32Exec(inst, di);
+	  di.mask_ = ~uint32_t(0);
+	  di.size_ = 4;
+	}
+      else
+	{
+	  inst = inst & 0xffff;
+	  decode16Table(inst, di);
+	  di.mask_ = 0xffff;
+	  di.size_ = 2;
+	}
+      di.inst_ = inst;
+      di.pc_ = pc;
+      block.insts_.push_back(di);
+      if (instFreq_ and instProfile_.countOnly())
+	block.ids_.push_back(decodeForCounters(inst).instId());
+      if (block.idleSafe_)
+	block.idleSafe_ = isIdleSafe(decodeForCounters(inst).instId());
+      if (timing_)
+	{
+	  TimingModel::Inst ti;
+	  ti.pc = pc;
+	  ti.size = di.size_;
+	  ti.kind = timingKind(decodeForCounters(inst));
+	  ti.iccm = memory_.getAttrib(pc).isIccm();
+	  ti.newLine = (block.insts_.size() == 1 or
+			not timing_->continuesLine(pc, di.size_));
+	  block.timingInsts_.push_back(ti);
+	}
+
+      if (endsBlock(di) or block.insts_.size() >= maxBlockSize_)
+	break;
+
+      // Look ahead without side effects: Stop the block at the first
+      // instruction that would fail to fetch and at the start of a pc
+      // trace window (entered blocks are checked by simpleRun).
+      pc += di.size_;
+      if (not traceWindows_.pcs.empty() and startsTraceWindow(pc))
+	break;
+      if (memory_.readInstWord(pc, inst))
+	continue;
+      uint16_t half = 0;
+      if (not memory_.readInstHalfWord(pc, half) or
+	  not isCompressedInst(half))
+	break;
+      inst = half;
+    }
+
+  return true;
+}
 
-  struct sigaction oldAction;
-  struct sigaction newAction;
-  memset(&newAction, 0, sizeof(newAction));
-  newAction.sa_handler = keyboardInterruptHandler;
 
-  userOk = true;
-  sigaction(SIGINT, &newAction, &oldAction);
+template <typename URV>
+inline
+typename Core<URV>::BlockStep
+Core<URV>::executeBlockInst(const DecodedInst& di)
+{
+  // Check for self-modifying code.
+  const uint8_t* data = memory_.data_ + arch_.pc;
+  unsigned size = di.size_;
+  if (size == 4)
+    {
+      if (*(reinterpret_cast<const uint32_t*>(data)) != di.inst_)
+	return BlockStep::Modified;
+    }
+  else if (*(reinterpret_cast<const uint16_t*>(data)) != di.inst_)
+    return BlockStep::Modified;
+
+  arch_.currPc = arch_.pc;
+  ++arch_.cycleCount;
+  ldStException_ = false;
+
+  executeDecoded(di);
+
+  if (not ldStException_)
+    ++arch_.retiredInsts;
+
+  if (arch_.pc != arch_.currPc + size)
+    return BlockStep::Leave;  // Branch, jump or exception.
+  return BlockStep::Next;
+}
+
+
+template <typename URV>
+inline
+void
+Core<URV>::executeBlock(DecodedBlock& block)
+{
+  for (const auto& di : block.insts_)
+    {
+      BlockStep step = executeBlockInst(di);
+      if (step == BlockStep::Next)
+	continue;
+      if (step == BlockStep::Modified)
+	block.insts_.clear();
+      return;
+    }
+}
+
+
+template <typename URV>
+void
+Core<URV>::executeProfiledBlock(DecodedBlock& block, bool countInsts)
+{
+  Coverage* coverage = coverage_;
+  TimingModel* timing = timing_;
+  uint64_t blockStart = arch_.retiredInsts;
+
+  for (size_t i = 0; i < block.insts_.size(); ++i)
+    {
+      const DecodedInst& di = block.insts_[i];
+      uint64_t retired = arch_.retiredInsts;
+      BlockStep step = executeBlockInst(di);
+      if (arch_.retiredInsts != retired)
+	{
+	  if (countInsts)
+	    instProfile_.count(block.ids_[i]);
+	  if (coverage)
+	    coverage->record(di.pc_, di.inst_, arch_.pc);
+	  if (timing)
+	    timeInstruction(block.timingInsts_[i]);
+	  if (addrTrace_)
+	    traceAddresses(di.inst_);
+	  if (plugins_)
+	    notifyPlugins(di.inst_);
+	}
+      if (step == BlockStep::Next)
+	continue;
+      if (step == BlockStep::Modified)
+	block.insts_.clear();
+      break;
+    }
+
+  if (bbv_ and arch_.retiredInsts != blockStart)
+    bbv_->record(block.bbvId_, arch_.retiredInsts - blockStart,
+		 arch_.retiredInsts);
+}
+
+
+template <typename URV>
+template <bool RETIRE, bool MEM>
+void
+Core<URV>::executePluginBlock(DecodedBlock& block)
+{
+  PluginSet& plugins = *plugins_;
+
+  for (const auto& di : block.insts_)
+    {
+      uint64_t retired = arch_.retiredInsts;
+      BlockStep step = executeBlockInst(di);
+      if (arch_.retiredInsts != retired)
+	{
+	  if constexpr (RETIRE)
+	    plugins.retire(hartId_, retired, di.pc_, di.inst_);
+	  if constexpr (MEM)
+	    {
+	      unsigned type = 0, size = 0;
+	      uint64_t addr = 0;
+	      if (lastDataAccess(di.inst_, type, addr, size))
+		plugins.memAccess(hartId_, di.pc_, addr, size, type);
+	    }
+	}
+      if (step == BlockStep::Next)
+	continue;
+      if (step == BlockStep::Modified)
+	block.insts_.clear();
+      return;
+    }
+}
+
+
+template <typename URV>
+bool
+Core<URV>::isIdleSafe(InstId id)
+{
+  switch (id)
+    {
+    case InstId::sb: case InstId::sh: case InstId::sw: case InstId::sd:
+    case InstId::fencei: case InstId::ecall: case InstId::ebreak:
+    case InstId::mret: case InstId::uret: case InstId::sret:
+    case InstId::c_fld: case InstId::c_lq: case InstId::c_flw:
+    case InstId::c_fsd: case InstId::c_sq: case InstId::c_sw:
+    case InstId::c_fsw: case InstId::c_sd: case InstId::c_fldsp:
+    case InstId::c_flwsp: case InstId::c_ebreak: case InstId::c_fsdsp:
+    case InstId::c_swsp: case InstId::c_fswsp:
+      return false;
+    default:
+      break;
+    }
+
+  // Exclude the CSR, atomic and floating point instructions (the
+  // enumeration groups them).
+  if (id >= InstId::csrrw and id <= InstId::csrrci)
+    return false;
+  if (id >= InstId::lr_w and id <= InstId::fmv_d_x)
+    return false;
+  return id != InstId::illegal;
+}
+
+
+template <typename URV>
+inline
+bool
+Core<URV>::skipIdleLoop(const DecodedBlock& block, uint64_t limit)
+{
+  IdleLoop& loop = idleLoop_;
+  URV lastBlock = loop.lastBlock;
+  loop.lastBlock = arch_.pc;
+
+  if (not block.idleSafe_)
+    {
+      loop.valid = false;
+      return true;
+    }
+
+  if (loop.valid and arch_.pc == loop.head)
+    {
+      if (loop.countdown > 1)
+	{
+	  --loop.countdown;
+	  return true;
+	}
+      return checkIdleLoop(limit);
+    }
+
+  // A new loop head is the target of a backward transfer.
+  if (arch_.pc <= lastBlock)
+    {
+      loop.valid = true;
+      loop.head = arch_.pc;
+      loop.backoff = 1;
+      loop.countdown = 1;
+      return checkIdleLoop(limit);
+    }
+  return true;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::checkIdleLoop(uint64_t limit)
+{
+  IdleLoop& loop = idleLoop_;
+  uint64_t traps = arch_.exceptionCount + arch_.interruptCount;
+
+  if (loop.countdown)
+    {
+      // Snapshot: Check at the next visit of head.
+      loop.countdown = 0;
+      loop.retired = arch_.retiredInsts;
+      loop.cycles = arch_.cycleCount;
+      loop.traps = traps;
+      loop.regs.assign(arch_.intRegs, arch_.intRegs + intRegs_.size());
+      return true;
+    }
+
+  if (arch_.retiredInsts == loop.retired)
+    return true;  // Back at head after a skip.
+
+  if (traps != loop.traps or
+      not std::equal(loop.regs.begin(), loop.regs.end(), arch_.intRegs) or
+      deviceBus_.hasReadSideEffects())
+    {
+      loop.backoff = std::min(loop.backoff * 2, 1024u);
+      loop.countdown = loop.backoff;
+      return true;
+    }
+
+  // The last iteration changed nothing: The next ones are identical
+  // until a device event or another hart changes memory.
+  uint64_t iterInsts = arch_.retiredInsts - loop.retired;
+  uint64_t iterCycles = arch_.cycleCount - loop.cycles;
+  uint64_t end = std::min(limit, deviceBus_.nextEventTime());
+  if (end == ~uint64_t(0))
+    return false;
+
+  end = std::min(end, metricsTime_);
+  uint64_t count = (end > arch_.retiredInsts ?
+		    (end - arch_.retiredInsts) / iterInsts : 0);
+  arch_.retiredInsts += count * iterInsts;
+  arch_.cycleCount += count * iterCycles;
+  idleSkipped_ += count * iterInsts;
+  loop.retired = arch_.retiredInsts;
+  loop.cycles = arch_.cycleCount;
+  return true;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::accelerateRoutine(const std::string& name, URV address)
+{
+  static const std::unordered_map<std::string, LibcRoutine> routines = {
+    { "memcpy", LibcRoutine::Memcpy }, { "memset", LibcRoutine::Memset },
+    { "strlen", LibcRoutine::Strlen }, { "memcmp", LibcRoutine::Memcmp }
+  };
+
+  auto iter = routines.find(name);
+  if (iter == routines.end())
+    return false;
+
+  accelRoutines_[address] = iter->second;
+  invalidateDecodeCache();  // Blocks record their routine when built.
+  return true;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::isPlainRange(uint64_t addr, uint64_t size, bool write) const
+{
+  if (addr > memory_.size() or size > memory_.size() - addr)
+    return false;
+
+  uint64_t end = addr + size;
+  for (uint64_t page = memory_.getPageStartAddr(addr); page < end;
+       page += memory_.pageSize())
+    {
+      PageAttribs attrib = memory_.getAttrib(page);
+      if (not (write ? attrib.isPlainWrite() : attrib.isPlainRead()))
+	return false;
+    }
+  return true;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::executeAccelerated(LibcRoutine routine)
+{
+  // The stores of the routine are needed to cancel the reservations
+  // of other harts and to check watchpoints.
+  if (memory_.isShared() or stopPoints_.hasWatchpoints())
+    return false;
+
+  URV a0 = intRegs_.read(RegA0), a1 = intRegs_.read(RegA1);
+  URV a2 = intRegs_.read(RegA2);
+  uint8_t* data = memory_.data_;
+  URV result = a0;
+
+  // Instructions of a word-at-a-time implementation: Loop overhead
+  // plus, per 4 bytes, 5 for memcpy (load, store, 3 updates), 3 for
+  // memset and 8 for memcmp, and 12 per 4 characters for strlen.
+  uint64_t count = 16;
+
+  switch (routine)
+    {
+    case LibcRoutine::Memcpy:
+      if (not isPlainRange(a1, a2, false) or not isPlainRange(a0, a2, true))
+	return false;
+      memory_.markModified(a0, a2);
+      memmove(data + a0, data + a1, a2);
+      count += 5*uint64_t(a2)/4;
+      break;
+
+    case LibcRoutine::Memset:
+      if (not isPlainRange(a0, a2, true))
+	return false;
+      memory_.markModified(a0, a2);
+      memset(data + a0, int(a1 & 0xff), a2);
+      count += 3*uint64_t(a2)/4;
+      break;
+
+    case LibcRoutine::Strlen:
+      {
+	// Scan a page at a time: The string may end before a page that
+	// is not plain.
+	uint64_t addr = a0;
+	const void* nul = nullptr;
+	while (not nul)
+	  {
+	    if (not isPlainRange(addr, 1, false))
+	      return false;
+	    uint64_t next = memory_.getPageStartAddr(addr) + memory_.pageSize();
+	    next = std::min(next, uint64_t(memory_.size()));
+	    nul = memchr(data + addr, 0, next - addr);
+	    addr = next;
+	  }
+	result = static_cast<const uint8_t*>(nul) - (data + a0);
+	count += 3*uint64_t(result);
+      }
+      break;
+
+    case LibcRoutine::Memcmp:
+      if (not isPlainRange(a0, a2, false) or not isPlainRange(a1, a2, false))
+	return false;
+      result = 0;
+      if (memcmp(data + a0, data + a1, a2) != 0)
+	{
+	  auto diff = std::mismatch(data + a0, data + a0 + a2, data + a1);
+	  result = SRV(int(*diff.first) - int(*diff.second));
+	}
+      count += 2*uint64_t(a2);
+      break;
+
+    default:
+      return false;
+    }
+
+  if (arch_.hasLr and (routine == LibcRoutine::Memcpy or
+		       routine == LibcRoutine::Memset) and
+      arch_.lrAddr >= a0 and arch_.lrAddr - a0 < a2)
+    arch_.hasLr = false;
+
+  intRegs_.write(RegA0, result);
+  arch_.pc = intRegs_.read(RegRa) & ~URV(1);
+  arch_.retiredInsts += count;
+  arch_.cycleCount += count;
+  accelCalls_++;
+  return true;
+}
+
+
+#ifdef WHISPER_JIT
+
+template <typename URV>
+bool
+Core<URV>::executeJitBlock(DecodedBlock& block)
+{
+  if constexpr (sizeof(URV) == 4)
+    {
+      if (not block.jitCode_)
+	{
+	  if (++block.execCount_ < jitThreshold_)
+	    return false;
+
+	  block.jitCode_ = jit_->compile(*this, block);
+	  if (not block.jitCode_)
+	    {
+	      // Code buffer is full: Start over.
+	      for (auto& blk : blockCache_)
+		blk.jitCode_ = nullptr;
+	      jit_->reset();
+	      block.jitCode_ = jit_->compile(*this, block);
+	      if (not block.jitCode_)
+		return false;
+	    }
+	}
+
+      int status = block.jitCode_(this);
+      if (status == Jit::Modified)
+	{
+	  block.insts_.clear();
+	  block.jitCode_ = nullptr;
+	}
+      else if (status == Jit::Exception)
+	std::rethrow_exception(jitException_);
+      return true;
+    }
+
+  return false;
+}
+
+
+template <typename URV>
+int
+Core<URV>::jitStep(Core<URV>* core, const DecodedInst* di)
+{
+  try
+    {
+      BlockStep step = core->executeBlockInst(*di);
+      if (step == BlockStep::Next)
+	return Jit::Continue;
+      return step == BlockStep::Modified ? Jit::Modified : Jit::Leave;
+    }
+  catch (...)
+    {
+      // Exceptions cannot propagate through compiled code.
+      core->jitException_ = std::current_exception();
+      return Jit::Exception;
+    }
+}
+
+
+template <typename URV>
+InstId
+Core<URV>::jitInlineId(const DecodedInst& di) const
+{
+  static const std::pair<ExecFn, InstId> table[] = {
+    { &Core::execLui, InstId::lui }, { &Core::execAuipc, InstId::auipc },
+    { &Core::execAddi, InstId::addi }, { &Core::execSlti, InstId::slti },
+    { &Core::execSltiu, InstId::sltiu }, { &Core::execXori, InstId::xori },
+    { &Core::execOri, InstId::ori }, { &Core::execAndi, InstId::andi },
+    { &Core::execSlli, InstId::slli }, { &Core::execSrli, InstId::srli },
+    { &Core::execSrai, InstId::srai }, { &Core::execAdd, InstId::add },
+    { &Core::execSub, InstId::sub }, { &Core::execSll, InstId::sll },
+    { &Core::execSlt, InstId::slt }, { &Core::execSltu, InstId::sltu },
+    { &Core::execXor, InstId::xor_ }, { &Core::execSrl, InstId::srl },
+    { &Core::execSra, InstId::sra }, { &Core::execOr, InstId::or_ },
+    { &Core::execAnd, InstId::and_ }
+  };
+
+  for (const auto& entry : table)
+    if (entry.first == di.fn_)
+      {
+	// Shifts with an out of bound amount are illegal in rv32.
+	bool shift = (entry.second == InstId::slli or
+		      entry.second == InstId::srli or
+		      entry.second == InstId::srai);
+	if (shift and (di.op2_ < 0 or di.op2_ > 31))
+	  return InstId::illegal;
+	return entry.second;
+      }
+
+  return InstId::illegal;
+}
+
+#endif
+
+
+template <typename URV>
+bool
+Core<URV>::simpleRun(uint64_t retiredLimit, bool& stopped)
+{
+  bool success = true;
+  stopped = false;
+  deviceBus_.enter();
+
+  // Nothing consumes per-instruction CSR changes in this loop: Skip
+  // recording them (trap entry/return and CSR instructions) and fold
+  // the host floating point flags into FCSR only when needed.
+  csRegs_.enableWriteRecording(false);
+  std::feclearexcept(FE_ALL_EXCEPT);
+  lazyFpFlags_ = true;
+
+  // Instruction frequency count mode, coverage, timing model, address
+  // trace and basic block vectors: Record in this loop.
+  bool countInsts = instFreq_ and instProfile_.countOnly();
+  bool profileBlocks = (countInsts or coverage_ or timing_ or addrTrace_ or
+			bbv_);
+
+  // Idle loops are only detected in the plain block loop.
+  bool idleSkip = idleSkip_ and not profileBlocks and not plugins_;
+  idleLoop_.valid = false;
+
+  // Library routines are executed on the host unless the blocks are
+  // profiled or observed by plugins or the run has trace windows.
+  bool accelerate = (not accelRoutines_.empty() and not profileBlocks and
+		     not plugins_ and not windowed_);
+
+  // Trace windows: Leave at the first block in them (see runWindowed).
+  bool windowed = windowed_;
+  windowExit_ = false;
+  uint64_t retired0 = arch_.retiredInsts;
+
+  // Plugin retire/memory hooks without the above: Use the block loop
+  // specialized for the hooks in use.
+  void (Core::*pluginBlock)(DecodedBlock&) = nullptr;
+  if (plugins_ and not profileBlocks)
+    {
+      bool retire = plugins_->hasRetire(), mem = plugins_->hasMemAccess();
+      if (retire and mem)
+	pluginBlock = &Core::executePluginBlock<true, true>;
+      else if (retire)
+	pluginBlock = &Core::executePluginBlock<true, false>;
+      else if (mem)
+	pluginBlock = &Core::executePluginBlock<false, true>;
+    }
+
+  try
+    {
+      eventTime_ = 0;
+      while (true)
+	{
+	  // Stop conditions and events: Looked at only when the earliest
+	  // of them may be due (see eventTime_).
+	  if (arch_.retiredInsts >= eventTime_)
+	    {
+	      uint64_t now = arch_.retiredInsts;
+	      if (stopToken_->requested() or leaveSimpleRun_ or now >= retiredLimit)
+		break;
+	      eventTime_ = now + serviceEvents(retiredLimit - now);
+	    }
+
+	  // Execute basic blocks chained by successor pc.
+	  size_t blockIx = (arch_.pc >> 1) & (blockCacheSize_ - 1);
+	  DecodedBlock& block = blockCache_[blockIx];
+	  if (block.pc_ != arch_.pc or block.insts_.empty())
+	    {
+	      arch_.currPc = arch_.pc;
+	      if (not buildBlock(arch_.pc, block))
+		{
+		  ++arch_.cycleCount;
+		  continue; // Next instruction in trap handler.
+		}
+	    }
+
+	  if (windowed and inTraceWindow())
+	    {
+	      windowExit_ = true;
+	      break;
+	    }
+
+	  if (accelerate and block.accel_ != LibcRoutine::None and
+	      executeAccelerated(block.accel_))
+	    continue;
+
+	  if (idleSkip)
+	    {
+	      uint64_t retired = arch_.retiredInsts;
+	      if (not skipIdleLoop(block, retiredLimit))
+		{
+		  std::cerr << "Stopped -- Idle loop at pc 0x" << std::hex
+			    << arch_.pc << std::dec
+			    << " with no pending event\n";
+		  success = false;
+		  stopped = true;
+		  break;
+		}
+	      if (arch_.retiredInsts != retired)
+		continue;  // Check events and limit at the new time.
+	    }
+
+#ifdef WHISPER_JIT
+	  if (jit_ and not profileBlocks and not pluginBlock and
+	      executeJitBlock(block))
+	    continue;
+#endif
+
+	  if (profileBlocks)
+	    executeProfiledBlock(block, countInsts);
+	  else if (pluginBlock)
+	    (this->*pluginBlock)(block);
+	  else
+	    executeBlock(block);
+	}
+    }
+  catch (const CoreException& ce)
+    {
+      if (ce.type() == CoreException::Stop)
+	{
+	  success = ce.value() == 1; // Anything besides 1 is a fail.
+	  std::cerr << (success? "Successful " : "Error: Failed ")
+		    << "stop: " << std::dec << ce.what() << '\n';
+	  setTargetProgramFinished(true);
+	}
+      else if (ce.type() == CoreException::Exit)
+	{
+	  std::cerr << "Target program exited with code " << ce.value() << '\n';
+	  success = ce.value() == 0;
+	  setTargetProgramFinished(true);
+	}
+      else
+	{
+	  success = false;
+	  std::cerr << "Stopped -- unexpected exception\n";
+	}
+      stopped = true;
+    }
+
+  if (metrics_)
+    publishMetrics();
+
+  // This loop does not count executed instructions: Advance the
+  // count (see getInstructionCount) by the retired ones.
+  if (arch_.retiredInsts > retired0)
+    arch_.counter += arch_.retiredInsts - retired0;
+
+  foldHostFpFlags();
+  lazyFpFlags_ = false;
+  restoreHostRoundingMode();
+  csRegs_.enableWriteRecording(true);
+  return success;
+}
+
+
+/// Run indefinitely.  If the tohost address is defined, then run till
+/// a write is attempted to that address.
+template <typename URV>
+bool
+Core<URV>::run(FILE* file)
+{
+  if (file and not traceWindows_.empty())
+    return runWindowed(file);
+
+  // If test has toHost defined then use that as the stopping criteria
+  // and ignore the stop address. Not having to check for the stop
+  // address gives us about an 10 percent boost in speed.
+  if (stopAddrValid_ and not toHostValid_)
+    return runUntilAddress(stopAddr_, file);
+
+  // To run fast, this method does not do much besides straight-forward
+  // execution. If any option is turned on, we switch to
+  // runUntilAdress which runs slower but is full-featured.
+  if (file or instCountLim_ < ~uint64_t(0) or
+      (instFreq_ and not instProfile_.countOnly()) or enableTriggers_ or
+      enableCounters_ or pcProfiler_ or reverseInterval_ or
+      stopPoints_.hasBreakpoints() or stopPoints_.hasWatchpoints())
+    {
+      URV address = ~URV(0);  // Invalid stop PC.
+      return runUntilAddress(address, file);
+    }
+
+  struct timeval t0;
+  gettimeofday(&t0, nullptr);
+
+  // In gdb mode, continue runs here until gdb regains control at an
+  // ebreak. Once gdb inserts a breakpoint or a watchpoint, the run
+  // proceeds in untilAddress which checks them.
+  leaveSimpleRun_ = false;
+  if (enableGdb_)
+    {
+      handleExceptionForGdb(*this);
+      leaveSimpleRun_ = (stopPoints_.hasBreakpoints() or
+			 stopPoints_.hasWatchpoints());
+    }
+
+  // The run starts in the fast loop and may continue in the
+  // per-instruction loop: Each part is accounted to its mode.
+  auto seconds = [] (const struct timeval& a, const struct timeval& b) {
+    return (b.tv_sec - a.tv_sec) + (b.tv_usec - a.tv_usec)*1e-6;
+  };
+  uint64_t counter0 = arch_.counter;
+  struct timeval tm = t0;
+
+  bool success = true;
+  if (not leaveSimpleRun_)
+    {
+      success = simpleRun();
+      gettimeofday(&tm, nullptr);
+      accountRun(RunMode::Fast, arch_.counter - counter0, seconds(t0, tm));
+    }
+  uint64_t counterM = arch_.counter;
+  bool until = leaveSimpleRun_ and not stopToken_->requested();
+  if (until)
+    {
+      std::feclearexcept(FE_ALL_EXCEPT);
+      success = untilAddress(~URV(0), nullptr);
+      restoreHostRoundingMode();
+    }
+
+  // Simulator stats.
+  struct timeval t1;
+  gettimeofday(&t1, nullptr);
+  double elapsed = seconds(t0, t1);
+  if (until)
+    accountRun(RunMode::Until, arch_.counter - counterM, seconds(tm, t1));
+
+  flushConsole();
+  std::cout.flush();
+  if (stopToken_->requested())
+    std::cerr << "Stopped -- Interrupted\n";
+  std::cerr << "Retired " << arch_.retiredInsts << " instruction"
+	    << (arch_.retiredInsts > 1? "s" : "") << " in "
+	    << (boost::format("%.2fs") % elapsed);
+  if (elapsed > 0)
+    std::cerr << "  " << size_t(arch_.retiredInsts/elapsed) << " inst/s";
+  std::cerr << '\n';
+  if (idleSkipped_)
+    std::cerr << "Skipped " << idleSkipped_ << " instructions in idle loops\n";
+  if (accelCalls_)
+    std::cerr << "Executed " << accelCalls_ << " library calls on the host\n";
+
+  return success;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::runWindowed(FILE* file)
+{
+  struct timeval t0;
+  gettimeofday(&t0, nullptr);
+
+  // Outside the windows, use the fast loop unless an option requires
+  // the simulation of each instruction (see run).
+  bool stopAtAddr = stopAddrValid_ and not toHostValid_;
+  URV address = stopAtAddr ? stopAddr_ : ~URV(0);
+  bool fast = not (stopAtAddr or (instFreq_ and not instProfile_.countOnly()) or
+		   enableTriggers_ or enableCounters_ or pcProfiler_ or
+		   reverseInterval_ or enableGdb_ or
+		   stopPoints_.hasBreakpoints() or stopPoints_.hasWatchpoints());
+
+  uint64_t limit = instCountLim_;
+  uint64_t counter0 = arch_.counter;
+  uint64_t windows = 0;
+  bool success = true;
+  leaveSimpleRun_ = false;
+  windowed_ = true;
+
+  while (not stopToken_->requested() and not arch_.targetProgFinished and
+	 arch_.counter < limit)
+    {
+      windowExit_ = false;
+      uint64_t counter = arch_.counter;
+      if (inTraceWindow())
+	{
+	  std::feclearexcept(FE_ALL_EXCEPT);
+	  success = untilAddress(address, file);
+	  restoreHostRoundingMode();
+	  windowTraced_ += arch_.counter - counter;
+	  windows += arch_.counter != counter;
+	}
+      else
+	{
+	  // Fast loop to a block short of the next count window (it
+	  // checks the limit at block boundaries), then step to it.
+	  uint64_t end = std::min(nextTraceWindowCount() - 1, limit);
+	  if (fast and end - counter > maxBlockSize_)
+	    {
+	      bool stopped = false;
+	      uint64_t retiredLimit = (arch_.retiredInsts + end - counter -
+				       maxBlockSize_);
+	      success = simpleRun(retiredLimit, stopped);
+	      if (stopped)
+		break;
+	      continue;
+	    }
+	  if (fast)
+	    instCountLim_ = end;
+	  std::feclearexcept(FE_ALL_EXCEPT);
+	  success = untilAddress(address, nullptr);
+	  restoreHostRoundingMode();
+	  instCountLim_ = limit;
+	  if (fast and arch_.counter >= end)
+	    continue;
+	}
+      if (not windowExit_)
+	break;  // Stop point, program end or stop request.
+    }
+
+  windowed_ = false;
+  if (arch_.counter == limit)
+    std::cerr << "Stopped -- Reached instruction limit\n";
+  else if (stopAtAddr and arch_.pc == address)
+    std::cerr << "Stopped -- Reached end address\n";
+
+  // Simulator stats.
+  struct timeval t1;
+  gettimeofday(&t1, nullptr);
+  double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
+
+  uint64_t numInsts = arch_.counter - counter0;
+  accountRun(RunMode::Windowed, numInsts, elapsed);
+
+  flushConsole();
+  std::cout.flush();
+  if (stopToken_->requested())
+    std::cerr << "Stopped -- Interrupted\n";
+  std::cerr << "Retired " << numInsts << " instruction"
+	    << (numInsts > 1? "s" : "") << " in "
+	    << (boost::format("%.2fs") % elapsed);
+  if (elapsed > 0)
+    std::cerr << "  " << size_t(numInsts/elapsed) << " inst/s";
+  std::cerr << '\n';
+  std::cerr << "Traced " << windowTraced_ << " instructions in " << windows
+	    << " window" << (windows != 1? "s" : "") << '\n';
+
+  return success;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::inTraceWindow()
+{
+  const auto& windows = traceWindows_;
+
+  bool start = false;
+  if (windows.triggers and csRegs_.takeTriggerTraceAction(start))
+    traceTriggerOn_ = start;
+  if (windows.triggers and not traceTriggerOn_)
+    return false;
+
+  if (windows.privModes and
+      not (windows.privModes & (1 << unsigned(arch_.privMode))))
+    return false;
+
+  if (not windows.counts.empty())
+    {
+      uint64_t number = arch_.counter + 1;
+      bool hit = false;
+      for (const auto& range : windows.counts)
+	hit = hit or (number >= range.first and number < range.second);
+      if (not hit)
+	return false;
+    }
+
+  if (not windows.pcs.empty())
+    {
+      bool hit = false;
+      for (const auto& range : windows.pcs)
+	hit = hit or (arch_.pc >= range.first and arch_.pc < range.second);
+      if (not hit)
+	return false;
+    }
+
+  return true;
+}
+
+
+template <typename URV>
+uint64_t
+Core<URV>::nextTraceWindowCount() const
+{
+  uint64_t number = arch_.counter + 1;
+  uint64_t next = ~uint64_t(0);
+  for (const auto& range : traceWindows_.counts)
+    if (range.first > number and range.first < range.second)
+      next = std::min(next, range.first);
+  return next;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::startsTraceWindow(URV addr) const
+{
+  for (const auto& range : traceWindows_.pcs)
+    if (range.first == addr)
+      return true;
+  return false;
+}
+
+
+static constexpr uint32_t checkpointMagic = 0x504b4357;  // "WCKP"
+static constexpr uint32_t checkpointVersion = 4;
+
+
+/// Write the given trivially copyable value to the given checkpoint
+/// file. Return true on success.
+template <typename T>
+static bool
+putCheckpointItem(FILE* out, const T& x)
+{
+  static_assert(std::is_trivially_copyable<T>::value);
+  return fwrite(&x, sizeof(x), 1, out) == 1;
+}
+
+
+/// Write the given vector (element count followed by the elements) to
+/// the given checkpoint file. Return true on success.
+template <typename T>
+static bool
+putCheckpointItem(FILE* out, const std::vector<T>& vec)
+{
+  if (not putCheckpointItem(out, uint64_t(vec.size())))
+    return false;
+  for (const auto& x : vec)
+    if (not putCheckpointItem(out, x))
+      return false;
+  return true;
+}
+
+
+/// Read from the given checkpoint file a value written with
+/// putCheckpointItem. Return true on success.
+template <typename T>
+static bool
+getCheckpointItem(FILE* in, T& x)
+{
+  static_assert(std::is_trivially_copyable<T>::value);
+  return fread(&x, sizeof(x), 1, in) == 1;
+}
+
+
+template <typename T>
+static bool
+getCheckpointItem(FILE* in, std::vector<T>& vec)
+{
+  uint64_t size = 0;
+  if (not getCheckpointItem(in, size) or size > (uint64_t(1) << 32))
+    return false;
+  vec.resize(size);
+  for (auto& x : vec)
+    if (not getCheckpointItem(in, x))
+      return false;
+  return true;
+}
+
+
+template <typename URV>
+bool
+Core<URV>::saveCheckpoint(const std::string& path,
+			  const std::vector<Core<URV>*>& cores)
+{
+  if (cores.empty())
+    return false;
+
+  FILE* out = fopen(path.c_str(), "wb");
+  if (not out)
+    {
+      std::cerr << "Failed to open checkpoint file '" << path
+		<< "' for output\n";
+      return false;
+    }
 
-  bool success = untilAddress(address, traceFile);
+  Memory& memory = cores.front()->memory_;
+  uint64_t pageSize = memory.pageSize();
 
-  sigaction(SIGINT, &oldAction, nullptr);
+  bool ok = (putCheckpointItem(out, checkpointMagic) and
+	     putCheckpointItem(out, checkpointVersion) and
+	     putCheckpointItem(out, uint32_t(8*sizeof(URV))) and
+	     putCheckpointItem(out, uint32_t(cores.size())) and
+	     putCheckpointItem(out, pageSize) and
+	     putCheckpointItem(out, uint64_t(memory.size())));
 
-  if (counter_ == limit)
-    std::cerr << "Stopped -- Reached instruction limit\n";
-  else if (pc_ == address)
-    std::cerr << "Stopped -- Reached end address\n";
+  for (auto core : cores)
+    {
+      if (not ok)
+	break;
 
-  // Simulator stats.
-  struct timeval t1;
-  gettimeofday(&t1, nullptr);
-  double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
+      HartState state;
+      core->saveState(state);
+      state.forEachField([&ok, out] (const auto& field) {
+	  ok = ok and putCheckpointItem(out, field); });
 
-  uint64_t numInsts = counter_ - counter0;
+      // Triggers are saved by value (configuration is not saved).
+      auto& triggers = core->csRegs_.triggers_;
+      ok = ok and putCheckpointItem(out, uint32_t(triggers.size()));
+      for (unsigned i = 0; ok and i < triggers.size(); ++i)
+	{
+	  URV data1 = 0, data2 = 0, data3 = 0;
+	  triggers.peek(i, data1, data2, data3);
+	  ok = (putCheckpointItem(out, data1) and
+		putCheckpointItem(out, data2) and
+		putCheckpointItem(out, data3));
+	}
+    }
 
-  std::cout.flush();
-  if (not userOk)
-    std::cerr << "Keyboard interrupt\n";
-  std::cerr << "Retired " << numInsts << " instruction"
-	    << (numInsts > 1? "s" : "") << " in "
-	    << (boost::format("%.2fs") % elapsed);
-  if (elapsed > 0)
-    std::cerr << "  " << size_t(numInsts/elapsed) << " inst/s";
-  std::cerr << '\n';
+  // Page data starts at a page-aligned file offset so that it can be
+  // mapped on restore.
+  std::vector<size_t> pages;
+  memory.getUsedPages(pages);
+  ok = ok and putCheckpointItem(out, pages);
+  if (ok)
+    {
+      long pos = ftell(out);
+      ok = pos >= 0;
+      std::vector<char> pad(pageSize - pos % pageSize, 0);
+      ok = ok and fwrite(pad.data(), pad.size(), 1, out) == 1;
+    }
+  ok = ok and memory.writePages(out, pages);
 
-  return success;
+  if (fclose(out) != 0)
+    ok = false;
+  if (not ok)
+    std::cerr << "Failed to write checkpoint file '" << path << "'\n";
+  return ok;
 }
 
 
 template <typename URV>
 bool
-Core<URV>::simpleRun()
+Core<URV>::loadCheckpoint(const std::string& path,
+			  const std::vector<Core<URV>*>& cores)
 {
-  bool success = true;
+  if (cores.empty())
+    return false;
 
-  try
+  FILE* in = fopen(path.c_str(), "rb");
+  if (not in)
     {
-      while (userOk) 
-	{
-	  // Fetch instruction
-	  currPc_ = pc_;
-	  ++cycleCount_;
-	  ldStException_ = false;
+      std::cerr << "Failed to open checkpoint file '" << path
+		<< "' for input\n";
+      return false;
+    }
 
-	  uint32_t inst;
-	  if (not fetchInst(pc_, inst))
-	    continue; // Next instruction in trap handler.
+  Memory& memory = cores.front()->memory_;
 
-	  // Increment pc and execute instruction
-	  if (isFullSizeInst(inst))
-	    {
-	      pc_ += 4;  // 4-byte instruction
-	      execute32(inst);
-	    }
-	  else
-	    {
-	      pc_ += 2;  // Compressed (2-byte) instruction.
-	      execute16(inst);
-	    }
+  uint32_t magic = 0, version = 0, xlen = 0, hartCount = 0;
+  uint64_t pageSize = 0, memSize = 0;
+  bool ok = (getCheckpointItem(in, magic) and
+	     getCheckpointItem(in, version) and
+	     getCheckpointItem(in, xlen) and
+	     getCheckpointItem(in, hartCount) and
+	     getCheckpointItem(in, pageSize) and
+	     getCheckpointItem(in, memSize));
 
-	  if (not ldStException_)
-	    ++retiredInsts_;
-	}
+  if (not ok or magic != checkpointMagic or version != checkpointVersion)
+    {
+      std::cerr << "File '" << path << "' is not a whisper checkpoint\n";
+      fclose(in);
+      return false;
     }
-  catch (const CoreException& ce)
+
+  if (xlen != 8*sizeof(URV) or hartCount != cores.size() or
+      pageSize != memory.pageSize() or memSize != memory.size())
     {
-      if (ce.type() == CoreException::Stop)
-	{
-	  success = ce.value() == 1; // Anything besides 1 is a fail.
-	  std::cerr << (success? "Successful " : "Error: Failed ")
-		    << "stop: " << std::dec << ce.what() << '\n';
-	  setTargetProgramFinished(true);
-	}
-      else if (ce.type() == CoreException::Exit)
-	{
-	  std::cerr << "Target program exited with code " << ce.value() << '\n';
-	  success = ce.value() == 0;
-	  setTargetProgramFinished(true);
-	}
-      else
+      std::cerr << "Checkpoint file '" << path << "' was saved from a "
+		<< "different configuration (" << xlen << "-bit, "
+		<< hartCount << " hart(s), memory size 0x" << std::hex
+		<< memSize << ", page size 0x" << pageSize << std::dec << ")\n";
+      fclose(in);
+      return false;
+    }
+
+  std::vector<HartState> states(cores.size());
+  for (size_t ix = 0; ok and ix < cores.size(); ++ix)
+    {
+      HartState& state = states.at(ix);
+      state.forEachField([&ok, in] (auto& field) {
+	  ok = ok and getCheckpointItem(in, field); });
+
+      uint32_t count = 0;
+      state.triggers = cores.at(ix)->csRegs_.triggers_;
+      ok = ok and getCheckpointItem(in, count) and
+	count == state.triggers.size();
+      for (unsigned i = 0; ok and i < count; ++i)
 	{
-	  success = false;
-	  std::cerr << "Stopped -- unexpected exception\n";
+	  URV data1 = 0, data2 = 0, data3 = 0;
+	  ok = (getCheckpointItem(in, data1) and
+		getCheckpointItem(in, data2) and
+		getCheckpointItem(in, data3));
+	  state.triggers.poke(i, data1, data2, data3);
 	}
     }
 
-  return success;
+  std::vector<size_t> pages;
+  ok = ok and getCheckpointItem(in, pages);
+
+  long pos = ok ? ftell(in) : -1;
+  if (pos < 0)
+    ok = false;
+
+  if (ok)
+    {
+      uint64_t offset = pos + (pageSize - pos % pageSize);
+      ok = memory.loadPages(fileno(in), offset, pages);
+    }
+
+  fclose(in);
+
+  if (not ok)
+    {
+      std::cerr << "Failed to load checkpoint file '" << path << "'\n";
+      return false;
+    }
+
+  for (size_t ix = 0; ix < cores.size(); ++ix)
+    cores.at(ix)->loadState(states.at(ix));
+  return true;
 }
 
 
-/// Run indefinitely.  If the tohost address is defined, then run till
-/// a write is attempted to that address.
 template <typename URV>
 bool
-Core<URV>::run(FILE* file)
+Core<URV>::runHarts(const std::vector<Core<URV>*>& cores, uint64_t quantum)
 {
-  // If test has toHost defined then use that as the stopping criteria
-  // and ignore the stop address. Not having to check for the stop
-  // address gives us about an 10 percent boost in speed.
-  if (stopAddrValid_ and not toHostValid_)
-    return runUntilAddress(stopAddr_, file);
+  if (cores.empty())
+    return true;
 
-  // To run fast, this method does not do much besides straight-forward
-  // execution. If any option is turned on, we switch to
-  // runUntilAdress which runs slower but is full-featured.
-  if (file or instCountLim_ < ~uint64_t(0) or instFreq_ or enableTriggers_ or
-      enableCounters_ or enableGdb_)
-    {
-      URV address = ~URV(0);  // Invalid stop PC.
-      return runUntilAddress(address, file);
-    }
+  if (quantum == 0)
+    quantum = 1;
 
-  struct timeval t0;
-  gettimeofday(&t0, nullptr);
+  for (auto core : cores)
+    if (core->instFreq_ or core->enableTriggers_ or core->enableCounters_ or
+	core->enableGdb_ or core->pcProfiler_ or
+	core->instCountLim_ < ~uint64_t(0) or
+	(core->stopAddrValid_ and not core->toHostValid_))
+      {
+	std::cerr << "Warning: Instruction-count-limit, end-address, "
+		  << "trigger, performance-counter,\n"
+		  << "         gdb and profile options ignored in multi-hart "
+		  << "runs.\n";
+	break;
+      }
 
-  struct sigaction oldAction;
-  struct sigaction newAction;
-  memset(&newAction, 0, sizeof(newAction));
-  newAction.sa_handler = keyboardInterruptHandler;
+  std::vector<uint64_t> counters0;
+  for (auto core : cores)
+    counters0.push_back(core->arch_.counter);
 
-  userOk = true;
-  sigaction(SIGINT, &newAction, &oldAction);
+  struct timeval t0;
+  gettimeofday(&t0, nullptr);
 
-  bool success = simpleRun();
+  // Barrier reached by each hart at the end of each quantum. The run
+  // ends at the first barrier following the stop of any hart. Finish
+  // is decided by the last hart to reach a barrier: it remains valid
+  // until all harts have left that barrier.
+  std::mutex mutex;
+  std::condition_variable barrier;
+  unsigned arrived = 0;
+  uint64_t generation = 0;
+  bool done = false, finish = false;
+
+  std::vector<char> stopped(cores.size(), false);
+  std::vector<char> success(cores.size(), true);
+
+  auto runHart = [&] (unsigned ix) {
+    Core<URV>& core = *cores.at(ix);
+    if (core.numaNode_ >= 0)
+      bindThreadToNumaNode(core.numaNode_);
+    uint64_t limit = core.arch_.retiredInsts;
+    while (true)
+      {
+	limit += quantum;
+	bool hartStopped = false;
+	success.at(ix) = core.simpleRun(limit, hartStopped);
+	stopped.at(ix) = hartStopped;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (hartStopped or core.stopToken_->requested())
+	  done = true;
+	if (++arrived == cores.size())
+	  {
+	    arrived = 0;
+	    finish = done;
+	    generation++;
+	    barrier.notify_all();
+	  }
+	else
+	  {
+	    uint64_t gen = generation;
+	    barrier.wait(lock, [&] { return gen != generation; });
+	  }
+	if (finish)
+	  break;
+      }
+  };
 
-  sigaction(SIGINT, &oldAction, nullptr);
+  std::vector<std::thread> threads;
+  for (unsigned ix = 1; ix < cores.size(); ++ix)
+    threads.emplace_back(runHart, ix);
+  runHart(0);
+  for (auto& thread : threads)
+    thread.join();
 
   // Simulator stats.
   struct timeval t1;
   gettimeofday(&t1, nullptr);
   double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
 
+  for (unsigned ix = 0; ix < cores.size(); ++ix)
+    {
+      Core<URV>& core = *cores.at(ix);
+      core.accountRun(RunMode::Harts, core.arch_.counter - counters0.at(ix),
+		      elapsed);
+    }
+
+  for (auto core : cores)
+    core->flushConsole();
   std::cout.flush();
-  if (not userOk)
-    std::cerr << "Keyboard interrupt\n";
-  std::cerr << "Retired " << retiredInsts_ << " instruction"
-	    << (retiredInsts_ > 1? "s" : "") << " in "
+  for (auto core : cores)
+    if (core->stopToken_->requested())
+      {
+	std::cerr << "Stopped -- Interrupted\n";
+	break;
+      }
+
+  bool ok = true;
+  uint64_t total = 0;
+  for (unsigned ix = 0; ix < cores.size(); ++ix)
+    {
+      uint64_t retired = cores.at(ix)->arch_.retiredInsts;
+      total += retired;
+      uint64_t skipped = cores.at(ix)->idleSkipped_;
+      std::cerr << "Hart " << ix << ": retired " << retired << " instruction"
+		<< (retired > 1? "s" : "")
+		<< (stopped.at(ix)? "" : " (not stopped)");
+      if (skipped)
+	std::cerr << ", " << skipped << " skipped in idle loops";
+      std::cerr << '\n';
+      if (stopped.at(ix))
+	ok = ok and success.at(ix);
+    }
+
+  std::cerr << "Retired " << total << " instruction"
+	    << (total > 1? "s" : "") << " in "
 	    << (boost::format("%.2fs") % elapsed);
   if (elapsed > 0)
-    std::cerr << "  " << size_t(retiredInsts_/elapsed) << " inst/s";
+    std::cerr << "  " << size_t(total/elapsed) << " inst/s";
   std::cerr << '\n';
 
-  return success;
+  return ok;
 }
 
 
@@ -2754,12 +4603,17 @@ template <typename URV>
 bool
 Core<URV>::isInterruptPossible(InterruptCause& cause)
 {
-  if (debugMode_ and not debugStepMode_)
+  // Cached: Avoid reading MSTATUS/MIE/MIP on every instruction.
+  if (not csRegs_.isInterruptPossible())
+    return false;
+
+  if (arch_.debugMode and not arch_.debugStepMode)
     return false;
 
+  typedef typename CsRegs<URV>::HotCsr HotCsr;
+
   URV mstatus;
-  if (not csRegs_.read(CsrNumber::MSTATUS, PrivilegeMode::Machine,
-		       debugMode_, mstatus))
+  if (not csRegs_.readHot(HotCsr::Mstatus, mstatus))
     return false;
 
   MstatusFields<URV> fields(mstatus);
@@ -2767,9 +4621,7 @@ Core<URV>::isInterruptPossible(InterruptCause& cause)
     return false;
 
   URV mip, mie;
-  if (csRegs_.read(CsrNumber::MIP, PrivilegeMode::Machine, debugMode_, mip)
-      and
-      csRegs_.read(CsrNumber::MIE, PrivilegeMode::Machine, debugMode_, mie))
+  if (csRegs_.readHot(HotCsr::Mip, mip) and csRegs_.readHot(HotCsr::Mie, mie))
     {
       if ((mie & mip) == 0)
 	return false;  // Nothing enabled is pending.
@@ -2816,19 +4668,19 @@ template <typename URV>
 bool
 Core<URV>::processExternalInterrupt(FILE* traceFile, std::string& instStr)
 {
-  if (debugStepMode_ and not dcsrStepIe_)
+  if (arch_.debugStepMode and not arch_.dcsrStepIe)
     return false;
 
   // If a non-maskable interrupt was signaled by the test-bench, take it.
-  if (nmiPending_)
+  if (arch_.nmiPending)
     {
-      initiateNmi(URV(nmiCause_), pc_);
-      nmiPending_ = false;
-      nmiCause_ = NmiCause::UNKNOWN;
+      initiateNmi(URV(arch_.nmiCause), arch_.pc);
+      arch_.nmiPending = false;
+      arch_.nmiCause = NmiCause::UNKNOWN;
       uint32_t inst = 0; // Load interrupted inst.
-      readInst(currPc_, inst);
+      readInst(arch_.currPc, inst);
       if (traceFile)  // Trace interrupted instruction.
-	printInstTrace(inst, counter_, instStr, traceFile, true);
+	printInstTrace(inst, arch_.counter, instStr, traceFile, true);
       return true;
     }
 
@@ -2837,12 +4689,12 @@ Core<URV>::processExternalInterrupt(FILE* traceFile, std::string& instStr)
   if (isInterruptPossible(cause))
     {
       // Attach changes to interrupted instruction.
-      initiateInterrupt(cause, pc_);
+      initiateInterrupt(cause, arch_.pc);
       uint32_t inst = 0; // Load interrupted inst.
-      readInst(currPc_, inst);
+      readInst(arch_.currPc, inst);
       if (traceFile)  // Trace interrupted instruction.
-	printInstTrace(inst, counter_, instStr, traceFile, true);
-      ++cycleCount_;
+	printInstTrace(inst, arch_.counter, instStr, traceFile, true);
+      ++arch_.cycleCount;
       return true;
     }
   return false;
@@ -2871,57 +4723,74 @@ isDebugModeStopCount(const Core<URV>& core)
 template <typename URV>
 void
 Core<URV>::singleStep(FILE* traceFile)
+{
+  singleStepInst(traceFile);
+  restoreHostRoundingMode();
+  if (conFlushOnStop_ or arch_.targetProgFinished)
+    flushConsole();
+}
+
+
+template <typename URV>
+void
+Core<URV>::singleStepInst(FILE* traceFile)
 {
   std::string instStr;
 
   // Single step is mostly used for follow-me mode where we want to
   // know the changes after the execution of each instruction.
   bool doStats = instFreq_ or enableCounters_;
+  deviceBus_.enter();
 
   try
     {
       uint32_t inst = 0;
-      currPc_ = pc_;
+      arch_.currPc = arch_.pc;
 
       loadAddrValid_ = false;
       triggerTripped_ = false;
       ldStException_ = false;
       csrException_ = false;
-      ebreakInst_ = false;
+      arch_.ebreakInst = false;
 
-      ++counter_;
+      if (arch_.counter >= reverseTime_)
+	saveReversePoint();
+      ++arch_.counter;
+
+      if (arch_.retiredInsts >= deviceBus_.nextEventTime())
+	deviceBus_.dispatch(arch_.retiredInsts);
 
       if (processExternalInterrupt(traceFile, instStr))
 	{
 #if 0
-	  if (dcsrStep_)
-	    enterDebugMode(DebugModeCause::STEP, pc_);
+	  if (arch_.dcsrStep)
+	    enterDebugMode(DebugModeCause::STEP, arch_.pc);
 #endif
-	  ++cycleCount_;
+	  ++arch_.cycleCount;
 	  return;  // Next instruction in interrupt handler.
 	}
 
       // Process pre-execute address trigger and fetch instruction.
       bool hasTrig = hasActiveInstTrigger();
-      triggerTripped_ = hasTrig and instAddrTriggerHit(pc_,
+      triggerTripped_ = hasTrig and instAddrTriggerHit(arch_.pc,
 						       TriggerTiming::Before,
 						       isInterruptEnabled());
       // Fetch instruction.
       bool fetchOk = true;
       if (triggerTripped_)
-	fetchOk = fetchInstPostTrigger(pc_, inst, traceFile);
+	fetchOk = fetchInstPostTrigger(arch_.pc, inst, traceFile);
       else if (forceFetchFail_)
 	{
 	  forceFetchFail_ = false;
-	  URV info = pc_ + forceFetchFailOffset_;
-	  initiateException(ExceptionCause::INST_ACC_FAULT, pc_, info);
+	  URV info = arch_.pc + forceFetchFailOffset_;
+	  initiateException(ExceptionCause::INST_ACC_FAULT, arch_.pc, info);
 	  fetchOk = false;
 	}
       else
-	fetchOk = fetchInst(pc_, inst);
+	fetchOk = fetchInst(arch_.pc, inst);
       if (not fetchOk)
 	{
-	  ++cycleCount_;
+	  ++arch_.cycleCount;
 	  return; // Next instruction in trap handler
 	}
 
@@ -2934,42 +4803,58 @@ Core<URV>::singleStep(FILE* traceFile)
       if (isFullSizeInst(inst))
 	{
 	  // 4-byte instruction
-	  pc_ += 4;
+	  arch_.pc += 4;
 	  execute32(inst);
 	}
       else
 	{
 	  // Compressed (2-byte) instruction.
-	  pc_ += 2;
+	  arch_.pc += 2;
 	  execute16(inst);
 	}
 
-      ++cycleCount_;
+      ++arch_.cycleCount;
 
       if (ldStException_)
 	{
 	  if (traceFile)
-	    printInstTrace(inst, counter_, instStr, traceFile);
-	  if (dcsrStep_)
-	    enterDebugMode(DebugModeCause::STEP, pc_);
+	    printInstTrace(inst, arch_.counter, instStr, traceFile);
+	  if (arch_.dcsrStep)
+	    enterDebugMode(DebugModeCause::STEP, arch_.pc);
 	  return;
 	}
 
       if (triggerTripped_)
 	{
 	  undoForTrigger();
-	  takeTriggerAction(traceFile, currPc_, currPc_, counter_, true);
+	  takeTriggerAction(traceFile, arch_.currPc, arch_.currPc,
+			    arch_.counter, true);
 	  return;
 	}
 
       if (not isDebugModeStopCount(*this))
-	++retiredInsts_;
+	++arch_.retiredInsts;
 
       if (doStats)
 	accumulateInstructionStats(inst);
+      if (pcProfiler_)
+	pcProfiler_->record(arch_.currPc, inst);
+      if (coverage_)
+	coverage_->record(arch_.currPc, inst, arch_.pc);
+      if (timing_)
+	timeInstruction(inst);
+      if (addrTrace_)
+	traceAddresses(inst);
+      if (bbv_)
+	bbv_->recordInst(arch_.currPc, isCompressedInst(inst) ? 2 : 4,
+			 arch_.retiredInsts);
+      if (plugins_)
+	notifyPlugins(inst);
+      if (arch_.retiredInsts >= metricsTime_)
+	publishMetrics();
 
       if (traceFile)
-	printInstTrace(inst, counter_, instStr, traceFile);
+	printInstTrace(inst, arch_.counter, instStr, traceFile);
 
       // If a register is used as a source by an instruction then any
       // pending load with same register as target is removed from the
@@ -2998,22 +4883,23 @@ Core<URV>::singleStep(FILE* traceFile)
 			icountTriggerHit());
       if (icountHit)
 	{
-	  takeTriggerAction(traceFile, pc_, pc_, counter_, false);
+	  takeTriggerAction(traceFile, arch_.pc, arch_.pc, arch_.counter,
+			    false);
 	  return;
 	}
 
       // If step bit set in dcsr then enter debug mode unless already there.
-      if (dcsrStep_ and not ebreakInst_)
-	enterDebugMode(DebugModeCause::STEP, pc_);
+      if (arch_.dcsrStep and not arch_.ebreakInst)
+	enterDebugMode(DebugModeCause::STEP, arch_.pc);
     }
   catch (const CoreException& ce)
     {
       uint32_t inst = 0;
-      readInst(currPc_, inst);
+      readInst(arch_.currPc, inst);
       if (ce.type() == CoreException::Stop)
 	{
 	  if (traceFile)
-	    printInstTrace(inst, counter_, instStr, traceFile);
+	    printInstTrace(inst, arch_.counter, instStr, traceFile);
 	  std::cerr << "Stopped...\n";
 	  setTargetProgramFinished(true);
 	}
@@ -3032,37 +4918,38 @@ template <typename URV>
 bool
 Core<URV>::whatIfSingleStep(uint32_t inst, ChangeRecord& record)
 {
-  uint64_t prevExceptionCount = exceptionCount_;
-  URV prevPc = pc_;
+  uint64_t prevExceptionCount = arch_.exceptionCount;
+  URV prevPc = arch_.pc;
 
   clearTraceData();
   triggerTripped_ = false;
+  deviceBus_.enter();
 
   // Note: triggers not yet supported.
 
   // Execute instruction
-  currPc_ = pc_;
+  arch_.currPc = arch_.pc;
   if (isFullSizeInst(inst))
     {
       // 4-byte instruction
-      pc_ += 4;
+      arch_.pc += 4;
       execute32(inst);
     }
   else
     {
       // Compressed (2-byte) instruction.
-      pc_ += 2;
+      arch_.pc += 2;
       execute16(inst);
     }
 
-  bool result = exceptionCount_ == prevExceptionCount;
+  bool result = arch_.exceptionCount == prevExceptionCount;
 
   // If step bit set in dcsr then enter debug mode unless already there.
-  if (dcsrStep_ and not ebreakInst_)
-    enterDebugMode(DebugModeCause::STEP, pc_);
+  if (arch_.dcsrStep and not arch_.ebreakInst)
+    enterDebugMode(DebugModeCause::STEP, arch_.pc);
 
   // Collect changes. Undo each collected change.
-  exceptionCount_ = prevExceptionCount;
+  arch_.exceptionCount = prevExceptionCount;
 
   collectAndUndoWhatIfChanges(prevPc, record);
   
@@ -3074,8 +4961,8 @@ template <typename URV>
 bool
 Core<URV>::whatIfSingleStep(URV whatIfPc, uint32_t inst, ChangeRecord& record)
 {
-  URV prevPc = pc_;
-  pc_ = whatIfPc;
+  URV prevPc = arch_.pc;
+  arch_.pc = whatIfPc;
 
   // Note: triggers not yet supported.
   triggerTripped_ = false;
@@ -3083,7 +4970,7 @@ Core<URV>::whatIfSingleStep(URV whatIfPc, uint32_t inst, ChangeRecord& record)
   // Fetch instruction. We don't care about what we fetch. Just checking
   // if there is a fetch exception.
   uint32_t dummyInst = 0;
-  bool fetchOk = fetchInst(pc_, dummyInst);
+  bool fetchOk = fetchInst(arch_.pc, dummyInst);
 
   if (not fetchOk)
     {
@@ -3093,19 +4980,136 @@ Core<URV>::whatIfSingleStep(URV whatIfPc, uint32_t inst, ChangeRecord& record)
 
   bool res = whatIfSingleStep(inst, record);
 
-  pc_ = prevPc;
+  arch_.pc = prevPc;
   return res;
 }
 
 
+template <typename URV>
+bool
+Core<URV>::isWhatIfLocal(const InstInfo& info)
+{
+  // CSRs may be tied to memory mapped registers or to the memory
+  // configuration.
+  if (info.isStore() or info.isCsr())
+    return false;
+
+  InstId id = info.instId();
+  if (id >= InstId::lr_w and id <= InstId::amomaxu_d)
+    return false;
+
+  switch (id)
+    {
+    case InstId::fencei: case InstId::ecall: case InstId::ebreak:
+    case InstId::c_ebreak:
+      return false;
+    default:
+      return true;
+    }
+}
+
+
+template <typename URV>
+bool
+Core<URV>::isUndoableStep()
+{
+  uint32_t inst = 0;
+  if (not readInst(arch_.pc, inst))
+    return true;  // Fetch fault: The trap only changes the hart.
+
+  uint32_t op0 = 0, op1 = 0; int32_t op2 = 0;
+  const InstInfo& info = decode(inst, op0, op1, op2);
+  if (not info.isLoad() and not info.isStore())
+    return isWhatIfLocal(info);
+
+  // The memory keeps the load reservations of the atomics: Going back
+  // does not restore them.
+  InstId id = info.instId();
+  if (id >= InstId::lr_w and id <= InstId::amomaxu_d)
+    return false;
+
+  // Base register: first operand of a store, second of a load.
+  URV base = 0;
+  peekIntReg(info.isStore() ? op0 : op1, base);
+  size_t addr = URV(base + SRV(op2));
+  for (size_t a : { addr, addr + 7 })
+    {
+      if (a >= memory_.size())
+	continue;  // Access fault.
+      auto attrib = memory_.getAttrib(a);
+      if (attrib.isWatched() or attrib.isMemMappedReg())
+	return false;
+    }
+  return true;
+}
+
+
+template <typename URV>
+void
+Core<URV>::whatIfBatch(const std::vector<WhatIfCandidate>& candidates,
+		       std::vector<ChangeRecord>& records)
+{
+  records.assign(candidates.size(), ChangeRecord());
+
+  // Undoing a candidate leaves the privilege and debug modes of a trap
+  // entry: Reload the state after a candidate taking an exception.
+  HartState state;
+  saveState(state);
+
+  auto evaluate = [&candidates, &records, &state] (Core<URV>& hart,
+						   size_t ix) {
+    const WhatIfCandidate& cand = candidates.at(ix);
+    ChangeRecord& record = records.at(ix);
+    record.hasException = not hart.whatIfSingleStep(URV(cand.pc), cand.inst,
+						    record);
+    if (record.hasException)
+      hart.loadState(state);
+  };
+
+  // Candidates evaluated concurrently: They only read memory.
+  std::vector<size_t> local, others;
+  bool readSideEffects = deviceBus_.hasReadSideEffects();
+  for (size_t ix = 0; ix < candidates.size(); ++ix)
+    {
+      const InstInfo& info = decodeForCounters(candidates[ix].inst);
+      if (not whatIfHelpers_.empty() and isWhatIfLocal(info) and
+	  not (readSideEffects and info.isLoad()))
+	local.push_back(ix);
+      else
+	others.push_back(ix);
+    }
+
+  if (not local.empty())
+    {
+      std::atomic<size_t> next(0);
+      auto worker = [&] (Core<URV>* hart) {
+	if (hart != this)
+	  hart->loadState(state);
+	for (size_t n = next++; n < local.size(); n = next++)
+	  evaluate(*hart, local[n]);
+      };
+
+      std::vector<std::thread> threads;
+      for (auto helper : whatIfHelpers_)
+	threads.emplace_back(worker, helper);
+      worker(this);
+      for (auto& thread : threads)
+	thread.join();
+    }
+
+  for (size_t ix : others)
+    evaluate(*this, ix);
+}
+
+
 template <typename URV>
 void
 Core<URV>::collectAndUndoWhatIfChanges(URV prevPc, ChangeRecord& record)
 {
   record.clear();
 
-  record.newPc = pc_;
-  pc_ = prevPc;
+  record.newPc = arch_.pc;
+  arch_.pc = prevPc;
 
   unsigned regIx = 0;
   URV oldValue = 0;
@@ -3145,11 +5149,7 @@ Core<URV>::collectAndUndoWhatIfChanges(URV prevPc, ChangeRecord& record)
       value = value >> 8;
     }
 
-  std::vector<CsrNumber> csrNums;
-  std::vector<unsigned> triggerNums;
-  csRegs_.getLastWrittenRegs(csrNums, triggerNums);
-
-  for (auto csrn : csrNums)
+  for (auto csrn : csRegs_.lastWrittenRegs())
     {
       Csr<URV>* csr = csRegs_.getImplementedCsr(csrn);
       if (not csr)
@@ -3581,6 +5581,11 @@ Core<URV>::execute32(uint32_t inst)
     uint32_t top5 = rf.top5(), f3 = rf.bits.funct3;
     uint32_t rd = rf.bits.rd, rs1 = rf.bits.rs1, rs2 = rf.bits.rs2;
     amoRl_ = rf.rl(); amoAq_ = rf.aq();
+
+    // Make the instruction indivisible with respect to the other
+    // harts sharing the memory.
+    AtomicGuard guard(*this, intRegs_.read(rs1), memory_.isShared());
+
     if (f3 == 2)
       {
 	if      (top5 == 0)     execAmoadd_w(rd, rs1, rs2);
@@ -3753,27 +5758,293 @@ Core<URV>::execute32(uint32_t inst)
 	  else if (csr == 0x105) execWfi();
 	  else                   illegalInst();
 	}
-	break;
-      case 1: execCsrrw(rd, rs1, csr); break;
-      case 2: execCsrrs(rd, rs1, csr); break;
-      case 3: execCsrrc(rd, rs1, csr); break;
-      case 5: execCsrrwi(rd, rs1, csr); break;
-      case 6: execCsrrsi(rd, rs1, csr); break;
-      case 7: execCsrrci(rd, rs1, csr); break;
-      default: illegalInst(); break;
+	break;
+      case 1: execCsrrw(rd, rs1, csr); break;
+      case 2: execCsrrs(rd, rs1, csr); break;
+      case 3: execCsrrc(rd, rs1, csr); break;
+      case 5: execCsrrwi(rd, rs1, csr); break;
+      case 6: execCsrrsi(rd, rs1, csr); break;
+      case 7: execCsrrci(rd, rs1, csr); break;
+      default: illegalInst(); break;
+      }
+  }
+}
+
+
+
+template <typename URV>
+const typename Core<URV>::OpTable&
+Core<URV>::opTable()
+{
+  static const OpTable table = [] {
+    OpTable t;
+
+    auto add = [&t] (unsigned opcode, unsigned funct3, InstId id, OpForm form,
+		     ExecFn fn) {
+      t.level1_[opcode][funct3] = { id, form, false, fn };
+    };
+
+    // R-form: funct7 0, 1 (M extension) or 0x20.
+    auto addR = [&t] (unsigned opcode, unsigned funct3, unsigned funct7,
+		      InstId id, ExecFn fn) {
+      t.level1_[opcode][funct3].form_ = OpForm::R;
+      unsigned ix = funct7 == 0x20 ? 2 : funct7;
+      t.rform_[opcode][funct3][ix] = { id, OpForm::R, funct7 == 1, fn };
+    };
+
+    // 00000  Loads.
+    add(0, 0, InstId::lb,  OpForm::I, &Core::execLb);
+    add(0, 1, InstId::lh,  OpForm::I, &Core::execLh);
+    add(0, 2, InstId::lw,  OpForm::I, &Core::execLw);
+    add(0, 3, InstId::ld,  OpForm::I, &Core::execLd);
+    add(0, 4, InstId::lbu, OpForm::I, &Core::execLbu);
+    add(0, 5, InstId::lhu, OpForm::I, &Core::execLhu);
+    add(0, 6, InstId::lwu, OpForm::I, &Core::execLwu);
+
+    // 00100  Immediate ops. Shifts (funct3 1 and 5) are left to the
+    // switches: their immediate field depends on the xlen.
+    add(4, 0, InstId::addi,  OpForm::I, &Core::execAddi);
+    add(4, 2, InstId::slti,  OpForm::I, &Core::execSlti);
+    add(4, 3, InstId::sltiu, OpForm::I, &Core::execSltiu);
+    add(4, 4, InstId::xori,  OpForm::I, &Core::execXori);
+    add(4, 6, InstId::ori,   OpForm::I, &Core::execOri);
+    add(4, 7, InstId::andi,  OpForm::I, &Core::execAndi);
+
+    // 01000  Stores. Sd is left to the switches (rv64 only).
+    add(8, 0, InstId::sb, OpForm::S, &Core::execSb);
+    add(8, 1, InstId::sh, OpForm::S, &Core::execSh);
+    add(8, 2, InstId::sw, OpForm::S, &Core::execSw);
+
+    // 01100  Register ops.
+    addR(12, 0, 0, InstId::add,  &Core::execAdd);
+    addR(12, 1, 0, InstId::sll,  &Core::execSll);
+    addR(12, 2, 0, InstId::slt,  &Core::execSlt);
+    addR(12, 3, 0, InstId::sltu, &Core::execSltu);
+    addR(12, 4, 0, InstId::xor_, &Core::execXor);
+    addR(12, 5, 0, InstId::srl,  &Core::execSrl);
+    addR(12, 6, 0, InstId::or_,  &Core::execOr);
+    addR(12, 7, 0, InstId::and_, &Core::execAnd);
+    addR(12, 0, 1, InstId::mul,    &Core::execMul);
+    addR(12, 1, 1, InstId::mulh,   &Core::execMulh);
+    addR(12, 2, 1, InstId::mulhsu, &Core::execMulhsu);
+    addR(12, 3, 1, InstId::mulhu,  &Core::execMulhu);
+    addR(12, 4, 1, InstId::div,    &Core::execDiv);
+    addR(12, 5, 1, InstId::divu,   &Core::execDivu);
+    addR(12, 6, 1, InstId::rem,    &Core::execRem);
+    addR(12, 7, 1, InstId::remu,   &Core::execRemu);
+    addR(12, 0, 0x20, InstId::sub, &Core::execSub);
+    addR(12, 5, 0x20, InstId::sra, &Core::execSra);
+
+    // 11000  Branches.
+    add(24, 0, InstId::beq,  OpForm::B, &Core::execBeq);
+    add(24, 1, InstId::bne,  OpForm::B, &Core::execBne);
+    add(24, 4, InstId::blt,  OpForm::B, &Core::execBlt);
+    add(24, 5, InstId::bge,  OpForm::B, &Core::execBge);
+    add(24, 6, InstId::bltu, OpForm::B, &Core::execBltu);
+    add(24, 7, InstId::bgeu, OpForm::B, &Core::execBgeu);
+
+    // 11001  Jalr.
+    add(25, 0, InstId::jalr, OpForm::I, &Core::execJalr);
+
+    // 11100  CSR instructions: Executed by execute32.
+    add(28, 1, InstId::csrrw,  OpForm::Csr, nullptr);
+    add(28, 2, InstId::csrrs,  OpForm::Csr, nullptr);
+    add(28, 3, InstId::csrrc,  OpForm::Csr, nullptr);
+    add(28, 5, InstId::csrrwi, OpForm::Csr, nullptr);
+    add(28, 6, InstId::csrrsi, OpForm::Csr, nullptr);
+    add(28, 7, InstId::csrrci, OpForm::Csr, nullptr);
+
+    // 00101 auipc, 01101 lui and 11011 jal: No funct3.
+    for (unsigned funct3 = 0; funct3 < 8; ++funct3)
+      {
+	add(5, funct3, InstId::auipc, OpForm::U, &Core::execAuipc);
+	add(13, funct3, InstId::lui, OpForm::U, &Core::execLui);
+	add(27, funct3, InstId::jal, OpForm::J, &Core::execJal);
+      }
+
+    return t;
+  } ();
+
+  return table;
+}
+
+
+template <typename URV>
+void
+Core<URV>::opOperands(OpForm form, uint32_t inst, uint32_t& op0,
+		      uint32_t& op1, int32_t& op2)
+{
+  op2 = 0;
+  switch (form)
+    {
+    case OpForm::I:
+      {
+	IFormInst iform(inst);
+	op0 = iform.fields.rd; op1 = iform.fields.rs1; op2 = iform.immed();
+      }
+      break;
+
+    case OpForm::Csr:
+      {
+	IFormInst iform(inst);
+	op0 = iform.fields.rd; op1 = iform.fields.rs1; op2 = iform.uimmed();
+      }
+      break;
+
+    case OpForm::S:
+      {
+	SFormInst sform(inst);
+	op0 = sform.bits.rs1; op1 = sform.bits.rs2; op2 = sform.immed();
+      }
+      break;
+
+    case OpForm::B:
+      {
+	BFormInst bform(inst);
+	op0 = bform.bits.rs1; op1 = bform.bits.rs2; op2 = bform.immed();
+      }
+      break;
+
+    case OpForm::U:
+      {
+	UFormInst uform(inst);
+	op0 = uform.bits.rd; op1 = uform.immed();
+      }
+      break;
+
+    case OpForm::J:
+      {
+	JFormInst jform(inst);
+	op0 = jform.bits.rd; op1 = jform.immed();
+      }
+      break;
+
+    case OpForm::R:
+      {
+	RFormInst rform(inst);
+	op0 = rform.bits.rd; op1 = rform.bits.rs1; op2 = rform.bits.rs2;
+      }
+      break;
+
+    default:
+      op0 = 0; op1 = 0;
+      break;
+    }
+}
+
+
+template <typename URV>
+void
+Core<URV>::decode32Exec(uint32_t inst, DecodedInst& di)
+{
+  if (const OpEntry* entry = lookupOp(inst))
+    {
+      if (not entry->fn_)
+	{
+	  di.set(&Core::execUndecoded32, inst);
+	  return;
+	}
+      uint32_t op0 = 0, op1 = 0;
+      int32_t op2 = 0;
+      opOperands(entry->form_, inst, op0, op1, op2);
+      di.set(entry->fn_, op0, op1, op2);
+      return;
+    }
+
+  // Encodings not covered by the opcode table.
+  unsigned opcode = (inst & 0x7f) >> 2;  // Upper 5 bits of opcode.
+
+  switch (opcode)
+    {
+    case 4:  // 00100   I-form shifts.
+      {
+	IFormInst iform(inst);
+	unsigned rd = iform.fields.rd, rs1 = iform.fields.rs1;
+	unsigned funct3 = iform.fields.funct3;
+	unsigned topBits = 0, shamt = 0;
+	iform.getShiftFields(isRv64(), topBits, shamt);
+
+	if (funct3 == 1 and topBits == 0)
+	  di.set(&Core::execSlli, rd, rs1, shamt);
+	else if (funct3 == 5 and topBits == 0)
+	  di.set(&Core::execSrli, rd, rs1, shamt);
+	else if (funct3 == 5 and (isRv64() ? topBits << 1 : topBits) == 0x20)
+	  di.set(&Core::execSrai, rd, rs1, shamt);
+	else
+	  di.set(&Core::execIllegal);
       }
-  }
-}
+      return;
+
+    case 8:  // 01000  S-form sd.
+      {
+	SFormInst sform(inst);
+	if (sform.bits.funct3 == 3)
+	  di.set(&Core::execSd, sform.bits.rs1, sform.bits.rs2, sform.immed());
+	else
+	  di.set(&Core::execIllegal);
+      }
+      return;
+
+    case 0:   // Loads, register ops, branches and jalr: Holes in the
+    case 12:  // opcode table are illegal.
+    case 24:
+    case 25:
+      di.set(&Core::execIllegal);
+      return;
+
+    case 1:   // Floating point loads/stores, fused multiply-add and
+    case 9:   // register ops: Illegal without F. D requires F.
+    case 16:
+    case 17:
+    case 18:
+    case 19:
+    case 20:
+      if (not isRvf())
+	di.set(&Core::execIllegal);
+      else
+	di.set(&Core::execUndecoded32, inst);
+      return;
+
+    case 11:  // Atomics: Illegal without A.
+      if (not isRva())
+	di.set(&Core::execIllegal);
+      else
+	di.set(&Core::execUndecoded32, inst);
+      return;
+
+    case 6:   // 32-bit (rv64) immediate and register ops.
+    case 14:
+      if (not isRv64())
+	di.set(&Core::execIllegal);
+      else
+	di.set(&Core::execUndecoded32, inst);
+      return;
 
+    default:
+      // Floating point, atomic, CSR, system and 32-bit (rv64)
+      // instructions: Leave them to execute32.
+      di.set(&Core::execUndecoded32, inst);
+      return;
+    }
+}
 
 
 template <typename URV>
 void
 Core<URV>::execute16(uint16_t inst)
+{
+  const RvcEntry& entry = rvcEntry(inst);
+  (this->*entry.fn_)(entry.op0_, entry.op1_, entry.op2_);
+}
+
+
+template <typename URV>
+void
+Core<URV>::decode16Exec(uint16_t inst, DecodedInst& di)
 {
   if (not isRvc())
     {
-      illegalInst();
+      di.set(&Core::execIllegal);
       return;
     }
 
@@ -3785,15 +6056,15 @@ Core<URV>::execute16(uint16_t inst)
       if (funct3 == 0)   // illegal, c.addi4spn
 	{
 	  if (inst == 0)
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  else
 	    {
 	      CiwFormInst ciwf(inst);
 	      unsigned immed = ciwf.immed();
 	      if (immed == 0)
-		illegalInst();  // As of v2.3 of User-Level ISA (Dec 2107).
+		di.set(&Core::execIllegal);  // As of v2.3 of User-Level ISA.
 	      else
-		execAddi(8+ciwf.bits.rdp, RegSp, immed);  // c.addi4spn
+		di.set(&Core::execAddi, 8+ciwf.bits.rdp, RegSp, immed);
 	    }
 	  return;
 	}
@@ -3801,11 +6072,11 @@ Core<URV>::execute16(uint16_t inst)
       if (funct3 == 1) // c.fld c.lq
 	{
 	  if (not isRvd())
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  else
 	    {
 	      ClFormInst clf(inst);
-	      execFld(8+clf.bits.rdp, 8+clf.bits.rs1p, clf.ldImmed());
+	      di.set(&Core::execFld, 8+clf.bits.rdp, 8+clf.bits.rs1p, clf.ldImmed());
 	    }
 	  return;
 	}
@@ -3813,7 +6084,7 @@ Core<URV>::execute16(uint16_t inst)
       if (funct3 == 2) // c.lw
 	{
 	  ClFormInst clf(inst);
-	  execLw(8+clf.bits.rdp, 8+clf.bits.rs1p, clf.lwImmed());
+	  di.set(&Core::execLw, 8+clf.bits.rdp, 8+clf.bits.rs1p, clf.lwImmed());
 	  return;
 	}
 
@@ -3821,13 +6092,13 @@ Core<URV>::execute16(uint16_t inst)
 	{
 	  ClFormInst clf(inst);
 	  if (isRv64())
-	    execLd(8+clf.bits.rdp, 8+clf.bits.rs1p, clf.ldImmed());
+	    di.set(&Core::execLd, 8+clf.bits.rdp, 8+clf.bits.rs1p, clf.ldImmed());
 	  else
 	    {  // c.flw
 	      if (isRvf())
-		execFlw(8+clf.bits.rdp, 8+clf.bits.rs1p, clf.lwImmed());
+		di.set(&Core::execFlw, 8+clf.bits.rdp, 8+clf.bits.rs1p, clf.lwImmed());
 	      else
-		illegalInst();
+		di.set(&Core::execIllegal);
 	    }
 	  return;
 	}
@@ -3837,17 +6108,17 @@ Core<URV>::execute16(uint16_t inst)
 	  if (isRvd())
 	    {
 	      ClFormInst clf(inst);
-	      execFsd(8+clf.bits.rdp, 8+clf.bits.rs1p, clf.ldImmed());
+	      di.set(&Core::execFsd, 8+clf.bits.rdp, 8+clf.bits.rs1p, clf.ldImmed());
 	    }
 	  else
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  return;
 	}
 
       if (funct3 == 6)  // c.sw
 	{
 	  CsFormInst cs(inst);
-	  execSw(8+cs.bits.rs1p, 8+cs.bits.rs2p, cs.swImmed());
+	  di.set(&Core::execSw, 8+cs.bits.rs1p, 8+cs.bits.rs2p, cs.swImmed());
 	  return;
 	}
 
@@ -3855,19 +6126,19 @@ Core<URV>::execute16(uint16_t inst)
 	{
 	  CsFormInst cs(inst);
 	  if (isRv64())
-	    execSd(8+cs.bits.rs1p, 8+cs.bits.rs2p, cs.sdImmed());
+	    di.set(&Core::execSd, 8+cs.bits.rs1p, 8+cs.bits.rs2p, cs.sdImmed());
 	  else
 	    {
 	      if (isRvf())
-		execFsw(8+cs.bits.rs1p, 8+cs.bits.rs2p, cs.swImmed());
+		di.set(&Core::execFsw, 8+cs.bits.rs1p, 8+cs.bits.rs2p, cs.swImmed());
 	      else
-		illegalInst(); // c.fsw
+		di.set(&Core::execIllegal); // c.fsw
 	    }
 	  return;
 	}
 
       // funct3 is 4 (reserved).
-      illegalInst();
+      di.set(&Core::execIllegal);
       return;
     }
 
@@ -3876,7 +6147,7 @@ Core<URV>::execute16(uint16_t inst)
       if (funct3 == 0)  // c.nop, c.addi
 	{
 	  CiFormInst cif(inst);
-	  execAddi(cif.bits.rd, cif.bits.rd, cif.addiImmed());
+	  di.set(&Core::execAddi, cif.bits.rd, cif.bits.rd, cif.addiImmed());
 	  return;
 	}
 	  
@@ -3886,14 +6157,14 @@ Core<URV>::execute16(uint16_t inst)
 	    {
 	      CiFormInst cif(inst);
 	      if (cif.bits.rd == 0)
-		illegalInst();
+		di.set(&Core::execIllegal);
 	      else
-		execAddiw(cif.bits.rd, cif.bits.rd, cif.addiImmed());
+		di.set(&Core::execAddiw, cif.bits.rd, cif.bits.rd, cif.addiImmed());
 	    }
 	  else
 	    {
 	      CjFormInst cjf(inst);
-	      execJal(RegRa, cjf.immed());
+	      di.set(&Core::execJal, RegRa, cjf.immed());
 	    }
 	  return;
 	}
@@ -3901,7 +6172,7 @@ Core<URV>::execute16(uint16_t inst)
       if (funct3 == 2)  // c.li
 	{
 	  CiFormInst cif(inst);
-	  execAddi(cif.bits.rd, RegX0, cif.addiImmed());
+	  di.set(&Core::execAddi, cif.bits.rd, RegX0, cif.addiImmed());
 	  return;
 	}
 
@@ -3910,11 +6181,11 @@ Core<URV>::execute16(uint16_t inst)
 	  CiFormInst cif(inst);
 	  int immed16 = cif.addi16spImmed();
 	  if (immed16 == 0)
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  else if (cif.bits.rd == RegSp)  // c.addi16sp
-	    execAddi(cif.bits.rd, cif.bits.rd, immed16);
+	    di.set(&Core::execAddi, cif.bits.rd, cif.bits.rd, immed16);
 	  else
-	    execLui(cif.bits.rd, cif.luiImmed());
+	    di.set(&Core::execLui, cif.bits.rd, cif.luiImmed());
 	  return;
 	}
 
@@ -3929,19 +6200,19 @@ Core<URV>::execute16(uint16_t inst)
 	  if (f2 == 0) // srli64, srli
 	    {
 	      if (caf.bits.ic5 != 0 and not isRv64())
-		illegalInst(); // As of v2.3 of User-Level ISA (Dec 2107).
+		di.set(&Core::execIllegal); // As of v2.3 of User-Level ISA (Dec 2107).
 	      else
-		execSrli(rd, rd, caf.shiftImmed());
+		di.set(&Core::execSrli, rd, rd, caf.shiftImmed());
 	    }
 	  else if (f2 == 1) // srai64, srai
 	    {
 	      if (caf.bits.ic5 != 0 and not isRv64())
-		illegalInst(); // As of v2.3 of User-Level ISA (Dec 2107).
+		di.set(&Core::execIllegal); // As of v2.3 of User-Level ISA (Dec 2107).
 	      else
-		execSrai(rd, rd, caf.shiftImmed());
+		di.set(&Core::execSrai, rd, rd, caf.shiftImmed());
 	    }
 	  else if (f2 == 2)  // c.andi
-	    execAndi(rd, rd, immed);
+	    di.set(&Core::execAndi, rd, rd, immed);
 	  else  // f2 == 3: c.sub c.xor c.or c.subw c.addw
 	    {
 	      unsigned rs2p = (immed & 0x7); // Lowest 3 bits of immed
@@ -3949,17 +6220,17 @@ Core<URV>::execute16(uint16_t inst)
 	      unsigned imm34 = (immed >> 3) & 3; // Bits 3 and 4 of immed
 	      if ((immed & 0x20) == 0)  // Bit 5 of immed
 		{
-		  if      (imm34 == 0) execSub(rd, rd, rs2);
-		  else if (imm34 == 1) execXor(rd, rd, rs2);
-		  else if (imm34 == 2) execOr(rd, rd, rs2);
-		  else                 execAnd(rd, rd, rs2);
+		  if      (imm34 == 0) di.set(&Core::execSub, rd, rd, rs2);
+		  else if (imm34 == 1) di.set(&Core::execXor, rd, rd, rs2);
+		  else if (imm34 == 2) di.set(&Core::execOr, rd, rd, rs2);
+		  else                 di.set(&Core::execAnd, rd, rd, rs2);
 		}
 	      else
 		{
-		  if      (imm34 == 0) execSubw(rd, rd, rs2);
-		  else if (imm34 == 1) execAddw(rd, rd, rs2);
-		  else if (imm34 == 2) illegalInst(); // reserved
-		  else                 illegalInst(); // reserved
+		  if      (imm34 == 0) di.set(&Core::execSubw, rd, rd, rs2);
+		  else if (imm34 == 1) di.set(&Core::execAddw, rd, rd, rs2);
+		  else if (imm34 == 2) di.set(&Core::execIllegal); // reserved
+		  else                 di.set(&Core::execIllegal); // reserved
 		}
 	    }
 	  return;
@@ -3968,20 +6239,20 @@ Core<URV>::execute16(uint16_t inst)
       if (funct3 == 5)  // c.j
 	{
 	  CjFormInst cjf(inst);
-	  execJal(RegX0, cjf.immed());
+	  di.set(&Core::execJal, RegX0, cjf.immed());
 	  return;
 	}
 	  
       if (funct3 == 6)  // c.beqz
 	{
 	  CbFormInst cbf(inst);
-	  execBeq(8+cbf.bits.rs1p, RegX0, cbf.immed());
+	  di.set(&Core::execBeq, 8+cbf.bits.rs1p, RegX0, cbf.immed());
 	  return;
 	}
 
       // (funct3 == 7)  // c.bnez
       CbFormInst cbf(inst);
-      execBne(8+cbf.bits.rs1p, RegX0, cbf.immed());
+      di.set(&Core::execBne, 8+cbf.bits.rs1p, RegX0, cbf.immed());
       return;
     }
 
@@ -3992,9 +6263,9 @@ Core<URV>::execute16(uint16_t inst)
 	  CiFormInst cif(inst);
 	  unsigned immed = unsigned(cif.slliImmed());
 	  if (cif.bits.ic5 != 0 and not isRv64())
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  else
-	    execSlli(cif.bits.rd, cif.bits.rd, immed);
+	    di.set(&Core::execSlli, cif.bits.rd, cif.bits.rd, immed);
 	  return;
 	}
 
@@ -4003,10 +6274,10 @@ Core<URV>::execute16(uint16_t inst)
 	  if (isRvd())
 	    {
 	      CiFormInst cif(inst);
-	      execFld(cif.bits.rd, RegSp, cif.ldspImmed());
+	      di.set(&Core::execFld, cif.bits.rd, RegSp, cif.ldspImmed());
 	    }
 	  else
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  return;
 	}
 
@@ -4014,7 +6285,7 @@ Core<URV>::execute16(uint16_t inst)
 	{
 	  CiFormInst cif(inst);
 	  unsigned rd = cif.bits.rd;
-	  execLw(rd, RegSp, cif.lwspImmed());
+	  di.set(&Core::execLw, rd, RegSp, cif.lwspImmed());
 	  return;
 	}
 
@@ -4023,11 +6294,11 @@ Core<URV>::execute16(uint16_t inst)
 	  CiFormInst cif(inst);
 	  unsigned rd = cif.bits.rd;
 	  if (isRv64())  // c.ldsp
-	    execLd(rd, RegSp, cif.ldspImmed());
+	    di.set(&Core::execLd, rd, RegSp, cif.ldspImmed());
 	  else if (isRvf())  // c.flwsp
-	    execFlw(rd, RegSp, cif.lwspImmed());
+	    di.set(&Core::execFlw, rd, RegSp, cif.lwspImmed());
 	  else
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  return;
 	}
 
@@ -4042,24 +6313,24 @@ Core<URV>::execute16(uint16_t inst)
 	      if (rs2 == RegX0)
 		{
 		  if (rd == RegX0)
-		    illegalInst();
+		    di.set(&Core::execIllegal);
 		  else
-		    execJalr(RegX0, rd, 0);
+		    di.set(&Core::execJalr, RegX0, rd, 0);
 		}
 	      else
-		execAdd(rd, RegX0, rs2);
+		di.set(&Core::execAdd, rd, RegX0, rs2);
 	    }
 	  else  // c.ebreak, c.jalr or c.add 
 	    {
 	      if (rs2 == RegX0)
 		{
 		  if (rd == RegX0)
-		    execEbreak();
+		    di.set(&Core::execEbreak);
 		  else
-		    execJalr(RegRa, rd, 0);
+		    di.set(&Core::execJalr, RegRa, rd, 0);
 		}
 	      else
-		execAdd(rd, rd, rs2);
+		di.set(&Core::execAdd, rd, rd, rs2);
 	    }
 	  return;
 	}
@@ -4069,17 +6340,18 @@ Core<URV>::execute16(uint16_t inst)
 	  if (isRvd())
 	    {
 	      CswspFormInst csw(inst);
-	      execFsd(RegSp, csw.bits.rs2, csw.sdImmed());
+	      di.set(&Core::execFsd, RegSp, csw.bits.rs2, csw.sdImmed());
 	    }
 	  else
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  return;
 	}
 
       if (funct3 == 6)  // c.swsp
 	{
 	  CswspFormInst csw(inst);
-	  execSw(RegSp, csw.bits.rs2, csw.swImmed());  // imm(sp) <- rs2
+	  // imm(sp) <- rs2
+	  di.set(&Core::execSw, RegSp, csw.bits.rs2, csw.swImmed());
 	  return;
 	}
 
@@ -4088,21 +6360,22 @@ Core<URV>::execute16(uint16_t inst)
 	  if (isRv64())  // c.sdsp
 	    {
 	      CswspFormInst csw(inst);
-	      execSd(RegSp, csw.bits.rs2, csw.sdImmed());
+	      di.set(&Core::execSd, RegSp, csw.bits.rs2, csw.sdImmed());
 	    }
 	  else if (isRvf())   // c.fswsp
 	    {
 	      CswspFormInst csw(inst);
-	      execFsw(RegSp, csw.bits.rs2, csw.swImmed());  // imm(sp) <- rs2
+	      // imm(sp) <- rs2
+	      di.set(&Core::execFsw, RegSp, csw.bits.rs2, csw.swImmed());
 	    }
 	  else
-	    illegalInst();
+	    di.set(&Core::execIllegal);
 	  return;
 	}
     }
 
   // quadrant 3
-  illegalInst();
+  di.set(&Core::execIllegal);
 }
 
 
@@ -4130,6 +6403,74 @@ Core<URV>::disassembleInst(uint32_t inst, std::string& str)
 }
 
 
+template <typename URV>
+typename Core<URV>::DisassSlice
+Core<URV>::disassSlice(URV pc, uint32_t inst)
+{
+  DisassEntry& entry = disassCache_[(pc >> 1) & (disassCacheSize_ - 1)];
+  if (entry.valid_ and entry.pc_ == pc and entry.inst_ == inst)
+    return entry.text_;
+
+  auto iter = disassIntern_.find(inst);
+  if (iter == disassIntern_.end())
+    {
+      if (disassPool_.size() >= maxDisassPool_)
+	clearDisassCache();
+
+      std::ostringstream oss;
+      disassembleInst(inst, oss);
+      const std::string& text = oss.str();
+
+      DisassSlice slice;
+      slice.offset_ = disassPool_.size();
+      slice.size_ = text.size();
+      disassPool_ += text;
+      iter = disassIntern_.emplace(inst, slice).first;
+    }
+
+  entry.pc_ = pc;
+  entry.inst_ = inst;
+  entry.valid_ = true;
+  entry.text_ = iter->second;
+  return entry.text_;
+}
+
+
+template <typename URV>
+size_t
+Core<URV>::disassembleInst(URV pc, uint32_t inst, char* buffer, size_t size)
+{
+  if (size == 0)
+    return 0;
+
+  DisassSlice slice = disassSlice(pc, inst);
+  size_t len = std::min(size_t(slice.size_), size - 1);
+  memcpy(buffer, disassPool_.data() + slice.offset_, len);
+  buffer[len] = 0;
+  return len;
+}
+
+
+template <typename URV>
+void
+Core<URV>::disassembleInst(URV pc, uint32_t inst, std::string& str)
+{
+  DisassSlice slice = disassSlice(pc, inst);
+  str.assign(disassPool_, slice.offset_, slice.size_);
+}
+
+
+template <typename URV>
+void
+Core<URV>::clearDisassCache()
+{
+  for (auto& entry : disassCache_)
+    entry.valid_ = false;
+  disassPool_.clear();
+  disassIntern_.clear();
+}
+
+
 template <typename URV>
 bool
 Core<URV>::expandInst(uint16_t inst, uint32_t& code32) const
@@ -4895,29 +7236,20 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
   bool quad3 = (inst & 0x3) == 0x3;
   if (quad3)
     {
+      // Common instructions: Opcode table (shared with decode32Exec).
+      if (const OpEntry* entry = lookupOp(inst))
+	{
+	  opOperands(entry->form_, inst, op0, op1, op2);
+	  return instTable_.getInstInfo(entry->id_);
+	}
+
+      // Others and holes of the opcode table.
       unsigned opcode = (inst & 0x7f) >> 2;  // Upper 5 bits of opcode.
 
       goto *opcodeLabels[opcode];
 
 
-    l0:  // 00000   I-form
-      {
-	IFormInst iform(inst);
-	op0 = iform.fields.rd;
-	op1 = iform.fields.rs1;
-	op2 = iform.immed(); 
-	switch (iform.fields.funct3)
-	  {
-	  case 0:  return instTable_.getInstInfo(InstId::lb);
-	  case 1:  return instTable_.getInstInfo(InstId::lh);
-	  case 2:  return instTable_.getInstInfo(InstId::lw);
-	  case 3:  return instTable_.getInstInfo(InstId::ld);
-	  case 4:  return instTable_.getInstInfo(InstId::lbu);
-	  case 5:  return instTable_.getInstInfo(InstId::lhu);
-	  case 6:  return instTable_.getInstInfo(InstId::lwu);
-	  default: return instTable_.getInstInfo(InstId::illegal);
-	  }
-      }
+    l0:  // 00000   I-form: Loads in opcode table.
       return instTable_.getInstInfo(InstId::illegal);
 
     l1:
@@ -5044,7 +7376,7 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
       }
       return instTable_.getInstInfo(InstId::illegal);
 
-    l4:  // 00100  I-form
+    l4:  // 00100  I-form: Shifts (others in opcode table).
       {
 	IFormInst iform(inst);
 	op0 = iform.fields.rd;
@@ -5052,24 +7384,18 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
 	op2 = iform.immed();
 	unsigned funct3 = iform.fields.funct3;
 
-	if      (funct3 == 0)  return instTable_.getInstInfo(InstId::addi);
-	else if (funct3 == 1)
+	unsigned topBits = 0, shamt = 0;
+	iform.getShiftFields(isRv64(), topBits, shamt);
+	if (funct3 == 1)
 	  {
-	    unsigned topBits = 0, shamt = 0;
-	    iform.getShiftFields(isRv64(), topBits, shamt);
 	    if (topBits == 0)
 	      {
 		op2 = shamt;
 		return instTable_.getInstInfo(InstId::slli);
 	      }
 	  }
-	else if (funct3 == 2)  return instTable_.getInstInfo(InstId::slti);
-	else if (funct3 == 3)  return instTable_.getInstInfo(InstId::sltiu);
-	else if (funct3 == 4)  return instTable_.getInstInfo(InstId::xori);
 	else if (funct3 == 5)
 	  {
-	    unsigned topBits = 0, shamt = 0;
-	    iform.getShiftFields(isRv64(), topBits, shamt);
 	    op2 = shamt;
 	    if (topBits == 0)
 	      return instTable_.getInstInfo(InstId::srli);
@@ -5078,17 +7404,6 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
 	    if (topBits == 0x20)
 	      return instTable_.getInstInfo(InstId::srai);
 	  }
-	else if (funct3 == 6)  return instTable_.getInstInfo(InstId::ori);
-	else if (funct3 == 7)  return instTable_.getInstInfo(InstId::andi);
-      }
-      return instTable_.getInstInfo(InstId::illegal);
-
-    l5:  // 00101   U-form
-      {
-	UFormInst uform(inst);
-	op0 = uform.bits.rd;
-	op1 = uform.immed();
-	return instTable_.getInstInfo(InstId::auipc);
       }
       return instTable_.getInstInfo(InstId::illegal);
 
@@ -5120,18 +7435,14 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
       }
       return instTable_.getInstInfo(InstId::illegal);
 
-    l8:  // 01000  S-form
+    l8:  // 01000  S-form: Sd (others in opcode table).
       {
 	SFormInst sform(inst);
 	op0 = sform.bits.rs1;
 	op1 = sform.bits.rs2;
 	op2 = sform.immed();
-	uint32_t funct3 = sform.bits.funct3;
-
-	if (funct3 == 0) return instTable_.getInstInfo(InstId::sb);
-	if (funct3 == 1) return instTable_.getInstInfo(InstId::sh);
-	if (funct3 == 2) return instTable_.getInstInfo(InstId::sw);
-	if (funct3 == 3 and isRv64()) return instTable_.getInstInfo(InstId::sd);
+	if (sform.bits.funct3 == 3 and isRv64())
+	  return instTable_.getInstInfo(InstId::sd);
       }
       return instTable_.getInstInfo(InstId::illegal);
 
@@ -5179,52 +7490,14 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
       }
       return instTable_.getInstInfo(InstId::illegal);
 
-    l12:  // 01100  R-form
-      {
-	RFormInst rform(inst);
-	op0 = rform.bits.rd;
-	op1 = rform.bits.rs1;
-	op2 = rform.bits.rs2;
-	unsigned funct7 = rform.bits.funct7, funct3 = rform.bits.funct3;
-	if (funct7 == 0)
-	  {
-	    if      (funct3 == 0) return instTable_.getInstInfo(InstId::add);
-	    else if (funct3 == 1) return instTable_.getInstInfo(InstId::sll);
-	    else if (funct3 == 2) return instTable_.getInstInfo(InstId::slt);
-	    else if (funct3 == 3) return instTable_.getInstInfo(InstId::sltu);
-	    else if (funct3 == 4) return instTable_.getInstInfo(InstId::xor_);
-	    else if (funct3 == 5) return instTable_.getInstInfo(InstId::srl);
-	    else if (funct3 == 6) return instTable_.getInstInfo(InstId::or_);
-	    else if (funct3 == 7) return instTable_.getInstInfo(InstId::and_);
-	  }
-	else if (funct7 == 1)
-	  {
-	    if      (not isRvm()) return instTable_.getInstInfo(InstId::illegal);
-	    else if (funct3 == 0) return instTable_.getInstInfo(InstId::mul);
-	    else if (funct3 == 1) return instTable_.getInstInfo(InstId::mulh);
-	    else if (funct3 == 2) return instTable_.getInstInfo(InstId::mulhsu);
-	    else if (funct3 == 3) return instTable_.getInstInfo(InstId::mulhu);
-	    else if (funct3 == 4) return instTable_.getInstInfo(InstId::div);
-	    else if (funct3 == 5) return instTable_.getInstInfo(InstId::divu);
-	    else if (funct3 == 6) return instTable_.getInstInfo(InstId::rem);
-	    else if (funct3 == 7) return instTable_.getInstInfo(InstId::remu);
-	  }
-	else if (funct7 == 0x20)
-	  {
-	    if      (funct3 == 0) return instTable_.getInstInfo(InstId::sub);
-	    else if (funct3 == 5) return instTable_.getInstInfo(InstId::sra);
-	  }
-      }
+    l5:   // 00101  auipc: In opcode table.
+    l13:  // 01101  lui: In opcode table.
+    l27:  // 11011  jal: In opcode table.
+    l12:  // 01100  R-form: Holes of opcode table are illegal.
+    l24:  // 11000  B-form: Same.
+    l25:  // 11001  jalr: Same.
       return instTable_.getInstInfo(InstId::illegal);
 
-    l13:  // 01101  U-form
-      {
-	UFormInst uform(inst);
-	op0 = uform.bits.rd;
-	op1 = uform.immed();
-	return instTable_.getInstInfo(InstId::lui);
-      }
-
     l14: // 01110  R-Form
       {
 	const RFormInst rform(inst);
@@ -5254,41 +7527,6 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
       }
       return instTable_.getInstInfo(InstId::illegal);
 
-    l24: // 11000   B-form
-      {
-	BFormInst bform(inst);
-	op0 = bform.bits.rs1;
-	op1 = bform.bits.rs2;
-	op2 = bform.immed();
-	uint32_t funct3 = bform.bits.funct3;
-	if      (funct3 == 0)  return instTable_.getInstInfo(InstId::beq);
-	else if (funct3 == 1)  return instTable_.getInstInfo(InstId::bne);
-	else if (funct3 == 4)  return instTable_.getInstInfo(InstId::blt);
-	else if (funct3 == 5)  return instTable_.getInstInfo(InstId::bge);
-	else if (funct3 == 6)  return instTable_.getInstInfo(InstId::bltu);
-	else if (funct3 == 7)  return instTable_.getInstInfo(InstId::bgeu);
-      }
-      return instTable_.getInstInfo(InstId::illegal);
-
-    l25:  // 11001  I-form
-      {
-	IFormInst iform(inst);
-	op0 = iform.fields.rd;
-	op1 = iform.fields.rs1;
-	op2 = iform.immed();
-	if (iform.fields.funct3 == 0)
-	  return instTable_.getInstInfo(InstId::jalr);
-      }
-      return instTable_.getInstInfo(InstId::illegal);
-
-    l27:  // 11011  J-form
-      {
-	JFormInst jform(inst);
-	op0 = jform.bits.rd;
-	op1 = jform.immed();
-	return instTable_.getInstInfo(InstId::jal);
-      }
-
     l28:  // 11100  I-form
       {
 	IFormInst iform(inst);
@@ -5326,13 +7564,8 @@ Core<URV>::decode(uint32_t inst, uint32_t& op0, uint32_t& op1, int32_t& op2)
 		return instTable_.getInstInfo(InstId::wfi);
 	    }
 	    break;
-	  case 1:  return instTable_.getInstInfo(InstId::csrrw);
-	  case 2:  return instTable_.getInstInfo(InstId::csrrs);
-	  case 3:  return instTable_.getInstInfo(InstId::csrrc);
-	  case 5:  return instTable_.getInstInfo(InstId::csrrwi);
-	  case 6:  return instTable_.getInstInfo(InstId::csrrsi);
-	  case 7:  return instTable_.getInstInfo(InstId::csrrci);
-	  default: return instTable_.getInstInfo(InstId::illegal);
+	  default:  // CSR instructions are in the opcode table.
+	    return instTable_.getInstInfo(InstId::illegal);
 	  }
 	return instTable_.getInstInfo(InstId::illegal);
       }
@@ -6730,24 +8963,15 @@ Core<URV>::disassembleInst16(uint16_t inst, std::string& str)
 
 template <typename URV>
 void
-Core<URV>::enableInstructionFrequency(bool b)
+Core<URV>::enableInstructionFrequency(bool b, InstProfile::Mode mode,
+				      uint64_t samplePeriod)
 {
   instFreq_ = b;
   if (b)
-    {
-      instProfileVec_.resize(size_t(InstId::maxId) + 1);
+    instProfile_.configure(mode, intRegCount(), samplePeriod);
 
-      unsigned regCount = intRegCount();
-      for (auto& inst : instProfileVec_)
-	{
-	  inst.rd_.resize(regCount);
-	  inst.rs1_.resize(regCount);
-	  inst.rs2_.resize(regCount);
-	  inst.rs1Histo_.resize(13);  // FIX: avoid magic 13
-	  inst.rs2Histo_.resize(13);  // FIX: avoid magic 13
-	  inst.immHisto_.resize(13);  // FIX: avoid magic 13
-	}
-    }
+  // Blocks carry instruction ids only in count mode.
+  invalidateDecodeCache();
 }
 
 
@@ -6755,27 +8979,28 @@ template <typename URV>
 void
 Core<URV>::enterDebugMode(DebugModeCause cause, URV pc)
 {
-  if (debugMode_)
+  if (arch_.debugMode)
     {
-      if (debugStepMode_)
-	debugStepMode_ = false;
+      if (arch_.debugStepMode)
+	arch_.debugStepMode = false;
       else
 	std::cerr << "Error: Entering debug-halt while in debug-halt\n";
     }
   else
     {
-      debugMode_ = true;
-      if (debugStepMode_)
+      arch_.debugMode = true;
+      if (arch_.debugStepMode)
 	std::cerr << "Error: Entering debug-halt with debug-step true\n";
-      debugStepMode_ = false;
+      arch_.debugStepMode = false;
     }
 
   URV value = 0;
-  if (csRegs_.read(CsrNumber::DCSR, PrivilegeMode::Machine, debugMode_, value))
+  if (csRegs_.read(CsrNumber::DCSR, PrivilegeMode::Machine, arch_.debugMode,
+		   value))
     {
       value &= ~(URV(7) << 6);   // Clear cause field (starts at bit 6).
       value |= URV(cause) << 6;  // Set cause field
-      if (nmiPending_)
+      if (arch_.nmiPending)
 	value |= URV(1) << 3;    // Set nmip bit.
       csRegs_.poke(CsrNumber::DCSR, value);
 
@@ -6791,14 +9016,14 @@ Core<URV>::enterDebugMode(URV pc)
   // This method is used by the test-bench to make the simulator
   // follow it into debug-halt or debug-stop mode. Do nothing if the
   // simulator got into debug mode on its own.
-  if (debugMode_)
+  if (arch_.debugMode)
     return;   // Already in debug mode.
 
-  if (debugStepMode_)
+  if (arch_.debugStepMode)
     std::cerr << "Error: Enter-debug command finds core in debug-step mode.\n";
 
-  debugStepMode_ = false;
-  debugMode_ = false;
+  arch_.debugStepMode = false;
+  arch_.debugMode = false;
 
   enterDebugMode(DebugModeCause::DEBUGGER, pc);
 }
@@ -6808,24 +9033,24 @@ template <typename URV>
 void
 Core<URV>::exitDebugMode()
 {
-  if (not debugMode_)
+  if (not arch_.debugMode)
     {
       std::cerr << "Error: Bench sent exit debug while not in debug mode.\n";
       return;
     }
 
-  csRegs_.peek(CsrNumber::DPC, pc_);
+  csRegs_.peek(CsrNumber::DPC, arch_.pc);
 
   // If in debug-step go to debug-halt. If in debug-halt go to normal
   // or debug-step based on step-bit in DCSR.
-  if (debugStepMode_)
-    debugStepMode_ = false;
+  if (arch_.debugStepMode)
+    arch_.debugStepMode = false;
   else
     {
-      if (dcsrStep_)
-	debugStepMode_ = true;
+      if (arch_.dcsrStep)
+	arch_.debugStepMode = true;
       else
-	debugMode_ = false;
+	arch_.debugMode = false;
     }
 
   // If pending nmi bit is set in dcsr, set pending nmi in core
@@ -6834,7 +9059,7 @@ Core<URV>::exitDebugMode()
     std::cerr << "Error: Failed to read DCSR in exit debug.\n";
 
   if ((dcsrVal >> 3) & 1)
-    setPendingNmi(nmiCause_);
+    setPendingNmi(arch_.nmiCause);
 }
 
 
@@ -6845,8 +9070,8 @@ Core<URV>::execBlt(uint32_t rs1, uint32_t rs2, int32_t offset)
   SRV v1 = intRegs_.read(rs1),  v2 = intRegs_.read(rs2);
   if (v1 < v2)
     {
-      pc_ = currPc_ + SRV(offset);
-      pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+      arch_.pc = arch_.currPc + SRV(offset);
+      arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
       lastBranchTaken_ = true;
     }
 }
@@ -6859,8 +9084,8 @@ Core<URV>::execBltu(uint32_t rs1, uint32_t rs2, int32_t offset)
   URV v1 = intRegs_.read(rs1),  v2 = intRegs_.read(rs2);
   if (v1 < v2)
     {
-      pc_ = currPc_ + SRV(offset);
-      pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+      arch_.pc = arch_.currPc + SRV(offset);
+      arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
       lastBranchTaken_ = true;
     }
 }
@@ -6873,8 +9098,8 @@ Core<URV>::execBge(uint32_t rs1, uint32_t rs2, int32_t offset)
   SRV v1 = intRegs_.read(rs1),  v2 = intRegs_.read(rs2);
   if (v1 >= v2)
     {
-      pc_ = currPc_ + SRV(offset);
-      pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+      arch_.pc = arch_.currPc + SRV(offset);
+      arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
       lastBranchTaken_ = true;
     }
 }
@@ -6887,8 +9112,8 @@ Core<URV>::execBgeu(uint32_t rs1, uint32_t rs2, int32_t offset)
   URV v1 = intRegs_.read(rs1),  v2 = intRegs_.read(rs2);
   if (v1 >= v2)
     {
-      pc_ = currPc_ + SRV(offset);
-      pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+      arch_.pc = arch_.currPc + SRV(offset);
+      arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
       lastBranchTaken_ = true;
     }
 }
@@ -6898,9 +9123,9 @@ template <typename URV>
 void
 Core<URV>::execJalr(uint32_t rd, uint32_t rs1, int32_t offset)
 {
-  URV temp = pc_;  // pc has the address of the instruction after jalr
-  pc_ = (intRegs_.read(rs1) + SRV(offset));
-  pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+  URV temp = arch_.pc;  // pc has the address of the instruction after jalr
+  arch_.pc = (intRegs_.read(rs1) + SRV(offset));
+  arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
   intRegs_.write(rd, temp);
   lastBranchTaken_ = true;
 }
@@ -6910,9 +9135,9 @@ template <typename URV>
 void
 Core<URV>::execJal(uint32_t rd, uint32_t offset, int32_t)
 {
-  intRegs_.write(rd, pc_);
-  pc_ = currPc_ + SRV(int32_t(offset));
-  pc_ = (pc_ >> 1) << 1;  // Clear least sig bit.
+  intRegs_.write(rd, arch_.pc);
+  arch_.pc = arch_.currPc + SRV(int32_t(offset));
+  arch_.pc = (arch_.pc >> 1) << 1;  // Clear least sig bit.
   lastBranchTaken_ = true;
 }
 
@@ -6929,7 +9154,7 @@ template <typename URV>
 void
 Core<URV>::execAuipc(uint32_t rd, uint32_t imm, int32_t)
 {
-  intRegs_.write(rd, currPc_ + SRV(int32_t(imm)));
+  intRegs_.write(rd, arch_.currPc + SRV(int32_t(imm)));
 }
 
 
@@ -6937,7 +9162,7 @@ template <typename URV>
 void
 Core<URV>::execSlli(uint32_t rd, uint32_t rs1, int32_t amount)
 {
-  if ((amount & 0x20) and not rv64_)
+  if ((amount & 0x20) and not isRv64())
     {
       illegalInst();  // Bit 5 of shift amount cannot be zero in 32-bit.
       return;
@@ -7112,6 +9337,7 @@ Core<URV>::execFence(uint32_t pred, uint32_t succ, int32_t)
 {
   storeQueue_.clear();
   loadQueue_.clear();
+  recountLoadQueueRegs();
 }
 
 
@@ -7119,7 +9345,18 @@ template <typename URV>
 void
 Core<URV>::execFencei(uint32_t, uint32_t, int32_t)
 {
-  return;  // Currently a no-op.
+  invalidateDecodeCache();
+}
+
+
+template <typename URV>
+void*
+Core<URV>::sysMemAddr(URV addr, size_t size)
+{
+  size_t simAddr = 0;
+  if (not memory_.getSimMemAddr(addr, size, simAddr))
+    return nullptr;
+  return reinterpret_cast<void*>(simAddr);
 }
 
 
@@ -7132,7 +9369,9 @@ Core<URV>::emulateNewlib()
   URV a0 = intRegs_.read(RegA0);
   URV a1 = intRegs_.read(RegA1);
   URV a2 = intRegs_.read(RegA2);
-  URV a3 = intRegs_.read(RegA2);
+  URV a3 = intRegs_.read(RegA3);
+  URV a4 = intRegs_.read(RegA4);
+  URV a5 = intRegs_.read(RegA5);
   URV num = intRegs_.read(RegA7);
 
   switch (num)
@@ -7159,34 +9398,36 @@ Core<URV>::emulateNewlib()
     case 66:       // writev
       {
 	int fd = a0;
-
-	size_t iovAddr = 0;
-	if (not memory_.getSimMemAddr(a1, iovAddr))
+	int count = a2;
+	if (count < 0)
 	  return SRV(-1);
 
-	int count = a2;
+	const URV* vec = static_cast<const URV*>(sysMemAddr(a1, count*2*sizeof(URV)));
+	if (not vec)
+	  return SRV(-1);
 
-	unsigned errors = 0;
-	struct iovec* iov = new struct iovec [count];
+	// Pass the guest buffers straight to writev. Vectors are
+	// collected on the stack unless there are many.
+	struct iovec smallIov[16];
+	std::vector<struct iovec> largeIov;
+	struct iovec* iov = smallIov;
+	if (count > 16)
+	  {
+	    largeIov.resize(count);
+	    iov = largeIov.data();
+	  }
 	for (int i = 0; i < count; ++i)
 	  {
-	    URV* vec = (URV*) iovAddr;
 	    URV base = vec[i*2];
 	    URV len = vec[i*2+1];
-	    size_t addr = 0;
-	    if (not memory_.getSimMemAddr(base, addr))
-	      {
-		errors++;
-		break;
-	      }
-	    iov[i].iov_base = (void*) addr;
+	    iov[i].iov_base = sysMemAddr(base, len);
 	    iov[i].iov_len = len;
+	    if (not iov[i].iov_base)
+	      return SRV(-1);
 	  }
-	int rc = -1;
-	if (not errors)
-	  rc = writev(fd, iov, count);
-	delete [] iov;
-	return SRV(rc);
+	if (fd == STDOUT_FILENO or fd == STDERR_FILENO)
+	  flushConsole();
+	return SRV(writev(fd, iov, count));
       }
 
     case 78:       // readlinat
@@ -7200,24 +9441,26 @@ Core<URV>::emulateNewlib()
 	if (not memory_.getSimMemAddr(path, pathAddr))
 	  return SRV(-1);
 
-	size_t bufAddr = 0;
-	if (not memory_.getSimMemAddr(buf, bufAddr))
+	char* bufPtr = static_cast<char*>(sysMemAddr(buf, bufSize));
+	if (not bufPtr)
 	  return SRV(-1);
-	int rc = readlinkat(dirfd, (const char*) pathAddr,
-			    (char*) bufAddr, bufSize);
+	memory_.markModified(buf, bufSize);
+	int rc = readlinkat(dirfd, (const char*) pathAddr, bufPtr, bufSize);
 	return SRV(rc);
       }
 
     case 80:       // fstat
       {
 	int fd = a0;
-	size_t rvBuff = 0;
-	if (not memory_.getSimMemAddr(a1, rvBuff))
+	size_t rvBuff = reinterpret_cast<size_t>
+	  (sysMemAddr(a1, sizeof(URV) == 4 ? 48 : sizeof(struct stat)));
+	if (not rvBuff)
 	  return SRV(-1);
 	struct stat buff;
 	SRV rv = fstat(fd, &buff);
 	if (rv < 0)
 	  return rv;
+	memory_.markModified(a1, sizeof(URV) == 4 ? 48 : sizeof(buff));
 	if (sizeof(URV) == 4)
 	  {
 	    // Copy x86 stat buffer to riscv stat buffer.
@@ -7247,9 +9490,9 @@ Core<URV>::emulateNewlib()
 
     case 214: // brk
       {
-	if (a0 < progBreak_)
-	  return progBreak_;
-	progBreak_ = a0;
+	if (a0 < arch_.progBreak)
+	  return arch_.progBreak;
+	arch_.progBreak = a0;
 	return a0;
       }
 
@@ -7265,25 +9508,111 @@ Core<URV>::emulateNewlib()
     case 63: // read
       {
 	int fd = a0;
-	size_t buffAddr = 0;
-	if (not memory_.getSimMemAddr(a1, buffAddr))
-	  return SRV(-1);
 	size_t count = a2;
-	SRV rv = read(fd, (void*) buffAddr, count);
+	void* buff = sysMemAddr(a1, count);
+	if (not buff)
+	  return SRV(-1);
+	memory_.markModified(a1, count);
+	SRV rv = read(fd, buff, count);
 	return rv;
       }
 
     case 64: // write
       {
 	int fd = a0;
-	size_t buffAddr = 0;
-	if (not memory_.getSimMemAddr(a1, buffAddr))
+	size_t count = a2;
+	const void* buff = sysMemAddr(a1, count);
+	if (not buff)
+	  return SRV(-1);
+	if (fd == STDOUT_FILENO or fd == STDERR_FILENO)
+	  flushConsole();
+	SRV rv = write(fd, buff, count);
+	return rv;
+      }
+
+    case 62: // lseek
+      {
+	int fd = a0;
+	SRV rv = lseek(fd, off_t(SRV(a1)), int(a2));
+	return rv;
+      }
+
+    case 67: // pread64
+      {
+	int fd = a0;
+	size_t count = a2;
+	void* buff = sysMemAddr(a1, count);
+	if (not buff)
 	  return SRV(-1);
+	memory_.markModified(a1, count);
+	SRV rv = pread(fd, buff, count, off_t(SRV(a3)));
+	return rv;
+      }
+
+    case 68: // pwrite64
+      {
+	int fd = a0;
 	size_t count = a2;
-	SRV rv = write(fd, (void*) buffAddr, count);
+	const void* buff = sysMemAddr(a1, count);
+	if (not buff)
+	  return SRV(-1);
+	SRV rv = pwrite(fd, buff, count, off_t(SRV(a3)));
 	return rv;
       }
 
+    case 222: // mmap
+      {
+	// Without an address, mappings are placed below the stack like
+	// Linux does. File contents are copied in: changes are not
+	// written back to the file. Protections are ignored.
+	size_t len = a1;
+	int flags = a3, fd = a4;
+	if (len == 0)
+	  return SRV(-1);
+
+	size_t pageSize = memory_.pageSize();
+	size_t size = (len + pageSize - 1) / pageSize * pageSize;
+	URV addr = a0;
+	if (addr == 0)
+	  {
+	    if (arch_.mmapTop == 0)
+	      {
+		// Keep half the space between the break and the stack
+		// for the stack, at most 8MB.
+		size_t sp = memory_.getPageStartAddr(intRegs_.read(RegSp));
+		size_t reserve = (sp > arch_.progBreak ?
+				  (sp - arch_.progBreak) / 2 : 0);
+		reserve = std::min(reserve, size_t(8*1024*1024));
+		arch_.mmapTop = memory_.getPageStartAddr(sp - reserve);
+	      }
+	    if (size > arch_.mmapTop or arch_.mmapTop - size < arch_.progBreak)
+	      return SRV(-1);
+	    arch_.mmapTop -= size;
+	    addr = arch_.mmapTop;
+	  }
+
+	uint8_t* host = static_cast<uint8_t*>(sysMemAddr(addr, len));
+	if (not host)
+	  return SRV(-1);
+	memory_.markModified(addr, len);
+
+	ssize_t count = 0;
+	if ((flags & 0x20) == 0)   // Not MAP_ANONYMOUS.
+	  {
+	    count = pread(fd, host, len, off_t(a5));
+	    if (count < 0)
+	      return SRV(-1);
+	  }
+	memset(host + count, 0, len - count);
+	return addr;
+      }
+
+    case 215: // munmap
+      {
+	// Mapped memory is not reclaimed.
+	return 0;
+      }
+
     case 93:  // exit
       {
 	throw CoreException(CoreException::Exit, "", 0, a0);
@@ -7299,9 +9628,11 @@ Core<URV>::emulateNewlib()
     case 160: // uname
       {
 	// Assumes that x86 and rv Linux have same layout for struct utsname.
-	size_t buffAddr = 0;
-	if (not memory_.getSimMemAddr(a0, buffAddr))
+	size_t buffAddr = reinterpret_cast<size_t>
+	  (sysMemAddr(a0, sizeof(struct utsname)));
+	if (not buffAddr)
 	  return SRV(-1);
+	memory_.markModified(a0, sizeof(struct utsname));
 	struct utsname* uts = (struct utsname*) buffAddr;
 	int rc = uname(uts);
 	strcpy(uts->release, "4.14.0");
@@ -7369,12 +9700,12 @@ Core<URV>::execEcall(uint32_t, uint32_t, int32_t)
       return;
     }
 
-  if (privMode_ == PrivilegeMode::Machine)
-    initiateException(ExceptionCause::M_ENV_CALL, currPc_, 0);
-  else if (privMode_ == PrivilegeMode::Supervisor)
-    initiateException(ExceptionCause::S_ENV_CALL, currPc_, 0);
-  else if (privMode_ == PrivilegeMode::User)
-    initiateException(ExceptionCause::U_ENV_CALL, currPc_, 0);
+  if (arch_.privMode == PrivilegeMode::Machine)
+    initiateException(ExceptionCause::M_ENV_CALL, arch_.currPc, 0);
+  else if (arch_.privMode == PrivilegeMode::Supervisor)
+    initiateException(ExceptionCause::S_ENV_CALL, arch_.currPc, 0);
+  else if (arch_.privMode == PrivilegeMode::User)
+    initiateException(ExceptionCause::U_ENV_CALL, arch_.currPc, 0);
   else
     assert(0 and "Invalid privilege mode in execEcall");
 }
@@ -7388,7 +9719,7 @@ Core<URV>::execEbreak(uint32_t, uint32_t, int32_t)
     return;
 
   // If in machine mode and DCSR bit ebreakm is set, then enter debug mode.
-  if (privMode_ == PrivilegeMode::Machine)
+  if (arch_.privMode == PrivilegeMode::Machine)
     {
       URV dcsrVal = 0;
       if (peekCsr(CsrNumber::DCSR, dcsrVal))
@@ -7397,23 +9728,30 @@ Core<URV>::execEbreak(uint32_t, uint32_t, int32_t)
 	    {
 	      // The documentation (RISCV external debug support) does
 	      // not say whether or not we set EPC and MTVAL.
-	      enterDebugMode(DebugModeCause::EBREAK, currPc_);
-	      ebreakInst_ = true;
+	      enterDebugMode(DebugModeCause::EBREAK, arch_.currPc);
+	      arch_.ebreakInst = true;
 	      recordCsrWrite(CsrNumber::DCSR);
 	      return;
 	    }
 	}
     }
 
-  URV savedPc = currPc_;  // Goes into MEPC.
-  URV trapInfo = currPc_;  // Goes into MTVAL.
+  URV savedPc = arch_.currPc;  // Goes into MEPC.
+  URV trapInfo = arch_.currPc;  // Goes into MTVAL.
 
   initiateException(ExceptionCause::BREAKP, savedPc, trapInfo);
 
   if (enableGdb_)
     {
-      pc_ = currPc_;
+      arch_.pc = arch_.currPc;
       handleExceptionForGdb(*this);
+
+      // Breakpoints and watchpoints are checked only by untilAddress.
+      if (stopPoints_.hasBreakpoints() or stopPoints_.hasWatchpoints())
+	{
+	  leaveSimpleRun_ = true;
+	  eventTime_ = 0;
+	}
       return;
     }
 }
@@ -7423,7 +9761,7 @@ template <typename URV>
 void
 Core<URV>::execMret(uint32_t, uint32_t, int32_t)
 {
-  if (privMode_ < PrivilegeMode::Machine)
+  if (arch_.privMode < PrivilegeMode::Machine)
     {
       illegalInst();
       return;
@@ -7432,10 +9770,13 @@ Core<URV>::execMret(uint32_t, uint32_t, int32_t)
   if (triggerTripped_)
     return;
 
+  // Privilege checked above: Use the direct hot CSR accessors.
+  typedef typename CsRegs<URV>::HotCsr HotCsr;
+
   // Restore privilege mode and interrupt enable by getting
   // current value of MSTATUS, ...
   URV value = 0;
-  if (not csRegs_.read(CsrNumber::MSTATUS, privMode_, debugMode_, value))
+  if (not csRegs_.readHot(HotCsr::Mstatus, value))
     {
       illegalInst();
       return;
@@ -7449,20 +9790,19 @@ Core<URV>::execMret(uint32_t, uint32_t, int32_t)
   fields.bits_.MPIE = 1;
 
   // ... and putting it back
-  if (not csRegs_.write(CsrNumber::MSTATUS, privMode_, debugMode_,
-			fields.value_))
+  if (not csRegs_.writeHot(HotCsr::Mstatus, fields.value_))
     assert(0 and "Failed to write MSTATUS register\n");
 
   // TBD: Handle MPV.
 
   // Restore program counter from MEPC.
-  URV epc;
-  if (not csRegs_.read(CsrNumber::MEPC, privMode_, debugMode_, epc))
+  URV epc = 0;
+  if (not csRegs_.readHot(HotCsr::Mepc, epc))
     illegalInst();
-  pc_ = (epc >> 1) << 1;  // Restore pc clearing least sig bit.
+  arch_.pc = (epc >> 1) << 1;  // Restore pc clearing least sig bit.
       
   // Update privilege mode.
-  privMode_ = savedMode;
+  arch_.privMode = savedMode;
 }
 
 
@@ -7476,7 +9816,7 @@ Core<URV>::execSret(uint32_t, uint32_t, int32_t)
       return;
     }
 
-  if (privMode_ < PrivilegeMode::Supervisor)
+  if (arch_.privMode < PrivilegeMode::Supervisor)
     {
       illegalInst();
       return;
@@ -7488,7 +9828,8 @@ Core<URV>::execSret(uint32_t, uint32_t, int32_t)
   // Restore privilege mode and interrupt enable by getting
   // current value of MSTATUS, ...
   URV value = 0;
-  if (not csRegs_.read(CsrNumber::SSTATUS, privMode_, debugMode_, value))
+  if (not csRegs_.read(CsrNumber::SSTATUS, arch_.privMode, arch_.debugMode,
+		       value))
     {
       illegalInst();
       return;
@@ -7504,7 +9845,7 @@ Core<URV>::execSret(uint32_t, uint32_t, int32_t)
   fields.bits_.SPIE = 1;
 
   // ... and putting it back
-  if (not csRegs_.write(CsrNumber::SSTATUS, privMode_, debugMode_,
+  if (not csRegs_.write(CsrNumber::SSTATUS, arch_.privMode, arch_.debugMode,
 			fields.value_))
     {
       illegalInst();
@@ -7513,15 +9854,15 @@ Core<URV>::execSret(uint32_t, uint32_t, int32_t)
 
   // Restore program counter from UEPC.
   URV epc;
-  if (not csRegs_.read(CsrNumber::SEPC, privMode_, debugMode_, epc))
+  if (not csRegs_.read(CsrNumber::SEPC, arch_.privMode, arch_.debugMode, epc))
     {
       illegalInst();
       return;
     }
-  pc_ = (epc >> 1) << 1;  // Restore pc clearing least sig bit.
+  arch_.pc = (epc >> 1) << 1;  // Restore pc clearing least sig bit.
 
   // Update privilege mode.
-  privMode_ = savedMode;
+  arch_.privMode = savedMode;
 }
 
 
@@ -7535,7 +9876,7 @@ Core<URV>::execUret(uint32_t, uint32_t, int32_t)
       return;
     }
 
-  if (privMode_ != PrivilegeMode::User)
+  if (arch_.privMode != PrivilegeMode::User)
     {
       illegalInst();
       return;
@@ -7547,7 +9888,8 @@ Core<URV>::execUret(uint32_t, uint32_t, int32_t)
   // Restore privilege mode and interrupt enable by getting
   // current value of MSTATUS, ...
   URV value = 0;
-  if (not csRegs_.read(CsrNumber::USTATUS, privMode_, debugMode_, value))
+  if (not csRegs_.read(CsrNumber::USTATUS, arch_.privMode, arch_.debugMode,
+		       value))
     {
       illegalInst();
       return;
@@ -7559,7 +9901,7 @@ Core<URV>::execUret(uint32_t, uint32_t, int32_t)
   fields.bits_.UPIE = 1;
 
   // ... and putting it back
-  if (not csRegs_.write(CsrNumber::USTATUS, privMode_, debugMode_,
+  if (not csRegs_.write(CsrNumber::USTATUS, arch_.privMode, arch_.debugMode,
 			fields.value_))
     {
       illegalInst();
@@ -7568,12 +9910,12 @@ Core<URV>::execUret(uint32_t, uint32_t, int32_t)
 
   // Restore program counter from UEPC.
   URV epc;
-  if (not csRegs_.read(CsrNumber::UEPC, privMode_, debugMode_, epc))
+  if (not csRegs_.read(CsrNumber::UEPC, arch_.privMode, arch_.debugMode, epc))
     {
       illegalInst();
       return;
     }
-  pc_ = (epc >> 1) << 1;  // Restore pc clearing least sig bit.
+  arch_.pc = (epc >> 1) << 1;  // Restore pc clearing least sig bit.
 }
 
 
@@ -7592,18 +9934,25 @@ Core<URV>::commitCsrWrite(CsrNumber csr, URV csrVal, unsigned intReg,
 {
   // Make auto-increment happen before write for minstret and cycle.
   if (csr == CsrNumber::MINSTRET or csr == CsrNumber::MINSTRETH)
-    retiredInsts_++;
+    arch_.retiredInsts++;
   if (csr == CsrNumber::MCYCLE or csr == CsrNumber::MCYCLEH)
-    cycleCount_++;
+    arch_.cycleCount++;
 
   // Update CSR and integer register.
-  csRegs_.write(csr, privMode_, debugMode_, csrVal);
+  csRegs_.write(csr, arch_.privMode, arch_.debugMode, csrVal);
   intRegs_.write(intReg, intRegVal);
 
+  if (plugins_)
+    {
+      URV val = csrVal;
+      peekCsr(csr, val);
+      plugins_->csrWrite(hartId_, arch_.currPc, unsigned(csr), val);
+    }
+
   if (csr == CsrNumber::DCSR)
     {
-      dcsrStep_ = (csrVal >> 2) & 1;
-      dcsrStepIe_ = (csrVal >> 11) & 1;
+      arch_.dcsrStep = (csrVal >> 2) & 1;
+      arch_.dcsrStepIe = (csrVal >> 11) & 1;
     }
   else if (csr == CsrNumber::MGPMC)
     {
@@ -7613,13 +9962,17 @@ Core<URV>::commitCsrWrite(CsrNumber csr, URV csrVal, unsigned intReg,
 
   // Csr was written. If it was minstret, compensate for
   // auto-increment that will be done by run, runUntilAddress or
-  // singleStep method.
+  // singleStep method. Events are timed in retired instructions:
+  // Have the run loops look at them again.
   if (csr == CsrNumber::MINSTRET or csr == CsrNumber::MINSTRETH)
-    retiredInsts_--;
+    {
+      arch_.retiredInsts--;
+      eventTime_ = 0;
+    }
 
   // Same for mcycle.
   if (csr == CsrNumber::MCYCLE or csr == CsrNumber::MCYCLEH)
-    cycleCount_--;
+    arch_.cycleCount--;
 }
 
 
@@ -7633,9 +9986,11 @@ Core<URV>::execCsrrw(uint32_t rd, uint32_t rs1, int32_t c)
     return;
 
   CsrNumber csr = CsrNumber(c);
+  if (lazyFpFlags_ and csr <= CsrNumber::FCSR)
+    foldHostFpFlags();  // Make FFLAGS/FCSR current.
 
   URV prev = 0;
-  if (not csRegs_.read(csr, privMode_, debugMode_, prev))
+  if (not csRegs_.read(csr, arch_.privMode, arch_.debugMode, prev))
     {
       illegalInst();
       csrException_ = true;
@@ -7644,7 +9999,7 @@ Core<URV>::execCsrrw(uint32_t rd, uint32_t rs1, int32_t c)
 
   URV next = intRegs_.read(rs1);
 
-  if (not csRegs_.isWriteable(csr, privMode_, debugMode_))
+  if (not csRegs_.isWriteable(csr, arch_.privMode, arch_.debugMode))
     {
       illegalInst();
       csrException_ = true;
@@ -7663,9 +10018,11 @@ Core<URV>::execCsrrs(uint32_t rd, uint32_t rs1, int32_t c)
     return;
 
   CsrNumber csr = CsrNumber(c);
+  if (lazyFpFlags_ and csr <= CsrNumber::FCSR)
+    foldHostFpFlags();  // Make FFLAGS/FCSR current.
 
   URV prev = 0;
-  if (not csRegs_.read(csr, privMode_, debugMode_, prev))
+  if (not csRegs_.read(csr, arch_.privMode, arch_.debugMode, prev))
     {
       illegalInst();
       csrException_ = true;
@@ -7679,7 +10036,7 @@ Core<URV>::execCsrrs(uint32_t rd, uint32_t rs1, int32_t c)
       return;
     }
 
-  if (not csRegs_.isWriteable(csr, privMode_, debugMode_))
+  if (not csRegs_.isWriteable(csr, arch_.privMode, arch_.debugMode))
     {
       illegalInst();
       csrException_ = true;
@@ -7698,9 +10055,11 @@ Core<URV>::execCsrrc(uint32_t rd, uint32_t rs1, int32_t c)
     return;
 
   CsrNumber csr = CsrNumber(c);
+  if (lazyFpFlags_ and csr <= CsrNumber::FCSR)
+    foldHostFpFlags();  // Make FFLAGS/FCSR current.
 
   URV prev = 0;
-  if (not csRegs_.read(csr, privMode_, debugMode_, prev))
+  if (not csRegs_.read(csr, arch_.privMode, arch_.debugMode, prev))
     {
       illegalInst();
       csrException_ = true;
@@ -7714,7 +10073,7 @@ Core<URV>::execCsrrc(uint32_t rd, uint32_t rs1, int32_t c)
       return;
     }
 
-  if (not csRegs_.isWriteable(csr, privMode_, debugMode_))
+  if (not csRegs_.isWriteable(csr, arch_.privMode, arch_.debugMode))
     {
       illegalInst();
       csrException_ = true;
@@ -7733,16 +10092,18 @@ Core<URV>::execCsrrwi(uint32_t rd, uint32_t imm, int32_t c)
     return;
 
   CsrNumber csr = CsrNumber(c);
+  if (lazyFpFlags_ and csr <= CsrNumber::FCSR)
+    foldHostFpFlags();  // Make FFLAGS/FCSR current.
 
   URV prev = 0;
-  if (rd != 0 and not csRegs_.read(csr, privMode_, debugMode_, prev))
+  if (rd != 0 and not csRegs_.read(csr, arch_.privMode, arch_.debugMode, prev))
     {
       illegalInst();
       csrException_ = true;
       return;
     }
 
-  if (not csRegs_.isWriteable(csr, privMode_, debugMode_))
+  if (not csRegs_.isWriteable(csr, arch_.privMode, arch_.debugMode))
     {
       illegalInst();
       csrException_ = true;
@@ -7761,9 +10122,11 @@ Core<URV>::execCsrrsi(uint32_t rd, uint32_t imm, int32_t c)
     return;
 
   CsrNumber csr = CsrNumber(c);
+  if (lazyFpFlags_ and csr <= CsrNumber::FCSR)
+    foldHostFpFlags();  // Make FFLAGS/FCSR current.
 
   URV prev = 0;
-  if (not csRegs_.read(csr, privMode_, debugMode_, prev))
+  if (not csRegs_.read(csr, arch_.privMode, arch_.debugMode, prev))
     {
       illegalInst();
       csrException_ = true;
@@ -7777,7 +10140,7 @@ Core<URV>::execCsrrsi(uint32_t rd, uint32_t imm, int32_t c)
       return;
     }
 
-  if (not csRegs_.isWriteable(csr, privMode_, debugMode_))
+  if (not csRegs_.isWriteable(csr, arch_.privMode, arch_.debugMode))
     {
       illegalInst();
       csrException_ = true;
@@ -7796,9 +10159,11 @@ Core<URV>::execCsrrci(uint32_t rd, uint32_t imm, int32_t c)
     return;
 
   CsrNumber csr = CsrNumber(c);
+  if (lazyFpFlags_ and csr <= CsrNumber::FCSR)
+    foldHostFpFlags();  // Make FFLAGS/FCSR current.
 
   URV prev = 0;
-  if (not csRegs_.read(csr, privMode_, debugMode_, prev))
+  if (not csRegs_.read(csr, arch_.privMode, arch_.debugMode, prev))
     {
       illegalInst();
       csrException_ = true;
@@ -7812,7 +10177,7 @@ Core<URV>::execCsrrci(uint32_t rd, uint32_t imm, int32_t c)
       return;
     }
 
-  if (not csRegs_.isWriteable(csr, privMode_, debugMode_))
+  if (not csRegs_.isWriteable(csr, arch_.privMode, arch_.debugMode))
     {
       illegalInst();
       csrException_ = true;
@@ -7872,7 +10237,7 @@ Core<URV>::store(URV addr, STORE_TYPE storeVal)
 	return;  // No exception if earlier trig. Suppress store data trig.
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::STORE_ADDR_MISAL, currPc_, addr);
+      initiateException(ExceptionCause::STORE_ADDR_MISAL, arch_.currPc, addr);
       return;
     }
 
@@ -7886,26 +10251,32 @@ Core<URV>::store(URV addr, STORE_TYPE storeVal)
   if (triggerTripped_)
     return;
 
-  if (not forceAccessFail_ and memory_.write(addr, storeVal))
+  if (not forceAccessFail_ and storeToMemory(addr, storeVal))
     {
-      if (hasLr_ and lrAddr_ == addr)
-	hasLr_ = false;
+      if (arch_.hasLr and arch_.lrAddr == addr)
+	arch_.hasLr = false;
 
-      // If we write to special location, end the simulation.
-      if (toHostValid_ and addr == toHost_ and storeVal != 0)
+      // The to-host and console addresses are in watched pages (see
+      // setToHostAddress): Look for them after writes to such pages.
+      if (memory_.hasWatchedWrite())
 	{
-	  throw CoreException(CoreException::Stop, "write to to-host",
-			      toHost_, storeVal);
-	}
+	  memory_.clearWatchedWrite();
 
-      // If addr is special location, then write to console.
-      if constexpr (sizeof(STORE_TYPE) == 1)
-        {
-	  if (conIoValid_ and addr == conIo_)
+	  // If we write to special location, end the simulation.
+	  if (toHostValid_ and addr == toHost_ and storeVal != 0)
 	    {
-	      if (consoleOut_)
-		fputc(storeVal, consoleOut_);
-	      return;
+	      throw CoreException(CoreException::Stop, "write to to-host",
+				  toHost_, storeVal);
+	    }
+
+	  // If addr is special location, then write to console.
+	  if constexpr (sizeof(STORE_TYPE) == 1)
+	    {
+	      if (conIoValid_ and addr == conIo_)
+		{
+		  putConsoleByte(storeVal);
+		  return;
+		}
 	    }
 	}
       if (maxStoreQueueSize_)
@@ -7919,7 +10290,7 @@ Core<URV>::store(URV addr, STORE_TYPE storeVal)
     {
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::STORE_ACC_FAULT, currPc_, addr);
+      initiateException(ExceptionCause::STORE_ACC_FAULT, arch_.currPc, addr);
     }
 }
 
@@ -8450,7 +10821,7 @@ Core<URV>::effectiveRoundingMode()
     return instRoundingMode_;
 
   URV fcsrVal = 0;
-  if (csRegs_.read(CsrNumber::FCSR, PrivilegeMode::Machine, debugMode_,
+  if (csRegs_.read(CsrNumber::FCSR, PrivilegeMode::Machine, arch_.debugMode,
 		   fcsrVal))
     {
       RoundingMode mode = RoundingMode((fcsrVal >> 5) & 0x7);
@@ -8463,15 +10834,21 @@ Core<URV>::effectiveRoundingMode()
 
 template <typename URV>
 void
-Core<URV>::updateAccruedFpBits()
+Core<URV>::foldHostFpFlags()
 {
+  int flags = fetestexcept(FE_ALL_EXCEPT);
+  if (not flags)
+    return;
+
+  // Clear the host flags: They accumulate until the next fold.
+  std::feclearexcept(FE_ALL_EXCEPT);
+
   URV val = 0;
-  if (csRegs_.read(CsrNumber::FCSR, PrivilegeMode::Machine, debugMode_, val))
+  if (csRegs_.read(CsrNumber::FCSR, PrivilegeMode::Machine, arch_.debugMode,
+		   val))
     {
       URV prev = val;
 
-      int flags = fetestexcept(FE_ALL_EXCEPT);
-      
       if (flags & FE_INEXACT)
 	val |= URV(FpFlags::Inexact);
 
@@ -8488,25 +10865,45 @@ Core<URV>::updateAccruedFpBits()
 	val |= URV(FpFlags::Invalid);
 
       if (val != prev)
-	csRegs_.write(CsrNumber::FCSR, PrivilegeMode::Machine, debugMode_, val);
+	csRegs_.write(CsrNumber::FCSR, PrivilegeMode::Machine, arch_.debugMode,
+		      val);
     }
 }
 
 
-int
-setSimulatorRoundingMode(RoundingMode mode)
+template <typename URV>
+void
+Core<URV>::setSimulatorRoundingMode(RoundingMode mode)
 {
-  int previous = std::fegetround();
+  int hostMode = hostRoundingMode_;
   switch(mode)
     {
-    case RoundingMode::NearestEven: std::fesetround(FE_TONEAREST);  break;
-    case RoundingMode::Zero:        std::fesetround(FE_TOWARDZERO); break;
-    case RoundingMode::Down:        std::fesetround(FE_DOWNWARD);   break;
-    case RoundingMode::Up:          std::fesetround(FE_UPWARD);     break;
-    case RoundingMode::NearestMax:  std::fesetround(FE_TONEAREST);  break; //FIX
+    case RoundingMode::NearestEven: hostMode = FE_TONEAREST;  break;
+    case RoundingMode::Zero:        hostMode = FE_TOWARDZERO; break;
+    case RoundingMode::Down:        hostMode = FE_DOWNWARD;   break;
+    case RoundingMode::Up:          hostMode = FE_UPWARD;     break;
+    case RoundingMode::NearestMax:  hostMode = FE_TONEAREST;  break; //FIX
     default: break;
     }
-  return previous;
+
+  // Changing the host mode is slow: Do it only when the mode changes.
+  if (hostMode != hostRoundingMode_)
+    {
+      std::fesetround(hostMode);
+      hostRoundingMode_ = hostMode;
+    }
+}
+
+
+template <typename URV>
+void
+Core<URV>::restoreHostRoundingMode()
+{
+  if (hostRoundingMode_ != FE_TONEAREST)
+    {
+      std::fesetround(FE_TONEAREST);
+      hostRoundingMode_ = FE_TONEAREST;
+    }
 }
 
 
@@ -8544,7 +10941,7 @@ Core<URV>::execFlw(uint32_t rd, uint32_t rs1, int32_t imm)
     {
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::LOAD_ADDR_MISAL, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ADDR_MISAL, arch_.currPc, addr);
       return;
     }
 
@@ -8557,6 +10954,8 @@ Core<URV>::execFlw(uint32_t rd, uint32_t rs1, int32_t imm)
   uint32_t word = 0;
   if (not forceAccessFail_ and memory_.read(addr, word))
     {
+      if (stopPoints_.hasWatchpoints())
+	stopPoints_.checkAccess(addr, sizeof(word), false);
       UFU ufu;
       ufu.u = word;
       fpRegs_.writeSingle(rd, ufu.f);
@@ -8564,7 +10963,7 @@ Core<URV>::execFlw(uint32_t rd, uint32_t rs1, int32_t imm)
   else
     {
       forceAccessFail_ = false;
-      initiateException(ExceptionCause::LOAD_ACC_FAULT, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ACC_FAULT, arch_.currPc, addr);
       ldStException_ = true;
     }
 }
@@ -8596,14 +10995,6 @@ Core<URV>::execFsw(uint32_t rs1, uint32_t rs2, int32_t imm)
 }
 
 
-inline
-void
-feClearAllExceptions()
-{
-  asm("fnclex");  // std::feclearexcept(FE_ALL_EXCEPT);
-}
-
-
 template <typename URV>
 void
 Core<URV>::execFmadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
@@ -8621,8 +11012,7 @@ Core<URV>::execFmadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8631,7 +11021,6 @@ Core<URV>::execFmadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8652,8 +11041,7 @@ Core<URV>::execFmsub_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8662,7 +11050,6 @@ Core<URV>::execFmsub_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8683,8 +11070,7 @@ Core<URV>::execFnmsub_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8693,7 +11079,6 @@ Core<URV>::execFnmsub_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, -res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8714,8 +11099,7 @@ Core<URV>::execFnmadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8724,7 +11108,6 @@ Core<URV>::execFnmadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, -res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8745,8 +11128,7 @@ Core<URV>::execFadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8754,7 +11136,6 @@ Core<URV>::execFadd_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8775,8 +11156,7 @@ Core<URV>::execFsub_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8784,7 +11164,6 @@ Core<URV>::execFsub_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8805,8 +11184,7 @@ Core<URV>::execFmul_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  std::feclearexcept(FE_ALL_EXCEPT);
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8814,7 +11192,6 @@ Core<URV>::execFmul_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8835,8 +11212,7 @@ Core<URV>::execFdiv_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -8844,7 +11220,6 @@ Core<URV>::execFdiv_s(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8865,15 +11240,13 @@ Core<URV>::execFsqrt_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  std::feclearexcept(FE_ALL_EXCEPT);
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   float res = std::sqrt(f1);
   fpRegs_.writeSingle(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -8986,15 +11359,13 @@ Core<URV>::execFcvt_w_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   SRV result = int32_t(f1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9015,15 +11386,13 @@ Core<URV>::execFcvt_wu_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   URV result = uint32_t(f1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9064,7 +11433,6 @@ Core<URV>::execFeq_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -9086,7 +11454,6 @@ Core<URV>::execFlt_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -9108,7 +11475,6 @@ Core<URV>::execFle_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
 
   float f1 = fpRegs_.readSingle(rs1);
   float f2 = fpRegs_.readSingle(rs2);
@@ -9227,15 +11593,13 @@ Core<URV>::execFcvt_s_w(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   int32_t i1 = intRegs_.read(rs1);
   float result = i1;
   fpRegs_.writeSingle(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9256,15 +11620,13 @@ Core<URV>::execFcvt_s_wu(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   uint32_t u1 = intRegs_.read(rs1);
   float result = u1;
   fpRegs_.writeSingle(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9310,15 +11672,13 @@ Core<URV>::execFcvt_l_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   SRV result = int64_t(f1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9339,15 +11699,13 @@ Core<URV>::execFcvt_lu_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   URV result = uint64_t(f1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9368,15 +11726,13 @@ Core<URV>::execFcvt_s_l(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   int64_t i1 = intRegs_.read(rs1);
   float result = i1;
   fpRegs_.writeSingle(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9397,15 +11753,13 @@ Core<URV>::execFcvt_s_lu(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   uint64_t i1 = intRegs_.read(rs1);
   float result = i1;
   fpRegs_.writeSingle(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9443,7 +11797,7 @@ Core<URV>::execFld(uint32_t rd, uint32_t rs1, int32_t imm)
     {
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::LOAD_ADDR_MISAL, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ADDR_MISAL, arch_.currPc, addr);
       return;
     }
 
@@ -9456,6 +11810,8 @@ Core<URV>::execFld(uint32_t rd, uint32_t rs1, int32_t imm)
   uint64_t val64 = 0;
   if (not forceAccessFail_ and memory_.read(addr, val64))
     {
+      if (stopPoints_.hasWatchpoints())
+	stopPoints_.checkAccess(addr, sizeof(val64), false);
       UDU udu;
       udu.u = val64;
       fpRegs_.write(rd, udu.d);
@@ -9463,7 +11819,7 @@ Core<URV>::execFld(uint32_t rd, uint32_t rs1, int32_t imm)
   else
     {
       forceAccessFail_ = false;
-      initiateException(ExceptionCause::LOAD_ACC_FAULT, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ACC_FAULT, arch_.currPc, addr);
       ldStException_ = true;
     }
 }
@@ -9512,8 +11868,7 @@ Core<URV>::execFmadd_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double f1 = fpRegs_.read(rs1);
   double f2 = fpRegs_.read(rs2);
@@ -9522,7 +11877,6 @@ Core<URV>::execFmadd_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9543,8 +11897,7 @@ Core<URV>::execFmsub_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double f1 = fpRegs_.read(rs1);
   double f2 = fpRegs_.read(rs2);
@@ -9553,7 +11906,6 @@ Core<URV>::execFmsub_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9574,8 +11926,7 @@ Core<URV>::execFnmsub_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double f1 = fpRegs_.read(rs1);
   double f2 = fpRegs_.read(rs2);
@@ -9584,7 +11935,6 @@ Core<URV>::execFnmsub_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, -res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9605,8 +11955,7 @@ Core<URV>::execFnmadd_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double f1 = fpRegs_.read(rs1);
   double f2 = fpRegs_.read(rs2);
@@ -9615,7 +11964,6 @@ Core<URV>::execFnmadd_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, -res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9636,8 +11984,7 @@ Core<URV>::execFadd_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   double d2 = fpRegs_.read(rs2);
@@ -9645,7 +11992,6 @@ Core<URV>::execFadd_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9666,8 +12012,7 @@ Core<URV>::execFsub_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   double d2 = fpRegs_.read(rs2);
@@ -9675,7 +12020,6 @@ Core<URV>::execFsub_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9696,8 +12040,7 @@ Core<URV>::execFmul_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   double d2 = fpRegs_.read(rs2);
@@ -9705,7 +12048,6 @@ Core<URV>::execFmul_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9727,8 +12069,7 @@ Core<URV>::execFdiv_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   double d2 = fpRegs_.read(rs2);
@@ -9736,7 +12077,6 @@ Core<URV>::execFdiv_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9850,15 +12190,13 @@ Core<URV>::execFcvt_d_s(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   float f1 = fpRegs_.readSingle(rs1);
   double result = f1;
   fpRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9879,15 +12217,13 @@ Core<URV>::execFcvt_s_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   float result = d1;
   fpRegs_.writeSingle(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9908,15 +12244,13 @@ Core<URV>::execFsqrt_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   double res = std::sqrt(d1);
   fpRegs_.write(rd, res);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -9997,15 +12331,13 @@ Core<URV>::execFcvt_w_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   SRV result = int32_t(d1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10026,15 +12358,13 @@ Core<URV>::execFcvt_wu_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double d1 = fpRegs_.read(rs1);
   URV result = uint32_t(d1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10055,15 +12385,13 @@ Core<URV>::execFcvt_d_w(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   int32_t i1 = intRegs_.read(rs1);
   double result = i1;
   fpRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10084,15 +12412,13 @@ Core<URV>::execFcvt_d_wu(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   uint32_t i1 = intRegs_.read(rs1);
   double result = i1;
   fpRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10170,15 +12496,13 @@ Core<URV>::execFcvt_l_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double f1 = fpRegs_.read(rs1);
   SRV result = int64_t(f1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10199,15 +12523,13 @@ Core<URV>::execFcvt_lu_d(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   double f1 = fpRegs_.read(rs1);
   URV result = uint64_t(f1);
   intRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10228,15 +12550,13 @@ Core<URV>::execFcvt_d_l(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   int64_t i1 = intRegs_.read(rs1);
   double result = i1;
   fpRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10257,15 +12577,13 @@ Core<URV>::execFcvt_d_lu(uint32_t rd, uint32_t rs1, int32_t rs2)
       return;
     }
 
-  feClearAllExceptions();
-  int prevMode = setSimulatorRoundingMode(riscvMode);
+  setSimulatorRoundingMode(riscvMode);
 
   uint64_t i1 = intRegs_.read(rs1);
   double result = i1;
   fpRegs_.write(rd, result);
 
   updateAccruedFpBits();
-  std::fesetround(prevMode);
 }
 
 
@@ -10407,13 +12725,15 @@ Core<URV>::loadReserve(uint32_t rd, uint32_t rs1)
 	putInLoadQueue(sizeof(LOAD_TYPE), addr, 0, 0);
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::LOAD_ADDR_MISAL, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ADDR_MISAL, arch_.currPc, addr);
       return;
     }
 
   ULT uval = 0;
   if (not forceAccessFail_ and memory_.read(addr, uval))
     {
+      if (stopPoints_.hasWatchpoints())
+	stopPoints_.checkAccess(addr, sizeof(LOAD_TYPE), false);
       URV value;
       if constexpr (std::is_same<ULT, LOAD_TYPE>::value)
         value = uval;
@@ -10436,7 +12756,7 @@ Core<URV>::loadReserve(uint32_t rd, uint32_t rs1)
 	putInLoadQueue(sizeof(LOAD_TYPE), addr, 0, 0);
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::LOAD_ACC_FAULT, currPc_, addr);
+      initiateException(ExceptionCause::LOAD_ACC_FAULT, arch_.currPc, addr);
     }
 }
 
@@ -10449,8 +12769,10 @@ Core<URV>::execLr_w(uint32_t rd, uint32_t rs1, int32_t rs2)
   if (ldStException_ or triggerTripped_)
     return;
 
-  hasLr_ = true;
-  lrAddr_ = loadAddr_;
+  arch_.hasLr = true;
+  arch_.lrAddr = loadAddr_;
+  if (memory_.isShared())
+    memory_.makeReservation(hartId_, arch_.lrAddr);
 }
 
 
@@ -10479,7 +12801,7 @@ Core<URV>::storeConditional(URV addr, STORE_TYPE storeVal)
 	return false; // No exception if earlier trig. Suppress store data trig.
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::STORE_ADDR_MISAL, currPc_, addr);
+      initiateException(ExceptionCause::STORE_ADDR_MISAL, arch_.currPc, addr);
       return false;
     }
 
@@ -10492,16 +12814,22 @@ Core<URV>::storeConditional(URV addr, STORE_TYPE storeVal)
   if (triggerTripped_)
     return false;
 
-  if (not hasLr_ or addr != lrAddr_)
+  if (not arch_.hasLr or addr != arch_.lrAddr)
+    return false;
+
+  // Reservation may have been cancelled by a store of another hart.
+  if (memory_.isShared() and not memory_.hasReservation(hartId_, addr))
     return false;
 
-  if (not forceAccessFail_ and memory_.write(addr, storeVal))
+  if (not forceAccessFail_ and storeToMemory(addr, storeVal))
     {
       // If we write to special location, end the simulation.
-      if (toHostValid_ and addr == toHost_ and storeVal != 0)
+      if (memory_.hasWatchedWrite())
 	{
-	  throw CoreException(CoreException::Stop, "write to to-host",
-			      toHost_, storeVal);
+	  memory_.clearWatchedWrite();
+	  if (toHostValid_ and addr == toHost_ and storeVal != 0)
+	    throw CoreException(CoreException::Stop, "write to to-host",
+				toHost_, storeVal);
 	}
 
       if (maxStoreQueueSize_)
@@ -10516,7 +12844,7 @@ Core<URV>::storeConditional(URV addr, STORE_TYPE storeVal)
     {
       forceAccessFail_ = false;
       ldStException_ = true;
-      initiateException(ExceptionCause::STORE_ACC_FAULT, currPc_, addr);
+      initiateException(ExceptionCause::STORE_ACC_FAULT, arch_.currPc, addr);
     }
 
   return false;
@@ -10745,8 +13073,10 @@ Core<URV>::execLr_d(uint32_t rd, uint32_t rs1, int32_t rs2)
   if (ldStException_ or triggerTripped_)
     return;
 
-  hasLr_ = true;
-  lrAddr_ = loadAddr_;
+  arch_.hasLr = true;
+  arch_.lrAddr = loadAddr_;
+  if (memory_.isShared())
+    memory_.makeReservation(hartId_, arch_.lrAddr);
 }
 
 
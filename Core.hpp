@@ -18,10 +18,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <vector>
+#include <deque>
 #include <iosfwd>
 #include <type_traits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <cfenv>
+#include <cstring>
 #include "InstId.hpp"
 #include "InstInfo.hpp"
 #include "IntRegs.hpp"
@@ -29,10 +37,28 @@
 #include "FpRegs.hpp"
 #include "Memory.hpp"
 #include "InstProfile.hpp"
+#include "TimingModel.hpp"
+#include "TraceRecord.hpp"
+#include "Device.hpp"
+#include "RingBuffer.hpp"
+#include "StopPoints.hpp"
+#include "StopToken.hpp"
 
 namespace WdRiscv
 {
 
+  class Jit;
+  class BinaryTraceWriter;
+  class BlockWriter;
+  class PcProfiler;
+  class SymbolIndex;
+  class Coverage;
+  class AddressTrace;
+  class BasicBlockVector;
+  class PluginSet;
+  struct GdbChannel;
+  class HartMetrics;
+
   /// Thrown by the simulator when a stop (store to to-host) is seen
   /// or when the target program reaches the exit system call.
   class CoreException : public std::exception
@@ -94,12 +120,23 @@ namespace WdRiscv
   };
 
 
+  /// Candidate instruction of a what-if batch (see
+  /// Core::whatIfBatch): the instruction code and its address.
+  struct WhatIfCandidate
+  {
+    uint64_t pc = 0;
+    uint32_t inst = 0;
+  };
+
+
   /// Model a RISCV core with registers of type URV (uint32_t for
   /// 32-bit registers and uint64_t for 64-bit registers).
   template <typename URV>
   class Core
   {
   public:
+
+    friend class Jit;
     
     /// Signed register type corresponding to URV. For example, if URV
     /// is uint32_t, then SRV will be int32_t.
@@ -109,6 +146,14 @@ namespace WdRiscv
     /// count.
     Core(unsigned hartId, size_t memorySize, unsigned intRegCount);
 
+    /// Constructor: Define a core with the given register count using
+    /// the given memory which may be shared with other cores (see
+    /// Memory::setHartCount). The memory must outlive the core. The
+    /// local-memory (ICCM/DCCM/PIC) layout of a shared memory is
+    /// defined by the core with hart id zero: the corresponding
+    /// define methods of other cores only record the layout.
+    Core(unsigned hartId, Memory& memory, unsigned intRegCount);
+
     /// Destructor.
     ~Core();
 
@@ -267,6 +312,216 @@ namespace WdRiscv
     /// defined by defineResetPc (default is zero).
     void reset();
 
+    /// Forget the state associated with the most recently loaded and
+    /// run program: tohost/stop addresses, program break, instruction
+    /// and exception counts, load reservation, privilege mode and
+    /// the program-finished flag. Configuration is kept. Used with
+    /// Memory::clearData and reset to run a new program on a
+    /// configured core (batch mode).
+    void resetProgramState();
+
+    // We model store buffer in order to undo store effects after an
+    // imprecise store exception.
+    struct StoreInfo
+    {
+      StoreInfo(unsigned size = 0, size_t addr = 0, uint64_t data = 0,
+		uint64_t prevData = 0)
+	: size_(size), addr_(addr), newData_(data), prevData_(prevData)
+      { }
+
+      unsigned size_ = 0;  // 0: invalid object.
+      size_t addr_ = 0;
+      uint64_t newData_ = 0;
+      uint64_t prevData_ = 0;
+    };
+
+    // We model non-blocking load buffer in order to undo load
+    // effects after an imprecise load exception.
+    struct LoadInfo
+    {
+      LoadInfo(unsigned size = 0, size_t addr = 0, unsigned regIx = 0,
+	       uint64_t prevData = 0)
+	: size_(size), addr_(addr), regIx_(regIx), prevData_(prevData)
+      { }
+
+      unsigned size_ = 0;  // 0: invalid object.
+      size_t addr_ = 0;
+      unsigned regIx_ = 0;
+      uint64_t prevData_ = 0;
+    };
+
+    /// Mutable architectural state of a hart in one trivially
+    /// copyable, cache-line aligned block: register files, CSR values
+    /// (including the performance counters), program counter and
+    /// scalar hart state. The register file and CSR objects keep
+    /// their metadata (names, masks, trigger setup) and hold pointers
+    /// into this block. A hart is value-initialized so that padding
+    /// bytes are zero: two blocks may be compared with memcmp.
+    struct alignas(64) ArchState
+    {
+      URV intRegs[32];
+      URV pc;                    // Program counter.
+      URV currPc;                // Addr instr being executed (pc before fetch).
+      uint64_t retiredInsts;     // Proxy for minstret CSR.
+      uint64_t cycleCount;       // Proxy for mcycle CSR.
+      uint64_t counter;          // Retired instruction count.
+      uint64_t exceptionCount;
+      uint64_t interruptCount;
+      uint64_t consecutiveIllegalCount;
+      uint64_t counterAtLastIllegal;
+      URV progBreak;             // For brk Linux emulation.
+      URV mmapTop;               // Lowest mmap'ed address (0 if none).
+      URV lrAddr;                // Address of load reservation.
+      NmiCause nmiCause;
+      PrivilegeMode privMode;    // Privilege mode.
+      bool nmiPending;
+      bool hasLr;                // True if there is a load reservation.
+      bool debugMode;            // True on debug mode.
+      bool debugStepMode;        // True in debug step mode.
+      bool dcsrStepIe;           // True if stepie bit set in dcsr.
+      bool dcsrStep;             // True if step bit set in dcsr.
+      bool ebreakInst;           // True if ebreak was executed.
+      bool targetProgFinished;
+
+      double fpRegs[32];
+      uint64_t perfCounters[PerfRegs::maxCounters];
+      URV csrs[size_t(CsrNumber::MAX_CSR_) + 1];  // Indexed by CSR number.
+    };
+
+    static_assert(std::is_trivially_copyable<ArchState>::value);
+
+    /// Return the architectural state block of this hart. Performance
+    /// counters are brought up to date first.
+    const ArchState& archState() const
+    { csRegs_.mPerfRegs_.sync(); return arch_; }
+
+    /// Return a hash of the program-visible state of this hart: the
+    /// program counter, the privilege mode and the integer and
+    /// floating point registers. Two harts running the same program
+    /// in lock-step compare these after each instruction (see whisper
+    /// --diffconfig). The terms are independent so that the
+    /// compiler can vectorize the sum.
+    uint64_t stateDigest() const
+    {
+      uint64_t sum = uint64_t(arch_.pc) ^ (uint64_t(arch_.privMode) << 56);
+      for (unsigned i = 1; i < 32; ++i)
+	sum += uint64_t(arch_.intRegs[i]) ^ (i * 0x9e3779b97f4a7c15);
+      uint64_t fpBits[32];
+      memcpy(fpBits, arch_.fpRegs, sizeof(fpBits));
+      for (unsigned i = 0; i < 32; ++i)
+	sum += fpBits[i] ^ ((i + 32) * 0x9e3779b97f4a7c15);
+      return sum * 0xff51afd7ed558ccd;
+    }
+
+    /// Causes counted separately by getTrapCauseCount.
+    static constexpr unsigned maxTrapCause = 63;
+
+    /// Dynamic state of a hart: the part of the hart that changes as
+    /// instructions execute. Configuration (CSR masks, memory map,
+    /// options) is not included. See saveState and loadState.
+    struct HartState
+    {
+      ArchState arch;
+      Triggers<URV> triggers;
+      bool interruptEnable = false;
+      bool hasActiveTrigger = false;
+      bool hasActiveInstTrigger = false;
+      bool mdseacLocked = false;
+
+      std::vector<EventNumber> eventOfCounter;
+      std::vector<std::vector<unsigned>> countersOfEvent;
+
+      std::vector<StoreInfo> storeQueue;
+      std::vector<LoadInfo> loadQueue;
+
+      // Tallies consistent with the exception/interrupt counts of arch.
+      std::array<uint64_t, maxTrapCause + 1> exceptionCauses = {};
+      std::array<uint64_t, maxTrapCause + 1> interruptCauses = {};
+      uint64_t triggerTrips = 0;
+
+      /// Apply the given function to each field other than triggers.
+      /// Used to serialize a state (see saveCheckpoint).
+      template <typename F>
+      void forEachField(F f)
+      {
+	f(arch);
+	f(interruptEnable); f(hasActiveTrigger); f(hasActiveInstTrigger);
+	f(mdseacLocked);
+	f(eventOfCounter); f(countersOfEvent);
+	f(storeQueue); f(loadQueue);
+	f(exceptionCauses); f(interruptCauses); f(triggerTrips);
+      }
+    };
+
+    /// Copy the dynamic state of this hart into the given object.
+    void saveState(HartState& state) const;
+
+    /// Set the dynamic state of this hart from the given object which
+    /// must have been obtained with saveState from a hart of the same
+    /// configuration.
+    void loadState(const HartState& state);
+
+    /// Take a snapshot of this hart: save its dynamic state and, if
+    /// withMemory is true, take a snapshot of the memory (see
+    /// Memory::takeSnapshot). When the memory is shared among harts,
+    /// exactly one hart should snapshot it. Harts sharing the memory
+    /// must not be running.
+    void takeSnapshot(bool withMemory = true);
+
+    /// Restore this hart (and, if withMemory is true, the memory) to
+    /// the most recent snapshot. The snapshot remains valid and may
+    /// be restored again. Return false if there is no snapshot.
+    bool restoreSnapshot(bool withMemory = true);
+
+    /// Discard the snapshot of this hart and of the memory.
+    void dropSnapshot();
+
+    /// Enable reverse execution (see reverseStep and reverseContinue)
+    /// if interval is non-zero, disable it otherwise. From now on, the
+    /// state of this hart is saved in host memory every interval
+    /// executed instructions (keeping the most recent
+    /// maxReversePoints_) and the original contents of modified memory
+    /// bytes are kept in an undo journal of journalBytes bytes (see
+    /// Memory::enableJournal). Runs use the step engine. The hart must
+    /// be the only user of its memory. State changes made other than
+    /// by executing instructions (pokes) are not recorded: going back
+    /// past them loses them.
+    void enableReverse(uint64_t interval, size_t journalBytes);
+
+    /// Return true if reverse execution is enabled.
+    bool isReverseEnabled() const
+    { return reverseInterval_ != 0; }
+
+    /// Go back count executed instructions (see getInstructionCount)
+    /// by restoring the most recent saved state preceding the target
+    /// and re-executing up to the target without trace or console
+    /// output. Return false if the target precedes the oldest state
+    /// still available, in which case the hart is left at that state.
+    bool reverseStep(uint64_t count = 1);
+
+    /// Go back to the most recent point preceding the current one at
+    /// which a run would have stopped for a breakpoint or a
+    /// watchpoint. Return false if there is no such point in the
+    /// available history, in which case the hart is left at the
+    /// oldest saved state.
+    bool reverseContinue();
+
+    /// Save the current state as a reverse execution point (see
+    /// enableReverse) so that going back to the current instruction
+    /// count or later never re-executes from an earlier point: State
+    /// changes made before by other means than executing instructions
+    /// (pokes) are kept. Do nothing if reverse execution is disabled.
+    void markReversePoint()
+    { if (reverseInterval_) saveReversePoint(); }
+
+    /// Return true if the instruction at the program counter can be
+    /// executed and then undone by going back (see reverseStep): its
+    /// effects are confined to this hart and its memory. Loads and
+    /// stores to watched pages (console io, tohost) or to memory
+    /// mapped registers (devices), CSR and atomic instructions, fence.i,
+    /// ecall and ebreak are not.
+    bool isUndoableStep();
+
     /// Run fetch-decode-execute loop. If a stop address (see
     /// setStopAddress) is defined, stop when the program counter
     /// reaches that address. If a tohost address is defined (see
@@ -275,6 +530,88 @@ namespace WdRiscv
     /// file a record for each executed instruction.
     bool run(FILE* file = nullptr);
 
+    /// Run with the fast execution loop until the count of retired
+    /// instructions reaches or exceeds the given limit (checked at
+    /// basic block boundaries), until tohost is written or until exit
+    /// is called. Set stopped to true if the target program stopped.
+    /// Return false if it stopped with a failure. This is used to
+    /// fast-forward a hart to a point of interest: instruction count
+    /// limit, stop address, trigger and performance counter options
+    /// are ignored.
+    bool runUntilRetired(uint64_t limit, bool& stopped)
+    { leaveSimpleRun_ = false; return simpleRun(limit, stopped); }
+
+    /// Windows of a traced run (see setTraceWindows). Each kind of
+    /// condition left empty (zero for privModes) is always true.
+    struct TraceWindows
+    {
+      /// Ranges [begin, end) of instruction numbers (as in the trace).
+      std::vector<std::pair<uint64_t, uint64_t>> counts;
+
+      /// Ranges [begin, end) of instruction addresses.
+      std::vector<std::pair<URV, URV>> pcs;
+
+      /// Bit (1 << mode) set for each traced privilege mode.
+      unsigned privModes = 0;
+
+      /// Trace between a start-trace and a stop-trace trigger action.
+      bool triggers = false;
+
+      bool empty() const
+      { return counts.empty() and pcs.empty() and not privModes and
+	  not triggers; }
+    };
+
+    /// Restrict the trace of the run method to the instructions
+    /// satisfying all the conditions of the given windows: number in
+    /// one of the count ranges, address in one of the pc ranges,
+    /// privilege mode among the traced ones and, with trigger
+    /// windows, tracing started by a trigger (tracing changes after
+    /// the instruction tripping the trigger). Outside the windows the
+    /// run uses the fast untraced loop unless options requiring
+    /// per-instruction simulation (triggers, breakpoints ...) are in
+    /// use.
+    void setTraceWindows(const TraceWindows& windows)
+    {
+      traceWindows_ = windows;
+      traceTriggerOn_ = false;
+      invalidateDecodeCache();  // Blocks end at pc window starts.
+    }
+
+    /// Return the number of instructions traced in windows.
+    uint64_t getWindowTracedCount() const
+    { return windowTraced_; }
+
+    /// Return the count of instructions retired by this hart.
+    uint64_t getRetiredCount() const
+    { return arch_.retiredInsts; }
+
+    /// Save the dynamic state (see HartState) of the given cores and
+    /// the used pages of the memory they share into the given
+    /// file. Return true on success.
+    static bool saveCheckpoint(const std::string& path,
+			       const std::vector<Core<URV>*>& cores);
+
+    /// Restore the given cores and their memory from the given
+    /// checkpoint file. The cores must have the configuration of the
+    /// cores the checkpoint was saved from. Memory pages are mapped
+    /// from the file and brought in on first access making the cost
+    /// of a restore independent of the size of the checkpoint.
+    /// Return true on success.
+    static bool loadCheckpoint(const std::string& path,
+			       const std::vector<Core<URV>*>& cores);
+
+    /// Run the given cores, which must share one memory (see
+    /// Memory::setHartCount), each in its own thread. The cores
+    /// synchronize every quantum retired instructions: the run ends
+    /// at the first synchronization point following the stop of any
+    /// core (write to tohost, exit system call) or a stop request
+    /// (see setStopToken). Return true if all the stopped cores succeeded.
+    /// Instruction-count-limit, end-address, trigger, performance
+    /// counter and gdb options are ignored in this mode.
+    static bool runHarts(const std::vector<Core<URV>*>& cores,
+			 uint64_t quantum);
+
     /// Run one instruction at the current program counter. Update
     /// program counter. If file is non-null then print thereon
     /// tracing information related to the executed instruction.
@@ -297,6 +634,39 @@ namespace WdRiscv
     /// exception).
     bool whatIfSingleStep(uint32_t inst, ChangeRecord& record);
 
+    /// Determine the effect of each of the given candidates as
+    /// whatIfSingleStep(pc, inst, record) does, each from the current
+    /// state of this hart, setting the ith record to the changes of
+    /// the ith candidate (hasException set if it would take an
+    /// exception). The candidates that change nothing but the
+    /// registers of the hart are spread over this hart and its what-if
+    /// helpers (see setWhatIfHelpers), each helper evaluating its share
+    /// in its own thread from a copy of the dynamic state of this hart.
+    /// The others (stores, atomics, CSR accesses, system calls and
+    /// loads from devices with read side effects) are evaluated by this
+    /// hart afterwards.
+    void whatIfBatch(const std::vector<WhatIfCandidate>& candidates,
+		     std::vector<ChangeRecord>& records);
+
+    /// Define the helpers of whatIfBatch: harts that share the memory
+    /// of this hart, have its hart id and have its configuration
+    /// (their memory layout definitions must only be recorded, see
+    /// followMemoryLayout). Pass an empty vector to evaluate what-if
+    /// batches in the calling thread only.
+    void setWhatIfHelpers(const std::vector<Core<URV>*>& helpers)
+    { whatIfHelpers_ = helpers; }
+
+    /// If flag is true, only record the local-memory (ICCM/DCCM/PIC)
+    /// layout given to the define methods of this hart: the memory is
+    /// shared with a hart defining it (see setWhatIfHelpers). Must be
+    /// called before the layout is defined.
+    void followMemoryLayout(bool flag)
+    { followLayout_ = flag; }
+
+    /// Return the memory of this hart.
+    Memory& getMemory()
+    { return memory_; }
+
     /// Run until the program counter reaches the given address. Do
     /// execute the instruction at that address. If file is non-null
     /// then print thereon tracing information after each executed
@@ -304,9 +674,18 @@ namespace WdRiscv
     bool runUntilAddress(URV address, FILE* file = nullptr);
 
     /// Helper to runUntiAddress: Same as runUntilAddress but does not
-    /// print run-time and instructions per second.
+    /// print run-time and instructions per second. Also stop before
+    /// executing an instruction at a breakpoint (other than the first
+    /// one) and after executing an instruction accessing a watched
+    /// location (see stopPoints). In gdb mode, report to gdb and keep
+    /// going instead of stopping.
     bool untilAddress(URV address, FILE* file = nullptr);
 
+    /// Return the breakpoints and watchpoints of this hart. When any
+    /// is defined, run goes through untilAddress.
+    StopPoints& stopPoints()
+    { return stopPoints_; }
+
     /// Define the program counter value at which the run method will
     /// stop.
     void setStopAddress(URV address)
@@ -320,15 +699,36 @@ namespace WdRiscv
     /// a byte (lb/sb) from/to that address reads/writes a byte to/from
     /// the console.
     void setConsoleIo(URV address)
-    { conIo_ = address; conIoValid_ = true; }
+    { conIo_ = address; conIoValid_ = true; memory_.watchPage(address); }
 
     /// Undefine console io address (see setConsoleIo).
     void clearConsoleIo()
     { conIoValid_ = false; }
 
-    /// Console output gets directed to given file.
+    /// Console output gets directed to given file. Pending output is
+    /// written to the previous file.
     void setConsoleOutput(FILE* out)
-    { consoleOut_ = out; }
+    { flushConsole(); consoleOut_ = out; }
+
+    /// Write pending console output to the console output file. This
+    /// is done at end of line, when the target program reads the
+    /// console or uses a write system call on standard output/error,
+    /// at the end of a run and, if enabled, whenever the core stops
+    /// (see setConsoleFlushOnStop).
+    void flushConsole()
+    {
+      if (conBufSize_ and consoleOut_)
+	{
+	  fwrite(conBuf_, 1, conBufSize_, consoleOut_);
+	  fflush(consoleOut_);
+	}
+      conBufSize_ = 0;
+    }
+
+    /// Flush console output after every single step (interactive and
+    /// server mode) and not only at end of line if flag is true.
+    void setConsoleFlushOnStop(bool flag)
+    { conFlushOnStop_ = flag; }
 
     /// If a console io memory mapped location is defined then put its
     /// address in address and return true; otherwise, return false
@@ -344,6 +744,16 @@ namespace WdRiscv
     /// string.
     void disassembleInst(uint32_t inst, std::string& str);
 
+    /// Disassemble the instruction with the given code located at the
+    /// given address into the given buffer of the given size. The text
+    /// is null terminated and truncated if the buffer is too small.
+    /// Return the length of the text. The result is cached by address
+    /// and code: repeated calls for the same instruction do not format.
+    size_t disassembleInst(URV pc, uint32_t inst, char* buffer, size_t size);
+
+    /// Same as above but put the text into the given string.
+    void disassembleInst(URV pc, uint32_t inst, std::string& str);
+
     /// Helper to disassembleInst. Disassemble a 32-bit instruction.
     void disassembleInst32(uint32_t inst, std::ostream&);
 
@@ -383,6 +793,12 @@ namespace WdRiscv
     /// tokens each consisting of two hexadecimal digits.
     bool loadHexFile(const std::string& file);
 
+    /// Invalidate all the entries of the decoded-instruction and of
+    /// the basic-block caches. This is done on reset, when loading a program and when
+    /// the memory map changes. Entries are also re-validated against
+    /// memory on every hit (see DecodedInst).
+    void invalidateDecodeCache();
+
     /// Load the given ELF file and set memory locations accordingly.
     /// Return true on success. Return false if file does not exists,
     /// cannot be opened or contains malformed data. If successful,
@@ -393,6 +809,11 @@ namespace WdRiscv
 		     size_t& exitPoint,
 		     std::unordered_map<std::string, ElfSymbol >& symbols);
 
+    /// Same as above but for an already opened ELF file and without
+    /// collecting symbols (see Memory::loadElfFile).
+    bool loadElfFile(const ElfFile& elf, size_t& entryPoint,
+		     size_t& exitPoint);
+
     /// Set val to the value of the memory byte at the given address
     /// returning true on success and false if address is out of
     /// bounds.
@@ -431,6 +852,15 @@ namespace WdRiscv
     void defineResetPc(URV addr)
     { resetPc_ = addr; }
 
+    /// Return the value of program counter after a reset (see
+    /// defineResetPc).
+    URV getResetPc() const
+    { return resetPc_; }
+
+    /// Return the id of this hart.
+    unsigned hartId() const
+    { return hartId_; }
+
     /// Define value of program counter after a non-maskable interrupt.
     void defineNmiPc(URV addr)
     { nmiPc_ = addr; }
@@ -478,6 +908,27 @@ namespace WdRiscv
     void lastCsr(std::vector<CsrNumber>& csrs,
 		 std::vector<unsigned>& triggers) const;
 
+    /// Support for tracing and server mode: Append to the given
+    /// vector the changes made by the last executed instruction:
+    /// integer register, floating point register, CSRs and trigger
+    /// components in CSR number order (trigger number in bits 16 and
+    /// up for the latter), then memory (full written value and
+    /// size). Nothing is allocated once the vector has grown to the
+    /// largest change count. Debug CSRs are skipped when the hart is
+    /// not in debug mode unless withDebugCsrs is true.
+    void collectChanges(std::vector<TraceChange>& changes,
+			bool withDebugCsrs = true) const;
+
+    /// Return the changes made by the last executed instruction (see
+    /// collectChanges). The returned vector is reused by the next
+    /// call.
+    const std::vector<TraceChange>& lastChanges()
+    {
+      lastChanges_.clear();
+      collectChanges(lastChanges_);
+      return lastChanges_;
+    }
+
     /// Support for tracing: Fill the addresses and words vectors with
     /// the addresses of the memory words modified by the last
     /// executed instruction and their corresponding values.
@@ -497,11 +948,11 @@ namespace WdRiscv
 
     /// Reset executed instruction count.
     void setInstructionCount(uint64_t count)
-    { counter_ = count; }
+    { arch_.counter = count; }
 
     /// Get executed instruction count.
     uint64_t getInstructionCount() const 
-    { return counter_; }
+    { return arch_.counter; }
 
     /// Define instruction closed coupled memory (in core instruction memory).
     bool defineIccm(size_t region, size_t offset, size_t size);
@@ -523,10 +974,20 @@ namespace WdRiscv
 					     size_t registerIx,
 					     uint32_t mask);
 
+    /// Define a machine timer (see Timer in Device.hpp) raising the
+    /// machine timer interrupt (MTIP bit of MIP) of this hart. The
+    /// given region and offset define a memory mapped register region
+    /// of the given size. Harts sharing memory have consecutive timer
+    /// register blocks starting at the beginning of that region. A
+    /// hart accessing the block of another hart gets an access fault.
+    /// Return true on success and false if the region is invalid or
+    /// too small.
+    bool defineTimer(size_t region, size_t offset, size_t size);
+
     /// Called after memory is configured to refine memory access to
     /// sections of regions containing ICCM, DCCM or PIC-registers.
     void finishMemoryConfig()
-    { memory_.finishMemoryConfig();}
+    { if (ownsMemoryLayout()) memory_.finishMemoryConfig(); }
 
     /// Direct the core to take an instruction access fault exception
     /// within the next singleStep invocation.
@@ -544,24 +1005,145 @@ namespace WdRiscv
     void setTraceLoad(bool flag)
     { traceLoad_ = flag; }
 
+    /// Write instruction trace records in binary form to the given
+    /// writer instead of text to the trace file. The trace file
+    /// passed to run/singleStep/... must still be non-null to enable
+    /// tracing. Pass nullptr to go back to text.
+    void setBinaryTrace(BinaryTraceWriter* writer)
+    { binaryTrace_ = writer; }
+
+    /// Format text instruction trace records into the buffer of the
+    /// given writer which writes them to the trace file from a
+    /// background thread. The trace file passed to run/singleStep/...
+    /// must still be non-null to enable tracing. Pass nullptr to go
+    /// back to writing directly to the trace file.
+    void setAsyncTrace(BlockWriter* writer)
+    { asyncTrace_ = writer; }
+
+    /// Annotate each record of the text instruction trace with the
+    /// function and offset of its address (for example <main+0x1c>)
+    /// found in the given index. Pass nullptr to stop annotating.
+    void setTraceSymbols(const SymbolIndex* index)
+    { traceSymbols_ = index; }
+
+    /// Pass each retired instruction to the given profiler. This
+    /// selects the slower per-instruction run loop. Pass nullptr to
+    /// stop profiling.
+    void setPcProfiler(PcProfiler* profiler)
+    { pcProfiler_ = profiler; }
+
+    /// Record each retired instruction in the given code coverage
+    /// (see Coverage). Runs keep using the fast execution loop. Pass
+    /// nullptr to stop recording.
+    void setCoverage(Coverage* coverage)
+    { coverage_ = coverage; }
+
+    /// Use the given timing model to estimate the cycles of the
+    /// retired instructions: Its stall cycles are added to the cycle
+    /// count (MCYCLE) and its cache/branch events are reported to the
+    /// performance counters. Runs keep using the fast execution
+    /// loop. Pass nullptr to count one cycle per instruction.
+    void setTimingModel(TimingModel* model)
+    { timing_ = model; }
+
+    /// Record the instruction fetches and the data accesses of the
+    /// retired instructions in the given address trace. Runs keep
+    /// using the fast execution loop. Pass nullptr to stop recording.
+    void setAddressTrace(AddressTrace* trace)
+    { addrTrace_ = trace; }
+
+    /// Record the basic blocks of the retired instructions in the
+    /// given basic block vector profile. Runs keep using the fast
+    /// execution loop. Pass nullptr to stop recording.
+    void setBasicBlockVector(BasicBlockVector* bbv)
+    { bbv_ = bbv; }
+
+    /// Call the hooks of the given plugins (see WhisperPlugin.h) as
+    /// instructions retire, access memory, trap or write CSRs. The
+    /// fast run loop is specialized for the retire and memory access
+    /// hooks in use: the cost of plugins without them is that of a
+    /// trap or of a CSR instruction. Pass nullptr to remove them.
+    void setPlugins(PluginSet* plugins)
+    { plugins_ = plugins; }
+
+    /// Publish the retired instruction count, cycle count, program
+    /// counter and trap counts of this hart to the given live metrics
+    /// block every HartMetrics::period retired instructions and at the
+    /// end of a run. Runs keep using the fast execution loop. Pass
+    /// nullptr to stop publishing.
+    void setMetrics(HartMetrics* metrics)
+    {
+      metrics_ = metrics;
+      metricsTime_ = metrics ? arch_.retiredInsts : ~uint64_t(0);
+    }
+
+    /// Return the bus of the device models of this hart. Devices
+    /// attached to it are dispatched the loads/stores falling in
+    /// their register range. Their events fire once the retired
+    /// instruction count of this hart reaches the event time (checked
+    /// between basic blocks in the fast run loop, so an event may
+    /// fire a few instructions late).
+    DeviceBus& deviceBus()
+    { return deviceBus_; }
+
     /// Return count of traps (exceptions or interrupts) seen by this
     /// core.
     uint64_t getTrapCount() const
-    { return exceptionCount_ + interruptCount_; }
+    { return arch_.exceptionCount + arch_.interruptCount; }
 
     /// Return count of exceptions seen by this core.
     uint64_t getExceptionCount() const
-    { return exceptionCount_; }
+    { return arch_.exceptionCount; }
 
     /// Return count of interrupts seen by this core.
     uint64_t getInterruptCount() const
-    { return interruptCount_; }
+    { return arch_.interruptCount; }
+
+    /// Return the number of exceptions (interrupts if interrupt is
+    /// true) of the given cause seen by this core. Causes from
+    /// maxTrapCause up are counted together.
+    uint64_t getTrapCauseCount(bool interrupt, unsigned cause) const
+    {
+      const auto& counts = interrupt ? interruptCauses_ : exceptionCauses_;
+      return counts.at(std::min(cause, maxTrapCause));
+    }
+
+    /// Return the number of actions (breakpoint exceptions or entries
+    /// into debug mode) taken by this core on debug trigger trips.
+    uint64_t getTriggerTripCount() const
+    { return triggerTrips_; }
+
+    /// Execution modes of the run methods: fast loop (see simpleRun),
+    /// per-instruction loop (see untilAddress), trace windows (see
+    /// setTraceWindows) and multi-hart run (see runHarts).
+    enum class RunMode { Fast, Until, Windowed, Harts, Count };
+
+    /// Runs, instructions executed and wall-clock time of the runs of
+    /// this core in an execution mode.
+    struct RunModeStats
+    {
+      uint64_t runs = 0;
+      uint64_t instructions = 0;
+      double seconds = 0;
+    };
+
+    /// Return the statistics of the given execution mode.
+    const RunModeStats& getRunModeStats(RunMode mode) const
+    { return runModes_.at(size_t(mode)); }
 
     /// Set pre and post to the count of "before"/"after" triggers
     /// that tripped by the last executed instruction.
     void countTrippedTriggers(unsigned& pre, unsigned& post) const
     { csRegs_.countTrippedTriggers(pre, post); }
 
+    /// Return the number of debug triggers.
+    unsigned triggerCount() const
+    { return csRegs_.triggerCount(); }
+
+    /// Return true if the hit bit of the given debug trigger is set.
+    bool isTriggerHit(unsigned trigger) const
+    { return csRegs_.isTriggerHit(trigger); }
+
     /// Apply an imprecise store exception at given address. Return
     /// true if address is found exactly once in the store
     /// queue. Return false otherwise. Save the given address in
@@ -593,10 +1175,20 @@ namespace WdRiscv
 
     /// Set load queue size (used when load exceptions are enabled).
     void setLoadQueueSize(unsigned size)
-    { maxLoadQueueSize_ = size; }
+    {
+      loadQueue_.setCapacity(size);
+      recountLoadQueueRegs();
+    }
 
-    /// Enable collection of instruction frequencies.
-    void enableInstructionFrequency(bool b);
+    /// Enable collection of instruction frequencies (see
+    /// reportInstructionFrequency). In Count mode only execution
+    /// counts are collected: runs keep using the fast execution loop.
+    /// In Operands mode, register use and operand value histograms
+    /// are also collected for one of every samplePeriod instructions
+    /// (all of them if samplePeriod is 0 or 1).
+    void enableInstructionFrequency(bool b, InstProfile::Mode mode =
+				    InstProfile::Mode::Operands,
+				    uint64_t samplePeriod = 1);
 
     /// Put the core in debug mode setting the DCSR cause field to the
     /// given cause.
@@ -609,11 +1201,11 @@ namespace WdRiscv
 
     /// True if in debug mode.
     bool inDebugMode() const
-    { return debugMode_; }
+    { return arch_.debugMode; }
 
     /// True if in debug-step mode.
     bool inDebugStepMode() const
-    { return debugStepMode_; }
+    { return arch_.debugStepMode; }
 
     /// Take the core out of debug mode.
     void exitDebugMode();
@@ -631,6 +1223,12 @@ namespace WdRiscv
     /// Print collected instruction frequency to the given file.
     void reportInstructionFrequency(FILE* file) const;
 
+    /// Add the instruction frequencies collected by the given core
+    /// to those of this core. Both must have been enabled with the
+    /// same mode (see enableInstructionFrequency).
+    void mergeInstructionFrequency(const Core<URV>& other)
+    { instProfile_.merge(other.instProfile_); }
+
     /// Reset trace data (items changed by the execution of an
     /// instruction.)
     void clearTraceData();
@@ -649,10 +1247,32 @@ namespace WdRiscv
     void enableGdb(bool flag)
     { enableGdb_ = flag; }
 
+    /// Talk to gdb over the given connection (see openGdbTcpPort in
+    /// gdb.cpp). Harts may share a connection. Without one, a
+    /// connection on the standard input/output is created at the
+    /// first gdb stop.
+    void setGdbChannel(std::shared_ptr<GdbChannel> channel)
+    { gdbChannel_ = std::move(channel); }
+
+    /// Return the connection to gdb (null if none).
+    const std::shared_ptr<GdbChannel>& gdbChannel() const
+    { return gdbChannel_; }
+
+    /// Stop the runs of this hart once the given token is set. A
+    /// token may be shared by several harts and set from any thread
+    /// or from a signal handler. Passing null reverts to the token
+    /// owned by this hart.
+    void setStopToken(StopToken* token)
+    { stopToken_ = token ? token : &ownStopToken_; }
+
+    /// Return the token stopping the runs of this hart.
+    StopToken& stopToken()
+    { return *stopToken_; }
+
     /// Enable use of ABI register names (e.g. sp instead of x2) in
     /// instruction disassembly.
     void enableAbiNames(bool flag)
-    { abiNames_ = flag; }
+    { abiNames_ = flag; clearDisassCache(); }
 
     /// Return true if ABI register names are enabled.
     bool abiNames() const
@@ -662,6 +1282,53 @@ namespace WdRiscv
     void enableNewlib(bool flag)
     { newlib_ = flag; }
 
+    /// Enable fast-forwarding of idle loops in the fast run loop: A
+    /// short loop without stores, CSR and floating point instructions
+    /// (wfi and fence are allowed) that completes an iteration without
+    /// changing the integer registers will repeat that iteration until
+    /// a device event (or the end of the quantum of a multi-hart run).
+    /// The retired instruction and cycle counts then jump to the last
+    /// iteration boundary before that event: minstret and mcycle have
+    /// the values of a step-by-step run. A loop that would never end
+    /// stops the run.
+    void enableIdleSkip(bool flag)
+    { idleSkip_ = flag; }
+
+    /// Enable/disable the messages printed when the target program
+    /// stops or exits in the middle of untilAddress (enabled by
+    /// default). Runs repeated many times (fuzzing) disable them.
+    void enableStopMessages(bool flag)
+    { stopMessages_ = flag; }
+
+    /// Run this hart on the CPUs of the given host NUMA node when it
+    /// has its own thread (see runHarts). A negative node leaves the
+    /// thread unbound.
+    void setNumaNode(int node)
+    { numaNode_ = node; }
+
+    /// Return the number of instructions skipped in idle loops (see
+    /// enableIdleSkip). They are included in the retired count.
+    uint64_t getIdleSkipped() const
+    { return idleSkipped_; }
+
+    /// Execute on the host the calls to the C library routine of the
+    /// given name (memcpy, memset, strlen or memcmp) whose first
+    /// instruction is at the given address. Only the fast run loop
+    /// does it, and only when it neither profiles nor calls plugins:
+    /// Traced runs, triggers and breakpoints simulate every
+    /// instruction. A call whose arguments are not all in plain
+    /// memory pages (see PageAttribs::isPlainRead) is simulated. The
+    /// routine result goes to a0, the pc to ra and the retired
+    /// instruction and cycle counts advance by an estimate of the
+    /// instructions of a word-at-a-time implementation. Return false
+    /// if the routine is not supported.
+    bool accelerateRoutine(const std::string& name, URV address);
+
+    /// Return the number of calls executed on the host (see
+    /// accelerateRoutine).
+    uint64_t getAcceleratedCalls() const
+    { return accelCalls_; }
+
     /// For Linux emulation: Set initial target program break to the
     /// RISCV page address larger than or equal to the given address.
     void setTargetProgramBreak(URV addr);
@@ -688,9 +1355,11 @@ namespace WdRiscv
     { return rvd_; }
 
     /// Return true if rv64 (64-bit option) extension is enabled in
-    /// this core.
-    bool isRv64() const
-    { return rv64_; }
+    /// this core. This is a compile-time constant of each
+    /// instantiation: checks of it in the decoders and execution
+    /// handlers are compiled out.
+    static constexpr bool isRv64()
+    { return sizeof(URV) == 8; }
 
     /// Return true if rvm (multiply/divide) extension is enabled in
     /// this core.
@@ -719,17 +1388,100 @@ namespace WdRiscv
     /// Return true if current program is considered finihsed (either
     /// reached stop address or executed exit limit).
     bool hasTargetProgramFinished() const
-    { return targetProgFinished_; }
+    { return arch_.targetProgFinished; }
 
     /// Mark target program as finished/non-finished based on flag.
     void setTargetProgramFinished(bool flag)
-    { targetProgFinished_ = flag; }
+    { arch_.targetProgFinished = flag; }
 
   protected:
 
     /// Helper to run method: Run until toHost is written or until
     /// exit is called.
-    bool simpleRun();
+    bool simpleRun()
+    { bool stopped = false; return simpleRun(~uint64_t(0), stopped); }
+
+    /// Helper to run and runHarts methods: Run until toHost is
+    /// written, until exit is called or until the count of retired
+    /// instructions reaches or exceeds the given limit (checked at
+    /// basic block boundaries). Set stopped to true if the target
+    /// program stopped.
+    bool simpleRun(uint64_t retiredLimit, bool& stopped);
+
+    /// Helper to run method: Run with trace windows (see
+    /// setTraceWindows) alternating between the fast loop or the
+    /// untraced untilAddress outside the windows and the traced
+    /// untilAddress inside them.
+    bool runWindowed(FILE* file);
+
+    /// Return true if the next instruction is in the trace
+    /// windows. Take the pending trigger trace action if any.
+    bool inTraceWindow();
+
+    /// Return the smallest instruction number greater than that of
+    /// the next instruction starting a count trace window or ~0 if
+    /// none.
+    uint64_t nextTraceWindowCount() const;
+
+    /// Return true if the given address starts a pc trace window.
+    bool startsTraceWindow(URV addr) const;
+
+    /// Write given value to memory on behalf of a store instruction.
+    /// If memory is shared by several harts, hold the granule lock of
+    /// the address around the write (unless an atomic instruction
+    /// already holds it) and cancel the matching load reservations
+    /// of the other harts.
+    template <typename STORE_TYPE>
+    bool storeToMemory(size_t addr, STORE_TYPE value)
+    {
+      if (not memory_.isShared())
+	{
+	  bool ok = memory_.write(addr, value);
+	  if (ok and stopPoints_.hasWatchpoints())
+	    stopPoints_.checkAccess(addr, sizeof(STORE_TYPE), true);
+	  return ok;
+	}
+
+      if (not inAtomic_)
+	memory_.lockGranule(addr);
+      bool ok = memory_.write(addr, value);
+      if (ok)
+	memory_.cancelOtherReservations(hartId_, addr);
+      if (not inAtomic_)
+	memory_.unlockGranule(addr);
+      if (ok and stopPoints_.hasWatchpoints())
+	stopPoints_.checkAccess(addr, sizeof(STORE_TYPE), true);
+      return ok;
+    }
+
+    /// Hold the granule lock (see Memory::lockGranule) of the target
+    /// address of an atomic instruction for the lifetime of this
+    /// object. Do nothing if enable is false.
+    struct AtomicGuard
+    {
+      AtomicGuard(Core<URV>& core, size_t addr, bool enable)
+	: core_(core), addr_(addr), enable_(enable)
+      {
+	if (enable_)
+	  {
+	    core_.memory_.lockGranule(addr_);
+	    core_.inAtomic_ = true;
+	  }
+      }
+
+      ~AtomicGuard()
+      {
+	if (enable_)
+	  {
+	    core_.inAtomic_ = false;
+	    core_.memory_.unlockGranule(addr_);
+	  }
+      }
+
+      Core<URV>& core_;
+      size_t addr_;
+      bool enable_;
+    };
 
     /// Helper to decode. Used for compressed instructions.
     const InstInfo& decode16(uint32_t inst, uint32_t& op0, uint32_t& op1,
@@ -738,6 +1490,16 @@ namespace WdRiscv
     /// Helper to whatIfSingleStep.
     void collectAndUndoWhatIfChanges(URV prevPc, ChangeRecord& record);
 
+    /// Return true if the given instruction changes nothing but the
+    /// registers and the mode of the hart: whatIfBatch may evaluate it
+    /// in a helper concurrently with other candidates.
+    static bool isWhatIfLocal(const InstInfo& info);
+
+    /// Return true if the local-memory layout definitions of this hart
+    /// apply to its memory (see followMemoryLayout).
+    bool ownsMemoryLayout() const
+    { return not followLayout_ and (hartId_ == 0 or not memory_.isShared()); }
+
     /// Helper to disassemble method. Print on the given stream given
     /// instruction which is of the form:  inst rd, rs1, rs2
     void printInstRdRs1Rs2(std::ostream&, const char* inst, unsigned rd,
@@ -813,8 +1575,30 @@ namespace WdRiscv
     /// execute16 has already set the instruction rounding mode.
     RoundingMode effectiveRoundingMode();
 
-    /// Update the accrued floating point bits in the FCSR register.
-    void updateAccruedFpBits();
+    /// Update the accrued floating point bits in the FCSR register
+    /// after a floating point operation. In the fast run loop this is
+    /// deferred: the host flags accumulate and are folded into FCSR
+    /// when a CSR instruction accesses FFLAGS/FRM/FCSR and when the
+    /// loop ends (see foldHostFpFlags).
+    void updateAccruedFpBits()
+    {
+      if (not lazyFpFlags_)
+	foldHostFpFlags();
+    }
+
+    /// Or the host floating point exception flags into the accrued
+    /// bits of FCSR and clear the host flags.
+    void foldHostFpFlags();
+
+    /// Set the host rounding mode to the given RISCV mode. The host
+    /// mode is cached: it is changed only if different.
+    void setSimulatorRoundingMode(RoundingMode mode);
+
+    /// Set the host rounding mode back to the default (nearest-even)
+    /// when leaving the run loops and after a single step: Harts
+    /// sharing a thread (hence a host floating point environment)
+    /// rely on finding that mode when they start executing.
+    void restoreHostRoundingMode();
 
     /// Undo the effect of the last executed instruction given that
     /// that a trigger has tripped.
@@ -908,6 +1692,107 @@ namespace WdRiscv
     /// performance monitors).
     void accumulateInstructionStats(uint32_t inst);
 
+    /// Return the timing model class of the given instruction.
+    static TimingModel::Kind timingKind(const InstInfo& info);
+
+    /// Pass the given retired instruction at currPc_ to the timing
+    /// model adding its stall cycles to the cycle count and its
+    /// cache/branch events to the performance counters.
+    void timeInstruction(uint32_t inst);
+
+    /// Same as above but the static fields of the given timing model
+    /// instruction (address, size, class, ICCM) are already set: Set
+    /// the others from the outcome of the execution. Performance
+    /// counters are not updated (they are never enabled in simpleRun).
+    void timeInstruction(TimingModel::Inst& ti);
+
+    /// Record the fetch and the data access (if any) of the given
+    /// retired instruction at currPc_ in the address trace.
+    void traceAddresses(uint32_t inst);
+
+    /// Set type (WhisperAddrType), address and size to those of the
+    /// data access of the given just retired instruction. Return
+    /// false if it did not access data memory (including a failed
+    /// store-conditional).
+    bool lastDataAccess(uint32_t inst, unsigned& type, uint64_t& address,
+			unsigned& size) const;
+
+    /// Call the retire and memory access hooks of the plugins for the
+    /// given retired instruction at currPc_.
+    void notifyPlugins(uint32_t inst);
+
+    /// Update the live metrics block and schedule the next update.
+    void publishMetrics();
+
+    /// Account a run in the given mode that executed the given number
+    /// of instructions in the given time (see getRunModeStats).
+    void accountRun(RunMode mode, uint64_t instructions, double seconds)
+    {
+      RunModeStats& stats = runModes_.at(size_t(mode));
+      stats.runs++;
+      stats.instructions += instructions;
+      stats.seconds += seconds;
+    }
+
+    /// C library routines executed on the host (see
+    /// accelerateRoutine).
+    enum class LibcRoutine : uint8_t { None, Memcpy, Memset, Strlen, Memcmp };
+
+    /// Execute on the host the call to the given routine whose first
+    /// instruction is at the current pc (see accelerateRoutine).
+    /// Return false leaving the hart and memory unchanged if an
+    /// argument is not in plain memory.
+    bool executeAccelerated(LibcRoutine routine);
+
+    /// Return true if the size bytes at the given address are in
+    /// plain memory pages: readable ones or, if write is true,
+    /// writable ones (see PageAttribs::isPlainWrite).
+    bool isPlainRange(uint64_t addr, uint64_t size, bool write) const;
+
+    /// Dispatch the due device events and publish the live metrics if
+    /// due. Return the number of instructions that may execute before
+    /// either is due again, at most maxCount and at most eventPeriod_
+    /// (see eventTime_).
+    uint64_t serviceEvents(uint64_t maxCount);
+
+    /// Save the state of this hart for reverse execution and schedule
+    /// the next save (see enableReverse).
+    void saveReversePoint();
+
+    /// Drop the oldest reverse points whose memory contents are no
+    /// longer in the memory journal.
+    void dropStaleReversePoints();
+
+    /// Restore the memory and the state of this hart to the ith
+    /// reverse point dropping the more recent ones.
+    void restoreReversePoint(size_t i);
+
+    /// Helper to reverseStep and reverseContinue: Execute instructions
+    /// with singleStep, without trace or console output, until the
+    /// executed instruction count reaches target. If lastStop is
+    /// non-null, set it to the count of the last state before target
+    /// at which a run would have stopped for a breakpoint or a
+    /// watchpoint (unchanged if none).
+    void replayTo(uint64_t target, uint64_t* lastStop = nullptr);
+
+    /// Go back to the given executed instruction count. See
+    /// reverseStep.
+    bool reverseTo(uint64_t target);
+
+    /// Return the info of the given instruction (like decode but
+    /// without operands) through a small cache: performance counters
+    /// need only the instruction class.
+    const InstInfo& decodeForCounters(uint32_t inst)
+    {
+      auto& entry = counterDecodeCache_[(inst ^ (inst >> 12)) & 0xff];
+      if (not entry.second or entry.first != inst)
+	{
+	  uint32_t op0 = 0, op1 = 0; int32_t op2 = 0;
+	  entry = { inst, &decode(inst, op0, op1, op2) };
+	}
+      return *entry.second;
+    }
+
     /// Fetch an instruction. Return true on success. Return false on
     /// fail (in which case an exception is initiated). May fetch a
     /// compressed instruction (16-bits) in which case the upper 16
@@ -928,6 +1813,11 @@ namespace WdRiscv
     void printInstTrace(uint32_t inst, uint64_t tag, std::string& tmp,
 			FILE* out, bool interrupt = false);
 
+    /// Fill the given record with the trace information (pc, opcode,
+    /// changed registers/memory) of the instruction just executed.
+    void collectInstTrace(uint32_t inst, uint64_t tag, bool interrupt,
+			  TraceRecord& rec);
+
     /// Start a synchronous exceptions.
     void initiateException(ExceptionCause cause, URV pc, URV info);
 
@@ -957,6 +1847,254 @@ namespace WdRiscv
     /// exception will end up modifying pc_.
     void execute16(uint16_t inst);
 
+    /// Signature shared by the instruction execution methods (execAdd,
+    /// execLw, ...). Used by the decoded-instruction cache.
+    typedef void (Core<URV>::*ExecFn)(uint32_t, uint32_t, int32_t);
+
+    /// Entry of the decoded-instruction cache: Execution method and
+    /// operands extracted from the code of the instruction at pc_.
+    /// An entry is valid only if the memory at pc_ still contains the
+    /// instruction code (masked by mask_): this takes care of
+    /// self-modifying code and of any external modification of
+    /// instruction memory (pokes, loaders, system call emulation).
+    struct DecodedInst
+    {
+      void set(ExecFn fn, uint32_t op0 = 0, uint32_t op1 = 0, int32_t op2 = 0)
+      { fn_ = fn; op0_ = op0; op1_ = op1; op2_ = op2; }
+
+      URV pc_ = 0;          // Address of instruction.
+      uint32_t inst_ = 1;   // Instruction code.
+      uint32_t mask_ = 0;   // Valid bits of inst_ (0 if entry is invalid).
+      ExecFn fn_ = nullptr; // Execution method.
+      uint32_t op0_ = 0;
+      uint32_t op1_ = 0;
+      int32_t op2_ = 0;
+      unsigned size_ = 0;   // Instruction size (2 or 4).
+    };
+
+    /// Fetch the instruction at the given address through the
+    /// decoded-instruction cache, decoding and caching it on a
+    /// miss. Return a pointer to the decoded entry and set inst to
+    /// the instruction code on success. Return nullptr on fail (in
+    /// which case an exception is initiated).
+    const DecodedInst* fetchDecoded(URV address, uint32_t& inst);
+
+    /// Execute a pre-decoded instruction. Assumes currPc_ is set to
+    /// the address of the instruction.
+    void executeDecoded(const DecodedInst& di)
+    {
+      arch_.pc += di.size_;
+      (this->*di.fn_)(di.op0_, di.op1_, di.op2_);
+    }
+
+    /// Straight-line sequence of decoded instructions ending with a
+    /// branch, a jump or a system/CSR/fence instruction. Used by
+    /// simpleRun.
+    struct DecodedBlock
+    {
+      URV pc_ = 0;                      // Address of first instruction.
+      LibcRoutine accel_ = LibcRoutine::None;  // Routine starting at pc_.
+      std::vector<DecodedInst> insts_;  // Empty if block is invalid.
+      std::vector<InstId> ids_;         // Ids of insts_ in count mode.
+      std::vector<TimingModel::Inst> timingInsts_;  // With a timing model.
+      unsigned bbvId_ = 0;              // With a basic block vector.
+      bool idleSafe_ = false;           // See isIdleSafe.
+#ifdef WHISPER_JIT
+      unsigned execCount_ = 0;          // Executions since decoded.
+      int (*jitCode_)(Core<uint32_t>*) = nullptr;  // Compiled code.
+#endif
+    };
+
+    /// Outcome of executing one instruction of a basic block.
+    enum class BlockStep { Next, Modified, Leave };
+
+    /// Execute the given instruction of a basic block assuming it is
+    /// at pc_. Return Next if execution should continue with the next
+    /// instruction of the block, Leave if the flow of control leaves
+    /// the block (branch, jump, exception) and Modified if the
+    /// instruction was found to have been modified since it was
+    /// decoded (in which case it is not executed).
+    BlockStep executeBlockInst(const DecodedInst& di);
+
+    /// Return true if given decoded instruction ends a basic block:
+    /// It may change the flow of control or it may change state that
+    /// affects decoding.
+    bool endsBlock(const DecodedInst& di) const;
+
+    /// Decode into the given block the basic block starting at the
+    /// given address. Return true on success. Return false if the
+    /// first instruction cannot be fetched (in which case an exception
+    /// is initiated).
+    bool buildBlock(URV address, DecodedBlock& block);
+
+    /// Execute the instructions of the given block starting with the
+    /// one at pc_. Return when the end of the block is reached or as
+    /// soon as the flow of control leaves the block (taken branch,
+    /// jump or exception). If an instruction of the block is found to
+    /// have been modified since it was decoded, invalidate the block
+    /// and return before executing that instruction.
+    void executeBlock(DecodedBlock& block);
+
+    /// Same as executeBlock but also pass each retired instruction to
+    /// the code coverage, the timing model, the address trace, the
+    /// basic block vector and the plugins (if any) and, if countInsts
+    /// is true, count it in the instruction frequency profile (the ids
+    /// and the timing classes of the block instructions are collected
+    /// by buildBlock).
+    void executeProfiledBlock(DecodedBlock& block, bool countInsts);
+
+    /// Same as executeBlock but also call the retire hooks (if RETIRE
+    /// is true) and the memory access hooks (if MEM is true) of the
+    /// plugins: simpleRun selects the instance matching the hooks in
+    /// use.
+    template <bool RETIRE, bool MEM>
+    void executePluginBlock(DecodedBlock& block);
+
+    /// Return true if the given instruction may be part of an idle
+    /// loop (see enableIdleSkip): Its only effect is on the integer
+    /// registers and the program counter.
+    static bool isIdleSafe(InstId id);
+
+    /// Idle loop detector of simpleRun called before the execution of
+    /// the given block: If the blocks executed since the previous
+    /// visit of the current loop head are all idle-safe and left the
+    /// integer registers unchanged, advance the retired instruction
+    /// and cycle counts by whole iterations up to the given limit, the
+    /// next device event and the next metrics update. Return false if
+    /// the loop would never end (no limit and no pending event).
+    bool skipIdleLoop(const DecodedBlock& block, uint64_t limit);
+
+    /// Helper to skipIdleLoop at a loop head: Take a snapshot of the
+    /// registers or compare them to the snapshot and skip.
+    bool checkIdleLoop(uint64_t limit);
+
+#ifdef WHISPER_JIT
+    /// Execute the given block using compiled code, compiling it if
+    /// it is hot. Return true if the block was executed. Return false
+    /// if the block should be interpreted.
+    bool executeJitBlock(DecodedBlock& block);
+
+    /// Return the id of the given decoded instruction if it is one of
+    /// the integer computational instructions translated inline by
+    /// the JIT. Return InstId::illegal otherwise.
+    InstId jitInlineId(const DecodedInst& di) const;
+
+    /// Execute the given instruction of a block on behalf of compiled
+    /// code. Return a Jit::Status value.
+    static int jitStep(Core<URV>* core, const DecodedInst* di);
+#endif
+
+    /// Decode given 32-bit instruction into the given entry. The
+    /// common integer instructions are decoded into their execution
+    /// method and operands. All other instructions are decoded to a
+    /// method forwarding to execute32. This must be kept in sync with
+    /// execute32.
+    void decode32Exec(uint32_t inst, DecodedInst& di);
+
+    /// Operand format of an opcode table entry: Determines how op0,
+    /// op1 and op2 are extracted from the instruction. None marks
+    /// encodings left to the decode switches.
+    enum class OpForm : uint8_t { None, I, S, B, U, J, R, Csr };
+
+    /// Entry of the opcode table.
+    struct OpEntry
+    {
+      InstId id_ = InstId::illegal;
+      OpForm form_ = OpForm::None;
+      bool rvm_ = false;      // True if the M extension is required.
+      ExecFn fn_ = nullptr;   // Null if left to execute32.
+    };
+
+    /// Opcode table of the common 32-bit instructions shared by
+    /// decode and decode32Exec. First level is indexed by opcode (bits
+    /// 6 to 2) and funct3. R-form entries have a second level indexed
+    /// by funct7 (0, 1 or 0x20).
+    struct OpTable
+    {
+      OpEntry level1_[32][8];
+      OpEntry rform_[32][8][3];
+    };
+
+    /// Return the opcode table (built on first use).
+    static const OpTable& opTable();
+
+    /// Return the opcode table entry of the given 32-bit instruction
+    /// or null if the instruction is not covered by the table (it is
+    /// then decoded by the switches of decode/decode32Exec).
+    const OpEntry* lookupOp(uint32_t inst) const
+    {
+      const OpTable& table = opTable();
+      unsigned opcode = (inst & 0x7f) >> 2, funct3 = (inst >> 12) & 7;
+      const OpEntry* entry = &table.level1_[opcode][funct3];
+      if (entry->form_ == OpForm::R)
+	{
+	  unsigned funct7 = inst >> 25;
+	  if (funct7 != 0 and funct7 != 1 and funct7 != 0x20)
+	    return nullptr;
+	  entry = &table.rform_[opcode][funct3][funct7 == 0x20 ? 2 : funct7];
+	}
+      if (entry->form_ == OpForm::None or (entry->rvm_ and not isRvm()))
+	return nullptr;
+      return entry;
+    }
+
+    /// Extract the operands of the given instruction according to the
+    /// given format.
+    static void opOperands(OpForm form, uint32_t inst, uint32_t& op0,
+			   uint32_t& op1, int32_t& op2);
+
+    /// Decode given 16-bit instruction into the given entry. This is
+    /// the slow path of decode16Table.
+    void decode16Exec(uint16_t inst, DecodedInst& di);
+
+    /// Entry of the compressed-instruction table: execution method
+    /// and operands of one 16-bit code.
+    struct RvcEntry
+    {
+      ExecFn fn_ = nullptr;  // Null if not yet decoded.
+      uint32_t op0_ = 0;
+      uint32_t op1_ = 0;
+      int32_t op2_ = 0;
+    };
+
+    /// Return the entry of the given 16-bit instruction in the
+    /// compressed-instruction table decoding it on first use. The
+    /// table covers all the 16-bit codes (no tags): Entries remain
+    /// valid until reset (which may change the enabled extensions).
+    const RvcEntry& rvcEntry(uint16_t inst)
+    {
+      RvcEntry& entry = rvcTable_[inst];
+      if (not entry.fn_)
+	{
+	  DecodedInst di;
+	  decode16Exec(inst, di);
+	  entry.fn_ = di.fn_;
+	  entry.op0_ = di.op0_;
+	  entry.op1_ = di.op1_;
+	  entry.op2_ = di.op2_;
+	}
+      return entry;
+    }
+
+    /// Decode given 16-bit instruction into the given entry using the
+    /// compressed-instruction table. This is used by execute16 and by
+    /// the decoded-instruction and block caches.
+    void decode16Table(uint16_t inst, DecodedInst& di)
+    {
+      const RvcEntry& entry = rvcEntry(inst);
+      di.set(entry.fn_, entry.op0_, entry.op1_, entry.op2_);
+    }
+
+    /// Execution method of decoded-instruction cache entries holding
+    /// a 32-bit instruction not decoded by decode32Exec.
+    void execUndecoded32(uint32_t inst, uint32_t, int32_t)
+    { execute32(inst); }
+
+    /// Execution method of decoded-instruction cache entries holding
+    /// an illegal instruction.
+    void execIllegal(uint32_t = 0, uint32_t = 0, int32_t = 0)
+    { illegalInst(); }
+
     /// Helper to decode: Decode instructions associated with opcode
     /// 1010011.
     const InstInfo& decodeFp(uint32_t inst, uint32_t& op0, uint32_t& op1,
@@ -997,9 +2135,27 @@ namespace WdRiscv
     /// Return true if 256mb region of address is idempotent.
     bool isIdempotentRegion(size_t addr) const;
 
+    /// Helper to singleStep: execute one instruction.
+    void singleStepInst(FILE* traceFile);
+
     /// Implement some Newlib system calls in the simulator.
     URV emulateNewlib();
 
+    /// Return the host address of the given range of simulated memory
+    /// or nullptr if the range is not entirely within the simulated
+    /// memory. Used to pass guest buffers to host system calls.
+    void* sysMemAddr(URV addr, size_t size);
+
+    /// Append the given byte to the console output buffer. The buffer
+    /// is written to the console output file at end of line and when
+    /// full.
+    void putConsoleByte(char c)
+    {
+      conBuf_[conBufSize_++] = c;
+      if (c == '\n' or conBufSize_ == sizeof(conBuf_))
+	flushConsole();
+    }
+
     // rs1: index of source register (value range: 0 to 31)
     // rs2: index of source register (value range: 0 to 31)
     // rd: index of destination register (value range: 0 to 31)
@@ -1199,36 +2355,6 @@ namespace WdRiscv
 
   private:
 
-    // We model store buffer in order to undo store effects after an
-    // imprecise store exception.
-    struct StoreInfo
-    {
-      StoreInfo(unsigned size = 0, size_t addr = 0, uint64_t data = 0,
-		uint64_t prevData = 0)
-	: size_(size), addr_(addr), newData_(data), prevData_(prevData)
-      { }
-
-      unsigned size_ = 0;  // 0: invalid object.
-      size_t addr_ = 0;
-      uint64_t newData_ = 0;
-      uint64_t prevData_ = 0;
-    };
-
-    // We model non-blocking load buffer in order to undo load
-    // effects after an imprecise load exception.
-    struct LoadInfo
-    {
-      LoadInfo(unsigned size = 0, size_t addr = 0, unsigned regIx = 0,
-	       uint64_t prevData = 0)
-	: size_(size), addr_(addr), regIx_(regIx), prevData_(prevData)
-      { }
-
-      unsigned size_ = 0;  // 0: invalid object.
-      size_t addr_ = 0;
-      unsigned regIx_ = 0;
-      uint64_t prevData_ = 0;
-    };
-
     void putInLoadQueue(unsigned size,size_t addr, unsigned regIx,
 			uint64_t prevData);
 
@@ -1236,17 +2362,22 @@ namespace WdRiscv
 
     void invalidateInLoadQueue(unsigned regIx);
 
+    /// Recompute the per register entry counts of the load queue
+    /// (see loadQueueRegCount_).
+    void recountLoadQueueRegs();
+
     void putInStoreQueue(unsigned size, size_t addr, uint64_t newData,
 			 uint64_t prevData);
 
   private:
 
     unsigned hartId_ = 0;        // Hardware thread id.
-    Memory memory_;
+    std::unique_ptr<Memory> ownMemory_;  // Memory owned by this core if any.
+    Memory& memory_;
+    ArchState arch_;             // Registers and scalar state (see ArchState).
     IntRegs<URV> intRegs_;       // Integer register file.
     CsRegs<URV> csRegs_;         // Control and status registers.
     FpRegs<double> fpRegs_;      // Floating point registers.
-    bool rv64_ = sizeof(URV)==8; // True if 64-bit base (RV64I).
     bool rva_ = false;           // True if extension A (atomic) enabled.
     bool rvc_ = true;            // True if extension C (compressed) enabled.
     bool rvd_ = false;           // True if extension D (double fp) enabled.
@@ -1254,8 +2385,6 @@ namespace WdRiscv
     bool rvm_ = true;            // True if extension M (mul/div) enabled.
     bool rvs_ = false;           // True if extension S (supervisor-mode) enabled.
     bool rvu_ = false;           // True if extension U (user-mode) enabled.
-    URV pc_ = 0;                 // Program counter. Incremented by instr fetch.
-    URV currPc_ = 0;             // Addr instr being executed (pc_ before fetch).
     URV resetPc_ = 0;            // Pc to use on reset.
     URV stopAddr_ = 0;           // Pc at which to stop the simulator.
     bool stopAddrValid_ = false; // True if stopAddr_ is valid.
@@ -1263,31 +2392,21 @@ namespace WdRiscv
     bool toHostValid_ = false;   // True if toHost_ is valid.
     URV conIo_ = 0;              // Writing a byte to this writes to console.
     bool conIoValid_ = false;    // True if conIo_ is valid.
-    URV progBreak_ = 0;          // For brk Linux emulation.
+    StopPoints stopPoints_;      // Breakpoints and watchpoints.
 
     URV nmiPc_ = 0;              // Non-maskable interrupt handler address.
-    bool nmiPending_ = false;
-    NmiCause nmiCause_ = NmiCause::UNKNOWN;
 
     // These should be cleared before each instruction when triggers enabled.
     bool ldStException_ = 0;     // True if there is a load/store exception.
     bool csrException_ = 0;      // True if there is a CSR related exception.
     bool triggerTripped_ = 0;    // True if a trigger trips.
 
-    bool hasLr_ = false;         // True if there is a load reservation.
-    URV lrAddr_ = 0;             // Address of load reservation.
+    bool inAtomic_ = false;      // True while atomic inst holds memory lock.
 
     bool lastBranchTaken_ = false; // Useful for performance counters
     bool misalignedLdSt_ = false;  // Useful for performance counters
 
-    uint64_t retiredInsts_ = 0;  // Proxy for minstret CSR.
-    uint64_t cycleCount_ = 0;    // Proxy for mcycle CSR.
-    uint64_t counter_ = 0;       // Retired instruction count.
     uint64_t instCountLim_ = ~uint64_t(0);
-    uint64_t exceptionCount_ = 0;
-    uint64_t interruptCount_ = 0;
-    uint64_t consecutiveIllegalCount_ = 0;
-    uint64_t counterAtLastIllegal_ = 0;
     bool forceAccessFail_ = false;  // Force load/store access fault.
     bool forceFetchFail_ = false;   // Force fetch access fault.
     URV forceAccessFailOffset_ = 0;
@@ -1298,48 +2417,181 @@ namespace WdRiscv
     bool prevCountersCsrOn_ = true;
     bool countersCsrOn_ = true;     // True when counters CSR is set to 1.
     bool enableTriggers_ = false;   // Enable debug triggers.
+    bool stopMessages_ = true;      // See enableStopMessages.
     bool enableGdb_ = false;        // Enable gdb mode.
+    std::shared_ptr<GdbChannel> gdbChannel_;  // See setGdbChannel.
+    StopToken ownStopToken_;
+    StopToken* stopToken_ = &ownStopToken_;   // See setStopToken.
     bool abiNames_ = false;         // Use ABI register names when true.
     bool newlib_ = false;           // Enable newlib system calls.
+    bool idleSkip_ = false;         // Fast-forward idle loops.
+    int numaNode_ = -1;             // Host node of the hart thread.
+    uint64_t idleSkipped_ = 0;      // Instructions skipped in idle loops.
+    std::unordered_map<URV, LibcRoutine> accelRoutines_;  // By address.
+    uint64_t accelCalls_ = 0;       // See getAcceleratedCalls.
+    TraceWindows traceWindows_;     // See setTraceWindows.
+    bool windowed_ = false;         // In runWindowed.
+    bool traceTriggerOn_ = false;   // Started by a trigger trace action.
+    bool windowExit_ = false;       // Run loop left for a window change.
+    uint64_t windowTraced_ = 0;     // See getWindowTracedCount.
+    std::array<uint64_t, maxTrapCause + 1> exceptionCauses_ = {};
+    std::array<uint64_t, maxTrapCause + 1> interruptCauses_ = {};
+    uint64_t triggerTrips_ = 0;     // See getTriggerTripCount.
+    std::array<RunModeStats, size_t(RunMode::Count)> runModes_;
+
+    // State of the idle loop detector (see skipIdleLoop). The check
+    // of a loop head backs off exponentially while it fails so that
+    // busy loops pay for a register comparison only once in a while.
+    struct IdleLoop
+    {
+      bool valid = false;     // True if only idle-safe blocks since head.
+      URV head = 0;           // Target of the last backward transfer.
+      URV lastBlock = 0;      // Address of the last executed block.
+      unsigned countdown = 0; // Visits of head till snapshot (0: check).
+      unsigned backoff = 1;
+      uint64_t retired = 0;   // Retired count at the snapshot.
+      uint64_t cycles = 0;    // Cycle count at the snapshot.
+      uint64_t traps = 0;     // Trap count at the snapshot.
+      std::vector<URV> regs;  // Integer registers at the snapshot.
+    };
+    IdleLoop idleLoop_;
 
     bool traceLoad_ = false;        // Trace addr of load inst if true.
     URV loadAddr_ = 0;              // Address of data of most recent load inst.
     bool loadAddrValid_ = false;    // True if loadAddr_ valid.
+    BinaryTraceWriter* binaryTrace_ = nullptr;  // Binary trace output.
+    BlockWriter* asyncTrace_ = nullptr;         // Buffered text trace.
+    PcProfiler* pcProfiler_ = nullptr;          // Execution profile.
+    const SymbolIndex* traceSymbols_ = nullptr;  // See setTraceSymbols.
+    Coverage* coverage_ = nullptr;              // Code coverage.
+    TimingModel* timing_ = nullptr;             // Cycle estimates.
+    AddressTrace* addrTrace_ = nullptr;         // Memory address trace.
+    BasicBlockVector* bbv_ = nullptr;           // Basic block vectors.
+    PluginSet* plugins_ = nullptr;              // Instrumentation plugins.
+    std::vector<Core<URV>*> whatIfHelpers_;     // See whatIfBatch.
+    bool followLayout_ = false;                 // See followMemoryLayout.
+    HartMetrics* metrics_ = nullptr;            // Live metrics.
+    uint64_t metricsTime_ = ~uint64_t(0);       // Retired count of next update.
+
+    // See decodeForCounters.
+    std::pair<uint32_t, const InstInfo*> counterDecodeCache_[256] = {};
+    TraceRecord traceRecord_;       // Record of last traced instruction.
+    std::vector<TraceChange> lastChanges_;  // See lastChanges.
+    DeviceBus deviceBus_;           // Device models and their events.
+    std::unique_ptr<Timer> timer_;  // See defineTimer.
+
+    // Time at which the run loops next look at their stop conditions
+    // (instruction limit, stop token) and at the pending
+    // events, which are not checked at the other instructions:
+    // executed instructions in untilAddress, retired instructions in
+    // simpleRun. Zeroed to have them looked at before the next
+    // instruction (scheduled device event, minstret write, ebreak
+    // served by gdb, restored state). The period bounds the delay of
+    // a stop request.
+    uint64_t eventTime_ = 0;
+    static constexpr uint64_t eventPeriod_ = 16384;
+    std::unique_ptr<HartState> snapshot_;  // See takeSnapshot.
+
+    // Reverse execution (see enableReverse): Saved states, oldest
+    // first, each with the memory journal position at which it was
+    // taken.
+    struct ReversePoint
+    {
+      HartState state;
+      uint64_t journalPos = 0;
+    };
+    static constexpr size_t maxReversePoints_ = 1024;
+    std::deque<ReversePoint> reversePoints_;
+    uint64_t reverseInterval_ = 0;              // 0: Disabled.
+    uint64_t reverseTime_ = ~uint64_t(0);       // Count of next saved state.
 
     // We keep track of the last committed 4 stores so that we can
     // revert in the case of an imprecise store exception.
-    std::vector<StoreInfo> storeQueue_;
+    RingBuffer<StoreInfo> storeQueue_ = RingBuffer<StoreInfo>(4);
     unsigned maxStoreQueueSize_ = 4;
 
-    // We keep track of the last committed 8 loads so that we can
+    // We keep track of the last committed 16 loads so that we can
     // revert in the case of an imprecise load exception.
-    std::vector<LoadInfo> loadQueue_;
-    unsigned maxLoadQueueSize_ = 16;
+    RingBuffer<LoadInfo> loadQueue_ = RingBuffer<LoadInfo>(16);
+    unsigned loadQueueRegCount_[32] = {};  // Entries targeting each reg.
     bool loadQueueEnabled_ = true;
 
-    PrivilegeMode privMode_ = PrivilegeMode::Machine; // Privilege mode.
-    bool debugMode_ = false;         // True on debug mode.
-    bool debugStepMode_ = false;     // True in debug step mode.
-    bool dcsrStepIe_ = false;        // True if stepie bit set in dcsr.
-    bool dcsrStep_ = false;          // True if step bit set in dcsr.
-    bool ebreakInst_ = false;        // True if ebreak was executed.
+    // Direct-mapped decoded-instruction cache indexed by pc/2. Size
+    // is a power of 2.
+    std::vector<DecodedInst> decodeCache_;
+    static constexpr size_t decodeCacheSize_ = 8192;
+
+    // Direct-mapped basic-block cache indexed by pc/2 of the first
+    // instruction of the block. Size is a power of 2.
+    std::vector<DecodedBlock> blockCache_;
+    static constexpr size_t blockCacheSize_ = 4096;
+    static constexpr unsigned maxBlockSize_ = 64;  // In instructions.
+
+    // Compressed-instruction table indexed by the 16-bit code (see
+    // rvcEntry).
+    std::vector<RvcEntry> rvcTable_;
+
+    // Slice of disassPool_ holding the disassembly of one instruction.
+    struct DisassSlice
+    {
+      uint32_t offset_ = 0;
+      uint32_t size_ = 0;
+    };
+
+    // Entry of the disassembly cache.
+    struct DisassEntry
+    {
+      URV pc_ = 0;
+      uint32_t inst_ = 0;
+      bool valid_ = false;
+      DisassSlice text_;
+    };
+
+    /// Return the slice of disassPool_ holding the disassembly of the
+    /// given instruction at the given address, formatting it if not
+    /// cached.
+    DisassSlice disassSlice(URV pc, uint32_t inst);
+
+    /// Empty the disassembly cache and string pool.
+    void clearDisassCache();
+
+    // Direct-mapped disassembly cache indexed by pc/2. The texts are
+    // interned by instruction code in disassPool_ which is emptied
+    // (along with the cache) when it reaches maxDisassPool_ bytes.
+    std::vector<DisassEntry> disassCache_;
+    static constexpr size_t disassCacheSize_ = 4096;
+    std::string disassPool_;
+    std::unordered_map<uint32_t, DisassSlice> disassIntern_;
+    static constexpr size_t maxDisassPool_ = 1024*1024;
+
+#ifdef WHISPER_JIT
+    std::unique_ptr<Jit> jit_;     // Translator of hot blocks (rv32 only).
+    static constexpr unsigned jitThreshold_ = 64;  // Executions before compile.
+    std::exception_ptr jitException_;  // Exception thrown within compiled code.
+#endif
+
     bool storeErrorRollback_ = false;
     bool loadErrorRollback_ = false;
-    bool targetProgFinished_ = false;
     unsigned mxlen_ = 8*sizeof(URV);
     FILE* consoleOut_ = nullptr;
+    char conBuf_[4096];              // Pending console output.
+    unsigned conBufSize_ = 0;        // Bytes in conBuf_.
+    bool conFlushOnStop_ = false;    // Flush console after each step.
 
     // FP instructions have additional operands besides rd, rs1, rs2 and imm.
     // We pass them in here.
     RoundingMode instRoundingMode_ = RoundingMode::NearestEven;
     unsigned instRs3_ = 0;
+    int hostRoundingMode_ = FE_TONEAREST;  // Current host rounding mode.
+    bool lazyFpFlags_ = false;   // Defer folding of host FP flags.
+    bool leaveSimpleRun_ = false; // Gdb added stop points: Use untilAddress.
 
     // AMO instructions have additional operands: rl and aq.
     bool amoAq_ = false;
     bool amoRl_ = false;
 
     InstInfoTable instTable_;
-    std::vector<InstProfile> instProfileVec_; // Instruction frequency
+    InstProfile instProfile_;   // Instruction frequency
 
     // Ith entry is true if ith region has iccm/dccm/pic.
     std::vector<bool> regionHasLocalMem_;
@@ -17,10 +17,12 @@
 //
 
 #include <nlohmann/json.hpp>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include "CoreConfig.hpp"
 #include "Core.hpp"
+#include "TimingModel.hpp"
 
 
 using namespace WdRiscv;
@@ -375,6 +377,35 @@ applyPicConfig(Core<URV>& core, const nlohmann::json& config)
 }
 
 
+template <typename URV>
+static
+bool
+applyTimerConfig(Core<URV>& core, const nlohmann::json& config)
+{
+  if (not config.count("timer"))
+    return true;  // Nothing to apply.
+
+  const auto& timer = config.at("timer");
+  bool badTimer = false;
+  for (const auto& tag : { "region", "offset", "size" } )
+    {
+      if (not timer.count(tag))
+	{
+	  std::cerr << "Missing '" << tag << "' entry in "
+		    << "config file timer section\n";
+	  badTimer = true;
+	}
+    }
+  if (badTimer)
+    return false;
+
+  uint64_t region = getJsonUnsigned("timer.region", timer.at("region"));
+  uint64_t offset = getJsonUnsigned("timer.offset", timer.at("offset"));
+  uint64_t size = getJsonUnsigned("timer.size", timer.at("size"));
+  return core.defineTimer(region, offset, size);
+}
+
+
 template <typename URV>
 static
 bool
@@ -614,6 +645,9 @@ CoreConfig::applyConfig(Core<URV>& core, bool verbose) const
   if (not applyTriggerConfig(core, *config_))
     errors++;
 
+  if (not applyTimerConfig(core, *config_))
+    errors++;
+
   core.finishMemoryConfig();
 
   return errors == 0;
@@ -632,6 +666,74 @@ CoreConfig::getXlen(unsigned& xlen) const
 }
 
 
+bool
+CoreConfig::getHartCount(unsigned& count) const
+{
+  if (config_ -> count("harts"))
+    {
+      count = getJsonUnsigned("harts", config_ -> at("harts"));
+      return true;
+    }
+  return false;
+}
+
+
+bool
+CoreConfig::getQuantum(uint64_t& quantum) const
+{
+  if (config_ -> count("quantum"))
+    {
+      quantum = getJsonUnsigned("quantum", config_ -> at("quantum"));
+      return true;
+    }
+  return false;
+}
+
+
+bool
+CoreConfig::getTimingConfig(TimingConfig& timing) const
+{
+  if (not config_ -> count("timing"))
+    return true;
+
+  const std::vector<std::pair<std::string, unsigned*>> params = {
+    { "icache_size",       &timing.icacheSize },
+    { "icache_ways",       &timing.icacheWays },
+    { "icache_line",       &timing.icacheLine },
+    { "dcache_size",       &timing.dcacheSize },
+    { "dcache_ways",       &timing.dcacheWays },
+    { "dcache_line",       &timing.dcacheLine },
+    { "miss_penalty",      &timing.missPenalty },
+    { "iccm_latency",      &timing.iccmLatency },
+    { "dccm_latency",      &timing.dccmLatency },
+    { "load_latency",      &timing.loadLatency },
+    { "mul_latency",       &timing.mulLatency },
+    { "div_latency",       &timing.divLatency },
+    { "branch_penalty",    &timing.branchPenalty },
+    { "predictor_entries", &timing.predictorEntries }
+  };
+
+  unsigned errors = 0;
+  for (const auto& item : config_ -> at("timing").items())
+    {
+      auto iter = std::find_if(params.begin(), params.end(),
+			       [&item] (const auto& param) {
+				 return param.first == item.key();
+			       });
+      if (iter == params.end())
+	{
+	  std::cerr << "Unknown config file entry: timing." << item.key()
+		    << '\n';
+	  errors++;
+	  continue;
+	}
+      *iter->second = getJsonUnsigned("timing." + item.key(), item.value());
+    }
+
+  return errors == 0;
+}
+
+
 void
 CoreConfig::clear()
 {
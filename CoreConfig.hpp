@@ -28,6 +28,8 @@ namespace WdRiscv
   template <typename URV>
   class Core;
 
+  struct TimingConfig;
+
 
   /// Manage loading of configuration file and applying it to a core.
   class CoreConfig
@@ -58,6 +60,23 @@ namespace WdRiscv
     /// not contain a register width (xlen) configuration.
     bool getXlen(unsigned& registerWidth) const;
 
+    /// Set count to the number of harts (cores) configured in this
+    /// object returning true on success and false if this object does
+    /// not contain a hart count (harts) configuration.
+    bool getHartCount(unsigned& count) const;
+
+    /// Set quantum to the number of instructions retired by each hart
+    /// between synchronizations in multi-hart runs returning true on
+    /// success and false if this object does not contain a quantum
+    /// configuration.
+    bool getQuantum(uint64_t& quantum) const;
+
+    /// Set the fields of the given timing model configuration that
+    /// are defined in the "timing" section of this object (others are
+    /// left unchanged). Return true on success and false if an entry
+    /// is not a valid number or is not a known parameter.
+    bool getTimingConfig(TimingConfig& timing) const;
+
     /// Clear (make empty) the set of configurations held in this object.
     void clear();
 
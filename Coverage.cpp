@@ -0,0 +1,158 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "Coverage.hpp"
+
+
+using namespace WdRiscv;
+
+
+// Coverage file layout (little endian):
+//
+//   Header:  u32 magic ("WCOV"), u16 version, u16 flags (bit 0: branch
+//            outcomes present), u64 page count
+//   Pages:   in increasing page number order: u64 page number, executed
+//            bitmap and, if flags bit 0 is set, taken and not-taken
+//            bitmaps (Coverage::wordsPerPage u64 each)
+
+static constexpr uint32_t coverageMagic = 0x564f4357;  // "WCOV"
+static constexpr uint16_t coverageVersion = 1;
+static constexpr uint16_t coverageBranchFlag = 1;
+
+
+void
+Coverage::merge(const Coverage& other)
+{
+  branches_ = branches_ or other.branches_;
+  for (const auto& [number, src] : other.pages_)
+    {
+      Page& dest = pages_[number];
+      for (unsigned i = 0; i < wordsPerPage; ++i)
+	{
+	  dest.exec[i] |= src.exec[i];
+	  dest.taken[i] |= src.taken[i];
+	  dest.notTaken[i] |= src.notTaken[i];
+	}
+    }
+  lastPage_ = ~uint64_t(0);
+}
+
+
+bool
+Coverage::write(const std::string& path) const
+{
+  FILE* out = fopen(path.c_str(), "wb");
+  if (not out)
+    {
+      std::cerr << "Failed to open coverage file '" << path
+		<< "' for output\n";
+      return false;
+    }
+
+  std::vector<uint64_t> numbers;
+  for (const auto& kv : pages_)
+    numbers.push_back(kv.first);
+  std::sort(numbers.begin(), numbers.end());
+
+  uint16_t flags = branches_ ? coverageBranchFlag : 0;
+  uint64_t count = numbers.size();
+  bool ok = (fwrite(&coverageMagic, 4, 1, out) == 1 and
+	     fwrite(&coverageVersion, 2, 1, out) == 1 and
+	     fwrite(&flags, 2, 1, out) == 1 and
+	     fwrite(&count, 8, 1, out) == 1);
+
+  for (size_t i = 0; i < numbers.size() and ok; ++i)
+    {
+      const Page& page = pages_.at(numbers[i]);
+      ok = (fwrite(&numbers[i], 8, 1, out) == 1 and
+	    fwrite(page.exec, sizeof(page.exec), 1, out) == 1);
+      if (ok and branches_)
+	ok = (fwrite(page.taken, sizeof(page.taken), 1, out) == 1 and
+	      fwrite(page.notTaken, sizeof(page.notTaken), 1, out) == 1);
+    }
+
+  if (fclose(out) != 0)
+    ok = false;
+  if (not ok)
+    std::cerr << "Failed to write coverage file '" << path << "'\n";
+  return ok;
+}
+
+
+bool
+Coverage::read(const std::string& path)
+{
+  FILE* in = fopen(path.c_str(), "rb");
+  if (not in)
+    {
+      std::cerr << "Failed to open coverage file '" << path
+		<< "' for input\n";
+      return false;
+    }
+  std::unique_ptr<FILE, int(*)(FILE*)> closer(in, fclose);
+
+  uint32_t magic = 0;
+  uint16_t version = 0, flags = 0;
+  uint64_t count = 0;
+  if (fread(&magic, 4, 1, in) != 1 or fread(&version, 2, 1, in) != 1 or
+      fread(&flags, 2, 1, in) != 1 or fread(&count, 8, 1, in) != 1 or
+      magic != coverageMagic or version != coverageVersion)
+    {
+      std::cerr << "File '" << path << "' is not a whisper coverage file\n";
+      return false;
+    }
+
+  bool branches = flags & coverageBranchFlag;
+  branches_ = branches_ or branches;
+
+  Page src;
+  for (uint64_t n = 0; n < count; ++n)
+    {
+      uint64_t number = 0;
+      bool ok = (fread(&number, 8, 1, in) == 1 and
+		 fread(src.exec, sizeof(src.exec), 1, in) == 1);
+      if (ok and branches)
+	ok = (fread(src.taken, sizeof(src.taken), 1, in) == 1 and
+	      fread(src.notTaken, sizeof(src.notTaken), 1, in) == 1);
+      if (not ok)
+	{
+	  std::cerr << "Coverage file '" << path << "' is truncated\n";
+	  return false;
+	}
+
+      Page& dest = pages_[number];
+      for (unsigned i = 0; i < wordsPerPage; ++i)
+	{
+	  dest.exec[i] |= src.exec[i];
+	  if (branches)
+	    {
+	      dest.taken[i] |= src.taken[i];
+	      dest.notTaken[i] |= src.notTaken[i];
+	    }
+	}
+    }
+
+  lastPage_ = ~uint64_t(0);
+  return true;
+}
@@ -0,0 +1,150 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+
+namespace WdRiscv
+{
+
+  /// Code coverage of a target program: One bit per half-word of
+  /// executed code telling whether an instruction starting there was
+  /// executed and, optionally, two bits per conditional branch telling
+  /// whether it was taken and not taken. Bits are kept by 4KB page:
+  /// only pages holding executed code have a bitmap. Coverage objects
+  /// (and files, see write) of runs of the same program are merged by
+  /// OR-ing them.
+  class Coverage
+  {
+  public:
+
+    static constexpr unsigned pageShift = 12;
+    static constexpr unsigned wordsPerPage = (1 << pageShift) / 2 / 64;
+
+    /// Bitmaps of a page: Bit i of a bitmap corresponds to the
+    /// half-word at offset 2*i of the page.
+    struct Page
+    {
+      uint64_t exec[wordsPerPage] = {};      // Executed.
+      uint64_t taken[wordsPerPage] = {};     // Branch taken.
+      uint64_t notTaken[wordsPerPage] = {};  // Branch not taken.
+    };
+
+    /// Constructor: If branches is true, collect conditional branch
+    /// outcomes in addition to executed instructions.
+    Coverage(bool branches = false)
+      : branches_(branches)
+    { }
+
+    /// Record the execution of instruction inst at the given PC which
+    /// left the program counter at nextPc.
+    void record(uint64_t pc, uint32_t inst, uint64_t nextPc)
+    {
+      uint64_t page = pc >> pageShift;
+      if (page != lastPage_)
+	selectPage(page);
+
+      unsigned ix = (pc & pageMask_) >> 1;
+      uint64_t bit = uint64_t(1) << (ix & 63);
+      last_->exec[ix >> 6] |= bit;
+
+      if (branches_ and isConditionalBranch(inst))
+	{
+	  uint64_t size = (inst & 3) == 3 ? 4 : 2;
+	  if (nextPc == pc + size)
+	    last_->notTaken[ix >> 6] |= bit;
+	  else
+	    last_->taken[ix >> 6] |= bit;
+	}
+    }
+
+    /// Return true if branch outcomes are collected.
+    bool hasBranches() const
+    { return branches_; }
+
+    /// Return true if the instruction at the given address was
+    /// executed.
+    bool isExecuted(uint64_t addr) const
+    { return testBit(addr, &Page::exec); }
+
+    /// Return true if the branch at the given address was taken.
+    bool isTaken(uint64_t addr) const
+    { return testBit(addr, &Page::taken); }
+
+    /// Return true if the branch at the given address was not taken.
+    bool isNotTaken(uint64_t addr) const
+    { return testBit(addr, &Page::notTaken); }
+
+    /// Return the pages with a bitmap by page number (address >>
+    /// pageShift).
+    const std::unordered_map<uint64_t, Page>& pages() const
+    { return pages_; }
+
+    /// OR the given coverage into this one. Branch outcomes are kept
+    /// if either has them.
+    void merge(const Coverage& other);
+
+    /// Write this coverage to the given file. Return true on success
+    /// and false (printing a message) on failure.
+    bool write(const std::string& path) const;
+
+    /// OR the coverage of the given file (see write) into this
+    /// one. Return true on success and false (printing a message) if
+    /// the file cannot be read or is not a coverage file.
+    bool read(const std::string& path);
+
+    /// Return true if given instruction is a conditional branch
+    /// (bxx, c.beqz, c.bnez).
+    static bool isConditionalBranch(uint32_t inst)
+    {
+      if ((inst & 3) == 3)
+	return (inst & 0x7f) == 0x63;
+      return (inst & 3) == 1 and ((inst >> 13) & 7) >= 6;
+    }
+
+  private:
+
+    static constexpr uint64_t pageMask_ = (uint64_t(1) << pageShift) - 1;
+
+    /// Make the page of the given number current creating it if
+    /// necessary.
+    void selectPage(uint64_t page)
+    {
+      last_ = &pages_[page];
+      lastPage_ = page;
+    }
+
+    bool testBit(uint64_t addr, const uint64_t (Page::*bits)[wordsPerPage]) const
+    {
+      auto iter = pages_.find(addr >> pageShift);
+      if (iter == pages_.end())
+	return false;
+      unsigned ix = (addr & pageMask_) >> 1;
+      return ((iter->second.*bits)[ix >> 6] >> (ix & 63)) & 1;
+    }
+
+    bool branches_ = false;
+    std::unordered_map<uint64_t, Page> pages_;
+    uint64_t lastPage_ = ~uint64_t(0);
+    Page* last_ = nullptr;
+  };
+}
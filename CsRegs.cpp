@@ -26,7 +26,8 @@ using namespace WdRiscv;
 
 
 template <typename URV>
-CsRegs<URV>::CsRegs()
+CsRegs<URV>::CsRegs(URV* values, uint64_t* perfCounters)
+  : values_(values), mPerfRegs_(perfCounters)
 {
   // Allocate CSR vector.  All entries are invalid.
   regs_.clear();
@@ -38,6 +39,26 @@ CsRegs<URV>::CsRegs()
   defineUserRegs();
   defineDebugRegs();
   defineNonStandardRegs();
+
+  tieValues();
+}
+
+
+template <typename URV>
+void
+CsRegs<URV>::tieValues()
+{
+  for (size_t i = 0; i < regs_.size(); ++i)
+    {
+      Csr<URV>& csr = regs_[i];
+      if (csr.valuePtr_ != &csr.value_)
+	continue;
+      values_[i] = csr.value_;
+      csr.tie(&values_[i]);
+    }
+
+  for (unsigned i = 0; i < unsigned(HotCsr::_Count); ++i)
+    hotCsrs_[i] = &regs_.at(size_t(hotNumbers_[i]));
 }
 
 
@@ -78,10 +99,12 @@ CsRegs<URV>::defineCsr(const std::string& name, CsrNumber csrn, bool mandatory,
 
   csr.setDefined(true);
 
-  csr.config(name, csrn, mandatory, implemented, resetValue, writeMask,
-	     pokeMask, isDebug);
-
-  nameToNumber_[name] = csrn;
+  // The name is kept in the name table: keys of an unordered_map do
+  // not move.
+  auto iter = nameToNumber_.emplace(name, csrn).first;
+  iter->second = csrn;
+  csr.config(&iter->first, csrn, mandatory, implemented, resetValue,
+	     writeMask, pokeMask, isDebug);
   return &csr;
 }
 
@@ -131,6 +154,9 @@ CsRegs<URV>::read(CsrNumber number, PrivilegeMode mode,
   if (number >= CsrNumber::TDATA1 and number <= CsrNumber::TDATA3)
     return readTdata(number, mode, debugMode, value);
 
+  if (isPerfCounterCsr(number))
+    mPerfRegs_.sync();
+
   value = csr->read();
   return true;
 }
@@ -151,6 +177,9 @@ CsRegs<URV>::write(CsrNumber number, PrivilegeMode mode, bool debugMode,
   if (csr->isDebug() and not debugMode)
     return false;
 
+  if (isPerfCounterCsr(number))
+    mPerfRegs_.sync();  // Apply pending events before overwriting.
+
   // fflags and frm are part of fcsr
   if (number <= CsrNumber::FCSR)  // FFLAGS, FRM or FCSR.
     {
@@ -192,12 +221,10 @@ CsRegs<URV>::write(CsrNumber number, PrivilegeMode mode, bool debugMode,
   csr->write(value);
   recordWrite(number);
 
-  // Cache interrupt enable.
-  if (number == CsrNumber::MSTATUS)
-    {
-      MstatusFields<URV> fields(csr->read());
-      interruptEnable_ = fields.bits_.MIE;
-    }
+  // Cache interrupt enable and pending.
+  if (number == CsrNumber::MSTATUS or number == CsrNumber::MIE or
+      number == CsrNumber::MIP)
+    updateInterruptCache();
 
   // Writing MDEAU unlocks mdseac.
   if (number == CsrNumber::MDEAU)
@@ -250,14 +277,9 @@ CsRegs<URV>::reset()
       csr.reset();
 
   triggers_.reset();
+  mPerfRegs_.discardEvents();
 
-  // Cache interrupt enable.
-  Csr<URV>* mstatus = getImplementedCsr(CsrNumber::MSTATUS);
-  if (mstatus)
-    {
-      MstatusFields<URV> fields(mstatus->read());
-      interruptEnable_ = fields.bits_.MIE;
-    }
+  updateInterruptCache();
 
   mdseacLocked_ = false;
 }
@@ -308,12 +330,10 @@ CsRegs<URV>::configCsr(CsrNumber csrNum, bool implemented,
   csr.pokeNoMask(resetValue);
   csr.setIsDebug(isDebug);
 
-  // Cahche interrupt enable.
-  if (csrNum == CsrNumber::MSTATUS)
-    {
-      MstatusFields<URV> fields(csr.read());
-      interruptEnable_ = fields.bits_.MIE;
-    }
+  // Cache interrupt enable and pending.
+  if (csrNum == CsrNumber::MSTATUS or csrNum == CsrNumber::MIE or
+      csrNum == CsrNumber::MIP)
+    updateInterruptCache();
 
   return true;
 }
@@ -358,7 +378,7 @@ CsRegs<URV>::configMachineModePerfCounters(unsigned numCounters)
   if (errors == 0)
     {
       mPerfRegs_.config(numCounters);
-      tieMachinePerfCounters(mPerfRegs_.counters_);
+      tieMachinePerfCounters(mPerfRegs_.counters_, PerfRegs::maxCounters);
     }
 
   return errors == 0;
@@ -461,11 +481,31 @@ CsRegs<URV>::updateFcsrGroupForPoke(CsrNumber number, URV value)
 
 template <typename URV>
 void
-CsRegs<URV>::recordWrite(CsrNumber num)
+CsRegs<URV>::updateInterruptCache()
 {
-  auto& lwr = lastWrittenRegs_;
-  if (std::find(lwr.begin(), lwr.end(), num) == lwr.end())
-    lwr.push_back(num);
+  URV mstatus = 0, mie = 0, mip = 0;
+  readHot(HotCsr::Mstatus, mstatus);
+  readHot(HotCsr::Mie, mie);
+  readHot(HotCsr::Mip, mip);
+
+  MstatusFields<URV> fields(mstatus);
+  interruptEnable_ = fields.bits_.MIE;
+  interruptPossible_ = interruptEnable_ and (mie & mip) != 0;
+}
+
+
+template <typename URV>
+void
+CsRegs<URV>::enableWriteRecording(bool flag)
+{
+  if (flag and not recordWrites_ and unrecordedWrites_)
+    {
+      // Previous values remembered by unrecorded writes are stale.
+      for (auto& csr : regs_)
+	csr.clearLastWritten();
+      unrecordedWrites_ = false;
+    }
+  recordWrites_ = flag;
 }
 
 
@@ -580,7 +620,7 @@ CsRegs<URV>::defineMachineRegs()
 
 template <typename URV>
 void
-CsRegs<URV>::tieMachinePerfCounters(std::vector<uint64_t>& counters)
+CsRegs<URV>::tieMachinePerfCounters(uint64_t* counters, unsigned count)
 {
   if constexpr (sizeof(URV) == 4)
     {
@@ -591,11 +631,11 @@ CsRegs<URV>::tieMachinePerfCounters(std::vector<uint64_t>& counters)
       for (unsigned num = 3; num <= 31; ++num)
 	{
 	  unsigned ix = num - 3;
-	  if (ix >= counters.size())
+	  if (ix >= count)
 	    break;
 	  unsigned lowIx = ix +  unsigned(CsrNumber::MHPMCOUNTER3);
 	  Csr<URV>& csrLow = regs_.at(lowIx);
-	  URV* loc = reinterpret_cast<URV*>(&counters.at(ix));
+	  URV* loc = reinterpret_cast<URV*>(&counters[ix]);
 	  csrLow.tie(loc);
 
 	  loc++;
@@ -610,11 +650,11 @@ CsRegs<URV>::tieMachinePerfCounters(std::vector<uint64_t>& counters)
       for (unsigned num = 3; num <= 31; ++num)
 	{
 	  unsigned ix = num - 3;
-	  if (ix >= counters.size())
+	  if (ix >= count)
 	    break;
 	  unsigned csrIx = ix +  unsigned(CsrNumber::MHPMCOUNTER3);
 	  Csr<URV>& csr = regs_.at(csrIx);
-	  URV* loc = reinterpret_cast<URV*>(&counters.at(ix));
+	  URV* loc = reinterpret_cast<URV*>(&counters[ix]);
 	  csr.tie(loc);
 	}
     }
@@ -836,6 +876,9 @@ CsRegs<URV>::peek(CsrNumber number, URV& value) const
   if (number >= CsrNumber::TDATA1 and number <= CsrNumber::TDATA3)
     return readTdata(number, PrivilegeMode::Machine, debugMode, value);
 
+  if (isPerfCounterCsr(number))
+    mPerfRegs_.sync();
+
   value = csr->read();
   return true;
 }
@@ -849,6 +892,9 @@ CsRegs<URV>::poke(CsrNumber number, URV value)
   if (not csr)
     return false;
 
+  if (isPerfCounterCsr(number))
+    mPerfRegs_.sync();  // Apply pending events before overwriting.
+
   // fflags and frm are parts of fcsr
   if (number <= CsrNumber::FCSR)  // FFLAGS, FRM or FCSR.
     {
@@ -883,12 +929,10 @@ CsRegs<URV>::poke(CsrNumber number, URV value)
 
   csr->poke(value);
 
-  // Cache interrupt enable.
-  if (number == CsrNumber::MSTATUS)
-    {
-      MstatusFields<URV> fields(csr->read());
-      interruptEnable_ = fields.bits_.MIE;
-    }
+  // Cache interrupt enable and pending.
+  if (number == CsrNumber::MSTATUS or number == CsrNumber::MIE or
+      number == CsrNumber::MIP)
+    updateInterruptCache();
 
   return true;
 }
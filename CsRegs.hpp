@@ -19,6 +19,7 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
 #include <string>
@@ -364,7 +365,8 @@ namespace WdRiscv
   /// Model a control and status register. The template type URV
   /// (unsigned register value) is the type of the register value. It
   /// should be uint32_t for 32-bit implementations and uint64_t for
-  /// 64-bit.
+  /// 64-bit. The name of the register is kept in the name table of
+  /// CsRegs (cold data) to keep this object small.
   template <typename URV>
   class Csr
   {
@@ -378,9 +380,9 @@ namespace WdRiscv
     /// in the mask corresponds to a non-writable (preserved) bit in the
     /// register value. To make the whole register writable, set mask to
     /// all ones.
-    Csr(const std::string& name, CsrNumber number, bool mandatory,
-	bool implemented, URV value, URV writeMask = ~URV(0))
-      : name_(name), number_(unsigned(number)), mandatory_(mandatory),
+    Csr(CsrNumber number, bool mandatory, bool implemented, URV value,
+	URV writeMask = ~URV(0))
+      : number_(unsigned(number)), mandatory_(mandatory),
 	implemented_(implemented), initialValue_(value), value_(value),
 	writeMask_(writeMask), pokeMask_(writeMask)
     { valuePtr_ = &value_; }
@@ -468,7 +470,7 @@ namespace WdRiscv
 
     /// Return the name of this register.
     const std::string& getName() const
-    { return name_; }
+    { return name_ ? *name_ : noName(); }
 
   protected:
 
@@ -492,8 +494,8 @@ namespace WdRiscv
     void reset()
     { *valuePtr_ = initialValue_; }
 
-    /// Configure.
-    void config(const std::string& name, CsrNumber num, bool mandatory,
+    /// Configure. The name must outlive this object.
+    void config(const std::string* name, CsrNumber num, bool mandatory,
 		bool implemented, URV value, URV writeMask, URV pokeMask,
 		bool isDebug)
     { name_ = name; number_ = unsigned(num); mandatory_ = mandatory;
@@ -553,7 +555,10 @@ namespace WdRiscv
 
   private:
 
-    std::string name_;
+    static const std::string& noName()
+    { static const std::string empty; return empty; }
+
+    const std::string* name_ = nullptr;  // In CsRegs name table.
     unsigned number_ = 0;
     bool mandatory_ = false;   // True if mandated by architecture.
     bool implemented_ = false; // True if register is implemented.
@@ -582,10 +587,48 @@ namespace WdRiscv
     friend class Core<uint32_t>;
     friend class Core<uint64_t>;
 
-    CsRegs();
+    /// Constructor: Keep the CSR values in the given array (indexed
+    /// by CSR number, MAX_CSR_ + 1 entries) and the performance
+    /// counters in the given array (see PerfRegs). Both arrays are
+    /// part of the architectural state block of the hart and must
+    /// outlive this object.
+    CsRegs(URV* values, uint64_t* perfCounters);
     
     ~CsRegs();
 
+    /// CSRs accessed on every trap entry/return and interrupt check.
+    /// They can be accessed by the hart without lookup or access
+    /// checks (see readHot/writeHot).
+    enum class HotCsr { Mstatus, Mepc, Mcause, Mtval, Mip, Mie, Mtvec,
+			Dcsr, _Count };
+
+    /// Set value to that of the given hot CSR. This is like peek.
+    /// Return false if the CSR is not implemented.
+    bool readHot(HotCsr which, URV& value) const
+    {
+      if (not hotCsrs_[unsigned(which)]->isImplemented())
+	return false;
+      value = values_[size_t(hotNumbers_[unsigned(which)])];
+      return true;
+    }
+
+    /// Write the given hot CSR on behalf of the hart (e.g. trap
+    /// entry). This is like write in machine mode but skips the lookup
+    /// and the privilege checks. Return false if the CSR is not
+    /// implemented.
+    bool writeHot(HotCsr which, URV value)
+    {
+      Csr<URV>* csr = hotCsrs_[unsigned(which)];
+      if (not csr->isImplemented())
+	return false;
+      csr->write(value);
+      recordWrite(csr->getNumber());
+      if (which == HotCsr::Mstatus or which == HotCsr::Mie or
+	  which == HotCsr::Mip)
+	updateInterruptCache();
+      return true;
+    }
+
     /// Return pointer to the control-and-status register
     /// corresponding to the given name or nullptr if no such
     /// register.
@@ -762,6 +805,10 @@ namespace WdRiscv
     bool hasEnterDebugModeTripped() const
     { return triggers_.hasEnterDebugModeTripped(); }
 
+    /// See Triggers::takeTraceAction.
+    bool takeTriggerTraceAction(bool& start)
+    { return triggers_.takeTraceAction(start); }
+
     /// Set value to the value of the given register returning true on
     /// success and false if number is out of bound.
     bool peek(CsrNumber number, URV& value) const;
@@ -830,17 +877,44 @@ namespace WdRiscv
 
     /// Record given CSR number as a being written by the current
     /// instruction. Recorded numbers can be later retrieved by the
-    /// getLastWrittenRegs method.
-    void recordWrite(CsrNumber num);
+    /// getLastWrittenRegs method. Nothing is recorded if recording is
+    /// disabled (see enableWriteRecording).
+    void recordWrite(CsrNumber num)
+    {
+      if (not recordWrites_)
+	{
+	  unrecordedWrites_ = true;
+	  return;
+	}
+      auto& lwr = lastWrittenRegs_;
+      if (std::find(lwr.begin(), lwr.end(), num) == lwr.end())
+	lwr.push_back(num);
+    }
+
+    /// Enable/disable the recording of written CSRs. Recording is
+    /// needed only by the consumers of per-instruction changes
+    /// (instruction trace, server, performance counters). It is
+    /// disabled by the fast run loop. Re-enabling forgets the writes
+    /// done while recording was off.
+    void enableWriteRecording(bool flag);
+
+    /// Recompute the cached interrupt enable and interrupt possible
+    /// flags from MSTATUS, MIE and MIP.
+    void updateInterruptCache();
 
     /// Clear the remembered indices of the CSR register(s) written by
     /// the last instruction.
     void clearLastWrittenRegs()
     {
+      bool written = not lastWrittenRegs_.empty();
       for (auto& csrNum : lastWrittenRegs_)
 	regs_.at(size_t(csrNum)).clearLastWritten();
       lastWrittenRegs_.clear();
-      triggers_.clearLastWrittenTriggers();
+
+      // Triggers change only through CSR writes (recorded above) or
+      // by tripping (possible only if one is active).
+      if (written or hasActiveTrigger_)
+	triggers_.clearLastWrittenTriggers();
     }
 
     /// Configure given trigger with given reset values, write and
@@ -849,10 +923,31 @@ namespace WdRiscv
 		       URV wm1, URV wm2, URV wm3,
 		       URV pm1, URV pm2, URV pm3)
     {
-      return triggers_.config(trigger, val1, val2, val3,
-			      wm1, wm2, wm3, pm1, pm2, pm3);
+      bool ok = triggers_.config(trigger, val1, val2, val3,
+				 wm1, wm2, wm3, pm1, pm2, pm3);
+      hasActiveTrigger_ = triggers_.hasActiveTrigger();
+      hasActiveInstTrigger_ = triggers_.hasActiveInstTrigger();
+      return ok;
     }
 
+    /// Return the numbers of the CSRs written by the last
+    /// instruction (no copy, see getLastWrittenRegs).
+    const std::vector<CsrNumber>& lastWrittenRegs() const
+    { return lastWrittenRegs_; }
+
+    /// Return true if the given trigger was written by the last
+    /// instruction.
+    bool isTriggerModified(unsigned trigger) const
+    { return triggers_.isModified(trigger); }
+
+    /// Return true if the hit bit of the given trigger is set.
+    bool isTriggerHit(unsigned trigger) const
+    { return triggers_.isHit(trigger); }
+
+    /// Return the number of debug triggers.
+    unsigned triggerCount() const
+    { return triggers_.size(); }
+
     /// Fill the nums vector with the numbers of the CSRs written by
     /// the last instruction.
     void getLastWrittenRegs(std::vector<CsrNumber>& csrNums,
@@ -865,12 +960,32 @@ namespace WdRiscv
     bool isInterruptEnabled() const
     { return interruptEnable_; }
 
+    /// Return true if interrupts are enabled in MSTATUS and one or
+    /// more interrupts are both pending (MIP) and enabled (MIE). This
+    /// is cached: it is recomputed when one of these CSRs is written,
+    /// poked or reset.
+    bool isInterruptPossible() const
+    { return interruptPossible_; }
+
+    /// Return true if given CSR is a machine performance counter
+    /// (mhpmcounter3 to mhpmcounter31 and their high halves) or event
+    /// selector.
+    static bool isPerfCounterCsr(CsrNumber number)
+    {
+      return ((number >= CsrNumber::MHPMCOUNTER3 and
+	       number <= CsrNumber::MHPMCOUNTER31) or
+	      (number >= CsrNumber::MHPMCOUNTER3H and
+	       number <= CsrNumber::MHPMCOUNTER31H) or
+	      (number >= CsrNumber::MHPMEVENT3 and
+	       number <= CsrNumber::MHPMEVENT31));
+    }
+
     /// Tie CSR values of machine mode performance counters to the
-    /// elements of the given vector so that when a counter in the
-    /// vector is changed the corresponding CSR value changes and
+    /// elements of the given array so that when a counter in the
+    /// array is changed the corresponding CSR value changes and
     /// vice-versa. This is done to avoid the overhead of CSR checking
     /// when incrementing performance counters.
-    void tieMachinePerfCounters(std::vector<uint64_t>& counters);
+    void tieMachinePerfCounters(uint64_t* counters, unsigned count);
 
     /// Set the maximum performance counter event id. Ids larger than
     /// the max value are replaced by that max.
@@ -888,18 +1003,35 @@ namespace WdRiscv
 
   private:
 
+    /// Tie the CSRs not tied to other locations to the value array
+    /// and collect the hot CSRs.
+    void tieValues();
+
     std::vector< Csr<URV> > regs_;
-    std::unordered_map<std::string, CsrNumber> nameToNumber_;
+    std::unordered_map<std::string, CsrNumber> nameToNumber_;  // Names.
+    URV* values_ = nullptr;       // See constructor.
+
+    // Hot CSRs (see HotCsr): Numbers and corresponding entries of regs_.
+    static constexpr CsrNumber hotNumbers_[] = {
+      CsrNumber::MSTATUS, CsrNumber::MEPC, CsrNumber::MCAUSE,
+      CsrNumber::MTVAL, CsrNumber::MIP, CsrNumber::MIE, CsrNumber::MTVEC,
+      CsrNumber::DCSR };
+    static_assert(sizeof(hotNumbers_)/sizeof(hotNumbers_[0]) ==
+		  unsigned(HotCsr::_Count));
+    Csr<URV>* hotCsrs_[unsigned(HotCsr::_Count)] = {};
 
     Triggers<URV> triggers_;
 
     // Register written since most recent clearLastWrittenRegs
     std::vector<CsrNumber> lastWrittenRegs_;
+    bool recordWrites_ = true;       // See enableWriteRecording.
+    bool unrecordedWrites_ = false;  // Writes while recording was off.
 
     // Counters implementing machine performance counters.
     PerfRegs mPerfRegs_;
 
     bool interruptEnable_ = false;  // Cached MSTATUS MIE bit.
+    bool interruptPossible_ = false;  // Cached MIE bit and (mie & mip).
 
     // These can be obtained from Triggers. Speed up access by caching
     // them in here.
@@ -0,0 +1,156 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <functional>
+#include "Device.hpp"
+#include "Memory.hpp"
+
+
+using namespace WdRiscv;
+
+
+bool
+DeviceBus::attach(Device& device)
+{
+  // Harts sharing the memory run on their own threads: Accesses by
+  // another hart would race with the owning hart on the device.
+  Device* dev = &device;
+  auto readFn = [this, dev] (size_t addr, uint32_t& value) {
+    return current_ == this and dev->read(addr, value); };
+  auto writeFn = [this, dev] (size_t addr, uint32_t value) {
+    return current_ == this and dev->write(addr, value); };
+
+  if (not memory_.defineDevice(device.address(), device.size(), readFn,
+			       writeFn))
+    return false;
+
+  devices_.push_back(dev);
+  return true;
+}
+
+
+void
+DeviceBus::schedule(Device& device, uint64_t time, unsigned tag)
+{
+  Event event;
+  event.time = time;
+  event.seq = seq_++;
+  event.device = &device;
+  event.tag = tag;
+
+  events_.push_back(event);
+  std::push_heap(events_.begin(), events_.end(), std::greater<Event>());
+  if (wakeup_ and events_.front().time < nextTime_)
+    *wakeup_ = 0;
+  nextTime_ = events_.front().time;
+}
+
+
+void
+DeviceBus::dispatch(uint64_t now)
+{
+  while (not events_.empty() and events_.front().time <= now)
+    {
+      std::pop_heap(events_.begin(), events_.end(), std::greater<Event>());
+      Event event = events_.back();
+      events_.pop_back();
+      nextTime_ = events_.empty() ? ~uint64_t(0) : events_.front().time;
+
+      event.device->event(event.time, event.tag);
+    }
+}
+
+
+void
+DeviceBus::cancel(Device& device)
+{
+  auto end = std::remove_if(events_.begin(), events_.end(),
+			    [&device] (const Event& event) {
+			      return event.device == &device; });
+  if (end == events_.end())
+    return;
+
+  events_.erase(end, events_.end());
+  std::make_heap(events_.begin(), events_.end(), std::greater<Event>());
+  nextTime_ = events_.empty() ? ~uint64_t(0) : events_.front().time;
+}
+
+
+bool
+Timer::read(size_t addr, uint32_t& value)
+{
+  size_t offset = addr - address();
+  uint64_t reg = offset < 8 ? mtime() : compare_;
+  value = (offset & 4) ? uint32_t(reg >> 32) : uint32_t(reg);
+  return true;
+}
+
+
+bool
+Timer::write(size_t addr, uint32_t value)
+{
+  size_t offset = addr - address();
+  uint64_t reg = offset < 8 ? mtime() : compare_;
+  if (offset & 4)
+    reg = (reg & 0xffffffff) | (uint64_t(value) << 32);
+  else
+    reg = (reg & ~uint64_t(0xffffffff)) | value;
+
+  if (offset < 8)
+    offset_ = reg - timeFn_();
+  else
+    compare_ = reg;
+
+  update();
+  return true;
+}
+
+
+void
+Timer::event(uint64_t, unsigned)
+{
+  update();
+}
+
+
+void
+Timer::reset()
+{
+  offset_ = 0 - timeFn_();
+  compare_ = ~uint64_t(0);
+  update();
+}
+
+
+void
+Timer::update()
+{
+  bus_.cancel(*this);
+
+  uint64_t now = timeFn_();
+  uint64_t time = mtime();
+  bool pending = time >= compare_;
+  interruptFn_(pending);
+
+  // Schedule the event unless mtime cannot reach mtimecmp before the
+  // current time wraps around.
+  uint64_t delay = compare_ - time;
+  if (not pending and delay < ~uint64_t(0) - now)
+    bus_.schedule(*this, now + delay);
+}
@@ -0,0 +1,233 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  class Memory;
+
+  /// Model of a device (UART, timer, interrupt source ...) whose
+  /// registers occupy a range of the memory mapped register space
+  /// (see Memory::defineMemoryMappedRegisterRegion). Loads and stores
+  /// are dispatched to the device only when they fall in its range.
+  /// Instead of being polled, a device schedules events on the bus it
+  /// is attached to (see DeviceBus::schedule).
+  class Device
+  {
+  public:
+
+    /// Constructor: The device registers occupy size bytes starting
+    /// at the given address. Address and size must be multiples of 4.
+    Device(size_t address, size_t size)
+      : address_(address), size_(size)
+    { }
+
+    virtual ~Device() = default;
+
+    /// Return the address of the first register of this device.
+    size_t address() const
+    { return address_; }
+
+    /// Return the size in bytes of the register range of this device.
+    size_t size() const
+    { return size_; }
+
+    /// Set value to the contents of the register at the given
+    /// address. Return true on success and false to fail the load
+    /// (access fault).
+    virtual bool read(size_t addr, uint32_t& value) = 0;
+
+    /// Process a write of the given value (after masking) to the
+    /// register at the given address. Return true on success and
+    /// false to fail the store (access fault).
+    virtual bool write(size_t addr, uint32_t value) = 0;
+
+    /// Process an event previously scheduled by this device with the
+    /// given time and tag (see DeviceBus::schedule).
+    virtual void event(uint64_t time, unsigned tag)
+    { (void)time; (void)tag; }
+
+    /// Return true if reading a register of this device changes its
+    /// state (read-to-clear status, receive FIFO ...). Loops polling
+    /// the registers of such a device are not fast-forwarded (see
+    /// Core::enableIdleSkip).
+    virtual bool hasReadSideEffects() const
+    { return false; }
+
+  private:
+
+    size_t address_;
+    size_t size_;
+  };
+
+
+  /// Collection of the devices attached to a memory and queue of
+  /// their pending events. Time is measured in retired instructions
+  /// of the hart owning the bus. Pending events are kept in a
+  /// min-heap: the run loop only compares the current time to the
+  /// time of the earliest event (see nextEventTime).
+  class DeviceBus
+  {
+  public:
+
+    /// Constructor: Devices are attached to the given memory.
+    DeviceBus(Memory& memory)
+      : memory_(memory)
+    { }
+
+    /// Attach the given device (which must outlive this bus): loads
+    /// and stores to its register range are dispatched to it. Return
+    /// true on success and false if the device range is not in
+    /// memory mapped register pages or overlaps another device. The
+    /// device state belongs to the hart owning the bus: Loads and
+    /// stores by other harts (see enter) fail.
+    bool attach(Device& device);
+
+    /// Make this bus the one of the hart executing on the calling
+    /// thread. Called by the run loops of the owning hart before
+    /// executing instructions.
+    void enter()
+    { current_ = this; }
+
+    /// Schedule an event for the given device at the given time
+    /// (retired instruction count). Events of equal time are
+    /// dispatched in the order they were scheduled.
+    void schedule(Device& device, uint64_t time, unsigned tag = 0);
+
+    /// Zero the given time whenever an event is scheduled before the
+    /// earliest pending one. The run loops of the owning hart keep
+    /// there the time at which they next look at the events (see
+    /// nextEventTime) and look at them before the next instruction.
+    void setWakeup(uint64_t* time)
+    { wakeup_ = time; }
+
+    /// Return the time of the earliest pending event or ~0 if none.
+    uint64_t nextEventTime() const
+    { return nextTime_; }
+
+    /// Dispatch, in time order, the pending events with a time less
+    /// than or equal to the given time, including those scheduled by
+    /// the event handlers themselves.
+    void dispatch(uint64_t now);
+
+    /// Remove the pending events of the given device.
+    void cancel(Device& device);
+
+    /// Return true if no device is attached to this bus.
+    bool empty() const
+    { return devices_.empty(); }
+
+    /// Return true if reading the registers of any of the attached
+    /// devices has side effects.
+    bool hasReadSideEffects() const
+    {
+      for (auto device : devices_)
+	if (device->hasReadSideEffects())
+	  return true;
+      return false;
+    }
+
+  private:
+
+    struct Event
+    {
+      uint64_t time = 0;
+      uint64_t seq = 0;     // Order of scheduling among equal times.
+      Device* device = nullptr;
+      unsigned tag = 0;
+
+      /// Heap order: earliest (time, seq) first.
+      bool operator>(const Event& other) const
+      { return time > other.time or (time == other.time and seq > other.seq); }
+    };
+
+    Memory& memory_;
+    std::vector<Device*> devices_;
+    std::vector<Event> events_;    // Min-heap.
+    uint64_t seq_ = 0;
+    uint64_t nextTime_ = ~uint64_t(0);
+    uint64_t* wakeup_ = nullptr;   // See setWakeup.
+
+    // Bus of the hart executing on this thread (see enter).
+    static inline thread_local const DeviceBus* current_ = nullptr;
+  };
+
+
+  /// Machine timer in the style of the mtime/mtimecmp pair of the
+  /// RISC-V CLINT. Its four 32-bit registers are mtime (low and high
+  /// halves at offsets 0 and 4) and mtimecmp (offsets 8 and 12). Mtime
+  /// counts the retired instructions of the hart owning the bus. The
+  /// timer interrupt is pending while mtime is greater than or equal
+  /// to mtimecmp: Instead of comparing them at every instruction, the
+  /// timer schedules an event at the time mtime reaches mtimecmp.
+  class Timer : public Device
+  {
+  public:
+
+    /// Size in bytes of the registers of a timer.
+    static constexpr size_t registerBytes = 16;
+
+    /// Return the current time (retired instruction count).
+    typedef std::function<uint64_t()> TimeFn;
+
+    /// Set (true) or clear (false) the timer interrupt.
+    typedef std::function<void(bool)> InterruptFn;
+
+    /// Constructor: The timer registers start at the given address
+    /// and its events are scheduled on the given bus.
+    Timer(size_t address, DeviceBus& bus, TimeFn timeFn,
+	  InterruptFn interruptFn)
+      : Device(address, registerBytes), bus_(bus), timeFn_(timeFn),
+	interruptFn_(interruptFn)
+    { }
+
+    bool read(size_t addr, uint32_t& value) override;
+
+    bool write(size_t addr, uint32_t value) override;
+
+    void event(uint64_t time, unsigned tag) override;
+
+    /// Zero mtime and set mtimecmp to its largest value (no
+    /// interrupt).
+    void reset();
+
+  private:
+
+    /// Return the current value of mtime.
+    uint64_t mtime() const
+    { return timeFn_() + offset_; }
+
+    /// Set or clear the interrupt according to the current values of
+    /// mtime and mtimecmp and schedule the event raising it.
+    void update();
+
+    DeviceBus& bus_;
+    TimeFn timeFn_;
+    InterruptFn interruptFn_;
+    uint64_t offset_ = 0;               // Mtime minus current time.
+    uint64_t compare_ = ~uint64_t(0);   // Mtimecmp.
+  };
+}
@@ -0,0 +1,276 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elfio/elf_types.hpp>
+#include "ElfFile.hpp"
+
+
+using namespace WdRiscv;
+
+
+ElfFile::~ElfFile()
+{
+  if (base_)
+    munmap(const_cast<uint8_t*>(base_), size_);
+}
+
+
+bool
+ElfFile::isRiscv() const
+{
+  return machine_ == EM_RISCV;
+}
+
+
+bool
+ElfFile::open(const std::string& path)
+{
+  path_ = path;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    {
+      std::cerr << "Failed to load ELF file " << path << '\n';
+      return false;
+    }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < EI_NIDENT)
+    {
+      std::cerr << "Failed to load ELF file " << path << '\n';
+      close(fd);
+      return false;
+    }
+
+  void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    {
+      std::cerr << "Failed to map ELF file " << path << '\n';
+      return false;
+    }
+  base_ = static_cast<const uint8_t*>(mem);
+  size_ = st.st_size;
+
+  if (base_[EI_MAG0] != ELFMAG0 or base_[EI_MAG1] != ELFMAG1 or
+      base_[EI_MAG2] != ELFMAG2 or base_[EI_MAG3] != ELFMAG3)
+    {
+      std::cerr << "Failed to load ELF file " << path << ": not an ELF file\n";
+      return false;
+    }
+
+  unsigned elfClass = base_[EI_CLASS];
+  if (elfClass != ELFCLASS32 and elfClass != ELFCLASS64)
+    {
+      std::cerr << "Only 32/64-bit ELFs are currently supported\n";
+      return false;
+    }
+
+  if (base_[EI_DATA] != ELFDATA2LSB)
+    {
+      std::cerr << "Only little-endian ELF is currently supported\n";
+      return false;
+    }
+
+  is64_ = elfClass == ELFCLASS64;
+  if (is64_)
+    return parseHeaders<ELFIO::Elf64_Ehdr, ELFIO::Elf64_Phdr,
+			ELFIO::Elf64_Shdr>(path);
+  return parseHeaders<ELFIO::Elf32_Ehdr, ELFIO::Elf32_Phdr,
+		      ELFIO::Elf32_Shdr>(path);
+}
+
+
+template <typename Ehdr, typename Phdr, typename Shdr>
+bool
+ElfFile::parseHeaders(const std::string& path)
+{
+  // Headers are copied out of the mapping: the file gives no
+  // alignment guarantee for the tables.
+  Ehdr ehdr;
+  if (size_ < sizeof(ehdr))
+    {
+      std::cerr << "Failed to load ELF file " << path << ": truncated header\n";
+      return false;
+    }
+  memcpy(&ehdr, base_, sizeof(ehdr));
+  machine_ = ehdr.e_machine;
+  entry_ = ehdr.e_entry;
+
+  auto inFile = [this] (uint64_t offset, uint64_t size) {
+    return offset <= size_ and size <= size_ - offset;
+  };
+
+  if (ehdr.e_phnum and (ehdr.e_phentsize < sizeof(Phdr) or
+			not inFile(ehdr.e_phoff, uint64_t(ehdr.e_phnum) * ehdr.e_phentsize)))
+    {
+      std::cerr << "Failed to load ELF file " << path
+		<< ": malformed program header table\n";
+      return false;
+    }
+
+  for (unsigned i = 0; i < ehdr.e_phnum; ++i)
+    {
+      Phdr phdr;
+      memcpy(&phdr, base_ + ehdr.e_phoff + uint64_t(i) * ehdr.e_phentsize,
+	     sizeof(phdr));
+      if (phdr.p_type != PT_LOAD)
+	continue;
+      if (not inFile(phdr.p_offset, phdr.p_filesz))
+	{
+	  std::cerr << "Failed to load ELF file " << path << ": segment " << i
+		    << " extends beyond end of file\n";
+	  return false;
+	}
+      segments_.push_back({phdr.p_vaddr, phdr.p_filesz, base_ + phdr.p_offset,
+			   (phdr.p_flags & PF_X) != 0});
+    }
+
+  // Only the section headers are read here. Symbol tables and their
+  // string tables are located but not walked.
+  if (ehdr.e_shnum == 0)
+    return true;
+  if (ehdr.e_shentsize < sizeof(Shdr) or
+      not inFile(ehdr.e_shoff, uint64_t(ehdr.e_shnum) * ehdr.e_shentsize))
+    {
+      std::cerr << "Warning: ELF file " << path
+		<< ": malformed section header table, symbols ignored\n";
+      return true;
+    }
+
+  auto section = [this, &ehdr] (unsigned ix) {
+    Shdr shdr;
+    memcpy(&shdr, base_ + ehdr.e_shoff + uint64_t(ix) * ehdr.e_shentsize,
+	   sizeof(shdr));
+    return shdr;
+  };
+
+  for (unsigned i = 0; i < ehdr.e_shnum; ++i)
+    {
+      Shdr shdr = section(i);
+      if (shdr.sh_type != SHT_SYMTAB or shdr.sh_entsize == 0 or
+	  shdr.sh_link >= ehdr.e_shnum)
+	continue;
+      Shdr strShdr = section(shdr.sh_link);
+      if (not inFile(shdr.sh_offset, shdr.sh_size) or
+	  not inFile(strShdr.sh_offset, strShdr.sh_size))
+	continue;
+
+      SymTab tab;
+      tab.syms = base_ + shdr.sh_offset;
+      tab.entSize = shdr.sh_entsize;
+      tab.count = shdr.sh_size / shdr.sh_entsize;
+      tab.strings = reinterpret_cast<const char*>(base_ + strShdr.sh_offset);
+      tab.stringsSize = strShdr.sh_size;
+      symTabs_.push_back(tab);
+    }
+
+  return true;
+}
+
+
+bool
+ElfFile::addressBounds(uint64_t& minAddr, uint64_t& maxAddr) const
+{
+  if (segments_.empty())
+    return false;
+
+  uint64_t minBound = ~uint64_t(0), maxBound = 0;
+  for (const auto& seg : segments_)
+    {
+      minBound = std::min(minBound, seg.addr);
+      maxBound = std::max(maxBound, seg.addr + seg.fileSize);
+    }
+  minAddr = minBound;
+  maxAddr = maxBound;
+  return true;
+}
+
+
+template <typename Visit>
+void
+ElfFile::walkSymbols(Visit visit) const
+{
+  for (const auto& tab : symTabs_)
+    for (uint64_t ix = 0; ix < tab.count; ++ix)
+      {
+	const uint8_t* entry = tab.syms + ix * tab.entSize;
+	uint64_t nameOffset = 0, addr = 0, size = 0;
+	unsigned type = 0;
+	if (is64_)
+	  {
+	    ELFIO::Elf64_Sym sym;
+	    if (tab.entSize < sizeof(sym))
+	      break;
+	    memcpy(&sym, entry, sizeof(sym));
+	    nameOffset = sym.st_name; addr = sym.st_value; size = sym.st_size;
+	    type = ELF_ST_TYPE(sym.st_info);
+	  }
+	else
+	  {
+	    ELFIO::Elf32_Sym sym;
+	    if (tab.entSize < sizeof(sym))
+	      break;
+	    memcpy(&sym, entry, sizeof(sym));
+	    nameOffset = sym.st_name; addr = sym.st_value; size = sym.st_size;
+	    type = ELF_ST_TYPE(sym.st_info);
+	  }
+
+	if (type != STT_NOTYPE and type != STT_FUNC and type != STT_OBJECT)
+	  continue;
+	if (nameOffset >= tab.stringsSize)
+	  continue;
+	const char* name = tab.strings + nameOffset;
+	size_t maxLen = tab.stringsSize - nameOffset;
+	size_t len = strnlen(name, maxLen);
+	if (len == 0 or len == maxLen)
+	  continue;  // Empty or not terminated.
+	visit(name, len, ElfSymbol(addr, size));
+      }
+}
+
+
+bool
+ElfFile::findSymbol(const char* name, ElfSymbol& symbol) const
+{
+  bool found = false;
+  size_t nameLen = strlen(name);
+  walkSymbols([&] (const char* symName, size_t len, const ElfSymbol& sym) {
+      if (len == nameLen and memcmp(symName, name, len) == 0)
+	{
+	  symbol = sym;
+	  found = true;
+	}
+    });
+  return found;
+}
+
+
+void
+ElfFile::collectSymbols(std::unordered_map<std::string, ElfSymbol>& symbols) const
+{
+  walkSymbols([&symbols] (const char* name, size_t len, const ElfSymbol& sym) {
+      symbols[std::string(name, len)] = sym;
+    });
+}
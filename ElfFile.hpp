@@ -0,0 +1,132 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Memory.hpp"
+
+
+namespace WdRiscv
+{
+
+  /// Read-only view of an ELF file mapped into the address space of
+  /// the simulator. Nothing is copied when the file is opened: only
+  /// the file and program headers are checked. Segment contents are
+  /// pointers into the mapping so that the pages of the file that are
+  /// never used (debug sections) are never read. The symbol table is
+  /// walked only when a symbol is looked up or when all the symbols
+  /// are requested.
+  class ElfFile
+  {
+  public:
+
+    /// A loadable (PT_LOAD) segment: file contents of the segment
+    /// (fileSize bytes) to be placed at the given address.
+    struct Segment
+    {
+      uint64_t addr = 0;
+      uint64_t fileSize = 0;
+      const uint8_t* data = nullptr;
+      bool exec = false;    // Executable (PF_X) segment.
+    };
+
+    ElfFile() = default;
+
+    /// Unmap the file.
+    ~ElfFile();
+
+    ElfFile(const ElfFile&) = delete;
+    ElfFile& operator=(const ElfFile&) = delete;
+
+    /// Map the given file and check its headers. Return true on
+    /// success. Return false printing a message on standard error if
+    /// the file cannot be opened or is not a little-endian 32/64-bit
+    /// ELF file or has a malformed header.
+    bool open(const std::string& path);
+
+    /// Return the path of the file given to open.
+    const std::string& path() const
+    { return path_; }
+
+    /// Return true if file is for the RISCV machine.
+    bool isRiscv() const;
+
+    /// Return true if this is a 64-bit ELF file.
+    bool is64() const
+    { return is64_; }
+
+    /// Return the program entry point.
+    uint64_t entryPoint() const
+    { return entry_; }
+
+    /// Return the loadable segments in the order of the program
+    /// headers.
+    const std::vector<Segment>& loadSegments() const
+    { return segments_; }
+
+    /// Set minAddr/maxAddr to the smallest start address and the
+    /// largest end address of the loadable segments. Return false
+    /// leaving minAddr/maxAddr unmodified if there is no loadable
+    /// segment.
+    bool addressBounds(uint64_t& minAddr, uint64_t& maxAddr) const;
+
+    /// Look up the given symbol (of type NOTYPE, FUNC or OBJECT) in
+    /// the symbol tables of the file without collecting the other
+    /// symbols. Return true setting symbol if found. If the name is
+    /// defined more than once, the last definition wins (as with
+    /// collectSymbols).
+    bool findSymbol(const char* name, ElfSymbol& symbol) const;
+
+    /// Add the symbols of type NOTYPE, FUNC or OBJECT of this file to
+    /// the given map replacing existing entries of the same name.
+    void collectSymbols(std::unordered_map<std::string, ElfSymbol>& symbols) const;
+
+  private:
+
+    /// Symbol table section: entries and associated string table.
+    struct SymTab
+    {
+      const uint8_t* syms = nullptr;
+      uint64_t count = 0;
+      uint64_t entSize = 0;
+      const char* strings = nullptr;
+      uint64_t stringsSize = 0;
+    };
+
+    template <typename Ehdr, typename Phdr, typename Shdr>
+    bool parseHeaders(const std::string& path);
+
+    /// Call visit(name, nameLength, symbol) for each symbol of
+    /// interest in the symbol tables in file order.
+    template <typename Visit>
+    void walkSymbols(Visit visit) const;
+
+    std::string path_;
+    const uint8_t* base_ = nullptr;   // Start of mapping.
+    uint64_t size_ = 0;               // File size.
+    bool is64_ = false;
+    unsigned machine_ = 0;
+    uint64_t entry_ = 0;
+    std::vector<Segment> segments_;
+    std::vector<SymTab> symTabs_;
+  };
+}
@@ -0,0 +1,140 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include "EventLog.hpp"
+
+
+using namespace WdRiscv;
+
+
+static constexpr uint32_t eventLogMagic = 0x54564557;  // "WEVT"
+static constexpr unsigned eventLogVersion = 1;
+
+
+EventLogWriter::EventLogWriter(FILE* out, unsigned xlen)
+  : out_(out)
+{
+  uint8_t header[8];
+  memcpy(header, &eventLogMagic, 4);   // Little endian host assumed.
+  header[4] = eventLogVersion;
+  header[5] = xlen;
+  header[6] = header[7] = 0;
+  fwrite(header, sizeof(header), 1, out_);
+}
+
+
+void
+EventLogWriter::putVarint(uint64_t x)
+{
+  while (x >= 0x80)
+    {
+      putc(int((x & 0x7f) | 0x80), out_);
+      x >>= 7;
+    }
+  putc(int(x), out_);
+}
+
+
+void
+EventLogWriter::write(const SessionEvent& event, const uint8_t* data,
+		      size_t size)
+{
+  // Counts restart at zero after a reset: Delta may be negative.
+  int64_t delta = int64_t(event.count - prevCount_);
+  prevCount_ = event.count;
+
+  putc(event.kind, out_);
+  putVarint((uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+  putVarint(event.resource);
+  putVarint(event.address);
+  putVarint(event.value);
+  if (event.kind == SessionEvent::PokeBlock)
+    {
+      putVarint(size);
+      fwrite(data, 1, size, out_);
+    }
+}
+
+
+EventLogReader::EventLogReader(FILE* in)
+  : in_(in)
+{
+  uint8_t header[8];
+  if (fread(header, sizeof(header), 1, in_) != 1)
+    return;
+  uint32_t magic = 0;
+  memcpy(&magic, header, 4);
+  xlen_ = header[5];
+  valid_ = (magic == eventLogMagic and header[4] == eventLogVersion and
+	    (xlen_ == 32 or xlen_ == 64));
+}
+
+
+bool
+EventLogReader::getVarint(uint64_t& x)
+{
+  x = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      int c = getc(in_);
+      if (c == EOF)
+	return false;
+      x |= uint64_t(c & 0x7f) << shift;
+      if ((c & 0x80) == 0)
+	return true;
+    }
+  return false;
+}
+
+
+bool
+EventLogReader::next(SessionEvent& event)
+{
+  if (not valid_)
+    return false;
+
+  int kind = getc(in_);
+  if (kind == EOF or kind < SessionEvent::Poke or kind > SessionEvent::End)
+    return false;
+
+  uint64_t zz = 0;
+  if (not getVarint(zz))
+    return false;
+  int64_t delta = int64_t(zz >> 1) ^ -int64_t(zz & 1);
+  prevCount_ += delta;
+
+  event.kind = SessionEvent::Kind(kind);
+  event.count = prevCount_;
+  event.data.clear();
+  if (not getVarint(event.resource) or not getVarint(event.address) or
+      not getVarint(event.value))
+    return false;
+
+  if (event.kind == SessionEvent::PokeBlock)
+    {
+      uint64_t size = 0;
+      if (not getVarint(size) or size > (uint64_t(1) << 32))
+	return false;
+      event.data.resize(size);
+      if (size and fread(event.data.data(), 1, size, in_) != size)
+	return false;
+    }
+
+  return true;
+}
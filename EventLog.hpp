@@ -0,0 +1,127 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  // Event log file layout (fixed size integers little endian):
+  //
+  //   Header:  u32 magic ("WEVT"), u8 version, u8 xlen, u16 0
+  //   Events:  u8 kind, svarint count (delta from previous event),
+  //            varint resource, varint address, varint value and, for
+  //            a PokeBlock event, varint size followed by size bytes.
+  //
+  // Varints are little endian base-128, svarints are zigzag encoded
+  // varints.
+
+  /// Event injected into a server-mode session by the test-bench
+  /// (anything that changes the state of the hart besides stepping).
+  /// The count is the instruction count of the hart (see
+  /// Core::getInstructionCount) when the event was applied.
+  struct SessionEvent
+  {
+    enum Kind : uint8_t
+      {
+	Poke = 1,      // Resource, address and value of a Poke request.
+	Exception,     // Address and value of an Exception request.
+	LoadFinished,  // Address of a LoadFinished request.
+	Reset,         // Address and value of a Reset request.
+	EnterDebug,
+	ExitDebug,
+	PokeBlock,     // Address and bytes of a memory block.
+	End            // End of session.
+      };
+
+    Kind kind = End;
+    uint64_t count = 0;
+    uint64_t resource = 0;
+    uint64_t address = 0;
+    uint64_t value = 0;
+    std::vector<uint8_t> data;   // PokeBlock bytes.
+  };
+
+
+  /// Record the events of a server-mode session to a file.
+  class EventLogWriter
+  {
+  public:
+
+    /// Constructor: Write to the given file which must be open for
+    /// writing the events of a hart of the given xlen (32 or 64).
+    EventLogWriter(FILE* out, unsigned xlen);
+
+    /// Append the given event. The data field is only used by
+    /// PokeBlock events.
+    void write(const SessionEvent& event)
+    { write(event, event.data.data(), event.data.size()); }
+
+    /// Append the given event with the given PokeBlock bytes (the data
+    /// field of the event is ignored).
+    void write(const SessionEvent& event, const uint8_t* data, size_t size);
+
+    /// Write buffered events to the file.
+    void flush()
+    { fflush(out_); }
+
+  private:
+
+    void putVarint(uint64_t x);
+
+    FILE* out_ = nullptr;
+    uint64_t prevCount_ = 0;
+  };
+
+
+  /// Read the events of an event log file.
+  class EventLogReader
+  {
+  public:
+
+    /// Constructor: Read from the given file which must be open for
+    /// reading.
+    EventLogReader(FILE* in);
+
+    /// Return true if the file header is valid.
+    bool isValid() const
+    { return valid_; }
+
+    /// Return the xlen of the recorded hart.
+    unsigned xlen() const
+    { return xlen_; }
+
+    /// Set event to the next event in the file. Return false at end
+    /// of file or if the file is truncated/malformed.
+    bool next(SessionEvent& event);
+
+  private:
+
+    bool getVarint(uint64_t& x);
+
+    FILE* in_ = nullptr;
+    bool valid_ = false;
+    unsigned xlen_ = 0;
+    uint64_t prevCount_ = 0;
+  };
+}
@@ -82,15 +82,16 @@ namespace WdRiscv
     friend class Core<uint64_t>;
 
     /// Constructor: Define a register file with the given number of
-    /// registers. Each register is of type FRV. All registers
-    /// initialized to zero.
-    FpRegs(unsigned registerCount)
-      : regs_(registerCount, 0)
-    { }
-
-    /// Destructor.
-    ~FpRegs()
-    { regs_.clear(); }
+    /// registers. Each register is of type FRV. The register values
+    /// are kept in the given array (at least registerCount entries,
+    /// part of the architectural state block of the hart) which must
+    /// outlive this object. All registers initialized to zero.
+    FpRegs(FRV* regs, unsigned registerCount)
+      : regs_(regs), count_(registerCount)
+    {
+      for (unsigned i = 0; i < registerCount; ++i)
+	regs_[i] = 0;
+    }
     
     /// Return value of ith register.
     FRV read(unsigned i) const
@@ -100,30 +101,30 @@ namespace WdRiscv
     uint64_t readBits(unsigned i) const
     {
       if (sizeof(FRV) == 4)
-	return *((uint32_t*) &regs_.at(i));
+	return *((uint32_t*) &regs_[i]);
 
       // If nan-boxed return the single precision number.
-      uint32_t* words = (uint32_t*) &regs_.at(i);
+      uint32_t* words = (uint32_t*) &regs_[i];
       if (words[1] == ~uint32_t(0))
 	return words[0];
 
-      return *((uint64_t*) &regs_.at(i));
+      return *((uint64_t*) &regs_[i]);
     }
 
     /// Set FP register i to the given value.
     void pokeBits(unsigned i, uint64_t val)
     {
       if (sizeof(FRV) == 4)
-	*((uint32_t*) &regs_.at(i)) = val;
+	*((uint32_t*) &regs_[i]) = val;
       else
-	*((uint64_t*) &regs_.at(i)) = val;
+	*((uint64_t*) &regs_[i]) = val;
     }
 
     /// Set value of ith register to the given value.
     void write(unsigned i, FRV value)
     {
-      originalValue_ = regs_.at(i);
-      regs_.at(i) = value;
+      originalValue_ = regs_[i];
+      regs_[i] = value;
       lastWrittenReg_ = i;
     }
 
@@ -140,7 +141,7 @@ namespace WdRiscv
 
     /// Return the count of registers in this register file.
     size_t size() const
-    { return regs_.size(); }
+    { return count_; }
 
     /// Return the number of bits in a register in this register file.
     static constexpr uint32_t regWidth()
@@ -151,8 +152,8 @@ namespace WdRiscv
     void reset()
     {
       clearLastWrittenReg();
-      for (auto& reg : regs_)
-	reg = 0;
+      for (unsigned i = 0; i < count_; ++i)
+	regs_[i] = 0;
     }
 
     /// Clear the number denoting the last written register.
@@ -195,7 +196,8 @@ namespace WdRiscv
 	
   private:
 
-    std::vector<FRV> regs_;
+    FRV* regs_ = nullptr;      // See constructor.
+    unsigned count_ = 0;
     int lastWrittenReg_ = -1;  // Register accessed in most recent write.
     FRV originalValue_ = 0;    // Original value of last written reg.
   };
@@ -206,7 +208,7 @@ namespace WdRiscv
   float
   FpRegs<float>::readSingle(unsigned i) const
   {
-    return regs_.at(i);
+    return regs_[i];
   }
 
 
@@ -225,7 +227,7 @@ namespace WdRiscv
   FpRegs<double>::readSingle(unsigned i) const
   {
     FpUnion u;
-    u.dp = regs_.at(i);
+    u.dp = regs_[i];
     return u.sp.sp;
   }
 
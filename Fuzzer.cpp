@@ -0,0 +1,508 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "Fuzzer.hpp"
+
+
+using namespace WdRiscv;
+
+
+/// Return a 32-bit hash of the given value.
+static uint32_t
+mix(uint64_t x)
+{
+  x ^= x >> 33;  x *= 0xff51afd7ed558ccd;
+  x ^= x >> 33;  x *= 0xc4ceb9fe1a85ec53;
+  x ^= x >> 33;
+  return uint32_t(x);
+}
+
+
+FuzzFeedback::FuzzFeedback()
+{
+  hooks_.context = this;
+  hooks_.trap = [] (void* context, uint32_t, uint64_t, uint64_t cause,
+		    uint32_t interrupt) {
+    static_cast<FuzzFeedback*>(context)->trap(cause, interrupt);
+  };
+  hooks_.csrWrite = [] (void* context, uint32_t, uint64_t, uint32_t csr,
+			uint64_t value) {
+    static_cast<FuzzFeedback*>(context)->csrWrite(csr, value);
+  };
+  features_.reserve(1024);
+}
+
+
+void
+FuzzFeedback::add(uint64_t kind, uint64_t a, uint64_t b)
+{
+  features_.push_back(mix((kind << 56) ^ (a << 20) ^ b ^ mix(b)));
+}
+
+
+void
+FuzzFeedback::trap(uint64_t cause, bool interrupt)
+{
+  uint64_t trap = (cause << 1) | interrupt;
+  add(1, trap);
+  add(2, trap, prevTrap_);
+  prevTrap_ = trap + 1;
+  trapCount_++;
+}
+
+
+void
+FuzzFeedback::csrWrite(unsigned csr, uint64_t value)
+{
+  if (value == 0)
+    add(3, csr);
+  for (uint64_t bits = value; bits; bits &= bits - 1)
+    add(4, csr, __builtin_ctzll(bits));
+}
+
+
+void
+FuzzFeedback::triggerHit(unsigned trigger)
+{
+  add(5, trigger);
+}
+
+
+void
+FuzzFeedback::finish()
+{
+  unsigned magnitude = 0;
+  for (uint64_t count = trapCount_; count; count >>= 1)
+    magnitude++;
+  add(6, magnitude);
+}
+
+
+FuzzCorpus::FuzzCorpus(const std::string& dir)
+  : dir_(dir), map_(new std::atomic<uint8_t>[size_t(1) << mapBits]),
+    featureCount_(0)
+{
+  for (size_t i = 0; i < (size_t(1) << mapBits); ++i)
+    map_[i].store(0, std::memory_order_relaxed);
+}
+
+
+bool
+FuzzCorpus::load(unsigned maxLength)
+{
+  if (mkdir(dir_.c_str(), 0777) != 0 and errno != EEXIST)
+    {
+      std::cerr << "Failed to create fuzzing corpus directory '" << dir_
+		<< "': " << strerror(errno) << '\n';
+      return false;
+    }
+
+  DIR* dir = opendir(dir_.c_str());
+  if (not dir)
+    {
+      std::cerr << "Failed to open fuzzing corpus directory '" << dir_
+		<< "': " << strerror(errno) << '\n';
+      return false;
+    }
+
+  // Sort by name for runs reproducible from their random seed.
+  std::vector<std::string> names;
+  while (const dirent* entry = readdir(dir))
+    if (entry->d_name[0] != '.')
+      names.push_back(entry->d_name);
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+
+  for (const auto& name : names)
+    {
+      std::string path = dir_ + "/" + name;
+      FILE* file = fopen(path.c_str(), "rb");
+      if (not file)
+	continue;
+
+      std::vector<uint32_t> words(maxLength);
+      size_t count = fread(words.data(), sizeof(uint32_t), maxLength, file);
+      fclose(file);
+      if (count == 0)
+	continue;
+      words.resize(count);
+      seeds_.push_back(std::move(words));
+    }
+
+  loaded_ = seeds_.size();
+  return true;
+}
+
+
+bool
+FuzzCorpus::seed(size_t i, std::vector<uint32_t>& words) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (i >= seeds_.size())
+    return false;
+  words = seeds_[i];
+  return true;
+}
+
+
+bool
+FuzzCorpus::pick(FuzzRandom& rand, std::vector<uint32_t>& words) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (seeds_.empty())
+    return false;
+  words = seeds_[rand.next() % seeds_.size()];
+  return true;
+}
+
+
+unsigned
+FuzzCorpus::merge(const std::vector<uint32_t>& features)
+{
+  // Test before exchanging: Known features (nearly all of them once
+  // the run has warmed up) leave the cache lines of the map shared.
+  unsigned fresh = 0;
+  size_t mask = (size_t(1) << mapBits) - 1;
+  for (uint32_t feature : features)
+    {
+      auto& slot = map_[feature & mask];
+      if (slot.load(std::memory_order_relaxed) == 0 and
+	  slot.exchange(1, std::memory_order_relaxed) == 0)
+	fresh++;
+    }
+  featureCount_ += fresh;
+  return fresh;
+}
+
+
+void
+FuzzCorpus::add(const std::vector<uint32_t>& words)
+{
+  // Name seeds by content: A seed found again overwrites itself.
+  uint64_t hash = 0xcbf29ce484222325;
+  for (uint32_t word : words)
+    hash = (hash ^ word) * 0x100000001b3;
+  char name[32];
+  snprintf(name, sizeof(name), "/seed-%016llx",
+	   static_cast<unsigned long long>(hash));
+  std::string path = dir_ + name;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  seeds_.push_back(words);
+
+  FILE* file = fopen(path.c_str(), "wb");
+  bool ok = (file and
+	     fwrite(words.data(), sizeof(uint32_t), words.size(), file) ==
+	     words.size());
+  if (file and fclose(file) != 0)
+    ok = false;
+  if (not ok and not saveFailed_)
+    {
+      std::cerr << "Failed to write fuzzing seed file '" << path << "'\n";
+      saveFailed_ = true;
+    }
+}
+
+
+size_t
+FuzzCorpus::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return seeds_.size();
+}
+
+
+FuzzGenerator::FuzzGenerator(bool rv64, bool atomics,
+			     const std::vector<unsigned>& csrs)
+  : csrs_(csrs), rv64_(rv64)
+{
+  // Weights favor the instructions exercising traps and CSRs.
+  auto weigh = [this] (Class c, unsigned weight) {
+    classes_.insert(classes_.end(), weight, c);
+  };
+  weigh(OpImm, 4);
+  weigh(Op, 3);
+  weigh(Upper, 1);
+  weigh(Load, 2);
+  weigh(Store, 2);
+  weigh(Branch, 2);
+  weigh(Jump, 1);
+  weigh(Csr, csrs_.empty() ? 0 : 5);
+  weigh(System, 2);
+  weigh(Amo, atomics ? 1 : 0);
+  weigh(Op32, rv64 ? 1 : 0);
+  weigh(Raw, 1);
+}
+
+
+/// Return a random register number favoring x1 to x7.
+static unsigned
+randomReg(FuzzRandom& rand)
+{
+  return rand.below(4) ? 1 + rand.below(7) : rand.below(32);
+}
+
+
+/// Return a random 12-bit immediate: small, boundary or any.
+static uint32_t
+randomImm12(FuzzRandom& rand)
+{
+  static const uint32_t special[] = { 0, 0xfff, 0x7ff, 0x800, 1, 4, 8 };
+  switch (rand.below(3))
+    {
+    case 0:  return (rand.below(32) - 16) & 0xfff;
+    case 1:  return special[rand.below(sizeof(special)/sizeof(special[0]))];
+    default: return rand.below(0x1000);
+    }
+}
+
+
+static uint32_t
+encodeR(uint32_t opcode, unsigned f3, unsigned f7, unsigned rd, unsigned rs1,
+	unsigned rs2)
+{
+  return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) |
+    opcode;
+}
+
+
+static uint32_t
+encodeI(uint32_t opcode, unsigned f3, unsigned rd, unsigned rs1, uint32_t imm)
+{
+  return ((imm & 0xfff) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | opcode;
+}
+
+
+static uint32_t
+encodeS(uint32_t opcode, unsigned f3, unsigned rs1, unsigned rs2, uint32_t imm)
+{
+  return (((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) |
+    ((imm & 0x1f) << 7) | opcode;
+}
+
+
+static uint32_t
+encodeB(unsigned f3, unsigned rs1, unsigned rs2, uint32_t imm)
+{
+  return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 0x3f) << 25) |
+    (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (((imm >> 1) & 0xf) << 8) |
+    (((imm >> 11) & 1) << 7) | 0x63;
+}
+
+
+static uint32_t
+encodeJ(unsigned rd, uint32_t imm)
+{
+  return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3ff) << 21) |
+    (((imm >> 11) & 1) << 20) | (((imm >> 12) & 0xff) << 12) | (rd << 7) | 0x6f;
+}
+
+
+uint32_t
+FuzzGenerator::instruction(FuzzRandom& rand) const
+{
+  unsigned rd = randomReg(rand), rs1 = randomReg(rand), rs2 = randomReg(rand);
+  unsigned shiftMask = rv64_ ? 0x3f : 0x1f;
+
+  // Branches and jumps stay near the stream (offsets in words).
+  uint32_t offset = uint32_t(int32_t(rand.below(12)) - 2) * 4;
+
+  switch (classes_.at(rand.below(classes_.size())))
+    {
+    case OpImm:
+      {
+	unsigned f3 = rand.below(8);
+	uint32_t imm = randomImm12(rand);
+	if (f3 == 1)
+	  imm &= shiftMask;                               // slli
+	else if (f3 == 5)
+	  imm = (imm & shiftMask) | (rand.below(2) << 10);  // srli/srai
+	return encodeI(0x13, f3, rd, rs1, imm);
+      }
+
+    case Op:
+      {
+	static const unsigned f7s[] = { 0, 0x20, 1 };
+	unsigned f7 = f7s[rand.below(3)], f3 = rand.below(8);
+	if (f7 == 0x20)
+	  f3 = rand.below(2) ? 0 : 5;   // sub/sra
+	return encodeR(0x33, f3, f7, rd, rs1, rs2);
+      }
+
+    case Upper:
+      return (uint32_t(rand.next()) & 0xfffff000) | (rd << 7) |
+	(rand.below(2) ? 0x37 : 0x17);
+
+    case Load:
+      {
+	static const unsigned f3s[] = { 0, 1, 2, 4, 5, 3, 6 };
+	unsigned f3 = f3s[rand.below(rv64_ ? 7 : 5)];
+	return encodeI(0x03, f3, rd, rs1, randomImm12(rand));
+      }
+
+    case Store:
+      return encodeS(0x23, rand.below(rv64_ ? 4 : 3), rs1, rs2,
+		     randomImm12(rand));
+
+    case Branch:
+      {
+	static const unsigned f3s[] = { 0, 1, 4, 5, 6, 7 };
+	return encodeB(f3s[rand.below(6)], rs1, rs2, offset);
+      }
+
+    case Jump:
+      if (rand.below(2))
+	return encodeJ(rd, offset);
+      return encodeI(0x67, 0, rd, rs1, randomImm12(rand));
+
+    case Csr:
+      {
+	unsigned csr = csrs_.at(rand.below(csrs_.size()));
+	unsigned f3 = 1 + rand.below(7);
+	if (f3 == 4)
+	  f3 = 1;
+	// Immediate forms (f3 >= 5) take a 5-bit value in rs1.
+	unsigned src = f3 >= 5 ? rand.below(32) : rs1;
+	return encodeI(0x73, f3, rd, src, csr);
+      }
+
+    case System:
+      {
+	static const uint32_t insts[] = {
+	  0x00000073,  // ecall
+	  0x00100073,  // ebreak
+	  0x30200073,  // mret
+	  0x10200073,  // sret
+	  0x10500073,  // wfi
+	  0x0ff0000f,  // fence
+	  0x0000100f,  // fence.i
+	  0x7b200073,  // dret
+	};
+	return insts[rand.below(sizeof(insts)/sizeof(insts[0]))];
+      }
+
+    case Amo:
+      {
+	static const unsigned f5s[] = { 0x02, 0x03, 0x01, 0x00, 0x04, 0x0c,
+					0x08, 0x10, 0x14, 0x18, 0x1c };
+	unsigned f5 = f5s[rand.below(sizeof(f5s)/sizeof(f5s[0]))];
+	if (f5 == 0x02)
+	  rs2 = 0;   // lr
+	unsigned f3 = rv64_ and rand.below(2) ? 3 : 2;
+	return encodeR(0x2f, f3, (f5 << 2) | rand.below(4), rd, rs1, rs2);
+      }
+
+    case Op32:
+      if (rand.below(2))
+	{
+	  static const unsigned f3s[] = { 0, 1, 5 };
+	  unsigned f3 = f3s[rand.below(3)];
+	  uint32_t imm = randomImm12(rand);
+	  if (f3 != 0)
+	    imm = (imm & 0x1f) | (f3 == 5 ? rand.below(2) << 10 : 0);
+	  return encodeI(0x1b, f3, rd, rs1, imm);
+	}
+      else
+	{
+	  static const unsigned f3s[] = { 0, 1, 5 };
+	  static const unsigned mulF3s[] = { 0, 4, 5, 6, 7 };
+	  unsigned f3 = f3s[rand.below(3)];
+	  unsigned f7 = (f3 != 1 and rand.below(2)) ? 0x20 : rand.below(2);
+	  if (f7 == 1)
+	    f3 = mulF3s[rand.below(5)];   // Multiply/divide word forms.
+	  return encodeR(0x3b, f3, f7, rd, rs1, rs2);
+	}
+
+    case Raw:
+      break;
+    }
+
+  return uint32_t(rand.next());
+}
+
+
+void
+FuzzGenerator::generate(FuzzRandom& rand, unsigned length,
+			std::vector<uint32_t>& words) const
+{
+  words.resize(std::max(length, 1u));
+  for (auto& word : words)
+    word = instruction(rand);
+}
+
+
+void
+FuzzGenerator::mutate(FuzzRandom& rand, const FuzzCorpus& corpus,
+		      unsigned maxLength, std::vector<uint32_t>& words) const
+{
+  maxLength = std::max(maxLength, 1u);
+  if (words.empty())
+    words.push_back(instruction(rand));
+
+  std::vector<uint32_t> other;
+  unsigned count = 1 + rand.below(4);
+  for (unsigned i = 0; i < count; ++i)
+    {
+      size_t ix = rand.next() % words.size();
+      switch (rand.below(6))
+	{
+	case 0:
+	  words[ix] = instruction(rand);
+	  break;
+
+	case 1:
+	  words[ix] ^= uint32_t(1) << rand.below(32);
+	  break;
+
+	case 2:
+	  if (words.size() < maxLength)
+	    words.insert(words.begin() + ix, instruction(rand));
+	  break;
+
+	case 3:
+	  if (words.size() > 1)
+	    words.erase(words.begin() + ix);
+	  break;
+
+	case 4:
+	  std::swap(words[ix], words[rand.next() % words.size()]);
+	  break;
+
+	case 5:
+	  // Keep the head of this stream and the tail of another seed.
+	  if (corpus.pick(rand, other))
+	    {
+	      size_t from = rand.next() % other.size();
+	      words.resize(ix);
+	      words.insert(words.end(), other.begin() + from, other.end());
+	      if (words.empty())
+		words.push_back(instruction(rand));
+	      if (words.size() > maxLength)
+		words.resize(maxLength);
+	    }
+	  break;
+	}
+    }
+}
@@ -0,0 +1,209 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "WhisperPlugin.h"
+
+
+namespace WdRiscv
+{
+
+  /// Pseudo-random number generator of a fuzzing worker (xorshift64*):
+  /// cheap and reproducible from its seed.
+  class FuzzRandom
+  {
+  public:
+
+    FuzzRandom(uint64_t seed)
+      : state_(seed * 0x9e3779b97f4a7c15 + 1)
+    { }
+
+    /// Return the next 64-bit random number.
+    uint64_t next()
+    {
+      state_ ^= state_ >> 12;  state_ ^= state_ << 25;  state_ ^= state_ >> 27;
+      return state_ * 0x2545f4914f6cdd1d;
+    }
+
+    /// Return a random number in [0, n). N must not be zero.
+    unsigned below(unsigned n)
+    { return unsigned((next() >> 32) % n); }
+
+  private:
+
+    uint64_t state_;
+  };
+
+
+  /// Coverage of one fuzzing execution as a list of features (32-bit
+  /// hashes): trap causes and pairs of consecutive trap causes, bits
+  /// written in each CSR by CSR instructions, hit debug triggers and
+  /// the order of magnitude of the trap count. Traps and CSR writes
+  /// are observed through plugin hooks (see hooks and
+  /// PluginSet::add).
+  class FuzzFeedback
+  {
+  public:
+
+    FuzzFeedback();
+
+    FuzzFeedback(const FuzzFeedback&) = delete;
+    FuzzFeedback& operator=(const FuzzFeedback&) = delete;
+
+    /// Return the plugin hooks feeding this object.
+    const WhisperPluginHooks& hooks() const
+    { return hooks_; }
+
+    /// Forget the features of the previous execution.
+    void clear()
+    {
+      features_.clear();
+      prevTrap_ = 0;
+      trapCount_ = 0;
+    }
+
+    /// Record a trap.
+    void trap(uint64_t cause, bool interrupt);
+
+    /// Record the write of the given value into the given CSR.
+    void csrWrite(unsigned csr, uint64_t value);
+
+    /// Record the hit of the given debug trigger.
+    void triggerHit(unsigned trigger);
+
+    /// Add the features summarizing the execution. Called once at the
+    /// end of an execution.
+    void finish();
+
+    /// Return the features of the current execution (may repeat).
+    const std::vector<uint32_t>& features() const
+    { return features_; }
+
+  private:
+
+    void add(uint64_t kind, uint64_t a, uint64_t b = 0);
+
+    WhisperPluginHooks hooks_ = {};
+    std::vector<uint32_t> features_;
+    uint64_t prevTrap_ = 0;    // Previous trap (cause, interrupt) plus 1.
+    uint64_t trapCount_ = 0;
+  };
+
+
+  /// Corpus of a fuzzing run shared by its worker threads: the map
+  /// of the features seen so far and the seeds (instruction streams)
+  /// that brought new features. Seeds are kept in a directory: one
+  /// file of little-endian 32-bit instruction words per seed. The
+  /// feature map is updated without locks.
+  class FuzzCorpus
+  {
+  public:
+
+    /// Log2 of the size of the feature map.
+    static constexpr unsigned mapBits = 22;
+
+    /// Constructor: Keep the seeds in the given directory.
+    FuzzCorpus(const std::string& dir);
+
+    /// Load the seeds of the directory (creating it if it does not
+    /// exist) truncating them to maxLength words. Return true on
+    /// success and false (printing a message) on failure.
+    bool load(unsigned maxLength);
+
+    /// Return the number of seeds found by load.
+    size_t loadedCount() const
+    { return loaded_; }
+
+    /// Set words to the ith seed. Return false if i is out of bounds.
+    bool seed(size_t i, std::vector<uint32_t>& words) const;
+
+    /// Set words to a random seed. Return false if there is no seed.
+    bool pick(FuzzRandom& rand, std::vector<uint32_t>& words) const;
+
+    /// Add the given features to the map. Return the number of
+    /// features that were not in it.
+    unsigned merge(const std::vector<uint32_t>& features);
+
+    /// Add the given seed and write it to the directory.
+    void add(const std::vector<uint32_t>& words);
+
+    /// Return the number of seeds.
+    size_t size() const;
+
+    /// Return the number of distinct features seen.
+    uint64_t featureCount() const
+    { return featureCount_; }
+
+  private:
+
+    std::string dir_;
+    std::unique_ptr<std::atomic<uint8_t>[]> map_;
+    std::atomic<uint64_t> featureCount_;
+    mutable std::mutex mutex_;
+    std::vector<std::vector<uint32_t>> seeds_;
+    size_t loaded_ = 0;
+    bool saveFailed_ = false;
+  };
+
+
+  /// Generator and mutator of random instruction streams: valid
+  /// encodings of the base integer instructions with short branch
+  /// and jump offsets, CSR instructions on the implemented CSRs,
+  /// system instructions, atomics and, rarely, random words. Register
+  /// operands favor x1 to x7 so that instructions consume each other's
+  /// results.
+  class FuzzGenerator
+  {
+  public:
+
+    /// Constructor: Generate RV64 instructions if rv64 is true, atomic
+    /// instructions if atomics is true and CSR instructions accessing
+    /// the given CSR numbers.
+    FuzzGenerator(bool rv64, bool atomics, const std::vector<unsigned>& csrs);
+
+    /// Return a random instruction.
+    uint32_t instruction(FuzzRandom& rand) const;
+
+    /// Set words to length random instructions.
+    void generate(FuzzRandom& rand, unsigned length,
+		  std::vector<uint32_t>& words) const;
+
+    /// Apply a few random mutations (replace, flip a bit, insert,
+    /// delete, swap, splice with a seed of the given corpus) to the
+    /// given instruction stream keeping it between 1 and maxLength
+    /// words.
+    void mutate(FuzzRandom& rand, const FuzzCorpus& corpus,
+		unsigned maxLength, std::vector<uint32_t>& words) const;
+
+  private:
+
+    enum Class { OpImm, Op, Upper, Load, Store, Branch, Jump, Csr, System,
+		 Amo, Op32, Raw };
+
+    std::vector<Class> classes_;   // Each class repeated by its weight.
+    std::vector<unsigned> csrs_;
+    bool rv64_ = false;
+  };
+}
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include "InstId.hpp"
@@ -18,40 +18,192 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
 #include "InstId.hpp"
 
 
 namespace WdRiscv
 {
 
-  struct InstProfile
+  /// Instruction frequency profile of a hart (see
+  /// Core::enableInstructionFrequency). The data of all the
+  /// instructions is kept in flat arrays indexed by instruction id
+  /// (struct of arrays) so that profiling an instruction touches a
+  /// few adjacent counters and no per-instruction vector.
+  class InstProfile
   {
-    InstId id_ = InstId::illegal;
-    uint64_t freq_ = 0;  // Number of times instruction was executed
+  public:
 
-    // One entry per integer register: Count of times register was used
-    // by instruction as rd.
-    std::vector<uint64_t> rd_;
+    /// Count: Collect only the execution count of each instruction.
+    /// Operands: Also collect register use and operand value
+    /// histograms.
+    enum class Mode { Count, Operands };
 
-    // One entry per integer register: Count of times register was
-    // used by instruction as rs1.
-    std::vector<uint64_t> rs1_;
+    /// Register operands with a per-register use count.
+    enum RegOperand { Rd, Rs1, Rs2, RegOperandCount };
 
-    // One entry per integer register: Count of times register was
-    // used by instruction as rs2.
-    std::vector<uint64_t> rs2_;
+    /// Operands with a value histogram.
+    enum HistoOperand { Rs1Histo, Rs2Histo, ImmHisto, HistoOperandCount };
 
-    std::vector<uint64_t> rs1Histo_;  // rs1 value histogram.
-    std::vector<uint64_t> rs2Histo_;  // rs2 value histogram.
-    std::vector<uint64_t> immHisto_;  // Immediate value histogram.
+    /// Histogram bin count (see Core::reportInstructionFrequency for
+    /// the bins).
+    static constexpr unsigned histoSize = 13;
 
-    bool hasImm_ = false;
-    int32_t minImm_ = 0;  // Minimum immediate operand value.
-    int32_t maxImm_ = 0;  // Maximum immediate operand value.
-  };
-}
+    /// Allocate and clear the profile of a hart with the given integer
+    /// register count. In operands mode, profile one of every
+    /// samplePeriod instructions (all of them if samplePeriod is 0 or
+    /// 1).
+    void configure(Mode mode, unsigned regCount, uint64_t samplePeriod)
+    {
+      size_t idCount = size_t(InstId::maxId) + 1;
+      mode_ = mode;
+      regCount_ = regCount;
+      period_ = std::max(samplePeriod, uint64_t(1));
+      countdown_ = period_;
+
+      freq_.assign(idCount, 0);
+      regUse_.clear();
+      histos_.clear();
+      imm_.clear();
+      if (mode == Mode::Operands)
+	{
+	  regUse_.assign(idCount * RegOperandCount * regCount, 0);
+	  histos_.assign(idCount * HistoOperandCount * histoSize, 0);
+	  imm_.assign(idCount, ImmRange());
+	}
+    }
+
+    /// Return true if only execution counts are collected.
+    bool countOnly() const
+    { return mode_ == Mode::Count; }
+
+    /// Return the sampling period: count values must be multiplied by
+    /// it to estimate the full counts.
+    uint64_t samplePeriod() const
+    { return period_; }
+
+    /// Return true if the operands of the current instruction should
+    /// be profiled (one in every samplePeriod instructions on
+    /// average). The distance between samples varies pseudo-randomly
+    /// around the period so that sampling does not lock onto a loop
+    /// whose length divides the period.
+    bool sample()
+    {
+      if (--countdown_)
+	return false;
+      if (period_ > 1)
+	{
+	  rand_ ^= rand_ << 13;  rand_ ^= rand_ >> 7;  rand_ ^= rand_ << 17;
+	  countdown_ = period_ / 2 + 1 + rand_ % period_;
+	}
+      else
+	countdown_ = 1;
+      return true;
+    }
+
+    /// Return the number of instruction ids.
+    size_t idCount() const
+    { return freq_.size(); }
+
+    /// Count one execution of the given instruction.
+    void count(InstId id)
+    { freq_[size_t(id)]++; }
+
+    /// Return the execution count of the given instruction.
+    uint64_t freq(InstId id) const
+    { return freq_.at(size_t(id)); }
+
+    /// Return the per-register use counts (one per integer register)
+    /// of the given operand of the given instruction (operands mode
+    /// only).
+    uint64_t* regUse(InstId id, RegOperand op)
+    { return &regUse_[(size_t(id) * RegOperandCount + op) * regCount_]; }
+
+    const uint64_t* regUse(InstId id, RegOperand op) const
+    { return &regUse_.at((size_t(id) * RegOperandCount + op) * regCount_); }
 
+    /// Return the histogram (histoSize bins) of the values of the
+    /// given operand of the given instruction (operands mode only).
+    uint64_t* histo(InstId id, HistoOperand op)
+    { return &histos_[(size_t(id) * HistoOperandCount + op) * histoSize]; }
 
-    
+    const uint64_t* histo(InstId id, HistoOperand op) const
+    { return &histos_.at((size_t(id) * HistoOperandCount + op) * histoSize); }
+
+    /// Record an immediate operand value of the given instruction
+    /// (operands mode only).
+    void addImm(InstId id, int32_t imm)
+    {
+      ImmRange& range = imm_[size_t(id)];
+      if (not range.valid)
+	range = ImmRange{ true, imm, imm };
+      else
+	{
+	  range.min = std::min(range.min, imm);
+	  range.max = std::max(range.max, imm);
+	}
+    }
+
+    /// Set min/max to the smallest/largest immediate operand value of
+    /// the given instruction. Return false if no immediate value was
+    /// recorded for it.
+    bool immRange(InstId id, int32_t& min, int32_t& max) const
+    {
+      if (imm_.empty() or not imm_.at(size_t(id)).valid)
+	return false;
+      min = imm_.at(size_t(id)).min;
+      max = imm_.at(size_t(id)).max;
+      return true;
+    }
+
+    /// Return the integer register count.
+    unsigned regCount() const
+    { return regCount_; }
+
+    /// Add the counts of the given profile to those of this one. Both
+    /// must have been configured with the same mode and register
+    /// count.
+    void merge(const InstProfile& other)
+    {
+      auto add = [] (std::vector<uint64_t>& a, const std::vector<uint64_t>& b) {
+	for (size_t i = 0; i < a.size() and i < b.size(); ++i)
+	  a[i] += b[i];
+      };
+      add(freq_, other.freq_);
+      add(regUse_, other.regUse_);
+      add(histos_, other.histos_);
+
+      for (size_t i = 0; i < imm_.size() and i < other.imm_.size(); ++i)
+	{
+	  const ImmRange& range = other.imm_[i];
+	  if (range.valid)
+	    {
+	      addImm(InstId(i), range.min);
+	      addImm(InstId(i), range.max);
+	    }
+	}
+    }
+
+  private:
+
+    struct ImmRange
+    {
+      bool valid = false;
+      int32_t min = 0;
+      int32_t max = 0;
+    };
+
+    Mode mode_ = Mode::Operands;
+    unsigned regCount_ = 0;
+    uint64_t period_ = 1;
+    uint64_t countdown_ = 1;
+    uint64_t rand_ = 0x9e3779b97f4a7c15;  // Xorshift state (see sample).
+
+    std::vector<uint64_t> freq_;     // Indexed by id.
+    std::vector<uint64_t> regUse_;   // Indexed by id, operand, register.
+    std::vector<uint64_t> histos_;   // Indexed by id, operand, bin.
+    std::vector<ImmRange> imm_;      // Indexed by id.
+  };
+}
@@ -23,9 +23,12 @@ using namespace WdRiscv;
 
 
 template <typename URV>
-IntRegs<URV>::IntRegs(unsigned regCount)
-  : regs_(regCount, 0)
+IntRegs<URV>::IntRegs(URV* regs, unsigned regCount)
+  : regs_(regs), count_(regCount)
 {
+  for (unsigned ix = 0; ix < regCount; ++ix)
+    regs_[ix] = 0;
+
   numberToName_.resize(32);
 
   for (unsigned ix = 0; ix < 32; ++ix)
@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <type_traits>
@@ -102,6 +103,8 @@ namespace WdRiscv
   template <typename URV>
   class Core;
 
+  class Jit;
+
   /// Model a RISCV integer register file.
   /// URV (unsigned register value) is the register value type. For
   /// 32-bit registers, URV should be uint32_t. For 64-bit integers,
@@ -112,16 +115,14 @@ namespace WdRiscv
   public:
 
     friend class Core<URV>;
+    friend class Jit;
 
     /// Constructor: Define a register file with the given number of
-    /// registers. Each register is of type URV. All registers initialized
-    /// to zero.
-    IntRegs(unsigned registerCount);
-
-
-    /// Destructor.
-    ~IntRegs()
-    { regs_.clear(); }
+    /// registers. Each register is of type URV. The register values
+    /// are kept in the given array (at least registerCount entries,
+    /// part of the architectural state block of the hart) which must
+    /// outlive this object. All registers initialized to zero.
+    IntRegs(URV* regs, unsigned registerCount);
     
     /// Return value of ith register. Register zero always yields zero.
     URV read(unsigned i) const
@@ -141,12 +142,12 @@ namespace WdRiscv
     void poke(unsigned i, URV value)
     {
       if (i != 0)
-	regs_.at(i) = value;
+	regs_[i] = value;
     }
 
     /// Return the count of registers in this register file.
     size_t size() const
-    { return regs_.size(); }
+    { return count_; }
 
     /// Set ix to the number of the register corresponding to the
     /// given name returning true on success and false if no such
@@ -206,8 +207,8 @@ namespace WdRiscv
     void reset()
     {
       clearLastWrittenReg();
-      for (auto& reg : regs_)
-	reg = 0;
+      for (unsigned i = 0; i < count_; ++i)
+	regs_[i] = 0;
     }
 
     /// Clear the number denoting the last written register.
@@ -234,7 +235,8 @@ namespace WdRiscv
 
   private:
 
-    std::vector<URV> regs_;
+    URV* regs_ = nullptr;      // See constructor.
+    unsigned count_ = 0;
     int lastWrittenReg_ = -1;  // Register accessed in most recent write.
     URV originalValue_ = 0;    // Original value of last written reg.
     std::unordered_map<std::string, IntRegNumber> nameToNumber_;
@@ -0,0 +1,350 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <cassert>
+#include <sys/mman.h>
+#include "Jit.hpp"
+
+
+using namespace WdRiscv;
+
+
+// Generated code conventions: r12 holds the core pointer, rbx holds
+// the address of the integer register array, eax/ecx are scratch and
+// eax holds the returned status.
+
+
+Jit::Jit(size_t bufferSize)
+{
+#if defined(__x86_64__)
+  void* p = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p != MAP_FAILED)
+    {
+      buffer_ = static_cast<uint8_t*>(p);
+      size_ = bufferSize;
+    }
+#endif
+}
+
+
+Jit::~Jit()
+{
+  if (buffer_)
+    munmap(buffer_, size_);
+  buffer_ = nullptr;
+}
+
+
+void
+Jit::emitRegOp(unsigned opcode, unsigned reg, unsigned ix)
+{
+  emit8(opcode);
+  emit8(0x80 | (reg << 3) | 3);  // [rbx + disp32]
+  emit32(4*ix);
+}
+
+
+void
+Jit::emitCoreOp(std::initializer_list<unsigned> opcode, unsigned reg,
+		int32_t offset)
+{
+  for (auto byte : opcode)
+    emit8(byte);
+  emit8(0x80 | (reg << 3) | 4);  // [r12 + disp32] using a SIB byte.
+  emit8(0x24);
+  emit32(offset);
+}
+
+
+void
+Jit::emitWriteReg(unsigned rd)
+{
+  emitRegOp(0x8b, 1, rd);                  // mov ecx, [rd]
+  emitCoreOp({0x41, 0x89}, 1, origValueOff_);  // mov originalValue_, ecx
+  if (rd != 0)
+    emitRegOp(0x89, 0, rd);                // mov [rd], eax
+  emitCoreOp({0x41, 0xc7}, 0, lastRegOff_);    // mov lastWrittenReg_, rd
+  emit32(rd);
+}
+
+
+void
+Jit::emitFlush(uint32_t pc)
+{
+  if (pending_)
+    {
+      emitCoreOp({0x49, 0x81}, 0, cycleOff_);    // add cycleCount_, pending
+      emit32(pending_);
+      emitCoreOp({0x49, 0x81}, 0, retiredOff_);  // add retiredInsts_, pending
+      emit32(pending_);
+      emitCoreOp({0x41, 0xc7}, 0, currPcOff_);   // mov currPc_, lastPc
+      emit32(lastPc_);
+      emitCoreOp({0x41, 0xc6}, 0, ldStOff_);     // mov ldStException_, 0
+      emit8(0);
+    }
+  emitCoreOp({0x41, 0xc7}, 0, pcOff_);           // mov pc_, pc
+  emit32(pc);
+}
+
+
+void
+Jit::emitJumpToEpilogue(unsigned opcode2)
+{
+  if (opcode2)
+    {
+      emit8(0x0f);  // jcc rel32
+      emit8(opcode2);
+    }
+  else
+    emit8(0xe9);  // jmp rel32
+  epilogueFix_.push_back(code_.size());
+  emit32(0);
+}
+
+
+void
+Jit::emitModifiedCheck(const Core<uint32_t>::DecodedInst& di,
+		       const uint8_t* memData)
+{
+  emit8(0x48);  // movabs rax, address of instruction
+  emit8(0xb8);
+  emit64(reinterpret_cast<uint64_t>(memData + di.pc_));
+
+  if (di.size_ == 4)
+    {
+      emit8(0x81); emit8(0x38); emit32(di.inst_);  // cmp dword [rax], inst
+    }
+  else
+    {
+      emit8(0x66); emit8(0x81); emit8(0x38);      // cmp word [rax], inst
+      emit8(di.inst_); emit8(di.inst_ >> 8);
+    }
+
+  emit8(0x74);  // je rel8 (over the exit stub)
+  size_t fix = code_.size();
+  emit8(0);
+
+  emitFlush(di.pc_);
+  emit8(0xb8);  // mov eax, Modified
+  emit32(Modified);
+  emitJumpToEpilogue(0);
+
+  code_.at(fix) = uint8_t(code_.size() - fix - 1);
+}
+
+
+void
+Jit::emitCallout(const Core<uint32_t>::DecodedInst& di)
+{
+  emitFlush(di.pc_);
+  pending_ = 0;
+
+  emit8(0x4c); emit8(0x89); emit8(0xe7);  // mov rdi, r12
+  emit8(0x48); emit8(0xbe);               // movabs rsi, di
+  emit64(reinterpret_cast<uint64_t>(&di));
+  emit8(0x48); emit8(0xb8);               // movabs rax, jitStep
+  emit64(reinterpret_cast<uint64_t>(&Core<uint32_t>::jitStep));
+  emit8(0xff); emit8(0xd0);               // call rax
+  emit8(0x85); emit8(0xc0);               // test eax, eax
+  emitJumpToEpilogue(0x85);               // jnz epilogue
+}
+
+
+void
+Jit::emitInline(const Core<uint32_t>::DecodedInst& di, InstId id)
+{
+  unsigned rd = di.op0_, rs1 = di.op1_, rs2 = di.op2_;
+  uint32_t imm = di.op2_;
+
+  auto setCond = [this] (unsigned cc) {
+    emit8(0x0f); emit8(cc); emit8(0xc0);    // setcc al
+    emit8(0x0f); emit8(0xb6); emit8(0xc0);  // movzx eax, al
+  };
+
+  switch (id)
+    {
+    case InstId::lui:
+      emit8(0xb8); emit32(di.op1_);          // mov eax, imm
+      break;
+
+    case InstId::auipc:
+      emit8(0xb8); emit32(di.pc_ + di.op1_); // mov eax, pc + imm
+      break;
+
+    case InstId::addi:
+    case InstId::xori:
+    case InstId::ori:
+    case InstId::andi:
+      {
+	unsigned op = 0x05;  // add eax, imm32
+	if (id == InstId::xori) op = 0x35;
+	if (id == InstId::ori)  op = 0x0d;
+	if (id == InstId::andi) op = 0x25;
+	emitRegOp(0x8b, 0, rs1);             // mov eax, [rs1]
+	emit8(op); emit32(imm);
+      }
+      break;
+
+    case InstId::slti:
+    case InstId::sltiu:
+      emitRegOp(0x8b, 0, rs1);               // mov eax, [rs1]
+      emit8(0x3d); emit32(imm);              // cmp eax, imm32
+      setCond(id == InstId::slti ? 0x9c : 0x92);  // setl/setb
+      break;
+
+    case InstId::slli:
+    case InstId::srli:
+    case InstId::srai:
+      {
+	unsigned modrm = 0xe0;  // shl
+	if (id == InstId::srli) modrm = 0xe8;
+	if (id == InstId::srai) modrm = 0xf8;
+	emitRegOp(0x8b, 0, rs1);             // mov eax, [rs1]
+	emit8(0xc1); emit8(modrm); emit8(imm);
+      }
+      break;
+
+    case InstId::add:
+    case InstId::sub:
+    case InstId::xor_:
+    case InstId::or_:
+    case InstId::and_:
+      {
+	unsigned op = 0x01;  // add eax, ecx
+	if (id == InstId::sub)  op = 0x29;
+	if (id == InstId::xor_) op = 0x31;
+	if (id == InstId::or_)  op = 0x09;
+	if (id == InstId::and_) op = 0x21;
+	emitRegOp(0x8b, 0, rs1);             // mov eax, [rs1]
+	emitRegOp(0x8b, 1, rs2);             // mov ecx, [rs2]
+	emit8(op); emit8(0xc8);
+      }
+      break;
+
+    case InstId::sll:
+    case InstId::srl:
+    case InstId::sra:
+      {
+	// The x86 shift count is masked to 5 bits like the rv32 one.
+	unsigned modrm = 0xe0;  // shl eax, cl
+	if (id == InstId::srl) modrm = 0xe8;
+	if (id == InstId::sra) modrm = 0xf8;
+	emitRegOp(0x8b, 0, rs1);             // mov eax, [rs1]
+	emitRegOp(0x8b, 1, rs2);             // mov ecx, [rs2]
+	emit8(0xd3); emit8(modrm);
+      }
+      break;
+
+    case InstId::slt:
+    case InstId::sltu:
+      emitRegOp(0x8b, 0, rs1);               // mov eax, [rs1]
+      emitRegOp(0x8b, 1, rs2);               // mov ecx, [rs2]
+      emit8(0x39); emit8(0xc8);              // cmp eax, ecx
+      setCond(id == InstId::slt ? 0x9c : 0x92);  // setl/setb
+      break;
+
+    default:
+      assert(0 && "Jit: instruction cannot be inlined");
+      break;
+    }
+
+  emitWriteReg(rd);
+
+  pending_++;
+  lastPc_ = di.pc_;
+}
+
+
+Jit::BlockFn
+Jit::compile(Core<uint32_t>& core, const Core<uint32_t>::DecodedBlock& block)
+{
+  if (not buffer_ or block.insts_.empty())
+    return nullptr;
+
+  code_.clear();
+  epilogueFix_.clear();
+  pending_ = 0;
+  lastPc_ = 0;
+
+  auto offset = [&core] (const void* field) {
+    const char* base = reinterpret_cast<const char*>(&core);
+    return int32_t(reinterpret_cast<const char*>(field) - base);
+  };
+
+  cycleOff_ = offset(&core.arch_.cycleCount);
+  retiredOff_ = offset(&core.arch_.retiredInsts);
+  pcOff_ = offset(&core.arch_.pc);
+  currPcOff_ = offset(&core.arch_.currPc);
+  ldStOff_ = offset(&core.ldStException_);
+  origValueOff_ = offset(&core.intRegs_.originalValue_);
+  lastRegOff_ = offset(&core.intRegs_.lastWrittenReg_);
+
+  // Prologue: push rbx; push r12; push r13 (keeps stack 16-byte
+  // aligned for callouts); mov r12, rdi; movabs rbx, registers.
+  for (unsigned byte : { 0x53, 0x41, 0x54, 0x41, 0x55, 0x49, 0x89, 0xfc,
+	0x48, 0xbb })
+    emit8(byte);
+  emit64(reinterpret_cast<uint64_t>(core.intRegs_.regs_));
+
+  const uint8_t* memData = core.memory_.data_;
+  bool lastInline = false;
+  for (const auto& di : block.insts_)
+    {
+      InstId id = core.jitInlineId(di);
+      lastInline = id != InstId::illegal;
+      if (lastInline)
+	{
+	  emitModifiedCheck(di, memData);
+	  emitInline(di, id);
+	}
+      else
+	emitCallout(di);
+    }
+
+  if (lastInline)
+    {
+      const auto& last = block.insts_.back();
+      emitFlush(last.pc_ + last.size_);
+      pending_ = 0;
+    }
+
+  emit8(0x31); emit8(0xc0);  // xor eax, eax (Continue)
+
+  // Epilogue: pop r13; pop r12; pop rbx; ret.
+  size_t epilogue = code_.size();
+  for (unsigned byte : { 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3 })
+    emit8(byte);
+
+  for (auto fix : epilogueFix_)
+    {
+      int32_t rel = int32_t(epilogue - (fix + 4));
+      memcpy(&code_.at(fix), &rel, sizeof(rel));
+    }
+
+  size_t aligned = (code_.size() + 15) & ~size_t(15);
+  if (used_ + aligned > size_)
+    return nullptr;
+
+  uint8_t* entry = buffer_ + used_;
+  memcpy(entry, code_.data(), code_.size());
+  used_ += aligned;
+
+  return reinterpret_cast<BlockFn>(entry);
+}
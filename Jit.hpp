@@ -0,0 +1,126 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <initializer_list>
+#include "Core.hpp"
+
+
+namespace WdRiscv
+{
+
+  /// Translate hot basic blocks of a 32-bit hart into x86-64 host
+  /// code. Integer register-register and register-immediate
+  /// instructions are translated inline. All other instructions
+  /// (loads, stores, branches, jumps, ...) are executed by calling
+  /// back into the core. The generated code updates the state of the
+  /// core exactly as the block interpreter (Core::executeBlock) does.
+  /// This is used by Core::simpleRun when the simulator is compiled
+  /// with WHISPER_JIT defined (make JIT=1).
+  class Jit
+  {
+  public:
+
+    /// Value returned by compiled code.
+    enum Status { Continue = 0, Modified = 1, Exception = 2, Leave = 3 };
+
+    /// Compiled block: Return a Status value.
+    typedef int (*BlockFn)(Core<uint32_t>* core);
+
+    /// Constructor: Reserve a code buffer of the given size in bytes.
+    Jit(size_t bufferSize = 32*1024*1024);
+
+    /// Destructor.
+    ~Jit();
+
+    /// Return true if the host supports this translator and the code
+    /// buffer was successfully reserved.
+    bool isValid() const
+    { return buffer_ != nullptr; }
+
+    /// Translate the given block of the given core. Return the entry
+    /// of the generated code or nullptr if the code buffer is full
+    /// (see reset). The decoded instructions of the block are
+    /// referenced by the generated code: they must not move while the
+    /// code is in use.
+    BlockFn compile(Core<uint32_t>& core,
+		    const Core<uint32_t>::DecodedBlock& block);
+
+    /// Discard all generated code.
+    void reset()
+    { used_ = 0; }
+
+  private:
+
+    void emit8(unsigned x)
+    { code_.push_back(uint8_t(x)); }
+
+    void emit32(uint32_t x)
+    { for (unsigned i = 0; i < 4; ++i) emit8(x >> (i*8)); }
+
+    void emit64(uint64_t x)
+    { for (unsigned i = 0; i < 8; ++i) emit8(x >> (i*8)); }
+
+    /// Emit: op reg, [rbx + 4*ix]. Reg is 0 for eax and 1 for ecx.
+    void emitRegOp(unsigned opcode, unsigned reg, unsigned ix);
+
+    /// Emit: op [r12 + offset] with given opcode bytes and modrm reg
+    /// field.
+    void emitCoreOp(std::initializer_list<unsigned> opcode, unsigned reg,
+		    int32_t offset);
+
+    /// Emit code for an inline instruction with the given id.
+    void emitInline(const Core<uint32_t>::DecodedInst& di, InstId id);
+
+    /// Emit code executing the given instruction by calling back into
+    /// the core.
+    void emitCallout(const Core<uint32_t>::DecodedInst& di);
+
+    /// Emit code leaving the block with the given status if the
+    /// given instruction is no longer in memory.
+    void emitModifiedCheck(const Core<uint32_t>::DecodedInst& di,
+			   const uint8_t* memData);
+
+    /// Emit code writing eax into integer register rd the way
+    /// IntRegs::write does.
+    void emitWriteReg(unsigned rd);
+
+    /// Emit code bringing the counters/pc of the core up to date for
+    /// the pending inline instructions.
+    void emitFlush(uint32_t pc);
+
+    /// Emit a jump to the epilogue (patched at the end of compile).
+    void emitJumpToEpilogue(unsigned opcode2);
+
+    uint8_t* buffer_ = nullptr;  // Executable code buffer.
+    size_t size_ = 0;            // Size of buffer.
+    size_t used_ = 0;            // Used bytes of buffer.
+
+    std::vector<uint8_t> code_;        // Code of block being compiled.
+    std::vector<size_t> epilogueFix_;  // Offsets of jumps to epilogue.
+    unsigned pending_ = 0;       // Inline instructions not yet counted.
+    uint32_t lastPc_ = 0;        // Address of last pending instruction.
+
+    // Offsets of core fields relative to core.
+    int32_t cycleOff_ = 0, retiredOff_ = 0, pcOff_ = 0, currPcOff_ = 0;
+    int32_t ldStOff_ = 0, origValueOff_ = 0, lastRegOff_ = 0;
+  };
+}
@@ -20,11 +20,18 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <algorithm>
 #include <math.h>
 #include <stdlib.h>
 #include <sys/mman.h>
-#include <elfio/elfio.hpp>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
 #include "Memory.hpp"
+#include "Numa.hpp"
+#include "ElfFile.hpp"
 
 using namespace WdRiscv;
 
@@ -114,17 +121,67 @@ Memory::Memory(size_t size, size_t regionSize)
   // Mark all regions as non-configured.
   regionConfigured_.resize(regionCount_);
 
-  attribs_.resize(pageCount_);
-
   // Make whole memory as mapped, writable, allowing data and inst.
   // Some of the pages will be later reconfigured when the user
   // supplied configuration file is processed.
-  for (size_t i = 0; i < pageCount_; ++i)
+  PageAttribs attrib;
+  attrib.setAll(true);
+  attrib.setIccm(false);
+  attrib.setDccm(false);
+  attrib.setMemMappedReg(false);
+  regionBits_.assign(regionCount_, attrib.bits());
+  regionPageShift_ = unsigned(std::log2(regionSize_ / pageSize_));
+
+  // All pages start with the attributes of their region (zero XOR).
+  mem = mmap(nullptr, pageCount_ * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == (void*) -1)
+    {
+      std::cerr << "Failed to map page attributes using mmap.\n";
+      munmap(data_, size_);
+      throw std::runtime_error("Out of memory");
+    }
+  pageBits_ = reinterpret_cast<uint32_t*>(mem);
+}
+
+
+template <typename F>
+void
+Memory::updatePageAttribs(size_t pageIx, F func)
+{
+  uint32_t regionBits = regionBits_.at(pageIx >> regionPageShift_);
+  PageAttribs attrib = PageAttribs::fromBits(pageBits_[pageIx] ^ regionBits);
+  func(attrib);
+  pageBits_[pageIx] = attrib.bits() ^ regionBits;
+  ownPages_.insert(pageIx);
+}
+
+
+template <typename F>
+void
+Memory::updateRegionAttribs(size_t region, F func)
+{
+  size_t begin = region << regionPageShift_;
+  size_t end = std::min(begin + (size_t(1) << regionPageShift_), pageCount_);
+  auto first = ownPages_.lower_bound(begin);
+  auto last = ownPages_.lower_bound(end);
+
+  uint32_t& regionBits = regionBits_.at(region);
+  uint32_t oldBits = regionBits;
+  if (size_t(std::distance(first, last)) < end - begin)
     {
-      attribs_.at(i).setAll(true);
-      attribs_.at(i).setIccm(false);
-      attribs_.at(i).setDccm(false);
-      attribs_.at(i).setMemMappedReg(false);
+      // Some pages use the default attributes of the region.
+      PageAttribs attrib = PageAttribs::fromBits(regionBits);
+      func(attrib);
+      regionBits = attrib.bits();
+    }
+
+  for (auto iter = first; iter != last; ++iter)
+    {
+      size_t ix = *iter;
+      PageAttribs attrib = PageAttribs::fromBits(pageBits_[ix] ^ oldBits);
+      func(attrib);
+      pageBits_[ix] = attrib.bits() ^ regionBits;
     }
 }
 
@@ -136,95 +193,388 @@ Memory::~Memory()
       munmap(data_, size_);
       data_ = nullptr;
     }
+  if (pageBits_)
+    {
+      munmap(pageBits_, pageCount_ * sizeof(uint32_t));
+      pageBits_ = nullptr;
+    }
 }
 
 
 bool
-Memory::loadHexFile(const std::string& fileName)
+Memory::enableHugePages(bool explicitPages)
 {
-  std::ifstream input(fileName);
+  if (not explicitPages)
+    {
+      if (madvise(data_, size_, MADV_HUGEPAGE) != 0)
+	{
+	  std::cerr << "Failed to enable transparent huge pages: "
+		    << strerror(errno) << '\n';
+	  return false;
+	}
+      return true;
+    }
 
-  if (not input.good())
+  // Default huge page size of the host.
+  size_t hugePageSize = 0;
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while (hugePageSize == 0 and std::getline(meminfo, line))
+    if (line.compare(0, 13, "Hugepagesize:") == 0)
+      hugePageSize = size_t(strtoull(line.c_str() + 13, nullptr, 10)) * 1024;
+  if (hugePageSize == 0 or size_ % hugePageSize != 0)
     {
-      std::cerr << "Failed to open hex-file '" << fileName << "' for input\n";
+      std::cerr << "Memory size (0x" << std::hex << size_ << std::dec
+		<< ") is not a multiple of the host huge page size\n";
       return false;
     }
 
-  size_t address = 0, errors = 0, overwrites = 0;
+  // Map the huge pages before dropping the regular ones so that a
+  // failure leaves this memory usable.
+  void* mem = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem == (void*) -1)
+    {
+      std::cerr << "Failed to map " << size_ << " bytes of huge pages: "
+		<< strerror(errno) << " (check /proc/sys/vm/nr_hugepages "
+		<< "or reduce the memory size)\n";
+      return false;
+    }
+
+  munmap(data_, size_);
+  data_ = reinterpret_cast<uint8_t*>(mem);
+  return true;
+}
 
-  std::string line;
 
-  for (unsigned lineNum = 0; std::getline(input, line); ++lineNum)
+bool
+Memory::bindToNumaNodes(const std::vector<unsigned>& nodes)
+{
+  if (nodes.empty())
+    return true;
+  if (not bindMemoryToNumaNodes(data_, size_, nodes))
+    return false;
+  if (nodes.size() == 1)
+    return true;
+
+  // Closely coupled memories: First node. Contiguous pages are bound
+  // with one call.
+  size_t hostPageSize = sysconf(_SC_PAGESIZE);
+  if (pageSize_ % hostPageSize != 0)
+    return true;
+  std::vector<unsigned> first(1, nodes.front());
+  auto local = [this] (size_t ix) {
+    PageAttribs attrib = getAttrib(ix * pageSize_);
+    return attrib.isIccm() or attrib.isDccm(); };
+
+  // Only pages with attributes of their own can be in a CCM.
+  for (auto iter = ownPages_.begin(); iter != ownPages_.end(); )
     {
-      if (line.empty())
+      size_t i = *iter++;
+      if (not local(i))
 	continue;
-
-      if (line[0] == '@')
+      size_t j = i + 1;
+      while (iter != ownPages_.end() and *iter == j and local(j))
 	{
-	  if (line.size() == 1)
-	    {
-	      std::cerr << "File " << fileName << ", Line " << lineNum << ": "
-			<< "Invalid hexadecimal address: " << line << '\n';
-	      errors++;
-	      continue;
-	    }
-	  char* end = nullptr;
-	  address = std::strtoull(line.c_str() + 1, &end, 16);
-	  if (end and *end and *end != ' ')
-	    {
-	      std::cerr << "File " << fileName << ", Line " << lineNum << ": "
-			<< "Invalid hexadecimal address: " << line << '\n';
-	      errors++;
-	    }
-	  continue;
+	  iter++;
+	  j++;
 	}
+      if (not bindMemoryToNumaNodes(data_ + i*pageSize_, (j - i)*pageSize_,
+				    first))
+	return false;
+    }
+  return true;
+}
 
-      std::istringstream iss(line);
-      uint32_t value;
-      while (iss)
-	{
-	  iss >> std::hex >> value;
-	  if (iss.fail())
-	    {
-	      std::cerr << "File " << fileName << ", Line " << lineNum << ": "
-			<< "Invalid data: " << line << '\n';
-	      errors++;
-	      break;
-	    }
-	  if (value > 0xff)
-	    {
-	      std::cerr << "File " << fileName << ", Line " << lineNum << ": "
-			<< "Invalid value: " << std::hex << value << '\n';
-	      errors++;
-	    }
-	  if (address < size_)
-	    {
-	      if (not errors)
-		{
-		  if (data_[address] != 0)
-		    overwrites++;
-		  data_[address++] = value;
-		}
-	    }
-	  else
-	    {
-	      std::cerr << "File " << fileName << ", Line " << lineNum << ": "
-			<< "Address out of bounds: " << std::hex << address
-			<< '\n';
-	      errors++;
+
+namespace
+{
+  /// A piece of a hex file starting at a line (an address record
+  /// except for the first piece) and the result of parsing it. See
+  /// Memory::loadHexFile.
+  struct HexChunk
+  {
+    /// Bytes at consecutive addresses: size bytes at addr taken from
+    /// bytes starting at offset.
+    struct Run { size_t addr = 0, offset = 0, size = 0; };
+
+    /// Error message: line number relative to start of chunk and
+    /// text following the line number.
+    struct Message { size_t line = 0; std::string text; };
+
+    HexChunk(const char* b, const char* e)
+      : begin(b), end(e)
+    { }
+
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    size_t lines = 0;              // Number of lines in chunk.
+    bool failed = false;           // True if chunk has an error.
+    std::vector<Run> runs;
+    std::vector<uint8_t> bytes;    // Bytes parsed before first error.
+    std::vector<Message> messages;
+    size_t overwrites = 0;
+  };
+
+
+  /// Map of ASCII characters to hexadecimal digit values (16 for a
+  /// character that is not a hexadecimal digit).
+  struct HexDigits
+  {
+    HexDigits()
+    {
+      for (unsigned i = 0; i < 256; ++i)
+	value[i] = 16;
+      for (unsigned i = 0; i < 10; ++i)
+	value['0' + i] = i;
+      for (unsigned i = 0; i < 6; ++i)
+	value['a' + i] = value['A' + i] = 10 + i;
+    }
+
+    uint8_t value[256];
+  };
+
+  const HexDigits hexDigits;
+
+
+  /// Parse the lines of the given chunk of a hex file for a memory of
+  /// the given size. Data bytes are collected (not written to memory)
+  /// until the first error. Tokens are parsed like std::istream
+  /// operator>> with std::hex into a uint32_t would: leading white
+  /// space is skipped, a 0x prefix is allowed and a line ending with
+  /// white space is invalid.
+  void
+  parseHexChunk(HexChunk& chunk, size_t memSize)
+  {
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    size_t address = 0, lineNum = 0;
+    bool newRun = true;
+
+    auto error = [&chunk, &lineNum] (std::string&& text) {
+      chunk.failed = true;
+      chunk.messages.push_back({lineNum, std::move(text)});
+    };
+
+    for ( ; p < end; ++lineNum)
+      {
+	const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+	if (not eol)
+	  eol = end;
+	const char* line = p;
+	p = eol < end ? eol + 1 : end;
+
+	if (line == eol)
+	  continue;
+
+	if (*line == '@')
+	  {
+	    std::string text(line, eol);
+	    if (text.size() == 1)
+	      {
+		error("Invalid hexadecimal address: " + text);
+		continue;
+	      }
+	    char* tail = nullptr;
+	    address = std::strtoull(text.c_str() + 1, &tail, 16);
+	    if (tail and *tail and *tail != ' ')
+	      error("Invalid hexadecimal address: " + text);
+	    newRun = true;
+	    continue;
+	  }
+
+	for (const char* q = line; ; )
+	  {
+	    while (q < eol and isspace(uint8_t(*q)))
+	      q++;
+	    if (q + 1 < eol and q[0] == '0' and (q[1] == 'x' or q[1] == 'X') and
+		q + 2 < eol and hexDigits.value[uint8_t(q[2])] < 16)
+	      q += 2;
+
+	    uint64_t value = 0;
+	    const char* digits = q;
+	    for ( ; q < eol and hexDigits.value[uint8_t(*q)] < 16; ++q)
+	      {
+		value = (value << 4) | hexDigits.value[uint8_t(*q)];
+		if (value > 0xffffffff)
+		  break;
+	      }
+	    if (q == digits or value > 0xffffffff)
+	      {
+		error("Invalid data: " + std::string(line, eol));
+		break;
+	      }
+
+	    if (value > 0xff)
+	      {
+		std::ostringstream oss;
+		oss << "Invalid value: " << std::hex << value;
+		error(oss.str());
+	      }
+
+	    if (address >= memSize)
+	      {
+		std::ostringstream oss;
+		oss << "Address out of bounds: " << std::hex << address;
+		error(oss.str());
+		break;
+	      }
+
+	    if (not chunk.failed)
+	      {
+		auto& runs = chunk.runs;
+		if (newRun or runs.empty() or
+		    runs.back().addr + runs.back().size != address)
+		  runs.push_back({address, chunk.bytes.size(), 0});
+		newRun = false;
+		runs.back().size++;
+		chunk.bytes.push_back(value);
+		address++;
+	      }
+
+	    if (q == eol)
 	      break;
-	    }
-	  if (iss.eof())
-	    break;
-	}
+	  }
+      }
+
+    chunk.lines = lineNum;
+  }
+
+
+  /// Copy the collected bytes of the given chunk to memory starting
+  /// at data counting the bytes changing a non-zero value.
+  void
+  writeHexChunk(HexChunk& chunk, uint8_t* data)
+  {
+    for (const auto& run : chunk.runs)
+      {
+	const uint8_t* src = chunk.bytes.data() + run.offset;
+	uint8_t* dest = data + run.addr;
+	for (size_t i = 0; i < run.size; ++i)
+	  {
+	    chunk.overwrites += dest[i] != 0 and dest[i] != src[i];
+	    dest[i] = src[i];
+	  }
+      }
+  }
+}
 
-      if (iss.bad())
+
+bool
+Memory::loadHexFile(const std::string& fileName)
+{
+  int fd = open(fileName.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 or fstat(fd, &st) != 0)
+    {
+      std::cerr << "Failed to open hex-file '" << fileName << "' for input\n";
+      if (fd >= 0)
+	close(fd);
+      return false;
+    }
+
+  size_t fileSize = st.st_size;
+  if (fileSize == 0)
+    {
+      close(fd);
+      return true;
+    }
+
+  void* mem = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    {
+      std::cerr << "Failed to open hex-file '" << fileName << "' for input\n";
+      return false;
+    }
+
+  const char* begin = static_cast<const char*>(mem);
+  const char* end = begin + fileSize;
+
+  // Split the file at address records into about one piece per
+  // thread. Pieces are parsed in parallel.
+  const size_t minChunk = 1024*1024;
+  size_t jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  jobs = std::min(jobs, std::max(fileSize / minChunk, size_t(1)));
+
+  std::vector<HexChunk> chunks;
+  const char* pos = begin;
+  for (size_t i = 1; i < jobs; ++i)
+    {
+      const char* at = begin + fileSize * i / jobs;
+      if (at <= pos)
+	continue;
+      while (at and at < end and not (at[-1] == '\n' and *at == '@'))
 	{
-	  std::cerr << "File " << fileName << ", Line " << lineNum << ": "
-		    << "Failed to parse data line: " << line << '\n';
-	  errors++;
+	  at = static_cast<const char*>(memchr(at, '\n', end - at));
+	  if (at)
+	    at++;
 	}
+      if (not at or at >= end)
+	break;
+      chunks.emplace_back(pos, at);
+      pos = at;
+    }
+  chunks.emplace_back(pos, end);
+
+  if (chunks.size() == 1)
+    parseHexChunk(chunks.front(), size_);
+  else
+    {
+      std::vector<std::thread> threads;
+      for (auto& chunk : chunks)
+	threads.emplace_back(parseHexChunk, std::ref(chunk), size_);
+      for (auto& t : threads)
+	t.join();
+    }
+
+  // Report errors in file order. No data is written past the first
+  // error.
+  size_t errors = 0, lineBase = 0, lastChunk = chunks.size() - 1;
+  for (size_t i = 0; i < chunks.size(); ++i)
+    {
+      const auto& chunk = chunks.at(i);
+      for (const auto& msg : chunk.messages)
+	std::cerr << "File " << fileName << ", Line " << (lineBase + msg.line)
+		  << ": " << msg.text << '\n';
+      errors += chunk.messages.size();
+      lineBase += chunk.lines;
+      if (chunk.failed and i < lastChunk)
+	lastChunk = i;
     }
+  chunks.erase(chunks.begin() + lastChunk + 1, chunks.end());
+
+  // Chunks are written in parallel unless two of them write the same
+  // location: overwrite counts then depend on file order.
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (const auto& chunk : chunks)
+    for (const auto& run : chunk.runs)
+      {
+	ranges.emplace_back(run.addr, run.addr + run.size);
+	markModified(run.addr, run.size);
+      }
+  std::sort(ranges.begin(), ranges.end());
+  bool overlap = false;
+  for (size_t i = 1; i < ranges.size() and not overlap; ++i)
+    overlap = ranges.at(i).first < ranges.at(i-1).second;
+
+  if (chunks.size() == 1 or overlap)
+    for (auto& chunk : chunks)
+      writeHexChunk(chunk, data_);
+  else
+    {
+      std::vector<std::thread> threads;
+      for (auto& chunk : chunks)
+	threads.emplace_back(writeHexChunk, std::ref(chunk), data_);
+      for (auto& t : threads)
+	t.join();
+    }
+
+  munmap(mem, fileSize);
+
+  size_t overwrites = 0;
+  for (const auto& chunk : chunks)
+    overwrites += chunk.overwrites;
 
   if (overwrites)
     std::cerr << "File " << fileName << ": Overwrote previously loaded data "
@@ -241,75 +591,72 @@ Memory::loadElfFile(const std::string& fileName, size_t& entryPoint,
 {
   entryPoint = 0;
 
-  ELFIO::elfio reader;
+  ElfFile elf;
+  if (not elf.open(fileName))
+    return false;
 
-  if (not reader.load(fileName))
-    {
-      std::cerr << "Failed to load ELF file " << fileName << '\n';
-      return false;
-    }
+  if (not loadElfFile(elf, entryPoint, exitPoint))
+    return false;
 
-  if (reader.get_class() != ELFCLASS32 and reader.get_class() != ELFCLASS64)
-    {
-      std::cerr << "Only 32/64-bit ELFs are currently supported\n";
-      return false;
-    }
+  elf.collectSymbols(symbols);
+  return true;
+}
 
-  if (reader.get_encoding() != ELFDATA2LSB)
-    {
-      std::cerr << "Only little-endian ELF is currently supported\n";
-      return false;
-    }
 
-  if (reader.get_machine() != EM_RISCV)
-    {
-      std::cerr << "Warning: non-riscv ELF file\n";
-    }
+bool
+Memory::loadElfFile(const ElfFile& elf, size_t& entryPoint,
+		    size_t& exitPoint)
+{
+  entryPoint = 0;
 
-  auto secCount = reader.sections.size();
+  if (not elf.isRiscv())
+    std::cerr << "Warning: non-riscv ELF file\n";
 
-  // Copy loadable ELF segments into memory.
+  // Copy loadable ELF segments into memory straight from the file
+  // mapping, one page at a time.
   size_t maxEnd = 0;  // Largest end address of a segment.
   size_t errors = 0, overwrites = 0;
 
-  unsigned loadedSegs = 0;
-  for (int segIx = 0; segIx < reader.segments.size(); ++segIx)
+  const auto& segments = elf.loadSegments();
+  for (size_t segIx = 0; segIx < segments.size(); ++segIx)
     {
-      const ELFIO::segment* seg = reader.segments[segIx];
-      ELFIO::Elf64_Addr vaddr = seg->get_virtual_address();
-      ELFIO::Elf_Xword segSize = seg->get_file_size(); // Size in file.
-      const char* segData = seg->get_data();
-      if (seg->get_type() == PT_LOAD)
+      const auto& seg = segments.at(segIx);
+      size_t vaddr = seg.addr, segSize = seg.fileSize;
+      if (vaddr + segSize > size_ or vaddr + segSize < vaddr)
+	{
+	  std::cerr << "End of ELF segment " << segIx << " ("
+		    << (vaddr+segSize)
+		    << ") is beyond end of simulated memory ("
+		    << size_ << ")\n";
+	  errors++;
+	  continue;
+	}
+
+      for (size_t offset = 0; offset < segSize; )
 	{
-	  if (vaddr + segSize > size_)
+	  size_t addr = vaddr + offset;
+	  size_t chunk = std::min(segSize - offset,
+				  getPageStartAddr(addr) + pageSize_ - addr);
+	  if (not getAttrib(addr).isMapped())
 	    {
-	      std::cerr << "End of ELF segment " << segIx << " ("
-			<< (vaddr+segSize)
-			<< ") is beyond end of simulated memory ("
-			<< size_ << ")\n";
+	      std::cerr << "Failed to copy ELF byte at address 0x"
+			<< std::hex << addr << std::dec
+			<< ": corresponding location is not mapped\n";
 	      errors++;
+	      break;
 	    }
-	  else
-	    {
-	      for (size_t i = 0; i < segSize; ++i)
-		{
-		  if (data_[vaddr + i] != 0)
-		    overwrites++;
-		  if (not writeByteNoAccessCheck(vaddr + i, segData[i]))
-		    {
-		      std::cerr << "Failed to copy ELF byte at address 0x"
-				<< std::hex << (vaddr + i)
-				<< ": corresponding location is not mapped\n";
-		      errors++;
-		      break;
-		    }
-		}
-	      loadedSegs++;
-	      maxEnd = std::max(maxEnd, size_t(vaddr) + size_t(segSize));
-	    }
+
+	  const uint8_t* src = seg.data + offset;
+	  uint8_t* dest = data_ + addr;
+	  for (size_t i = 0; i < chunk; ++i)
+	    overwrites += dest[i] != 0 and dest[i] != src[i];
+	  markModified(addr, chunk);
+	  memcpy(dest, src, chunk);
+	  offset += chunk;
 	}
+      maxEnd = std::max(maxEnd, vaddr + segSize);
     }
-  if (loadedSegs == 0)
+  if (segments.empty())
     {
       std::cerr << "No loadable segment in ELF file\n";
       errors++;
@@ -317,46 +664,18 @@ Memory::loadElfFile(const std::string& fileName, size_t& entryPoint,
 
   clearLastWriteInfo();
 
-  // Collect symbols.
-  for (int secIx = 0; secIx < secCount; ++secIx)
-    {
-      auto sec = reader.sections[secIx];
-      if (sec->get_type() != SHT_SYMTAB)
-	continue;
-
-      const ELFIO::symbol_section_accessor symAccesor(reader, sec);
-      ELFIO::Elf64_Addr address = 0;
-      ELFIO::Elf_Xword size = 0;
-      unsigned char bind, type, other;
-      ELFIO::Elf_Half index = 0;
-
-      // Finding symbol by name does not work. Walk all the symbols.
-      ELFIO::Elf_Xword symCount = symAccesor.get_symbols_num();
-      for (ELFIO::Elf_Xword symIx = 0; symIx < symCount; ++symIx)
-	{
-	  std::string name;
-	  if (symAccesor.get_symbol(symIx, name, address, size, bind, type,
-				    index, other))
-	    {
-	      if (name.empty())
-		continue;
-	      if (type == STT_NOTYPE or type == STT_FUNC or type == STT_OBJECT)
-		symbols[name] = ElfSymbol(address, size);
-	    }
-	}
-    }
-
   // Get the program entry point.
   if (not errors)
     {
-      entryPoint = reader.get_entry();
+      entryPoint = elf.entryPoint();
       exitPoint = maxEnd;
-      if (symbols.count("_finish"))
-	exitPoint = symbols.at("_finish").addr_;
+      ElfSymbol finish;
+      if (elf.findSymbol("_finish", finish))
+	exitPoint = finish.addr_;
     }
 
   if (overwrites)
-    std::cerr << "File " << fileName << ": Overwrote previously loaded data "
+    std::cerr << "File " << elf.path() << ": Overwrote previously loaded data "
 	      << "changing " << overwrites << " or more bytes\n";
 
   return errors == 0;
@@ -368,49 +687,114 @@ Memory::getElfFileAddressBounds(const std::string& fileName, size_t& minAddr,
 				size_t& maxAddr)
 
 {
-  ELFIO::elfio reader;
+  ElfFile elf;
+  if (not elf.open(fileName))
+    return false;
 
-  if (not reader.load(fileName))
+  // Only the program headers are read.
+  uint64_t minBound = 0, maxBound = 0;
+  if (not elf.addressBounds(minBound, maxBound))
     {
-      std::cerr << "Failed to load ELF file " << fileName << '\n';
+      std::cerr << "No loadable segment in ELF file\n";
       return false;
     }
 
-  // Get min max bounds of the segments.
-  size_t minBound = ~ size_t(0);
-  size_t maxBound = 0;
-  unsigned validSegs = 0;
-  for (int segIx = 0; segIx < reader.segments.size(); ++segIx)
+  minAddr = minBound;
+  maxAddr = maxBound;
+  return true;
+}
+
+
+void
+Memory::copy(const Memory& other)
+{
+  dropSnapshot();
+  size_t n = std::min(size_, other.size_);
+
+  // Copy only the pages of the other memory that hold data: the rest
+  // of the destination is released and reads back as zero.
+  zeroRange(0, n);
+
+  std::vector<size_t> pages;
+  other.getUsedPages(pages);
+  for (auto ix : pages)
     {
-      const ELFIO::segment* seg = reader.segments[segIx];
-      if (seg->get_type() != PT_LOAD)
-	continue;
+      size_t begin = ix*other.pageSize_;
+      if (begin >= n)
+	break;
+      size_t count = std::min(other.pageSize_, n - begin);
+      memcpy(data_ + begin, other.data_ + begin, count);
+    }
+}
+
 
-      ELFIO::Elf64_Addr vaddr = seg->get_virtual_address();
-      ELFIO::Elf_Xword size = seg->get_file_size(); // Size in file.
+void
+Memory::clearData()
+{
+  dropSnapshot();
+  zeroRange(0, size_);
+}
 
-      minBound = std::min(minBound, size_t(vaddr));
-      maxBound = std::max(maxBound, size_t(vaddr + size));
-      validSegs++;
+
+void
+Memory::zeroRange(size_t addr, size_t size)
+{
+  if (addr >= size_)
+    return;
+  size = std::min(size, size_ - addr);
+
+  // Host pages entirely within the range are released. Bytes of
+  // partially covered host pages are cleared.
+  size_t hostPageSize = sysconf(_SC_PAGESIZE);
+  size_t begin = (addr + hostPageSize - 1) / hostPageSize * hostPageSize;
+  size_t end = (addr + size) / hostPageSize * hostPageSize;
+  if (begin >= end)
+    {
+      memset(data_ + addr, 0, size);
+      return;
     }
+  memset(data_ + addr, 0, begin - addr);
+  memset(data_ + end, 0, addr + size - end);
+
+  uint8_t* start = data_ + begin;
+  size_t length = end - begin;
 
-  if (validSegs == 0)
+  if (fileMapped_)
     {
-      std::cerr << "No loadable segment in ELF file\n";
-      return false;
+      // Dropping file-mapped pages would bring back the file contents:
+      // replace them with a fresh anonymous mapping.
+      void* mem = mmap(start, length, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+		       -1, 0);
+      if (mem != (void*) -1)
+	{
+	  if (addr == 0 and size == size_)
+	    fileMapped_ = false;
+	  return;
+	}
     }
 
-  minAddr = minBound;
-  maxAddr = maxBound;
-  return true;
+  // Anonymous private pages read back as zero once dropped.
+  if (madvise(start, length, MADV_DONTNEED) != 0)
+    memset(start, 0, length);
 }
 
 
 void
-Memory::copy(const Memory& other)
+Memory::setHartCount(unsigned count)
 {
-  size_t n = std::min(size_, other.size_);
-  memcpy(data_, other.data_, n);
+  hartCount_ = std::max(count, 1u);
+  if (hartCount_ == 1)
+    {
+      granuleLocks_.clear();
+      reservations_.clear();
+      return;
+    }
+
+  granuleLocks_ = std::vector<std::atomic<bool>>(granuleLockCount_);
+  reservations_ = std::vector<std::atomic<size_t>>(hartCount_);
+  for (auto& reservation : reservations_)
+    reservation.store(noReservation_);
 }
 
 
@@ -471,20 +855,14 @@ Memory::checkCcmOverlap(const std::string& tag, size_t region, size_t offset,
     {
       // Region never configured. Make it all inaccessible.
       regionConfigured_.at(region) = true;
-      size_t ix0 = getPageIx(regionSize_*size_t(region));
-      size_t ix1 = ix0 + getPageIx(regionSize_);
-      for (size_t ix = ix0; ix < ix1; ++ix)
-	{
-	  auto& attrib = attribs_.at(ix);
-	  attrib.setAll(false);
-	}
+      updateRegionAttribs(region, [] (PageAttribs& attrib) {
+	  attrib.setAll(false); });
       return true;  // No overlap.
     }
 
   // Check area overlap.
   size_t addr = region * regionSize_ + offset;
-  size_t ix = getPageIx(addr);
-  if (attribs_.at(ix).isMapped())
+  if (getAttrib(addr).isMapped())
     {
       std::cerr << tag << " area at address " << addr << " overlaps "
 		<< " a previously defined area.\n";
@@ -510,12 +888,13 @@ Memory::defineIccm(size_t region, size_t offset, size_t size)
   size_t count = size/pageSize_;  // Count of pages in iccm
   for (size_t i = 0; i < count; ++i)
     {
-      auto& attrib = attribs_.at(ix + i);
-      attrib.setSectionPages(count);
-      attrib.setMapped(true);
-      attrib.setExec(true);
-      attrib.setRead(true);
-      attrib.setIccm(true);
+      updatePageAttribs(ix + i, [count] (PageAttribs& attrib) {
+	  attrib.setSectionPages(count);
+	  attrib.setMapped(true);
+	  attrib.setExec(true);
+	  attrib.setRead(true);
+	  attrib.setIccm(true);
+	});
     }
   return true;
 }
@@ -536,12 +915,13 @@ Memory::defineDccm(size_t region, size_t offset, size_t size)
   size_t count = size/pageSize_;  // Count of pages in iccm
   for (size_t i = 0; i < count; ++i)
     {
-      auto& attrib = attribs_.at(ix + i);
-      attrib.setSectionPages(count);
-      attrib.setMapped(true);
-      attrib.setWrite(true);
-      attrib.setRead(true);
-      attrib.setDccm(true);
+      updatePageAttribs(ix + i, [count] (PageAttribs& attrib) {
+	  attrib.setSectionPages(count);
+	  attrib.setMapped(true);
+	  attrib.setWrite(true);
+	  attrib.setRead(true);
+	  attrib.setDccm(true);
+	});
     }
   return true;
 }
@@ -565,12 +945,13 @@ Memory::defineMemoryMappedRegisterRegion(size_t region, size_t offset,
     {
       mmrPages_.push_back(pageIx);
 
-      auto& attrib = attribs_.at(pageIx++);
-      attrib.setSectionPages(count);
-      attrib.setMapped(true);
-      attrib.setRead(true);
-      attrib.setWrite(true);
-      attrib.setMemMappedReg(true);
+      updatePageAttribs(pageIx++, [count] (PageAttribs& attrib) {
+	  attrib.setSectionPages(count);
+	  attrib.setMapped(true);
+	  attrib.setRead(true);
+	  attrib.setWrite(true);
+	  attrib.setMemMappedReg(true);
+	});
     }
   return true;
 }
@@ -585,8 +966,167 @@ Memory::resetMemoryMappedRegisters()
       size_t addr1 = addr0 + pageSize_ - 1; // last byte in page.
       size_t hostAddr0 = 0, hostAddr1 = 0;
       if (getSimMemAddr(addr0, hostAddr0) and getSimMemAddr(addr1, hostAddr1))
-	memset(reinterpret_cast<void*>(hostAddr0), 0, pageSize_);
+	{
+	  markModified(addr0, pageSize_);
+	  memset(reinterpret_cast<void*>(hostAddr0), 0, pageSize_);
+	}
+    }
+}
+
+
+void
+Memory::takeSnapshot()
+{
+  dropSnapshot();
+  pageSaved_.assign(pageCount_, false);
+  snapshotActive_ = true;
+  trackWrites_ = true;
+}
+
+
+bool
+Memory::restoreSnapshot()
+{
+  if (not snapshotActive_)
+    return false;
+
+  for (size_t i = 0; i < savedPages_.size(); ++i)
+    {
+      size_t pageIx = savedPages_[i];
+      memcpy(data_ + pageIx*pageSize_, savedData_.data() + i*pageSize_,
+	     pageSize_);
+      pageSaved_[pageIx] = false;
+    }
+
+  savedPages_.clear();
+  savedData_.clear();
+  return true;
+}
+
+
+void
+Memory::dropSnapshot()
+{
+  snapshotActive_ = false;
+  trackWrites_ = journalActive_;
+  pageSaved_.clear();
+  savedPages_.clear();
+  savedData_.clear();
+  savedData_.shrink_to_fit();
+}
+
+
+bool
+Memory::watchPage(size_t addr)
+{
+  if (addr >= size_)
+    return false;
+
+  updatePageAttribs(getPageIx(addr), [] (PageAttribs& attrib) {
+      attrib.setWatch(true); });
+  return true;
+}
+
+
+void
+Memory::saveSnapshotPages(size_t addr, size_t size)
+{
+  if (size == 0 or addr >= size_)
+    return;
+
+  size_t last = std::min(addr + size, size_) - 1;
+  for (size_t pageIx = getPageIx(addr); pageIx <= getPageIx(last); ++pageIx)
+    {
+      if (pageSaved_[pageIx])
+	continue;
+      pageSaved_[pageIx] = true;
+      savedPages_.push_back(pageIx);
+      const uint8_t* page = data_ + pageIx*pageSize_;
+      savedData_.insert(savedData_.end(), page, page + pageSize_);
+    }
+}
+
+
+void
+Memory::enableJournal(size_t capacity)
+{
+  disableJournal();
+  journalData_.reset(new uint8_t[capacity]);
+  journalCapacity_ = capacity;
+  journalActive_ = true;
+  trackWrites_ = true;
+}
+
+
+void
+Memory::disableJournal()
+{
+  journalActive_ = false;
+  trackWrites_ = snapshotActive_;
+  journal_.clear();
+  journalData_.reset();
+  journalCapacity_ = 0;
+  journalStart_ = 0;
+  journalDataEnd_ = 0;
+}
+
+
+void
+Memory::journalModification(size_t addr, size_t size)
+{
+  if (size == 0 or addr >= size_)
+    return;
+  size = std::min(size, size_ - addr);
+
+  if (size > journalCapacity_)
+    {
+      // Too large to be kept: Nothing before it can be undone.
+      journalStart_ += journal_.size() + 1;
+      journal_.clear();
+      return;
+    }
+
+  uint64_t pos = journalDataEnd_;
+  journalDataEnd_ += size;
+
+  // Drop the oldest records whose bytes are about to be overwritten.
+  while (not journal_.empty() and
+	 journal_.front().dataPos + journalCapacity_ < journalDataEnd_)
+    {
+      journal_.pop_front();
+      journalStart_++;
+    }
+
+  size_t offset = pos % journalCapacity_;
+  size_t first = std::min(size, journalCapacity_ - offset);
+  memcpy(journalData_.get() + offset, data_ + addr, first);
+  memcpy(journalData_.get(), data_ + addr + first, size - first);
+
+  journal_.push_back(JournalRecord{addr, size, pos});
+}
+
+
+bool
+Memory::undoJournal(uint64_t position)
+{
+  if (position < journalStart_ or position > journalPosition())
+    return false;
+
+  while (journalPosition() > position)
+    {
+      const JournalRecord& rec = journal_.back();
+      if (snapshotActive_)
+	saveSnapshotPages(rec.addr, rec.size);
+
+      size_t offset = rec.dataPos % journalCapacity_;
+      size_t first = std::min(rec.size, journalCapacity_ - offset);
+      memcpy(data_ + rec.addr, journalData_.get() + offset, first);
+      memcpy(data_ + rec.addr + first, journalData_.get(), rec.size - first);
+
+      journalDataEnd_ = rec.dataPos;
+      journal_.pop_back();
     }
+  return true;
 }
 
 
@@ -616,15 +1156,14 @@ Memory::defineMemoryMappedRegisterWriteMask(size_t region,
 					    uint32_t mask)
 {
   size_t sectionStart = region * regionSize_ + picOffset;
-  size_t ix = getPageIx(sectionStart);
-  if (not attribs_.at(ix).isMapped())
+  if (not getAttrib(sectionStart).isMapped())
     {
       printPicRegisterError("PIC area does not exist", region, picOffset,
 			    regAreaOffset, regIx);
       return false;
     }
 
-  if (not attribs_.at(ix).isMemMappedReg())
+  if (not getAttrib(sectionStart).isMemMappedReg())
     {
       printPicRegisterError("Area not defined for PIC registers", region,
 			    picOffset, regAreaOffset, regIx);
@@ -648,13 +1187,10 @@ Memory::defineMemoryMappedRegisterWriteMask(size_t region,
       return false;
     }
 
-  if (masks_.empty())
-    masks_.resize(pageCount_);
-
   size_t registerStartAddr = sectionStart + regAreaOffset + regIx*4;
   size_t pageIx = getPageIx(registerStartAddr);
   size_t pageStart = getPageStartAddr(registerStartAddr);
-  std::vector<uint32_t>& pageMasks = masks_.at(pageIx);
+  std::vector<uint32_t>& pageMasks = masks_[pageIx];
   if (pageMasks.empty())
     {
       size_t wordCount = pageSize_ / 4;
@@ -663,6 +1199,76 @@ Memory::defineMemoryMappedRegisterWriteMask(size_t region,
   size_t maskIx = (registerStartAddr - pageStart) / 4;
   pageMasks.at(maskIx) = mask;
 
+  compileRegisterMasks();
+
+  return true;
+}
+
+
+void
+Memory::compileRegisterMasks()
+{
+  flatMasks_.clear();
+  maskBase_ = 0;
+  if (masks_.empty())
+    return;
+
+  size_t firstPage = ~size_t(0), lastPage = 0;
+  for (const auto& kv : masks_)
+    {
+      firstPage = std::min(firstPage, kv.first);
+      lastPage = std::max(lastPage, kv.first);
+    }
+
+  size_t wordsPerPage = pageSize_ / 4;
+  maskBase_ = firstPage * pageSize_;
+  flatMasks_.assign((lastPage - firstPage + 1) * wordsPerPage, ~uint32_t(0));
+  for (const auto& kv : masks_)
+    std::copy(kv.second.begin(), kv.second.end(),
+	      flatMasks_.begin() + (kv.first - firstPage) * wordsPerPage);
+}
+
+
+bool
+Memory::defineDevice(size_t addr, size_t size, DeviceReadFn readFn,
+		     DeviceWriteFn writeFn)
+{
+  if ((addr & 3) != 0 or (size & 3) != 0 or size == 0 or addr >= size_ or
+      size > size_ - addr)
+    {
+      std::cerr << "Invalid device address range: 0x" << std::hex << addr
+		<< " size 0x" << size << std::dec << '\n';
+      return false;
+    }
+
+  for (size_t a = addr; a < addr + size; a += pageSize_)
+    if (not getAttrib(a).isMemMappedReg())
+      {
+	std::cerr << "Device address 0x" << std::hex << a << std::dec
+		  << " is not in a memory mapped register region\n";
+	return false;
+      }
+  if (not getAttrib(addr + size - 1).isMemMappedReg())
+    {
+      std::cerr << "Device address 0x" << std::hex << (addr + size - 1)
+		<< std::dec << " is not in a memory mapped register region\n";
+      return false;
+    }
+
+  for (const auto& device : devices_)
+    if (addr < device.end and device.begin < addr + size)
+      {
+	std::cerr << "Device at 0x" << std::hex << addr << " overlaps device "
+		  << "at 0x" << device.begin << std::dec << '\n';
+	return false;
+      }
+
+  Device device;
+  device.begin = addr;
+  device.end = addr + size;
+  device.readFn = readFn;
+  device.writeFn = writeFn;
+  devices_.push_back(device);
   return true;
 }
 
@@ -687,41 +1293,164 @@ Memory::finishMemoryConfig()
       bool hasData = false;  // True if region has DCCM/PIC section(s).
       bool hasInst = false;  // True if region has ICCM section(s).
 
-      size_t addr = region * regionSize_;
-      size_t pageCount = regionSize_ / pageSize_;
-
-      size_t pageIx = getPageIx(addr);
-      for (size_t i = 0; i < pageCount; ++i, ++pageIx)
-	{
-	  PageAttribs attrib = attribs_.at(pageIx);
+      updateRegionAttribs(region, [&] (PageAttribs& attrib) {
 	  hasData = hasData or attrib.isMappedWrite();
 	  hasInst = hasInst or attrib.isMappedExec();
-	}
+	});
 
       if (hasInst and hasData)
 	continue;
 
       if (hasInst)
+	updateRegionAttribs(region, [] (PageAttribs& attrib) {
+	    attrib.setMapped(true);
+	    attrib.setWrite(true);
+	    attrib.setRead(true);
+	  });
+
+      if (hasData)
+	updateRegionAttribs(region, [] (PageAttribs& attrib) {
+	    attrib.setMapped(true);
+	    attrib.setExec(true);
+	  });
+    }
+}
+
+
+size_t
+Memory::residentPageCount() const
+{
+  size_t hostPageSize = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> resident((size_ + hostPageSize - 1) / hostPageSize);
+  if (mincore(data_, size_, resident.data()) != 0)
+    return 0;
+  return std::count_if(resident.begin(), resident.end(),
+		       [] (unsigned char c) { return c & 1; });
+}
+
+
+void
+Memory::getUsedPages(std::vector<size_t>& pages) const
+{
+  pages.clear();
+
+  // Use the page map of the process to skip host pages that are
+  // neither present nor swapped: these were never touched and read
+  // as zero. Reading them would only waste time mapping them.
+  size_t hostPageSize = sysconf(_SC_PAGESIZE);
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  std::vector<uint64_t> entries(4096);
+  size_t first = 0, count = 0;  // Host pages whose entries are loaded.
+
+  auto touched = [&] (size_t hostIx) -> bool {
+    if (fd < 0)
+      return true;
+    if (hostIx < first or hostIx >= first + count)
+      {
+	ssize_t n = pread(fd, entries.data(), entries.size()*sizeof(uint64_t),
+			  off_t(hostIx*sizeof(uint64_t)));
+	if (n < ssize_t(sizeof(uint64_t)))
+	  {
+	    close(fd);
+	    fd = -1;
+	    return true;
+	  }
+	first = hostIx;
+	count = n / sizeof(uint64_t);
+      }
+    return (entries[hostIx - first] >> 62) != 0;  // Present or swapped.
+  };
+
+  size_t base = reinterpret_cast<size_t>(data_);
+  for (size_t ix = 0; ix < pageCount_; ++ix)
+    {
+      size_t begin = ix*pageSize_;
+      size_t end = std::min(begin + pageSize_, size_);
+
+      bool used = false;
+      for (size_t h = (base + begin)/hostPageSize;
+	   not used and h <= (base + end - 1)/hostPageSize; ++h)
+	used = touched(h);
+      if (not used)
+	continue;
+
+      // Page size is a power of 2 and data_ is page aligned.
+      const uint64_t* words = reinterpret_cast<const uint64_t*>(data_ + begin);
+      size_t wordCount = (end - begin) / sizeof(uint64_t);
+      used = false;
+      for (size_t w = 0; w < wordCount and not used; ++w)
+	used = words[w] != 0;
+      if (used)
+	pages.push_back(ix);
+    }
+
+  if (fd >= 0)
+    close(fd);
+}
+
+
+bool
+Memory::writePages(FILE* out, const std::vector<size_t>& pages) const
+{
+  for (auto ix : pages)
+    {
+      if (ix >= pageCount_)
+	return false;
+      if (fwrite(data_ + ix*pageSize_, pageSize_, 1, out) != 1)
+	return false;
+    }
+  return true;
+}
+
+
+bool
+Memory::loadPages(int fd, uint64_t offset, const std::vector<size_t>& pages)
+{
+  clearData();
+
+  long hostPageSize = sysconf(_SC_PAGESIZE);
+  bool canMap = (hostPageSize > 0 and pageSize_ % hostPageSize == 0 and
+		 offset % hostPageSize == 0);
+
+  for (size_t i = 0; i < pages.size(); )
+    {
+      // Consecutive pages are mapped (or read) with one call.
+      size_t j = i + 1;
+      while (j < pages.size() and pages.at(j) == pages.at(j-1) + 1)
+	j++;
+
+      if (pages.at(j-1) >= pageCount_ or pages.at(i) > pages.at(j-1))
 	{
-	  size_t pageIx = getPageIx(addr);
-	  for (size_t i = 0; i < pageCount; ++i, ++pageIx)
-	    {
-	      auto& attrib = attribs_.at(pageIx);
-	      attrib.setMapped(true);
-	      attrib.setWrite(true);
-	      attrib.setRead(true);
-	    }
+	  std::cerr << "Checkpoint page out of memory bounds\n";
+	  return false;
 	}
 
-      if (hasData)
+      uint8_t* dest = data_ + pages.at(i)*pageSize_;
+      size_t size = (j - i)*pageSize_;
+      off_t pos = offset + i*pageSize_;
+
+      bool mapped = false;
+      if (canMap)
+	{
+	  void* addr = mmap(dest, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_FIXED, fd, pos);
+	  mapped = addr != (void*) -1;
+	  fileMapped_ = fileMapped_ or mapped;
+	}
+
+      for (size_t done = 0; not mapped and done < size; )
 	{
-	  size_t pageIx = getPageIx(addr);
-	  for (size_t i = 0; i < pageCount; ++i, ++pageIx)
+	  ssize_t n = pread(fd, dest + done, size - done, pos + done);
+	  if (n <= 0)
 	    {
-	      auto& attrib = attribs_.at(pageIx);
-	      attrib.setMapped(true);
-	      attrib.setExec(true);
+	      std::cerr << "Failed to read checkpoint memory pages\n";
+	      return false;
 	    }
+	  done += n;
 	}
+
+      i = j;
     }
+
+  return true;
 }
@@ -19,9 +19,17 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdio>
+#include <string>
 #include <vector>
+#include <set>
+#include <deque>
+#include <memory>
+#include <cstring>
 #include <unordered_map>
 #include <type_traits>
+#include <atomic>
+#include <functional>
 #include <assert.h>
 
 namespace WdRiscv
@@ -30,16 +38,34 @@ namespace WdRiscv
   template <typename URV>
   class Core;
 
+  class ElfFile;
+
   /// Page attributes.
   struct PageAttribs
   {
     PageAttribs()
-      : secPages_(1), mapped_(false), read_(false), write_(false), exec_(false),
-	reg_(false), iccm_(false), dccm_(false)
     {
+      memset(static_cast<void*>(this), 0, sizeof(*this));  // Unused bits too.
+      secPages_ = 1;
       setMapped(mapped_); // Update mappedInst_, mappedData_ and mappedDataWrite_
     }
 
+    /// Return the attributes packed in a word (see Memory::getAttrib).
+    uint32_t bits() const
+    {
+      uint32_t word;
+      memcpy(&word, static_cast<const void*>(this), sizeof(word));
+      return word;
+    }
+
+    /// Return the attributes packed in the given word (see bits).
+    static PageAttribs fromBits(uint32_t word)
+    {
+      PageAttribs attrib;
+      memcpy(static_cast<void*>(&attrib), &word, sizeof(word));
+      return attrib;
+    }
+
     /// Set all attributes to given flag.
     void setAll(bool flag)
     {
@@ -60,6 +86,7 @@ namespace WdRiscv
       mappedRead_ = mapped_ and read_;
       mappedWrite_ = mapped_ and write_;
       mappedExec_ = mapped_ and exec_;
+      setPlain();
     }
 
     /// Mark page as writable/non-writable.
@@ -67,6 +94,7 @@ namespace WdRiscv
     {
       write_ = flag;
       mappedWrite_ = mapped_ and write_;
+      setPlain();
     }
 
     /// Mark/unmark page as usable for instruction fetch.
@@ -81,12 +109,23 @@ namespace WdRiscv
     {
       read_ = flag;
       mappedRead_ = mapped_ and read_;
+      setPlain();
     }
 
     /// Mark/unmark page as usable for memory-mapped registers.
     void setMemMappedReg(bool flag)
     {
       reg_ = flag;
+      setPlain();
+    }
+
+    /// Mark/unmark page as watched: writes to it take the slow path
+    /// of Memory::write which reports them (see
+    /// Memory::takeWatchedWrite).
+    void setWatch(bool flag)
+    {
+      watch_ = flag;
+      setPlain();
     }
 
     /// Mark page as belonging to an ICCM region.
@@ -148,6 +187,12 @@ namespace WdRiscv
       return reg_;
     }
 
+    /// True if writes to page are reported (see setWatch).
+    bool isWatched() const
+    {
+      return watch_;
+    }
+
     /// True if page is mapped and is usable for instruction fetch.
     bool isMappedExec() const
     {
@@ -166,6 +211,21 @@ namespace WdRiscv
       return mappedWrite_;
     }
 
+    /// True if page is mapped, readable and holds no memory-mapped
+    /// registers: an aligned load from it needs no other check.
+    bool isPlainRead() const
+    {
+      return plainRead_;
+    }
+
+    /// True if page is mapped, writable, holds no memory-mapped
+    /// registers and is not watched: an aligned store to it needs no
+    /// other check.
+    bool isPlainWrite() const
+    {
+      return plainWrite_;
+    }
+
     /// Assign to this page the number of pages in the section
     /// (e.g. ICCM area) containing it.
     void setSectionPages(size_t count)
@@ -191,8 +251,23 @@ namespace WdRiscv
     bool mappedExec_      : 1; // True if mapped and exec.
     bool mappedRead_      : 1; // True if mapped and readable.
     bool mappedWrite_     : 1; // True if mapped and writable.
+    bool plainRead_       : 1; // True if mapped, readable and not reg.
+    bool plainWrite_      : 1; // True if mapped, writable, not reg/watched.
+    bool watch_           : 1; // True if writes are reported.
+
+  private:
+
+    /// Update plainRead_ and plainWrite_ after an attribute change.
+    void setPlain()
+    {
+      plainRead_ = mappedRead_ and not reg_;
+      plainWrite_ = mappedWrite_ and not reg_ and not watch_;
+    }
   };
 
+  static_assert(sizeof(PageAttribs) == sizeof(uint32_t),
+		"Page attributes must pack in a word");
+
 
   /// Location and size of an ELF file symbol.
   struct ElfSymbol
@@ -213,6 +288,7 @@ namespace WdRiscv
 
     friend class Core<uint32_t>;
     friend class Core<uint64_t>;
+    friend class Jit;
 
     /// Constructor: define a memory of the given size initialized to
     /// zero. Given memory size (byte count) must be a multiple of 4
@@ -228,6 +304,12 @@ namespace WdRiscv
     size_t size() const
     { return size_; }
 
+    /// Return the number of host pages of this memory currently in
+    /// host memory: the pages touched by loading programs and by
+    /// simulated accesses that were not released since. Return 0 if
+    /// the host does not tell.
+    size_t residentPageCount() const;
+
     /// Read an unsigned integer value of type T from memory at the
     /// given address into value. Return true on success. Return false
     /// if any of the requested bytes is out of memory bounds or fall
@@ -237,6 +319,14 @@ namespace WdRiscv
     bool read(size_t address, T& value) const
     {
       PageAttribs attrib = getAttrib(address);
+
+      // Common case: aligned access to ordinary memory.
+      if (attrib.isPlainRead() and (address & (sizeof(T) - 1)) == 0)
+	{
+	  value = *(reinterpret_cast<const T*>(data_ + address));
+	  return true;
+	}
+
       if (not attrib.isMappedRead())
 	return false;
 
@@ -273,11 +363,8 @@ namespace WdRiscv
     bool readByte(size_t address, uint8_t& value) const
     {
       PageAttribs attrib = getAttrib(address);
-      if (not attrib.isMappedRead())
-	return false;
-
-      if (attrib.isMemMappedReg())
-	return false; // Only word access allowed to memory mapped regs.
+      if (not attrib.isPlainRead())
+	return false;  // Unmapped or memory mapped reg (word access only).
 
       value = data_[address];
       return true;
@@ -363,6 +450,9 @@ namespace WdRiscv
     bool checkWrite(size_t address, T& value)
     {
       PageAttribs attrib1 = getAttrib(address);
+      if (attrib1.isPlainWrite() and (address & (sizeof(T) - 1)) == 0)
+	return true;  // Common case: aligned access to ordinary memory.
+
       bool dccm1 = attrib1.isDccm();
 
       if (address & (sizeof(T) - 1))  // If address is misaligned
@@ -410,35 +500,44 @@ namespace WdRiscv
       PageAttribs attrib1 = getAttrib(address);
       bool dccm1 = attrib1.isDccm();
 
-      if (address & (sizeof(T) - 1))  // If address is misaligned
+      // Common case (aligned access to ordinary memory) needs no other
+      // check.
+      if (not attrib1.isPlainWrite() or (address & (sizeof(T) - 1)))
 	{
-	  size_t page = getPageStartAddr(address);
-	  size_t page2 = getPageStartAddr(address + sizeof(T) - 1);
-	  if (page != page2)
+	  if (address & (sizeof(T) - 1))  // If address is misaligned
 	    {
-	      // Write crosses page boundary: Check next page.
-	      PageAttribs attrib2 = getAttrib(address + sizeof(T));
-	      if (not attrib2.isMappedWrite())
-		return false;
-	      if (not attrib1.isMappedWrite())
-		return false;
-	      if (dccm1 != attrib2.isDccm())
-		return false;  // Cannot cross a DCCM boundary.
+	      size_t page = getPageStartAddr(address);
+	      size_t page2 = getPageStartAddr(address + sizeof(T) - 1);
+	      if (page != page2)
+		{
+		  // Write crosses page boundary: Check next page.
+		  PageAttribs attrib2 = getAttrib(address + sizeof(T));
+		  if (not attrib2.isMappedWrite())
+		    return false;
+		  if (not attrib1.isMappedWrite())
+		    return false;
+		  if (dccm1 != attrib2.isDccm())
+		    return false;  // Cannot cross a DCCM boundary.
+		}
 	    }
-	}
 
-      if (not attrib1.isMappedWrite())
-	return false;
+	  if (not attrib1.isMappedWrite())
+	    return false;
 
-      // Memory mapped region accessible only with word-size write.
-      if constexpr (sizeof(T) == 4)
-        {
-	  if (attrib1.isMemMappedReg())
-	    return writeRegister(address, value);
+	  if (attrib1.isWatched())
+	    watchedWrite_ = true;
+
+	  // Memory mapped region accessible only with word-size write.
+	  if constexpr (sizeof(T) == 4)
+	    {
+	      if (attrib1.isMemMappedReg())
+		return writeRegister(address, value);
+	    }
+	  else if (attrib1.isMemMappedReg())
+	    return false;
 	}
-      else if (attrib1.isMemMappedReg())
-	return false;
 
+      markModified(address, sizeof(T));
       prevWriteValue_ = *(reinterpret_cast<T*>(data_ + address));
       *(reinterpret_cast<T*>(data_ + address)) = value;
       lastWriteSize_ = sizeof(T);
@@ -453,12 +552,16 @@ namespace WdRiscv
     bool writeByte(size_t address, uint8_t value)
     {
       PageAttribs attrib = getAttrib(address);
-      if (not attrib.isMappedWrite())
-	return false;
-
-      if (attrib.isMemMappedReg())
-	return false;  // Only word access allowed to memory mapped regs.
+      if (not attrib.isPlainWrite())
+	{
+	  // Unmapped or memory mapped reg (word access only).
+	  if (not attrib.isMappedWrite() or attrib.isMemMappedReg())
+	    return false;
+	  if (attrib.isWatched())
+	    watchedWrite_ = true;
+	}
 
+      markModified(address, 1);
       prevWriteValue_ = *(data_ + address);
 
       data_[address] = value;
@@ -507,6 +610,12 @@ namespace WdRiscv
 		     size_t& exitPoint,
 		     std::unordered_map<std::string, ElfSymbol>& symbols);
 
+    /// Same as above but for an ELF file that is already open and
+    /// without collecting the symbols: only the _finish symbol is
+    /// looked up. Only the loadable segments are read from the file.
+    bool loadElfFile(const ElfFile& elf, size_t& entryPoint,
+		     size_t& exitPoint);
+
     /// Return the min and max addresses corresponding to the segments
     /// in the given ELF file. Return true on success and false if
     /// the ELF file does not exist or cannot be read (in which
@@ -516,9 +625,165 @@ namespace WdRiscv
 
     /// Copy data from the given memory into this memory. If the two
     /// memories have different sizes then copy data from location
-    /// zero up to n-1 where n is the minimum of the sizes.
+    /// zero up to n-1 where n is the minimum of the sizes. Only the
+    /// pages of the other memory holding data are copied (see
+    /// getUsedPages).
     void copy(const Memory& other);
 
+    /// Set all bytes of this memory to zero leaving the page
+    /// attributes (memory configuration) unchanged. This restores the
+    /// memory to the state it had right after configuration.
+    void clearData();
+
+    /// Back this memory with huge host pages to reduce host TLB misses
+    /// for programs with large working sets. If explicitPages is
+    /// false, ask the kernel for transparent huge pages. Otherwise
+    /// replace the mapping with one from the hugetlbfs pool, which
+    /// must hold enough pages for the whole memory (see
+    /// /proc/sys/vm/nr_hugepages). Must be called before any data is
+    /// written to this memory. Return true on success and false
+    /// (printing a message and keeping regular pages) on failure.
+    bool enableHugePages(bool explicitPages);
+
+    /// Allocate the host pages of this memory on the given NUMA node
+    /// or, if several nodes are given, interleave them across those
+    /// nodes. The pages of the ICCM and DCCM, used by the harts at
+    /// every access, are bound to the first node. Pages already
+    /// touched are migrated. Return true on success and false
+    /// (printing a message) on failure.
+    bool bindToNumaNodes(const std::vector<unsigned>& nodes);
+
+    /// Take a snapshot of the contents of this memory replacing any
+    /// previous snapshot. Nothing is copied: from now on the original
+    /// contents of a page are saved the first time the page is
+    /// modified, so the cost of a snapshot is proportional to the
+    /// number of pages written after it was taken. Must not be called
+    /// while harts using this memory are running.
+    void takeSnapshot();
+
+    /// Restore the contents of the pages modified since the most
+    /// recent takeSnapshot. Only modified pages are copied. The
+    /// snapshot remains in effect and may be restored again. Return
+    /// false if there is no snapshot. Must not be called while harts
+    /// using this memory are running.
+    bool restoreSnapshot();
+
+    /// Discard the current snapshot (if any) and stop saving pages.
+    void dropSnapshot();
+
+    /// Return true if a snapshot is in effect.
+    bool hasSnapshot() const
+    { return snapshotActive_; }
+
+    /// Return the number of pages modified since the most recent
+    /// takeSnapshot or restoreSnapshot.
+    size_t snapshotDirtyPageCount() const
+    { return savedPages_.size(); }
+
+    /// Start an undo journal: from now on, the original contents of
+    /// the bytes about to be modified are recorded, keeping the most
+    /// recent records holding up to capacity bytes in total (older
+    /// records are dropped). This replaces any previous journal. The
+    /// journal is for a memory used by a single hart. See
+    /// journalPosition and undoJournal.
+    void enableJournal(size_t capacity);
+
+    /// Discard the undo journal and stop recording.
+    void disableJournal();
+
+    /// Return the number of modifications recorded since the journal
+    /// was enabled: the position of the next record.
+    uint64_t journalPosition() const
+    { return journalStart_ + journal_.size(); }
+
+    /// Return the position of the oldest record kept in the journal.
+    uint64_t journalStart() const
+    { return journalStart_; }
+
+    /// Undo the modifications recorded at or after the given position
+    /// (most recent first) and drop their records. Return false
+    /// changing nothing if the position is before journalStart or
+    /// after journalPosition.
+    bool undoJournal(uint64_t position);
+
+    /// Define the number of harts sharing this memory. A count larger
+    /// than 1 enables the bookkeeping needed by harts running
+    /// concurrently in separate threads: granule locks and per-hart
+    /// load reservations.
+    void setHartCount(unsigned count);
+
+    /// Return true if this memory is shared by more than one hart.
+    bool isShared() const
+    { return hartCount_ > 1; }
+
+    /// Callback of a device model reading the memory mapped register
+    /// at the given address into value. Return true on success and
+    /// false to fail the load (access fault).
+    typedef std::function<bool(size_t addr, uint32_t& value)> DeviceReadFn;
+
+    /// Callback of a device model notified of a write of the given
+    /// (masked) value to the memory mapped register at the given
+    /// address. Return true on success and false to fail the store
+    /// (access fault).
+    typedef std::function<bool(size_t addr, uint32_t value)> DeviceWriteFn;
+
+    /// Attach a device model to the given range of memory mapped
+    /// registers. The range must be word aligned and fall in memory
+    /// mapped register pages (see defineMemoryMappedRegisterRegion). A
+    /// load (word) from the range is satisfied by the read callback
+    /// if not empty; otherwise, by the register contents. A store
+    /// updates the register contents (with masking) then calls the
+    /// write callback if not empty. Return true on success and false
+    /// if the range is not valid or overlaps a previously attached
+    /// device.
+    bool defineDevice(size_t addr, size_t size, DeviceReadFn readFn,
+		      DeviceWriteFn writeFn);
+
+    /// Acquire the lock of the 8-byte granule containing the given
+    /// address. Atomic instructions hold this lock for their duration
+    /// and stores to a shared memory hold it around the write making
+    /// atomic instructions indivisible with respect to other harts.
+    void lockGranule(size_t addr)
+    {
+      auto& lock = granuleLocks_[(addr >> 3) & (granuleLockCount_ - 1)];
+      while (lock.exchange(true, std::memory_order_acquire))
+	;
+    }
+
+    /// Release the lock acquired by lockGranule.
+    void unlockGranule(size_t addr)
+    {
+      auto& lock = granuleLocks_[(addr >> 3) & (granuleLockCount_ - 1)];
+      lock.store(false, std::memory_order_release);
+    }
+
+    /// Make a load reservation for the given hart on the granule
+    /// containing the given address, replacing any prior reservation
+    /// of that hart. Caller must hold the granule lock.
+    void makeReservation(unsigned hart, size_t addr)
+    { reservations_[hart].store(addr & ~size_t(7), std::memory_order_relaxed); }
+
+    /// Return true if the given hart holds a reservation on the
+    /// granule containing the given address. Caller must hold the
+    /// granule lock.
+    bool hasReservation(unsigned hart, size_t addr) const
+    {
+      size_t granule = addr & ~size_t(7);
+      return reservations_[hart].load(std::memory_order_relaxed) == granule;
+    }
+
+    /// Cancel the reservations of all harts other than the given one
+    /// on the granule containing the given address. Caller must hold
+    /// the granule lock.
+    void cancelOtherReservations(unsigned hart, size_t addr)
+    {
+      size_t granule = addr & ~size_t(7);
+      for (unsigned i = 0; i < hartCount_; ++i)
+	if (i != hart and
+	    reservations_[i].load(std::memory_order_relaxed) == granule)
+	  reservations_[i].store(noReservation_, std::memory_order_relaxed);
+    }
+
   protected:
 
     /// Same as write but effects not recorded in last-write info.
@@ -550,6 +815,7 @@ namespace WdRiscv
       else if (attrib.isMemMappedReg())
 	return false;
 
+      markModified(address, sizeof(T));
       *(reinterpret_cast<T*>(data_ + address)) = value;
       return true;
     }
@@ -564,6 +830,7 @@ namespace WdRiscv
       if (attrib.isMemMappedReg())
 	return false;  // Only word access allowed to memory mapped regs.
 
+      markModified(address, 1);
       data_[address] = value;
       return true;
     }
@@ -576,6 +843,7 @@ namespace WdRiscv
       if (not attrib.isMapped())
 	return false;
 
+      markModified(address, 1);
       prevWriteValue_ = *(data_ + address);
 
       data_[address] = value;
@@ -633,10 +901,30 @@ namespace WdRiscv
     bool isLastWriteToDccm() const
     { return lastWriteIsDccm_; }
 
+    /// Mark the page containing the given address as watched: Writes
+    /// to it leave the fast path of write and are reported by
+    /// hasWatchedWrite. Return false if address is out of bounds.
+    bool watchPage(size_t addr);
+
+    /// Return true if a write to a watched page (see watchPage)
+    /// succeeded since the most recent clearWatchedWrite. A write
+    /// failing after its page was checked may also be reported: The
+    /// caller is expected to find out the exact cause.
+    bool hasWatchedWrite() const
+    { return watchedWrite_; }
+
+    /// Clear the indication returned by hasWatchedWrite.
+    void clearWatchedWrite()
+    { watchedWrite_ = false; }
+
     /// Return the page size.
     size_t pageSize() const
     { return pageSize_; }
 
+    /// Return the region size.
+    size_t regionSize() const
+    { return regionSize_; }
+
     /// Return the number of the page containing the given address.
     size_t getPageIx(size_t addr) const
     { return addr >> pageShift_; }
@@ -645,7 +933,10 @@ namespace WdRiscv
     PageAttribs getAttrib(size_t addr) const
     {
       size_t ix = getPageIx(addr);
-      return ix < attribs_.size() ? attribs_[ix] : PageAttribs();
+      if (ix >= pageCount_)
+	return PageAttribs();
+      uint32_t bits = pageBits_[ix] ^ regionBits_[ix >> regionPageShift_];
+      return PageAttribs::fromBits(bits);
     }
 
     /// Return start address of page containing given address.
@@ -702,6 +993,12 @@ namespace WdRiscv
     {
       if ((addr & 3) != 0)
 	return false;  // Address must be workd-aligned.
+      if (not devices_.empty())
+	{
+	  const Device* device = findDevice(addr);
+	  if (device and device->readFn)
+	    return device->readFn(addr, value);
+	}
       value = *(reinterpret_cast<const uint32_t*>(data_ + addr));
       value = doRegisterMasking(addr, value);
       return true;
@@ -711,18 +1008,28 @@ namespace WdRiscv
     /// Return masked value.
     uint32_t doRegisterMasking(size_t addr, uint32_t value) const
     {
-      if (masks_.empty())
-	return value;
-      unsigned pageIx = getPageIx(addr);
-      auto& pageMasks = masks_.at(pageIx);
-      if (pageMasks.empty())
-	return value;
-      size_t ix = (addr - getPageStartAddr(addr)) / 4;
-      uint32_t mask = pageMasks.at(ix);
-      value = value & mask;
+      size_t offset = addr - maskBase_;
+      if (offset < flatMasks_.size() * 4)
+	return value & flatMasks_[offset >> 2];
       return value;
     }
 
+    /// Compile the per-page write masks into flatMasks_. Called each
+    /// time a mask is defined (configuration time).
+    void compileRegisterMasks();
+
+    /// Apply the given function (taking a PageAttribs reference) to
+    /// the attributes of the given page.
+    template <typename F>
+    void updatePageAttribs(size_t pageIx, F func);
+
+    /// Apply the given function (taking a PageAttribs reference) to
+    /// the attributes of all the pages of the given region: to the
+    /// default attributes of the region and to those of its pages
+    /// with attributes of their own.
+    template <typename F>
+    void updateRegionAttribs(size_t region, F func);
+
     /// Write a memory mapped register.
     bool writeRegister(size_t addr, uint32_t value)
     {
@@ -731,8 +1038,17 @@ namespace WdRiscv
 
       value = doRegisterMasking(addr, value);
 
+      // A write rejected by a device leaves memory unchanged.
+      if (not devices_.empty())
+	{
+	  const Device* device = findDevice(addr);
+	  if (device and device->writeFn and not device->writeFn(addr, value))
+	    return false;
+	}
+
       PageAttribs attrib = getAttrib(addr);
 
+      markModified(addr, 4);
       prevWriteValue_ = *(reinterpret_cast<uint32_t*>(data_ + addr));
 
       *(reinterpret_cast<uint32_t*>(data_ + addr)) = value;
@@ -743,6 +1059,25 @@ namespace WdRiscv
       return true;
     }
 
+    /// A device model attached to memory mapped registers.
+    struct Device
+    {
+      size_t begin = 0;   // Address of first register.
+      size_t end = 0;     // Address following last register.
+      DeviceReadFn readFn;
+      DeviceWriteFn writeFn;
+    };
+
+    /// Return the device whose range contains the given address or
+    /// null if none.
+    const Device* findDevice(size_t addr) const
+    {
+      for (const auto& device : devices_)
+	if (addr >= device.begin and addr < device.end)
+	  return &device;
+      return nullptr;
+    }
+
     /// Return the number of the 256-mb region containing given address.
     size_t getRegionIndex(size_t addr) const
     { return addr >> regionShift_; }
@@ -762,6 +1097,61 @@ namespace WdRiscv
       return true;
     }
 
+    /// Same as above but fail unless the whole range of size bytes
+    /// starting at addr is within the simulated memory.
+    bool getSimMemAddr(size_t addr, size_t size, size_t& simAddr)
+    {
+      if (addr > size_ or size > size_ - addr)
+	return false;
+      simAddr = reinterpret_cast<size_t>(data_ + addr);
+      return true;
+    }
+
+    /// Must be called before the given range of bytes is modified by
+    /// other than the write/poke methods (e.g. through an address
+    /// obtained with getSimMemAddr) so that the range is covered by
+    /// the current snapshot (see takeSnapshot) and by the undo journal
+    /// (see enableJournal).
+    void markModified(size_t addr, size_t size)
+    {
+      if (trackWrites_)
+	{
+	  if (snapshotActive_)
+	    saveSnapshotPages(addr, size);
+	  if (journalActive_)
+	    journalModification(addr, size);
+	}
+    }
+
+    /// Save the original contents of the not-yet-saved pages
+    /// overlapping the given range. Helper to markModified.
+    void saveSnapshotPages(size_t addr, size_t size);
+
+    /// Record the original contents of the given range in the undo
+    /// journal. Helper to markModified.
+    void journalModification(size_t addr, size_t size);
+
+    /// Set pages to the indices (in increasing order) of the pages
+    /// holding non-zero data. Pages never touched by the simulator
+    /// are skipped without being read.
+    void getUsedPages(std::vector<size_t>& pages) const;
+
+    /// Write the contents of the given pages consecutively to the
+    /// given file. Return true on success.
+    bool writePages(FILE* out, const std::vector<size_t>& pages) const;
+
+    /// Clear this memory (see clearData) then set the contents of the
+    /// given pages (in increasing order) from consecutive pages of
+    /// the given file starting at the given offset. When page size
+    /// and offset allow it, the file is mapped copy-on-write instead
+    /// of being read so that pages are brought in on first
+    /// access. Return true on success.
+    bool loadPages(int fd, uint64_t offset, const std::vector<size_t>& pages);
+
+    /// Set the bytes of the given range to zero releasing the host
+    /// memory backing them.
+    void zeroRange(size_t addr, size_t size);
+
   private:
 
     size_t size_;        // Size of memory in bytes.
@@ -780,16 +1170,74 @@ namespace WdRiscv
     unsigned pageShift_   = 12;        // Shift address by this to get page no.
     unsigned regionShift_ = 28;        // Shift address by this to get region no
 
-    // Attributes are assigned to pages.
-    std::vector<PageAttribs> attribs_;      // One entry per page.
-    std::vector<std::vector<uint32_t> > masks_;  // One vector per page.
+    // Attributes are assigned to pages: Each region has default
+    // attributes (packed, see PageAttribs::bits) and the attributes
+    // of a page are those of its region XOR its entry in pageBits_.
+    // PageBits_ is a lazily zero-filled mapping: Only the entries of
+    // the pages with attributes of their own (ICCM, DCCM and
+    // memory-mapped register areas, listed in ownPages_) are ever
+    // written. Construction and configuration are thus proportional
+    // to the region count and the size of the defined areas, and a
+    // lookup costs two independent loads.
+    std::vector<uint32_t> regionBits_;  // One per region.
+    uint32_t* pageBits_ = nullptr;      // One per page.
+    unsigned regionPageShift_ = 16;     // Shift page no by this to get region.
+    std::set<size_t> ownPages_;
+    // Write masks of memory mapped register pages indexed by page
+    // number. Other pages have no entry. Compiled into flatMasks_: one
+    // mask per word from maskBase_ to the end of the last page with
+    // masks (words of pages without masks get all ones).
+    std::unordered_map<size_t, std::vector<uint32_t>> masks_;
+    std::vector<uint32_t> flatMasks_;
+    size_t maskBase_ = 0;
+
+    std::vector<Device> devices_;   // See defineDevice.
 
     std::vector<size_t> mmrPages_;  // Memory mapped register pages.
 
-    unsigned lastWriteSize_ = 0;    // Size of last write.
-    size_t lastWriteAddr_ = 0;      // Location of most recent write.
-    uint64_t lastWriteValue_ = 0;   // Value of most recent write.
-    uint64_t prevWriteValue_ = 0;   // Value replaced by most recent write.
-    bool lastWriteIsDccm_ = false;  // Last write was to DCCM.
+    // Size, location, new value and replaced value of the most recent
+    // write and whether it was to DCCM. Kept per thread so that harts
+    // sharing this memory from separate threads each see their own
+    // last write.
+    static inline thread_local unsigned lastWriteSize_ = 0;
+    static inline thread_local size_t lastWriteAddr_ = 0;
+    static inline thread_local uint64_t lastWriteValue_ = 0;
+    static inline thread_local uint64_t prevWriteValue_ = 0;
+    static inline thread_local bool lastWriteIsDccm_ = false;
+    static inline thread_local bool watchedWrite_ = false;  // See watchPage.
+
+    // Multi-hart support (see setHartCount).
+    static constexpr size_t noReservation_ = ~size_t(0);
+    static constexpr size_t granuleLockCount_ = 1024;  // Power of 2.
+    unsigned hartCount_ = 1;
+    std::vector<std::atomic<bool>> granuleLocks_;
+    std::vector<std::atomic<size_t>> reservations_;  // One per hart.
+
+    // Snapshot support (see takeSnapshot). The original contents of
+    // page savedPages_[i] are at offset i*pageSize_ in savedData_.
+    bool snapshotActive_ = false;
+    bool trackWrites_ = false;          // snapshotActive_ or journalActive_.
+    std::vector<bool> pageSaved_;       // One entry per page.
+    std::vector<size_t> savedPages_;    // Indices of saved pages.
+    std::vector<uint8_t> savedData_;
+
+    // Undo journal (see enableJournal). Record i (position
+    // journalStart_ + i) holds the original contents of size bytes at
+    // addr, found in the circular buffer journalData_ at offset
+    // dataPos modulo journalCapacity_.
+    struct JournalRecord
+    {
+      size_t addr;
+      size_t size;
+      uint64_t dataPos;
+    };
+    bool journalActive_ = false;
+    std::deque<JournalRecord> journal_;
+    std::unique_ptr<uint8_t[]> journalData_;
+    size_t journalCapacity_ = 0;
+    uint64_t journalStart_ = 0;
+    uint64_t journalDataEnd_ = 0;       // Total bytes recorded.
+
+    bool fileMapped_ = false;   // True if some pages are file mapped.
   };
 }
@@ -0,0 +1,302 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "Metrics.hpp"
+
+
+using namespace WdRiscv;
+
+
+/// Return the time of the steady clock in microseconds.
+static uint64_t
+steadyMicroseconds()
+{
+  using namespace std::chrono;
+  auto now = steady_clock::now().time_since_epoch();
+  return duration_cast<microseconds>(now).count();
+}
+
+
+void
+HartMetrics::sample(uint64_t pc)
+{
+  unsigned min = 0;
+  for (unsigned i = 0; i < WHISPER_METRICS_HOT_PCS; ++i)
+    {
+      if (local_.hotSamples[i] and local_.hotPc[i] == pc)
+	{
+	  local_.hotSamples[i]++;
+	  return;
+	}
+      if (local_.hotSamples[i] < local_.hotSamples[min])
+	min = i;
+    }
+  local_.hotPc[min] = pc;
+  local_.hotSamples[min]++;
+}
+
+
+void
+HartMetrics::publish(uint64_t retired, uint64_t cycles, uint64_t pc,
+		     uint64_t exceptions, uint64_t interrupts)
+{
+  // Rate over a window of at least rateWindow microseconds (over the
+  // whole run until the first window closes) so that an update soon
+  // after the previous one does not give a noisy rate.
+  static constexpr uint64_t rateWindow = 100000;
+  uint64_t time = steadyMicroseconds() - startUs_;
+  if (time >= windowTime_ + rateWindow)
+    {
+      local_.instPerSec = (retired - windowRetired_) * 1000000 /
+	(time - windowTime_);
+      windowTime_ = time;
+      windowRetired_ = retired;
+    }
+  else if (windowTime_ == 0 and time > 0)
+    local_.instPerSec = retired * 1000000 / time;
+
+  sample(pc);
+  local_.time = time;
+  local_.retired = retired;
+  local_.cycles = cycles;
+  local_.pc = pc;
+  local_.exceptions = exceptions;
+  local_.interrupts = interrupts;
+
+  // Seqlock write: Readers retry while the sequence is odd or if it
+  // changed during their copy.
+  uint64_t seq = local_.sequence;
+  __atomic_store_n(&block_->sequence, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  const uint64_t* src = reinterpret_cast<const uint64_t*>(&local_);
+  uint64_t* dst = reinterpret_cast<uint64_t*>(block_);
+  for (unsigned i = 1; i < sizeof(local_) / sizeof(uint64_t); ++i)
+    __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+
+  local_.sequence = seq + 2;
+  __atomic_store_n(&block_->sequence, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+MetricsBlock::~MetricsBlock()
+{
+  if (server_.joinable())
+    {
+      stop_ = true;
+      server_.join();
+    }
+  if (socket_ >= 0)
+    close(socket_);
+  if (map_)
+    munmap(map_, mapSize_);
+}
+
+
+bool
+MetricsBlock::create(const std::string& path, unsigned hartCount)
+{
+  mapSize_ = sizeof(WhisperMetricsHeader) +
+    hartCount * sizeof(WhisperHartMetrics);
+
+  int fd = -1;
+  if (not path.empty())
+    {
+      fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0 or ftruncate(fd, mapSize_) != 0)
+	{
+	  std::cerr << "Failed to create metrics file '" << path << "': "
+		    << strerror(errno) << '\n';
+	  if (fd >= 0)
+	    close(fd);
+	  return false;
+	}
+      map_ = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+    }
+  else
+    map_ = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (map_ == MAP_FAILED)
+    {
+      map_ = nullptr;
+      std::cerr << "Failed to map metrics blocks: " << strerror(errno) << '\n';
+      return false;
+    }
+
+  memset(map_, 0, mapSize_);
+  header_ = static_cast<WhisperMetricsHeader*>(map_);
+  blocks_ = reinterpret_cast<WhisperHartMetrics*>(header_ + 1);
+
+  using namespace std::chrono;
+  auto epoch = system_clock::now().time_since_epoch();
+  startUs_ = steadyMicroseconds();
+
+  header_->version = WHISPER_METRICS_VERSION;
+  header_->hartCount = hartCount;
+  header_->pid = getpid();
+  header_->startTime = duration_cast<microseconds>(epoch).count();
+  __atomic_store_n(&header_->magic, WHISPER_METRICS_MAGIC, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+std::string
+MetricsBlock::text() const
+{
+  std::ostringstream out;
+
+  struct Metric
+  {
+    const char* name;
+    const char* type;
+    const char* help;
+    uint64_t WhisperHartMetrics::*field;
+  };
+
+  static const Metric metrics[] = {
+    { "whisper_retired_instructions_total", "counter", "Retired instructions.",
+      &WhisperHartMetrics::retired },
+    { "whisper_cycles_total", "counter", "Cycle count (MCYCLE).",
+      &WhisperHartMetrics::cycles },
+    { "whisper_exceptions_total", "counter", "Exceptions taken.",
+      &WhisperHartMetrics::exceptions },
+    { "whisper_interrupts_total", "counter", "Interrupts taken.",
+      &WhisperHartMetrics::interrupts },
+    { "whisper_instructions_per_second", "gauge",
+      "Retired instructions per second (recent).",
+      &WhisperHartMetrics::instPerSec },
+    { "whisper_pc", "gauge", "Program counter.", &WhisperHartMetrics::pc }
+  };
+
+  std::vector<WhisperHartMetrics> copies(header_->hartCount);
+  for (unsigned i = 0; i < copies.size(); ++i)
+    whisperMetricsRead(&blocks_[i], &copies[i]);
+
+  for (const auto& metric : metrics)
+    {
+      out << "# HELP " << metric.name << ' ' << metric.help << '\n'
+	  << "# TYPE " << metric.name << ' ' << metric.type << '\n';
+      for (unsigned i = 0; i < copies.size(); ++i)
+	out << metric.name << "{hart=\"" << i << "\"} "
+	    << copies[i].*metric.field << '\n';
+    }
+
+  out << "# HELP whisper_hot_pc_samples Program counters most often seen "
+      << "at updates.\n"
+      << "# TYPE whisper_hot_pc_samples gauge\n";
+  for (unsigned i = 0; i < copies.size(); ++i)
+    for (unsigned j = 0; j < WHISPER_METRICS_HOT_PCS; ++j)
+      if (copies[i].hotSamples[j])
+	out << "whisper_hot_pc_samples{hart=\"" << i << "\",pc=\"0x"
+	    << std::hex << copies[i].hotPc[j] << std::dec << "\"} "
+	    << copies[i].hotSamples[j] << '\n';
+
+  double uptime = double(steadyMicroseconds() - startUs_) * 1e-6;
+  out << "# HELP whisper_uptime_seconds Time since the start of the run.\n"
+      << "# TYPE whisper_uptime_seconds gauge\n"
+      << "whisper_uptime_seconds " << uptime << '\n';
+  return out.str();
+}
+
+
+bool
+MetricsBlock::serve(unsigned port)
+{
+  socket_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (socket_ < 0)
+    {
+      std::cerr << "Failed to create metrics socket: " << strerror(errno)
+		<< '\n';
+      return false;
+    }
+
+  int one = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(socket_, (sockaddr*) &addr, sizeof(addr)) < 0 or
+      listen(socket_, 8) < 0)
+    {
+      std::cerr << "Failed to listen on metrics port " << port << ": "
+		<< strerror(errno) << '\n';
+      return false;
+    }
+
+  server_ = std::thread([this] () { serverLoop(); });
+  return true;
+}
+
+
+void
+MetricsBlock::serverLoop()
+{
+  while (not stop_)
+    {
+      // Wake up periodically to notice a stop request.
+      pollfd pfd = { socket_, POLLIN, 0 };
+      if (poll(&pfd, 1, 200) <= 0)
+	continue;
+
+      int conn = accept(socket_, nullptr, nullptr);
+      if (conn < 0)
+	continue;
+
+      // Any request gets the metrics: Read (and ignore) it first.
+      char request[1024];
+      pollfd cfd = { conn, POLLIN, 0 };
+      if (poll(&cfd, 1, 1000) > 0)
+	if (read(conn, request, sizeof(request)) < 0)
+	  {
+	    close(conn);
+	    continue;
+	  }
+
+      std::string body = text();
+      std::ostringstream reply;
+      reply << "HTTP/1.0 200 OK\r\n"
+	    << "Content-Type: text/plain; version=0.0.4\r\n"
+	    << "Content-Length: " << body.size() << "\r\n"
+	    << "Connection: close\r\n\r\n" << body;
+      std::string data = reply.str();
+      for (size_t done = 0; done < data.size(); )
+	{
+	  ssize_t n = write(conn, data.data() + done, data.size() - done);
+	  if (n <= 0)
+	    break;
+	  done += n;
+	}
+      close(conn);
+    }
+}
@@ -0,0 +1,112 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "WhisperMetrics.h"
+
+
+namespace WdRiscv
+{
+
+  /// Writer of the metrics block of a hart (see WhisperMetrics.h).
+  /// Owned by the thread running the hart.
+  class HartMetrics
+  {
+  public:
+
+    /// Retired instructions between updates.
+    static constexpr uint64_t period = 65536;
+
+    /// Constructor: Update the given block. StartUs is the start time
+    /// of the run in microseconds of the steady clock.
+    HartMetrics(WhisperHartMetrics* block, uint64_t startUs)
+      : block_(block), startUs_(startUs)
+    { }
+
+    /// Update the block with the given values sampling the given
+    /// program counter into the hot PC table.
+    void publish(uint64_t retired, uint64_t cycles, uint64_t pc,
+		 uint64_t exceptions, uint64_t interrupts);
+
+  private:
+
+    /// Count one sample of the given pc in the hot table (space-saving
+    /// top-k: a new pc replaces the least sampled entry and inherits
+    /// its count).
+    void sample(uint64_t pc);
+
+    WhisperHartMetrics* block_ = nullptr;
+    WhisperHartMetrics local_ = {};   // Contents of the block.
+    uint64_t startUs_ = 0;
+    uint64_t windowTime_ = 0;      // Start of instruction rate window.
+    uint64_t windowRetired_ = 0;   // Retired count at windowTime_.
+  };
+
+
+  /// The metrics blocks of the harts of a run mapped from a file (or
+  /// from anonymous memory) and, optionally, served over HTTP.
+  class MetricsBlock
+  {
+  public:
+
+    MetricsBlock() = default;
+
+    MetricsBlock(const MetricsBlock&) = delete;
+    MetricsBlock& operator=(const MetricsBlock&) = delete;
+
+    /// Stop serving and unmap the blocks. The file is kept.
+    ~MetricsBlock();
+
+    /// Create the blocks of the given number of harts in the given
+    /// file (in process memory if the path is empty). Return true on
+    /// success and false (printing a message) on failure.
+    bool create(const std::string& path, unsigned hartCount);
+
+    /// Return a writer for the block of the given hart.
+    HartMetrics hart(unsigned ix) const
+    { return HartMetrics(&blocks_[ix], startUs_); }
+
+    /// Serve the metrics as text (Prometheus exposition format) to
+    /// HTTP GET requests on the given TCP port from a background
+    /// thread. Return true on success and false (printing a message)
+    /// on failure.
+    bool serve(unsigned port);
+
+    /// Return the metrics in Prometheus exposition format.
+    std::string text() const;
+
+  private:
+
+    void serverLoop();
+
+    void* map_ = nullptr;
+    size_t mapSize_ = 0;
+    WhisperMetricsHeader* header_ = nullptr;
+    WhisperHartMetrics* blocks_ = nullptr;
+    uint64_t startUs_ = 0;
+
+    int socket_ = -1;
+    std::atomic<bool> stop_ = false;
+    std::thread server_;
+  };
+}
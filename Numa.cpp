@@ -0,0 +1,160 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "Numa.hpp"
+
+
+using namespace WdRiscv;
+
+
+/// Parse a list such as 0-3,8,10-11 into values. Return true on
+/// success.
+static bool
+parseList(const std::string& spec, std::vector<unsigned>& values)
+{
+  std::istringstream in(spec);
+  std::string item;
+  while (std::getline(in, item, ','))
+    {
+      if (item.empty() or item == "\n")
+	continue;
+      char* end = nullptr;
+      unsigned long first = strtoul(item.c_str(), &end, 10);
+      unsigned long last = first;
+      if (end == item.c_str())
+	return false;
+      if (*end == '-')
+	{
+	  const char* next = end + 1;
+	  last = strtoul(next, &end, 10);
+	  if (end == next or last < first)
+	    return false;
+	}
+      if (*end != 0 and *end != '\n')
+	return false;
+      for (unsigned long v = first; v <= last; ++v)
+	values.push_back(v);
+    }
+  return true;
+}
+
+
+/// Set values to the contents of the given sysfs list file (such as
+/// the online nodes or the CPUs of a node). Return true on success.
+static bool
+readSysList(const std::string& path, std::vector<unsigned>& values)
+{
+  std::ifstream in(path);
+  std::string line;
+  if (not in or not std::getline(in, line))
+    return false;
+  return parseList(line, values);
+}
+
+
+bool
+WdRiscv::parseNumaNodes(const std::string& spec, std::vector<unsigned>& nodes)
+{
+  nodes.clear();
+  if (not parseList(spec, nodes) or nodes.empty())
+    {
+      std::cerr << "Invalid NUMA node list: " << spec << '\n';
+      return false;
+    }
+
+  std::vector<unsigned> online;
+  if (not readSysList("/sys/devices/system/node/online", online))
+    {
+      std::cerr << "Host has no NUMA support (no online node list)\n";
+      return false;
+    }
+
+  for (auto node : nodes)
+    if (std::find(online.begin(), online.end(), node) == online.end())
+      {
+	std::cerr << "NUMA node " << node << " is not online\n";
+	return false;
+      }
+  return true;
+}
+
+
+bool
+WdRiscv::bindThreadToNumaNode(unsigned node)
+{
+  std::vector<unsigned> cpus;
+  std::string path = "/sys/devices/system/node/node" + std::to_string(node) +
+    "/cpulist";
+  if (not readSysList(path, cpus) or cpus.empty())
+    {
+      std::cerr << "Failed to get the CPUs of NUMA node " << node << '\n';
+      return false;
+    }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus)
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+
+  // Pid 0: The calling thread.
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+      std::cerr << "Failed to bind thread to NUMA node " << node << ": "
+		<< strerror(errno) << '\n';
+      return false;
+    }
+  return true;
+}
+
+
+bool
+WdRiscv::bindMemoryToNumaNodes(void* addr, size_t size,
+			       const std::vector<unsigned>& nodes)
+{
+  constexpr unsigned bits = 8*sizeof(unsigned long);
+  std::vector<unsigned long> mask;
+  for (auto node : nodes)
+    {
+      if (node / bits >= mask.size())
+	mask.resize(node / bits + 1);
+      mask.at(node / bits) |= 1ul << (node % bits);
+    }
+  if (mask.empty())
+    return true;
+
+  int mode = nodes.size() > 1 ? MPOL_INTERLEAVE : MPOL_BIND;
+  unsigned long maxNode = mask.size() * bits + 1;
+  if (syscall(SYS_mbind, addr, size, mode, mask.data(), maxNode,
+	      MPOL_MF_MOVE) != 0)
+    {
+      std::cerr << "Failed to bind memory to NUMA node(s): "
+		<< strerror(errno) << '\n';
+      return false;
+    }
+  return true;
+}
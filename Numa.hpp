@@ -0,0 +1,51 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  // Placement of the simulator threads and of the simulated memory on
+  // the NUMA nodes of the host. These use the Linux system calls
+  // directly (no libnuma). On a host without NUMA support they fail
+  // with a message.
+
+  /// Parse a comma separated list of NUMA node numbers (ranges such as
+  /// 0-3 allowed) into nodes. Return true on success and false
+  /// (printing a message) if the list is malformed or names a node
+  /// that is not online.
+  bool parseNumaNodes(const std::string& spec, std::vector<unsigned>& nodes);
+
+  /// Restrict the calling thread to the CPUs of the given node. Return
+  /// true on success and false (printing a message) on failure.
+  bool bindThreadToNumaNode(unsigned node);
+
+  /// Allocate the host pages of the given address range (which must be
+  /// host-page aligned) on the given node or, if more than one node is
+  /// given, interleaved across the given nodes. Pages already touched
+  /// are migrated. Return true on success and false (printing a
+  /// message) on failure.
+  bool bindMemoryToNumaNodes(void* addr, size_t size,
+			     const std::vector<unsigned>& nodes);
+}
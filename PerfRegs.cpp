@@ -23,10 +23,11 @@
 using namespace WdRiscv;
 
 
-PerfRegs::PerfRegs(unsigned numCounters)
+PerfRegs::PerfRegs(uint64_t* counters, unsigned numCounters)
+  : counters_(counters)
 {
-  // 29 counters: MHPMCOUNTER3 to MHPMCOUNTER31
-  counters_.resize(29);
+  for (unsigned i = 0; i < maxCounters; ++i)
+    counters_[i] = 0;
 
   config(numCounters);
 }
@@ -35,13 +36,37 @@ PerfRegs::PerfRegs(unsigned numCounters)
 void
 PerfRegs::config(unsigned numCounters)
 {
-  assert(numCounters < counters_.size());
+  assert(numCounters < maxCounters);
 
   eventOfCounter_.resize(numCounters);
 
   unsigned numEvents = unsigned(EventNumber::_End);
   countersOfEvent_.resize(numEvents);
-  modified_.resize(numEvents);
+  events_.resize(numEvents);
+  synced_.resize(numCounters);
+  discardEvents();
+}
+
+
+void
+PerfRegs::applyEvents() const
+{
+  for (size_t i = 0; i < eventOfCounter_.size(); ++i)
+    {
+      uint64_t count = events_[size_t(eventOfCounter_[i])];
+      counters_[i] += count - synced_[i];
+      synced_[i] = count;
+    }
+  pending_ = false;
+}
+
+
+void
+PerfRegs::discardEvents()
+{
+  for (size_t i = 0; i < eventOfCounter_.size(); ++i)
+    synced_[i] = events_[size_t(eventOfCounter_[i])];
+  pending_ = false;
 }
 
 
@@ -54,6 +79,8 @@ PerfRegs::assignEventToCounter(EventNumber event, unsigned counter)
   if (size_t(event) >= countersOfEvent_.size())
     return false;
 
+  sync();
+
   // Disassociate counter from its previous event.
   EventNumber prevEvent = eventOfCounter_.at(counter);
   if (prevEvent != EventNumber::None)
@@ -66,6 +93,7 @@ PerfRegs::assignEventToCounter(EventNumber event, unsigned counter)
     countersOfEvent_.at(size_t(event)).push_back(counter);
 
   eventOfCounter_.at(counter) = event;
+  synced_.at(counter) = events_.at(size_t(event));
   return true;
 }
 
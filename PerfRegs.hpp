@@ -105,6 +105,9 @@ namespace WdRiscv
 
   /// Model a set of consecutive performance counters. Theses
   /// correspond to a set of consecutive performance counter CSR.
+  /// Events are tallied per event number (see updateCounters) and
+  /// the counters are brought up to date from the tallies only when
+  /// observed (see sync).
   class PerfRegs
   {
   public:
@@ -114,8 +117,14 @@ namespace WdRiscv
     friend class CsRegs<uint32_t>;
     friend class CsRegs<uint64_t>;
 
-    /// Define numCounters counters. These correspond to mhp
-    PerfRegs(unsigned numCounters = 0);
+    /// Count of counters: MHPMCOUNTER3 to MHPMCOUNTER31.
+    static constexpr unsigned maxCounters = 29;
+
+    /// Define numCounters counters. These correspond to mhp. The
+    /// counter values are kept in the given array (maxCounters
+    /// entries, part of the architectural state block of the hart)
+    /// which must outlive this object.
+    PerfRegs(uint64_t* counters, unsigned numCounters = 0);
 
     /// Configure numCounters counters initialized to zero.  This
     /// should not be used if some CSR registers are tied to the
@@ -123,21 +132,27 @@ namespace WdRiscv
     void config(unsigned numCounters);
 
     /// Update (count-up) all the performance counters currently
-    /// associated with the given event.
+    /// associated with the given event. The event is tallied: the
+    /// counters see it at the next sync.
     bool updateCounters(EventNumber event)
     {
       size_t eventIx = size_t(event);
-      if (eventIx >= countersOfEvent_.size())
+      if (eventIx >= events_.size())
 	return false;
-      const auto& counterIndices = countersOfEvent_.at(eventIx);
-      for (auto counterIx : counterIndices)
-	{
-	  counters_.at(counterIx)++;
-	  modified_.at(counterIx) = true;
-	}
+      events_[eventIx]++;
+      pending_ = true;
       return true;
     }
 
+    /// Add to the counters the events tallied since the last
+    /// sync. This must be done before the counters are read or
+    /// written.
+    void sync() const
+    {
+      if (pending_)
+	applyEvents();
+    }
+
     /// Associate given event number with given counter.
     /// Subsequent calls to updatePerofrmanceCounters(en) will cause
     /// given counter to count up by 1. Return true on success. Return
@@ -146,25 +161,23 @@ namespace WdRiscv
 
   protected:
 
-    /// Unmark registers marked as modified by current instruction. This
-    /// is done at the end of each instruction.
-    void clearModified()
+    /// Drop the events tallied for the given counter since the last
+    /// sync.
+    void discardEvents(unsigned counter)
     {
-      for (auto& m : modified_)
-	m = false;
+      if (counter < eventOfCounter_.size())
+	synced_[counter] = events_[size_t(eventOfCounter_[counter])];
     }
 
-    /// Return true if given number corresponds to a valid performance
-    /// counter and if that counter was modified by the current
-    /// instruction.
-    bool isModified(unsigned ix)
-    {
-      if (ix < modified_.size()) return modified_[ix];
-      return false;
-    }
+    /// Drop all the events tallied since the last sync (counters were
+    /// reset or restored).
+    void discardEvents();
 
   private:
 
+    /// Add the tallied events to the counters.
+    void applyEvents() const;
+
     // Map counter index to event currently associated with counter.
     std::vector<EventNumber> eventOfCounter_;
 
@@ -172,7 +185,12 @@ namespace WdRiscv
     // counters currently associated with that event.
     std::vector< std::vector<unsigned> > countersOfEvent_;
 
-    std::vector<uint64_t> counters_;
-    std::vector<unsigned> modified_;
+    // Counter values (see constructor): the CSRs are tied to
+    // these. Sync brings them up to date on a read.
+    uint64_t* counters_ = nullptr;
+
+    std::vector<uint64_t> events_;          // Tally of each event.
+    mutable std::vector<uint64_t> synced_;  // Tally seen by each counter.
+    mutable bool pending_ = false;          // Tally changed since sync.
   };
 }
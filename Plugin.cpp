@@ -0,0 +1,108 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <iostream>
+#include <dlfcn.h>
+#include "Plugin.hpp"
+
+
+using namespace WdRiscv;
+
+
+PluginSet::~PluginSet()
+{
+  for (auto& plugin : plugins_)
+    if (plugin->handle)
+      dlclose(plugin->handle);
+}
+
+
+bool
+PluginSet::load(const std::string& path, const std::string& arg,
+		unsigned xlen)
+{
+  // A path without a slash would be searched in the library path.
+  std::string file = path;
+  if (file.find('/') == std::string::npos)
+    file = "./" + file;
+
+  void* handle = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (not handle)
+    {
+      std::cerr << "Failed to load plugin '" << path << "': " << dlerror()
+		<< '\n';
+      return false;
+    }
+
+  auto init = reinterpret_cast<WhisperPluginInitFn>(dlsym(handle,
+							  "whisperPluginInit"));
+  if (not init)
+    {
+      std::cerr << "Plugin '" << path << "' does not define "
+		<< "whisperPluginInit\n";
+      dlclose(handle);
+      return false;
+    }
+
+  auto plugin = std::make_unique<Plugin>();
+  plugin->handle = handle;
+  if (not init(WHISPER_PLUGIN_VERSION, arg.c_str(), xlen, &plugin->hooks))
+    {
+      std::cerr << "Plugin '" << path << "' failed to initialize\n";
+      dlclose(handle);
+      return false;
+    }
+
+  addPlugin(std::move(plugin));
+  return true;
+}
+
+
+void
+PluginSet::add(const WhisperPluginHooks& hooks)
+{
+  auto plugin = std::make_unique<Plugin>();
+  plugin->hooks = hooks;
+  addPlugin(std::move(plugin));
+}
+
+
+void
+PluginSet::addPlugin(std::unique_ptr<Plugin> plugin)
+{
+  // Hooks are kept by address: Plugin objects are never moved.
+  const WhisperPluginHooks* hooks = &plugin->hooks;
+  plugins_.push_back(std::move(plugin));
+  if (hooks->retire)
+    retire_.push_back(hooks);
+  if (hooks->memAccess)
+    memAccess_.push_back(hooks);
+  if (hooks->trap)
+    trap_.push_back(hooks);
+  if (hooks->csrWrite)
+    csrWrite_.push_back(hooks);
+}
+
+
+void
+PluginSet::finish()
+{
+  for (auto& plugin : plugins_)
+    if (plugin->hooks.finish)
+      plugin->hooks.finish(plugin->hooks.context);
+}
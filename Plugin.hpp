@@ -0,0 +1,118 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "WhisperPlugin.h"
+
+
+namespace WdRiscv
+{
+
+  /// The instrumentation plugins of a run (see WhisperPlugin.h): The
+  /// hooks of all the loaded plugins grouped by kind so that a hook
+  /// point only visits the plugins that use it. Shared by the harts of
+  /// a run.
+  class PluginSet
+  {
+  public:
+
+    PluginSet() = default;
+
+    PluginSet(const PluginSet&) = delete;
+    PluginSet& operator=(const PluginSet&) = delete;
+
+    /// Unload the plugins.
+    ~PluginSet();
+
+    /// Load the plugin in the given shared object and initialize it
+    /// with the given argument for harts of the given xlen. Return
+    /// true on success and false (printing a message) on failure.
+    bool load(const std::string& path, const std::string& arg,
+	      unsigned xlen);
+
+    /// Add the given hooks of a plugin linked with whisper (the
+    /// context and the functions must outlive this object).
+    void add(const WhisperPluginHooks& hooks);
+
+    /// Return true if no plugin is loaded.
+    bool empty() const
+    { return plugins_.empty(); }
+
+    /// Return true if a plugin has a retire hook.
+    bool hasRetire() const
+    { return not retire_.empty(); }
+
+    /// Return true if a plugin has a memory access hook.
+    bool hasMemAccess() const
+    { return not memAccess_.empty(); }
+
+    /// Call the retire hooks.
+    void retire(unsigned hart, uint64_t count, uint64_t pc, uint32_t inst)
+    {
+      for (const auto& hooks : retire_)
+	hooks->retire(hooks->context, hart, count, pc, inst);
+    }
+
+    /// Call the memory access hooks.
+    void memAccess(unsigned hart, uint64_t pc, uint64_t address,
+		   unsigned size, unsigned type)
+    {
+      for (const auto& hooks : memAccess_)
+	hooks->memAccess(hooks->context, hart, pc, address, size, type);
+    }
+
+    /// Call the trap hooks.
+    void trap(unsigned hart, uint64_t pc, uint64_t cause, bool interrupt)
+    {
+      for (const auto& hooks : trap_)
+	hooks->trap(hooks->context, hart, pc, cause, interrupt);
+    }
+
+    /// Call the CSR write hooks.
+    void csrWrite(unsigned hart, uint64_t pc, unsigned csr, uint64_t value)
+    {
+      for (const auto& hooks : csrWrite_)
+	hooks->csrWrite(hooks->context, hart, pc, csr, value);
+    }
+
+    /// Call the finish hooks (end of run).
+    void finish();
+
+  private:
+
+    struct Plugin
+    {
+      void* handle = nullptr;   // Null if linked with whisper (see add).
+      WhisperPluginHooks hooks = {};
+    };
+
+    /// Take ownership of the given plugin and register its hooks.
+    void addPlugin(std::unique_ptr<Plugin> plugin);
+
+    std::vector<std::unique_ptr<Plugin>> plugins_;
+    std::vector<const WhisperPluginHooks*> retire_;
+    std::vector<const WhisperPluginHooks*> memAccess_;
+    std::vector<const WhisperPluginHooks*> trap_;
+    std::vector<const WhisperPluginHooks*> csrWrite_;
+  };
+}
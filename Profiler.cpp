@@ -0,0 +1,257 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cinttypes>
+#include "Profiler.hpp"
+
+
+using namespace WdRiscv;
+
+
+PcProfiler::PcProfiler(const SymbolIndex& symbols, bool rv64)
+  : rv64_(rv64), symbols_(symbols), funcNames_(symbols.names())
+{
+  funcNames_.at(0) = "[unknown]";
+
+  // Root of the calling context tree has an empty range: first
+  // recorded instruction creates a child.
+  nodes_.push_back(Node());
+  setNode(0);
+}
+
+
+void
+PcProfiler::selectPage(uint64_t page)
+{
+  auto& counts = counts_[page];
+  if (counts.empty())
+    counts.resize(size_t(1) << (pageShift_ - 1));
+  lastPage_ = page;
+  lastCounts_ = counts.data();
+}
+
+
+unsigned
+PcProfiler::child(const Range& range)
+{
+  for (unsigned ix : nodes_[node_].children)
+    if (nodes_[ix].begin == range.begin)
+      return ix;
+
+  Node node;
+  node.func = range.symbol;
+  node.parent = node_;
+  node.begin = range.begin;
+  node.end = range.end;
+  nodes_.push_back(node);
+  unsigned ix = nodes_.size() - 1;
+  nodes_[node_].children.push_back(ix);
+  return ix;
+}
+
+
+void
+PcProfiler::enter(uint64_t pc)
+{
+  Transfer transfer = pending_;
+  pending_ = Transfer::None;
+
+  if (transfer == Transfer::Call)
+    {
+      const Range& range = findRange(pc);
+      uint64_t edge = (uint64_t(nodes_[node_].func) << 32) | range.symbol;
+      edges_[edge]++;
+      if (depth_ >= maxDepth_)
+	{
+	  overflow_++;
+	  return;
+	}
+      setNode(child(range));
+      depth_++;
+      return;
+    }
+
+  if (transfer == Transfer::Return)
+    {
+      if (overflow_)
+	overflow_--;
+      else if (depth_ > 1)
+	{
+	  setNode(nodes_[node_].parent);
+	  depth_--;
+	}
+      if (pc >= begin_ and pc < end_)
+	return;
+    }
+
+  // Control went to another function without a call: Go back to the
+  // innermost caller containing pc (e.g. return from trap handler or
+  // from tail call) or else enter the function (trap, tail call).
+  unsigned depth = depth_;
+  for (unsigned ix = node_; ix != 0; ix = nodes_[ix].parent, --depth)
+    if (pc >= nodes_[ix].begin and pc < nodes_[ix].end)
+      {
+	setNode(ix);
+	depth_ = depth;
+	overflow_ = 0;
+	return;
+      }
+
+  if (depth_ < maxDepth_)
+    {
+      setNode(child(findRange(pc)));
+      depth_++;
+    }
+}
+
+
+std::string
+PcProfiler::location(uint64_t pc) const
+{
+  const Range& range = findRange(pc);
+  if (range.symbol == 0)
+    return funcNames_[0];
+  char offset[32];
+  snprintf(offset, sizeof(offset), "+0x%" PRIx64, pc - range.begin);
+  return funcNames_[range.symbol] + offset;
+}
+
+
+void
+PcProfiler::report(FILE* out, unsigned topN) const
+{
+  size_t funcCount = funcNames_.size();
+  std::vector<uint64_t> exclusive(funcCount), inclusive(funcCount);
+
+  // Children are created after their parent: Accumulate subtree
+  // counts from the last node to the first.
+  std::vector<uint64_t> subtree(nodes_.size());
+  for (size_t ix = nodes_.size(); ix > 1; --ix)
+    {
+      const Node& node = nodes_[ix-1];
+      subtree[ix-1] += node.self;
+      subtree[node.parent] += subtree[ix-1];
+      exclusive[node.func] += node.self;
+    }
+
+  // Inclusive count of a function: subtrees of its outermost nodes
+  // (recursive calls are not counted twice).
+  std::vector<unsigned> active(funcCount);
+  std::vector<std::pair<unsigned, bool>> stack;  // Node, children done.
+  for (unsigned ix : nodes_[0].children)
+    stack.push_back({ix, false});
+  while (not stack.empty())
+    {
+      auto [ix, done] = stack.back();
+      stack.pop_back();
+      const Node& node = nodes_[ix];
+      if (done)
+	{
+	  active[node.func]--;
+	  continue;
+	}
+      if (active[node.func]++ == 0)
+	inclusive[node.func] += subtree[ix];
+      stack.push_back({ix, true});
+      for (unsigned child : node.children)
+	stack.push_back({child, false});
+    }
+
+  double percent = total_ ? 100.0 / double(total_) : 0;
+  fprintf(out, "Instructions: %" PRIu64 "\n", total_);
+
+  std::vector<unsigned> funcs;
+  for (unsigned f = 0; f < funcCount; ++f)
+    if (inclusive[f])
+      funcs.push_back(f);
+  std::sort(funcs.begin(), funcs.end(), [&] (unsigned a, unsigned b) {
+      if (exclusive[a] != exclusive[b]) return exclusive[a] > exclusive[b];
+      return inclusive[a] > inclusive[b]; });
+  if (funcs.size() > topN)
+    funcs.resize(topN);
+
+  fprintf(out, "\nFunctions (exclusive: in function, inclusive: in function"
+	  " and callees):\n");
+  fprintf(out, "%16s %7s %16s %7s  %s\n", "Exclusive", "%", "Inclusive", "%",
+	  "Function");
+  for (unsigned f : funcs)
+    fprintf(out, "%16" PRIu64 " %7.2f %16" PRIu64 " %7.2f  %s\n",
+	    exclusive[f], exclusive[f]*percent, inclusive[f],
+	    inclusive[f]*percent, funcNames_[f].c_str());
+
+  std::vector<std::pair<uint64_t, uint64_t>> edges(edges_.begin(),
+						   edges_.end());
+  std::sort(edges.begin(), edges.end(), [] (const auto& a, const auto& b) {
+      if (a.second != b.second) return a.second > b.second;
+      return a.first < b.first; });
+  if (edges.size() > topN)
+    edges.resize(topN);
+
+  fprintf(out, "\nCalls:\n");
+  fprintf(out, "%16s  %s\n", "Count", "Caller -> Callee");
+  for (const auto& [edge, count] : edges)
+    fprintf(out, "%16" PRIu64 "  %s -> %s\n", count,
+	    funcNames_[edge >> 32].c_str(), funcNames_[uint32_t(edge)].c_str());
+
+  std::vector<std::pair<uint64_t, uint64_t>> pcs;  // PC and count.
+  for (const auto& [page, counts] : counts_)
+    for (size_t i = 0; i < counts.size(); ++i)
+      if (counts[i])
+	pcs.push_back({(page << pageShift_) + 2*i, counts[i]});
+  std::sort(pcs.begin(), pcs.end(), [] (const auto& a, const auto& b) {
+      if (a.second != b.second) return a.second > b.second;
+      return a.first < b.first; });
+  if (pcs.size() > topN)
+    pcs.resize(topN);
+
+  fprintf(out, "\nHot PCs:\n");
+  int width = rv64_ ? 16 : 8;
+  fprintf(out, "%*s %16s %7s  %s\n", width + 2, "PC", "Count", "%",
+	  "Location");
+  for (const auto& [pc, count] : pcs)
+    fprintf(out, "0x%0*" PRIx64 " %16" PRIu64 " %7.2f  %s\n", width, pc,
+	    count, count*percent, location(pc).c_str());
+}
+
+
+void
+PcProfiler::writeFoldedStacks(FILE* out) const
+{
+  std::string path;
+  std::vector<std::pair<unsigned, size_t>> stack;  // Node, parent path size.
+  for (unsigned ix : nodes_[0].children)
+    stack.push_back({ix, 0});
+  while (not stack.empty())
+    {
+      auto [ix, pathSize] = stack.back();
+      stack.pop_back();
+      const Node& node = nodes_[ix];
+
+      path.resize(pathSize);
+      if (pathSize)
+	path += ';';
+      path += funcNames_[node.func];
+
+      if (node.self)
+	fprintf(out, "%s %" PRIu64 "\n", path.c_str(), node.self);
+
+      for (unsigned child : node.children)
+	stack.push_back({child, path.size()});
+    }
+}
@@ -0,0 +1,181 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "SymbolIndex.hpp"
+
+
+namespace WdRiscv
+{
+
+  /// Execution profile of a target program by program counter and by
+  /// function. Functions come from the ELF symbols of the program. Each
+  /// retired instruction is passed to record which counts it against
+  /// its PC and against the current node of a calling context tree
+  /// maintained by following calls (jal/jalr writing ra or t0),
+  /// returns (jalr reading ra or t0 without link) and control
+  /// transfers into other functions (traps, tail calls). From these,
+  /// the profiler reports the exclusive and inclusive instruction
+  /// counts of each function and the call graph edges, and writes the
+  /// stacks in the folded format of flamegraph.pl.
+  class PcProfiler
+  {
+  public:
+
+    /// Constructor: Attribute PCs to the functions of the given
+    /// symbol index. PCs without a symbol are attributed to
+    /// "[unknown]". Rv64 selects the meaning of compressed
+    /// instructions (c.jal is rv32 only).
+    PcProfiler(const SymbolIndex& symbols, bool rv64);
+
+    /// Count the retired instruction inst at the given PC.
+    void record(uint64_t pc, uint32_t inst)
+    {
+      uint64_t page = pc >> pageShift_;
+      if (page != lastPage_)
+	selectPage(page);
+      lastCounts_[(pc & pageMask_) >> 1]++;
+
+      if (pending_ != Transfer::None or pc < begin_ or pc >= end_)
+	enter(pc);
+      nodes_[node_].self++;
+
+      pending_ = classify(inst);
+      total_++;
+    }
+
+    /// Return the number of recorded instructions.
+    uint64_t total() const
+    { return total_; }
+
+    /// Write the report (functions sorted by exclusive count, call
+    /// edges and hottest PCs, at most topN of each) to the given file.
+    void report(FILE* out, unsigned topN = 50) const;
+
+    /// Write one line per calling context: function names from
+    /// outermost to innermost separated by semicolons followed by the
+    /// instruction count of the context (input of flamegraph.pl).
+    void writeFoldedStacks(FILE* out) const;
+
+  private:
+
+    enum class Transfer { None, Call, Return };
+
+    using Range = SymbolIndex::Range;
+
+    /// Node of the calling context tree.
+    struct Node
+    {
+      unsigned func = 0;
+      unsigned parent = 0;
+      uint64_t begin = 0, end = 0;  // Range of func entered at this node.
+      uint64_t self = 0;            // Instructions executed in this node.
+      std::vector<unsigned> children;
+    };
+
+    /// Classify given instruction as a call, return or neither.
+    Transfer classify(uint32_t inst) const
+    {
+      if ((inst & 3) == 3)
+	{
+	  unsigned opcode = inst & 0x7f, rd = (inst >> 7) & 0x1f;
+	  if (opcode == 0x6f)   // jal
+	    return isLink(rd) ? Transfer::Call : Transfer::None;
+	  if (opcode != 0x67)   // Not jalr.
+	    return Transfer::None;
+	  if (isLink(rd))
+	    return Transfer::Call;
+	  unsigned rs1 = (inst >> 15) & 0x1f;
+	  return (rd == 0 and isLink(rs1)) ? Transfer::Return : Transfer::None;
+	}
+
+      unsigned quadrant = inst & 3, f3 = (inst >> 13) & 7;
+      if (quadrant == 1 and f3 == 1 and not rv64_)
+	return Transfer::Call;  // c.jal
+      if (quadrant != 2 or f3 != 4 or ((inst >> 2) & 0x1f) != 0)
+	return Transfer::None;
+      unsigned rs1 = (inst >> 7) & 0x1f;
+      if (rs1 == 0)
+	return Transfer::None;
+      if ((inst >> 12) & 1)
+	return Transfer::Call;  // c.jalr
+      return isLink(rs1) ? Transfer::Return : Transfer::None;  // c.jr
+    }
+
+    static bool isLink(unsigned reg)
+    { return reg == 1 or reg == 5; }
+
+    /// Make counts_ of the given page current.
+    void selectPage(uint64_t page);
+
+    /// Update the current node for the given PC which is outside the
+    /// function of the current node or follows a call/return.
+    void enter(uint64_t pc);
+
+    /// Return the range containing the given address.
+    const Range& findRange(uint64_t pc) const
+    { return symbols_.find(pc); }
+
+    /// Return the child of the current node for the given range
+    /// creating it if necessary.
+    unsigned child(const Range& range);
+
+    /// Set the current node.
+    void setNode(unsigned ix)
+    {
+      node_ = ix;
+      begin_ = nodes_[ix].begin;
+      end_ = nodes_[ix].end;
+    }
+
+    /// Return the function name and offset of the given address.
+    std::string location(uint64_t pc) const;
+
+    static constexpr unsigned pageShift_ = 12;
+    static constexpr uint64_t pageMask_ = (uint64_t(1) << pageShift_) - 1;
+    static constexpr unsigned maxDepth_ = 1024;
+
+    bool rv64_ = false;
+    uint64_t total_ = 0;
+
+    SymbolIndex symbols_;                  // Function ranges.
+    std::vector<std::string> funcNames_;   // By symbol, 0 is "[unknown]".
+
+    // Instruction count of each half-word PC, by page.
+    std::unordered_map<uint64_t, std::vector<uint64_t>> counts_;
+    uint64_t lastPage_ = ~uint64_t(0);
+    uint64_t* lastCounts_ = nullptr;
+
+    std::vector<Node> nodes_;              // Node 0 is the root.
+    unsigned node_ = 0;                    // Current node.
+    uint64_t begin_ = 0, end_ = 0;         // Range of current node.
+    unsigned depth_ = 0;                   // Depth of current node.
+    unsigned overflow_ = 0;                // Calls not pushed (maxDepth_).
+    Transfer pending_ = Transfer::None;    // Kind of last instruction.
+
+    // Call counts by caller function (high 32 bits) and callee
+    // function (low 32 bits).
+    std::unordered_map<uint64_t, uint64_t> edges_;
+  };
+}
@@ -0,0 +1,179 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  /// Fixed capacity queue kept in a circular buffer. Items are indexed
+  /// from oldest (index 0) to youngest (index size()-1). Appending to
+  /// a full queue drops the oldest item. Appending and dropping are
+  /// constant time: nothing is shifted and nothing is allocated after
+  /// setCapacity.
+  template <typename T>
+  class RingBuffer
+  {
+  public:
+
+    /// Constructor: Queue holding up to capacity items.
+    RingBuffer(size_t capacity = 0)
+      : items_(capacity)
+    { }
+
+    /// Change the capacity of this queue. This empties the queue.
+    void setCapacity(size_t capacity)
+    {
+      items_.assign(capacity, T());
+      head_ = count_ = 0;
+    }
+
+    /// Return the maximum number of items.
+    size_t capacity() const
+    { return items_.size(); }
+
+    /// Return the number of items.
+    size_t size() const
+    { return count_; }
+
+    bool empty() const
+    { return count_ == 0; }
+
+    bool full() const
+    { return count_ == items_.size(); }
+
+    /// Return the ith item: 0 is the oldest.
+    T& operator[](size_t i)
+    { return items_[slot(i)]; }
+
+    const T& operator[](size_t i) const
+    { return items_[slot(i)]; }
+
+    /// Return the oldest item. Queue must not be empty.
+    T& front()
+    { return items_[head_]; }
+
+    /// Append given item dropping the oldest item if the queue is
+    /// full. Do nothing if capacity is zero.
+    void push(const T& item)
+    {
+      if (items_.empty())
+	return;
+      if (full())
+	{
+	  items_[head_] = item;
+	  head_ = slot(1);
+	}
+      else
+	items_[slot(count_++)] = item;
+    }
+
+    /// Remove the ith item moving the younger items down by one.
+    void erase(size_t i)
+    {
+      for (size_t j = i + 1; j < count_; ++j)
+	(*this)[j-1] = (*this)[j];
+      if (i < count_)
+	count_--;
+    }
+
+    /// Keep the n oldest items and drop the others. Do nothing if n
+    /// is not smaller than the size.
+    void truncate(size_t n)
+    {
+      if (n < count_)
+	count_ = n;
+    }
+
+    /// Remove all items.
+    void clear()
+    { head_ = count_ = 0; }
+
+    /// Iterator from oldest to youngest.
+    template <typename Q, typename V>
+    class Iterator
+    {
+    public:
+      Iterator(Q& queue, size_t ix)
+	: queue_(queue), ix_(ix)
+      { }
+
+      V& operator*() const
+      { return queue_[ix_]; }
+
+      Iterator& operator++()
+      { ++ix_; return *this; }
+
+      bool operator!=(const Iterator& other) const
+      { return ix_ != other.ix_; }
+
+    private:
+      Q& queue_;
+      size_t ix_;
+    };
+
+    typedef Iterator<RingBuffer, T> iterator;
+    typedef Iterator<const RingBuffer, const T> const_iterator;
+
+    iterator begin()
+    { return iterator(*this, 0); }
+
+    iterator end()
+    { return iterator(*this, count_); }
+
+    const_iterator begin() const
+    { return const_iterator(*this, 0); }
+
+    const_iterator end() const
+    { return const_iterator(*this, count_); }
+
+    /// Fill given vector with the items from oldest to youngest.
+    void copyTo(std::vector<T>& vec) const
+    {
+      vec.clear();
+      for (const auto& item : *this)
+	vec.push_back(item);
+    }
+
+    /// Replace the contents with the items of the given vector
+    /// (oldest first) keeping the youngest ones if they do not fit.
+    void assign(const std::vector<T>& vec)
+    {
+      clear();
+      for (const auto& item : vec)
+	push(item);
+    }
+
+  private:
+
+    /// Return index in items_ of the ith item of the queue.
+    size_t slot(size_t i) const
+    {
+      size_t s = head_ + i;
+      return s < items_.size() ? s : s - items_.size();
+    }
+
+    std::vector<T> items_;
+    size_t head_ = 0;   // Index in items_ of the oldest item.
+    size_t count_ = 0;  // Number of items.
+  };
+}
@@ -0,0 +1,131 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <fstream>
+#include <iostream>
+#include <sys/resource.h>
+#include <nlohmann/json.hpp>
+#include "RunReport.hpp"
+
+
+using namespace WdRiscv;
+
+
+RunReport::RunReport()
+  : phaseStart_(Clock::now())
+{
+}
+
+
+void
+RunReport::endPhase(const std::string& name)
+{
+  auto now = Clock::now();
+  double seconds = std::chrono::duration<double>(now - phaseStart_).count();
+  phases_.emplace_back(name, seconds);
+  phaseStart_ = now;
+}
+
+
+/// Return the given instruction count per second in millions (0 if
+/// seconds is not positive).
+static double
+mips(uint64_t instructions, double seconds)
+{
+  return seconds > 0 ? double(instructions) / seconds / 1e6 : 0;
+}
+
+
+/// Return the given (cause, count) pairs as a JSON object keyed by
+/// cause.
+static nlohmann::json
+causeObject(const std::vector<std::pair<uint64_t, uint64_t>>& causes)
+{
+  nlohmann::json obj = nlohmann::json::object();
+  for (const auto& [cause, count] : causes)
+    obj[std::to_string(cause)] = count;
+  return obj;
+}
+
+
+bool
+RunReport::write(const std::string& path) const
+{
+  using nlohmann::json;
+
+  json report;
+  report["version"] = version_;
+  report["programs"] = programs_;
+  report["success"] = success_;
+
+  json phases = json::object();
+  double total = 0;
+  for (const auto& [name, seconds] : phases_)
+    {
+      phases[name] = seconds;
+      total += seconds;
+    }
+  phases["total"] = total;
+  report["phases"] = phases;
+
+  json harts = json::array();
+  for (const auto& hart : harts_)
+    {
+      json modes = json::object();
+      for (const auto& mode : hart.modes)
+	modes[mode.name] = { { "runs", mode.runs },
+			     { "instructions", mode.instructions },
+			     { "seconds", mode.seconds },
+			     { "mips", mips(mode.instructions, mode.seconds) } };
+
+      harts.push_back({ { "hart", hart.hartId },
+			{ "retired", hart.retired },
+			{ "cycles", hart.cycles },
+			{ "exceptions", hart.exceptions },
+			{ "interrupts", hart.interrupts },
+			{ "triggerTrips", hart.triggerTrips },
+			{ "exceptionCauses", causeObject(hart.exceptionCauses) },
+			{ "interruptCauses", causeObject(hart.interruptCauses) },
+			{ "modes", modes } });
+    }
+  report["harts"] = harts;
+
+  // Peak resident set size: kilobytes on Linux.
+  struct rusage usage;
+  uint64_t peakRss = 0;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    peakRss = uint64_t(usage.ru_maxrss) * 1024;
+  report["memory"] = { { "pagesTouched", pageCount_ },
+		       { "pageSize", pageSize_ },
+		       { "peakRssBytes", peakRss } };
+
+  std::ofstream out(path);
+  if (not out)
+    {
+      std::cerr << "Failed to open run report file '" << path
+		<< "' for output\n";
+      return false;
+    }
+  out << report.dump(2) << '\n';
+  if (not out)
+    {
+      std::cerr << "Failed to write run report file '" << path << "'\n";
+      return false;
+    }
+  return true;
+}
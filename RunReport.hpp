@@ -0,0 +1,109 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  /// Statistics of a hart at the end of a run (see RunReport).
+  struct RunReportHart
+  {
+    /// Instructions and time of the runs in an execution mode.
+    struct Mode
+    {
+      std::string name;
+      uint64_t runs = 0;
+      uint64_t instructions = 0;
+      double seconds = 0;
+    };
+
+    unsigned hartId = 0;
+    uint64_t retired = 0;
+    uint64_t cycles = 0;
+    uint64_t exceptions = 0;
+    uint64_t interrupts = 0;
+    uint64_t triggerTrips = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> exceptionCauses; // Cause, count.
+    std::vector<std::pair<uint64_t, uint64_t>> interruptCauses; // Cause, count.
+    std::vector<Mode> modes;
+  };
+
+
+  /// Structured report of a run (see whisper --reportjson): the
+  /// phases of the run with their wall-clock times, the statistics of
+  /// each hart, the simulated memory pages touched and the peak
+  /// resident memory of the process. Written as one JSON object so
+  /// that the records of many runs can be collected and compared.
+  class RunReport
+  {
+  public:
+
+    /// Constructor: The first phase starts now.
+    RunReport();
+
+    /// End the current phase giving it the given name. The next
+    /// phase starts now.
+    void endPhase(const std::string& name);
+
+    /// Set the version of the simulator.
+    void setVersion(const std::string& version)
+    { version_ = version; }
+
+    /// Set the programs (hex, ELF or checkpoint files) of the run.
+    void setPrograms(const std::vector<std::string>& programs)
+    { programs_ = programs; }
+
+    /// Set the outcome of the run: true if it succeeded.
+    void setSuccess(bool success)
+    { success_ = success; }
+
+    /// Set the number and size of the host pages of the simulated
+    /// memory that were touched.
+    void setMemoryPages(uint64_t count, uint64_t size)
+    { pageCount_ = count; pageSize_ = size; }
+
+    /// Add the statistics of a hart.
+    void addHart(const RunReportHart& hart)
+    { harts_.push_back(hart); }
+
+    /// Write the report to the given file. Return true on success and
+    /// false (printing a message) on failure.
+    bool write(const std::string& path) const;
+
+  private:
+
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point phaseStart_;
+    std::vector<std::pair<std::string, double>> phases_;  // Name, seconds.
+    std::string version_;
+    std::vector<std::string> programs_;
+    bool success_ = false;
+    uint64_t pageCount_ = 0;
+    uint64_t pageSize_ = 0;
+    std::vector<RunReportHart> harts_;
+  };
+}
@@ -0,0 +1,98 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  /// Fixed capacity queue passing items from one producer thread to
+  /// one consumer thread without locks: each side owns one index and
+  /// publishes it with a release store; the other side reads it only
+  /// when its cached copy says the queue looks full (producer) or
+  /// empty (consumer).
+  template <typename T>
+  class SpscQueue
+  {
+  public:
+
+    /// Constructor: Queue holding up to capacity items. The capacity
+    /// is rounded up to a power of 2.
+    SpscQueue(size_t capacity)
+    {
+      size_t size = 1;
+      while (size < capacity)
+	size *= 2;
+      items_.resize(size);
+      mask_ = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /// Append given item. Return false if the queue is full. Called
+    /// by the producer thread only.
+    bool push(const T& item)
+    {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail - headCache_ > mask_)
+	{
+	  headCache_ = head_.load(std::memory_order_acquire);
+	  if (tail - headCache_ > mask_)
+	    return false;
+	}
+      items_[tail & mask_] = item;
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// Remove the oldest item placing it in item. Return false if the
+    /// queue is empty. Called by the consumer thread only.
+    bool pop(T& item)
+    {
+      size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tailCache_)
+	{
+	  tailCache_ = tail_.load(std::memory_order_acquire);
+	  if (head == tailCache_)
+	    return false;
+	}
+      item = items_[head & mask_];
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+  private:
+
+    std::vector<T> items_;
+    size_t mask_ = 0;
+
+    // Indices keep growing: the slot of an index is index & mask_.
+    // Each side's index and cached copy of the other side's index
+    // share a cache line of their own.
+    alignas(64) std::atomic<size_t> tail_ = 0;   // Written by producer.
+    size_t headCache_ = 0;
+    alignas(64) std::atomic<size_t> head_ = 0;   // Written by consumer.
+    size_t tailCache_ = 0;
+  };
+}
@@ -0,0 +1,241 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+
+namespace WdRiscv
+{
+
+  /// Set of breakpoint addresses and watched memory ranges of a hart.
+  /// Each kind has a bitmap with one bit per 4KB page holding a member
+  /// so that an address on an unflagged page is rejected with one
+  /// test. Only addresses on flagged pages are compared to the
+  /// members. Runs check breakpoints at fetch and watchpoints at
+  /// load/store (see Core::untilAddress).
+  class StopPoints
+  {
+  public:
+
+    enum class Access { Write, Read, Any };
+
+    /// Watched range: size bytes at addr.
+    struct Watch
+    {
+      uint64_t addr = 0;
+      uint64_t size = 0;
+      Access access = Access::Any;
+    };
+
+    /// Add a breakpoint at the given address. Return false if there
+    /// is already one.
+    bool addBreakpoint(uint64_t addr)
+    {
+      if (std::find(breaks_.begin(), breaks_.end(), addr) != breaks_.end())
+	return false;
+      breaks_.push_back(addr);
+      setPages(breakPages_, addr, 1);
+      return true;
+    }
+
+    /// Remove the breakpoint at the given address. Return false if
+    /// there is none.
+    bool removeBreakpoint(uint64_t addr)
+    {
+      auto iter = std::find(breaks_.begin(), breaks_.end(), addr);
+      if (iter == breaks_.end())
+	return false;
+      breaks_.erase(iter);
+      breakPages_.clear();
+      for (auto bp : breaks_)
+	setPages(breakPages_, bp, 1);
+      return true;
+    }
+
+    /// Watch accesses of the given type to the size bytes at the
+    /// given address. Return false if size is zero or if the same
+    /// watchpoint exists.
+    bool addWatchpoint(uint64_t addr, uint64_t size, Access access)
+    {
+      if (size == 0 or findWatch(addr, size, access) != watches_.end())
+	return false;
+      watches_.push_back({addr, size, access});
+      setPages(watchPages_, addr, size);
+      return true;
+    }
+
+    /// Remove the given watchpoint. Return false if there is none.
+    bool removeWatchpoint(uint64_t addr, uint64_t size, Access access)
+    {
+      auto iter = findWatch(addr, size, access);
+      if (iter == watches_.end())
+	return false;
+      watches_.erase(iter);
+      watchPages_.clear();
+      for (const auto& w : watches_)
+	setPages(watchPages_, w.addr, w.size);
+      return true;
+    }
+
+    /// Remove all breakpoints and watchpoints.
+    void clear()
+    {
+      breaks_.clear();
+      watches_.clear();
+      breakPages_.clear();
+      watchPages_.clear();
+      watchHit_ = false;
+    }
+
+    /// Return true if there is at least one breakpoint.
+    bool hasBreakpoints() const
+    { return not breaks_.empty(); }
+
+    /// Return true if there is at least one watchpoint.
+    bool hasWatchpoints() const
+    { return not watches_.empty(); }
+
+    /// Return the breakpoint addresses.
+    const std::vector<uint64_t>& breakpoints() const
+    { return breaks_; }
+
+    /// Return the watchpoints.
+    const std::vector<Watch>& watchpoints() const
+    { return watches_; }
+
+    /// Return true if there is a breakpoint at the given address.
+    bool isBreakpoint(uint64_t addr) const
+    {
+      if (not isFlagged(breakPages_, addr))
+	return false;
+      return std::find(breaks_.begin(), breaks_.end(), addr) != breaks_.end();
+    }
+
+    /// Check an access of size bytes at the given address against
+    /// the watchpoints. On a match, record the access (see watchHit)
+    /// and return true.
+    bool checkAccess(uint64_t addr, unsigned size, bool isWrite)
+    {
+      if (watches_.empty())
+	return false;
+      if (not isFlagged(watchPages_, addr) and
+	  not isFlagged(watchPages_, addr + size - 1))
+	return false;
+      for (const auto& w : watches_)
+	{
+	  if (addr + size <= w.addr or addr >= w.addr + w.size)
+	    continue;
+	  if ((w.access == Access::Write and not isWrite) or
+	      (w.access == Access::Read and isWrite))
+	    continue;
+	  watchHit_ = true;
+	  hit_ = w;
+	  hitAddr_ = addr;
+	  return true;
+	}
+      return false;
+    }
+
+    /// Return true if a watched access was recorded since the last
+    /// clearWatchHit. Set watch to the matching watchpoint and addr
+    /// to the address of the access.
+    bool watchHit(Watch& watch, uint64_t& addr) const
+    {
+      if (watchHit_)
+	{
+	  watch = hit_;
+	  addr = hitAddr_;
+	}
+      return watchHit_;
+    }
+
+    /// Return true if a watched access was recorded since the last
+    /// clearWatchHit.
+    bool hasWatchHit() const
+    { return watchHit_; }
+
+    /// Forget recorded watched access.
+    void clearWatchHit()
+    { watchHit_ = false; }
+
+  private:
+
+    static constexpr unsigned pageShift_ = 12;
+
+    static constexpr uint64_t maxPages_ = uint64_t(1) << 24;
+
+    /// One bit per page of the low 64GB of the address space. Pages
+    /// above that are all flagged as soon as one of them is.
+    struct PageSet
+    {
+      std::vector<bool> bits;
+      bool high = false;
+
+      void clear()
+      { bits.clear(); high = false; }
+    };
+
+    static bool isFlagged(const PageSet& pages, uint64_t addr)
+    {
+      uint64_t page = addr >> pageShift_;
+      if (page < pages.bits.size())
+	return pages.bits[page];
+      return pages.high and page >= maxPages_;
+    }
+
+    static void setPages(PageSet& pages, uint64_t addr, uint64_t size)
+    {
+      uint64_t first = addr >> pageShift_;
+      uint64_t last = (addr + size - 1) >> pageShift_;
+      if (last >= maxPages_)
+	{
+	  pages.high = true;
+	  last = maxPages_ - 1;
+	  if (first > last)
+	    return;
+	}
+      if (last >= pages.bits.size())
+	pages.bits.resize(last + 1);
+      for (uint64_t page = first; page <= last; ++page)
+	pages.bits[page] = true;
+    }
+
+    std::vector<Watch>::iterator
+    findWatch(uint64_t addr, uint64_t size, Access access)
+    {
+      return std::find_if(watches_.begin(), watches_.end(),
+			  [=] (const Watch& w) {
+			    return w.addr == addr and w.size == size and
+			      w.access == access;
+			  });
+    }
+
+    std::vector<uint64_t> breaks_;
+    std::vector<Watch> watches_;
+    PageSet breakPages_;    // Pages holding a breakpoint.
+    PageSet watchPages_;    // Pages holding watched bytes.
+
+    bool watchHit_ = false;
+    Watch hit_;
+    uint64_t hitAddr_ = 0;
+  };
+}
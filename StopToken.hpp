@@ -0,0 +1,53 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+
+
+namespace WdRiscv
+{
+
+  /// Request to stop the runs of the harts observing this token (see
+  /// Core::setStopToken). A run checks the token at its stop-condition
+  /// checks and returns once it is set. The token is lock-free: It may
+  /// be set from another thread or from a signal handler. It remains
+  /// set until cleared.
+  class StopToken
+  {
+  public:
+
+    /// Request a stop.
+    void request()
+    { stop_.store(true, std::memory_order_relaxed); }
+
+    /// Withdraw the stop request.
+    void clear()
+    { stop_.store(false, std::memory_order_relaxed); }
+
+    /// Return true if a stop was requested.
+    bool requested() const
+    { return stop_.load(std::memory_order_relaxed); }
+
+  private:
+
+    std::atomic<bool> stop_ = false;
+    static_assert(std::atomic<bool>::is_always_lock_free);
+  };
+}
@@ -0,0 +1,89 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <cinttypes>
+#include <cstdio>
+#include "SymbolIndex.hpp"
+
+
+using namespace WdRiscv;
+
+
+SymbolIndex::SymbolIndex(const std::unordered_map<std::string, ElfSymbol>& symbols)
+{
+  names_.push_back("");
+
+  // Sort symbols by address, larger first among equal addresses. Skip
+  // mapping symbols ($x, $d) and local labels.
+  struct Sym { uint64_t addr, size; const std::string* name; };
+  std::vector<Sym> syms;
+  for (const auto& [name, sym] : symbols)
+    if (not name.empty() and name.front() != '$' and
+	name.compare(0, 2, ".L") != 0)
+      syms.push_back({sym.addr_, sym.size_, &name});
+  std::sort(syms.begin(), syms.end(), [] (const Sym& a, const Sym& b) {
+      if (a.addr != b.addr) return a.addr < b.addr;
+      if (a.size != b.size) return a.size > b.size;
+      return *a.name < *b.name; });
+
+  // Make disjoint ranges covering the whole address space: a symbol
+  // extends to the end given by its size or, if it has no size, to
+  // the next symbol. Gaps have no symbol.
+  uint64_t covered = 0;  // Addresses below this are in ranges_.
+  for (size_t i = 0; i < syms.size(); ++i)
+    {
+      const Sym& sym = syms[i];
+      if (i > 0 and sym.addr == syms[i-1].addr)
+	continue;
+      uint64_t next = ~uint64_t(0);
+      for (size_t j = i + 1; j < syms.size(); ++j)
+	if (syms[j].addr != sym.addr)
+	  {
+	    next = syms[j].addr;
+	    break;
+	  }
+      uint64_t end = sym.size ? sym.addr + sym.size : next;
+      end = std::min(end, next);
+
+      if (sym.addr > covered)
+	ranges_.push_back({covered, sym.addr, 0});
+      names_.push_back(*sym.name);
+      ranges_.push_back({sym.addr, end, unsigned(names_.size() - 1)});
+      covered = end;
+    }
+  if (covered != ~uint64_t(0) or ranges_.empty())
+    ranges_.push_back({covered, ~uint64_t(0), 0});
+
+  begins_.reserve(ranges_.size());
+  for (const auto& range : ranges_)
+    begins_.push_back(range.begin);
+}
+
+
+std::string
+SymbolIndex::location(uint64_t addr) const
+{
+  const Range& range = find(addr);
+  if (range.symbol == 0)
+    return "";
+  if (addr == range.begin)
+    return names_[range.symbol];
+  char offset[32];
+  snprintf(offset, sizeof(offset), "+0x%" PRIx64, addr - range.begin);
+  return names_[range.symbol] + offset;
+}
@@ -0,0 +1,94 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Memory.hpp"
+
+
+namespace WdRiscv
+{
+
+  /// Index of the ELF symbols of a program by address: Sorted
+  /// disjoint address ranges covering the whole address space, each
+  /// attributed to a symbol or to no symbol. Built once after the ELF
+  /// files are loaded, it maps an address to its function with a
+  /// binary search on a packed array of range starts. Used to
+  /// annotate traces, profiles and disassembly.
+  class SymbolIndex
+  {
+  public:
+
+    /// Address range attributed to a symbol.
+    struct Range
+    {
+      uint64_t begin = 0;
+      uint64_t end = 0;      // Excluded (~0 is included in the last range).
+      unsigned symbol = 0;   // Index in names (0 if no symbol).
+    };
+
+    /// Constructor: Empty index. All addresses have no symbol.
+    SymbolIndex()
+      : SymbolIndex(std::unordered_map<std::string, ElfSymbol>())
+    { }
+
+    /// Constructor: Index the given symbols. A symbol with zero size
+    /// extends to the next symbol. Among symbols at the same address,
+    /// the largest one wins. Mapping symbols ($x, $d) and local labels
+    /// (.L) are skipped.
+    SymbolIndex(const std::unordered_map<std::string, ElfSymbol>& symbols);
+
+    /// Return the range containing the given address.
+    const Range& find(uint64_t addr) const
+    {
+      auto iter = std::upper_bound(begins_.begin(), begins_.end(), addr);
+      return ranges_[iter - begins_.begin() - 1];
+    }
+
+    /// Return the name of the symbol of the given index (see Range),
+    /// empty for index 0.
+    const std::string& name(unsigned symbol) const
+    { return names_.at(symbol); }
+
+    /// Return the symbol names by index (see Range). Index 0 is the
+    /// empty name.
+    const std::vector<std::string>& names() const
+    { return names_; }
+
+    /// Return the location of the given address as the name of its
+    /// symbol followed by the offset in the symbol if not zero (for
+    /// example main+0x1c). Return the empty string if the address has
+    /// no symbol.
+    std::string location(uint64_t addr) const;
+
+    /// Return true if no address has a symbol.
+    bool empty() const
+    { return names_.size() == 1; }
+
+  private:
+
+    std::vector<uint64_t> begins_;     // Begin of each range.
+    std::vector<Range> ranges_;        // Sorted, disjoint, no gap.
+    std::vector<std::string> names_;   // Index 0 is the empty name.
+  };
+}
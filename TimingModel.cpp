@@ -0,0 +1,97 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include "TimingModel.hpp"
+
+
+using namespace WdRiscv;
+
+
+/// Return the log base 2 of the given power of 2.
+static unsigned
+log2Of(uint64_t x)
+{
+  unsigned n = 0;
+  while ((uint64_t(1) << n) < x)
+    n++;
+  return n;
+}
+
+
+/// Return the largest power of 2 less than or equal to the given
+/// value (1 if the value is zero).
+static uint64_t
+floorPowerOf2(uint64_t x)
+{
+  uint64_t p = 1;
+  while (p * 2 <= x)
+    p *= 2;
+  return p;
+}
+
+
+void
+TimingCache::configure(unsigned size, unsigned ways, unsigned lineSize)
+{
+  lineSize = floorPowerOf2(lineSize);
+  ways_ = std::max(ways, 1u);
+  lineShift_ = log2Of(lineSize);
+
+  uint64_t sets = floorPowerOf2(std::max(size / (lineSize * ways_), 1u));
+  setMask_ = sets - 1;
+  tags_.assign(sets * ways_, 0);
+}
+
+
+TimingModel::TimingModel(const TimingConfig& config)
+  : config_(config)
+{
+  icache_.configure(config.icacheSize, config.icacheWays, config.icacheLine);
+  dcache_.configure(config.dcacheSize, config.dcacheWays, config.dcacheLine);
+
+  uint64_t entries = floorPowerOf2(config.predictorEntries);
+  predictorMask_ = entries - 1;
+  counters_.assign(entries, 1);   // Weakly not taken.
+  targets_.assign(entries, 0);
+}
+
+
+void
+TimingModel::report(std::ostream& out) const
+{
+  auto percent = [] (uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * double(part) / double(whole) : 0.0;
+  };
+
+  uint64_t cycles = insts_ + stalls_;
+  out << std::fixed << std::setprecision(2)
+      << "Timing model: " << cycles << " cycles, " << insts_
+      << " instructions, CPI " << (insts_ ? double(cycles) / insts_ : 0.0)
+      << '\n'
+      << "  I-cache: " << icacheAccesses_ << " line fetches, "
+      << icacheMisses_ << " misses ("
+      << percent(icacheMisses_, icacheAccesses_) << "%)\n"
+      << "  D-cache: " << dataAccesses_ << " accesses, " << dcacheMisses_
+      << " misses (" << percent(dcacheMisses_, dataAccesses_) << "%)\n"
+      << "  Branches: " << branches_ << ", " << mispredicts_
+      << " mispredicted (" << percent(mispredicts_, branches_) << "%)\n";
+  out.unsetf(std::ios::floatfield);
+}
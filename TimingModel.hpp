@@ -0,0 +1,297 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  /// Parameters of the timing model. Latencies are in cycles on top
+  /// of the single cycle of every instruction. Cache sizes and line
+  /// sizes are in bytes and must be powers of 2.
+  struct TimingConfig
+  {
+    unsigned icacheSize = 16*1024;
+    unsigned icacheWays = 4;
+    unsigned icacheLine = 64;
+    unsigned dcacheSize = 16*1024;
+    unsigned dcacheWays = 4;
+    unsigned dcacheLine = 64;
+    unsigned missPenalty = 20;      // Cache line fill.
+    unsigned iccmLatency = 0;       // Fetch from ICCM.
+    unsigned dccmLatency = 0;       // Load from DCCM.
+    unsigned loadLatency = 1;       // Load hitting the data cache.
+    unsigned mulLatency = 2;
+    unsigned divLatency = 33;
+    unsigned branchPenalty = 3;     // Mispredicted branch/jump.
+    unsigned predictorEntries = 256;  // Branch predictor/target table.
+  };
+
+
+  /// Set associative cache with LRU replacement: The tags of a set
+  /// are consecutive in a single array, most recently used first.
+  class TimingCache
+  {
+  public:
+
+    /// Define a cache of the given size, associativity and line size.
+    void configure(unsigned size, unsigned ways, unsigned lineSize);
+
+    /// Access the line containing the given address. Return true on a
+    /// hit. On a miss, the line replaces the least recently used line
+    /// of its set.
+    bool access(uint64_t addr)
+    {
+      uint64_t tag = (addr >> lineShift_) + 1;   // Zero is invalid.
+      uint64_t* set = &tags_[(tag & setMask_) * ways_];
+      if (set[0] == tag)
+	return true;
+      for (unsigned i = 1; i < ways_; ++i)
+	if (set[i] == tag)
+	  {
+	    for (unsigned j = i; j > 0; --j)
+	      set[j] = set[j-1];
+	    set[0] = tag;
+	    return true;
+	  }
+      for (unsigned j = ways_ - 1; j > 0; --j)
+	set[j] = set[j-1];
+      set[0] = tag;
+      return false;
+    }
+
+    /// Return the number of the line containing the given address.
+    uint64_t lineOf(uint64_t addr) const
+    { return addr >> lineShift_; }
+
+  private:
+
+    std::vector<uint64_t> tags_;
+    unsigned ways_ = 1;
+    unsigned lineShift_ = 6;
+    uint64_t setMask_ = 0;
+  };
+
+
+  /// Estimate the cycles of a program from the stream of its retired
+  /// instructions: instruction and data caches (bypassed by the
+  /// ICCM/DCCM), multiply/divide latencies and a branch predictor
+  /// (2-bit counters for conditional branches and a last-target table
+  /// for indirect jumps). Each instruction costs one cycle plus its
+  /// stall cycles: there is no overlap between stalls.
+  class TimingModel
+  {
+  public:
+
+    /// Instruction class for timing purposes.
+    enum class Kind : uint8_t { Other, Load, Store, Multiply, Divide,
+				Branch, IndirectJump };
+
+    /// Retired instruction.
+    struct Inst
+    {
+      uint64_t pc = 0;
+      uint64_t nextPc = 0;     // Address of the next instruction.
+      uint64_t dataAddr = 0;   // Load/store address.
+      unsigned size = 4;
+      Kind kind = Kind::Other;
+      bool iccm = false;       // Fetched from ICCM.
+      bool dccm = false;       // Load/store in DCCM.
+      bool newLine = true;     // False if known to be in the fetch line
+                               // of the previous instruction.
+    };
+
+    TimingModel(const TimingConfig& config = TimingConfig());
+
+    /// Return true if an instruction of the given size at the given
+    /// address is in the instruction fetch line of the instruction
+    /// ending just before the given address.
+    bool continuesLine(uint64_t pc, unsigned size) const
+    { return icache_.lineOf(pc - 1) == icache_.lineOf(pc + size - 1); }
+
+    /// Return the number of stall cycles of the given instruction
+    /// updating the state of the caches and predictors.
+    unsigned retire(const Inst& inst)
+    {
+      unsigned stall = 0;
+      icacheLookup_ = icacheMissed_ = branchMissed_ = false;
+
+      if (inst.newLine)
+	stall += fetch(inst);
+
+      switch (inst.kind)
+	{
+	case Kind::Other:
+	  break;
+	case Kind::Load:
+	  if (inst.dccm)
+	    stall += config_.dccmLatency;
+	  else
+	    {
+	      stall += config_.loadLatency;
+	      dataAccesses_++;
+	      if (not dcache_.access(inst.dataAddr))
+		{
+		  stall += config_.missPenalty;
+		  dcacheMisses_++;
+		}
+	    }
+	  break;
+	case Kind::Store:
+	  // Stores retire through a write buffer: They only allocate.
+	  if (not inst.dccm)
+	    {
+	      dataAccesses_++;
+	      dcacheMisses_ += not dcache_.access(inst.dataAddr);
+	    }
+	  break;
+	case Kind::Multiply:
+	  stall += config_.mulLatency;
+	  break;
+	case Kind::Divide:
+	  stall += config_.divLatency;
+	  break;
+	case Kind::Branch:
+	  stall += predictBranch(inst);
+	  break;
+	case Kind::IndirectJump:
+	  stall += predictTarget(inst);
+	  break;
+	}
+
+      insts_++;
+      stalls_ += stall;
+      return stall;
+    }
+
+    /// Return true if the last retired instruction looked up the
+    /// instruction cache (first instruction of a fetched line).
+    bool icacheLookedUp() const
+    { return icacheLookup_; }
+
+    /// Return true if the last retired instruction missed in the
+    /// instruction cache.
+    bool icacheMissed() const
+    { return icacheMissed_; }
+
+    /// Return true if the last retired instruction was a mispredicted
+    /// branch or jump.
+    bool branchMissed() const
+    { return branchMissed_; }
+
+    /// Return the total stall cycles.
+    uint64_t stalls() const
+    { return stalls_; }
+
+    /// Return the count of retired instructions.
+    uint64_t instructions() const
+    { return insts_; }
+
+    /// Zero the statistics keeping the state of the caches and of the
+    /// predictors (end of a warm-up period).
+    void clearStats()
+    {
+      insts_ = stalls_ = 0;
+      icacheAccesses_ = icacheMisses_ = dataAccesses_ = dcacheMisses_ = 0;
+      branches_ = mispredicts_ = 0;
+    }
+
+    /// Print the statistics of the model.
+    void report(std::ostream& out) const;
+
+  private:
+
+    /// Return the stall cycles of the fetch of the given instruction:
+    /// The cache is looked up once per fetched line.
+    unsigned fetch(const Inst& inst)
+    {
+      uint64_t first = icache_.lineOf(inst.pc);
+      uint64_t last = icache_.lineOf(inst.pc + inst.size - 1);
+      if (last == fetchLine_ and first == last)
+	return 0;
+      fetchLine_ = last;
+      if (inst.iccm)
+	return config_.iccmLatency;
+
+      bool hit = icache_.access(inst.pc);
+      if (first != last)
+	hit = icache_.access(inst.pc + inst.size - 1) and hit;
+      icacheLookup_ = true;
+      icacheMissed_ = not hit;
+      icacheAccesses_++;
+      icacheMisses_ += icacheMissed_;
+      return icacheMissed_ ? config_.missPenalty : 0;
+    }
+
+    /// Return the stall cycles of a conditional branch: 2-bit
+    /// saturating counters indexed by address.
+    unsigned predictBranch(const Inst& inst)
+    {
+      uint8_t& counter = counters_[(inst.pc >> 1) & predictorMask_];
+      bool taken = inst.nextPc != inst.pc + inst.size;
+      bool predicted = counter >= 2;
+      if (taken and counter < 3)
+	counter++;
+      else if (not taken and counter > 0)
+	counter--;
+      branches_++;
+      branchMissed_ = predicted != taken;
+      mispredicts_ += branchMissed_;
+      return branchMissed_ ? config_.branchPenalty : 0;
+    }
+
+    /// Return the stall cycles of an indirect jump: The target is
+    /// predicted to be that of the previous execution.
+    unsigned predictTarget(const Inst& inst)
+    {
+      uint64_t& target = targets_[(inst.pc >> 1) & predictorMask_];
+      branches_++;
+      branchMissed_ = target != inst.nextPc;
+      target = inst.nextPc;
+      mispredicts_ += branchMissed_;
+      return branchMissed_ ? config_.branchPenalty : 0;
+    }
+
+    TimingConfig config_;
+    TimingCache icache_;
+    TimingCache dcache_;
+    uint64_t fetchLine_ = ~uint64_t(0);
+
+    std::vector<uint8_t> counters_;
+    std::vector<uint64_t> targets_;
+    uint64_t predictorMask_ = 0;
+
+    bool icacheLookup_ = false;
+    bool icacheMissed_ = false;
+    bool branchMissed_ = false;
+
+    uint64_t insts_ = 0;
+    uint64_t stalls_ = 0;
+    uint64_t icacheAccesses_ = 0;
+    uint64_t icacheMisses_ = 0;
+    uint64_t dataAccesses_ = 0;
+    uint64_t dcacheMisses_ = 0;
+    uint64_t branches_ = 0;
+    uint64_t mispredicts_ = 0;
+  };
+}
@@ -0,0 +1,159 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+namespace WdRiscv
+{
+
+  /// One state change of an executed instruction: integer register
+  /// ('r'), floating point register ('f'), CSR ('c') or memory ('m').
+  struct TraceChange
+  {
+    char resource = 'r';
+    uint64_t addr = 0;    // Register number, CSR number or memory address.
+    uint64_t value = 0;   // New value.
+    unsigned size = 0;    // Memory change: Size of the write in bytes.
+  };
+
+
+  /// Instruction trace information of one executed instruction. This
+  /// is what the text trace (see printTraceRecord) and the binary
+  /// trace (see BinaryTrace.hpp) are generated from.
+  struct TraceRecord
+  {
+    uint64_t tag = 0;             // Retired instruction count.
+    unsigned hartId = 0;
+    uint64_t pc = 0;
+    uint32_t inst = 0;            // Top 16 bits cleared if compressed.
+    bool interrupted = false;
+    bool hasLoadAddr = false;
+    uint64_t loadAddr = 0;        // Valid if hasLoadAddr is true.
+    std::vector<TraceChange> changes;
+  };
+
+
+  /// Print to the given file.
+  template <typename... Args>
+  inline void
+  tracePrintf(FILE* out, const char* format, Args... args)
+  {
+    fprintf(out, format, args...);
+  }
+
+
+  /// Append to the given buffer.
+  template <typename... Args>
+  inline void
+  tracePrintf(std::vector<char>& out, const char* format, Args... args)
+  {
+    size_t size = out.size(), room = 256;
+    out.resize(size + room);
+    int n = snprintf(out.data() + size, room, format, args...);
+    if (n >= int(room))
+      {
+	out.resize(size + n + 1);
+	snprintf(out.data() + size, n + 1, format, args...);
+      }
+    out.resize(size + (n > 0 ? n : 0));
+  }
+
+
+  /// Print the text of one change of an executed instruction to the
+  /// given output: a FILE* or a std::vector<char> (see tracePrintf).
+  template <typename URV, typename Out>
+  void
+  formatInstTrace(Out& out, uint64_t tag, unsigned hartId, URV currPc,
+		  const char* opcode, char resource, URV addr,
+		  URV value, const char* assembly)
+  {
+    if constexpr (sizeof(URV) == 4)
+      {
+	if (resource == 'r')
+	  tracePrintf(out, "#%ld %d %08x %8s r %02x         %08x  %s",
+		      tag, hartId, currPc, opcode, addr, value, assembly);
+
+	else
+	  tracePrintf(out, "#%ld %d %08x %8s %c %08x   %08x  %s", tag, hartId,
+		      currPc, opcode, resource, addr, value, assembly);
+      }
+    else
+      tracePrintf(out, "#%ld %d %016lx %8s %c %016lx %016lx  %s", tag,
+		  hartId, currPc, opcode, resource, addr, value, assembly);
+  }
+
+
+  template <typename URV, typename Out>
+  void
+  formatFpInstTrace(Out& out, uint64_t tag, unsigned hartId, URV currPc,
+		    const char* opcode, unsigned fpReg,
+		    uint64_t fpVal, const char* assembly)
+  {
+    if constexpr (sizeof(URV) == 4)
+      tracePrintf(out, "#%ld %d %08x %8s f %02x %016lx  %s",
+		  tag, hartId, currPc, opcode, fpReg, fpVal, assembly);
+
+    else
+      tracePrintf(out, "#%ld %d %016lx %8s f %016lx %016lx  %s", tag,
+		  hartId, currPc, opcode, uint64_t(fpReg), fpVal, assembly);
+  }
+
+
+  /// Print the text form of the given record to the given output (a
+  /// FILE* or a std::vector<char>): one line per change (consecutive
+  /// lines joined by "  +") or a single x0 line if there is no
+  /// change. Assembly is the disassembly of the instruction including
+  /// any interrupt/load-address annotation.
+  template <typename URV, typename Out>
+  void
+  printTraceRecord(Out& out, const TraceRecord& rec, const char* assembly)
+  {
+    char instBuff[128];
+    if ((rec.inst & 0x3) == 3)
+      sprintf(instBuff, "%08x", rec.inst);
+    else
+      sprintf(instBuff, "%04x", rec.inst);
+
+    URV pc = rec.pc;
+    bool pending = false;  // True if a printed line need to be terminated.
+
+    for (const auto& change : rec.changes)
+      {
+	if (pending)
+	  tracePrintf(out, "  +\n");
+	if (change.resource == 'f')
+	  formatFpInstTrace<URV>(out, rec.tag, rec.hartId, pc, instBuff,
+				 change.addr, change.value, assembly);
+	else
+	  formatInstTrace<URV>(out, rec.tag, rec.hartId, pc, instBuff,
+			       change.resource, change.addr, change.value,
+			       assembly);
+	pending = true;
+      }
+
+    if (not pending)  // No diffs: Generate an x0 record.
+      formatInstTrace<URV>(out, rec.tag, rec.hartId, pc, instBuff, 'r', 0, 0,
+			   assembly);
+    tracePrintf(out, "\n");
+  }
+}
@@ -16,6 +16,7 @@
 // this program. If not, see <https://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
 #include "Triggers.hpp"
 
 
@@ -29,6 +30,7 @@ Triggers<URV>::Triggers(unsigned count)
   // Define each triggers as a single-element chain.
   for (unsigned i = 0; i < count; ++i)
     triggers_.at(i).setChainBounds(i, i+1);
+  updateFilters();
 }
 
 
@@ -85,6 +87,7 @@ Triggers<URV>::writeData1(URV trigIx, bool debugMode, URV value)
   if (prevChain != newChain)
     defineChainBounds();
 
+  updateFilters();
   return true;
 }
 
@@ -96,7 +99,11 @@ Triggers<URV>::writeData2(URV trigger, bool debugMode, URV value)
   if (trigger >= triggers_.size())
     return false;
 
-  return triggers_.at(trigger).writeData2(debugMode, value);
+  if (not triggers_.at(trigger).writeData2(debugMode, value))
+    return false;
+
+  updateFilters();
+  return true;
 }
 
 
@@ -132,6 +139,14 @@ Triggers<URV>::updateChainHitBit(Trigger<URV>& trigger)
   if (not chainHit or not uniformTiming)
     return false;
 
+  // Trace actions do not stop the instruction: Record them.
+  const auto& last = triggers_.at(endChain - 1);
+  if (last.isTraceOnHit())
+    {
+      traceAction_ = last.getAction();
+      return false;
+    }
+
   for (size_t i = beginChain; i < endChain; ++i)
     triggers_.at(i).setHit(true);
   return true;
@@ -143,10 +158,14 @@ bool
 Triggers<URV>::ldStAddrTriggerHit(URV address, TriggerTiming timing,
 				  bool isLoad, bool interruptEnabled)
 {
+  if (not filter(isLoad ? LoadAddrFilter : StoreAddrFilter, timing).mayMatch(address))
+    return false;  // No trigger can match.
+
   bool hit = false;
   for (auto& trigger : triggers_)
     {
-      if (not trigger.isEnterDebugOnHit() and not interruptEnabled)
+      if (not trigger.isEnterDebugOnHit() and not trigger.isTraceOnHit() and
+	  not interruptEnabled)
 	continue;
 
       if (not trigger.matchLdStAddr(address, timing, isLoad))
@@ -166,10 +185,14 @@ bool
 Triggers<URV>::ldStDataTriggerHit(URV value, TriggerTiming timing, bool isLoad,
 				  bool interruptEnabled)
 {
+  if (not filter(isLoad ? LoadDataFilter : StoreDataFilter, timing).mayMatch(value))
+    return false;  // No trigger can match.
+
   bool hit = false;
   for (auto& trigger : triggers_)
     {
-      if (not trigger.isEnterDebugOnHit() and not interruptEnabled)
+      if (not trigger.isEnterDebugOnHit() and not trigger.isTraceOnHit() and
+	  not interruptEnabled)
 	continue;
 
       if (not trigger.matchLdStData(value, timing, isLoad))
@@ -190,10 +213,14 @@ bool
 Triggers<URV>::instAddrTriggerHit(URV address, TriggerTiming timing,
 				  bool interruptEnabled)
 {
+  if (not filter(InstAddrFilter, timing).mayMatch(address))
+    return false;  // No trigger can match.
+
   bool hit = false;
   for (auto& trigger : triggers_)
     {
-      if (not trigger.isEnterDebugOnHit() and not interruptEnabled)
+      if (not trigger.isEnterDebugOnHit() and not trigger.isTraceOnHit() and
+	  not interruptEnabled)
 	continue;
 
       if (not trigger.matchInstAddr(address, timing))
@@ -213,10 +240,14 @@ bool
 Triggers<URV>::instOpcodeTriggerHit(URV opcode, TriggerTiming timing,
 				    bool interruptEnabled)
 {
+  if (not filter(InstOpcodeFilter, timing).mayMatch(opcode))
+    return false;  // No trigger can match.
+
   bool hit = false;
   for (auto& trigger : triggers_)
     {
-      if (not trigger.isEnterDebugOnHit() and not interruptEnabled)
+      if (not trigger.isEnterDebugOnHit() and not trigger.isTraceOnHit() and
+	  not interruptEnabled)
 	continue;
 
       if (not trigger.matchInstOpcode(opcode, timing))
@@ -240,7 +271,8 @@ Triggers<URV>::icountTriggerHit(bool interruptEnabled)
 
   for (auto& trig : triggers_)
     {
-      if (not trig.isEnterDebugOnHit() and not interruptEnabled)
+      if (not trig.isEnterDebugOnHit() and not trig.isTraceOnHit() and
+	  not interruptEnabled)
 	continue;
 
       if (trig.isModified())
@@ -249,6 +281,12 @@ Triggers<URV>::icountTriggerHit(bool interruptEnabled)
       if (not trig.instCountdown())
 	continue;
 
+      if (trig.isTraceOnHit())
+	{
+	  traceAction_ = trig.getAction();
+	  continue;
+	}
+
       hit = true;
       trig.setHit(true);
       trig.setLocalHit(true);
@@ -273,6 +311,7 @@ Triggers<URV>::config(unsigned trigger, URV reset1, URV reset2, URV reset3,
   triggers_.at(trigger).writeData2(true, reset2);  // Define compare mask.
 
   defineChainBounds();
+  updateFilters();
 
   return true;
 }
@@ -285,6 +324,8 @@ Triggers<URV>::reset()
   for (auto& trigger : triggers_)
     trigger.reset();
   defineChainBounds();
+  updateFilters();
+  traceAction_ = Trigger<URV>::Action::RaiseBreak;
 }
 
 
@@ -327,6 +368,7 @@ Triggers<URV>::poke(URV trigger, URV v1, URV v2, URV v3)
   trig.pokeData2(v2);
   trig.pokeData3(v3);
 
+  updateFilters();
   return true;
 }
 
@@ -347,6 +389,7 @@ Triggers<URV>::pokeData1(URV trigger, URV val)
   if (prevChain != newChain)
     defineChainBounds();
 
+  updateFilters();
   return true;
 }
 
@@ -361,6 +404,7 @@ Triggers<URV>::pokeData2(URV trigger, URV val)
   Trigger<URV>& trig = triggers_.at(trigger);
 
   trig.pokeData2(val);
+  updateFilters();
   return true;
 }
 
@@ -420,6 +464,62 @@ Triggers<URV>::defineChainBounds()
 }
 
 
+template <typename URV>
+void
+Triggers<URV>::updateFilters()
+{
+  for (auto& kindFilters : filters_)
+    for (auto& filter : kindFilters)
+      {
+	filter.ranges.clear();
+	filter.masked.clear();
+      }
+
+  for (const auto& trig : triggers_)
+    {
+      if (TriggerType(trig.data1_.data1_.type_) != TriggerType::AddrData)
+	continue;
+      const Mcontrol<URV>& ctl = trig.data1_.mcontrol_;
+      if (not ctl.m_)
+	continue;  // Not enabled.
+
+      bool isAddr = (typename Trigger<URV>::Select(ctl.select_) ==
+		     Trigger<URV>::Select::MatchAddress);
+      unsigned enabled[] = { ctl.load_, ctl.store_, ctl.execute_ };
+      FilterKind kinds[] = {
+	isAddr ? LoadAddrFilter : LoadDataFilter,
+	isAddr ? StoreAddrFilter : StoreDataFilter,
+	isAddr ? InstAddrFilter : InstOpcodeFilter };
+
+      for (unsigned i = 0; i < 3; ++i)
+	if (enabled[i])
+	  {
+	    Filter& filter = filters_[kinds[i]][ctl.timing_];
+	    trig.addMatchSet(filter.ranges, filter.masked);
+	  }
+    }
+
+  // Sort and merge overlapping or adjacent intervals.
+  for (auto& kindFilters : filters_)
+    for (auto& filter : kindFilters)
+      {
+	auto& ranges = filter.ranges;
+	std::sort(ranges.begin(), ranges.end());
+	size_t count = 0;
+	for (const auto& range : ranges)
+	  {
+	    if (count and (ranges[count-1].second == ~URV(0) or
+			   range.first <= ranges[count-1].second + 1))
+	      ranges[count-1].second = std::max(ranges[count-1].second,
+					       range.second);
+	    else
+	      ranges[count++] = range;
+	  }
+	ranges.resize(count);
+      }
+}
+
+
 template <typename URV>
 bool
 Trigger<URV>::matchLdStAddr(URV address, TriggerTiming timing, bool isLoad) const
@@ -505,6 +605,48 @@ Trigger<URV>::doMatch(URV item) const
 }
 
 
+template <typename URV>
+void
+Trigger<URV>::addMatchSet(std::vector<std::pair<URV, URV>>& ranges,
+			  std::vector<std::pair<URV, URV>>& masked) const
+{
+  unsigned halfBitCount = 4*sizeof(URV);
+  URV lowHalf = ~URV(0) >> halfBitCount;
+
+  switch (Match(data1_.mcontrol_.match_))
+    {
+    case Match::Equal:
+      ranges.push_back({data2_, data2_});
+      return;
+
+    case Match::Masked:
+      {
+	URV low = data2_ & data2CompareMask_;
+	ranges.push_back({low, low | ~data2CompareMask_});
+	return;
+      }
+
+    case Match::GE:
+      ranges.push_back({data2_, ~URV(0)});
+      return;
+
+    case Match::LT:
+      if (data2_ != 0)
+	ranges.push_back({0, data2_ - 1});
+      return;
+
+    case Match::MaskHighEqualLow:
+      masked.push_back({data2_ >> halfBitCount, data2_ & lowHalf});
+      return;
+
+    case Match::MaskLowEqualHigh:
+      masked.push_back({data2_ << halfBitCount, data2_ & ~lowHalf});
+      return;
+    }
+  // Other match values never match (see doMatch).
+}
+
+
 template <typename URV>
 bool
 Trigger<URV>::matchInstAddr(URV address, TriggerTiming timing) const
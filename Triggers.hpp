@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <utility>
 #include <unordered_map>
 #include <string>
 
@@ -316,6 +317,15 @@ namespace WdRiscv
       return false;
     }
 
+    /// Return true if this trigger starts or stops tracing on a hit
+    /// (see Triggers::takeTraceAction) instead of stopping the
+    /// instruction.
+    bool isTraceOnHit() const
+    {
+      Action action = getAction();
+      return action == Action::StartTrace or action == Action::StopTrace;
+    }
+
     /// Return true if this trigger is enabled for loads (or stores if
     /// isLoad is false), for addresses, for the given timing and if
     /// it matches the given data address.  Return false otherwise.
@@ -434,6 +444,12 @@ namespace WdRiscv
 	data2CompareMask_ = data2CompareMask_ << (leastSigZeroBit + 1);
     }
 
+    /// Add to ranges (closed intervals) and masked (mask/value
+    /// pairs) the items that may match the data2 component of this
+    /// trigger according to the match field (see doMatch).
+    void addMatchSet(std::vector<std::pair<URV, URV>>& ranges,
+		     std::vector<std::pair<URV, URV>>& masked) const;
+
     bool isModified() const
     { return modified_; }
 
@@ -649,6 +665,15 @@ namespace WdRiscv
 	}
     }
 
+    /// Return true if the given trigger was written by the last
+    /// instruction.
+    bool isModified(unsigned trigger) const
+    { return trigger < triggers_.size() and triggers_[trigger].isModified(); }
+
+    /// Return true if the hit bit of the given trigger is set.
+    bool isHit(unsigned trigger) const
+    { return trigger < triggers_.size() and triggers_[trigger].getHit(); }
+
     /// Fill the trigs vector with the indices of the triggers written
     /// by the last instruction.
     void getLastWrittenTriggers(std::vector<unsigned>& trigs) const
@@ -679,6 +704,19 @@ namespace WdRiscv
       return false;
     }
 
+    /// If a trigger chain with a start-trace or stop-trace action
+    /// tripped since the last call, set start to true for start-trace
+    /// (false for stop-trace) and return true. Return false otherwise.
+    /// Such chains do not count as hits of the trigger-hit methods.
+    bool takeTraceAction(bool& start)
+    {
+      if (traceAction_ == Trigger<URV>::Action::RaiseBreak)
+	return false;
+      start = traceAction_ == Trigger<URV>::Action::StartTrace;
+      traceAction_ = Trigger<URV>::Action::RaiseBreak;
+      return true;
+    }
+
     /// Restrict chaining only to pairs of consecutive (even-numbered followed
     /// by odd) triggers.
     void setEvenOddChaining(bool flag)
@@ -692,15 +730,58 @@ namespace WdRiscv
     /// If all the triggers in the chain of the given trigger have
     /// tripped (in isolation using local-hit), then return true
     /// setting the hit bit of these triggers. Otherwise, return
-    /// false.
+    /// false. A tripped chain with a trace action is recorded for
+    /// takeTraceAction instead: Return false.
     bool updateChainHitBit(Trigger<URV>& trigger);
 
     /// Define the chain bounds of each trigger.
     void defineChainBounds();
 
+    /// Items (addresses, data values or opcodes) that may match one
+    /// of the enabled triggers of a given kind and timing: A union of
+    /// closed intervals and of masked compares. An item outside the
+    /// filter cannot trip a trigger and is rejected without visiting
+    /// the triggers.
+    struct Filter
+    {
+      std::vector<std::pair<URV, URV>> ranges;  // Sorted and disjoint.
+      std::vector<std::pair<URV, URV>> masked;  // Mask and value.
+
+      bool mayMatch(URV item) const
+      {
+	for (const auto& range : ranges)
+	  if (item <= range.second)
+	    {
+	      if (item >= range.first)
+		return true;
+	      break;
+	    }
+	for (const auto& mv : masked)
+	  if ((item & mv.first) == mv.second)
+	    return true;
+	return false;
+      }
+    };
+
+    enum FilterKind { LoadAddrFilter, StoreAddrFilter, LoadDataFilter,
+		      StoreDataFilter, InstAddrFilter, InstOpcodeFilter,
+		      FilterKindCount };
+
+    /// Return the filter of the given kind and timing.
+    const Filter& filter(FilterKind kind, TriggerTiming timing) const
+    { return filters_[kind][timing == TriggerTiming::Before ? 0 : 1]; }
+
+    /// Recompute the filters from the configuration of the
+    /// triggers. Called whenever a data1/data2 component changes.
+    void updateFilters();
+
   private:
 
     std::vector< Trigger<URV> > triggers_;
     bool chainPairs_ = false;
+    Filter filters_[FilterKindCount][2];  // By kind and timing.
+
+    // Pending trace action (see takeTraceAction): RaiseBreak if none.
+    typename Trigger<URV>::Action traceAction_ = Trigger<URV>::Action::RaiseBreak;
   };
 }
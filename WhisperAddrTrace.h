@@ -0,0 +1,72 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// Memory address trace (whisper --addrtrace <file> or --addrtraceshm
+// <name>) for external cache/interconnect simulators. This header is
+// plain C.
+//
+// The trace is a header followed by fixed size records (all integers
+// little endian) and ends with a record of type WhisperAddrEnd:
+//
+//   Header:  u32 magic ("WADR"), u16 version, u8 xlen, u8 0
+//   Records: struct WhisperAddrRecord (32 bytes)
+//
+// Each retired instruction produces a fetch record (address: the pc,
+// size: the instruction size) followed, for a load, store or atomic
+// instruction, by a record of its data access. Records of the harts
+// of a multi-hart run are interleaved in chunks: the count field is
+// per hart.
+//
+// With --addrtraceshm, the same bytes flow on the reply ring of a
+// shared memory segment with the layout of the server transport (see
+// WhisperShm.h): a consumer attaches with whisperShmAttach and reads
+// with whisperShmRead(shm, &shm->reply, ...). Whisper waits when the
+// ring is full, and drops the records once the consumer has exited.
+// The file may also be a named pipe (mkfifo).
+
+#include <stdint.h>
+
+
+#define WHISPER_ADDR_MAGIC    0x52444157   /* "WADR" */
+#define WHISPER_ADDR_VERSION  1
+
+
+/// Type of a record.
+enum WhisperAddrType
+  {
+    WhisperAddrFetch,    /* Instruction fetch. */
+    WhisperAddrLoad,     /* Load (including load-reserved). */
+    WhisperAddrStore,    /* Store (including successful store-conditional). */
+    WhisperAddrAmo,      /* Atomic read-modify-write. */
+    WhisperAddrEnd       /* End of trace (other fields zero). */
+  };
+
+
+/// Address trace record.
+struct WhisperAddrRecord
+{
+  uint64_t count;      /* Instructions retired by the hart before this one. */
+  uint64_t pc;         /* Address of the instruction. */
+  uint64_t address;    /* Address of the access. */
+  uint8_t type;        /* WhisperAddrType. */
+  uint8_t size;        /* Byte count of the access. */
+  uint16_t hart;       /* Hart id. */
+  uint32_t reserved;
+};
@@ -0,0 +1,561 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <iostream>
+#include <memory>
+#include "WhisperApi.h"
+#include "CoreConfig.hpp"
+#include "ElfFile.hpp"
+#include "Core.hpp"
+
+
+using namespace WdRiscv;
+
+
+/// A hart of the embedding interface: a 32-bit or a 64-bit core (the
+/// other pointer is null), the change records of its last executed
+/// instruction and its what-if helpers (see whisperSetWhatIfThreads)
+/// with the records of the last what-if batch.
+struct WhisperHart
+{
+  std::unique_ptr<Core<uint32_t>> core32;
+  std::unique_ptr<Core<uint64_t>> core64;
+  std::vector<TraceChange> changes;
+
+  std::string configFile;
+  std::vector<std::unique_ptr<Core<uint32_t>>> helpers32;
+  std::vector<std::unique_ptr<Core<uint64_t>>> helpers64;
+  std::vector<ChangeRecord> whatIf;
+};
+
+
+namespace
+{
+  /// Call func with the core of the given hart. Return the value
+  /// returned by func (converted to int) or 0 if the hart is null or
+  /// if func throws: exceptions must not cross into the (C/DPI)
+  /// caller.
+  template <typename Func>
+  int
+  withCore(WhisperHart* hart, const char* what, Func func)
+  {
+    if (not hart)
+      {
+	std::cerr << "Error: " << what << ": null hart handle\n";
+	return 0;
+      }
+
+    try
+      {
+	if (hart->core32)
+	  return func(*hart->core32) ? 1 : 0;
+	return func(*hart->core64) ? 1 : 0;
+      }
+    catch (const std::exception& e)
+      {
+	std::cerr << "Error: " << what << ": " << e.what() << '\n';
+      }
+    catch (...)
+      {
+	std::cerr << "Error: " << what << ": unexpected exception\n";
+      }
+    return 0;
+  }
+
+
+  /// Create a core configured by the given configuration. If leader
+  /// is non-null, the core is a what-if helper of the leader (see
+  /// Core::setWhatIfHelpers) sharing its memory.
+  template <typename URV>
+  std::unique_ptr<Core<URV>>
+  createCore(const CoreConfig& config, Core<URV>* leader = nullptr)
+  {
+    size_t memorySize = size_t(1) << 32;  // 4 gigs
+    unsigned registerCount = 32;
+
+    std::unique_ptr<Core<URV>> core;
+    if (leader)
+      {
+	core = std::make_unique<Core<URV>>(leader->hartId(),
+					   leader->getMemory(), registerCount);
+	core->followMemoryLayout(true);
+      }
+    else
+      core = std::make_unique<Core<URV>>(0, memorySize, registerCount);
+
+    if (not config.applyConfig(*core, false))
+      return nullptr;
+
+    // Same setup as the whisper server mode.
+    core->enableTriggers(true);
+    core->enablePerformanceCounters(true);
+    core->enableStoreExceptions(true);
+    core->enableLoadExceptions(true);
+    core->setConsoleOutput(stdout);
+    core->reset();
+    return core;
+  }
+
+
+  /// Single step the given core setting flags to the corresponding
+  /// WhisperRecordFlags and collecting the changes of the executed
+  /// instruction into the given vector.
+  template <typename URV>
+  void
+  stepCore(Core<URV>& core, std::vector<TraceChange>& changes,
+	   uint32_t& flags)
+  {
+    uint64_t interruptCount = core.getInterruptCount();
+
+    core.singleStep(nullptr);
+
+    flags = 0;
+    if (core.getInterruptCount() != interruptCount)
+      flags |= WhisperRecordInterrupted;
+
+    unsigned preCount = 0, postCount = 0;
+    core.countTrippedTriggers(preCount, postCount);
+    if (preCount)
+      flags |= WhisperRecordPreTrigger;
+    if (postCount)
+      flags |= WhisperRecordPostTrigger;
+
+    changes.clear();
+    core.collectChanges(changes);
+    core.clearTraceData();
+  }
+
+
+  /// Return the what-if helpers of the given hart.
+  template <typename URV>
+  std::vector<std::unique_ptr<Core<URV>>>&
+  helpersOf(WhisperHart& hart)
+  {
+    if constexpr (sizeof(URV) == 4)
+      return hart.helpers32;
+    else
+      return hart.helpers64;
+  }
+
+
+  /// Set changes to the changes of the given what-if record in the
+  /// order of Core::collectChanges.
+  void
+  whatIfChanges(const ChangeRecord& record, std::vector<TraceChange>& changes)
+  {
+    changes.clear();
+    if (record.hasIntReg)
+      changes.push_back(TraceChange{'r', record.intRegIx, record.intRegValue});
+    if (record.hasFpReg)
+      changes.push_back(TraceChange{'f', record.fpRegIx, record.fpRegValue});
+    for (size_t i = 0; i < record.csrIx.size(); ++i)
+      changes.push_back(TraceChange{'c', uint64_t(record.csrIx.at(i)),
+				    record.csrValue.at(i)});
+    if (record.memSize)
+      changes.push_back(TraceChange{'m', record.memAddr, record.memValue,
+				    record.memSize});
+  }
+}
+
+
+extern "C" {
+
+WhisperHart*
+whisperCreate(const char* configFile, unsigned xlen)
+{
+  try
+    {
+      CoreConfig config;
+      if (configFile and *configFile)
+	if (not config.loadConfigFile(configFile))
+	  return nullptr;
+
+      if (xlen == 0)
+	{
+	  xlen = 32;
+	  config.getXlen(xlen);
+	}
+
+      auto hart = std::make_unique<WhisperHart>();
+      if (configFile)
+	hart->configFile = configFile;
+      if (xlen == 32)
+	hart->core32 = createCore<uint32_t>(config);
+      else if (xlen == 64)
+	hart->core64 = createCore<uint64_t>(config);
+      else
+	{
+	  std::cerr << "Invalid register width: " << xlen
+		    << " -- expecting 32 or 64\n";
+	  return nullptr;
+	}
+
+      if (not hart->core32 and not hart->core64)
+	return nullptr;
+      return hart.release();
+    }
+  catch (const std::exception& e)
+    {
+      std::cerr << "Error: whisperCreate: " << e.what() << '\n';
+    }
+  catch (...)
+    {
+      std::cerr << "Error: whisperCreate: unexpected exception\n";
+    }
+  return nullptr;
+}
+
+
+void
+whisperDestroy(WhisperHart* hart)
+{
+  if (not hart)
+    return;
+  withCore(hart, "whisperDestroy", [] (auto& core) {
+      core.flushConsole();
+      return true;
+    });
+  delete hart;
+}
+
+
+int
+whisperLoadElf(WhisperHart* hart, const char* path)
+{
+  return withCore(hart, "whisperLoadElf", [path] (auto& core) {
+      using URV = decltype(core.peekPc());
+
+      ElfFile elf;
+      if (not path or not elf.open(path))
+	return false;
+
+      size_t entryPoint = 0, exitPoint = 0;
+      if (not core.loadElfFile(elf, entryPoint, exitPoint))
+	return false;
+
+      core.pokePc(URV(entryPoint));
+
+      ElfSymbol sym;
+      if (elf.findSymbol("tohost", sym))
+	core.setToHostAddress(sym.addr_);
+      if (elf.findSymbol("__whisper_console_io", sym))
+	core.setConsoleIo(URV(sym.addr_));
+      if (elf.findSymbol("__global_pointer$", sym))
+	core.pokeIntReg(RegGp, URV(sym.addr_));
+      return true;
+    });
+}
+
+
+int
+whisperLoadHex(WhisperHart* hart, const char* path)
+{
+  return withCore(hart, "whisperLoadHex", [path] (auto& core) {
+      return path and core.loadHexFile(path);
+    });
+}
+
+
+int
+whisperReset(WhisperHart* hart, uint64_t resetPc, int useResetPc)
+{
+  if (hart)
+    hart->changes.clear();
+  return withCore(hart, "whisperReset", [=] (auto& core) {
+      using URV = decltype(core.peekPc());
+      if (useResetPc)
+	core.defineResetPc(URV(resetPc));
+      core.reset();
+      return true;
+    });
+}
+
+
+int
+whisperStep(WhisperHart* hart, uint64_t* pc, uint32_t* opcode,
+	    uint32_t* changeCount, uint32_t* flags)
+{
+  return withCore(hart, "whisperStep", [=] (auto& core) {
+      uint32_t stepFlags = 0;
+      stepCore(core, hart->changes, stepFlags);
+
+      uint32_t inst = 0;
+      core.readInst(core.lastPc(), inst);
+      if (pc)
+	*pc = core.lastPc();
+      if (opcode)
+	*opcode = inst;
+      if (changeCount)
+	*changeCount = hart->changes.size();
+      if (flags)
+	*flags = stepFlags;
+      return true;
+    });
+}
+
+
+int
+whisperStepUntil(WhisperHart* hart, uint64_t address, uint64_t count,
+		 uint64_t* executed)
+{
+  return withCore(hart, "whisperStepUntil", [=] (auto& core) {
+      uint64_t done = 0;
+      uint32_t flags = 0;
+      while (done < count and core.peekPc() != address)
+	{
+	  stepCore(core, hart->changes, flags);
+	  done++;
+	  if (core.hasTargetProgramFinished())
+	    break;
+	  if (core.inDebugMode() and not core.inDebugStepMode())
+	    break;
+	}
+      if (executed)
+	*executed = done;
+      return true;
+    });
+}
+
+
+int
+whisperChange(WhisperHart* hart, uint32_t index, uint32_t* resource,
+	      uint64_t* address, uint64_t* value, uint32_t* size)
+{
+  if (not hart or index >= hart->changes.size())
+    return 0;
+
+  const TraceChange& change = hart->changes[index];
+  if (resource)
+    *resource = change.resource;
+  if (address)
+    *address = change.addr;
+  if (value)
+    *value = change.value;
+  if (size)
+    *size = change.resource == 'm' ? change.size : 0;
+  return 1;
+}
+
+
+int
+whisperPeek(WhisperHart* hart, uint32_t resource, uint64_t address,
+	    uint64_t* value)
+{
+  return withCore(hart, "whisperPeek", [=] (auto& core) {
+      using URV = decltype(core.peekPc());
+      URV val = 0;
+      uint64_t val64 = 0;
+      bool ok = false;
+      switch (resource)
+	{
+	case 'r': ok = core.peekIntReg(address, val); val64 = val; break;
+	case 'f': ok = core.peekFpReg(address, val64); break;
+	case 'c': ok = core.peekCsr(CsrNumber(address), val); val64 = val; break;
+	case 'p': ok = true; val64 = core.peekPc(); break;
+	case 'm': ok = core.peekMemory(address, val); val64 = val; break;
+	}
+      if (ok and value)
+	*value = val64;
+      return ok;
+    });
+}
+
+
+int
+whisperPoke(WhisperHart* hart, uint32_t resource, uint64_t address,
+	    uint64_t value)
+{
+  return withCore(hart, "whisperPoke", [=] (auto& core) {
+      using URV = decltype(core.peekPc());
+      switch (resource)
+	{
+	case 'r': return core.pokeIntReg(address, URV(value));
+	case 'f': return core.pokeFpReg(address, value);
+	case 'c': return core.pokeCsr(CsrNumber(address), URV(value));
+	case 'p': core.pokePc(URV(value)); return true;
+	case 'm': return core.pokeMemory(address, URV(value));
+	}
+      return false;
+    });
+}
+
+
+int
+whisperException(WhisperHart* hart, uint32_t type, uint64_t address,
+		 uint32_t* matchCount)
+{
+  return withCore(hart, "whisperException", [=] (auto& core) {
+      using URV = decltype(core.peekPc());
+      URV addr = address;
+      unsigned count = 0;
+      bool ok = true;
+      switch (WhisperExceptionType(type))
+	{
+	case InstAccessFault:      core.postInstAccessFault(addr); break;
+	case DataAccessFault:      core.postDataAccessFault(addr); break;
+	case ImpreciseStoreFault:  ok = core.applyStoreException(addr, count); break;
+	case ImpreciseLoadFault:   ok = core.applyLoadException(addr, count); break;
+	case NonMaskableInterrupt: core.setPendingNmi(NmiCause(addr)); break;
+	default:                   ok = false; break;
+	}
+      if (matchCount)
+	*matchCount = count;
+      return ok;
+    });
+}
+
+
+int
+whisperLoadFinished(WhisperHart* hart, uint64_t address, uint32_t* matchCount)
+{
+  return withCore(hart, "whisperLoadFinished", [=] (auto& core) {
+      using URV = decltype(core.peekPc());
+      unsigned count = 0;
+      bool ok = core.applyLoadFinished(URV(address), count);
+      if (matchCount)
+	*matchCount = count;
+      return ok;
+    });
+}
+
+
+int
+whisperEnterDebug(WhisperHart* hart)
+{
+  return withCore(hart, "whisperEnterDebug", [] (auto& core) {
+      core.enterDebugMode(core.peekPc());
+      return true;
+    });
+}
+
+
+int
+whisperExitDebug(WhisperHart* hart)
+{
+  return withCore(hart, "whisperExitDebug", [] (auto& core) {
+      core.exitDebugMode();
+      return true;
+    });
+}
+
+
+int
+whisperFinished(WhisperHart* hart)
+{
+  return withCore(hart, "whisperFinished", [] (auto& core) {
+      return core.hasTargetProgramFinished();
+    });
+}
+
+
+int
+whisperSetWhatIfThreads(WhisperHart* hart, unsigned threads)
+{
+  return withCore(hart, "whisperSetWhatIfThreads", [=] (auto& core) {
+      using URV = decltype(core.peekPc());
+      auto& helpers = helpersOf<URV>(*hart);
+      core.setWhatIfHelpers({});
+      helpers.clear();
+
+      CoreConfig config;
+      if (not hart->configFile.empty())
+	if (not config.loadConfigFile(hart->configFile))
+	  return false;
+
+      std::vector<Core<URV>*> pointers;
+      for (unsigned i = 1; i < threads; ++i)
+	{
+	  auto helper = createCore<URV>(config, &core);
+	  if (not helper)
+	    return false;
+	  pointers.push_back(helper.get());
+	  helpers.push_back(std::move(helper));
+	}
+      core.setWhatIfHelpers(pointers);
+      return true;
+    });
+}
+
+
+int
+whisperWhatIf(WhisperHart* hart, uint32_t count, const uint64_t* pcs,
+	      const uint32_t* opcodes)
+{
+  if (hart)
+    hart->whatIf.clear();
+  return withCore(hart, "whisperWhatIf", [=] (auto& core) {
+      if (count and (not pcs or not opcodes))
+	return false;
+      std::vector<WhatIfCandidate> candidates(count);
+      for (uint32_t i = 0; i < count; ++i)
+	{
+	  candidates[i].pc = pcs[i];
+	  candidates[i].inst = opcodes[i];
+	}
+      core.whatIfBatch(candidates, hart->whatIf);
+      return true;
+    });
+}
+
+
+int
+whisperWhatIfResult(WhisperHart* hart, uint32_t index, uint64_t* newPc,
+		    uint32_t* exception, uint32_t* changeCount)
+{
+  if (not hart or index >= hart->whatIf.size())
+    return 0;
+
+  const ChangeRecord& record = hart->whatIf[index];
+  std::vector<TraceChange> changes;
+  whatIfChanges(record, changes);
+  if (newPc)
+    *newPc = record.newPc;
+  if (exception)
+    *exception = record.hasException ? 1 : 0;
+  if (changeCount)
+    *changeCount = changes.size();
+  return 1;
+}
+
+
+int
+whisperWhatIfChange(WhisperHart* hart, uint32_t index, uint32_t changeIndex,
+		    uint32_t* resource, uint64_t* address, uint64_t* value,
+		    uint32_t* size)
+{
+  if (not hart or index >= hart->whatIf.size())
+    return 0;
+
+  std::vector<TraceChange> changes;
+  whatIfChanges(hart->whatIf[index], changes);
+  if (changeIndex >= changes.size())
+    return 0;
+
+  const TraceChange& change = changes[changeIndex];
+  if (resource)
+    *resource = change.resource;
+  if (address)
+    *address = change.addr;
+  if (value)
+    *value = change.value;
+  if (size)
+    *size = change.size;
+  return 1;
+}
+
+}
@@ -0,0 +1,177 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// In-process interface to the simulator (part of librvcore.a). This
+// header is plain C so that the functions can be imported by the DPI
+// side of a SystemVerilog test-bench: a lock-step bench calls them
+// directly instead of exchanging WhisperMessage structures with a
+// whisper server process (see WhisperMessage.h).
+//
+// The functions take and return only integers, strings and pointers
+// to integers (DPI int, longint, string, chandle and output
+// arguments). They never throw: a failure (including an internal
+// exception) is reported by a zero return value and a message on the
+// standard error stream. Unless stated otherwise, an int return value
+// is 1 on success and 0 on failure.
+//
+// A handle is a single hart with its own memory. Distinct handles may
+// be used from distinct threads. A handle must not be used from two
+// threads at the same time.
+//
+// Typical lock-step use:
+//
+//   WhisperHart* hart = whisperCreate("whisper.json", 0);
+//   whisperLoadElf(hart, "test.elf");
+//   while (!whisperFinished(hart)) {
+//     whisperStep(hart, &pc, &opcode, &changeCount, &flags);
+//     for (unsigned i = 0; i < changeCount; ++i)
+//       whisperChange(hart, i, &resource, &address, &value, &size);
+//   }
+//   whisperDestroy(hart);
+
+#include <stdint.h>
+#include "WhisperMessage.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Opaque hart handle (DPI chandle).
+typedef struct WhisperHart WhisperHart;
+
+/// Create a hart configured by the given JSON configuration file (as
+/// with whisper --configfile). The configuration file may be null or
+/// empty. The register width is the given xlen (32 or 64) or, if xlen
+/// is zero, that of the configuration file (32 if not defined there).
+/// The hart is reset and its console output goes to the standard
+/// output. Return null on failure.
+WhisperHart* whisperCreate(const char* configFile, unsigned xlen);
+
+/// Delete the given hart (null is ignored) flushing its console
+/// output.
+void whisperDestroy(WhisperHart* hart);
+
+/// Load the given ELF file into the memory of the given hart and set
+/// the program counter to its entry point. Use the tohost,
+/// __whisper_console_io and __global_pointer$ symbols as whisper does.
+int whisperLoadElf(WhisperHart* hart, const char* path);
+
+/// Load the given hex file into the memory of the given hart.
+int whisperLoadHex(WhisperHart* hart, const char* path);
+
+/// Reset the given hart. If useResetPc is non-zero, resetPc becomes
+/// the reset program counter (as with a WhisperMessage Reset request).
+int whisperReset(WhisperHart* hart, uint64_t resetPc, int useResetPc);
+
+/// Execute one instruction. Set pc and opcode to the address and the
+/// code of the executed instruction, changeCount to the number of its
+/// change records (see whisperChange) and flags to a combination of
+/// WhisperRecordInterrupted, WhisperRecordPreTrigger and
+/// WhisperRecordPostTrigger (see WhisperMessage.h).
+int whisperStep(WhisperHart* hart, uint64_t* pc, uint32_t* opcode,
+		uint32_t* changeCount, uint32_t* flags);
+
+/// Execute instructions until the program counter reaches the given
+/// address, until count instructions are executed, until the target
+/// program finishes or until the hart enters debug-halt mode. Set
+/// executed to the number of executed instructions. The change
+/// records of the last executed instruction remain available (see
+/// whisperChange).
+int whisperStepUntil(WhisperHart* hart, uint64_t address, uint64_t count,
+		     uint64_t* executed);
+
+/// Set resource, address, value and size to the index-th change
+/// record of the last executed instruction. Resource is 'r' (integer
+/// register), 'f' (floating point register), 'c' (CSR) or 'm'
+/// (memory). Size is the byte count of a memory change (the full
+/// value written is reported, it is not split into words) and zero
+/// otherwise. Return 0 if the index is out of bounds.
+int whisperChange(WhisperHart* hart, uint32_t index, uint32_t* resource,
+		  uint64_t* address, uint64_t* value, uint32_t* size);
+
+/// Set value to the given resource: 'r' (integer register), 'f'
+/// (floating point register), 'c' (CSR), 'p' (program counter,
+/// address ignored) or 'm' (memory word, double word in 64-bit harts).
+int whisperPeek(WhisperHart* hart, uint32_t resource, uint64_t address,
+		uint64_t* value);
+
+/// Set the given resource ('r', 'c', 'p' or 'm' as in whisperPeek) to
+/// the given value.
+int whisperPoke(WhisperHart* hart, uint32_t resource, uint64_t address,
+		uint64_t value);
+
+/// Inject an exception of the given WhisperExceptionType at the given
+/// address (as with a WhisperMessage Exception request). Set
+/// matchCount to the number of matching pending loads/stores for an
+/// imprecise load/store fault (zero otherwise).
+int whisperException(WhisperHart* hart, uint32_t type, uint64_t address,
+		     uint32_t* matchCount);
+
+/// Complete the pending load at the given address (as with a
+/// WhisperMessage LoadFinished request). Set matchCount to the number
+/// of matching pending loads.
+int whisperLoadFinished(WhisperHart* hart, uint64_t address,
+			uint32_t* matchCount);
+
+/// Put the given hart in debug-halt mode.
+int whisperEnterDebug(WhisperHart* hart);
+
+/// Take the given hart out of debug mode.
+int whisperExitDebug(WhisperHart* hart);
+
+/// Return 1 if the target program running on the given hart has
+/// finished (wrote to tohost or called exit) and 0 otherwise.
+int whisperFinished(WhisperHart* hart);
+
+/// Evaluate the candidates of whisperWhatIf with the given number of
+/// threads (1 by default). Each thread but the calling one uses a
+/// helper hart sharing the memory of the given hart and configured by
+/// the configuration file of whisperCreate.
+int whisperSetWhatIfThreads(WhisperHart* hart, unsigned threads);
+
+/// Determine the effect of count candidate instructions, the ith with
+/// code opcodes[i] at address pcs[i], each from the current state of
+/// the given hart as if it were the next executed instruction,
+/// without changing that state. The candidates that change only
+/// registers are evaluated concurrently (see whisperSetWhatIfThreads).
+/// The results remain available (see whisperWhatIfResult) until the
+/// next call.
+int whisperWhatIf(WhisperHart* hart, uint32_t count, const uint64_t* pcs,
+		  const uint32_t* opcodes);
+
+/// Set newPc to the program counter following the index-th candidate
+/// of the last whisperWhatIf, exception to 1 if that candidate would
+/// take an exception (0 otherwise) and changeCount to the number of
+/// its change records (see whisperWhatIfChange). Return 0 if the index
+/// is out of bounds.
+int whisperWhatIfResult(WhisperHart* hart, uint32_t index, uint64_t* newPc,
+			uint32_t* exception, uint32_t* changeCount);
+
+/// Set resource, address, value and size to the changeIndex-th change
+/// record of the index-th candidate of the last whisperWhatIf (as
+/// whisperChange does for a step).
+int whisperWhatIfChange(WhisperHart* hart, uint32_t index,
+			uint32_t changeIndex, uint32_t* resource,
+			uint64_t* address, uint64_t* value, uint32_t* size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -23,7 +23,8 @@
 
 enum WhisperMessageType { Peek, Poke, Step, Until, Change, ChangeCount,
 			  Quit, Invalid, Reset, Exception, EnterDebug,
-			  ExitDebug, LoadFinished };
+			  ExitDebug, LoadFinished, StepStream, PeekBlock,
+			  PokeBlock, PeekMulti, PokeMulti, WhatIf };
 
 // Be careful changing this: test-bench file (defines.svh) needs to be
 // updated.
@@ -58,3 +59,112 @@ struct WhisperMessage
   uint64_t value;
   char buffer[128];
 };
+
+
+/// StepStream protocol: The StepStream request executes up to value
+/// instructions (at least one) with one round trip. The resource
+/// field of the request holds WhisperStreamFlags. Whisper stops early
+/// if the target program finishes or if the hart enters debug-halt
+/// mode. The reply is a WhisperMessage of type StepStream with value
+/// set to the number of executed instructions and address set to the
+/// byte count of the step records immediately following the reply on
+/// the socket: one record per executed instruction.
+///
+/// Step record layout (multi-byte fixed-size fields are big-endian,
+/// varint fields use the unsigned LEB128 encoding):
+///   uint16  size          Record size in bytes (including this field).
+///   uint8   flags         WhisperRecordFlags.
+///   uint8   changeCount   Number of change entries.
+///   varint  pc            Address of the executed instruction.
+///   uint32  opcode        Executed instruction.
+///   changeCount entries:
+///     uint8   resource    'r', 'f', 'c' or 'm' (as in Change messages).
+///     varint  address     Register number, CSR number or memory address.
+///     varint  value       New value.
+///   If flags has WhisperRecordText:
+///     uint8   length      Length of disassembly text.
+///     char    text[length] (not null terminated).
+enum WhisperStreamFlags { WhisperStreamDisass = 1 };
+
+enum WhisperRecordFlags { WhisperRecordInterrupted = 1,
+			  WhisperRecordPreTrigger = 2,
+			  WhisperRecordPostTrigger = 4,
+			  WhisperRecordText = 8,
+			  WhisperRecordException = 16 };
+
+
+/// Block and batched peek/poke protocol: The data of these requests
+/// and replies is sent on the socket immediately after the
+/// WhisperMessage header.
+///
+/// PeekBlock: Read value bytes of memory starting at address (at most
+/// WHISPER_MAX_BLOCK bytes). The reply is a PeekBlock message with
+/// value set to the byte count followed by the bytes. If any byte is
+/// out of bounds, the reply is an Invalid message with no data.
+///
+/// PokeBlock: Write the value bytes following the request to memory
+/// starting at address. The reply is a PokeBlock message with value
+/// set to the byte count. If a byte is out of bounds, the bytes
+/// preceding it are written, the following ones are dropped and the
+/// reply is an Invalid message with value set to the number of bytes
+/// written.
+///
+/// PeekMulti: The request is followed by value entries (at most
+/// WHISPER_MAX_ENTRIES) each holding a resource ('r', 'f', 'c' or 'm'
+/// as in a Peek request) and an address. The reply is a PeekMulti
+/// message with value set to the entry count and address set to the
+/// number of failed entries followed by the entries with their value
+/// fields set. A failed entry has its resource field set to zero. If value exceeds
+/// WHISPER_MAX_ENTRIES, the entries are dropped and the reply is an
+/// Invalid message with no data.
+///
+/// PokeMulti: The request is followed by value entries (resource,
+/// address and value as in a Poke request). Entries are applied in
+/// order. The reply is a PokeMulti message with value set to the
+/// number of applied entries or, if an entry fails, an Invalid
+/// message with value set to the number of applied entries and address
+/// set to the index of the first failed entry.
+///
+/// Entry layout (big-endian as the WhisperMessage fields):
+///   uint32  resource
+///   uint64  address
+///   uint64  value       Ignored in a PeekMulti request.
+///
+/// WhatIf: The request is followed by value candidate entries (at
+/// most WHISPER_MAX_ENTRIES) each holding an instruction code in the
+/// resource field and its address in the address field. Whisper
+/// determines the effect of each candidate, from the current state
+/// of the hart as if it were the next executed instruction, without
+/// changing that state (candidates are evaluated by several threads
+/// with whisper --whatifthreads). The reply is a WhatIf message with
+/// value set to the candidate count and address set to the byte count
+/// of the records following it: one step record (see StepStream) per
+/// candidate in request order. The flags of a record have
+/// WhisperRecordException if the candidate would take an exception
+/// and its first change entry is the program counter following the
+/// candidate (resource 'p', address 0). Records hold the disassembly
+/// text if the resource field of the request has WhisperStreamDisass.
+/// If value exceeds WHISPER_MAX_ENTRIES, the entries are dropped and
+/// the reply is an Invalid message with no data.
+#define WHISPER_MAX_BLOCK    (1u << 26)
+#define WHISPER_MAX_ENTRIES  (1u << 20)
+#define WHISPER_ENTRY_SIZE   20
+
+
+/// Decode a varint field of a step record at *p advancing *p past
+/// the field.
+static inline uint64_t
+whisperReadVarint(const uint8_t** p)
+{
+  uint64_t value = 0;
+  unsigned shift = 0;
+  uint8_t byte;
+  do
+    {
+      byte = *(*p)++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      shift += 7;
+    }
+  while (byte & 0x80);
+  return value;
+}
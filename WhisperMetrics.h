@@ -0,0 +1,99 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// Live metrics of a run (whisper --metrics <file>). This header is
+// plain C.
+//
+// The file is a header followed by one block per hart. The blocks are
+// updated in place every 65536 retired instructions (checked between
+// basic blocks) and at the end of a run. A monitor maps the file
+// read-only and takes consistent copies of the blocks with
+// whisperMetricsRead. No lock is involved: the simulation never waits
+// for a reader. With --metricsport, whisper also serves the same data
+// as text over HTTP (Prometheus exposition format).
+
+#include <stdint.h>
+
+
+#define WHISPER_METRICS_MAGIC    0x54454d57   /* "WMET" */
+#define WHISPER_METRICS_VERSION  1
+#define WHISPER_METRICS_HOT_PCS  8
+
+
+/// File header (64 bytes).
+struct WhisperMetricsHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t hartCount;     /* Number of hart blocks following the header. */
+  uint32_t pid;           /* Process id of whisper. */
+  uint32_t reserved0;
+  uint64_t startTime;     /* Start of the run: microseconds since the epoch. */
+  uint64_t reserved[5];
+};
+
+
+/// Metrics of a hart (256 bytes).
+struct WhisperHartMetrics
+{
+  uint64_t sequence;      /* Odd while the block is being updated. */
+  uint64_t time;          /* Update time: microseconds since startTime. */
+  uint64_t retired;       /* Retired instructions. */
+  uint64_t cycles;        /* Cycle count (MCYCLE). */
+  uint64_t pc;            /* Program counter. */
+  uint64_t exceptions;    /* Exceptions taken. */
+  uint64_t interrupts;    /* Interrupts taken. */
+  uint64_t instPerSec;    /* Retired instructions per second since the
+			     previous update. */
+
+  /* Program counters most often seen at updates (a sampled profile:
+     a loop that the hart does not leave shows up as one dominant
+     entry) with their sample counts. Unused entries have zero
+     counts. */
+  uint64_t hotPc[WHISPER_METRICS_HOT_PCS];
+  uint64_t hotSamples[WHISPER_METRICS_HOT_PCS];
+
+  uint64_t reserved[8];
+};
+
+
+/// Copy the given hart block into copy. Return 1 on success and 0 if
+/// no consistent copy could be taken (the block kept changing).
+static inline int
+whisperMetricsRead(const struct WhisperHartMetrics* block,
+		   struct WhisperHartMetrics* copy)
+{
+  const uint64_t* src = (const uint64_t*) block;
+  uint64_t* dst = (uint64_t*) copy;
+  unsigned words = sizeof(*block) / sizeof(uint64_t);
+
+  for (unsigned tries = 0; tries < 1000; ++tries)
+    {
+      uint64_t seq = __atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE);
+      if (seq & 1)
+	continue;
+      for (unsigned i = 0; i < words; ++i)
+	dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&block->sequence, __ATOMIC_RELAXED) == seq)
+	return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,102 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// Instrumentation plugin interface (whisper --plugin <file>[:<arg>]).
+// This header is plain C.
+//
+// A plugin is a shared object exporting whisperPluginInit. Whisper
+// calls it once after loading the plugin. The plugin fills the hooks
+// it needs and leaves the others null:
+//
+//   static void onRetire(void* ctx, uint32_t hart, uint64_t count,
+//                        uint64_t pc, uint32_t inst) { ... }
+//
+//   int whisperPluginInit(uint32_t version, const char* arg,
+//                         uint32_t xlen, WhisperPluginHooks* hooks)
+//   {
+//     if (version != WHISPER_PLUGIN_VERSION) return 0;
+//     hooks->retire = onRetire;
+//     return 1;
+//   }
+//
+// Build with: cc -shared -fPIC -o myplugin.so myplugin.c
+//
+// Only the requested hooks cost anything: the run loop is specialized
+// for the retire and memory hooks in use. Runs with only trap and CSR
+// hooks keep the speed of uninstrumented runs. In multi-hart runs,
+// hooks of different harts may be called concurrently from different
+// threads.
+
+#include <stdint.h>
+#include "WhisperAddrTrace.h"
+
+
+#define WHISPER_PLUGIN_VERSION  1
+
+
+typedef struct WhisperPluginHooks
+{
+  /* Passed as first argument to every hook. */
+  void* context;
+
+  /* Instruction retired: count is the number of instructions retired
+     by the hart before this one. */
+  void (*retire)(void* context, uint32_t hart, uint64_t count, uint64_t pc,
+		 uint32_t inst);
+
+  /* Data memory access of a retired instruction: type is
+     WhisperAddrLoad, WhisperAddrStore or WhisperAddrAmo (see
+     WhisperAddrTrace.h). Called after the retire hook. */
+  void (*memAccess)(void* context, uint32_t hart, uint64_t pc,
+		    uint64_t address, uint32_t size, uint32_t type);
+
+  /* Trap (exception or interrupt if interrupt is non-zero) taken at
+     the given pc with the given cause (MCAUSE without the interrupt
+     bit). */
+  void (*trap)(void* context, uint32_t hart, uint64_t pc, uint64_t cause,
+	       uint32_t interrupt);
+
+  /* CSR written by a CSR instruction at the given pc: value is the
+     resulting CSR value. */
+  void (*csrWrite)(void* context, uint32_t hart, uint64_t pc, uint32_t csr,
+		   uint64_t value);
+
+  /* End of the run (reports are written here). */
+  void (*finish)(void* context);
+} WhisperPluginHooks;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Entry point of a plugin: Fill the given hooks (initially all null)
+/// for a run with harts of the given xlen (32 or 64). Arg is the text
+/// following the colon of the --plugin option (empty if none). Return
+/// non-zero on success and zero to abort the run.
+int whisperPluginInit(uint32_t version, const char* arg, uint32_t xlen,
+		      WhisperPluginHooks* hooks);
+
+typedef int (*WhisperPluginInitFn)(uint32_t version, const char* arg,
+				   uint32_t xlen, WhisperPluginHooks* hooks);
+
+#ifdef __cplusplus
+}
+#endif
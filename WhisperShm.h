@@ -0,0 +1,292 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// Shared memory transport for the whisper server mode (whisper --shm
+// <name>). This header is plain C so that it can be included by the
+// DPI side of a SystemVerilog test-bench.
+//
+// Whisper creates a POSIX shared memory segment holding two single
+// producer/single consumer byte rings: one carrying requests from the
+// test-bench to whisper and one carrying replies back. The bytes
+// exchanged are exactly those of the socket protocol: serialized
+// WhisperMessage structures (see WhisperMessage.h) and, for a
+// StepStream reply, the step records that follow it. A test-bench
+// attaches with whisperShmAttach and then uses whisperShmWrite on the
+// request ring and whisperShmRead on the reply ring.
+//
+// A side waiting for data (or for room) either busy polls or, if
+// whisper was started with --shmfutex, sleeps on a futex. Busy polling
+// gives the smallest latency but burns one host core on each side.
+//
+// Each side records its process id in the segment (whisper when it
+// creates it, the test-bench in whisperShmAttach). A side waiting on
+// the other checks from time to time that the other process is still
+// alive: whisperShmRead and whisperShmWrite return 0 if it is gone
+// (e.g. the test-bench crashed without sending a Quit request).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "WhisperMessage.h"
+
+
+#define WHISPER_SHM_MAGIC      0x5753484d   /* "WSHM" */
+#define WHISPER_SHM_VERSION    1
+#define WHISPER_SHM_RING_SIZE  (1u << 20)  /* Bytes, must be a power of 2. */
+#define WHISPER_SHM_CHECK_POLLS  (1u << 16)  /* Busy polls between checks
+						of the other side. */
+#define WHISPER_SHM_SLEEP_NS   100000000  /* Longest futex sleep (100 ms). */
+
+
+/// One direction of the transport. Head and tail are running byte
+/// counts: the ring holds head - tail bytes. Head is only written by
+/// the producer and tail only by the consumer. Each is on its own
+/// cache line.
+struct WhisperShmRing
+{
+  uint64_t head;          /* Bytes written so far. */
+  char pad0[56];
+  uint64_t tail;          /* Bytes read so far. */
+  char pad1[56];
+  uint32_t headSeq;       /* Futex word: bumped after each write. */
+  uint32_t headWaiters;   /* Consumers sleeping on headSeq. */
+  uint32_t tailSeq;       /* Futex word: bumped after each read. */
+  uint32_t tailWaiters;   /* Producers sleeping on tailSeq. */
+  char pad2[48];
+  uint8_t data[WHISPER_SHM_RING_SIZE];
+};
+
+
+/// Layout of the shared memory segment. Magic is set last by whisper,
+/// once the rest of the segment is initialized.
+struct WhisperShm
+{
+  uint32_t magic;      /* WHISPER_SHM_MAGIC when ready. */
+  uint32_t version;    /* WHISPER_SHM_VERSION. */
+  uint32_t useFutex;   /* Non-zero: sleep on a futex instead of polling. */
+  uint32_t serverPid;  /* Process id of whisper. */
+  uint32_t clientPid;  /* Process id of the test-bench (0: not attached). */
+  char pad[44];
+  struct WhisperShmRing request;   /* Test-bench to whisper. */
+  struct WhisperShmRing reply;     /* Whisper to test-bench. */
+};
+
+
+/// Return the process id of the other side of the given ring for the
+/// given side: the producer if reading is non-zero and the consumer
+/// otherwise. Return 0 if it is not known. The test-bench produces
+/// the request ring and consumes the reply ring.
+static inline uint32_t
+whisperShmPeer(const struct WhisperShm* shm, const struct WhisperShmRing* ring,
+	       int reading)
+{
+  int client = (ring == &shm->request) == (reading != 0);
+  return __atomic_load_n(client ? &shm->clientPid : &shm->serverPid,
+			 __ATOMIC_ACQUIRE);
+}
+
+
+/// Return 0 if the process of the given id is gone and 1 if it is
+/// alive or not known (zero id).
+static inline int
+whisperShmAlive(uint32_t pid)
+{
+  if (pid == 0)
+    return 1;
+  return kill((pid_t) pid, 0) == 0 || errno == EPERM;
+}
+
+
+/// Wait for the given futex word to change from the given value. When
+/// busy polling, return immediately except that every 1024th poll
+/// (per the given poll count) yields the host processor so that the
+/// other side can make progress on a loaded host. Return 0 if the
+/// process of the given id is gone: checked before each futex sleep
+/// (which lasts at most WHISPER_SHM_SLEEP_NS) and every
+/// WHISPER_SHM_CHECK_POLLS busy polls.
+static inline int
+whisperShmWait(const struct WhisperShm* shm, uint32_t* seq,
+	       uint32_t* waiters, uint32_t expected, unsigned polls,
+	       uint32_t peer)
+{
+  if (!shm->useFutex)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+      if ((polls & 1023) == 0)
+	sched_yield();
+      if ((polls & (WHISPER_SHM_CHECK_POLLS - 1)) == 0)
+	return whisperShmAlive(peer);
+      return 1;
+    }
+
+  if (!whisperShmAlive(peer))
+    return 0;
+
+  struct timespec timeout = { 0, WHISPER_SHM_SLEEP_NS };
+  __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(seq, __ATOMIC_SEQ_CST) == expected)
+    syscall(SYS_futex, seq, FUTEX_WAIT, expected, &timeout, NULL, 0);
+  __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+  return 1;
+}
+
+
+/// Bump the given futex word and wake up its sleepers (if any).
+static inline void
+whisperShmWake(const struct WhisperShm* shm, uint32_t* seq, uint32_t* waiters)
+{
+  __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+  if (shm->useFutex && __atomic_load_n(waiters, __ATOMIC_SEQ_CST))
+    syscall(SYS_futex, seq, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+}
+
+
+/// Append the given bytes to the given ring waiting for room as
+/// needed. Return 1 on success and 0 if the consumer of the ring is
+/// gone.
+static inline int
+whisperShmWrite(const struct WhisperShm* shm, struct WhisperShmRing* ring,
+		const void* buffer, size_t size)
+{
+  const uint8_t* p = (const uint8_t*) buffer;
+  const uint64_t mask = WHISPER_SHM_RING_SIZE - 1;
+  unsigned polls = 0;
+
+  while (size)
+    {
+      uint64_t head = ring->head;
+      uint32_t seq = __atomic_load_n(&ring->tailSeq, __ATOMIC_SEQ_CST);
+      uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      size_t room = WHISPER_SHM_RING_SIZE - (size_t) (head - tail);
+      if (room == 0)
+	{
+	  if (!whisperShmWait(shm, &ring->tailSeq, &ring->tailWaiters, seq,
+			      ++polls, whisperShmPeer(shm, ring, 0)))
+	    return 0;
+	  continue;
+	}
+
+      size_t n = size < room ? size : room;
+      size_t offset = head & mask;
+      size_t first = WHISPER_SHM_RING_SIZE - offset;
+      if (first > n)
+	first = n;
+      memcpy(ring->data + offset, p, first);
+      memcpy(ring->data, p + first, n - first);
+
+      __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+      whisperShmWake(shm, &ring->headSeq, &ring->headWaiters);
+      p += n;
+      size -= n;
+    }
+  return 1;
+}
+
+
+/// Remove the given number of bytes from the given ring into the
+/// given buffer waiting for data as needed. Return 1 on success and 0
+/// if the producer of the ring is gone.
+static inline int
+whisperShmRead(const struct WhisperShm* shm, struct WhisperShmRing* ring,
+	       void* buffer, size_t size)
+{
+  uint8_t* p = (uint8_t*) buffer;
+  const uint64_t mask = WHISPER_SHM_RING_SIZE - 1;
+  unsigned polls = 0;
+
+  while (size)
+    {
+      uint64_t tail = ring->tail;
+      uint32_t seq = __atomic_load_n(&ring->headSeq, __ATOMIC_SEQ_CST);
+      uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      size_t avail = (size_t) (head - tail);
+      if (avail == 0)
+	{
+	  if (!whisperShmWait(shm, &ring->headSeq, &ring->headWaiters, seq,
+			      ++polls, whisperShmPeer(shm, ring, 1)))
+	    return 0;
+	  continue;
+	}
+
+      size_t n = size < avail ? size : avail;
+      size_t offset = tail & mask;
+      size_t first = WHISPER_SHM_RING_SIZE - offset;
+      if (first > n)
+	first = n;
+      memcpy(p, ring->data + offset, first);
+      memcpy(p + first, ring->data, n - first);
+
+      __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+      whisperShmWake(shm, &ring->tailSeq, &ring->tailWaiters);
+      p += n;
+      size -= n;
+    }
+  return 1;
+}
+
+
+/// Test-bench side: Attach to the segment of the given name created by
+/// whisper. Return a pointer to the segment or NULL if it does not
+/// exist (yet) or is not ready: the caller should retry. Record the
+/// process id of the caller so that whisper notices if it goes away.
+/// Detach with munmap(shm, sizeof(struct WhisperShm)).
+static inline struct WhisperShm*
+whisperShmAttach(const char* name)
+{
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct WhisperShm))
+    {
+      close(fd);
+      return NULL;
+    }
+
+  void* p = mmap(NULL, sizeof(struct WhisperShm), PROT_READ | PROT_WRITE,
+		 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return NULL;
+
+  struct WhisperShm* shm = (struct WhisperShm*) p;
+  if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != WHISPER_SHM_MAGIC ||
+      shm->version != WHISPER_SHM_VERSION)
+    {
+      munmap(p, sizeof(struct WhisperShm));
+      return NULL;
+    }
+
+  __atomic_store_n(&shm->clientPid, (uint32_t) getpid(), __ATOMIC_RELEASE);
+  return shm;
+}
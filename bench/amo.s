@@ -0,0 +1,17 @@
+# Atomic memory operations (needs the A extension).
+  li a0, 0x20000
+  li s0, 0
+  li s1, 1500000
+  li t2, 3
+loop:
+  amoadd.w t0, t2, (a0)
+  lr.w t1, (a0)
+  addi t1, t1, 1
+  sc.w t3, t1, (a0)
+  amoswap.w t4, t1, (a0)
+  amomax.w t5, s0, (a0)
+  addi s0, s0, 1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright 2018 Western Digital Corporation or its affiliates.
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the Free
+# Software Foundation, either version 3 of the License, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program. If not, see <https://www.gnu.org/licenses/>.
+#
+
+# Throughput benchmark of whisper: Run the kernels of this directory
+# in each execution mode and report the instructions per second as
+# JSON. Usage: bench.py [options] path-to-whisper
+
+import argparse
+import json
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# Kernel name, ISA and extra whisper arguments. The program of kernel
+# x is in x.hex (assembled from x.s, linked at address 0). Kernels
+# stop by writing to the to-host address 0x10000.
+KERNELS = [
+    ("intloop", "imc", []),
+    ("memcpy", "imc", []),
+    ("branch", "imc", []),
+    ("rvc", "imc", []),
+    ("fp", "imfd", []),
+    ("amo", "imac", []),
+    ("trap", "imc", []),
+    ("pic", "imc", ["--configfile", os.path.join(BENCH_DIR, "pic.json")]),
+    ("bigmem", "imc", []),
+]
+
+# run: fast loop (simpleRun).
+# until: per-instruction loop (untilAddress) without trace.
+# trace: per-instruction loop with a text trace to /dev/null.
+# server: server mode, one Step request per instruction plus one
+#         Change request per change (like a test-bench).
+# stream: server mode, StepStream requests of 1024 instructions.
+MODES = ["run", "until", "trace", "server", "stream"]
+
+# Message types and layout from WhisperMessage.h.
+MSG_STEP, MSG_CHANGE, MSG_QUIT, MSG_STEP_STREAM = 2, 4, 6, 13
+MSG_SIZE = 160
+
+
+def whisper_args(whisper, kernel, isa, extra):
+    hex_file = os.path.join(BENCH_DIR, kernel + ".hex")
+    return [whisper, "--hex", hex_file, "--startpc", "0", "--tohost",
+            "0x10000", "--isa", isa] + extra
+
+
+def run_batch(args):
+    """Run whisper to completion and return (instructions, seconds)
+    of its execution modes from its run report (see --reportjson)."""
+    with tempfile.TemporaryDirectory() as tmp:
+        report_file = os.path.join(tmp, "report.json")
+        proc = subprocess.run(args + ["--reportjson", report_file],
+                              stdout=subprocess.DEVNULL,
+                              stderr=subprocess.PIPE, universal_newlines=True)
+        if not os.path.exists(report_file):
+            raise RuntimeError("no run report from: " + " ".join(args) +
+                               "\n" + proc.stderr)
+        with open(report_file) as f:
+            report = json.load(f)
+    # Harts of a multi-hart run share the same run time.
+    harts = [list(h["modes"].values()) for h in report["harts"]]
+    return (sum(m["instructions"] for modes in harts for m in modes),
+            max(sum(m["seconds"] for m in modes) for modes in harts))
+
+
+def message(msg_type, resource=0, address=0, value=0):
+    return struct.pack(">IIIIIII", 0, msg_type, resource, address >> 32,
+                       address & 0xffffffff, value >> 32,
+                       value & 0xffffffff) + bytes(MSG_SIZE - 28)
+
+
+def receive(sock, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise RuntimeError("whisper server closed the connection")
+        data += chunk
+    return bytes(data)
+
+
+def reply(sock):
+    data = receive(sock, MSG_SIZE)
+    _, msg_type, resource, ahi, alo, vhi, vlo = struct.unpack(">IIIIIII",
+                                                              data[:28])
+    return msg_type, resource, (ahi << 32) | alo, (vhi << 32) | vlo
+
+
+def run_server(args, budget, stream):
+    """Run whisper in server mode for up to budget instructions and
+    return (instructions, seconds)."""
+    with tempfile.TemporaryDirectory() as tmp:
+        server_file = os.path.join(tmp, "server")
+        proc = subprocess.Popen(args + ["--server", server_file],
+                                stdout=subprocess.DEVNULL,
+                                stderr=subprocess.DEVNULL)
+        try:
+            deadline = time.time() + 30
+            while not (os.path.exists(server_file) and
+                       open(server_file).read().strip()):
+                if time.time() > deadline or proc.poll() is not None:
+                    raise RuntimeError("whisper server did not start")
+                time.sleep(0.01)
+            port = int(open(server_file).read().split()[1])
+            sock = socket.create_connection(("localhost", port))
+
+            count = 0
+            start = time.time()
+            while count < budget:
+                if stream:
+                    n = min(1024, budget - count)
+                    sock.sendall(message(MSG_STEP_STREAM, 0, 0, n))
+                    _, _, size, executed = reply(sock)
+                    receive(sock, size)
+                else:
+                    sock.sendall(message(MSG_STEP))
+                    msg_type, _, _, changes = reply(sock)
+                    for _ in range(changes):
+                        sock.sendall(message(MSG_CHANGE))
+                        reply(sock)
+                    executed = 1
+                if executed == 0:
+                    break
+                count += executed
+            elapsed = time.time() - start
+
+            sock.sendall(message(MSG_QUIT))
+            sock.close()
+            proc.wait(timeout=30)
+            return count, elapsed
+        finally:
+            if proc.poll() is None:
+                proc.kill()
+
+
+def measure(whisper, kernel, isa, extra, mode, opts):
+    args = whisper_args(whisper, kernel, isa, extra)
+    if mode == "run":
+        return run_batch(args)
+    if mode == "until":
+        return run_batch(args + ["--maxinst", str(10**12)])
+    if mode == "trace":
+        return run_batch(args + ["--logfile", os.devnull, "--maxinst",
+                                 str(opts.trace_budget)])
+    if mode == "server":
+        return run_server(args, opts.server_budget, False)
+    return run_server(args, opts.stream_budget, True)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure whisper throughput (MIPS) per kernel and "
+        "execution mode. Results are written as JSON.")
+    parser.add_argument("whisper", help="Path to the whisper executable")
+    parser.add_argument("--kernels", default=",".join(k[0] for k in KERNELS),
+                        help="Comma separated kernels (default: all)")
+    parser.add_argument("--modes", default=",".join(MODES),
+                        help="Comma separated modes among: " + ",".join(MODES))
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="Runs per measurement, best one is kept")
+    parser.add_argument("--trace-budget", type=int, default=500000,
+                        help="Instruction limit of the trace mode")
+    parser.add_argument("--server-budget", type=int, default=50000,
+                        help="Instruction limit of the server mode")
+    parser.add_argument("--stream-budget", type=int, default=1000000,
+                        help="Instruction limit of the stream mode")
+    parser.add_argument("--extra", default="",
+                        help="Space separated whisper options added to every "
+                        "run (example: --extra='--hugepages thp')")
+    parser.add_argument("--output", help="JSON output file (default: stdout)")
+    opts = parser.parse_args()
+
+    kernels = {k[0]: k for k in KERNELS}
+    modes = opts.modes.split(",")
+    for mode in modes:
+        if mode not in MODES:
+            parser.error("unknown mode '%s'" % mode)
+    for name in opts.kernels.split(","):
+        if name not in kernels:
+            parser.error("unknown kernel '%s'" % name)
+
+    results = []
+    for name in opts.kernels.split(","):
+        _, isa, extra = kernels[name]
+        extra = extra + opts.extra.split()
+        for mode in modes:
+            best = None
+            for _ in range(max(1, opts.repeat)):
+                count, seconds = measure(opts.whisper, name, isa, extra, mode,
+                                         opts)
+                if best is None or seconds * best[0] < best[1] * count:
+                    best = (count, seconds)
+            count, seconds = best
+            mips = count / seconds / 1e6 if seconds > 0 else 0.0
+            results.append({"kernel": name, "mode": mode,
+                            "instructions": count,
+                            "seconds": round(seconds, 6),
+                            "mips": round(mips, 3)})
+            print("%-8s %-7s %10d inst %9.3f MIPS" % (name, mode, count, mips),
+                  file=sys.stderr)
+
+    report = {"whisper": os.path.abspath(opts.whisper),
+              "extra": opts.extra,
+              "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+              "results": results}
+    text = json.dumps(report, indent=2) + "\n"
+    if opts.output:
+        with open(opts.output, "w") as out:
+            out.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
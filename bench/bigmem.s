@@ -0,0 +1,23 @@
+# Large working set: 2M pseudo-random (LCG) word load/store pairs over
+# 64MB at 0x1000000, touching about 16K host pages. Host TLB bound:
+# compare runs with and without --hugepages.
+  li s0, 0
+  li s1, 2000000
+  li s2, 0x01000000
+  li s3, 0x03fffffc
+  li s4, 12345
+  li s5, 1664525
+  li s6, 1013904223
+loop:
+  mul s4, s4, s5
+  add s4, s4, s6
+  and t0, s4, s3
+  add t0, t0, s2
+  lw t1, 0(t0)
+  add t2, t2, t1
+  sw s4, 0(t0)
+  addi s0, s0, 1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,25 @@
+# Data dependent branches driven by a linear congruential generator.
+  li s0, 0
+  li s1, 1500000
+  li s2, 12345
+  li s3, 1103515245
+  li s4, 0
+loop:
+  mul s2, s2, s3
+  addi s2, s2, 0x39
+  andi t0, s2, 0x100
+  beq t0, zero, skip1
+  addi s4, s4, 1
+skip1:
+  andi t1, s2, 0x400
+  bne t1, zero, skip2
+  addi s4, s4, -1
+skip2:
+  blt s2, zero, skip3
+  xori s4, s4, 5
+skip3:
+  addi s0, s0, 1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,20 @@
+# Single precision arithmetic loop (needs the F extension).
+  li t0, 0x6000
+  csrrs zero, mstatus, t0
+  li s0, 0
+  li s1, 1000000
+  li a0, 0x20000
+loop:
+  fcvt.s.w f1, s0
+  fcvt.s.w f2, s1
+  fadd.s f3, f1, f2
+  fmul.s f4, f3, f1
+  fdiv.s f5, f4, f2
+  fsw f5, 0(a0)
+  flw f6, 0(a0)
+  fcvt.w.s t1, f6
+  addi s0, s0, 1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,15 @@
+# Integer ALU loop: 8 instructions per iteration, 2.5M iterations.
+  li s0, 0
+  li s1, 2500000
+loop:
+  addi s0, s0, 1
+  xor t0, s0, s1
+  andi t1, s0, 7
+  slli t2, t1, 2
+  add t3, t2, s0
+  sub t4, t3, t1
+  mul t5, t4, t1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,19 @@
+# Copy 16KB (word at a time) from 0x20000 to 0x30000, 400 times.
+  li s2, 400
+outer:
+  li a0, 0x20000
+  li a1, 0x30000
+  li a2, 4096
+copy:
+  lw t0, 0(a0)
+  addi t0, t0, 3
+  sw t0, 0(a1)
+  addi a0, a0, 4
+  addi a1, a1, 4
+  addi a2, a2, -1
+  bne a2, zero, copy
+  addi s2, s2, -1
+  bne s2, zero, outer
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,20 @@
+# Storm of PIC memory mapped register accesses (see pic.json): set and
+# clear interrupt enables and priorities of all sources.
+  li s0, 0
+  li s1, 300000
+  li a0, 0xf00c0000
+  li a1, 0xf00c2000
+  li t2, 1
+loop:
+  sw t2, 4(a1)
+  sw t2, 8(a1)
+  lw t0, 4(a1)
+  sw s0, 4(a0)
+  lw t1, 4(a0)
+  sw zero, 4(a1)
+  sw zero, 8(a1)
+  addi s0, s0, 1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
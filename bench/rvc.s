@@ -0,0 +1,17 @@
+# Compressed instruction heavy loop (needs the C extension).
+  li s0, 0
+  li s1, 2000000
+  li a0, 0x20000
+loop:
+  c.addi s0, 1
+  c.li a1, 5
+  c.add a1, s0
+  c.sw a1, 0(a0)
+  c.lw a2, 0(a0)
+  c.mv a3, a2
+  c.add a3, a1
+  c.nop
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
@@ -0,0 +1,23 @@
+# Trap heavy loop: ecall and illegal instruction with a CSR heavy handler.
+  li t0, handler
+  csrrw zero, mtvec, t0
+  li s0, 0
+  li s1, 400000
+loop:
+  ecall
+  csrrs t1, mscratch, zero
+  addi t1, t1, 1
+  csrrw zero, mscratch, t1
+  csrrs t2, minstret, zero
+  .word 0xffffffff
+  addi s0, s0, 1
+  bne s0, s1, loop
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
+handler:
+  csrrs t5, mepc, zero
+  csrrs t6, mcause, zero
+  addi t5, t5, 4
+  csrrw zero, mepc, t5
+  mret
@@ -0,0 +1,338 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Merge code coverage files (whisper --coverage) and report the
+// coverage of the functions of an ELF file.
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cinttypes>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include "Coverage.hpp"
+#include "ElfFile.hpp"
+
+
+using namespace WdRiscv;
+
+
+static
+void
+printUsage()
+{
+  std::cerr <<
+    "Usage: whisper-covmerge [options] coverage-file ...\n"
+    "Merge (OR) code coverage files written by whisper --coverage and\n"
+    "report the coverage of the functions of a program.\n"
+    "Options:\n"
+    "  -o, --output file     Write the merged coverage to the given file.\n"
+    "  -l, --list file       Also merge the coverage files listed in the\n"
+    "                        given file (one per line).\n"
+    "  -j, --jobs n          Number of reading threads (default: host\n"
+    "                        cores).\n"
+    "  -e, --elf file        Report the coverage of each function of the\n"
+    "                        given ELF file (on standard output unless\n"
+    "                        --report is used).\n"
+    "  -r, --report file     Write the function report to the given file.\n"
+    "  -u, --uncovered file  Write the address ranges of the instructions\n"
+    "                        of the ELF functions that were never executed\n"
+    "                        (first column may be passed to addr2line to\n"
+    "                        obtain source lines).\n";
+}
+
+
+/// Merge the given files into the given coverage using the given
+/// number of threads. Return true if all the files could be read.
+static
+bool
+mergeFiles(const std::vector<std::string>& files, unsigned jobs,
+	   Coverage& merged)
+{
+  jobs = std::max(1u, std::min(jobs, unsigned(files.size())));
+
+  std::vector<Coverage> partial(jobs);
+  std::atomic<size_t> next(0);
+  std::atomic<bool> ok(true);
+
+  auto worker = [&] (unsigned id) {
+    for (size_t ix = next++; ix < files.size(); ix = next++)
+      if (not partial.at(id).read(files.at(ix)))
+	ok = false;
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; ++i)
+    threads.emplace_back(worker, i);
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& cov : partial)
+    merged.merge(cov);
+  return ok;
+}
+
+
+/// A function of the ELF file: Symbol with a non-zero size in an
+/// executable segment.
+struct Function
+{
+  std::string name;
+  uint64_t addr = 0;
+  uint64_t size = 0;
+  const uint8_t* code = nullptr;   // Contents in the ELF file.
+};
+
+
+/// Collect the functions of the given ELF file sorted by address.
+static
+std::vector<Function>
+collectFunctions(const ElfFile& elf)
+{
+  std::unordered_map<std::string, ElfSymbol> symbols;
+  elf.collectSymbols(symbols);
+
+  std::vector<Function> funcs;
+  for (const auto& [name, sym] : symbols)
+    {
+      if (sym.size_ == 0 or name.empty() or name.front() == '$' or
+	  name.compare(0, 2, ".L") == 0)
+	continue;
+      for (const auto& seg : elf.loadSegments())
+	if (seg.exec and sym.addr_ >= seg.addr and
+	    sym.addr_ + sym.size_ <= seg.addr + seg.fileSize)
+	  {
+	    funcs.push_back({name, sym.addr_, sym.size_,
+			     seg.data + (sym.addr_ - seg.addr)});
+	    break;
+	  }
+    }
+
+  std::sort(funcs.begin(), funcs.end(),
+	    [] (const Function& a, const Function& b) {
+	      return a.addr < b.addr or (a.addr == b.addr and a.name < b.name);
+	    });
+  return funcs;
+}
+
+
+/// Report the instruction and branch coverage of each of the given
+/// functions. Write the address ranges of unexecuted instructions to
+/// the uncovered file if it is not null.
+static
+void
+reportFunctions(const std::vector<Function>& funcs, const Coverage& cov,
+		FILE* out, FILE* uncovered)
+{
+  bool branches = cov.hasBranches();
+  uint64_t totalInsts = 0, totalExec = 0, totalBranches = 0, totalBoth = 0;
+
+  fprintf(out, "%10s %10s %7s", "executed", "insts", "cover");
+  if (branches)
+    fprintf(out, " %10s %10s", "both-ways", "branches");
+  fprintf(out, "  function\n");
+
+  for (const auto& func : funcs)
+    {
+      uint64_t insts = 0, exec = 0, condBranches = 0, both = 0;
+      uint64_t gapStart = 0;
+      bool inGap = false;
+
+      // Walk the instructions: The size of an instruction is given by
+      // its 2 least significant bits.
+      uint64_t offset = 0;
+      while (offset + 2 <= func.size)
+	{
+	  uint32_t inst = func.code[offset] | (func.code[offset+1] << 8);
+	  unsigned size = (inst & 3) == 3 ? 4 : 2;
+	  if (offset + size > func.size)
+	    break;
+	  if (size == 4)
+	    inst |= (func.code[offset+2] << 16) | (uint32_t(func.code[offset+3]) << 24);
+
+	  uint64_t addr = func.addr + offset;
+	  insts++;
+	  bool executed = cov.isExecuted(addr);
+	  exec += executed;
+	  if (branches and Coverage::isConditionalBranch(inst))
+	    {
+	      condBranches++;
+	      both += cov.isTaken(addr) and cov.isNotTaken(addr);
+	    }
+
+	  if (uncovered)
+	    {
+	      if (not executed and not inGap)
+		{
+		  gapStart = addr;
+		  inGap = true;
+		}
+	      else if (executed and inGap)
+		{
+		  fprintf(uncovered, "0x%" PRIx64 " 0x%" PRIx64 " %s+0x%" PRIx64 "\n",
+			  gapStart, addr, func.name.c_str(), gapStart - func.addr);
+		  inGap = false;
+		}
+	    }
+	  offset += size;
+	}
+
+      if (uncovered and inGap)
+	fprintf(uncovered, "0x%" PRIx64 " 0x%" PRIx64 " %s+0x%" PRIx64 "\n",
+		gapStart, func.addr + offset, func.name.c_str(),
+		gapStart - func.addr);
+
+      double pct = insts ? 100.0 * exec / insts : 0;
+      fprintf(out, "%10" PRIu64 " %10" PRIu64 " %6.2f%%", exec, insts, pct);
+      if (branches)
+	fprintf(out, " %10" PRIu64 " %10" PRIu64, both, condBranches);
+      fprintf(out, "  %s\n", func.name.c_str());
+
+      totalInsts += insts;
+      totalExec += exec;
+      totalBranches += condBranches;
+      totalBoth += both;
+    }
+
+  double pct = totalInsts ? 100.0 * totalExec / totalInsts : 0;
+  fprintf(out, "%10" PRIu64 " %10" PRIu64 " %6.2f%%", totalExec, totalInsts,
+	  pct);
+  if (branches)
+    fprintf(out, " %10" PRIu64 " %10" PRIu64, totalBoth, totalBranches);
+  fprintf(out, "  [total]\n");
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  std::vector<std::string> files;
+  std::string outPath, elfPath, reportPath, uncoveredPath;
+  unsigned jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+  for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      auto value = [&] () -> const char* {
+	if (i + 1 >= argc)
+	  {
+	    std::cerr << "Missing value of option " << arg << '\n';
+	    exit(1);
+	  }
+	return argv[++i];
+      };
+
+      if (arg == "-h" or arg == "--help")
+	{
+	  printUsage();
+	  return 0;
+	}
+      else if (arg == "-o" or arg == "--output")
+	outPath = value();
+      else if (arg == "-e" or arg == "--elf")
+	elfPath = value();
+      else if (arg == "-r" or arg == "--report")
+	reportPath = value();
+      else if (arg == "-u" or arg == "--uncovered")
+	uncoveredPath = value();
+      else if (arg == "-j" or arg == "--jobs")
+	jobs = std::max(1, atoi(value()));
+      else if (arg == "-l" or arg == "--list")
+	{
+	  const char* listPath = value();
+	  std::ifstream list(listPath);
+	  if (not list.good())
+	    {
+	      std::cerr << "Failed to open file '" << listPath
+			<< "' for input\n";
+	      return 1;
+	    }
+	  std::string line;
+	  while (std::getline(list, line))
+	    if (not line.empty() and line.front() != '#')
+	      files.push_back(line);
+	}
+      else if (not arg.empty() and arg.front() == '-')
+	{
+	  std::cerr << "Unknown option: " << arg << '\n';
+	  printUsage();
+	  return 1;
+	}
+      else
+	files.push_back(arg);
+    }
+
+  if (files.empty())
+    {
+      printUsage();
+      return 1;
+    }
+
+  if (not reportPath.empty() and elfPath.empty())
+    std::cerr << "Warning: Option --report requires --elf -- ignored\n";
+  if (not uncoveredPath.empty() and elfPath.empty())
+    std::cerr << "Warning: Option --uncovered requires --elf -- ignored\n";
+
+  Coverage merged;
+  bool ok = mergeFiles(files, jobs, merged);
+
+  if (not outPath.empty())
+    ok = merged.write(outPath) and ok;
+
+  if (not elfPath.empty())
+    {
+      ElfFile elf;
+      if (not elf.open(elfPath))
+	return 1;
+
+      FILE* out = stdout;
+      if (not reportPath.empty())
+	{
+	  out = fopen(reportPath.c_str(), "w");
+	  if (not out)
+	    {
+	      std::cerr << "Failed to open file '" << reportPath
+			<< "' for output\n";
+	      return 1;
+	    }
+	}
+
+      FILE* uncovered = nullptr;
+      if (not uncoveredPath.empty())
+	{
+	  uncovered = fopen(uncoveredPath.c_str(), "w");
+	  if (not uncovered)
+	    {
+	      std::cerr << "Failed to open file '" << uncoveredPath
+			<< "' for output\n";
+	      return 1;
+	    }
+	}
+
+      reportFunctions(collectFunctions(elf), merged, out, uncovered);
+
+      if (out != stdout)
+	fclose(out);
+      if (uncovered)
+	fclose(uncovered);
+    }
+
+  return ok ? 0 : 1;
+}
@@ -18,25 +18,156 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sstream>
 #include <boost/format.hpp>
 #include "Core.hpp"
 
 
+namespace WdRiscv
+{
+  /// Connection to gdb: Standard input/output (default) or a TCP
+  /// socket (see openGdbTcpPort). Input is read in large chunks and
+  /// output is accumulated until a packet is complete so that a
+  /// packet costs one system call each way instead of one per
+  /// character. Each hart refers to its connection (see
+  /// Core::setGdbChannel).
+  struct GdbChannel
+  {
+    int inFd = 0;
+    int outFd = 1;
+    char inBuf[64*1024];
+    size_t inPos = 0;
+    size_t inEnd = 0;
+    std::string out;
+    bool noAck = false;     // No-acknowledgment mode (QStartNoAckMode).
+  };
+}
+
+
+namespace
+{
+  using WdRiscv::GdbChannel;
+
+  /// Largest packet accepted from gdb (reported in qSupported reply).
+  constexpr size_t gdbMaxPacketSize = 0x20000;
+}
+
+
+/// Write the buffered output characters to gdb.
 static
-int
-putDebugChar(char c)
+void
+flushDebugOutput(GdbChannel& chan)
+{
+  if (chan.out.empty())
+    return;
+
+  // Keep target program output (also on standard output) ordered
+  // with respect to the packets.
+  if (chan.outFd == 1)
+    fflush(stdout);
+
+  const char* data = chan.out.data();
+  size_t remain = chan.out.size();
+  while (remain)
+    {
+      ssize_t n = write(chan.outFd, data, remain);
+      if (n < 0 and errno == EINTR)
+	continue;
+      if (n <= 0)
+	{
+	  std::cerr << "Failed to write to gdb: " << strerror(errno) << '\n';
+	  exit(1);
+	}
+      data += n;
+      remain -= n;
+    }
+  chan.out.clear();
+}
+
+
+static
+void
+putDebugChar(GdbChannel& chan, char c)
 {
-  return putchar(c);
+  chan.out.push_back(c);
 }
 
 
 static
 int
-getDebugChar()
+getDebugChar(GdbChannel& chan)
+{
+  if (chan.inPos == chan.inEnd)
+    {
+      flushDebugOutput(chan);
+      ssize_t n = 0;
+      do
+	n = read(chan.inFd, chan.inBuf, sizeof(chan.inBuf));
+      while (n < 0 and errno == EINTR);
+      if (n <= 0)
+	{
+	  std::cerr << "Connection to gdb closed\n";
+	  exit(0);
+	}
+      chan.inPos = 0;
+      chan.inEnd = n;
+    }
+  return static_cast<unsigned char>(chan.inBuf[chan.inPos++]);
+}
+
+
+std::shared_ptr<GdbChannel>
+openGdbTcpPort(unsigned port)
 {
-  return getchar();
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    {
+      std::cerr << "Failed to create gdb socket: " << strerror(errno) << '\n';
+      return nullptr;
+    }
+
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(sock, (sockaddr*) &addr, sizeof(addr)) < 0 or listen(sock, 1) < 0)
+    {
+      std::cerr << "Failed to listen for gdb on port " << port << ": "
+		<< strerror(errno) << '\n';
+      close(sock);
+      return nullptr;
+    }
+
+  std::cerr << "Waiting for gdb connection on port " << port << '\n';
+  int conn = accept(sock, nullptr, nullptr);
+  close(sock);
+  if (conn < 0)
+    {
+      std::cerr << "Failed to accept gdb connection: " << strerror(errno)
+		<< '\n';
+      return nullptr;
+    }
+
+  // Packets are small and latency bound: Do not delay them.
+  setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  auto chan = std::make_shared<GdbChannel>();
+  chan->inFd = conn;
+  chan->outFd = conn;
+  return chan;
 }
 
 
@@ -107,7 +238,7 @@ getStringComponents(const std::string& str, char delim1, char delim2,
   comp1 = str.substr(0, delim1Ix);
 
   auto delim2Ix = str.find(delim2, delim1Ix + 1);
-  if (delim1Ix == std::string::npos)
+  if (delim2Ix == std::string::npos)
     return false;
 
   comp2 = str.substr(delim1Ix + 1, delim2Ix - delim1Ix - 1);
@@ -120,7 +251,7 @@ getStringComponents(const std::string& str, char delim1, char delim2,
 // checksum is incorrect. Return succesfully received packet.
 static
 std::string
-receivePacketFromGdb()
+receivePacketFromGdb(GdbChannel& chan)
 {
   std::string data;  // Data part of packet.
 
@@ -129,12 +260,13 @@ receivePacketFromGdb()
   while (1)
     {
       while (ch != '$')
-	ch = getDebugChar();
+	ch = getDebugChar(chan);
 
+      data.clear();
       uint8_t sum = 0;  // checksum
       while (1)
 	{
-	  ch = getDebugChar();
+	  ch = getDebugChar(chan);
           if (ch == '$')
             break;
 	  if (ch == '#')
@@ -148,29 +280,32 @@ receivePacketFromGdb()
 
       if (ch == '#')
 	{
-	  ch = getDebugChar();
+	  ch = getDebugChar(chan);
 	  uint8_t pacSum = hexCharToInt(ch) << 4; // Packet checksum
-	  ch = getDebugChar();
+	  ch = getDebugChar(chan);
 	  pacSum += hexCharToInt(ch);
 
+	  if (chan.noAck)
+	    return data;
+
 	  if (sum != pacSum)
 	    {
 	      std::cerr << "Bad checksum form gdb: "
 			<< (boost::format("%02x v %02x") % unsigned(sum) %
 			    unsigned(pacSum))
 			<< '\n';
-	      putDebugChar('-'); // Signal failed reception.
+	      putDebugChar(chan, '-'); // Signal failed reception.
+	      flushDebugOutput(chan);
 	    }
 	  else
 	    {
-	      putDebugChar('+');  // Signal successul reception.
-	      fflush(stdout);
+	      putDebugChar(chan, '+');  // Signal successul reception.
 
 	      // If sequence char present, reply with sequence id.
 	      if (data.size() >= 3 and data.at(2) == ':')
 		{
-		  putDebugChar(data.at(0));
-		  putDebugChar(data.at(1));
+		  putDebugChar(chan, data.at(0));
+		  putDebugChar(chan, data.at(1));
 		  data = data.substr(3);
 		}
 #if 0
@@ -187,40 +322,78 @@ receivePacketFromGdb()
 
 
 // Send given data string as a gdb remote packet. Resend until a
-// positive ack is received.
+// positive ack is received (unless in no-acknowledgment mode).
 //
 // Format of packet:  $<data>#<checksum>
 //
-// TODO: quote special characters.
+// Binary data must be escaped by the caller (see escapeBinary).
 static void
-sendPacketToGdb(const std::string& data)
+sendPacketToGdb(GdbChannel& chan, const std::string& data)
 {
   const char hexDigit[] = "0123456789abcdef";
 
   while (true)
     {
-      putDebugChar('$');
+      putDebugChar(chan, '$');
       unsigned char checksum = 0;
       for (unsigned char c : data)
-	{
-	  putDebugChar(c);
-	  checksum += c;
-	}
+	checksum += c;
+      chan.out.append(data);
 
-      putDebugChar('#');
-      putDebugChar(hexDigit[checksum >> 4]);
-      putDebugChar(hexDigit[checksum & 0xf]);
-      fflush(stdout);
+      putDebugChar(chan, '#');
+      putDebugChar(chan, hexDigit[checksum >> 4]);
+      putDebugChar(chan, hexDigit[checksum & 0xf]);
+      flushDebugOutput(chan);
 
       // std::cerr << "Send to gdb: " << data << '\n';
 
-      char c = getDebugChar();
+      if (chan.noAck)
+	return;
+
+      char c = getDebugChar(chan);
       if (c == '+')
 	return;
     }
 }
 
 
+/// Append to the given string the binary data of the given size
+/// escaping the characters that are special in packets.
+static
+void
+escapeBinary(const char* data, size_t size, std::string& result)
+{
+  for (size_t i = 0; i < size; ++i)
+    {
+      char c = data[i];
+      if (c == '$' or c == '#' or c == '}' or c == '*')
+	{
+	  result.push_back('}');
+	  c ^= 0x20;
+	}
+      result.push_back(c);
+    }
+}
+
+
+/// Remove the escapes from the given binary data received from gdb.
+static
+std::string
+unescapeBinary(const std::string& data)
+{
+  std::string result;
+  result.reserve(data.size());
+  for (size_t i = 0; i < data.size(); ++i)
+    {
+      char c = data[i];
+      if (c == '}' and i + 1 < data.size())
+	c = data[++i] ^ 0x20;
+      result.push_back(c);
+    }
+  return result;
+}
+
+
 /// Return hexadecimal representation of given integer register value.
 template <typename T>
 std::string
@@ -341,13 +514,67 @@ handlePeekRegisterForGdb(WdRiscv::Core<URV>& core, unsigned regNum,
 }
 
 
+/// Reply to a qXfer:features:read:annex:offset,length request. The
+/// only annex is the target description which names the architecture
+/// so that gdb uses its built-in RISCV register set.
 template <typename URV>
 void
-handleExceptionForGdb(WdRiscv::Core<URV>& core)
+handleFeaturesReadForGdb(WdRiscv::Core<URV>&, const std::string& packet,
+			 std::ostream& reply)
+{
+  std::string args = packet.substr(strlen("qXfer:features:read:"));
+  std::string annex, offsetStr, lengthStr;
+  size_t offset = 0, length = 0;
+  if (not getStringComponents(args, ':', ',', annex, offsetStr, lengthStr) or
+      not hexToInt(offsetStr, offset) or not hexToInt(lengthStr, length))
+    {
+      reply << "E01";
+      return;
+    }
+
+  if (annex != "target.xml")
+    {
+      reply << "E00";
+      return;
+    }
+
+  std::string xml = "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "<architecture>riscv:rv";
+  xml += sizeof(URV) == 4 ? "32" : "64";
+  xml += "</architecture>\n</target>\n";
+
+  if (offset >= xml.size())
+    {
+      reply << "l";
+      return;
+    }
+
+  size_t count = std::min(length, xml.size() - offset);
+  std::string data(offset + count < xml.size() ? "m" : "l");
+  escapeBinary(xml.data() + offset, count, data);
+  reply << data;
+}
+
+
+/// Report a stop to gdb and serve its requests until it resumes the
+/// target. Stop info (e.g. "replaylog:begin;") is added to the stop
+/// reply.
+template <typename URV>
+static
+void
+serveGdb(WdRiscv::Core<URV>& core, const char* stopInfo)
 {
   // The trap handler is expected to set the PC to point to the instruction
   // after the one with the exception if necessary/possible.
 
+  // Without a connection of its own, the hart talks to gdb on the
+  // standard input/output.
+  if (not core.gdbChannel())
+    core.setGdbChannel(std::make_shared<GdbChannel>());
+  GdbChannel& chan = *core.gdbChannel();
+
   // Construct a reply of the form T xx n1:r1;n2:r2;... where xx is
   // the trap cause and ni is a resource (e.g. register number) and ri
   // is the resource data (e.g. content of register).
@@ -364,12 +591,27 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 
   reply << "T" << (boost::format("%02x") % signalNum);
 
+  // Report the watched access that stopped the target.
+  WdRiscv::StopPoints::Watch watch;
+  uint64_t watchAddr = 0;
+  if (core.stopPoints().watchHit(watch, watchAddr))
+    {
+      using Access = WdRiscv::StopPoints::Access;
+      const char* kind = "awatch";
+      if (watch.access == Access::Write)
+	kind = "watch";
+      else if (watch.access == Access::Read)
+	kind = "rwatch";
+      reply << kind << ':' << std::hex << watchAddr << std::dec << ';';
+    }
+  reply << stopInfo;
+
   URV spVal = 0;
   URV spNum = WdRiscv::RegSp;
   core.peekIntReg(spNum, spVal);
   reply << (boost::format("%02x") % spNum) << ':'
 	<< littleEndianIntToHex(spVal) << ';';
-  sendPacketToGdb(reply.str());
+  sendPacketToGdb(chan, reply.str());
 
   bool gotQuit = false;
 
@@ -378,7 +620,7 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
       reply.str("");
       reply.clear();
 
-      std::string packet = receivePacketFromGdb();
+      std::string packet = receivePacketFromGdb(chan);
       if (packet.empty())
 	continue;
 
@@ -441,12 +683,17 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 		  reply << "E02";
 		else
 		  {
+		    const char hexDigit[] = "0123456789abcdef";
+		    std::string hex;
+		    hex.reserve(2*len);
 		    for (URV ix = 0; ix < len; ++ix)
 		      {
 			uint8_t byte = 0;
 			core.peekMemory(addr++, byte);
-			reply << (boost::format("%02x") % unsigned(byte));
+			hex.push_back(hexDigit[byte >> 4]);
+			hex.push_back(hexDigit[byte & 0xf]);
 		      }
+		    reply << hex;
 		  }
 	      }
 	  }
@@ -482,6 +729,32 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 	  }
 	  break;
 
+	case 'X': // XAA..AA,LLLL:bb..  Write LLLL binary bytes at AA..AA
+	  {
+	    auto colonIx = packet.find(':');
+	    std::string addrStr, lenStr;
+	    if (colonIx == std::string::npos or
+		not getStringComponents(packet.substr(1, colonIx - 1), ',',
+					addrStr, lenStr))
+	      reply << "E01";
+	    else
+	      {
+		URV addr = 0, len = 0;
+		std::string data = unescapeBinary(packet.substr(colonIx + 1));
+		if (not hexToInt(addrStr, addr) or not hexToInt(lenStr, len))
+		  reply << "E02";
+		else if (data.size() != len)
+		  reply << "E03";
+		else
+		  {
+		    for (unsigned char byte : data)
+		      core.pokeMemory(addr++, uint8_t(byte));
+		    reply << "OK";
+		  }
+	      }
+	  }
+	  break;
+
 	case 'c':  // cAA..AA    Continue at address AA..AA(optional)
 	  {
 	    if (packet.size() == 1)
@@ -541,9 +814,65 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 
 	case 's':
 	  core.singleStep(nullptr);
-	  handleExceptionForGdb(core);
+	  serveGdb(core, "");
 	  return;
 
+	case 'b':  // bs/bc  Reverse step/continue (see Core::enableReverse)
+	  if (core.isReverseEnabled() and (packet == "bs" or packet == "bc"))
+	    {
+	      bool ok = (packet == "bs" ? core.reverseStep() :
+			 core.reverseContinue());
+	      serveGdb(core, ok ? "" : "replaylog:begin;");
+	      return;
+	    }
+	  reply << "";
+	  break;
+
+	case 'Z':  // Ztype,addr,kind  Insert breakpoint/watchpoint
+	case 'z':  // ztype,addr,kind  Remove breakpoint/watchpoint
+	  {
+	    // Types: 0/1 software/hardware breakpoint, 2/3/4
+	    // write/read/access watchpoint. For a watchpoint, kind is the
+	    // number of watched bytes.
+	    std::string typeStr, addrStr, kindStr;
+	    URV type = 0, addr = 0, kind = 0;
+	    bool insert = packet.at(0) == 'Z';
+	    if (not getStringComponents(packet.substr(1), ',', ',', typeStr,
+					addrStr, kindStr))
+	      reply << "E01";
+	    else if (not hexToInt(typeStr, type) or not hexToInt(addrStr, addr)
+		     or not hexToInt(kindStr, kind))
+	      reply << "E02";
+	    else if (type > 4)
+	      reply << "";  // Unsupported type.
+	    else
+	      {
+		auto& points = core.stopPoints();
+		if (type <= 1)
+		  {
+		    if (insert)
+		      points.addBreakpoint(addr);
+		    else
+		      points.removeBreakpoint(addr);
+		  }
+		else
+		  {
+		    using Access = WdRiscv::StopPoints::Access;
+		    Access access = Access::Any;
+		    if (type == 2)
+		      access = Access::Write;
+		    else if (type == 3)
+		      access = Access::Read;
+		    if (insert)
+		      points.addWatchpoint(addr, kind, access);
+		    else
+		      points.removeWatchpoint(addr, kind, access);
+		  }
+		reply << "OK";
+	      }
+	  }
+	  break;
+
 	case 'k':  // kill
 	  reply << "OK";
 	  gotQuit = true;
@@ -556,6 +885,13 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 	    reply << "Text=0;Data=0;Bss=0";
 	  else if (packet == "qSymbol::")
 	    reply << "OK";
+	  else if (packet.find("qSupported") == 0)
+	    reply << "PacketSize=" << std::hex << gdbMaxPacketSize << std::dec
+		  << ";QStartNoAckMode+;qXfer:features:read+;vContSupported+"
+		  << (core.isReverseEnabled() ?
+		      ";ReverseStep+;ReverseContinue+" : "");
+	  else if (packet.find("qXfer:features:read:") == 0)
+	    handleFeaturesReadForGdb(core, packet, reply);
 	  else
 	    {
 	      std::cerr << "Unhandled gdb request: " << packet << '\n';
@@ -563,9 +899,39 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 	    }
 	  break;
 
+	case 'Q':
+	  if (packet == "QStartNoAckMode")
+	    {
+	      // Last acknowledged packet: Acknowledgments stop after the
+	      // reply.
+	      sendPacketToGdb(chan, "OK");
+	      chan.noAck = true;
+	      continue;
+	    }
+	  std::cerr << "Unhandled gdb request: " << packet << '\n';
+	  reply << "";
+	  break;
+
 	case 'v':
 	  if (packet == "vMustReplyEmpty")
 	    reply << "";
+	  else if (packet == "vCont?")
+	    reply << "vCont;c;C;s;S";
+	  else if (packet.find("vCont;") == 0 and packet.size() > 6)
+	    {
+	      // Single thread: The first action applies. Signals are
+	      // not delivered to the target.
+	      char action = packet.at(6);
+	      if (action == 'c' or action == 'C')
+		return;
+	      if (action == 's' or action == 'S')
+		{
+		  core.singleStep(nullptr);
+		  serveGdb(core, "");
+		  return;
+		}
+	      reply << "E01";
+	    }
 	  else if (packet.find("vKill;") == 0)
 	    {
 	      reply << "OK";
@@ -584,7 +950,7 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 	}
 
       // Reply to the request
-      sendPacketToGdb(reply.str());
+      sendPacketToGdb(chan, reply.str());
 
       if (gotQuit)
 	exit(0);
@@ -592,5 +958,13 @@ handleExceptionForGdb(WdRiscv::Core<URV>& core)
 }
 
 
+template <typename URV>
+void
+handleExceptionForGdb(WdRiscv::Core<URV>& core)
+{
+  serveGdb(core, "");
+}
+
+
 template void handleExceptionForGdb<uint32_t>(WdRiscv::Core<uint32_t>&);
 template void handleExceptionForGdb<uint64_t>(WdRiscv::Core<uint64_t>&);
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright 2018 Western Digital Corporation or its affiliates.
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the Free
+# Software Foundation, either version 3 of the License, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program. If not, see <https://www.gnu.org/licenses/>.
+#
+
+# Functional checks of whisper: Run the programs of this directory and
+# check their outcome. Usage: check.py path-to-whisper
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+
+TEST_DIR = os.path.dirname(os.path.abspath(__file__))
+BENCH_DIR = os.path.join(os.path.dirname(TEST_DIR), "bench")
+
+
+def test_path(name):
+    return os.path.join(TEST_DIR, name)
+
+
+def run(whisper, program, isa, extra):
+    """Run the given program (x.hex, assembled from x.s, linked at
+    address 0, in this directory or, for bench/x, in the bench
+    directory) to its write to the to-host address 0x10000. Without
+    a program, the run resumes a checkpoint given in extra. Return
+    (exit code, stderr)."""
+    args = [whisper, "--tohost", "0x10000", "--isa", isa] + extra
+    if program:
+        hex_file = (os.path.join(BENCH_DIR, program[6:] + ".hex")
+                    if program.startswith("bench/")
+                    else test_path(program + ".hex"))
+        args += ["--hex", hex_file, "--startpc", "0"]
+    proc = subprocess.run(args, stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE, universal_newlines=True,
+                          timeout=60)
+    return proc.returncode, proc.stderr
+
+
+def check_timer_harts(whisper):
+    """A hart cannot store to the timer of another hart."""
+    code, err = run(whisper, "timerharts", "imc",
+                    ["--configfile", test_path("timer.json")])
+    if code != 0 or "Successful stop" not in err:
+        return "run failed:\n" + err
+    return None
+
+
+def check_checkpoint_causes(whisper):
+    """The per-cause trap counts of a run resumed from a checkpoint add
+    up to its trap counts."""
+    with tempfile.TemporaryDirectory() as tmp:
+        checkpoint = os.path.join(tmp, "trap.ckp")
+        code, err = run(whisper, "bench/trap", "imc",
+                        ["--checkpointat", "1000000",
+                         "--savecheckpoint", checkpoint])
+        if not os.path.exists(checkpoint):
+            return "no checkpoint:\n" + err
+
+        report_file = os.path.join(tmp, "report.json")
+        code, err = run(whisper, None, "imc",
+                        ["--loadcheckpoint", checkpoint,
+                         "--reportjson", report_file])
+        if code != 0 or not os.path.exists(report_file):
+            return "resumed run failed:\n" + err
+        with open(report_file) as f:
+            hart = json.load(f)["harts"][0]
+
+    for kind in ("exception", "interrupt"):
+        total = hart[kind + "s"]
+        causes = sum(hart[kind + "Causes"].values())
+        if total != causes:
+            return "%ss: %d, sum of %sCauses: %d" % (kind, total, kind, causes)
+    if hart["exceptions"] == 0:
+        return "no exception counted"
+    return None
+
+
+CHECKS = [
+    ("timer-harts", check_timer_harts),
+    ("checkpoint-causes", check_checkpoint_causes),
+]
+
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: check.py path-to-whisper", file=sys.stderr)
+        return 1
+    whisper = os.path.abspath(sys.argv[1])
+
+    failed = 0
+    for name, check in CHECKS:
+        error = check(whisper)
+        if error:
+            failed += 1
+            print("FAIL " + name + ": " + error)
+        else:
+            print("ok   " + name)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,35 @@
+# Two harts, each with its own timer (see timer.json). Hart 0 reads
+# its own mtimecmp then stores to the mtimecmp of hart 1, which must
+# fail with a store access fault (mcause 7). Hart 1 checks that its
+# mtimecmp is never modified. Pass: hart 0 writes 1 to the to-host
+# address 0x10000.
+  csrrs t0, mhartid, zero
+  bne t0, zero, hart1
+  li t0, 0x100
+  csrrw zero, mtvec, t0
+  li a0, 0xc0000000
+  lw t1, 8(a0)
+  li t2, -1
+  bne t1, t2, fail
+  sw zero, 24(a0)
+fail:
+  li t0, 0x10000
+  li t1, 3
+  sw t1, 0(t0)
+  j fail
+hart1:
+  li a0, 0xc0000000
+  li t2, -1
+hart1loop:
+  lw t1, 24(a0)
+  bne t1, t2, fail
+  j hart1loop
+.org 0x100
+handler:
+  csrrs t1, mcause, zero
+  li t2, 7
+  bne t1, t2, fail
+  li t0, 0x10000
+  li t1, 1
+  sw t1, 0(t0)
+  j handler
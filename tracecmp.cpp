@@ -0,0 +1,765 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Compare two instruction traces (whisper --logfile or --binlogfile)
+// and report their first divergence.
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Core.hpp"
+#include "BinaryTrace.hpp"
+
+
+using namespace WdRiscv;
+
+
+static
+void
+printUsage()
+{
+  std::cerr <<
+    "Usage: whisper-tracecmp [options] trace1 trace2\n"
+    "Compare two instruction traces written by whisper --logfile or\n"
+    "--binlogfile (the two forms may be mixed) and report the first\n"
+    "instruction where they differ. Exit status is 0 if the traces are\n"
+    "identical, 1 if they differ and 2 on error.\n"
+    "Options:\n"
+    "  -j, --jobs n          Number of comparing threads (default: host\n"
+    "                        cores).\n"
+    "  -c, --context n       Number of identical instructions printed\n"
+    "                        before the divergence (default: 3).\n"
+    "  -f, --fields          Compare only the fields of the trace lines\n"
+    "                        (tag, hart, pc, opcode, resource, address and\n"
+    "                        value) ignoring the assembly text and the\n"
+    "                        spacing.\n";
+}
+
+
+/// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+
+  ~MappedFile()
+  {
+    if (data_)
+      munmap(const_cast<char*>(data_), size_);
+  }
+
+  /// Map the given file. Return true on success.
+  bool open(const std::string& path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      {
+	std::cerr << "Failed to open file '" << path << "' for input\n";
+	return false;
+      }
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    size_ = ok ? st.st_size : 0;
+    if (ok and size_)
+      {
+	void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	ok = addr != MAP_FAILED;
+	if (ok)
+	  {
+	    data_ = static_cast<const char*>(addr);
+	    madvise(addr, size_, MADV_SEQUENTIAL);
+	  }
+      }
+    close(fd);
+
+    if (not ok)
+      std::cerr << "Failed to map file '" << path << "'\n";
+    return ok;
+  }
+
+  const char* data() const
+  { return data_; }
+
+  size_t size() const
+  { return size_; }
+
+private:
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+
+// An instruction occupies one line of the text trace per change it
+// made, each but the last ending with "  +" (see printTraceRecord).
+// The comparison and the reports are done at that granularity.
+
+/// Return the offset past the end (newline) of the line at the given
+/// offset.
+static
+size_t
+lineEnd(const char* data, size_t size, size_t pos)
+{
+  auto nl = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+  return nl ? nl - data + 1 : size;
+}
+
+
+/// Return true if the line [begin, end) is continued by the next one
+/// (the instruction has more changes).
+static
+bool
+isContinued(const char* data, size_t begin, size_t end)
+{
+  while (end > begin and (data[end-1] == '\n' or data[end-1] == '\r'))
+    end--;
+  return end - begin >= 2 and data[end-1] == '+' and data[end-2] == ' ';
+}
+
+
+/// Return the offset past the end of the instruction starting at the
+/// given offset.
+static
+size_t
+instEnd(const char* data, size_t size, size_t pos)
+{
+  size_t end = lineEnd(data, size, pos);
+  while (end < size and isContinued(data, pos, end))
+    {
+      pos = end;
+      end = lineEnd(data, size, pos);
+    }
+  return end;
+}
+
+
+/// Return the offset of the start of the instruction containing the
+/// given offset.
+static
+size_t
+instStart(const char* data, size_t pos)
+{
+  auto nl = static_cast<const char*>(memrchr(data, '\n', pos));
+  size_t start = nl ? nl - data + 1 : 0;
+  while (start > 0)
+    {
+      nl = static_cast<const char*>(memrchr(data, '\n', start - 1));
+      size_t prev = nl ? nl - data + 1 : 0;
+      if (not isContinued(data, prev, start))
+	break;
+      start = prev;
+    }
+  return start;
+}
+
+
+/// Append to key the fields of the lines of the given text: the first
+/// 7 whitespace separated tokens of each line separated by single
+/// spaces.
+static
+void
+appendFields(const char* text, size_t size, std::string& key)
+{
+  const char* end = text + size;
+  while (text < end)
+    {
+      unsigned count = 0;
+      while (text < end and *text != '\n')
+	{
+	  while (text < end and (*text == ' ' or *text == '\t' or *text == '\r'))
+	    text++;
+	  if (text == end or *text == '\n')
+	    break;
+	  if (count == 7)
+	    {
+	      text = static_cast<const char*>(memchr(text, '\n', end - text));
+	      if (not text)
+		text = end;
+	      break;
+	    }
+	  if (count++)
+	    key.push_back(' ');
+	  while (text < end and not isspace(*text))
+	    key.push_back(*text++);
+	}
+      key.push_back('\n');
+      if (text < end)
+	text++;
+    }
+}
+
+
+/// An instruction of a trace: its text lines and the line number of
+/// the first one in the text trace.
+struct TraceInst
+{
+  std::string text;
+  std::string key;    // Compared part of the text (fields mode only).
+  uint64_t line = 0;
+
+  const std::string& compared() const
+  { return key.empty() ? text : key; }
+};
+
+
+/// Instructions of a trace produced in batches by a background thread
+/// (parsing or decoding the trace) and consumed by the caller of next.
+class InstStream
+{
+public:
+
+  /// The producer calls add for each instruction of the trace and
+  /// returns false on error.
+  typedef std::function<bool (InstStream&)> Producer;
+
+  /// Start producing with the given producer. In fields mode, the
+  /// compared key of each instruction is its fields (see appendFields).
+  InstStream(Producer producer, bool fields)
+    : fields_(fields)
+  {
+    thread_ = std::thread([this, producer] () {
+	bool ok = producer(*this);
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (batch_.size)
+	  queue_.push_back(std::move(batch_));
+	error_ = not ok;
+	done_ = true;
+	cv_.notify_all();
+      });
+  }
+
+  ~InstStream()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      cv_.notify_all();
+    }
+    thread_.join();
+  }
+
+  /// Add an instruction (called by the producer). Return false if the
+  /// consumer is no longer interested.
+  bool add(const char* text, size_t size, uint64_t line)
+  {
+    if (batch_.size == batchSize)
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this] { return queue_.size() < maxBatches or stop_; });
+	if (stop_)
+	  return false;
+	queue_.push_back(std::move(batch_));
+	cv_.notify_all();
+	batch_ = Batch();
+	if (not free_.empty())
+	  {
+	    batch_ = std::move(free_.back());
+	    free_.pop_back();
+	    batch_.size = 0;
+	  }
+      }
+
+    if (batch_.size == batch_.insts.size())
+      batch_.insts.emplace_back();
+    TraceInst& inst = batch_.insts[batch_.size++];
+    inst.text.assign(text, size);
+    if (size == 0 or text[size-1] != '\n')
+      inst.text.push_back('\n');
+    inst.line = line;
+    if (fields_)
+      {
+	inst.key.clear();
+	appendFields(text, size, inst.key);
+      }
+    return true;
+  }
+
+  /// Set inst to the next instruction which remains valid until the
+  /// next call. Return false if there is none.
+  bool next(const TraceInst*& inst)
+  {
+    if (pos_ == current_.size)
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this] { return not queue_.empty() or done_; });
+	if (queue_.empty())
+	  return false;
+	if (current_.size)
+	  free_.push_back(std::move(current_));
+	current_ = std::move(queue_.front());
+	queue_.pop_front();
+	pos_ = 0;
+	cv_.notify_all();
+      }
+    inst = &current_.insts.at(pos_++);
+    return true;
+  }
+
+  /// Return true if the producer failed (valid once next returned
+  /// false).
+  bool hasError() const
+  { return error_; }
+
+private:
+
+  static constexpr size_t batchSize = 4096;
+  static constexpr size_t maxBatches = 16;
+
+  // Consumed batches are recycled to reuse the memory of their strings.
+  struct Batch
+  {
+    std::vector<TraceInst> insts;
+    size_t size = 0;   // Number of valid entries in insts.
+  };
+
+  bool fields_ = false;
+  Batch batch_;      // Being filled by the producer.
+  Batch current_;    // Being consumed.
+  size_t pos_ = 0;
+  std::deque<Batch> queue_;
+  std::vector<Batch> free_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  bool stop_ = false;
+  bool error_ = false;
+  std::thread thread_;
+};
+
+
+/// Add the instructions of the given text trace to the given stream.
+static
+bool
+produceText(const MappedFile& file, InstStream& stream)
+{
+  const char* data = file.data();
+  size_t size = file.size();
+  uint64_t line = 1;
+  for (size_t pos = 0; pos < size; )
+    {
+      size_t end = instEnd(data, size, pos);
+      if (not stream.add(data + pos, end - pos, line))
+	break;
+      line += std::count(data + pos, data + end, '\n');
+      pos = end;
+    }
+  return true;
+}
+
+
+/// Add the instructions of the given binary trace to the given stream
+/// converting them to text (as whisper-tracedump does).
+template <typename URV>
+static
+bool
+produceBinary(BinaryTraceReader& reader, InstStream& stream)
+{
+  // Core used to disassemble the traced instructions.
+  Core<URV> core(0, 64*1024, 32);
+
+  URV misa = reader.extensions();
+  URV mask = 0, pokeMask = 0;
+  bool implemented = true, isDebug = false;
+  if (not core.configCsr("misa", implemented, misa, mask, pokeMask, isDebug))
+    {
+      std::cerr << "Failed to configure MISA CSR\n";
+      return false;
+    }
+  core.reset();
+  core.enableAbiNames(reader.flags() & BinaryTraceAbiNames);
+
+  // Programs execute few distinct instruction codes: Disassemble each
+  // once.
+  std::unordered_map<uint32_t, std::string> disassembly;
+
+  TraceRecord rec;
+  std::string text;
+  std::vector<char> buffer;
+  uint64_t line = 1;
+  while (reader.read(rec))
+    {
+      auto iter = disassembly.find(rec.inst);
+      if (iter == disassembly.end())
+	{
+	  core.disassembleInst(rec.inst, text);
+	  iter = disassembly.emplace(rec.inst, text).first;
+	}
+      text = iter->second;
+      if (rec.interrupted)
+	text += " (interrupted)";
+
+      if (rec.hasLoadAddr)
+	{
+	  std::ostringstream oss;
+	  oss << "0x" << std::hex << URV(rec.loadAddr);
+	  text += " [" + oss.str() + "]";
+	}
+
+      buffer.clear();
+      printTraceRecord<URV>(buffer, rec, text.c_str());
+      if (not stream.add(buffer.data(), buffer.size(), line))
+	return true;
+      line += std::count(buffer.begin(), buffer.end(), '\n');
+    }
+
+  if (reader.hasError())
+    {
+      std::cerr << "Malformed or truncated binary trace file\n";
+      return false;
+    }
+  return true;
+}
+
+
+/// A trace file: memory mapped if it is a text trace.
+struct TraceFile
+{
+  ~TraceFile()
+  {
+    reader.reset();
+    if (in)
+      fclose(in);
+  }
+
+  /// Open the given file. Return true on success.
+  bool open(const std::string& filePath)
+  {
+    path = filePath;
+    in = fopen(path.c_str(), "rb");
+    if (not in)
+      {
+	std::cerr << "Failed to open file '" << path << "' for input\n";
+	return false;
+      }
+
+    reader = std::make_unique<BinaryTraceReader>(in);
+    if (reader->isValid())
+      return true;
+
+    reader.reset();
+    fclose(in);
+    in = nullptr;
+    return text.open(path);
+  }
+
+  bool isBinary() const
+  { return reader != nullptr; }
+
+  /// Return a producer of the instructions of this trace.
+  InstStream::Producer producer()
+  {
+    if (not isBinary())
+      return [this] (InstStream& stream) { return produceText(text, stream); };
+    if (reader->xlen() == 32)
+      return [this] (InstStream& stream) {
+	return produceBinary<uint32_t>(*reader, stream); };
+    return [this] (InstStream& stream) {
+      return produceBinary<uint64_t>(*reader, stream); };
+  }
+
+  std::string path;
+  FILE* in = nullptr;
+  std::unique_ptr<BinaryTraceReader> reader;
+  MappedFile text;
+};
+
+
+/// Print the given text with the given prefix at the start of each
+/// line.
+static
+void
+printLines(const std::string& text, const char* prefix)
+{
+  size_t pos = 0;
+  while (pos < text.size())
+    {
+      size_t end = text.find('\n', pos);
+      end = end == std::string::npos ? text.size() : end + 1;
+      std::cout << prefix;
+      std::cout.write(text.data() + pos, end - pos);
+      pos = end;
+    }
+}
+
+
+/// Return the tag of the given instruction text or -1 if it has none.
+static
+int64_t
+instTag(const std::string& text)
+{
+  if (text.empty() or text[0] != '#')
+    return -1;
+  return strtoll(text.c_str() + 1, nullptr, 10);
+}
+
+
+/// Report the first divergence of the traces: the instructions a and
+/// b (null at the end of a trace) preceded by the given identical
+/// instructions.
+static
+void
+reportDivergence(const TraceFile& file1, const TraceFile& file2,
+		 const std::deque<std::string>& context,
+		 const TraceInst* a, const TraceInst* b)
+{
+  int64_t tag = instTag(a ? a->text : b->text);
+
+  std::cout << "Traces differ";
+  if (tag >= 0)
+    std::cout << " at instruction #" << tag;
+  std::cout << ":\n";
+
+  for (const TraceInst* inst : { a, b })
+    {
+      const TraceFile& file = inst == a ? file1 : file2;
+      std::cout << (inst == a ? "< " : "> ") << file.path;
+      if (inst)
+	std::cout << " line " << inst->line << '\n';
+      else
+	std::cout << " ends\n";
+    }
+
+  for (const auto& text : context)
+    printLines(text, "  ");
+  if (a)
+    printLines(a->text, "< ");
+  if (b)
+    printLines(b->text, "> ");
+}
+
+
+/// Compare the traces instruction by instruction with one thread
+/// producing the instructions of each trace. Return 0 if they are
+/// identical, 1 if they differ and 2 on error.
+static
+int
+compareStreams(TraceFile& file1, TraceFile& file2, bool fields,
+	       unsigned contextSize)
+{
+  InstStream stream1(file1.producer(), fields);
+  InstStream stream2(file2.producer(), fields);
+
+  std::deque<std::string> context;
+  while (true)
+    {
+      const TraceInst* a = nullptr;
+      const TraceInst* b = nullptr;
+      bool has1 = stream1.next(a), has2 = stream2.next(b);
+      if (not has1 and not has2)
+	break;
+      if (not has1 or not has2 or a->compared() != b->compared())
+	{
+	  if ((not has1 and stream1.hasError()) or
+	      (not has2 and stream2.hasError()))
+	    return 2;
+	  reportDivergence(file1, file2, context, has1 ? a : nullptr,
+			   has2 ? b : nullptr);
+	  return 1;
+	}
+
+      if (contextSize)
+	{
+	  if (context.size() == contextSize)
+	    {
+	      // Recycle the oldest string.
+	      context.push_back(std::move(context.front()));
+	      context.pop_front();
+	      context.back().assign(a->text);
+	    }
+	  else
+	    context.push_back(a->text);
+	}
+    }
+
+  return (stream1.hasError() or stream2.hasError()) ? 2 : 0;
+}
+
+
+/// Return the offset of the first byte that differs in the given
+/// buffers (the given size if they are identical). The buffers are
+/// split into chunks compared by the given number of threads (memcmp
+/// is vectorized). A thread skips the chunks following the first
+/// differing chunk found so far.
+static
+size_t
+firstDifference(const char* a, const char* b, size_t size, unsigned jobs)
+{
+  const size_t chunkSize = size_t(16) << 20;
+  size_t chunkCount = (size + chunkSize - 1) / chunkSize;
+
+  std::atomic<size_t> nextChunk(0);
+  std::atomic<size_t> firstBad(chunkCount);
+
+  auto worker = [&] () {
+    while (true)
+      {
+	size_t ix = nextChunk++;
+	if (ix >= firstBad)
+	  break;
+	size_t offset = ix * chunkSize;
+	size_t len = std::min(chunkSize, size - offset);
+	if (memcmp(a + offset, b + offset, len) == 0)
+	  continue;
+	size_t bad = firstBad;
+	while (ix < bad and not firstBad.compare_exchange_weak(bad, ix))
+	  ;
+	break;
+      }
+  };
+
+  jobs = std::max(1u, unsigned(std::min(size_t(jobs), chunkCount)));
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < jobs; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+
+  if (firstBad == chunkCount)
+    return size;
+
+  // Narrow down to the byte within the first differing chunk.
+  size_t offset = firstBad * chunkSize;
+  size_t end = std::min(offset + chunkSize, size);
+  const size_t step = 4096;
+  while (offset + step < end and memcmp(a + offset, b + offset, step) == 0)
+    offset += step;
+  while (offset < end and a[offset] == b[offset])
+    offset++;
+  return offset;
+}
+
+
+/// Compare two text traces byte by byte in parallel. Identical traces
+/// have their instructions at identical offsets: the first differing
+/// byte locates the first differing instruction in both. Return 0 if
+/// they are identical, 1 if they differ.
+static
+int
+compareTexts(const TraceFile& file1, const TraceFile& file2, unsigned jobs,
+	     unsigned contextSize)
+{
+  const char* a = file1.text.data();
+  const char* b = file2.text.data();
+  size_t size1 = file1.text.size(), size2 = file2.text.size();
+
+  size_t common = std::min(size1, size2);
+  size_t diff = common ? firstDifference(a, b, common, jobs) : 0;
+  if (diff == common and size1 == size2)
+    return 0;
+
+  size_t start = instStart(a, diff);
+  uint64_t line = 1 + std::count(a, a + start, '\n');
+
+  // Collect the identical instructions preceding the divergence.
+  std::deque<std::string> context;
+  size_t pos = start;
+  while (pos > 0 and context.size() < contextSize)
+    {
+      size_t prev = instStart(a, pos - 1);
+      context.emplace_front(a + prev, pos - prev);
+      pos = prev;
+    }
+
+  TraceInst inst1, inst2;
+  for (auto [inst, data, size] : { std::make_tuple(&inst1, a, size1),
+				   std::make_tuple(&inst2, b, size2) })
+    if (start < size)
+      {
+	inst->text.assign(data + start, instEnd(data, size, start) - start);
+	if (inst->text.back() != '\n')
+	  inst->text.push_back('\n');
+	inst->line = line;
+      }
+
+  reportDivergence(file1, file2, context, start < size1 ? &inst1 : nullptr,
+		   start < size2 ? &inst2 : nullptr);
+  return 1;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  std::vector<std::string> files;
+  unsigned jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  unsigned contextSize = 3;
+  bool fields = false;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      auto value = [&] () -> const char* {
+	if (i + 1 >= argc)
+	  {
+	    std::cerr << "Missing value of option " << arg << '\n';
+	    exit(2);
+	  }
+	return argv[++i];
+      };
+
+      if (arg == "-h" or arg == "--help")
+	{
+	  printUsage();
+	  return 0;
+	}
+      else if (arg == "-j" or arg == "--jobs")
+	jobs = std::max(1, atoi(value()));
+      else if (arg == "-c" or arg == "--context")
+	contextSize = std::max(0, atoi(value()));
+      else if (arg == "-f" or arg == "--fields")
+	fields = true;
+      else if (not arg.empty() and arg.front() == '-')
+	{
+	  std::cerr << "Unknown option: " << arg << '\n';
+	  printUsage();
+	  return 2;
+	}
+      else
+	files.push_back(arg);
+    }
+
+  if (files.size() != 2)
+    {
+      printUsage();
+      return 2;
+    }
+
+  TraceFile file1, file2;
+  if (not file1.open(files.at(0)) or not file2.open(files.at(1)))
+    return 2;
+
+  // Two text traces compared exactly need no parsing: Compare the
+  // mapped bytes in parallel.
+  if (not file1.isBinary() and not file2.isBinary() and not fields)
+    return compareTexts(file1, file2, jobs, contextSize);
+
+  return compareStreams(file1, file2, fields, contextSize);
+}
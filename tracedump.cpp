@@ -0,0 +1,126 @@
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2018 Western Digital Corporation or its affiliates.
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+// Convert a binary instruction trace (whisper --binlogfile) to the text
+// form produced by whisper --logfile.
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include "Core.hpp"
+#include "BinaryTrace.hpp"
+
+
+using namespace WdRiscv;
+
+
+/// Convert the records of the given reader to text on the given output
+/// file. Return true on success.
+template <typename URV>
+static
+bool
+dumpTrace(BinaryTraceReader& reader, FILE* out)
+{
+  // Core used to disassemble the traced instructions.
+  Core<URV> core(0, 64*1024, 32);
+
+  URV misa = reader.extensions();
+  URV mask = 0, pokeMask = 0;
+  bool implemented = true, isDebug = false;
+  if (not core.configCsr("misa", implemented, misa, mask, pokeMask, isDebug))
+    {
+      std::cerr << "Failed to configure MISA CSR\n";
+      return false;
+    }
+  core.reset();
+  core.enableAbiNames(reader.flags() & BinaryTraceAbiNames);
+
+  TraceRecord rec;
+  std::string text;
+  while (reader.read(rec))
+    {
+      core.disassembleInst(rec.inst, text);
+      if (rec.interrupted)
+	text += " (interrupted)";
+
+      if (rec.hasLoadAddr)
+	{
+	  std::ostringstream oss;
+	  oss << "0x" << std::hex << URV(rec.loadAddr);
+	  text += " [" + oss.str() + "]";
+	}
+
+      printTraceRecord<URV>(out, rec, text.c_str());
+    }
+
+  if (reader.hasError())
+    {
+      std::cerr << "Malformed or truncated binary trace file\n";
+      return false;
+    }
+
+  return true;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2 or argc > 3 or strcmp(argv[1], "-h") == 0 or
+      strcmp(argv[1], "--help") == 0)
+    {
+      std::cerr << "Usage: whisper-tracedump binary-trace [text-trace]\n"
+		<< "Convert a binary instruction trace (whisper --binlogfile)\n"
+		<< "to text (whisper --logfile). Output defaults to stdout.\n";
+      return 1;
+    }
+
+  FILE* in = fopen(argv[1], "rb");
+  if (not in)
+    {
+      std::cerr << "Failed to open file '" << argv[1] << "' for input\n";
+      return 1;
+    }
+
+  FILE* out = stdout;
+  if (argc == 3)
+    {
+      out = fopen(argv[2], "w");
+      if (not out)
+	{
+	  std::cerr << "Failed to open file '" << argv[2] << "' for output\n";
+	  fclose(in);
+	  return 1;
+	}
+    }
+
+  BinaryTraceReader reader(in);
+  bool ok = reader.isValid();
+  if (not ok)
+    std::cerr << "File '" << argv[1] << "' is not a whisper binary trace\n";
+  else if (reader.xlen() == 32)
+    ok = dumpTrace<uint32_t>(reader, out);
+  else
+    ok = dumpTrace<uint64_t>(reader, out);
+
+  if (out != stdout)
+    fclose(out);
+  fclose(in);
+
+  return ok ? 0 : 1;
+}
@@ -19,15 +19,41 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <sys/time.h>
 #include "CoreConfig.hpp"
 #include "WhisperMessage.h"
+#include "WhisperShm.h"
+#include "BinaryTrace.hpp"
+#include "BlockWriter.hpp"
+#include "Profiler.hpp"
+#include "SymbolIndex.hpp"
+#include "Coverage.hpp"
+#include "TimingModel.hpp"
+#include "AddressTrace.hpp"
+#include "BasicBlockVector.hpp"
+#include "Plugin.hpp"
+#include "Metrics.hpp"
+#include "RunReport.hpp"
+#include "Numa.hpp"
+#include "Fuzzer.hpp"
+#include "SpscQueue.hpp"
+#include "ElfFile.hpp"
+#include "EventLog.hpp"
 #include "Core.hpp"
 #include "linenoise.h"
 
@@ -35,6 +61,13 @@
 using namespace WdRiscv;
 
 
+/// Listen on the given TCP port and accept a connection from gdb to
+/// be used by the gdb remote protocol instead of standard
+/// input/output (see gdb.cpp and Core::setGdbChannel). Return the
+/// connection on success and null on failure.
+extern std::shared_ptr<GdbChannel> openGdbTcpPort(unsigned port);
+
+
 /// Return format string suitable for printing an integer of type URV
 /// in hexadecimal form.
 template <typename URV>
@@ -97,12 +130,40 @@ struct Args
 {
   StringVec   hexFiles;        // Hex files to be loaded into simulator memory.
   std::string traceFile;       // Log of state change after each instruction.
+  std::string binLogFile;      // Binary form of traceFile.
   std::string commandLogFile;  // Log of interactive or socket commands.
   std::string consoleOutFile;  // Console io output file.
   std::string serverFile;      // File in which to write server host and port.
+  std::string shmName;         // Name of server shared memory segment.
+  std::string recordEventsFile;  // Event log of server session (output).
+  std::string replayEventsFile;  // Event log of server session (input).
   std::string instFreqFile;    // Instruction frequency file.
+  std::string instFreqMode = "operands";  // Instruction frequency detail.
+  std::string pcProfileFile;   // Per-PC/per-function profile report file.
+  std::string foldedStacksFile;  // Profile in flamegraph.pl input form.
+  std::string coverageFile;    // Code coverage output file.
+  std::string addrTraceFile;   // Memory address trace file (or pipe).
+  std::string addrTraceShm;    // Memory address trace shared memory segment.
+  std::string addrTraceTypes = "fetch,load,store,amo";
+  StringVec   addrTraceRanges; // Address trace filter (begin:end strings).
+  std::string bbvFile;         // Basic block vector output file.
+  std::string simpointsFile;   // Intervals of a sampled run.
+  std::string simpointWeightsFile;  // Weights of the sampled intervals.
+  std::string simpointPrefix = "simpoint";  // Interval checkpoint files.
+  StringVec   plugins;         // Instrumentation plugins (file[:arg]).
+  std::string metricsFile;     // Live metrics file.
+  std::string reportJsonFile;  // Structured run report (JSON) file.
   std::string configFile;      // Configuration (JSON) file.
   std::string isa;
+  std::string batchFile;       // File listing the tests of a batch run.
+  std::string fuzzDir;         // Seed directory of a fuzzing run.
+  std::string diffConfigFile;  // Configuration of the other hart of a diff run.
+  std::string diffEngine;      // Engine of the other hart: fast or step.
+  std::string accelerate;      // Library routines executed on the host.
+  StringVec   traceWindows;    // Trace windows (kind:value strings).
+  std::string saveCheckpointFile;  // Checkpoint written at end of run.
+  std::string signatureFile;   // Signature region written at end of run.
+  std::string loadCheckpointFile;  // Checkpoint to resume from.
   StringVec   regInits;        // Initial values of regs
   StringVec   codes;           // Instruction codes to disassemble
   StringVec   targets;         // Target (ELF file) programs and associated
@@ -113,13 +174,39 @@ struct Args
   // Ith item is a vector of strings representing ith target and its args.
   std::vector<StringVec> expandedTargets;
 
+  // Parsed address trace filter.
+  unsigned addrTraceMask = AddressTrace::AllBits;
+  std::vector<std::pair<uint64_t, uint64_t>> addrRanges;
+  std::string hugePages;       // Huge page backing of memory: thp/hugetlb.
+  std::string numaNodeSpec;    // Host NUMA nodes (comma separated list).
+  std::vector<unsigned> numaNodes;  // Parsed numaNodeSpec.
+
   uint64_t startPc = 0;
   uint64_t endPc = 0;
   uint64_t toHost = 0;
   uint64_t consoleIo = 0;
   uint64_t instCountLim = ~uint64_t(0);
+  uint64_t quantum = 0;        // Multi-hart synchronization quantum.
+  uint64_t checkpointAt = 0;   // Instruction count at which to checkpoint.
+  uint64_t instFreqSample = 1; // Profile operands of every nth instruction.
+  uint64_t bbvInterval = 100000000;  // Basic block vector interval size.
+  uint64_t simpointWarmup = 0; // Instructions run before a sampled interval.
+  uint64_t fuzzAddr = 0;       // Address of the fuzzed instructions.
+  uint64_t fuzzCount = 0;      // Fuzzing executions (0: until signal).
+  uint64_t fuzzSeed = 1;       // Random seed of a fuzzing run.
+  uint64_t reverseInterval = 0;  // Instructions between reverse checkpoints.
+  uint64_t reverseMemory = 256;  // Megabytes of the reverse memory journal.
   
   unsigned regWidth = 32;
+  unsigned harts = 1;          // Hart count.
+  unsigned jobs = 0;           // Batch/simpoint thread count (0: host cores).
+  std::string disassElfFile;   // ELF file whose code is disassembled.
+  unsigned sessions = 0;       // Concurrent server sessions (0: just one).
+  unsigned whatIfThreads = 1;  // Threads evaluating what-if requests.
+  unsigned runAhead = 0;       // Server steps executed ahead (0: none).
+  unsigned gdbTcpPort = 0;     // Port of gdb connection (see hasGdbTcpPort).
+  unsigned metricsPort = 0;    // HTTP port of live metrics (0: none).
+  unsigned fuzzLength = 32;    // Instructions of a generated stream.
 
   bool help = false;
   bool hasStartPc = false;
@@ -127,16 +214,28 @@ struct Args
   bool hasToHost = false;
   bool hasConsoleIo = false;
   bool hasRegWidth = false;
+  bool hasHarts = false;
+  bool hasQuantum = false;
+  bool hasGdbTcpPort = false;
+  bool hasCheckpointAt = false;
+  bool hasFuzzAddr = false;
   bool trace = false;
   bool interactive = false;
   bool verbose = false;
   bool version = false;
   bool traceLoad = false;  // Trace load address if true.
+  bool traceSymbols = false;  // Annotate trace with function names.
   bool triggers = false;   // Enable debug triggers when true.
   bool counters = false;   // Enable performance counters when true.
   bool gdb = false;        // Enable gdb mode when true.
   bool abiNames = false;   // Use ABI register names in inst disassembly.
   bool newlib = false;     // True if target program linked with newlib.
+  bool skipIdle = false;   // Fast-forward idle loops.
+  bool coverageBranches = false;  // Branch outcomes in coverage file.
+  bool timing = false;     // Estimate cycles with a timing model.
+  bool shmFutex = false;   // Sleep instead of polling in shared memory mode.
+  bool binLogCompress = false;  // Compress binary trace file.
+  bool consoleFlush = false;    // Flush console output after each step.
 };
 
 
@@ -166,6 +265,61 @@ parseCmdLineArgs(int argc, char* argv[], Args& args)
 	 "are a, c, d, f, i, m, s and u. Default is imc.")
 	("xlen", po::value(&args.regWidth),
 	 "Specify register width (32 or 64), defaults to 32")
+	("harts", po::value(&args.harts),
+	 "Specify the number of harts (cores) sharing the memory, defaults to "
+	 "1. In non-interactive mode each hart runs in its own thread.")
+	("quantum", po::value(&args.quantum),
+	 "Specify the number of instructions retired by each hart between "
+	 "hart synchronizations in multi-hart runs, defaults to 100000.")
+	("batch", po::value(&args.batchFile),
+	 "Run the tests listed in the given file: one test per line consisting "
+	 "of an ELF file optionally followed by program options (see "
+	 "--targetsep). The tests run on a pool of threads each reusing a "
+	 "configured core. A pass/fail summary is printed at the end.")
+	("jobs,j", po::value(&args.jobs),
+	 "Specify the number of threads used in batch, simpoint, fuzzing and "
+	 "ELF disassembly modes, defaults to the number of host cores.")
+	("fuzz", po::value(&args.fuzzDir),
+	 "Coverage-guided fuzzing: Repeatedly write a random or mutated "
+	 "instruction stream at --fuzzaddr and run it (up to --maxinst "
+	 "instructions) from the state reached after loading the program "
+	 "files, on a pool of threads (see --jobs). Streams bringing new trap "
+	 "causes, CSR bit patterns or trigger hits are kept as seeds in the "
+	 "given directory, which also provides the initial seeds.")
+	("fuzzaddr", po::value<std::string>(),
+	 "Address at which --fuzz writes the instruction streams (in hex with "
+	 "0x prefix), defaults to the start pc.")
+	("fuzzlength", po::value(&args.fuzzLength),
+	 "Instruction count of the streams generated by --fuzz, defaults to "
+	 "32. Mutated streams are at most twice as long.")
+	("fuzzcount", po::value(&args.fuzzCount),
+	 "Stop --fuzz after the given number of executions instead of at "
+	 "SIGINT or SIGTERM.")
+	("fuzzseed", po::value(&args.fuzzSeed),
+	 "Random seed of --fuzz, defaults to 1.")
+	("diffconfig", po::value(&args.diffConfigFile),
+	 "Differential run: Run the program on two harts in lock-step on "
+	 "separate threads, one configured by --configfile and the other by "
+	 "the given configuration file. After each retired instruction, the "
+	 "harts compare a digest of their program counter and registers. The "
+	 "run stops at the first divergence printing the diverging "
+	 "instructions and the state of both harts after them. No trace is "
+	 "written.")
+	("diffengine", po::value(&args.diffEngine),
+	 "Engine of the other hart of a differential run: fast (the block "
+	 "engine used by untraced runs, the default) or step (the "
+	 "instruction by instruction engine of traced runs). Without "
+	 "--diffconfig, both harts use the configuration of --configfile.")
+	("reverse", po::value(&args.reverseInterval),
+	 "Enable reverse execution in interactive and gdb modes (interactive "
+	 "rstep and rcont commands, gdb reverse-stepi and reverse-continue): "
+	 "save the state of the hart every given number of executed "
+	 "instructions and journal the original contents of modified memory "
+	 "(see --reversememory). Going back restores the nearest saved state "
+	 "and re-executes from it. Single hart only.")
+	("reversememory", po::value(&args.reverseMemory),
+	 "Size in megabytes of the memory journal of --reverse (default 256). "
+	 "Older history is dropped when the journal is full.")
 	("target,t", po::value(&args.targets)->multitoken(),
 	 "Target program (ELF file) to load into simulator memory. In newlib "
 	 "emulations mode, program options may follow program name.")
@@ -175,12 +329,62 @@ parseCmdLineArgs(int argc, char* argv[], Args& args)
 	 "HEX file to load into simulator memory.")
 	("logfile,f", po::value(&args.traceFile),
 	 "Enable tracing to given file of executed instructions.")
+	("binlogfile", po::value(&args.binLogFile),
+	 "Enable tracing to given file of executed instructions in a compact "
+	 "binary form. Use whisper-tracedump to convert to the --logfile "
+	 "text form.")
+	("binlogcompress", po::bool_switch(&args.binLogCompress),
+	 "Compress binary trace (--binlogfile) using zstd. Requires whisper "
+	 "compiled with zstd support (make ZSTD=1).")
+	("tracewindow", po::value(&args.traceWindows)->multitoken(),
+	 "Only trace (--logfile) the instructions in the given windows: "
+	 "count:n-m (instruction numbers, m excluded), pc:a-b (addresses, "
+	 "b excluded), func:name (ELF function), priv:modes (letters among "
+	 "m, s and u) or trigger (between start-trace and stop-trace "
+	 "trigger actions, requires --triggers). Windows of one kind add "
+	 "up, windows of different kinds restrict each other. Outside the "
+	 "windows the run uses the fast untraced loop when it can. "
+	 "Example: --tracewindow count:1000000-2000000 func:main")
 	("consoleoutfile", po::value(&args.consoleOutFile),
 	 "Redirect console output to given file.")
+	("consoleflush", po::bool_switch(&args.consoleFlush),
+	 "Flush console output whenever the simulator stops after a single "
+	 "step (interactive and server modes). By default, console output is "
+	 "flushed at end of line and at the end of a run.")
 	("commandlog", po::value(&args.commandLogFile),
 	 "Enable logging of interactive/socket commands to the given file.")
 	("server", po::value(&args.serverFile),
 	 "Interactive server mode. Put server hostname and port in file.")
+	("shm", po::value(&args.shmName),
+	 "Interactive server mode using the POSIX shared memory segment of the "
+	 "given name (e.g. /whisper) instead of a socket. See WhisperShm.h.")
+	("sessions", po::value(&args.sessions),
+	 "In server mode (--server), keep accepting test-bench connections "
+	 "until terminated (SIGINT or SIGTERM) servicing up to the given "
+	 "number of sessions at a time. Each session runs on a core taken "
+	 "from a pool of cores configured and loaded once: setting up a "
+	 "session only restores the memory pages touched by the previous "
+	 "one.")
+	("whatifthreads", po::value(&args.whatIfThreads),
+	 "In server mode, evaluate the candidate instructions of a what-if "
+	 "request (see WhisperMessage.h) with the given number of threads, "
+	 "each with its own copy of the hart registers, defaults to 1.")
+	("runahead", po::value(&args.runAhead),
+	 "In server mode, execute up to the given number of steps ahead of "
+	 "the test-bench on a helper thread, answering step requests from "
+	 "the steps already executed. Other requests take the hart back to "
+	 "the last step answered. Ignored with tracing and profiling options.")
+	("shmfutex", po::bool_switch(&args.shmFutex),
+	 "In shared memory server mode, sleep on a futex while waiting instead "
+	 "of busy polling.")
+	("recordevents", po::value(&args.recordEventsFile),
+	 "In server mode, record the requests changing the state of the hart "
+	 "(other than stepping) with their instruction counts to the given "
+	 "event log file (see --replayevents).")
+	("replayevents", po::value(&args.replayEventsFile),
+	 "Replay without a test-bench the server session recorded in the "
+	 "given event log file (see --recordevents). Load the same program "
+	 "files and use the same configuration as the recorded session.")
 	("startpc,s", po::value<std::string>(),
 	 "Set program entry point (in hex notation with a 0x prefix). "
 	 "If not specified, use the ELF file entry point.")
@@ -197,28 +401,155 @@ parseCmdLineArgs(int argc, char* argv[], Args& args)
 	 "reads/writes a byte from the console.")
 	("maxinst,m", po::value(&args.instCountLim),
 	 "Limit executed instruction count to limit.")
+	("savecheckpoint", po::value(&args.saveCheckpointFile),
+	 "Save the state of the harts and the used memory pages to the given "
+	 "file at the end of the run (see --checkpointat).")
+	("checkpointat", po::value(&args.checkpointAt),
+	 "Stop the run once the retired instruction count reaches the given "
+	 "value and save a checkpoint (see --savecheckpoint).")
+	("loadcheckpoint", po::value(&args.loadCheckpointFile),
+	 "Resume from the given checkpoint file (see --savecheckpoint). "
+	 "Program files are optional with this option.")
+	("signature", po::value(&args.signatureFile),
+	 "At the end of the run, write to the given file the memory between "
+	 "the begin_signature and end_signature symbols of the ELF files: "
+	 "one 32-bit word per line in hexadecimal (compliance test format).")
 	("interactive,i", po::bool_switch(&args.interactive),
 	 "Enable interactive mode.")
 	("traceload", po::bool_switch(&args.traceLoad),
 	 "Enable tracing of load instruction data address.")
+	("tracesymbols", po::bool_switch(&args.traceSymbols),
+	 "Annotate each instruction of the text trace (--logfile) with its "
+	 "function and offset in the loaded ELF files: <main+0x1c>.")
 	("triggers", po::bool_switch(&args.triggers),
 	 "Enable debug triggers (triggers are on in interactive and server modes)")
 	("counters", po::bool_switch(&args.counters),
 	 "Enable performance counters")
 	("gdb", po::bool_switch(&args.gdb),
 	 "Run in gdb mode enabling remote debugging from gdb.")
+	("gdbtcpport", po::value(&args.gdbTcpPort),
+	 "Run in gdb mode accepting a gdb connection on the given TCP port "
+	 "instead of using standard input/output.")
 	("profileinst", po::value(&args.instFreqFile),
 	 "Report instruction frequency to file.")
+	("profileinstmode", po::value(&args.instFreqMode),
+	 "Detail of the instruction frequency report (--profileinst): count "
+	 "(execution counts only, runs at nearly full speed) or operands "
+	 "(also register use and operand value histograms, the default).")
+	("profileinstsample", po::value(&args.instFreqSample),
+	 "In operands mode (--profileinstmode), profile one of every n "
+	 "executed instructions instead of all of them. Reported counts are "
+	 "scaled by n.")
+	("profilepc", po::value(&args.pcProfileFile),
+	 "Profile the executed instructions by PC and by function (using the "
+	 "ELF symbols) and write the hottest functions, call edges and PCs "
+	 "to the given file.")
+	("foldedstacks", po::value(&args.foldedStacksFile),
+	 "Profile the executed instructions by calling context and write "
+	 "them to the given file in the folded stack form of flamegraph.pl.")
+	("coverage", po::value(&args.coverageFile),
+	 "Record the executed instructions (one bit per half-word of code) "
+	 "and write them to the given binary coverage file at the end of the "
+	 "run. Coverage files are merged and reported by whisper-covmerge.")
+	("coveragebranches", po::bool_switch(&args.coverageBranches),
+	 "With --coverage, also record whether each conditional branch was "
+	 "taken and not taken.")
+	("addrtrace", po::value(&args.addrTraceFile),
+	 "Write the memory address trace (instruction fetches and data "
+	 "accesses in the packed binary form of WhisperAddrTrace.h) to the "
+	 "given file which may be a named pipe.")
+	("addrtraceshm", po::value(&args.addrTraceShm),
+	 "Stream the memory address trace through the given shared memory "
+	 "segment (see WhisperAddrTrace.h) for a live consumer.")
+	("addrtracetypes", po::value(&args.addrTraceTypes),
+	 "Comma separated access types recorded in the address trace: "
+	 "fetch, load, store and/or amo (default: all).")
+	("addrtracerange", po::value(&args.addrTraceRanges)->multitoken(),
+	 "Only record the accesses in the given address ranges in the "
+	 "address trace. Example: --addrtracerange 0x1000:0x2000 0x8000:0x9000 "
+	 "(end excluded).")
+	("timing", po::bool_switch(&args.timing),
+	 "Estimate the cycle count (MCYCLE) with a model of the caches, "
+	 "closely coupled memories, multiply/divide latencies and branch "
+	 "prediction (parameters in the timing section of the configuration "
+	 "file) and report its statistics at the end of the run.")
+	("bbv", po::value(&args.bbvFile),
+	 "Write the basic block vectors of hart 0 to the given file in the "
+	 "format of the SimPoint tool: one line per interval of --bbvinterval "
+	 "retired instructions giving the instruction count of each executed "
+	 "basic block.")
+	("bbvinterval", po::value(&args.bbvInterval),
+	 "Specify the instruction count of an interval of --bbv and "
+	 "--simpoints, defaults to 100000000.")
+	("simpoints", po::value(&args.simpointsFile),
+	 "Sampled simulation: Fast-forward the program saving a checkpoint at "
+	 "the start of each interval listed in the given SimPoint file (one "
+	 "interval number and cluster number per line), then run these "
+	 "intervals from their checkpoints on a pool of threads (see --jobs) "
+	 "with --timing, --profileinst and --logfile applied to them only, "
+	 "and merge their results (see --simpointweights).")
+	("simpointweights", po::value(&args.simpointWeightsFile),
+	 "SimPoint weights file (one weight and cluster number per line) of "
+	 "the intervals of --simpoints, defaults to equal weights.")
+	("simpointprefix", po::value(&args.simpointPrefix),
+	 "Save the checkpoint of interval n of --simpoints in file prefix.n, "
+	 "defaults to simpoint.")
+	("simpointwarmup", po::value(&args.simpointWarmup),
+	 "Run the given number of instructions before each interval of "
+	 "--simpoints to warm up the caches and the predictors of the timing "
+	 "model without counting them, defaults to 0.")
+	("plugin", po::value(&args.plugins),
+	 "Load the given instrumentation plugin: a shared object with the "
+	 "interface of WhisperPlugin.h, optionally followed by a colon and an "
+	 "argument string passed to the plugin. May be repeated. Example: "
+	 "--plugin ./count.so:count.txt")
+	("metrics", po::value(&args.metricsFile),
+	 "Publish live metrics of the run (instruction rate, program counter, "
+	 "instruction/trap counts and hot program counters of each hart) in "
+	 "the given file which other processes can map and read while the run "
+	 "proceeds (see WhisperMetrics.h).")
+	("metricsport", po::value(&args.metricsPort),
+	 "Serve the live metrics of the run as text (Prometheus exposition "
+	 "format) to HTTP requests on the given TCP port.")
+	("reportjson", po::value(&args.reportJsonFile),
+	 "At the end of the run, write a report of the run to the given file "
+	 "as a JSON object: time of each phase (config, load, run, teardown), "
+	 "instructions and MIPS per execution mode, trap causes and trigger "
+	 "trips of each hart, memory pages touched and peak resident memory.")
 	("setreg", po::value(&args.regInits)->multitoken(),
 	 "Initialize registers. Example --setreg x1=4 x2=0xff")
 	("disass,d", po::value(&args.codes)->multitoken(),
 	 "Disassemble instruction code(s). Example --disass 0x93 0x33")
+	("disasself", po::value(&args.disassElfFile),
+	 "Disassemble the executable segments of the given ELF file to the "
+	 "standard output annotating each instruction with its symbol and "
+	 "offset. The work is spread over a pool of threads (see --jobs); "
+	 "the output is that of a sequential disassembly.")
 	("configfile", po::value(&args.configFile),
 	 "Configuration file (JSON file defining system features).")
 	("abinames", po::bool_switch(&args.abiNames),
 	 "Use ABI register names (e.g. sp instead of x2) in instruction disassembly.")
 	("newlib", po::bool_switch(&args.newlib),
 	 "Emulate (some) newlib system calls when true.")
+	("hugepages", po::value(&args.hugePages),
+	 "Back the simulated memory with huge host pages: thp (transparent "
+	 "huge pages) or hugetlb (pages of the hugetlbfs pool which must be "
+	 "reserved beforehand).")
+	("numanodes", po::value(&args.numaNodeSpec),
+	 "Run the hart threads (or the batch, server-session or simpoint "
+	 "worker threads) on the given host NUMA nodes, used round-robin, "
+	 "and allocate their memory there. Example: --numanodes 0,1")
+	("skipidle", po::bool_switch(&args.skipIdle),
+	 "Fast-forward idle loops (wfi or polling loops that leave the "
+	 "registers unchanged) to the next device event. The retired "
+	 "instruction and cycle counts are those of a step-by-step run.")
+	("accelerate", po::value(&args.accelerate),
+	 "Execute on the host the calls to the given comma separated C "
+	 "library routines of the loaded ELF files (memcpy, memset, strlen, "
+	 "memcmp or all of them with \"all\") when their arguments are in "
+	 "plain memory. The retired instruction and cycle counts advance by "
+	 "an estimate. Only untraced runs without triggers, profiling or "
+	 "plugins do it.")
 	("verbose,v", po::bool_switch(&args.verbose),
 	 "Be verbose.")
 	("version", po::bool_switch(&args.version),
@@ -273,6 +604,14 @@ parseCmdLineArgs(int argc, char* argv[], Args& args)
 	  if (not args.hasToHost)
 	    errors++;
 	}
+      if (varMap.count("fuzzaddr"))
+	{
+	  auto addrStr = varMap["fuzzaddr"].as<std::string>();
+	  args.hasFuzzAddr = parseCmdLineNumber("fuzzaddr", addrStr,
+						args.fuzzAddr);
+	  if (not args.hasFuzzAddr)
+	    errors++;
+	}
       if (varMap.count("consoleio"))
 	{
 	  auto consoleIoStr = varMap["consoleio"].as<std::string>();
@@ -281,8 +620,58 @@ parseCmdLineArgs(int argc, char* argv[], Args& args)
 	  if (not args.hasConsoleIo)
 	    errors++;
 	}
+      if (not AddressTrace::parseTypes(args.addrTraceTypes,
+				       args.addrTraceMask))
+	{
+	  std::cerr << "Invalid command line addrtracetypes value: "
+		    << args.addrTraceTypes << '\n';
+	  errors++;
+	}
+      for (const auto& range : args.addrTraceRanges)
+	{
+	  auto colon = range.find(':');
+	  uint64_t begin = 0, end = 0;
+	  if (colon == std::string::npos or
+	      not parseCmdLineNumber("addrtracerange", range.substr(0, colon),
+				     begin) or
+	      not parseCmdLineNumber("addrtracerange", range.substr(colon + 1),
+				     end))
+	    {
+	      std::cerr << "Invalid address trace range: " << range
+			<< " -- expecting begin:end\n";
+	      errors++;
+	      continue;
+	    }
+	  args.addrRanges.push_back({begin, end});
+	}
       if (varMap.count("xlen"))
 	args.hasRegWidth = true;
+      if (varMap.count("harts"))
+	args.hasHarts = true;
+      if (varMap.count("quantum"))
+	args.hasQuantum = true;
+      if (varMap.count("gdbtcpport"))
+	{
+	  args.hasGdbTcpPort = true;
+	  args.gdb = true;
+	}
+      if (varMap.count("checkpointat"))
+	args.hasCheckpointAt = true;
+      if (not args.hugePages.empty() and args.hugePages != "thp" and
+	  args.hugePages != "hugetlb")
+	{
+	  std::cerr << "Invalid --hugepages value: " << args.hugePages
+		    << " -- expecting thp or hugetlb\n";
+	  errors++;
+	}
+      if (not args.numaNodeSpec.empty() and
+	  not parseNumaNodes(args.numaNodeSpec, args.numaNodes))
+	errors++;
+      if (args.hasCheckpointAt and args.saveCheckpointFile.empty())
+	{
+	  std::cerr << "Option --checkpointat requires --savecheckpoint\n";
+	  errors++;
+	}
       if (args.interactive)
 	args.trace = true;  // Enable instruction tracing in interactive mode.
     }
@@ -296,6 +685,26 @@ parseCmdLineArgs(int argc, char* argv[], Args& args)
 }
 
 
+/// Apply the --hugepages option to the given memory. If worker is
+/// non-negative, also bind the calling thread and the memory to the
+/// node of that worker among the nodes of --numanodes (round-robin).
+/// Return true on success.
+static bool
+placeMemory(const Args& args, Memory& memory, int worker)
+{
+  if (not args.hugePages.empty() and
+      not memory.enableHugePages(args.hugePages == "hugetlb"))
+    return false;
+
+  if (args.numaNodes.empty() or worker < 0)
+    return true;
+
+  unsigned node = args.numaNodes.at(worker % args.numaNodes.size());
+  return (bindThreadToNumaNode(node) and
+	  memory.bindToNumaNodes(std::vector<unsigned>(1, node)));
+}
+
+
 /// Apply register initializations specified on the command line.
 template<typename URV>
 static
@@ -349,7 +758,82 @@ applyCmdLineRegInit(const Args& args, Core<URV>& core)
 }
 
 
-std::unordered_map<std::string, ElfSymbol> elfSymbols;
+// Loaded ELF files and their symbols. One per thread for batch mode.
+// The symbol tables are walked only when all the symbols are needed
+// (see getElfSymbols): loading a program looks up a handful of
+// symbols by name.
+thread_local std::vector<std::string> elfFiles;
+thread_local std::unordered_map<std::string, ElfSymbol> elfSymbols;
+thread_local bool elfSymbolsValid = true;
+thread_local SymbolIndex elfSymbolIndex;
+thread_local bool elfSymbolIndexValid = true;
+
+
+/// Return the symbols of the loaded ELF files collecting them on
+/// first use.
+static
+const std::unordered_map<std::string, ElfSymbol>&
+getElfSymbols()
+{
+  if (not elfSymbolsValid)
+    {
+      elfSymbols.clear();
+      for (const auto& path : elfFiles)
+	{
+	  ElfFile elf;
+	  if (elf.open(path))
+	    elf.collectSymbols(elfSymbols);
+	}
+      elfSymbolsValid = true;
+    }
+  return elfSymbols;
+}
+
+
+/// Return the index by address of the symbols of the loaded ELF files
+/// building it on first use after a load.
+static
+const SymbolIndex&
+getSymbolIndex()
+{
+  if (not elfSymbolIndexValid)
+    {
+      elfSymbolIndex = SymbolIndex(getElfSymbols());
+      elfSymbolIndexValid = true;
+    }
+  return elfSymbolIndex;
+}
+
+
+/// Forget the symbols of the loaded ELF files.
+static
+void
+clearElfSymbols()
+{
+  elfFiles.clear();
+  elfSymbols.clear();
+  elfSymbolsValid = true;
+  elfSymbolIndex = SymbolIndex();
+  elfSymbolIndexValid = true;
+}
+
+
+/// Set symbol to the given symbol of the given ELF file or, if not
+/// found there, of the previously loaded ELF files. Return false if
+/// no file defines it.
+static
+bool
+findElfSymbol(const ElfFile& elf, const char* name, ElfSymbol& symbol)
+{
+  if (elf.findSymbol(name, symbol))
+    return true;
+  const auto& symbols = getElfSymbols();
+  auto iter = symbols.find(name);
+  if (iter == symbols.end())
+    return false;
+  symbol = iter->second;
+  return true;
+}
 
 
 template<typename URV>
@@ -359,7 +843,11 @@ loadElfFile(Core<URV>& core, const std::string& filePath)
 {
   size_t entryPoint = 0, exitPoint = 0;
 
-  if (not core.loadElfFile(filePath, entryPoint, exitPoint, elfSymbols))
+  ElfFile elf;
+  if (not elf.open(filePath))
+    return false;
+
+  if (not core.loadElfFile(elf, entryPoint, exitPoint))
     return false;
 
   core.pokePc(entryPoint);
@@ -367,20 +855,28 @@ loadElfFile(Core<URV>& core, const std::string& filePath)
   if (exitPoint)
     core.setStopAddress(exitPoint);
 
-  if (elfSymbols.count("tohost"))
-    core.setToHostAddress(elfSymbols.at("tohost").addr_);
+  ElfSymbol sym;
+  auto find = [&elf, &sym] (const char* name) {
+    return findElfSymbol(elf, name, sym);
+  };
+
+  if (find("tohost"))
+    core.setToHostAddress(sym.addr_);
 
-  if (elfSymbols.count("__whisper_console_io"))
-    core.setConsoleIo(elfSymbols.at("__whisper_console_io").addr_);
+  if (find("__whisper_console_io"))
+    core.setConsoleIo(sym.addr_);
 
-  if (elfSymbols.count("__global_pointer$"))
-    core.pokeIntReg(RegGp, elfSymbols.at("__global_pointer$").addr_);
+  if (find("__global_pointer$"))
+    core.pokeIntReg(RegGp, sym.addr_);
 
-  if (elfSymbols.count("_end"))   // For newlib emulation.
-    core.setTargetProgramBreak(elfSymbols.at("_end").addr_);
+  if (find("_end"))   // For newlib emulation.
+    core.setTargetProgramBreak(sym.addr_);
   else
     core.setTargetProgramBreak(exitPoint);
 
+  elfFiles.push_back(filePath);
+  elfSymbolsValid = false;
+  elfSymbolIndexValid = false;
   return true;
 }
 
@@ -442,6 +938,108 @@ applyIsaString(const std::string& isaStr, Core<URV>& core)
 }
 
 
+/// Parse the given trace window specs (see --tracewindow) into the
+/// given windows. Function windows use the symbols of the loaded ELF
+/// files. Return true on success and false (printing a message) on
+/// failure.
+template<typename URV>
+static
+bool
+parseTraceWindows(const StringVec& specs,
+		  typename Core<URV>::TraceWindows& windows)
+{
+  unsigned errors = 0;
+
+  for (const auto& spec : specs)
+    {
+      auto colon = spec.find(':');
+      std::string kind = spec.substr(0, colon);
+      std::string value = colon == std::string::npos? "" : spec.substr(colon + 1);
+
+      if (kind == "trigger" and colon == std::string::npos)
+	{
+	  windows.triggers = true;
+	  continue;
+	}
+
+      if (kind == "count" or kind == "pc")
+	{
+	  auto dash = value.find('-');
+	  uint64_t begin = 0, end = 0;
+	  if (dash == std::string::npos or
+	      not parseCmdLineNumber("tracewindow", value.substr(0, dash), begin) or
+	      not parseCmdLineNumber("tracewindow", value.substr(dash + 1), end) or
+	      begin >= end)
+	    {
+	      std::cerr << "Invalid trace window: " << spec << " -- expecting "
+			<< kind << ":begin-end with begin less than end\n";
+	      errors++;
+	    }
+	  else if (kind == "count")
+	    windows.counts.push_back({begin, end});
+	  else
+	    windows.pcs.push_back({URV(begin), URV(end)});
+	  continue;
+	}
+
+      if (kind == "func")
+	{
+	  const auto& symbols = getElfSymbols();
+	  auto iter = symbols.find(value);
+	  if (iter == symbols.end() or iter->second.size_ == 0)
+	    {
+	      std::cerr << "Invalid trace window: " << spec << " -- no function "
+			<< value << " in the loaded ELF files\n";
+	      errors++;
+	    }
+	  else
+	    {
+	      URV addr = iter->second.addr_;
+	      windows.pcs.push_back({addr, URV(addr + iter->second.size_)});
+	    }
+	  continue;
+	}
+
+      if (kind == "priv" and not value.empty())
+	{
+	  unsigned modes = 0;
+	  for (char c : value)
+	    {
+	      if (c == 'm')
+		modes |= 1 << unsigned(PrivilegeMode::Machine);
+	      else if (c == 's')
+		modes |= 1 << unsigned(PrivilegeMode::Supervisor);
+	      else if (c == 'u')
+		modes |= 1 << unsigned(PrivilegeMode::User);
+	      else
+		modes = 0;
+	      if (not modes)
+		break;
+	    }
+	  if (not modes)
+	    {
+	      std::cerr << "Invalid trace window: " << spec << " -- expecting "
+			<< "privilege modes among m, s and u\n";
+	      errors++;
+	    }
+	  windows.privModes |= modes;
+	  continue;
+	}
+
+      std::cerr << "Invalid trace window: " << spec << " -- expecting "
+		<< "count:n-m, pc:a-b, func:name, priv:modes or trigger\n";
+      errors++;
+    }
+
+  return errors == 0;
+}
+
+
+/// Stop token of the harts of this process: Set by keyboard
+/// interrupts (see kbdInterruptHandler).
+static StopToken interruptToken;
+
+
 /// Apply command line arguments: Load ELF and HEX files, set
 /// start/end/tohost. Return true on success and false on failure.
 template<typename URV>
@@ -451,6 +1049,8 @@ applyCmdLineArgs(const Args& args, Core<URV>& core)
 {
   unsigned errors = 0;
 
+  core.setStopToken(&interruptToken);
+
   if (not args.isa.empty())
     {
       if (not applyIsaString(args.isa, core))
@@ -476,8 +1076,56 @@ applyCmdLineArgs(const Args& args, Core<URV>& core)
 	errors++;
     }
 
+  // Library routines executed on the host: Found in the symbols of
+  // the loaded ELF files.
+  if (not args.accelerate.empty())
+    {
+      std::vector<std::string> names;
+      boost::split(names, args.accelerate, boost::is_any_of(","),
+		   boost::token_compress_on);
+      if (args.accelerate == "all")
+	names = { "memcpy", "memset", "strlen", "memcmp" };
+      const auto& symbols = getElfSymbols();
+      for (const auto& name : names)
+	{
+	  auto iter = symbols.find(name);
+	  if (iter == symbols.end())
+	    std::cerr << "Warning: No symbol " << name << " in the loaded "
+		      << "ELF files -- not accelerated\n";
+	  else if (not core.accelerateRoutine(name, iter->second.addr_))
+	    {
+	      std::cerr << "Cannot accelerate " << name << " -- expecting "
+			<< "memcpy, memset, strlen or memcmp\n";
+	      errors++;
+	    }
+	}
+    }
+
+  if (not args.traceWindows.empty())
+    {
+      typename Core<URV>::TraceWindows windows;
+      if (parseTraceWindows<URV>(args.traceWindows, windows))
+	core.setTraceWindows(windows);
+      else
+	errors++;
+      if (windows.triggers and not args.triggers)
+	std::cerr << "Warning: Trigger trace window without --triggers -- "
+		  << "nothing will be traced\n";
+    }
+
   if (not args.instFreqFile.empty())
-    core.enableInstructionFrequency(true);
+    {
+      InstProfile::Mode mode = InstProfile::Mode::Operands;
+      if (args.instFreqMode == "count")
+	mode = InstProfile::Mode::Count;
+      else if (args.instFreqMode != "operands")
+	{
+	  std::cerr << "Invalid instruction profile mode: "
+		    << args.instFreqMode << " -- expecting count or operands\n";
+	  errors++;
+	}
+      core.enableInstructionFrequency(true, mode, args.instFreqSample);
+    }
 
   // Command line to-host overrides that of ELF and config file.
   if (args.hasToHost)
@@ -501,11 +1149,17 @@ applyCmdLineArgs(const Args& args, Core<URV>& core)
   // Print load-instruction data-address when tracing instructions.
   core.setTraceLoad(args.traceLoad);
 
+  // Annotate traced instructions with their function.
+  if (args.traceSymbols)
+    core.setTraceSymbols(&getSymbolIndex());
+
   core.enableTriggers(args.triggers);
   core.enableGdb(args.gdb);
   core.enablePerformanceCounters(args.counters);
   core.enableAbiNames(args.abiNames);
   core.enableNewlib(args.newlib);
+  core.enableIdleSkip(args.skipIdle);
+  core.setConsoleFlushOnStop(args.consoleFlush);
 
   // Apply register initialization.
   if (not applyCmdLineRegInit(args, core))
@@ -536,6 +1190,42 @@ applyCmdLineArgs(const Args& args, Core<URV>& core)
 }
 
 
+/// Create the what-if helpers of the given hart (see
+/// Core::whatIfBatch): count harts sharing its memory configured as
+/// it is by the given configuration and by the command line options
+/// that change the execution of instructions.
+template <typename URV>
+static
+bool
+createWhatIfHelpers(const Args& args, const CoreConfig& config,
+		    Core<URV>& core, unsigned count,
+		    std::vector<std::unique_ptr<Core<URV>>>& helpers)
+{
+  std::vector<Core<URV>*> pointers;
+  for (unsigned i = 0; i < count; ++i)
+    {
+      auto helper = std::make_unique<Core<URV>>(core.hartId(),
+						core.getMemory(),
+						core.intRegCount());
+      helper->followMemoryLayout(true);
+      if (not config.applyConfig(*helper, false))
+	return false;
+      if (not args.isa.empty() and not applyIsaString(args.isa, *helper))
+	return false;
+      helper->enableTriggers(args.triggers);
+      helper->enablePerformanceCounters(args.counters);
+      helper->enableStoreExceptions(true);
+      helper->enableLoadExceptions(true);
+      helper->reset();
+      pointers.push_back(helper.get());
+      helpers.push_back(std::move(helper));
+    }
+
+  core.setWhatIfHelpers(pointers);
+  return true;
+}
+
+
 /// Interactive "until" command.
 template <typename URV>
 static
@@ -590,6 +1280,116 @@ stepCommand(Core<URV>& core, const std::string& line,
 }
 
 
+/// Interactive "rstep" and "rcont" commands.
+template <typename URV>
+static
+bool
+reverseCommand(Core<URV>& core, const std::string& line,
+	       const std::vector<std::string>& tokens)
+{
+  if (not core.isReverseEnabled())
+    {
+      std::cerr << "Reverse execution is not enabled (see option --reverse)\n";
+      return false;
+    }
+
+  bool reached = true;
+  if (tokens.at(0) == "rcont")
+    {
+      if (tokens.size() != 1)
+	{
+	  std::cerr << "Invalid rcont command: " << line << '\n';
+	  return false;
+	}
+      reached = core.reverseContinue();
+    }
+  else
+    {
+      uint64_t count = 1;
+      if (tokens.size() > 1 and
+	  not parseCmdLineNumber("instruction-count", tokens.at(1), count))
+	return false;
+      reached = core.reverseStep(count);
+    }
+
+  if (not reached)
+    std::cerr << "Reached the beginning of the reverse execution history\n";
+  return true;
+}
+
+
+/// Interactive "break", "watch" and "delete" commands.
+template <typename URV>
+static
+bool
+stopPointCommand(Core<URV>& core, const std::string& line,
+		 const std::vector<std::string>& tokens)
+{
+  const std::string& command = tokens.at(0);
+  auto& points = core.stopPoints();
+
+  if (command == "delete" and tokens.size() == 1)
+    {
+      points.clear();
+      return true;
+    }
+
+  URV addr = 0;
+  if (tokens.size() < 2 or not parseCmdLineNumber("address", tokens.at(1), addr))
+    {
+      std::cerr << "Invalid " << command << " command: " << line << '\n';
+      std::cerr << "Expecting: " << command << " address\n";
+      return false;
+    }
+
+  if (command == "break")
+    {
+      if (tokens.size() != 2)
+	{
+	  std::cerr << "Invalid break command: " << line << '\n';
+	  return false;
+	}
+      points.addBreakpoint(addr);
+      return true;
+    }
+
+  if (command == "delete")
+    {
+      bool found = points.removeBreakpoint(addr);
+      auto watches = points.watchpoints();
+      for (const auto& w : watches)
+	if (w.addr == addr)
+	  found = points.removeWatchpoint(w.addr, w.size, w.access) or found;
+      if (not found)
+	std::cerr << "No breakpoint or watchpoint at " << tokens.at(1) << '\n';
+      return found;
+    }
+
+  // Watch command.
+  using Access = StopPoints::Access;
+  uint64_t size = 1;
+  Access access = Access::Write;
+  for (size_t i = 2; i < tokens.size(); ++i)
+    {
+      const auto& tok = tokens.at(i);
+      if (tok == "read")
+	access = Access::Read;
+      else if (tok == "write")
+	access = Access::Write;
+      else if (tok == "access")
+	access = Access::Any;
+      else if (i != 2 or not parseCmdLineNumber("size", tok, size) or size == 0)
+	{
+	  std::cerr << "Invalid watch command: " << line << '\n';
+	  std::cerr << "Expecting: watch address [size] [read|write|access]\n";
+	  return false;
+	}
+    }
+  points.addWatchpoint(addr, size, access);
+  return true;
+}
+
+
 template <typename URV>
 static
 void
@@ -773,7 +1573,11 @@ peekCommand(Core<URV>& core, const std::string& line,
   if (resource == "pc")
     {
       URV pc = core.peekPc();
-      std::cout << (boost::format(hexForm) % pc) << std::endl;
+      std::string location = getSymbolIndex().location(pc);
+      std::cout << (boost::format(hexForm) % pc);
+      if (not location.empty())
+	std::cout << " <" << location << ">";
+      std::cout << std::endl;
       return true;
     }
 
@@ -1067,10 +1871,11 @@ disassCommand(Core<URV>& core, const std::string& line,
       std::string item = tokens.at(2);
       std::string name;  // item (if a symbol) or function name containing item
       ElfSymbol symbol;
-      if (elfSymbols.count(item))
+      const auto& symbols = getElfSymbols();
+      if (symbols.count(item))
 	{
 	  name = item;
-	  symbol = elfSymbols.at(item);
+	  symbol = symbols.at(item);
 	}
       else
 	{
@@ -1079,15 +1884,12 @@ disassCommand(Core<URV>& core, const std::string& line,
 	  if (not parseCmdLineNumber("address", item, addr))
 	    return false;
 
-	  for (const auto& kv : elfSymbols)
+	  const auto& index = getSymbolIndex();
+	  const auto& range = index.find(addr);
+	  if (range.symbol and symbols.at(index.name(range.symbol)).size_)
 	    {
-	      auto& sym = kv.second;
-	      size_t start = sym.addr_, end = sym.addr_ + sym.size_;
-	      if (addr >= start and addr < end)
-		{
-		  name = kv.first;
-		  symbol = sym;
-		}
+	      name = index.name(range.symbol);
+	      symbol = symbols.at(name);
 	    }
 	}
 
@@ -1115,7 +1917,7 @@ disassCommand(Core<URV>& core, const std::string& line,
 	    inst = (inst << 16) >> 16; // Clear top 16 bits.
 
 	  std::string str;
-	  core.disassembleInst(inst, str);
+	  core.disassembleInst(addr, inst, str);
 	  std::cout << "  " << (boost::format(hexForm) % addr) << ' '
 		    << (boost::format(hexForm) % inst) << ' ' << str << '\n';
 
@@ -1141,6 +1943,7 @@ disassCommand(Core<URV>& core, const std::string& line,
   if (not parseCmdLineNumber("address", tokens[2], addr2))
     return false;
 
+  const auto& index = getSymbolIndex();
   for (URV addr = addr1; addr <= addr2; )
     {
       uint32_t inst = 0;
@@ -1155,7 +1958,10 @@ disassCommand(Core<URV>& core, const std::string& line,
 	inst = (inst << 16) >> 16; // Clear top 16 bits.
 
       std::string str;
-      core.disassembleInst(inst, str);
+      core.disassembleInst(addr, inst, str);
+      std::string location = index.location(addr);
+      if (not location.empty())
+	str += " <" + location + ">";
       std::cout << (boost::format(hexForm) % addr) << ' '
 		<< (boost::format(hexForm) % inst) << ' '
 		<< str << '\n';
@@ -1529,67 +2335,187 @@ serializeMessage(const WhisperMessage& msg, char buffer[],
 }
 
 
-static bool
-receiveMessage(int soc, WhisperMessage& msg)
+/// Server transport over a connected socket.
+struct SocketChannel
 {
-  char buffer[sizeof(msg)];
-  char* p = buffer;
-
-  size_t remain = sizeof(msg);
+  SocketChannel(int soc)
+    : soc_(soc)
+  { }
 
-  while (remain > 0)
-    {
-      ssize_t l = recv(soc, p, remain, 0);
-      if (l < 0)
-	{
-	  if (errno == EINTR)
-	    continue;
-	  std::cerr << "Failed to receive socket message\n";
-	  return false;
-	}
-      if (l == 0)
-	{
-	  msg.type = Quit;
-	  return true;
-	}
-      remain -= l;
-      p += l;
-    }
+  /// Receive exactly size bytes into the given buffer. Set eof to true
+  /// if the peer closed the connection. Return true on success.
+  bool read(char* p, size_t size, bool& eof)
+  {
+    eof = false;
+    while (size > 0)
+      {
+	ssize_t l = recv(soc_, p, size, 0);
+	if (l < 0)
+	  {
+	    if (errno == EINTR)
+	      continue;
+	    std::cerr << "Failed to receive socket message\n";
+	    return false;
+	  }
+	if (l == 0)
+	  {
+	    eof = true;
+	    return true;
+	  }
+	size -= l;
+	p += l;
+      }
+    return true;
+  }
 
-  deserializeMessage(buffer, sizeof(buffer), msg);
+  /// Send the given bytes. Return true on success.
+  bool write(const char* p, size_t size)
+  {
+    while (size > 0)
+      {
+	ssize_t l = send(soc_, p, size, 0);
+	if (l < 0)
+	  {
+	    if (errno == EINTR)
+	      continue;
+	    std::cerr << "Failed to send socket command\n";
+	    return false;
+	  }
+	size -= l;
+	p += l;
+      }
+    return true;
+  }
 
-  return true;
-}
+  int soc_;
+};
 
 
-static bool
-sendMessage(int soc, WhisperMessage& msg)
+/// Server transport over a shared memory segment holding a pair of
+/// single producer/single consumer rings (see WhisperShm.h). The
+/// segment is created by the constructor and removed by the
+/// destructor.
+class ShmChannel
 {
-  char buffer[sizeof(msg)];
+public:
 
-  serializeMessage(msg, buffer, sizeof(buffer));
+  ShmChannel(const std::string& name, bool useFutex)
+    : name_(name)
+  {
+    // Remove a segment left behind by an earlier run.
+    shm_unlink(name.c_str());
 
-  // Send command.
-  ssize_t remain = sizeof(msg);
-  char* p = buffer;
-  while (remain > 0)
-    {
-      ssize_t l = send(soc, p, remain , 0);
-      if (l < 0)
-	{
-	  if (errno == EINTR)
-	    continue;
-	  std::cerr << "Failed to send socket command\n";
-	  return false;
-	}
-      remain -= l;
-      p += l;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+      {
+	std::cerr << "Failed to create shared memory segment " << name
+		  << ": " << strerror(errno) << '\n';
+	return;
+      }
+
+    void* p = MAP_FAILED;
+    if (ftruncate(fd, sizeof(WhisperShm)) == 0)
+      p = mmap(nullptr, sizeof(WhisperShm), PROT_READ | PROT_WRITE,
+	       MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+      {
+	std::cerr << "Failed to map shared memory segment " << name
+		  << ": " << strerror(errno) << '\n';
+	shm_unlink(name.c_str());
+	return;
+      }
+
+    shm_ = static_cast<WhisperShm*>(p);
+    shm_->version = WHISPER_SHM_VERSION;
+    shm_->useFutex = useFutex;
+    shm_->serverPid = getpid();
+    __atomic_store_n(&shm_->magic, WHISPER_SHM_MAGIC, __ATOMIC_RELEASE);
+  }
+
+  ~ShmChannel()
+  {
+    if (not shm_)
+      return;
+    munmap(shm_, sizeof(WhisperShm));
+    shm_unlink(name_.c_str());
+  }
+
+  /// Return true if the segment was successfully created.
+  bool isValid() const
+  { return shm_ != nullptr; }
+
+  /// Receive exactly size bytes from the request ring. Set eof if
+  /// the test-bench is gone (see WhisperShm.h).
+  bool read(char* p, size_t size, bool& eof)
+  {
+    eof = gone_ or not whisperShmRead(shm_, &shm_->request, p, size);
+    gone_ = eof;
+    return true;
+  }
+
+  /// Send the given bytes on the reply ring. Return false if the
+  /// consumer is gone.
+  bool write(const char* p, size_t size)
+  {
+    gone_ = gone_ or not whisperShmWrite(shm_, &shm_->reply, p, size);
+    return not gone_;
+  }
+
+private:
+
+  std::string name_;
+  WhisperShm* shm_ = nullptr;
+  bool gone_ = false;    // Other side exited.
+};
+
+
+/// Receive a message from the given channel. A closed channel is
+/// reported as a Quit message. Return true on success.
+template <typename Channel>
+static bool
+receiveMessage(Channel& channel, WhisperMessage& msg)
+{
+  char buffer[sizeof(msg)];
+
+  bool eof = false;
+  if (not channel.read(buffer, sizeof(buffer), eof))
+    return false;
+
+  if (eof)
+    {
+      msg.type = Quit;
+      return true;
     }
 
+  deserializeMessage(buffer, sizeof(buffer), msg);
+
   return true;
 }
 
 
+/// Send the given bytes on the given channel. Return true on success.
+template <typename Channel>
+static bool
+sendBytes(Channel& channel, const char* p, size_t size)
+{
+  return channel.write(p, size);
+}
+
+
+template <typename Channel>
+static bool
+sendMessage(Channel& channel, WhisperMessage& msg)
+{
+  char buffer[sizeof(msg)];
+
+  serializeMessage(msg, buffer, sizeof(buffer));
+
+  // Send command.
+  return sendBytes(channel, buffer, sizeof(buffer));
+}
+
+
 /// Server mode poke command.
 template <typename URV>
 static
@@ -1675,6 +2601,275 @@ peekCommand(Core<URV>& core, const WhisperMessage& req, WhisperMessage& reply)
 }
 
 
+/// Decode the peek/poke entry (see WhisperMessage.h) at the given
+/// location into the resource, address and value fields of msg.
+static
+void
+decodeEntry(const char* p, WhisperMessage& msg)
+{
+  uint32_t x = 0, hi = 0, lo = 0;
+  memcpy(&x, p, sizeof(x));
+  msg.resource = ntohl(x);
+  memcpy(&hi, p + 4, sizeof(hi));
+  memcpy(&lo, p + 8, sizeof(lo));
+  msg.address = (uint64_t(ntohl(hi)) << 32) | ntohl(lo);
+  memcpy(&hi, p + 12, sizeof(hi));
+  memcpy(&lo, p + 16, sizeof(lo));
+  msg.value = (uint64_t(ntohl(hi)) << 32) | ntohl(lo);
+}
+
+
+/// Encode the resource, address and value fields of msg as a
+/// peek/poke entry (see WhisperMessage.h) at the given location.
+static
+void
+encodeEntry(const WhisperMessage& msg, char* p)
+{
+  uint32_t fields[5] = { htonl(msg.resource),
+			 htonl(uint32_t(msg.address >> 32)),
+			 htonl(uint32_t(msg.address)),
+			 htonl(uint32_t(msg.value >> 32)),
+			 htonl(uint32_t(msg.value)) };
+  memcpy(p, fields, sizeof(fields));
+}
+
+
+/// Read and drop the given number of bytes from the given
+/// channel. Return true on success.
+template <typename Channel>
+static
+bool
+discardBytes(Channel& channel, uint64_t count)
+{
+  char buffer[64*1024];
+  while (count)
+    {
+      size_t n = std::min(count, uint64_t(sizeof(buffer)));
+      bool eof = false;
+      if (not channel.read(buffer, n, eof) or eof)
+	return false;
+      count -= n;
+    }
+  return true;
+}
+
+
+/// Server mode peek-block command: Set reply to the header message
+/// and data to the memory bytes following it on the socket.
+template <typename URV>
+static
+bool
+peekBlockCommand(Core<URV>& core, const WhisperMessage& req,
+		 WhisperMessage& reply, std::vector<char>& data)
+{
+  reply = req;
+  data.clear();
+
+  if (req.value > WHISPER_MAX_BLOCK)
+    {
+      reply.type = Invalid;
+      return false;
+    }
+
+  data.resize(req.value);
+  for (uint64_t i = 0; i < req.value; ++i)
+    {
+      uint8_t byte = 0;
+      if (not core.peekMemory(req.address + i, byte))
+	{
+	  reply.type = Invalid;
+	  data.clear();
+	  return false;
+	}
+      data[i] = char(byte);
+    }
+
+  return true;
+}
+
+
+/// Server mode poke-block command: Write the req.value bytes
+/// following the request on the channel to memory. Return false if
+/// the bytes cannot be read from the channel.
+template <typename URV, typename Channel>
+static
+bool
+pokeBlockCommand(Core<URV>& core, Channel& channel, const WhisperMessage& req,
+		 WhisperMessage& reply, FILE* commandLog,
+		 EventLogWriter* events)
+{
+  reply = req;
+
+  // Log word pokes (replayable) when the block is word aligned.
+  bool logWords = ((req.address | req.value) % sizeof(URV)) == 0;
+  if (commandLog and not logWords)
+    fprintf(commandLog, "# poke_block 0x%lx %ld\n", req.address, req.value);
+
+  char buffer[64*1024];
+  uint64_t remain = req.value, written = 0;
+  bool ok = true;
+
+  while (remain)
+    {
+      size_t n = std::min(remain, uint64_t(sizeof(buffer)));
+      bool eof = false;
+      if (not channel.read(buffer, n, eof) or eof)
+	return false;
+      remain -= n;
+
+      uint64_t chunkAddr = req.address + written;
+      for (size_t i = 0; i < n and ok; ++i)
+	{
+	  if (core.pokeMemory(req.address + written, uint8_t(buffer[i])))
+	    written++;
+	  else
+	    ok = false;
+	}
+
+      // Record the bytes actually written.
+      size_t chunkWritten = req.address + written - chunkAddr;
+      if (events and chunkWritten)
+	{
+	  SessionEvent event;
+	  event.kind = SessionEvent::PokeBlock;
+	  event.count = core.getInstructionCount();
+	  event.address = chunkAddr;
+	  events->write(event, reinterpret_cast<const uint8_t*>(buffer),
+			chunkWritten);
+	}
+
+      // Log only the bytes actually written. A failure may leave a
+      // partial word which cannot be logged as a word poke.
+      if (commandLog and logWords)
+	{
+	  size_t i = 0;
+	  for ( ; i + sizeof(URV) <= chunkWritten; i += sizeof(URV))
+	    {
+	      URV word = 0;
+	      memcpy(&word, buffer + i, sizeof(word));
+	      fprintf(commandLog, "poke m 0x%lx 0x%lx\n", chunkAddr + i,
+		      uint64_t(word));
+	    }
+	  if (i < chunkWritten)
+	    fprintf(commandLog, "# poke_block 0x%lx %ld\n", chunkAddr + i,
+		    chunkWritten - i);
+	}
+    }
+
+  if (not ok)
+    {
+      reply.type = Invalid;
+      reply.value = written;
+    }
+  return true;
+}
+
+
+/// Server mode peek-multi command: Read the req.value entries
+/// following the request on the channel and peek the corresponding
+/// resources. Set reply to the header message and data to the
+/// entries following it on the socket. Return false if the entries
+/// cannot be read from the channel.
+template <typename URV, typename Channel>
+static
+bool
+peekMultiCommand(Core<URV>& core, Channel& channel, const WhisperMessage& req,
+		 WhisperMessage& reply, std::vector<char>& data,
+		 FILE* commandLog)
+{
+  reply = req;
+  data.clear();
+
+  uint64_t count = req.value;
+  if (count > WHISPER_MAX_ENTRIES)
+    {
+      reply.type = Invalid;
+      return discardBytes(channel, count * WHISPER_ENTRY_SIZE);
+    }
+
+  data.resize(count * WHISPER_ENTRY_SIZE);
+  bool eof = false;
+  if (count and (not channel.read(data.data(), data.size(), eof) or eof))
+    return false;
+
+  uint64_t failed = 0;
+  for (uint64_t i = 0; i < count; ++i)
+    {
+      char* p = data.data() + i * WHISPER_ENTRY_SIZE;
+      WhisperMessage entry(req.hart, Peek), entryReply;
+      decodeEntry(p, entry);
+      peekCommand(core, entry, entryReply);
+      if (entryReply.type == Invalid)
+	{
+	  entryReply.resource = 0;
+	  entryReply.value = 0;
+	  failed++;
+	}
+      encodeEntry(entryReply, p);
+      if (commandLog)
+	fprintf(commandLog, "peek %c 0x%lx\n", char(entry.resource),
+		entry.address);
+    }
+
+  reply.address = failed;
+  return true;
+}
+
+
+/// Server mode poke-multi command: Read the req.value entries
+/// following the request on the channel and apply them in order.
+/// Return false if the entries cannot be read from the channel.
+template <typename URV, typename Channel>
+static
+bool
+pokeMultiCommand(Core<URV>& core, Channel& channel, const WhisperMessage& req,
+		 WhisperMessage& reply, FILE* commandLog,
+		 EventLogWriter* events)
+{
+  reply = req;
+
+  const uint64_t chunkEntries = 4096;
+  char buffer[chunkEntries * WHISPER_ENTRY_SIZE];
+  uint64_t remain = req.value, index = 0, applied = 0;
+  bool ok = true;
+
+  while (remain)
+    {
+      uint64_t n = std::min(remain, chunkEntries);
+      bool eof = false;
+      if (not channel.read(buffer, n * WHISPER_ENTRY_SIZE, eof) or eof)
+	return false;
+      remain -= n;
+
+      for (uint64_t i = 0; i < n; ++i, ++index)
+	{
+	  WhisperMessage entry(req.hart, Poke), entryReply;
+	  decodeEntry(buffer + i * WHISPER_ENTRY_SIZE, entry);
+	  if (events)
+	    events->write(SessionEvent{SessionEvent::Poke,
+				       core.getInstructionCount(),
+				       entry.resource, entry.address,
+				       entry.value, {}});
+	  if (pokeCommand(core, entry, entryReply))
+	    applied++;
+	  else if (ok)
+	    {
+	      ok = false;
+	      reply.address = index;
+	    }
+	  if (commandLog)
+	    fprintf(commandLog, "poke %c 0x%lx 0x%lx\n", char(entry.resource),
+		    entry.address, entry.value);
+	}
+    }
+
+  reply.value = applied;
+  if (not ok)
+    reply.type = Invalid;
+  return true;
+}
+
+
 /// Server mode disassemble command.
 template <typename URV>
 static
@@ -1683,7 +2878,7 @@ disassembleAnnotateInst(Core<URV>& core, uint32_t inst, bool interrupted,
 			bool hasPreTrigger, bool hasPostTrigger,
 			std::string& text)
 {
-  core.disassembleInst(inst, text);
+  core.disassembleInst(core.lastPc(), inst, text);
   uint32_t op0 = 0, op1 = 0; int32_t op2 = 0;
   const InstInfo& info = core.decode(inst, op0, op1, op2);
   if (info.isBranch())
@@ -1717,13 +2912,14 @@ disassembleAnnotateInst(Core<URV>& core, uint32_t inst, bool interrupted,
 /// address, opcode and assembly text. Use hasPre (instruction tripped
 /// a "before" trigger), hasPost (tripped an "after" trigger) and
 /// interrupted (instruction encountered an external interrupt) to
-/// annotate the assembly text.
+/// annotate the assembly text. Leave the assembly text empty if
+/// withText is false.
 template <typename URV>
 static
 void
 processStepCahnges(Core<URV>& core, std::vector<WhisperMessage>& pendingChanges,
 		   bool interrupted, bool hasPre, bool hasPost,
-		   WhisperMessage& reply, FILE* traceFile)
+		   WhisperMessage& reply, FILE* traceFile, bool withText = true)
 {
   // Get executed instruction.
   URV pc = core.lastPc();
@@ -1737,119 +2933,41 @@ processStepCahnges(Core<URV>& core, std::vector<WhisperMessage>& pendingChanges,
 
   // Add disassembly of instruction to reply.
   std::string text;
-  disassembleAnnotateInst(core, inst, interrupted, hasPre, hasPost, text);
+  if (withText)
+    disassembleAnnotateInst(core, inst, interrupted, hasPre, hasPost, text);
 
   strncpy(reply.buffer, text.c_str(), sizeof(reply.buffer) - 1);
   reply.buffer[sizeof(reply.buffer) -1] = 0;
 
-  // Collect integer register change caused by execution of instruction.
+  // Collect changes caused by execution of instruction. Memory
+  // changes are reported as words.
   pendingChanges.clear();
-  int regIx = core.lastIntReg();
-  if (regIx > 0)
+  for (const auto& change : core.lastChanges())
     {
-      URV value = 0;
-      if (core.peekIntReg(regIx, value))
+      if (change.resource != 'm')
 	{
-	  WhisperMessage msg;
-	  msg.type = Change;
-	  msg.resource = 'r';
-	  msg.address = regIx;
-	  msg.value = value;
+	  WhisperMessage msg(0, Change, change.resource, change.addr,
+			     change.value);
 	  pendingChanges.push_back(msg);
+	  continue;
 	}
-    }
-
-  // Collect floating point register change.
-  int fpRegIx = core.lastFpReg();
-  if (fpRegIx >= 0)
-    {
-      uint64_t val = 0;
-      if (core.peekFpReg(fpRegIx, val))
-	{
-	  WhisperMessage msg;
-	  msg.type = Change;
-	  msg.resource = 'f';
-	  msg.address = fpRegIx;
-	  msg.value = val;
-	  pendingChanges.push_back(msg);
-	}
-    }
-
-  // Collect CSR and trigger changes.
-  std::vector<CsrNumber> csrs;
-  std::vector<unsigned> triggers;
-  core.lastCsr(csrs, triggers);
-
-  // Map to keep CSRs in order and to drop duplicate entries.
-  std::map<URV,URV> csrMap;
-
-  // Components of the triggers that changed (if any).
-  std::vector<bool> tdataChanged(3);
-
-  // Collect changed CSRs and their values. Collect components of
-  // changed trigger.
-  for (CsrNumber csr : csrs)
-    {
-      URV value;
-      if (core.peekCsr(csr, value))
-	{
-	  if (csr >= CsrNumber::TDATA1 and csr <= CsrNumber::TDATA3)
-	    {
-	      size_t ix = size_t(csr) - size_t(CsrNumber::TDATA1);
-	      tdataChanged.at(ix) = true;
-	    }
-	  else
-	    csrMap[URV(csr)] = value;
-	}
-    }
 
-  // Collect changes associated with trigger register.
-  for (unsigned trigger : triggers)
-    {
-      URV data1(0), data2(0), data3(0);
-      if (not core.peekTrigger(trigger, data1, data2, data3))
-	continue;
-      if (tdataChanged.at(0))
-	{
-	  URV addr = (trigger << 16) | unsigned(CsrNumber::TDATA1);
-	  csrMap[addr] = data1;
-	}
-      if (tdataChanged.at(1))
-	{
-	  URV addr = (trigger << 16) | unsigned(CsrNumber::TDATA2);
-	  csrMap[addr] = data2;
-	}
-      if (tdataChanged.at(2))
+      WhisperMessage msg(0, Change, 'm', change.addr, uint32_t(change.value));
+      pendingChanges.push_back(msg);
+      if (change.size == 8)
 	{
-	  URV addr = (trigger << 16) | unsigned(CsrNumber::TDATA3);
-	  csrMap[addr] = data3;
+	  WhisperMessage high(0, Change, 'm', change.addr + 4,
+			      uint32_t(change.value >> 32));
+	  pendingChanges.push_back(high);
 	}
     }
 
-  for (const auto& [key, val] : csrMap)
-    {
-      WhisperMessage msg(0, Change, 'c', key, val);
-      pendingChanges.push_back(msg);
-    }
-
-  std::vector<size_t> addresses;
-  std::vector<uint32_t> words;
-
-  core.lastMemory(addresses, words);
-  assert(addresses.size() == words.size());
-
-  for (size_t i = 0; i < addresses.size(); ++i)
-    {
-      WhisperMessage msg(0, Change, 'm', addresses.at(i), words.at(i));
-      pendingChanges.push_back(msg);
-    }
-
   // Add count of changes to reply.
   reply.value = pendingChanges.size();
 
   // The changes will be retrieved one at a time from the back of the
   // pendigChanges vector: Put the vector in reverse order. Changes
-  // are retrieved using a Change request (see interactUsingSocket).
+  // are retrieved using a Change request (see interactUsingChannel).
   std::reverse(pendingChanges.begin(), pendingChanges.end());
 }
 
@@ -1885,48 +3003,439 @@ stepCommand(Core<URV>& core, const WhisperMessage& req,
 }
 
 
-/// Server mode exception command.
+/// Run-ahead stepping of the hart of a server session (see
+/// --runahead): While the test-bench works on the reply of a step, a
+/// helper thread keeps stepping the hart queuing the replies and
+/// changes of up to depth steps. Step requests are answered from the
+/// queue. Other requests must first call sync which stops the helper
+/// and takes the hart back to the last step answered using reverse
+/// execution (see Core::enableReverse). The helper stops before an
+/// instruction that cannot be undone (see Core::isUndoableStep):
+/// such an instruction is stepped by the server thread.
 template <typename URV>
-static
-bool
-exceptionCommand(Core<URV>& core, const WhisperMessage& req, 
-		 WhisperMessage& reply, FILE* traceFile,
-		 std::string& text)
+class RunAhead
 {
-  std::ostringstream oss;
-
-  bool ok = true;
-  URV addr = req.address;
-  unsigned matchCount = 0;
+public:
 
-  reply = req;
+  RunAhead(Core<URV>& core, unsigned depth)
+    : core_(core), queue_(depth)
+  {
+    core_.enableReverse(reverseInterval_, journalBytes_);
+    thread_ = std::thread([this] { work(); });
+  }
 
-  WhisperExceptionType expType = WhisperExceptionType(req.value);
-  switch (expType)
+  ~RunAhead()
+  {
     {
-    case InstAccessFault:
-      core.postInstAccessFault(addr);
-      oss << "exception inst " << addr;
-      break;
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      quit_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+    core_.enableReverse(0, 0);
+  }
 
-    case DataAccessFault:
-      core.postDataAccessFault(addr);
-      oss << "exception data " << addr;
-      break;
+  /// Answer a step request from the queue setting reply and
+  /// pendingChanges as stepCommand does. Return false if the step is
+  /// to be executed by the caller: the hart is then at the last step
+  /// answered.
+  bool step(WhisperMessage& reply, std::vector<WhisperMessage>& pendingChanges)
+  {
+    if (not active_)
+      {
+	if (not canStep())
+	  return false;
+	core_.markReversePoint();
+	start_ = committed_ = core_.getInstructionCount();
+	{
+	  std::lock_guard<std::mutex> lock(mutex_);
+	  stop_ = false;
+	  running_ = true;
+	}
+	cond_.notify_all();
+	active_ = true;
+      }
 
-    case ImpreciseStoreFault:
-      ok = core.applyStoreException(addr, matchCount);
-      reply.value = matchCount;
-      oss << "exception store 0x" << std::hex << addr;
-      break;
+    while (not queue_.pop(item_))
+      {
+	if (not running_.load(std::memory_order_acquire))
+	  {
+	    if (queue_.pop(item_))
+	      break;
+	    active_ = false;  // Helper stopped: hart at last step answered.
+	    return false;
+	  }
+	std::this_thread::yield();
+      }
 
-    case ImpreciseLoadFault:
-      ok = core.applyLoadException(addr, matchCount);
-      reply.value = matchCount;
-      oss << "exception load 0x" << std::hex << addr;
-      break;
+    committed_ = item_.count;
+    reply = item_.reply;
+    pendingChanges.swap(item_.changes);
+    return true;
+  }
 
-    case NonMaskableInterrupt:
+  /// Stop the helper and take the hart back to the last step
+  /// answered. Return true on success and false (printing a message)
+  /// on failure.
+  bool sync()
+  {
+    if (not active_)
+      return true;
+    active_ = false;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+      cond_.wait(lock, [this] { return not running_; });
+    }
+    while (queue_.pop(item_))
+      ;
+
+    uint64_t now = core_.getInstructionCount();
+    if (now == committed_)
+      return true;
+
+    // Go back one step before the last step answered and execute that
+    // step again so that the hart remembers it (see Core::lastPc).
+    bool ok = false;
+    if (committed_ == start_)
+      ok = core_.reverseStep(now - committed_);
+    else if ((ok = core_.reverseStep(now - committed_ + 1)))
+      {
+	core_.singleStep(nullptr);
+	core_.clearTraceData();
+      }
+    if (not ok)
+      std::cerr << "Error: Failed to take the hart back to instruction #"
+		<< committed_ << " after running ahead\n";
+    return ok;
+  }
+
+  /// Return the instruction count of the last step answered.
+  uint64_t committed() const
+  { return committed_; }
+
+private:
+
+  /// Return true if the helper can execute the next instruction.
+  bool canStep()
+  {
+    if (core_.hasTargetProgramFinished())
+      return false;
+    if (core_.inDebugMode() and not core_.inDebugStepMode())
+      return false;
+    return core_.isUndoableStep();
+  }
+
+  /// Body of the helper thread.
+  void work()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+      {
+	cond_.wait(lock, [this] { return running_ or quit_; });
+	if (quit_)
+	  return;
+	lock.unlock();
+
+	Item item;
+	while (not stop_.load(std::memory_order_relaxed) and canStep())
+	  {
+	    stepCommand(core_, WhisperMessage(), item.changes, item.reply,
+			nullptr);
+	    item.count = core_.getInstructionCount();
+	    while (not queue_.push(item) and
+		   not stop_.load(std::memory_order_relaxed))
+	      std::this_thread::yield();
+	  }
+
+	lock.lock();
+	running_.store(false, std::memory_order_release);
+	cond_.notify_all();
+      }
+  }
+
+  struct Item
+  {
+    WhisperMessage reply;
+    std::vector<WhisperMessage> changes;
+    uint64_t count = 0;  // Instruction count after the step.
+  };
+
+  // Instructions between reverse points and bytes of the memory
+  // journal: Going back replays at most reverseInterval_ steps.
+  static constexpr uint64_t reverseInterval_ = 64;
+  static constexpr size_t journalBytes_ = size_t(64) << 20;
+
+  Core<URV>& core_;
+  SpscQueue<Item> queue_;
+  Item item_;                 // Last item popped (server thread).
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::atomic<bool> running_ = false;  // Helper stepping.
+  std::atomic<bool> stop_ = false;     // Request to stop stepping.
+  bool quit_ = false;                  // Request to end the helper.
+  bool active_ = false;       // Helper started since last sync/stop.
+  uint64_t start_ = 0;        // Instruction count when helper started.
+  uint64_t committed_ = 0;    // Instruction count of last step answered.
+};
+
+
+/// Append to the given buffer the given value using the unsigned
+/// LEB128 (varint) encoding.
+static
+void
+appendVarint(std::vector<char>& buffer, uint64_t value)
+{
+  do
+    {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      if (value)
+	byte |= 0x80;
+      buffer.push_back(byte);
+    }
+  while (value);
+}
+
+
+/// Append to the given buffer a step record (see WhisperMessage.h)
+/// for the instruction described by the given step reply and
+/// changes (changes are in reverse order as produced by
+/// processStepCahnges).
+static
+void
+appendStepRecord(const WhisperMessage& stepReply,
+		 const std::vector<WhisperMessage>& changes, unsigned flags,
+		 std::vector<char>& buffer)
+{
+  size_t start = buffer.size();
+  size_t count = std::min(changes.size(), size_t(255));
+
+  buffer.resize(start + 4);  // Size and count filled in below.
+  appendVarint(buffer, stepReply.address);
+
+  uint32_t inst = htonl(stepReply.resource);
+  const char* p = reinterpret_cast<const char*>(&inst);
+  buffer.insert(buffer.end(), p, p + sizeof(inst));
+
+  for (auto iter = changes.rbegin(); iter != changes.rbegin() + count; ++iter)
+    {
+      buffer.push_back(char(iter->resource));
+      appendVarint(buffer, iter->address);
+      appendVarint(buffer, iter->value);
+    }
+
+  if (flags & WhisperRecordText)
+    {
+      size_t len = strnlen(stepReply.buffer, sizeof(stepReply.buffer));
+      buffer.push_back(char(len));
+      buffer.insert(buffer.end(), stepReply.buffer, stepReply.buffer + len);
+    }
+
+  uint16_t size = htons(uint16_t(buffer.size() - start));
+  memcpy(&buffer.at(start), &size, sizeof(size));
+  buffer.at(start + 2) = char(flags);
+  buffer.at(start + 3) = char(count);
+}
+
+
+/// Server mode step-stream command: Execute up to req.value
+/// instructions (at least one) collecting a step record for each in
+/// the records buffer. Stop early if the target program finishes or
+/// if the core enters debug-halt mode. Set reply to the header
+/// message preceding the records on the socket.
+template <typename URV>
+static
+bool
+stepStreamCommand(Core<URV>& core, const WhisperMessage& req,
+		  std::vector<WhisperMessage>& pendingChanges,
+		  WhisperMessage& reply, std::vector<char>& records,
+		  FILE* traceFile)
+{
+  uint64_t limit = std::max(req.value, uint64_t(1));
+  bool withText = req.resource & WhisperStreamDisass;
+
+  records.clear();
+
+  uint64_t count = 0;
+  while (count < limit)
+    {
+      uint64_t interruptCount = core.getInterruptCount();
+
+      core.singleStep(traceFile);
+      count++;
+
+      unsigned flags = withText ? WhisperRecordText : 0;
+      if (core.getInterruptCount() != interruptCount)
+	flags |= WhisperRecordInterrupted;
+
+      unsigned preCount = 0, postCount = 0;
+      core.countTrippedTriggers(preCount, postCount);
+      if (preCount)
+	flags |= WhisperRecordPreTrigger;
+      if (postCount)
+	flags |= WhisperRecordPostTrigger;
+
+      WhisperMessage stepReply;
+      processStepCahnges(core, pendingChanges,
+			 flags & WhisperRecordInterrupted,
+			 flags & WhisperRecordPreTrigger,
+			 flags & WhisperRecordPostTrigger,
+			 stepReply, traceFile, withText);
+      appendStepRecord(stepReply, pendingChanges, flags, records);
+
+      core.clearTraceData();
+
+      if (core.hasTargetProgramFinished())
+	break;
+      if (core.inDebugMode() and not core.inDebugStepMode())
+	break;
+    }
+
+  reply = req;
+  reply.value = count;
+  reply.address = records.size();
+  return true;
+}
+
+
+/// Server mode what-if command: Read the req.value candidate entries
+/// following the request on the channel, evaluate them (see
+/// Core::whatIfBatch) and collect a step record for each in the
+/// records buffer. Set reply to the header message preceding the
+/// records on the socket. Return false if the entries cannot be read
+/// from the channel.
+template <typename URV, typename Channel>
+static
+bool
+whatIfCommand(Core<URV>& core, Channel& channel, const WhisperMessage& req,
+	      WhisperMessage& reply, std::vector<char>& records,
+	      FILE* commandLog)
+{
+  reply = req;
+  records.clear();
+
+  uint64_t count = req.value;
+  if (count > WHISPER_MAX_ENTRIES)
+    {
+      reply.type = Invalid;
+      return discardBytes(channel, count * WHISPER_ENTRY_SIZE);
+    }
+
+  records.resize(count * WHISPER_ENTRY_SIZE);
+  bool eof = false;
+  if (count and (not channel.read(records.data(), records.size(), eof) or eof))
+    return false;
+
+  std::vector<WhatIfCandidate> candidates(count);
+  for (uint64_t i = 0; i < count; ++i)
+    {
+      WhisperMessage entry;
+      decodeEntry(records.data() + i * WHISPER_ENTRY_SIZE, entry);
+      candidates.at(i).pc = URV(entry.address);
+      candidates.at(i).inst = entry.resource;
+    }
+
+  std::vector<ChangeRecord> changeRecords;
+  core.whatIfBatch(candidates, changeRecords);
+
+  bool withText = req.resource & WhisperStreamDisass;
+  records.clear();
+  std::vector<WhisperMessage> changes;
+  for (uint64_t i = 0; i < count; ++i)
+    {
+      const WhatIfCandidate& cand = candidates.at(i);
+      const ChangeRecord& rec = changeRecords.at(i);
+
+      WhisperMessage stepReply(0, WhatIf, cand.inst, cand.pc);
+      if (withText)
+	{
+	  std::string text;
+	  core.disassembleInst(cand.inst, text);
+	  strncpy(stepReply.buffer, text.c_str(), sizeof(stepReply.buffer) - 1);
+	  stepReply.buffer[sizeof(stepReply.buffer) - 1] = 0;
+	}
+
+      // Memory changes are reported as words as in processStepCahnges.
+      changes.clear();
+      changes.emplace_back(0, Change, 'p', 0, rec.newPc);
+      if (rec.hasIntReg)
+	changes.emplace_back(0, Change, 'r', rec.intRegIx, rec.intRegValue);
+      if (rec.hasFpReg)
+	changes.emplace_back(0, Change, 'f', rec.fpRegIx, rec.fpRegValue);
+      for (size_t j = 0; j < rec.csrIx.size(); ++j)
+	changes.emplace_back(0, Change, 'c', unsigned(rec.csrIx.at(j)),
+			     rec.csrValue.at(j));
+      if (rec.memSize)
+	{
+	  changes.emplace_back(0, Change, 'm', rec.memAddr,
+			       uint32_t(rec.memValue));
+	  if (rec.memSize == 8)
+	    changes.emplace_back(0, Change, 'm', rec.memAddr + 4,
+				 uint32_t(rec.memValue >> 32));
+	}
+      std::reverse(changes.begin(), changes.end());
+
+      unsigned flags = withText ? WhisperRecordText : 0;
+      if (rec.hasException)
+	flags |= WhisperRecordException;
+      appendStepRecord(stepReply, changes, flags, records);
+
+      if (commandLog)
+	fprintf(commandLog, "# what_if 0x%lx 0x%x\n", cand.pc, cand.inst);
+    }
+
+  reply.value = count;
+  reply.address = records.size();
+  return true;
+}
+
+
+/// Server mode exception command.
+template <typename URV>
+static
+bool
+exceptionCommand(Core<URV>& core, const WhisperMessage& req, 
+		 WhisperMessage& reply, FILE* traceFile,
+		 std::string& text)
+{
+  std::ostringstream oss;
+
+  bool ok = true;
+  URV addr = req.address;
+  unsigned matchCount = 0;
+
+  reply = req;
+
+  WhisperExceptionType expType = WhisperExceptionType(req.value);
+  switch (expType)
+    {
+    case InstAccessFault:
+      core.postInstAccessFault(addr);
+      oss << "exception inst " << addr;
+      break;
+
+    case DataAccessFault:
+      core.postDataAccessFault(addr);
+      oss << "exception data " << addr;
+      break;
+
+    case ImpreciseStoreFault:
+      ok = core.applyStoreException(addr, matchCount);
+      reply.value = matchCount;
+      oss << "exception store 0x" << std::hex << addr;
+      break;
+
+    case ImpreciseLoadFault:
+      ok = core.applyLoadException(addr, matchCount);
+      reply.value = matchCount;
+      oss << "exception load 0x" << std::hex << addr;
+      break;
+
+    case NonMaskableInterrupt:
       core.setPendingNmi(NmiCause(addr));
       oss << "exception nmi 0x" << std::hex << addr;
       break;
@@ -1957,31 +3466,58 @@ exceptionCommand(Core<URV>& core, const WhisperMessage& req,
 
 /// Server mode loop: Receive command and send reply till a quit
 /// command is received. Return true on successful termination (quit
-/// received). Return false otherwise.
-template <typename URV>
+/// received). Return false otherwise. If events is not null, record
+/// the requests that change the state of the hart (other than
+/// stepping) into it. If runAhead is not zero, execute up to that
+/// many steps ahead of the requests (see RunAhead).
+template <typename URV, typename Channel>
 static
 bool
-interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
+interactUsingChannel(Core<URV>& core, Channel& channel, FILE* traceFile,
+		     FILE* commandLog, EventLogWriter* events,
+		     unsigned runAhead = 0)
 {
+  // Record an event applied at the current instruction count.
+  auto record = [&core, events] (SessionEvent::Kind kind,
+				 const WhisperMessage& msg) {
+    if (events)
+      events->write(SessionEvent{kind, core.getInstructionCount(),
+				 msg.resource, msg.address, msg.value, {}});
+  };
+
   std::vector<WhisperMessage> pendingChanges;
+  std::vector<char> records;  // Step records of a StepStream command.
+  std::vector<char> data;     // Data following a PeekBlock/PeekMulti reply.
 
   auto hexForm = getHexForm<URV>(); // Format string for printing a hex val
 
+  std::unique_ptr<RunAhead<URV>> ahead;
+  if (runAhead)
+    ahead = std::make_unique<RunAhead<URV>>(core, runAhead);
+
   while (true)
     {
       WhisperMessage msg;
       WhisperMessage reply;
-      if (not receiveMessage(soc, msg))
+      if (not receiveMessage(channel, msg))
+	return false;
+
+      // Requests other than stepping see the hart at the last step
+      // answered.
+      if (ahead and msg.type != Step and msg.type != Change and
+	  not ahead->sync())
 	return false;
 
       switch (msg.type)
 	{
 	case Quit:
+	  record(SessionEvent::End, WhisperMessage());
 	  if (commandLog)
 	    fprintf(commandLog, "quit\n");
 	  return true;
 
 	case Poke:
+	  record(SessionEvent::Poke, msg);
 	  pokeCommand(core, msg, reply);
 	  if (commandLog)
 	    fprintf(commandLog, "poke %c %s %s\n", msg.resource,
@@ -1998,6 +3534,12 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	  break;
 
 	case Step:
+	  if (ahead and ahead->step(reply, pendingChanges))
+	    {
+	      if (commandLog)
+		fprintf(commandLog, "step #%ld\n", ahead->committed());
+	      break;
+	    }
 	  // Step is not allowed in debug mode unless we are in debug_step
 	  // as well.
 	  if (core.inDebugMode() and not core.inDebugStepMode())
@@ -2011,6 +3553,69 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	    fprintf(commandLog, "step #%ld\n", core.getInstructionCount());
 	  break;
 
+	case StepStream:
+	  stepStreamCommand(core, msg, pendingChanges, reply, records,
+			    traceFile);
+	  if (commandLog)
+	    fprintf(commandLog, "step %ld #%ld\n", reply.value,
+		    core.getInstructionCount());
+	  {
+	    // Send reply and records with a single send.
+	    char header[sizeof(reply)];
+	    serializeMessage(reply, header, sizeof(header));
+	    records.insert(records.begin(), header, header + sizeof(header));
+	    if (not sendBytes(channel, records.data(), records.size()))
+	      return false;
+	  }
+	  continue;
+
+	case PeekBlock:
+	case PeekMulti:
+	  if (msg.type == PeekBlock)
+	    {
+	      peekBlockCommand(core, msg, reply, data);
+	      if (commandLog)
+		fprintf(commandLog, "# peek_block 0x%lx %ld\n", msg.address,
+			msg.value);
+	    }
+	  else if (not peekMultiCommand(core, channel, msg, reply, data,
+					commandLog))
+	    return false;
+	  {
+	    // Send reply and data with a single send.
+	    char header[sizeof(reply)];
+	    serializeMessage(reply, header, sizeof(header));
+	    data.insert(data.begin(), header, header + sizeof(header));
+	    if (not sendBytes(channel, data.data(), data.size()))
+	      return false;
+	  }
+	  continue;
+
+	case WhatIf:
+	  if (not whatIfCommand(core, channel, msg, reply, records, commandLog))
+	    return false;
+	  {
+	    // Send reply and records with a single send.
+	    char header[sizeof(reply)];
+	    serializeMessage(reply, header, sizeof(header));
+	    records.insert(records.begin(), header, header + sizeof(header));
+	    if (not sendBytes(channel, records.data(), records.size()))
+	      return false;
+	  }
+	  continue;
+
+	case PokeBlock:
+	  if (not pokeBlockCommand(core, channel, msg, reply, commandLog,
+				   events))
+	    return false;
+	  break;
+
+	case PokeMulti:
+	  if (not pokeMultiCommand(core, channel, msg, reply, commandLog,
+				   events))
+	    return false;
+	  break;
+
 	case ChangeCount:
 	  reply.type = ChangeCount;
 	  reply.value = pendingChanges.size();
@@ -2020,7 +3625,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	    core.readInst(core.lastPc(), inst);
 	    reply.resource = inst;
 	    std::string text;
-	    core.disassembleInst(inst, text);
+	    core.disassembleInst(core.lastPc(), inst, text);
 	    uint32_t op0 = 0, op1 = 0; int32_t op2 = 0;
 	    const InstInfo& info = core.decode(inst, op0, op1, op2);
 	    if (info.isBranch())
@@ -2046,6 +3651,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	  break;
 
 	case Reset:
+	  record(SessionEvent::Reset, msg);
 	  pendingChanges.clear();
 	  if (msg.value != 0)
 	    core.defineResetPc(msg.address);
@@ -2062,6 +3668,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 
 	case Exception:
 	  {
+	    record(SessionEvent::Exception, msg);
 	    std::string text;
 	    exceptionCommand(core, msg, reply, traceFile, text);
 	    if (commandLog)
@@ -2070,6 +3677,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	  break;
 
 	case EnterDebug:
+	  record(SessionEvent::EnterDebug, msg);
 	  core.enterDebugMode(core.peekPc());
 	  reply = msg;
 	  if (commandLog)
@@ -2077,6 +3685,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	  break;
 
 	case ExitDebug:
+	  record(SessionEvent::ExitDebug, msg);
 	  core.exitDebugMode();
 	  reply = msg;
 	  if (commandLog)
@@ -2085,6 +3694,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 
 	case LoadFinished:
 	  {
+	    record(SessionEvent::LoadFinished, msg);
 	    URV addr = msg.address;
 	    unsigned matchCount = 0;
 	    core.applyLoadFinished(addr, matchCount);
@@ -2104,7 +3714,7 @@ interactUsingSocket(Core<URV>& core, int soc, FILE* traceFile, FILE* commandLog)
 	  reply.type = Invalid;
 	}
 
-      if (not sendMessage(soc, reply))
+      if (not sendMessage(channel, reply))
 	return false;
     }
 
@@ -2171,6 +3781,16 @@ printInteractiveHelp()
   cout << "  Run until address or interrupted.\n\n";
   cout << "step [<n>]\n";
   cout << "  Execute n instructions (1 if n is missing).\n\n";
+  cout << "rstep [<n>]\n";
+  cout << "  Undo the execution of n instructions (1 if n is missing).\n\n";
+  cout << "rcont\n";
+  cout << "  Run backwards until a breakpoint or watchpoint.\n\n";
+  cout << "break <address>\n";
+  cout << "  Stop run and until commands before executing the instruction at address.\n\n";
+  cout << "watch <address> [<size>] [read|write|access]\n";
+  cout << "  Stop run and until commands after an access to the watched bytes.\n\n";
+  cout << "delete [<address>]\n";
+  cout << "  Delete breakpoints and watchpoints at address (all if address missing).\n\n";
   cout << "peek <res> <addr>\n";
   cout << "  Print value of resource res (one of r, f, c, m) and address addr.\n";
   cout << "  For memory (m) up to 2 addresses may be provided to define a range\n";
@@ -2248,6 +3868,22 @@ helpCommand(const std::vector<std::string>& tokens)
       return;
     }
 
+  if (tag == "break" or tag == "watch" or tag == "delete")
+    {
+      cout << "break <address>\n"
+	   << "  Define a breakpoint: the run and until commands stop before\n"
+	   << "  executing the instruction at the given address.\n"
+	   << "watch <address> [<size>] [read|write|access]\n"
+	   << "  Define a watchpoint: the run and until commands stop after\n"
+	   << "  executing an instruction accessing (writing by default) one of\n"
+	   << "  the size bytes (1 by default) at the given address.\n"
+	   << "delete [<address>]\n"
+	   << "  Delete the breakpoints and watchpoints at the given address or\n"
+	   << "  all of them if no address is given.\n"
+	   << "  Examples: break 0x1000   watch 0x8000 4 access   delete\n";
+      return;
+    }
+
   if (tag == "step")
     {
       cout << "step [<n>]\n"
@@ -2257,6 +3893,20 @@ helpCommand(const std::vector<std::string>& tokens)
       return;
     }
 
+  if (tag == "rstep" or tag == "rcont")
+    {
+      cout << "rstep [<n>]\n"
+	   << "  Undo the execution of a single instruction (n instructions if\n"
+	   << "  an integer argument is given) restoring the registers, CSRs and\n"
+	   << "  memory of the hart.\n"
+	   << "rcont\n"
+	   << "  Run backwards: stop at the most recent earlier hit of a\n"
+	   << "  breakpoint or watchpoint (see break command) or at the\n"
+	   << "  beginning of the history.\n"
+	   << "  Both commands require option --reverse.\n";
+      return;
+    }
+
   if (tag == "peek")
     {
       cout << "peek <res> <addr>\n"
@@ -2428,6 +4078,15 @@ executeLine(std::vector<Core<URV>*>& cores, unsigned& currentHartId,
       return true;
     }
 
+  if (command == "break" or command == "watch" or command == "delete")
+    {
+      if (not stopPointCommand(core, line, tokens))
+	return false;
+      if (commandLog)
+	fprintf(commandLog, "%s\n", line.c_str());
+      return true;
+    }
+
   if (command == "s" or command == "step")
     {
       if (core.inDebugMode() and not core.inDebugStepMode())
@@ -2442,6 +4101,15 @@ executeLine(std::vector<Core<URV>*>& cores, unsigned& currentHartId,
       return true;
     }
 
+  if (command == "rstep" or command == "rcont")
+    {
+      if (not reverseCommand(core, line, tokens))
+	return false;
+      if (commandLog)
+	fprintf(commandLog, "%s\n", line.c_str());
+      return true;
+    }
+
   if (command == "peek")
     {
       if (not peekCommand(core, line, tokens))
@@ -2560,7 +4228,7 @@ executeLine(std::vector<Core<URV>*>& cores, unsigned& currentHartId,
 
   if (command == "symbols")
     {
-      for (const auto& kv : elfSymbols)
+      for (const auto& kv : getElfSymbols())
 	std::cout << kv.first << ' ' << "0x" << std::hex << kv.second.addr_ << '\n';
       return true;
     }
@@ -2672,6 +4340,8 @@ interact(std::vector<Core<URV>*>& cores, FILE* traceFile, FILE* commandLog)
       linenoiseHistoryAdd(cline);
       free(cline);
 
+      interruptToken.clear();
+
       if (not executeLine(cores, currentHartId, line, traceFile, commandLog,
 			  replayStream, done))
 	errors++;
@@ -2681,21 +4351,19 @@ interact(std::vector<Core<URV>*>& cores, FILE* traceFile, FILE* commandLog)
 }
 
 
-/// Open a server socket and put opened socket information (hostname
-/// and port number) in the given server file. Wait for one
-/// connection. Service connection. Return true on success and false
-/// on failure.
-template <typename URV>
+/// Create a TCP socket listening on an unused port of this computer
+/// with the given backlog and write the host name and the port number
+/// to the given file (for the test-bench to connect). Return the
+/// socket or -1 on failure.
 static
-bool
-runServer(Core<URV>& core, const std::string& serverFile, FILE* traceFile,
-	  FILE* commandLog)
+int
+openServerSocket(const std::string& serverFile, int backlog)
 {
   char hostName[1024];
   if (gethostname(hostName, sizeof(hostName)) != 0)
     {
       std::cerr << "Failed to obtain name of this computer\n";
-      return false;
+      return -1;
     }
 
   int soc = socket(AF_INET, SOCK_STREAM, 0);
@@ -2716,13 +4384,15 @@ runServer(Core<URV>& core, const std::string& serverFile, FILE* traceFile,
   if (bind(soc, (sockaddr*) &serverAddr, sizeof(serverAddr)) < 0)
     {
       perror("Socket bind failed");
-      return false;
+      close(soc);
+      return -1;
     }
 
-  if (listen(soc, 1) < 0)
+  if (listen(soc, backlog) < 0)
     {
       perror("Socket listen failed");
-      return false;
+      close(soc);
+      return -1;
     }
 
   sockaddr_in socAddr;
@@ -2732,7 +4402,8 @@ runServer(Core<URV>& core, const std::string& serverFile, FILE* traceFile,
   if (getsockname(soc, (sockaddr*) &socAddr,  &socAddrSize) == -1)
     {
       perror("Failed to obtain socket information");
-      return false;
+      close(soc);
+      return -1;
     }
 
   {
@@ -2740,21 +4411,43 @@ runServer(Core<URV>& core, const std::string& serverFile, FILE* traceFile,
     if (not out.good())
       {
 	std::cerr << "Failed to open file '" << serverFile << "' for output\n";
-	return false;
+	close(soc);
+	return -1;
       }
     out << hostName << ' ' << ntohs(socAddr.sin_port) << std::endl;
   }
 
+  return soc;
+}
+
+
+/// Open a server socket and put opened socket information (hostname
+/// and port number) in the given server file. Wait for one
+/// connection. Service connection (see interactUsingChannel). Return
+/// true on success and false on failure.
+template <typename URV>
+static
+bool
+runServer(Core<URV>& core, const std::string& serverFile, FILE* traceFile,
+	  FILE* commandLog, EventLogWriter* events, unsigned runAhead)
+{
+  int soc = openServerSocket(serverFile, 1);
+  if (soc < 0)
+    return false;
+
   sockaddr_in clientAddr;
   socklen_t clientAddrSize = sizeof(clientAddr);
   int newSoc = accept(soc, (sockaddr*) & clientAddr, &clientAddrSize);
   if (newSoc < 0)
     {
       perror("Socket accept failed");
+      close(soc);
       return false;
     }
 
-  bool ok = interactUsingSocket(core, newSoc, traceFile, commandLog);
+  SocketChannel channel(newSoc);
+  bool ok = interactUsingChannel(core, channel, traceFile, commandLog,
+				 events, runAhead);
 
   close(newSoc);
   close(soc);
@@ -2763,33 +4456,194 @@ runServer(Core<URV>& core, const std::string& serverFile, FILE* traceFile,
 }
 
 
+/// Create a shared memory segment of the given name and service the
+/// requests of the test-bench attaching to it (see WhisperShm.h).
+/// Return true on success and false on failure.
 template <typename URV>
 static
 bool
-reportInstructionFrequency(Core<URV>& core, const std::string& outPath)
+runShmServer(Core<URV>& core, const std::string& name, bool useFutex,
+	     FILE* traceFile, FILE* commandLog, EventLogWriter* events,
+	     unsigned runAhead)
 {
-  FILE* outFile = fopen(outPath.c_str(), "w");
-  if (not outFile)
-    {
-      std::cerr << "Failed to open instruction frequency file '" << outPath
-		<< "' for output.\n";
-      return false;
-    }
-  core.reportInstructionFrequency(outFile);
-  fclose(outFile);
-  return true;
+  ShmChannel channel(name, useFutex);
+  if (not channel.isValid())
+    return false;
+
+  return interactUsingChannel(core, channel, traceFile, commandLog, events,
+			      runAhead);
 }
 
 
-/// Open the trace-file, command-log and console-output files
-/// specified on the command line. Return true if successful or false
-/// if any specified file fails to open.
+/// Replay on the given hart the server-mode session recorded in the
+/// given event log file (see --recordevents): Single step the hart
+/// (as the Step request of the server does) up to the instruction
+/// count of each event then apply the event. Stop at the end of the
+/// log or once the instruction count reaches instCountLim. Return
+/// true on success and false on failure.
+template <typename URV>
 static
 bool
-openUserFiles(const Args& args, FILE*& traceFile, FILE*& commandLog,
-	      FILE*& consoleOut)
+replayEvents(Core<URV>& core, const std::string& path, FILE* traceFile,
+	     uint64_t instCountLim)
 {
-  if (not args.traceFile.empty())
+  FILE* in = fopen(path.c_str(), "rb");
+  if (not in)
+    {
+      std::cerr << "Failed to open event log file '" << path
+		<< "' for input\n";
+      return false;
+    }
+  std::unique_ptr<FILE, int(*)(FILE*)> closer(in, fclose);
+
+  EventLogReader reader(in);
+  if (not reader.isValid())
+    {
+      std::cerr << "File '" << path << "' is not a whisper event log\n";
+      return false;
+    }
+  if (reader.xlen() != 8*sizeof(URV))
+    {
+      std::cerr << "Event log file '" << path << "' was recorded with a "
+		<< reader.xlen() << "-bit hart -- expecting "
+		<< 8*sizeof(URV) << '\n';
+      return false;
+    }
+
+  SessionEvent event;
+  uint64_t applied = 0;
+  while (reader.next(event))
+    {
+      while (core.getInstructionCount() < event.count)
+	{
+	  if (core.getInstructionCount() >= instCountLim)
+	    {
+	      std::cerr << "Stopped -- Reached instruction limit\n";
+	      return true;
+	    }
+	  core.singleStep(traceFile);
+	  core.clearTraceData();
+	}
+
+      WhisperMessage msg, reply;
+      msg.resource = event.resource;
+      msg.address = event.address;
+      msg.value = event.value;
+      std::string text;
+
+      switch (event.kind)
+	{
+	case SessionEvent::Poke:
+	  pokeCommand(core, msg, reply);
+	  break;
+
+	case SessionEvent::PokeBlock:
+	  for (size_t i = 0; i < event.data.size(); ++i)
+	    core.pokeMemory(event.address + i, event.data[i]);
+	  break;
+
+	case SessionEvent::Exception:
+	  exceptionCommand(core, msg, reply, traceFile, text);
+	  break;
+
+	case SessionEvent::LoadFinished:
+	  {
+	    unsigned matchCount = 0;
+	    core.applyLoadFinished(URV(event.address), matchCount);
+	  }
+	  break;
+
+	case SessionEvent::Reset:
+	  if (event.value != 0)
+	    core.defineResetPc(URV(event.address));
+	  core.reset();
+	  break;
+
+	case SessionEvent::EnterDebug:
+	  core.enterDebugMode(core.peekPc());
+	  break;
+
+	case SessionEvent::ExitDebug:
+	  core.exitDebugMode();
+	  break;
+
+	case SessionEvent::End:
+	  std::cerr << "Replayed " << applied << " events\n";
+	  return true;
+	}
+      applied++;
+    }
+
+  std::cerr << "Event log file '" << path << "' is truncated after "
+	    << applied << " events\n";
+  return false;
+}
+
+
+template <typename URV>
+static
+bool
+reportInstructionFrequency(Core<URV>& core, const std::string& outPath)
+{
+  FILE* outFile = fopen(outPath.c_str(), "w");
+  if (not outFile)
+    {
+      std::cerr << "Failed to open instruction frequency file '" << outPath
+		<< "' for output.\n";
+      return false;
+    }
+  core.reportInstructionFrequency(outFile);
+  fclose(outFile);
+  return true;
+}
+
+
+/// Write the reports of the given profilers (one per hart) to the
+/// files of the --profilepc and --foldedstacks options. Return true
+/// on success.
+static
+bool
+writePcProfiles(const std::vector<std::unique_ptr<PcProfiler>>& profilers,
+		const Args& args)
+{
+  bool ok = true;
+  std::string paths[] = { args.pcProfileFile, args.foldedStacksFile };
+  for (unsigned i = 0; i < 2; ++i)
+    {
+      if (paths[i].empty() or profilers.empty())
+	continue;
+      FILE* outFile = fopen(paths[i].c_str(), "w");
+      if (not outFile)
+	{
+	  std::cerr << "Failed to open profile file '" << paths[i]
+		    << "' for output.\n";
+	  ok = false;
+	  continue;
+	}
+      for (size_t hart = 0; hart < profilers.size(); ++hart)
+	{
+	  if (profilers.size() > 1)
+	    fprintf(outFile, "%sHart %zu\n", hart ? "\n" : "", hart);
+	  if (i == 0)
+	    profilers.at(hart)->report(outFile);
+	  else
+	    profilers.at(hart)->writeFoldedStacks(outFile);
+	}
+      fclose(outFile);
+    }
+  return ok;
+}
+
+
+/// Open the trace-file, command-log and console-output files
+/// specified on the command line. Return true if successful or false
+/// if any specified file fails to open.
+static
+bool
+openUserFiles(const Args& args, FILE*& traceFile, FILE*& commandLog,
+	      FILE*& consoleOut)
+{
+  if (not args.traceFile.empty())
     {
       traceFile = fopen(args.traceFile.c_str(), "w");
       if (not traceFile)
@@ -2805,6 +4659,23 @@ openUserFiles(const Args& args, FILE*& traceFile, FILE*& commandLog,
   if (traceFile)
     setlinebuf(traceFile);  // Make line-buffered.
 
+  if (not args.binLogFile.empty())
+    {
+      if (traceFile)
+	{
+	  std::cerr << "Binary trace (--binlogfile) cannot be combined with "
+		    << "text trace (--logfile/--trace)\n";
+	  return false;
+	}
+      traceFile = fopen(args.binLogFile.c_str(), "wb");
+      if (not traceFile)
+	{
+	  std::cerr << "Failed to open binary trace file '" << args.binLogFile
+		    << "' for output\n";
+	  return false;
+	}
+    }
+
   if (not args.commandLogFile.empty())
     {
       commandLog = fopen(args.commandLogFile.c_str(), "w");
@@ -2851,54 +4722,360 @@ closeUserFiles(FILE*& traceFile, FILE*& commandLog, FILE*& consoleOut)
 }
 
 
-// In interactive mode, keyboard interrupts (typically control-c) are
-// ignored.
+/// Set begin and end to the bounds of the signature region of the
+/// loaded ELF files: the begin_signature and end_signature symbols.
+/// Return true on success and false (printing a message) if a symbol
+/// is missing or if the region is not made of whole words.
+static
+bool
+findSignatureRegion(uint64_t& begin, uint64_t& end)
+{
+  const auto& symbols = getElfSymbols();
+  auto beginIter = symbols.find("begin_signature");
+  auto endIter = symbols.find("end_signature");
+  if (beginIter == symbols.end() or endIter == symbols.end())
+    {
+      std::cerr << "Option --signature: No begin_signature/end_signature "
+		<< "symbols in the ELF files\n";
+      return false;
+    }
+
+  begin = beginIter->second.addr_;
+  end = endIter->second.addr_;
+  if (end < begin or (begin & 3) or (end & 3))
+    {
+      std::cerr << "Option --signature: Invalid signature region 0x"
+		<< std::hex << begin << " to 0x" << end << std::dec
+		<< " -- expecting word-aligned bounds\n";
+      return false;
+    }
+  return true;
+}
+
+
+/// Write to the given file the words of memory between the given
+/// addresses, one per line in hexadecimal. Return true on success and
+/// false (printing a message) on failure.
+template <typename URV>
+static
+bool
+writeSignature(const Core<URV>& core, const std::string& path,
+	       uint64_t begin, uint64_t end)
+{
+  FILE* file = fopen(path.c_str(), "w");
+  if (not file)
+    {
+      std::cerr << "Failed to open signature file '" << path
+		<< "' for output\n";
+      return false;
+    }
+
+  bool ok = true;
+  for (uint64_t addr = begin; addr < end; addr += 4)
+    {
+      uint32_t word = 0;
+      if (not core.peekMemory(addr, word))
+	{
+	  std::cerr << "Failed to read signature word at address 0x"
+		    << std::hex << addr << std::dec << '\n';
+	  ok = false;
+	  break;
+	}
+      fprintf(file, "%08x\n", word);
+    }
+
+  if (fclose(file) != 0)
+    {
+      std::cerr << "Failed to write signature file '" << path << "'\n";
+      ok = false;
+    }
+  return ok;
+}
+
+
+// In interactive mode, a keyboard interrupt (typically control-c)
+// stops the running command (if any): The stop request is cleared
+// before each command.
 static void
 kbdInterruptHandler(int)
 {
-  std::cerr << "keyboard interrupt\n";
+  interruptToken.request();
+}
+
+
+// Outside interactive mode, a keyboard interrupt stops the runs of
+// the harts. A second one terminates the process (e.g. blocked on
+// input).
+static void
+runInterruptHandler(int)
+{
+  if (interruptToken.requested())
+    {
+      signal(SIGINT, SIG_DFL);
+      raise(SIGINT);
+      return;
+    }
+  interruptToken.request();
 }
 
 
 /// Depending on command line args, start a server, run in interactive
-/// mode, or initiate a batch run.
+/// mode, or initiate a batch run. Harts of a batch run with more than
+/// one hart run in separate threads synchronizing every quantum
+/// instructions.
 template <typename URV>
 static
 bool
-sessionRun(Core<URV>& core, const Args& args, FILE* traceFile, FILE* commandLog)
+sessionRun(std::vector<Core<URV>*>& cores, const Args& args, FILE* traceFile,
+	   FILE* commandLog, uint64_t quantum,
+	   std::vector<std::unique_ptr<PcProfiler>>& profilers,
+	   RunReport* report)
 {
-  if (not applyCmdLineArgs(args, core))
-    if (not args.interactive)
+  for (auto core : cores)
+    if (not applyCmdLineArgs(args, *core))
+      if (not args.interactive)
+	return false;
+
+  Core<URV>& core = *cores.front();
+
+  if (not args.loadCheckpointFile.empty())
+    if (not Core<URV>::loadCheckpoint(args.loadCheckpointFile, cores))
       return false;
 
-  bool serverMode = not args.serverFile.empty();
+  if (report)
+    report->endPhase("load");
+
+  // Profile: One profiler per hart attributing PCs to the symbols of
+  // the loaded ELF files.
+  if (not args.pcProfileFile.empty() or not args.foldedStacksFile.empty())
+    for (auto hart : cores)
+      {
+	profilers.push_back(std::make_unique<PcProfiler>(getSymbolIndex(),
+							 sizeof(URV) == 8));
+	hart->setPcProfiler(profilers.back().get());
+      }
+
+  // Binary trace: Records are flushed when binaryTrace goes out of
+  // scope (same for asyncTrace below).
+  std::unique_ptr<BinaryTraceWriter> binaryTrace;
+  if (not args.binLogFile.empty())
+    {
+      if (args.binLogCompress and not BinaryTraceWriter::zstdSupported())
+	std::cerr << "Warning: Whisper compiled without zstd support -- "
+		  << "binary trace will not be compressed\n";
+      URV misa = 0;
+      core.peekCsr(CsrNumber::MISA, misa);
+      unsigned flags = args.abiNames ? BinaryTraceAbiNames : 0;
+      binaryTrace = std::make_unique<BinaryTraceWriter>(traceFile,
+							8*sizeof(URV), misa,
+							flags,
+							args.binLogCompress);
+      for (auto hart : cores)
+	hart->setBinaryTrace(binaryTrace.get());
+    }
+
+  // Text trace of a non-interactive run to a file: Format records into
+  // large buffers written by a background thread. Interactive and server
+  // modes keep writing each record as it is produced so that the trace
+  // file is current between commands.
+  std::unique_ptr<BlockWriter> asyncTrace;
+  bool serverMode = not args.serverFile.empty() or not args.shmName.empty();
+  if (traceFile and traceFile != stdout and not binaryTrace and
+      not args.interactive and not serverMode)
+    {
+      asyncTrace = std::make_unique<BlockWriter>(traceFile);
+      for (auto hart : cores)
+	hart->setAsyncTrace(asyncTrace.get());
+    }
+
+  // Address trace: One sink shared by the harts, to a file/pipe or
+  // to the reply ring of a shared memory segment. Records are flushed
+  // when addrTraces and addrSink go out of scope.
+  std::unique_ptr<FILE, int(*)(FILE*)> addrFile(nullptr, fclose);
+  std::unique_ptr<ShmChannel> addrShm;
+  std::unique_ptr<AddressTraceSink> addrSink;
+  std::vector<std::unique_ptr<AddressTrace>> addrTraces;
+  if (not args.addrTraceFile.empty())
+    {
+      addrFile.reset(fopen(args.addrTraceFile.c_str(), "wb"));
+      if (not addrFile)
+	{
+	  std::cerr << "Failed to open address trace file '"
+		    << args.addrTraceFile << "' for output\n";
+	  return false;
+	}
+      addrSink = std::make_unique<AddressTraceSink>(addrFile.get(),
+						    8*sizeof(URV));
+    }
+  else if (not args.addrTraceShm.empty())
+    {
+      addrShm = std::make_unique<ShmChannel>(args.addrTraceShm, args.shmFutex);
+      if (not addrShm->isValid())
+	return false;
+      ShmChannel* channel = addrShm.get();
+      // Records are dropped once the consumer is gone.
+      auto writeFn = [channel, gone = false] (FILE*,
+					      const std::vector<char>& block)
+	mutable {
+	if (not channel->write(block.data(), block.size()) and not gone)
+	  {
+	    std::cerr << "Warning: Address trace consumer exited -- "
+		      << "address trace stopped\n";
+	    gone = true;
+	  }
+      };
+      addrSink = std::make_unique<AddressTraceSink>(nullptr, 8*sizeof(URV),
+						    writeFn);
+    }
+  if (addrSink)
+    for (auto hart : cores)
+      {
+	addrTraces.push_back(std::make_unique<AddressTrace>(*addrSink,
+							    hart->hartId()));
+	addrTraces.back()->setTypes(args.addrTraceMask);
+	for (const auto& range : args.addrRanges)
+	  addrTraces.back()->addRange(range.first, range.second);
+	hart->setAddressTrace(addrTraces.back().get());
+      }
+
+  // Reverse execution: Interactive and gdb sessions of a single hart.
+  if (args.reverseInterval)
+    {
+      if (cores.size() > 1 or not (args.interactive or args.gdb))
+	std::cerr << "Warning: Option --reverse requires an interactive or "
+		  << "gdb session of a single hart -- ignored\n";
+      else
+	core.enableReverse(args.reverseInterval, args.reverseMemory << 20);
+    }
+
   if (serverMode)
     {
+      if (cores.size() > 1)
+	{
+	  std::cerr << "Server mode supports a single hart\n";
+	  return false;
+	}
+
       core.enableTriggers(true);
       core.enablePerformanceCounters(true);
 
-      return runServer(core, args.serverFile, traceFile, commandLog);
+      std::unique_ptr<FILE, int(*)(FILE*)> eventFile(nullptr, fclose);
+      std::unique_ptr<EventLogWriter> events;
+      if (not args.recordEventsFile.empty())
+	{
+	  eventFile.reset(fopen(args.recordEventsFile.c_str(), "wb"));
+	  if (not eventFile)
+	    {
+	      std::cerr << "Failed to open event log file '"
+			<< args.recordEventsFile << "' for output\n";
+	      return false;
+	    }
+	  events = std::make_unique<EventLogWriter>(eventFile.get(),
+						    8*sizeof(URV));
+	}
+
+      // Run-ahead steps are executed again when a request takes the
+      // hart back: Tracing and profiling would see them twice.
+      unsigned runAhead = args.runAhead;
+      if (runAhead and
+	  (traceFile or not args.binLogFile.empty() or
+	   not args.instFreqFile.empty() or not args.pcProfileFile.empty() or
+	   not args.foldedStacksFile.empty() or
+	   not args.coverageFile.empty() or not args.addrTraceFile.empty() or
+	   not args.addrTraceShm.empty() or not args.bbvFile.empty() or
+	   not args.plugins.empty() or args.timing))
+	{
+	  std::cerr << "Warning: Option --runahead cannot be used with "
+		    << "tracing, profiling or plugins -- ignored\n";
+	  runAhead = 0;
+	}
+
+      if (not args.shmName.empty())
+	return runShmServer(core, args.shmName, args.shmFutex, traceFile,
+			    commandLog, events.get(), runAhead);
+      return runServer(core, args.serverFile, traceFile, commandLog,
+		       events.get(), runAhead);
     }
 
-  if (args.interactive)
+  if (not args.replayEventsFile.empty())
     {
+      if (cores.size() > 1)
+	{
+	  std::cerr << "Event replay supports a single hart\n";
+	  return false;
+	}
+
+      // Same setup as server mode.
       core.enableTriggers(true);
       core.enablePerformanceCounters(true);
 
-      // Ignore keyboard interrupt for most commands. Long running
-      // commands will enable keyboard interrupts while they run.
+      if (not replayEvents(core, args.replayEventsFile, traceFile,
+			   args.instCountLim))
+	return false;
+      if (args.interactive)
+	return interact(cores, traceFile, commandLog);
+      return true;
+    }
+
+  if (args.interactive)
+    {
+      for (auto hart : cores)
+	{
+	  hart->enableTriggers(true);
+	  hart->enablePerformanceCounters(true);
+	}
+
+      // Keyboard interrupts stop the running command instead of the
+      // session.
       struct sigaction newAction;
       sigemptyset(&newAction.sa_mask);
       newAction.sa_flags = 0;
       newAction.sa_handler = kbdInterruptHandler;
       sigaction(SIGINT, &newAction, nullptr);
 
-      std::vector<Core<URV>*> cores;
-      cores.push_back(&core);
       return interact(cores, traceFile, commandLog);
     }
 
-  return core.run(traceFile);
+  // Signature region: Resolved before the run so that a test lacking
+  // the symbols fails at once.
+  uint64_t sigBegin = 0, sigEnd = 0;
+  if (not args.signatureFile.empty() and
+      not findSignatureRegion(sigBegin, sigEnd))
+    return false;
+
+  if (args.hasGdbTcpPort)
+    {
+      auto channel = openGdbTcpPort(args.gdbTcpPort);
+      if (not channel)
+	return false;
+      for (auto hart : cores)
+	hart->setGdbChannel(channel);
+    }
+
+  bool ok = false;
+  if (cores.size() == 1)
+    {
+      if (args.hasCheckpointAt)
+	core.setInstructionCountLimit(std::min(args.instCountLim,
+					       args.checkpointAt));
+      ok = core.run(traceFile);
+    }
+  else
+    {
+      if (traceFile)
+	std::cerr << "Warning: Tracing not supported in multi-hart runs\n";
+      if (args.hasCheckpointAt)
+	std::cerr << "Warning: Option --checkpointat ignored in multi-hart "
+		  << "runs: checkpoint saved at end of run\n";
+      ok = Core<URV>::runHarts(cores, quantum);
+    }
+
+  if (not args.signatureFile.empty())
+    ok = writeSignature(core, args.signatureFile, sigBegin, sigEnd) and ok;
+
+  if (not args.saveCheckpointFile.empty())
+    ok = Core<URV>::saveCheckpoint(args.saveCheckpointFile, cores) and ok;
+  return ok;
 }
 
 
@@ -2925,54 +5102,1944 @@ applyDisassemble(Core<URV>& core, const Args& args)
 }
 
 
+/// Disassemble the executable segments of the ELF file of the
+/// --disasself option to the standard output in the format of the
+/// interactive "disass" command. A sequential scan of the instruction
+/// lengths cuts each segment into chunks at instruction boundaries;
+/// the chunks are formatted in parallel, a batch at a time, and
+/// written in address order. Return true on success.
 template <typename URV>
 static
 bool
-session(const Args& args, const CoreConfig& config)
+disassembleElf(Core<URV>& core, const Args& args)
 {
-  size_t memorySize = size_t(1) << 32;  // 4 gigs
-  unsigned registerCount = 32;
-  unsigned hartId = 0;
-
-  Core<URV> core(hartId, memorySize, registerCount);
+  ElfFile elf;
+  if (not elf.open(args.disassElfFile))
+    return false;
 
-  if (not config.applyConfig(core, args.verbose))
-    if (not args.interactive)
-      return false;
+  if (not args.isa.empty() and not applyIsaString(args.isa, core))
+    return false;
+  core.enableAbiNames(args.abiNames);
 
-  bool disasOk = applyDisassemble(core, args);
+  std::unordered_map<std::string, ElfSymbol> symbols;
+  elf.collectSymbols(symbols);
+  SymbolIndex index(symbols);
 
-  if (args.hexFiles.empty() and args.expandedTargets.empty()
-      and not args.interactive)
+  // Chunk: Instructions of a segment starting at a boundary.
+  struct Chunk
+  {
+    uint64_t addr = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::string text;
+  };
+
+  std::vector<Chunk> chunks;
+  const size_t chunkSize = 64*1024;
+  for (const auto& seg : elf.loadSegments())
     {
-      if (not args.codes.empty())
-	return disasOk;
-      std::cerr << "No program file specified.\n";
-      return false;
+      if (not seg.exec)
+	continue;
+      size_t offset = 0, start = 0;
+      while (offset + 2 <= seg.fileSize)
+	{
+	  offset += (seg.data[offset] & 3) == 3 ? 4 : 2;
+	  if (offset - start >= chunkSize or offset + 2 > seg.fileSize)
+	    {
+	      size_t end = std::min(offset, size_t(seg.fileSize));
+	      chunks.push_back(Chunk{seg.addr + start, seg.data + start,
+				     end - start, std::string()});
+	      start = end;
+	    }
+	}
     }
 
-  FILE* traceFile = nullptr;
-  FILE* commandLog = nullptr;
-  FILE* consoleOut = stdout;
-  if (not openUserFiles(args, traceFile, commandLog, consoleOut))
-    return false;
-
-  core.setConsoleOutput(consoleOut);
-
-  bool serverMode = not args.serverFile.empty();
-  bool storeExceptions = args.interactive or serverMode;
-  core.enableStoreExceptions(storeExceptions);
-  core.enableLoadExceptions(storeExceptions);
+  // Append value to out as by getHexForm.
+  auto appendHex = [] (std::string& out, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    out += "0x";
+    for (int shift = 8*sizeof(URV) - 4; shift >= 0; shift -= 4)
+      out += digits[(value >> shift) & 0xf];
+  };
+
+  // Format a chunk. Instruction texts are memoized by code: The
+  // disassembler is only read by the workers.
+  auto format = [&core, &index, &appendHex] (Chunk& chunk) {
+    std::unordered_map<uint32_t, std::string> texts;
+    std::string& out = chunk.text;
+    for (size_t offset = 0; offset + 2 <= chunk.size; )
+      {
+	const uint8_t* p = chunk.data + offset;
+	uint32_t inst = p[0] | (uint32_t(p[1]) << 8);
+	unsigned instSize = 2;
+	if ((inst & 3) == 3 and offset + 4 <= chunk.size)
+	  {
+	    inst |= (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+	    instSize = 4;
+	  }
 
-  core.reset();
+	auto iter = texts.find(inst);
+	if (iter == texts.end())
+	  {
+	    std::string text;
+	    core.disassembleInst(inst, text);
+	    iter = texts.emplace(inst, std::move(text)).first;
+	  }
 
-  bool result = sessionRun(core, args, traceFile, commandLog);
+	URV addr = chunk.addr + offset;
+	appendHex(out, addr);
+	out += ' ';
+	appendHex(out, inst);
+	out += ' ';
+	out += iter->second;
+	std::string location = index.location(addr);
+	if (not location.empty())
+	  {
+	    out += " <";
+	    out += location;
+	    out += '>';
+	  }
+	out += '\n';
+	offset += instSize;
+      }
+  };
+
+  unsigned jobs = args.jobs;
+  if (jobs == 0)
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // Batches of a few chunks per thread bound the memory held by the
+  // formatted text.
+  size_t batch = size_t(jobs) * 4;
+  for (size_t first = 0; first < chunks.size(); first += batch)
+    {
+      size_t last = std::min(first + batch, chunks.size());
+      std::atomic<size_t> next(first);
+      auto worker = [&] () {
+	for (size_t ix = next++; ix < last; ix = next++)
+	  format(chunks.at(ix));
+      };
+
+      std::vector<std::thread> threads;
+      for (unsigned i = 1; i < jobs and first + i < last; ++i)
+	threads.emplace_back(worker);
+      worker();
+      for (auto& thread : threads)
+	thread.join();
+
+      for (size_t ix = first; ix < last; ++ix)
+	{
+	  std::string& text = chunks.at(ix).text;
+	  if (fwrite(text.data(), 1, text.size(), stdout) != text.size())
+	    {
+	      std::cerr << "Failed to write disassembly\n";
+	      return false;
+	    }
+	  std::string().swap(text);
+	}
+    }
+
+  fflush(stdout);
+  return true;
+}
+
+
+/// Run the tests listed in the batch file (one test per line: ELF
+/// file and program options) using a pool of threads. Each thread
+/// configures one core (and its memory) once and reuses it for each
+/// of the tests it runs. Print a pass/fail line for each test and a
+/// summary. Return true if all tests pass.
+template <typename URV>
+static
+bool
+batchSession(const Args& args, const CoreConfig& config)
+{
+  std::ifstream input(args.batchFile);
+  if (not input.good())
+    {
+      std::cerr << "Failed to open batch file '" << args.batchFile
+		<< "' for input\n";
+      return false;
+    }
+
+  std::vector<StringVec> tests;
+  std::string line;
+  while (std::getline(input, line))
+    {
+      boost::trim(line);
+      if (line.empty() or line.front() == '#')
+	continue;
+      StringVec tokens;
+      boost::split(tokens, line, boost::is_any_of(args.targetSep),
+		   boost::token_compress_on);
+      tests.push_back(tokens);
+    }
+
+  if (tests.empty())
+    {
+      std::cerr << "No tests in batch file '" << args.batchFile << "'\n";
+      return false;
+    }
+
+  if (args.interactive or not args.serverFile.empty() or
+      not args.shmName.empty())
+    {
+      std::cerr << "Batch mode cannot be combined with interactive or "
+		<< "server mode\n";
+      return false;
+    }
+
+  if (args.trace or not args.traceFile.empty() or not args.binLogFile.empty() or
+      not args.addrTraceFile.empty() or not args.addrTraceShm.empty())
+    std::cerr << "Warning: Tracing not supported in batch mode -- ignored\n";
+
+  if (not args.pcProfileFile.empty() or not args.foldedStacksFile.empty() or
+      not args.coverageFile.empty() or args.timing or not args.bbvFile.empty() or
+      not args.plugins.empty() or not args.metricsFile.empty() or
+      args.metricsPort)
+    std::cerr << "Warning: Profiling not supported in batch mode -- ignored\n";
+
+  if (not args.saveCheckpointFile.empty() or
+      not args.loadCheckpointFile.empty())
+    std::cerr << "Warning: Checkpoints not supported in batch mode -- "
+	      << "ignored\n";
+
+  if (not args.signatureFile.empty())
+    std::cerr << "Warning: Option --signature not supported in batch mode -- "
+	      << "ignored\n";
+
+  Args testArgs = args;
+  testArgs.trace = false;
+  testArgs.traceFile.clear();
+  testArgs.binLogFile.clear();
+
+  FILE* traceFile = nullptr;
+  FILE* commandLog = nullptr;
+  FILE* consoleOut = stdout;
+  if (not openUserFiles(testArgs, traceFile, commandLog, consoleOut))
+    return false;
+
+  unsigned jobs = args.jobs;
+  if (jobs == 0)
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  jobs = std::min(size_t(jobs), tests.size());
+
+  std::vector<char> passed(tests.size(), false);
+  std::vector<double> times(tests.size(), 0);
+  std::atomic<size_t> nextTest(0);
+  std::atomic<bool> configOk(true);
+
+  auto worker = [&] (unsigned workerIx) {
+    size_t memorySize = size_t(1) << 32;  // 4 gigs
+    unsigned registerCount = 32;
+    unsigned hartId = 0;
+
+    Memory memory(memorySize);
+    Core<URV> core(hartId, memory, registerCount);
+    if (not placeMemory(args, memory, workerIx) or
+	not config.applyConfig(core, args.verbose))
+      {
+	configOk = false;
+	return;
+      }
+
+    // Console io address may be redefined by an ELF file: Restore the
+    // configured one before each test.
+    URV conIo = 0;
+    bool hasConIo = core.getConsoleIo(conIo);
+
+    core.setConsoleOutput(consoleOut);
+    core.enableStoreExceptions(false);
+    core.enableLoadExceptions(false);
+
+    // Restoring the configured state between tests only rewrites the
+    // pages touched by the preceding test.
+    core.takeSnapshot();
+
+    bool used = false;
+    for (size_t ix = nextTest++; ix < tests.size(); ix = nextTest++)
+      {
+	struct timeval t0;
+	gettimeofday(&t0, nullptr);
+
+	if (used)
+	  {
+	    core.restoreSnapshot();
+	    core.resetProgramState();
+	    if (hasConIo)
+	      core.setConsoleIo(conIo);
+	    else
+	      core.clearConsoleIo();
+	  }
+	used = true;
+	clearElfSymbols();
+	core.reset();
+
+	Args runArgs = testArgs;
+	runArgs.expandedTargets = { tests.at(ix) };
+	passed.at(ix) = applyCmdLineArgs(runArgs, core) and core.run();
+
+	struct timeval t1;
+	gettimeofday(&t1, nullptr);
+	times.at(ix) = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
+      }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; ++i)
+    threads.emplace_back(worker, i);
+  for (auto& thread : threads)
+    thread.join();
+
+  closeUserFiles(traceFile, commandLog, consoleOut);
+
+  if (not configOk)
+    return false;
+
+  size_t passCount = 0;
+  for (size_t ix = 0; ix < tests.size(); ++ix)
+    {
+      passCount += passed.at(ix);
+      std::cout << (passed.at(ix)? "PASS " : "FAIL ")
+		<< (boost::format("%8.2fs ") % times.at(ix))
+		<< boost::join(tests.at(ix), " ") << '\n';
+    }
+  std::cout << "Batch: " << tests.size() << " test"
+	    << (tests.size() > 1? "s" : "") << ", " << passCount
+	    << " passed, " << (tests.size() - passCount) << " failed\n";
+
+  return passCount == tests.size();
+}
+
+
+/// Coverage-guided fuzzing (see --fuzz): Each worker thread owns a
+/// core which is configured and loaded with the program files of the
+/// command line once and then snapshotted. An execution restores the
+/// snapshot, writes an instruction stream at the fuzzing address and
+/// runs up to the instruction limit. The seeds of the corpus directory
+/// are executed first; then each execution runs a mutated seed or a
+/// fresh random stream and streams bringing new coverage features
+/// become seeds. Run until the execution count is reached or SIGINT or
+/// SIGTERM is received. Return true on success.
+template <typename URV>
+static
+bool
+fuzzSession(const Args& args, const CoreConfig& config)
+{
+  if (args.interactive or not args.serverFile.empty() or
+      not args.shmName.empty())
+    {
+      std::cerr << "Fuzzing cannot be combined with interactive or "
+		<< "server mode\n";
+      return false;
+    }
+
+  if (args.trace or not args.traceFile.empty() or not args.binLogFile.empty() or
+      not args.addrTraceFile.empty() or not args.addrTraceShm.empty())
+    std::cerr << "Warning: Tracing not supported in fuzzing mode -- ignored\n";
+
+  if (not args.pcProfileFile.empty() or not args.foldedStacksFile.empty() or
+      not args.coverageFile.empty() or args.timing or not args.bbvFile.empty() or
+      not args.plugins.empty() or not args.metricsFile.empty() or
+      args.metricsPort)
+    std::cerr << "Warning: Profiling not supported in fuzzing mode -- "
+	      << "ignored\n";
+
+  if (args.fuzzLength == 0)
+    {
+      std::cerr << "Invalid fuzzing stream length: 0\n";
+      return false;
+    }
+
+  // Mutations may grow a stream up to twice the generated length.
+  unsigned maxLength = 2 * args.fuzzLength;
+  uint64_t limit = args.instCountLim;
+  if (limit == ~uint64_t(0))
+    limit = 4 * uint64_t(maxLength);
+
+  FuzzCorpus corpus(args.fuzzDir);
+  if (not corpus.load(maxLength))
+    return false;
+
+  Args fuzzArgs = args;
+  fuzzArgs.trace = false;
+  fuzzArgs.traceFile.clear();
+  fuzzArgs.binLogFile.clear();
+
+  FILE* traceFile = nullptr;
+  FILE* commandLog = nullptr;
+  FILE* consoleOut = stdout;
+  if (not openUserFiles(fuzzArgs, traceFile, commandLog, consoleOut))
+    return false;
+
+  unsigned jobs = args.jobs;
+  if (jobs == 0)
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // Termination signals are waited for by the main thread: Block them
+  // before starting the workers so that all threads inherit the mask.
+  sigset_t termSignals;
+  sigemptyset(&termSignals);
+  sigaddset(&termSignals, SIGINT);
+  sigaddset(&termSignals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &termSignals, nullptr);
+
+  std::atomic<bool> stop(false), configOk(true);
+  std::atomic<uint64_t> budget(0), execs(0);
+  std::atomic<size_t> nextSeed(0);
+  std::atomic<unsigned> running(jobs);
+
+  auto worker = [&] (unsigned workerIx) {
+    size_t memorySize = size_t(1) << 32;  // 4 gigs
+    unsigned registerCount = 32;
+    unsigned hartId = 0;
+
+    Memory memory(memorySize);
+    Core<URV> core(hartId, memory, registerCount);
+    bool ok = (placeMemory(args, memory, workerIx) and
+	       config.applyConfig(core, args.verbose));
+    if (ok)
+      {
+	core.setConsoleOutput(consoleOut);
+	core.enableStoreExceptions(false);
+	core.enableLoadExceptions(false);
+	core.enableTriggers(true);
+	core.enableStopMessages(false);
+	core.reset();
+	ok = applyCmdLineArgs(fuzzArgs, core);
+      }
+
+    URV fuzzAddr = args.hasFuzzAddr ? URV(args.fuzzAddr) : core.peekPc();
+    if (ok and size_t(fuzzAddr) + 4*size_t(maxLength) > memory.size())
+      {
+	std::cerr << "Fuzzing address 0x" << std::hex << fuzzAddr << std::dec
+		  << " is too close to the end of memory\n";
+	ok = false;
+      }
+    if (not ok)
+      {
+	configOk = false;
+	stop = true;
+	running--;
+	return;
+      }
+
+    // CSR instructions are generated for the implemented CSRs.
+    std::vector<unsigned> csrs;
+    for (unsigned csr = 0; csr <= unsigned(CsrNumber::MAX_CSR_); ++csr)
+      {
+	URV value = 0;
+	if (core.peekCsr(CsrNumber(csr), value))
+	  csrs.push_back(csr);
+      }
+    FuzzGenerator generator(core.isRv64(), core.isRva(), csrs);
+
+    FuzzFeedback feedback;
+    PluginSet plugins;
+    plugins.add(feedback.hooks());
+    core.setPlugins(&plugins);
+
+    core.takeSnapshot();
+
+    auto execute = [&] (const std::vector<uint32_t>& words) {
+      core.restoreSnapshot();
+      for (size_t i = 0; i < words.size(); ++i)
+	core.pokeMemory(size_t(fuzzAddr) + 4*i, words[i]);
+      feedback.clear();
+      core.setInstructionCountLimit(core.getInstructionCount() + limit);
+      core.untilAddress(~URV(0), nullptr);
+      for (unsigned trigger = 0; trigger < core.triggerCount(); ++trigger)
+	if (core.isTriggerHit(trigger))
+	  feedback.triggerHit(trigger);
+      feedback.finish();
+      execs++;
+      return corpus.merge(feedback.features()) != 0;
+    };
+
+    auto reserve = [&] () {
+      return (not stop and
+	      (args.fuzzCount == 0 or budget++ < args.fuzzCount));
+    };
+
+    std::vector<uint32_t> words;
+    for (size_t ix = nextSeed++; ix < corpus.loadedCount() and reserve();
+	 ix = nextSeed++)
+      if (corpus.seed(ix, words))
+	execute(words);
+
+    FuzzRandom rand(args.fuzzSeed * 1000003 + workerIx);
+    while (reserve())
+      {
+	// Mostly mutate seeds, sometimes start afresh.
+	if (rand.below(8) and corpus.pick(rand, words))
+	  generator.mutate(rand, corpus, maxLength, words);
+	else
+	  generator.generate(rand, args.fuzzLength, words);
+	if (execute(words))
+	  corpus.add(words);
+      }
+
+    core.flushConsole();
+    core.setPlugins(nullptr);
+    running--;
+  };
+
+  struct timeval t0;
+  gettimeofday(&t0, nullptr);
+  size_t initialSeeds = corpus.loadedCount();
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; ++i)
+    threads.emplace_back(worker, i);
+
+  auto elapsedSince = [] (const struct timeval& start) {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec)*1e-6;
+  };
+
+  auto report = [&] () {
+    double elapsed = elapsedSince(t0);
+    std::cerr << "Fuzz: " << execs << " executions in "
+	      << (boost::format("%.0fs") % elapsed);
+    if (elapsed > 0)
+      std::cerr << " (" << uint64_t(execs / elapsed) << "/s)";
+    std::cerr << ", " << corpus.size() << " seeds ("
+	      << (corpus.size() - initialSeeds) << " new), "
+	      << corpus.featureCount() << " features\n";
+  };
+
+  // Report progress every 10 seconds until the workers are done or a
+  // termination signal arrives.
+  struct timeval lastReport = t0;
+  while (running)
+    {
+      struct timespec wait = { 0, 200000000 };  // 0.2 seconds
+      int sig = sigtimedwait(&termSignals, nullptr, &wait);
+      if (sig > 0)
+	{
+	  std::cerr << "Received signal " << sig << " -- stopping fuzzing\n";
+	  stop = true;
+	  break;
+	}
+      if (elapsedSince(lastReport) >= 10)
+	{
+	  report();
+	  gettimeofday(&lastReport, nullptr);
+	}
+    }
+
+  for (auto& thread : threads)
+    thread.join();
+  pthread_sigmask(SIG_UNBLOCK, &termSignals, nullptr);
+  closeUserFiles(traceFile, commandLog, consoleOut);
+
+  if (not configOk)
+    return false;
+
+  report();
+  return true;
+}
+
+
+/// Record of an instruction retired by the reference hart of a
+/// differential run (see diffSession).
+struct DiffRecord
+{
+  uint64_t count = 0;   // Instructions retired before this one.
+  uint64_t pc = 0;
+  uint64_t digest = 0;  // Core::stateDigest after the instruction.
+  uint32_t inst = 0;
+
+  bool operator==(const DiffRecord& other) const
+  {
+    return (count == other.count and pc == other.pc and
+	    digest == other.digest and inst == other.inst);
+  }
+};
+
+
+/// Hart of a differential run with its own memory.
+template <typename URV>
+struct DiffHart
+{
+  DiffHart()
+    : memory(size_t(1) << 32), core(0, memory, 32)
+  { }
+
+  Memory memory;
+  Core<URV> core;
+  PluginSet plugins;
+  WhisperPluginHooks hooks = {};
+  bool step = false;      // Use the step engine instead of the fast one.
+  bool success = true;
+  bool stopped = false;   // Target program stopped.
+};
+
+
+/// Run the given hart of a differential run with its engine until
+/// its retired instruction count reaches the given limit (or a block
+/// boundary past it with the fast engine). Return false if the
+/// target program stopped.
+template <typename URV>
+static
+bool
+diffRunChunk(DiffHart<URV>& hart, uint64_t limit)
+{
+  Core<URV>& core = hart.core;
+  if (hart.step)
+    {
+      uint64_t retired = core.getRetiredCount();
+      uint64_t count = limit > retired ? limit - retired : 1;
+      core.setInstructionCountLimit(core.getInstructionCount() + count);
+      hart.success = core.untilAddress(~URV(0), nullptr);
+      hart.stopped = core.hasTargetProgramFinished();
+    }
+  else
+    hart.success = core.runUntilRetired(limit, hart.stopped);
+  return not hart.stopped;
+}
+
+
+/// Print side by side the given states of the reference and of the
+/// other hart of a differential run marking the differences: all
+/// the integer registers, the floating point registers and the CSRs
+/// of the given (reference) hart that differ.
+template <typename URV>
+static
+void
+printDiffStates(Core<URV>& core, const typename Core<URV>::ArchState& ref,
+		const typename Core<URV>::ArchState& other)
+{
+  auto hexForm = getHexForm<URV>();
+  auto line = [&] (const std::string& name, uint64_t a, uint64_t b,
+		   const char* form) {
+    std::cerr << "  " << (boost::format("%-10s") % name)
+	      << (boost::format(form) % a) << ' ' << (boost::format(form) % b)
+	      << (a != b ? "  *" : "") << '\n';
+  };
+
+  std::cerr << "State after the instruction (reference, other):\n";
+  line("pc", ref.pc, other.pc, hexForm);
+  line("privilege", unsigned(ref.privMode), unsigned(other.privMode), "%d");
+  line("retired", ref.retiredInsts, other.retiredInsts, "%d");
+
+  for (unsigned i = 0; i < 32; ++i)
+    {
+      std::string name;
+      URV val = 0;
+      if (core.peekIntReg(i, val, name))
+	line(name, ref.intRegs[i], other.intRegs[i], hexForm);
+    }
+
+  for (unsigned i = 0; i < core.fpRegCount(); ++i)
+    {
+      uint64_t a = 0, b = 0;
+      memcpy(&a, &ref.fpRegs[i], sizeof(a));
+      memcpy(&b, &other.fpRegs[i], sizeof(b));
+      if (a != b)
+	line("f" + std::to_string(i), a, b, "0x%016x");
+    }
+
+  for (size_t i = 0; i <= size_t(CsrNumber::MAX_CSR_); ++i)
+    {
+      std::string name;
+      URV val = 0;
+      if (ref.csrs[i] != other.csrs[i] and
+	  core.peekCsr(CsrNumber(i), val, name))
+	line(name, ref.csrs[i], other.csrs[i], hexForm);
+    }
+}
+
+
+/// Differential run (see --diffconfig and --diffengine): Run the
+/// program files of the command line on two harts, each with its own
+/// memory: the reference hart configured by the configuration file
+/// and running with the fast engine, and the other hart configured
+/// by the diff configuration file (or the configuration file) and
+/// running with the diff engine. The harts run on separate threads.
+/// After each retired instruction, the reference hart passes the
+/// instruction and a digest of its state (see Core::stateDigest)
+/// through a lock-free queue to the other hart which compares them
+/// with its own. At the first divergence, the reference hart is
+/// restored to its initial snapshot and rerun up to the diverging
+/// instruction to print the state of both harts after it. Return
+/// true if the harts did not diverge.
+template <typename URV>
+static
+bool
+diffSession(const Args& args, const CoreConfig& config)
+{
+  typedef typename Core<URV>::ArchState ArchState;
+
+  if (args.interactive or not args.serverFile.empty() or
+      not args.shmName.empty() or args.gdb or args.hasGdbTcpPort)
+    {
+      std::cerr << "Differential run cannot be combined with interactive, "
+		<< "server or gdb mode\n";
+      return false;
+    }
+
+  if (args.trace or not args.traceFile.empty() or not args.binLogFile.empty() or
+      not args.addrTraceFile.empty() or not args.addrTraceShm.empty())
+    std::cerr << "Warning: Tracing not supported in differential run -- "
+	      << "ignored\n";
+
+  if (not args.instFreqFile.empty() or not args.pcProfileFile.empty() or
+      not args.foldedStacksFile.empty() or not args.coverageFile.empty() or
+      args.timing or not args.bbvFile.empty() or not args.plugins.empty() or
+      not args.metricsFile.empty() or args.metricsPort)
+    std::cerr << "Warning: Profiling not supported in differential run -- "
+	      << "ignored\n";
+
+  bool step = false;
+  if (args.diffEngine == "step")
+    step = true;
+  else if (not args.diffEngine.empty() and args.diffEngine != "fast")
+    {
+      std::cerr << "Invalid differential run engine: " << args.diffEngine
+		<< " -- expecting fast or step\n";
+      return false;
+    }
+
+  CoreConfig otherConfig;
+  if (not args.diffConfigFile.empty())
+    {
+      if (not otherConfig.loadConfigFile(args.diffConfigFile))
+	return false;
+      unsigned xlen = sizeof(URV) * 8;
+      otherConfig.getXlen(xlen);
+      if (xlen != sizeof(URV) * 8 and not args.hasRegWidth)
+	{
+	  std::cerr << "Differential run: Register width of "
+		    << args.diffConfigFile << " (" << xlen << ") differs "
+		    << "from that of the reference hart (" << sizeof(URV) * 8
+		    << ")\n";
+	  return false;
+	}
+    }
+
+  Args diffArgs = args;
+  diffArgs.instFreqFile.clear();
+  diffArgs.gdb = false;
+
+  DiffHart<URV> ref, other;
+  other.step = step;
+  const CoreConfig& refConfig = config;
+  const CoreConfig& diffConfig = (args.diffConfigFile.empty() ? config :
+				  otherConfig);
+
+  FILE* consoleOut = stdout;
+  if (not args.consoleOutFile.empty())
+    {
+      consoleOut = fopen(args.consoleOutFile.c_str(), "w");
+      if (not consoleOut)
+	{
+	  std::cerr << "Failed to open console output file '"
+		    << args.consoleOutFile << "' for output\n";
+	  return false;
+	}
+    }
+
+  // Only the reference hart writes the console output.
+  bool ok = true;
+  for (auto hart : { &ref, &other })
+    {
+      Core<URV>& core = hart->core;
+      const CoreConfig& conf = hart == &ref ? refConfig : diffConfig;
+      ok = (placeMemory(args, hart->memory, -1) and
+	    conf.applyConfig(core, args.verbose) and ok);
+      core.setConsoleOutput(hart == &ref ? consoleOut : nullptr);
+      core.enableStopMessages(hart == &ref);
+      core.reset();
+      ok = applyCmdLineArgs(diffArgs, core) and ok;
+    }
+  if (not ok)
+    {
+      if (consoleOut != stdout)
+	fclose(consoleOut);
+      return false;
+    }
+
+  uint64_t limit = args.instCountLim;
+  const uint64_t chunk = 4096;   // Retired instructions between checks.
+
+  SpscQueue<DiffRecord> queue(size_t(1) << 16);
+  std::atomic<bool> diverged(false), refDone(false);
+  std::atomic<uint64_t> otherEnd(~uint64_t(0));  // Retired count at end.
+
+  // Divergence found by the other hart: its record and state, and the
+  // reference record (none if the reference stopped before).
+  DiffRecord refRecord, otherRecord;
+  bool hasRefRecord = false;
+  auto otherState = std::make_unique<ArchState>();
+  uint64_t compared = 0;
+
+  // Everything the hooks need.
+  struct Context
+  {
+    DiffHart<URV>* ref;
+    DiffHart<URV>* other;
+    SpscQueue<DiffRecord>* queue;
+    std::atomic<bool>* diverged;
+    std::atomic<bool>* refDone;
+    std::atomic<uint64_t>* otherEnd;
+    DiffRecord* refRecord;
+    DiffRecord* otherRecord;
+    bool* hasRefRecord;
+    ArchState* otherState;
+    uint64_t* compared;
+    uint64_t limit;
+  } context = { &ref, &other, &queue, &diverged, &refDone, &otherEnd,
+		&refRecord, &otherRecord, &hasRefRecord, otherState.get(),
+		&compared, limit };
+
+  // Reference hart: Queue its records waiting while the queue is full
+  // unless the other hart has stopped.
+  ref.hooks.context = &context;
+  ref.hooks.retire = [] (void* ctx, uint32_t, uint64_t count, uint64_t pc,
+			 uint32_t inst) {
+    auto& c = *static_cast<Context*>(ctx);
+    if (count >= c.limit)
+      return;
+    DiffRecord rec{count, pc, c.ref->core.stateDigest(), inst};
+    while (not c.queue->push(rec))
+      {
+	if (*c.diverged or *c.otherEnd != ~uint64_t(0))
+	  return;
+	std::this_thread::yield();
+      }
+  };
+
+  // Other hart: Compare its records to those of the reference hart
+  // waiting while the queue is empty unless the reference has stopped.
+  other.hooks.context = &context;
+  other.hooks.retire = [] (void* ctx, uint32_t, uint64_t count, uint64_t pc,
+			   uint32_t inst) {
+    auto& c = *static_cast<Context*>(ctx);
+    if (*c.diverged or count >= c.limit)
+      return;
+    DiffRecord mine{count, pc, c.other->core.stateDigest(), inst};
+    DiffRecord theirs;
+    bool hasTheirs = false;
+    while (not (hasTheirs = c.queue->pop(theirs)))
+      {
+	if (*c.refDone)
+	  {
+	    hasTheirs = c.queue->pop(theirs);
+	    break;
+	  }
+	std::this_thread::yield();
+      }
+    if (hasTheirs and theirs == mine)
+      {
+	++*c.compared;
+	return;
+      }
+    *c.refRecord = theirs;
+    *c.otherRecord = mine;
+    *c.hasRefRecord = hasTheirs;
+    *c.otherState = c.other->core.archState();
+    *c.diverged = true;
+  };
+
+  ref.plugins.add(ref.hooks);
+  other.plugins.add(other.hooks);
+  ref.core.setPlugins(&ref.plugins);
+  other.core.setPlugins(&other.plugins);
+
+  // The reference hart is rerun from its snapshot to obtain its state
+  // at the divergence.
+  ref.core.takeSnapshot();
+
+  struct timeval t0;
+  gettimeofday(&t0, nullptr);
+
+  // The reference hart runs until the other hart diverges or until it
+  // goes past the end of the other hart.
+  std::thread refThread([&] () {
+    uint64_t retired = ref.core.getRetiredCount();
+    while (not diverged and retired < limit and retired <= otherEnd)
+      {
+	if (not diffRunChunk(ref, std::min(retired + chunk, limit)))
+	  break;
+	retired = ref.core.getRetiredCount();
+      }
+    refDone = true;
+  });
+
+  uint64_t retired = other.core.getRetiredCount();
+  while (not diverged and retired < limit)
+    {
+      if (not diffRunChunk(other, std::min(retired + chunk, limit)))
+	break;
+      retired = other.core.getRetiredCount();
+    }
+  otherEnd = other.core.getRetiredCount();
+  refThread.join();
+
+  struct timeval t1;
+  gettimeofday(&t1, nullptr);
+  double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
+
+  ref.core.flushConsole();
+  ref.core.setPlugins(nullptr);
+  other.core.setPlugins(nullptr);
+  if (consoleOut != stdout)
+    fclose(consoleOut);
+
+  if (not diverged)
+    {
+      // Harts ending at different points or with different outcomes.
+      uint64_t refCount = std::min(ref.core.getRetiredCount(), limit);
+      uint64_t otherCount = std::min(other.core.getRetiredCount(), limit);
+      if (refCount == otherCount and ref.stopped == other.stopped and
+	  (not ref.stopped or ref.success == other.success))
+	{
+	  std::cerr << "Diff: No divergence in " << compared
+		    << " instructions ("
+		    << (boost::format("%.2fs") % elapsed) << ")\n";
+	  return true;
+	}
+
+      auto outcome = [] (const DiffHart<URV>& hart) {
+	return (not hart.stopped ? "did not stop" :
+		hart.success ? "stopped successfully" : "stopped with a failure");
+      };
+      std::cerr << "Diff: Harts ended differently after " << compared
+		<< " matching instructions: reference retired " << refCount
+		<< " and " << outcome(ref) << ", other retired " << otherCount
+		<< " and " << outcome(other) << '\n';
+      printDiffStates(ref.core, ref.core.archState(), other.core.archState());
+      return false;
+    }
+
+  // Rerun the reference hart up to the diverging instruction unless
+  // it stopped before it.
+  auto refState = std::make_unique<ArchState>();
+  if (hasRefRecord)
+    {
+      ref.core.restoreSnapshot();
+
+      struct Capture
+      {
+	Core<URV>* core;
+	uint64_t count;
+	ArchState* state;
+	bool done;
+      } capture = { &ref.core, refRecord.count, refState.get(), false };
+
+      WhisperPluginHooks hooks = {};
+      hooks.context = &capture;
+      hooks.retire = [] (void* ctx, uint32_t, uint64_t count, uint64_t,
+			 uint32_t) {
+	auto& c = *static_cast<Capture*>(ctx);
+	if (count == c.count)
+	  {
+	    *c.state = c.core->archState();
+	    c.done = true;
+	  }
+      };
+      PluginSet plugins;
+      plugins.add(hooks);
+      ref.core.setPlugins(&plugins);
+      ref.core.enableStopMessages(false);
+      ref.core.setConsoleOutput(nullptr);
+      while (not capture.done and diffRunChunk(ref, refRecord.count + 1))
+	;
+      ref.core.setPlugins(nullptr);
+      if (not capture.done)
+	*refState = ref.core.archState();
+    }
+  else
+    *refState = ref.core.archState();
+
+  auto describe = [] (Core<URV>& core, const DiffRecord& rec) {
+    std::string text;
+    core.disassembleInst(rec.inst, text);
+    std::ostringstream oss;
+    oss << "pc 0x" << std::hex << rec.pc << " inst 0x" << rec.inst << std::dec
+	<< ' ' << text;
+    return oss.str();
+  };
+
+  std::cerr << "Diff: First divergence at instruction "
+	    << (otherRecord.count + 1) << " after " << compared
+	    << " matching instructions\n";
+  if (hasRefRecord)
+    std::cerr << "  reference: " << describe(ref.core, refRecord) << '\n';
+  else
+    std::cerr << "  reference: stopped after "
+	      << ref.core.getRetiredCount() << " instructions\n";
+  std::cerr << "  other:     " << describe(other.core, otherRecord) << '\n';
+  printDiffStates(ref.core, *refState, *otherState);
+  return false;
+}
+
+
+/// Server mode with concurrent sessions (see --sessions): Accept
+/// test-bench connections on a socket until SIGINT or SIGTERM is
+/// received and service each on one of a pool of worker threads. Each
+/// worker owns a core which is configured, reset and loaded with the
+/// program files of the command line once and then snapshotted:
+/// before each session but the first, the core is restored to that
+/// snapshot. The socket information is written to the server file
+/// once all the cores are ready. Return true on success.
+template <typename URV>
+static
+bool
+sessionServer(const Args& args, const CoreConfig& config)
+{
+  if (args.serverFile.empty() or not args.shmName.empty() or
+      args.interactive or args.gdb)
+    {
+      std::cerr << "Option --sessions requires --server and cannot be "
+		<< "combined with --shm, --interactive or --gdb\n";
+      return false;
+    }
+
+  if (args.trace or not args.traceFile.empty() or
+      not args.binLogFile.empty() or not args.commandLogFile.empty() or
+      not args.recordEventsFile.empty() or not args.coverageFile.empty() or
+      not args.addrTraceFile.empty() or not args.addrTraceShm.empty())
+    std::cerr << "Warning: Tracing, coverage, command and event logs not "
+	      << "supported with --sessions -- ignored\n";
+
+  Args sessionArgs = args;
+  sessionArgs.trace = false;
+  sessionArgs.traceFile.clear();
+  sessionArgs.binLogFile.clear();
+  sessionArgs.commandLogFile.clear();
+
+  FILE* traceFile = nullptr;
+  FILE* commandLog = nullptr;
+  FILE* consoleOut = stdout;
+  if (not openUserFiles(sessionArgs, traceFile, commandLog, consoleOut))
+    return false;
+
+  // Termination signals are received through a signalfd: Block them
+  // before starting the workers so that all threads inherit the mask.
+  sigset_t termSignals;
+  sigemptyset(&termSignals);
+  sigaddset(&termSignals, SIGINT);
+  sigaddset(&termSignals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &termSignals, nullptr);
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<int> pending;   // Accepted connections waiting for a worker.
+  bool done = false;         // Set when shutting down.
+  unsigned readyCount = 0, failCount = 0;
+  std::atomic<uint64_t> sessionCount(0), failedSessions(0);
+
+  auto worker = [&] (unsigned workerIx) {
+    size_t memorySize = size_t(1) << 32;  // 4 gigs
+    unsigned registerCount = 32;
+    unsigned hartId = 0;
+
+    Memory memory(memorySize);
+    Core<URV> core(hartId, memory, registerCount);
+
+    // Same setup as the single-session server.
+    bool ok = (placeMemory(args, memory, workerIx) and
+	       config.applyConfig(core, args.verbose));
+    if (ok)
+      {
+	core.setConsoleOutput(consoleOut);
+	core.enableStoreExceptions(true);
+	core.enableLoadExceptions(true);
+	core.enableTriggers(true);
+	core.enablePerformanceCounters(true);
+	core.reset();
+	ok = applyCmdLineArgs(sessionArgs, core);
+      }
+
+    // A session may redefine the reset pc (Reset request).
+    URV resetPc = core.getResetPc();
+    if (ok)
+      core.takeSnapshot();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      readyCount++;
+      failCount += not ok;
+    }
+    cond.notify_all();
+    if (not ok)
+      return;
+
+    bool used = false;
+    while (true)
+      {
+	int soc = -1;
+	{
+	  std::unique_lock<std::mutex> lock(mutex);
+	  cond.wait(lock, [&] { return done or not pending.empty(); });
+	  if (pending.empty())
+	    return;
+	  soc = pending.front();
+	  pending.pop_front();
+	}
+
+	if (used)
+	  {
+	    core.restoreSnapshot();
+	    core.defineResetPc(resetPc);
+	  }
+	used = true;
+
+	SocketChannel channel(soc);
+	if (not interactUsingChannel(core, channel, nullptr, nullptr, nullptr))
+	  failedSessions++;
+	sessionCount++;
+	core.flushConsole();
+	close(soc);
+      }
+  };
+
+  unsigned workerCount = args.sessions;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < workerCount; ++i)
+    threads.emplace_back(worker, i);
+
+  auto shutdown = [&] () {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      for (int soc : pending)
+	close(soc);
+      pending.clear();
+    }
+    cond.notify_all();
+    for (auto& thread : threads)
+      thread.join();
+    closeUserFiles(traceFile, commandLog, consoleOut);
+  };
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&] { return readyCount == workerCount; });
+  }
+  if (failCount)
+    {
+      shutdown();
+      return false;
+    }
+
+  int soc = openServerSocket(args.serverFile, SOMAXCONN);
+  int sigFd = signalfd(-1, &termSignals, SFD_CLOEXEC);
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  bool ok = soc >= 0 and sigFd >= 0 and epollFd >= 0;
+  if (ok)
+    {
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = soc;
+      ok = epoll_ctl(epollFd, EPOLL_CTL_ADD, soc, &event) == 0;
+      event.data.fd = sigFd;
+      ok = ok and epoll_ctl(epollFd, EPOLL_CTL_ADD, sigFd, &event) == 0;
+      if (not ok)
+	perror("Failed to set up server event loop");
+    }
+
+  bool stop = not ok;
+  while (not stop)
+    {
+      epoll_event events[2];
+      int count = epoll_wait(epollFd, events, 2, -1);
+      if (count < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  perror("Server event wait failed");
+	  ok = false;
+	  break;
+	}
+
+      for (int i = 0; i < count; ++i)
+	{
+	  if (events[i].data.fd == sigFd)
+	    {
+	      signalfd_siginfo info;
+	      if (read(sigFd, &info, sizeof(info)) > 0)
+		std::cerr << "Received signal " << info.ssi_signo
+			  << " -- shutting down server\n";
+	      stop = true;
+	      continue;
+	    }
+
+	  int newSoc = accept(soc, nullptr, nullptr);
+	  if (newSoc < 0)
+	    {
+	      if (errno != EINTR and errno != EAGAIN and
+		  errno != ECONNABORTED)
+		perror("Socket accept failed");
+	      continue;
+	    }
+
+	  // Requests and replies alternate: Send replies right away.
+	  int one = 1;
+	  setsockopt(newSoc, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	  {
+	    std::lock_guard<std::mutex> lock(mutex);
+	    pending.push_back(newSoc);
+	  }
+	  cond.notify_one();
+	}
+    }
+
+  // Stop accepting: Running sessions finish, waiting ones are dropped.
+  if (soc >= 0)
+    close(soc);
+  shutdown();
+  if (epollFd >= 0)
+    close(epollFd);
+  if (sigFd >= 0)
+    close(sigFd);
+  pthread_sigmask(SIG_UNBLOCK, &termSignals, nullptr);
+
+  std::cerr << "Served " << sessionCount << " session"
+	    << (sessionCount == 1 ? "" : "s") << " (" << failedSessions
+	    << " failed)\n";
+  return ok;
+}
+
+
+/// An interval of a sampled run (see simpointSession).
+struct SimPoint
+{
+  uint64_t interval = 0;  // Interval number (see --bbvinterval).
+  double weight = 0;      // Weight of the cluster of the interval.
+  bool saved = false;     // True if the checkpoint of the interval is saved.
+  bool ok = false;        // True if the interval ran successfully.
+  uint64_t insts = 0;     // Instructions retired in the interval.
+  uint64_t cycles = 0;    // Cycles estimated by the timing model.
+};
+
+
+/// Read the intervals of the given SimPoint simpoints file (interval
+/// and cluster number per line) and their weights from the given
+/// weights file (weight and cluster number per line, equal weights if
+/// the path is empty) into the given vector sorted by interval
+/// number. Return true on success.
+static
+bool
+readSimPoints(const std::string& pointsPath, const std::string& weightsPath,
+	      std::vector<SimPoint>& points)
+{
+  // Read "x cluster" lines of the given file into the given vectors.
+  auto readPairs = [] (const std::string& path, const char* what,
+		       std::vector<double>& values,
+		       std::vector<uint64_t>& clusters) {
+    std::ifstream input(path);
+    if (not input.good())
+      {
+	std::cerr << "Failed to open " << what << " file '" << path
+		  << "' for input\n";
+	return false;
+      }
+    std::string line;
+    while (std::getline(input, line))
+      {
+	boost::trim(line);
+	if (line.empty() or line.front() == '#')
+	  continue;
+	std::istringstream iss(line);
+	double value = 0;
+	uint64_t cluster = 0;
+	if (not (iss >> value >> cluster) or value < 0)
+	  {
+	    std::cerr << "Invalid line in " << what << " file '" << path
+		      << "': " << line << '\n';
+	    return false;
+	  }
+	values.push_back(value);
+	clusters.push_back(cluster);
+      }
+    return true;
+  };
+
+  std::vector<double> intervals;
+  std::vector<uint64_t> clusters;
+  if (not readPairs(pointsPath, "simpoints", intervals, clusters))
+    return false;
+  if (intervals.empty())
+    {
+      std::cerr << "No intervals in simpoints file '" << pointsPath << "'\n";
+      return false;
+    }
+
+  std::unordered_map<uint64_t, double> weightOfCluster;
+  if (not weightsPath.empty())
+    {
+      std::vector<double> weights;
+      std::vector<uint64_t> weightClusters;
+      if (not readPairs(weightsPath, "simpoint weights", weights,
+			weightClusters))
+	return false;
+      for (size_t i = 0; i < weights.size(); ++i)
+	weightOfCluster[weightClusters.at(i)] = weights.at(i);
+    }
+
+  points.clear();
+  for (size_t i = 0; i < intervals.size(); ++i)
+    {
+      SimPoint point;
+      point.interval = uint64_t(intervals.at(i));
+      point.weight = 1.0 / intervals.size();
+      if (not weightsPath.empty())
+	{
+	  auto iter = weightOfCluster.find(clusters.at(i));
+	  if (iter == weightOfCluster.end())
+	    {
+	      std::cerr << "No weight for cluster " << clusters.at(i)
+			<< " in file '" << weightsPath << "'\n";
+	      return false;
+	    }
+	  point.weight = iter->second;
+	}
+      points.push_back(point);
+    }
+
+  std::sort(points.begin(), points.end(),
+	    [] (const SimPoint& a, const SimPoint& b) {
+	      return a.interval < b.interval; });
+  for (size_t i = 1; i < points.size(); ++i)
+    if (points.at(i).interval == points.at(i-1).interval)
+      {
+	std::cerr << "Interval " << points.at(i).interval << " listed twice "
+		  << "in simpoints file '" << pointsPath << "'\n";
+	return false;
+      }
+
+  return true;
+}
+
+
+/// Sampled simulation (see --simpoints): Fast-forward a hart through
+/// the target program with the fast run loop saving a checkpoint at
+/// the start of each selected interval (minus the warm-up count).
+/// Meanwhile, a pool of threads, each owning a hart, runs the saved
+/// intervals from their checkpoints with the timing model,
+/// instruction profile and/or trace of the command line. At the end,
+/// the instruction profiles are summed, the traces are left in one
+/// file per interval and the cycles per instruction of the intervals
+/// are combined by weight into an estimate for the whole
+/// program. Return true on success.
+template <typename URV>
+static
+bool
+simpointSession(const Args& args, const CoreConfig& config)
+{
+  unsigned hartCount = 1;
+  config.getHartCount(hartCount);
+  if (args.hasHarts)
+    hartCount = args.harts;
+
+  if (args.interactive or args.gdb or not args.serverFile.empty() or
+      not args.shmName.empty() or hartCount != 1)
+    {
+      std::cerr << "Option --simpoints requires a single hart and cannot be "
+		<< "combined with interactive, gdb or server mode\n";
+      return false;
+    }
+
+  if (args.bbvInterval == 0)
+    {
+      std::cerr << "Invalid --bbvinterval value: 0\n";
+      return false;
+    }
+
+  if (args.trace or not args.binLogFile.empty() or not args.bbvFile.empty() or
+      not args.addrTraceFile.empty() or not args.addrTraceShm.empty() or
+      not args.pcProfileFile.empty() or not args.foldedStacksFile.empty() or
+      not args.coverageFile.empty() or not args.saveCheckpointFile.empty())
+    std::cerr << "Warning: Only --timing, --profileinst and --logfile apply "
+	      << "to the intervals of --simpoints -- other tracing, profiling "
+	      << "and checkpoint options ignored\n";
+
+  std::vector<SimPoint> points;
+  if (not readSimPoints(args.simpointsFile, args.simpointWeightsFile, points))
+    return false;
+
+  TimingConfig timingConfig;
+  if (args.timing and not config.getTimingConfig(timingConfig))
+    return false;
+
+  bool instFreq = not args.instFreqFile.empty();
+  InstProfile::Mode instFreqMode = InstProfile::Mode::Operands;
+  if (args.instFreqMode == "count")
+    instFreqMode = InstProfile::Mode::Count;
+  else if (args.instFreqMode != "operands")
+    {
+      std::cerr << "Invalid instruction profile mode: " << args.instFreqMode
+		<< " -- expecting count or operands\n";
+      return false;
+    }
+
+  // The fast-forward hart loads the program but is not instrumented.
+  Args forwardArgs = args;
+  forwardArgs.trace = false;
+  forwardArgs.traceFile.clear();
+  forwardArgs.binLogFile.clear();
+  forwardArgs.instFreqFile.clear();
+
+  FILE* traceFile = nullptr;
+  FILE* commandLog = nullptr;
+  FILE* consoleOut = stdout;
+  if (not openUserFiles(forwardArgs, traceFile, commandLog, consoleOut))
+    return false;
+
+  size_t memorySize = size_t(1) << 32;  // 4 gigs
+  unsigned registerCount = 32;
+
+  Memory memory(memorySize);
+  Core<URV> core(0, memory, registerCount);
+  bool ok = (placeMemory(args, memory, -1) and
+	     config.applyConfig(core, args.verbose));
+  if (ok)
+    {
+      core.setConsoleOutput(consoleOut);
+      core.enableStoreExceptions(false);
+      core.enableLoadExceptions(false);
+      core.reset();
+      ok = applyCmdLineArgs(forwardArgs, core);
+    }
+  if (ok and not args.loadCheckpointFile.empty())
+    ok = Core<URV>::loadCheckpoint(args.loadCheckpointFile, { &core });
+  if (not ok)
+    {
+      closeUserFiles(traceFile, commandLog, consoleOut);
+      return false;
+    }
+
+  // Settings of the fast-forward hart not saved in checkpoints.
+  size_t toHost = 0;
+  bool hasToHost = core.getToHostAddress(toHost);
+  URV conIo = 0;
+  bool hasConIo = core.getConsoleIo(conIo);
+
+  // Sum of the instruction profiles of the intervals.
+  std::unique_ptr<Memory> sumMemory;
+  std::unique_ptr<Core<URV>> sumCore;
+  if (instFreq)
+    {
+      sumMemory = std::make_unique<Memory>(memorySize);
+      sumCore = std::make_unique<Core<URV>>(0, *sumMemory, registerCount);
+      sumCore->enableInstructionFrequency(true, instFreqMode,
+					  args.instFreqSample);
+    }
+
+  std::mutex mutex;
+  std::condition_variable savedCv;
+  size_t savedCount = 0;    // Points processed by the fast-forward hart.
+  std::atomic<size_t> nextPoint(0);
+  std::atomic<bool> configOk(true);
+
+  auto checkpointPath = [&args] (const SimPoint& point) {
+    return args.simpointPrefix + "." + std::to_string(point.interval);
+  };
+
+  // Run the given interval on the given hart.
+  auto runPoint = [&] (Core<URV>& hart, SimPoint& point) {
+    if (not Core<URV>::loadCheckpoint(checkpointPath(point), { &hart }))
+      return;
+
+    std::unique_ptr<TimingModel> model;
+    if (args.timing)
+      model = std::make_unique<TimingModel>(timingConfig);
+    hart.setTimingModel(model.get());
+
+    bool stopped = false;
+    uint64_t begin = point.interval * args.bbvInterval;
+    if (hart.getRetiredCount() < begin)
+      {
+	hart.enableInstructionFrequency(false);
+	hart.runUntilRetired(begin, stopped);
+	if (model)
+	  model->clearStats();
+      }
+
+    FILE* trace = nullptr;
+    if (not args.traceFile.empty() and not stopped)
+      {
+	std::string path = args.traceFile + "." + std::to_string(point.interval);
+	trace = fopen(path.c_str(), "w");
+	if (not trace)
+	  {
+	    std::cerr << "Failed to open trace file '" << path
+		      << "' for output\n";
+	    hart.setTimingModel(nullptr);
+	    return;
+	  }
+      }
+
+    if (instFreq)
+      hart.enableInstructionFrequency(true, instFreqMode, args.instFreqSample);
+
+    uint64_t first = hart.getRetiredCount();
+    if (stopped)
+      point.ok = false;
+    else if (trace or
+	     (instFreq and instFreqMode == InstProfile::Mode::Operands))
+      {
+	// Features of the per-instruction run loop.
+	hart.setInstructionCountLimit(hart.getInstructionCount() +
+				      args.bbvInterval);
+	point.ok = hart.run(trace);
+      }
+    else
+      point.ok = hart.runUntilRetired(first + args.bbvInterval, stopped);
+
+    point.insts = hart.getRetiredCount() - first;
+    if (model)
+      point.cycles = model->instructions() + model->stalls();
+    hart.setTimingModel(nullptr);
+    if (trace)
+      fclose(trace);
+
+    if (sumCore)
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	sumCore->mergeInstructionFrequency(hart);
+      }
+  };
+
+  auto worker = [&] (unsigned workerIx) {
+    Memory hartMemory(memorySize);
+    Core<URV> hart(0, hartMemory, registerCount);
+    if (not placeMemory(args, hartMemory, workerIx) or
+	not config.applyConfig(hart, false))
+      {
+	configOk = false;
+	return;
+      }
+
+    // Console output is that of the fast-forward run.
+    hart.setConsoleOutput(nullptr);
+    hart.setStopToken(&interruptToken);
+    hart.enableStoreExceptions(false);
+    hart.enableLoadExceptions(false);
+    hart.reset();
+    if (hasToHost)
+      hart.setToHostAddress(toHost);
+    if (hasConIo)
+      hart.setConsoleIo(conIo);
+    if (args.hasEndPc)
+      hart.setStopAddress(args.endPc);
+    hart.setTraceLoad(args.traceLoad);
+    hart.enableAbiNames(args.abiNames);
+    hart.enableNewlib(args.newlib);
+
+    for (size_t ix = nextPoint++; ix < points.size(); ix = nextPoint++)
+      {
+	{
+	  std::unique_lock<std::mutex> lock(mutex);
+	  savedCv.wait(lock, [&] { return savedCount > ix; });
+	}
+	if (points.at(ix).saved)
+	  runPoint(hart, points.at(ix));
+      }
+  };
+
+  unsigned jobs = args.jobs;
+  if (jobs == 0)
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  jobs = std::min(size_t(jobs), points.size());
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; ++i)
+    threads.emplace_back(worker, i);
+
+  // Fast-forward: Checkpoint the start of each interval (minus the
+  // warm-up count) then run the program to its end.
+  struct timeval t0;
+  gettimeofday(&t0, nullptr);
+
+  bool stopped = false;
+  for (auto& point : points)
+    {
+      uint64_t begin = point.interval * args.bbvInterval;
+      uint64_t start = begin - std::min(begin, args.simpointWarmup);
+      if (not stopped)
+	ok = core.runUntilRetired(start, stopped) and ok;
+      if (not stopped)
+	point.saved = Core<URV>::saveCheckpoint(checkpointPath(point),
+						{ &core });
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	savedCount++;
+      }
+      savedCv.notify_all();
+    }
+  if (not stopped)
+    ok = core.runUntilRetired(~uint64_t(0), stopped) and ok;
+
+  struct timeval t1;
+  gettimeofday(&t1, nullptr);
+  double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)*1e-6;
+
+  for (auto& thread : threads)
+    thread.join();
+
+  core.flushConsole();
+  closeUserFiles(traceFile, commandLog, consoleOut);
+
+  if (not configOk)
+    return false;
+
+  uint64_t total = core.getRetiredCount();
+  std::cerr << "Retired " << total << " instruction" << (total > 1? "s" : "")
+	    << " in " << (boost::format("%.2fs") % elapsed)
+	    << " (fast-forward)\n";
+
+  // Combine the cycles per instruction of the intervals by weight.
+  double weightSum = 0, cpi = 0;
+  for (const auto& point : points)
+    {
+      std::cerr << "Simpoint interval " << point.interval << " (weight "
+		<< (boost::format("%.4f") % point.weight) << "): ";
+      if (not point.saved)
+	{
+	  std::cerr << "not reached\n";
+	  ok = false;
+	  continue;
+	}
+      std::cerr << point.insts << " instructions";
+      if (args.timing and point.insts)
+	{
+	  double pointCpi = double(point.cycles) / point.insts;
+	  std::cerr << ", " << point.cycles << " cycles, CPI "
+		    << (boost::format("%.3f") % pointCpi);
+	  weightSum += point.weight;
+	  cpi += point.weight * pointCpi;
+	}
+      std::cerr << (point.ok ? "" : " -- failed") << '\n';
+      ok = point.ok and ok;
+    }
+
+  if (weightSum > 0)
+    {
+      cpi /= weightSum;
+      std::cerr << "Simpoints: weighted CPI " << (boost::format("%.3f") % cpi)
+		<< ", estimated " << uint64_t(cpi * total) << " cycles for "
+		<< total << " instructions\n";
+    }
+
+  if (sumCore)
+    ok = reportInstructionFrequency(*sumCore, args.instFreqFile) and ok;
+
+  return ok;
+}
+
+
+/// Complete the given run report with the statistics of the given
+/// harts and of their memory and write it to the file given by the
+/// command line (see --reportjson). Return true on success.
+template <typename URV>
+static
+bool
+writeRunReport(RunReport& report, const std::vector<Core<URV>*>& cores,
+	       const Memory& memory, const Args& args, bool success)
+{
+  using Mode = typename Core<URV>::RunMode;
+  static const std::pair<Mode, const char*> modes[] = {
+    { Mode::Fast, "fast" }, { Mode::Until, "until" },
+    { Mode::Windowed, "windowed" }, { Mode::Harts, "harts" } };
+
+  for (auto core : cores)
+    {
+      RunReportHart hart;
+      hart.hartId = core->hartId();
+      hart.retired = core->getRetiredCount();
+      hart.cycles = core->archState().cycleCount;
+      hart.exceptions = core->getExceptionCount();
+      hart.interrupts = core->getInterruptCount();
+      hart.triggerTrips = core->getTriggerTripCount();
+      for (unsigned cause = 0; cause <= Core<URV>::maxTrapCause; ++cause)
+	{
+	  if (uint64_t count = core->getTrapCauseCount(false, cause))
+	    hart.exceptionCauses.emplace_back(cause, count);
+	  if (uint64_t count = core->getTrapCauseCount(true, cause))
+	    hart.interruptCauses.emplace_back(cause, count);
+	}
+      for (const auto& [mode, name] : modes)
+	{
+	  const auto& stats = core->getRunModeStats(mode);
+	  if (stats.runs)
+	    hart.modes.push_back({ name, stats.runs, stats.instructions,
+				   stats.seconds });
+	}
+      report.addHart(hart);
+    }
+
+  std::vector<std::string> programs = args.hexFiles;
+  for (const auto& target : args.expandedTargets)
+    programs.push_back(target.front());
+  if (not args.loadCheckpointFile.empty())
+    programs.push_back(args.loadCheckpointFile);
+  report.setPrograms(programs);
+
+  report.setMemoryPages(memory.residentPageCount(), sysconf(_SC_PAGESIZE));
+  report.setSuccess(success);
+  return report.write(args.reportJsonFile);
+}
+
+
+/// Run a session as given by the command line. If report is not null,
+/// time the phases of a plain run (see --reportjson) into it.
+template <typename URV>
+static
+bool
+session(const Args& args, const CoreConfig& config, RunReport* report)
+{
+  // Keyboard interrupts stop the runs of the harts (see interruptToken).
+  // The fuzzing and server sessions wait for them instead.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = runInterruptHandler;
+  sigaction(SIGINT, &action, nullptr);
+
+  if (report and (not args.batchFile.empty() or not args.fuzzDir.empty() or
+		  not args.diffConfigFile.empty() or
+		  not args.diffEngine.empty() or args.sessions or
+		  not args.simpointsFile.empty()))
+    std::cerr << "Warning: Option --reportjson only applies to plain runs "
+	      << "-- ignored\n";
+
+  if (not args.batchFile.empty())
+    return batchSession<URV>(args, config);
+
+  if (not args.fuzzDir.empty())
+    return fuzzSession<URV>(args, config);
+
+  if (not args.diffConfigFile.empty() or not args.diffEngine.empty())
+    return diffSession<URV>(args, config);
+
+  if (args.sessions)
+    return sessionServer<URV>(args, config);
+
+  if (not args.simpointsFile.empty())
+    return simpointSession<URV>(args, config);
+
+  size_t memorySize = size_t(1) << 32;  // 4 gigs
+  unsigned registerCount = 32;
+
+  // Obtain hart count and synchronization quantum. First from config
+  // file then from command line.
+  unsigned hartCount = 1;
+  config.getHartCount(hartCount);
+  if (args.hasHarts)
+    hartCount = args.harts;
+  if (hartCount == 0)
+    {
+      std::cerr << "Invalid hart count: 0\n";
+      return false;
+    }
+
+  uint64_t quantum = 100000;
+  config.getQuantum(quantum);
+  if (args.hasQuantum)
+    quantum = args.quantum;
+
+  // All harts share one memory.
+  Memory memory(memorySize);
+  memory.setHartCount(hartCount);
+  if (not placeMemory(args, memory, -1))
+    return false;
+
+  std::vector< std::unique_ptr<Core<URV>> > harts;
+  std::vector<Core<URV>*> cores;
+  for (unsigned hartId = 0; hartId < hartCount; ++hartId)
+    {
+      harts.push_back(std::make_unique<Core<URV>>(hartId, memory,
+						  registerCount));
+      cores.push_back(harts.back().get());
+      if (not config.applyConfig(*cores.back(), args.verbose))
+	if (not args.interactive)
+	  return false;
+    }
+
+  // Hart threads on the NUMA nodes round-robin (hart 0 runs in this
+  // thread) and memory interleaved across them. Done after the
+  // configuration which defines the closely coupled memories.
+  if (not args.numaNodes.empty())
+    {
+      for (unsigned i = 0; i < hartCount; ++i)
+	cores.at(i)->setNumaNode(args.numaNodes.at(i % args.numaNodes.size()));
+      if (not bindThreadToNumaNode(args.numaNodes.front()) or
+	  not memory.bindToNumaNodes(args.numaNodes))
+	return false;
+    }
+
+  if (report)
+    report->endPhase("config");
+
+  Core<URV>& core = *cores.front();
+
+  bool disasOk = applyDisassemble(core, args);
+  if (not args.disassElfFile.empty())
+    disasOk = disassembleElf(core, args) and disasOk;
+
+  if (args.hexFiles.empty() and args.expandedTargets.empty()
+      and args.loadCheckpointFile.empty() and not args.interactive)
+    {
+      if (not args.codes.empty() or not args.disassElfFile.empty())
+	return disasOk;
+      std::cerr << "No program file specified.\n";
+      return false;
+    }
+
+  FILE* traceFile = nullptr;
+  FILE* commandLog = nullptr;
+  FILE* consoleOut = stdout;
+  if (not openUserFiles(args, traceFile, commandLog, consoleOut))
+    return false;
+
+  bool serverMode = not args.serverFile.empty() or not args.shmName.empty();
+  bool replayMode = not args.replayEventsFile.empty();
+  bool storeExceptions = args.interactive or serverMode or replayMode;
+  for (auto hart : cores)
+    {
+      hart->setConsoleOutput(consoleOut);
+      hart->enableStoreExceptions(storeExceptions);
+      hart->enableLoadExceptions(storeExceptions);
+      hart->reset();
+    }
+
+  // What-if helpers of the hart serving the test-bench requests.
+  std::vector<std::unique_ptr<Core<URV>>> whatIfHelpers;
+  if (serverMode and args.whatIfThreads > 1)
+    if (not createWhatIfHelpers(args, config, core, args.whatIfThreads - 1,
+				whatIfHelpers))
+      return false;
+
+  // Code coverage: One per hart (harts may run in separate threads),
+  // merged into one file.
+  std::vector<std::unique_ptr<Coverage>> coverages;
+  if (not args.coverageFile.empty())
+    for (auto hart : cores)
+      {
+	coverages.push_back(std::make_unique<Coverage>(args.coverageBranches));
+	hart->setCoverage(coverages.back().get());
+      }
+
+  // Timing model: One per hart.
+  std::vector<std::unique_ptr<TimingModel>> timings;
+  if (args.timing)
+    {
+      TimingConfig timingConfig;
+      if (not config.getTimingConfig(timingConfig))
+	return false;
+      for (auto hart : cores)
+	{
+	  timings.push_back(std::make_unique<TimingModel>(timingConfig));
+	  hart->setTimingModel(timings.back().get());
+	}
+    }
+
+  // Basic block vectors: Hart 0 only (intervals are counted in its
+  // retired instructions).
+  FILE* bbvFile = nullptr;
+  std::unique_ptr<BasicBlockVector> bbv;
+  if (not args.bbvFile.empty())
+    {
+      bbvFile = fopen(args.bbvFile.c_str(), "w");
+      if (not bbvFile)
+	{
+	  std::cerr << "Failed to open basic block vector file '"
+		    << args.bbvFile << "' for output\n";
+	  return false;
+	}
+      if (cores.size() > 1)
+	std::cerr << "Warning: Option --bbv only records hart 0\n";
+      bbv = std::make_unique<BasicBlockVector>(bbvFile, args.bbvInterval);
+      core.setBasicBlockVector(bbv.get());
+    }
+
+  // Instrumentation plugins: Shared by the harts.
+  PluginSet plugins;
+  for (const auto& spec : args.plugins)
+    {
+      auto colon = spec.find(':');
+      std::string arg;
+      if (colon != std::string::npos)
+	arg = spec.substr(colon + 1);
+      if (not plugins.load(spec.substr(0, colon), arg, 8*sizeof(URV)))
+	return false;
+    }
+  if (not plugins.empty())
+    for (auto hart : cores)
+      hart->setPlugins(&plugins);
+
+  // Live metrics: One block per hart in a file and/or served over
+  // HTTP.
+  MetricsBlock metricsBlock;
+  std::vector<HartMetrics> hartMetrics;
+  if (not args.metricsFile.empty() or args.metricsPort)
+    {
+      if (not metricsBlock.create(args.metricsFile, cores.size()))
+	return false;
+      if (args.metricsPort and not metricsBlock.serve(args.metricsPort))
+	return false;
+      for (unsigned i = 0; i < cores.size(); ++i)
+	hartMetrics.push_back(metricsBlock.hart(i));
+      for (unsigned i = 0; i < cores.size(); ++i)
+	cores.at(i)->setMetrics(&hartMetrics.at(i));
+    }
+
+  std::vector<std::unique_ptr<PcProfiler>> profilers;
+  bool result = sessionRun(cores, args, traceFile, commandLog, quantum,
+			   profilers, report);
+  if (report)
+    report->endPhase("run");
+  for (auto hart : cores)
+    {
+      hart->setPcProfiler(nullptr);
+      hart->setCoverage(nullptr);
+      hart->setTimingModel(nullptr);
+      hart->setBasicBlockVector(nullptr);
+      hart->setPlugins(nullptr);
+      hart->setMetrics(nullptr);
+      hart->setWhatIfHelpers({});
+    }
+  result = writePcProfiles(profilers, args) and result;
+  plugins.finish();
+
+  if (bbv)
+    {
+      bbv->finish(core.getRetiredCount());
+      fclose(bbvFile);
+    }
+
+  for (size_t i = 0; i < timings.size(); ++i)
+    {
+      if (timings.size() > 1)
+	std::cerr << "Hart " << i << ": ";
+      timings.at(i)->report(std::cerr);
+    }
+
+  if (not coverages.empty())
+    {
+      for (size_t i = 1; i < coverages.size(); ++i)
+	coverages.front()->merge(*coverages.at(i));
+      result = coverages.front()->write(args.coverageFile) and result;
+    }
 
   if (not args.instFreqFile.empty())
     result = reportInstructionFrequency(core, args.instFreqFile) and result;
 
+  for (auto hart : cores)
+    hart->flushConsole();
   closeUserFiles(traceFile, commandLog, consoleOut);
 
+  if (report)
+    {
+      report->endPhase("teardown");
+      result = writeRunReport(*report, cores, memory, args, result) and result;
+    }
+
   return result;
 }
 
@@ -3002,6 +7069,15 @@ main(int argc, char* argv[])
       args.expandedTargets.push_back(tokens);
     }
 
+  // Run report: Its first phase (config) starts here.
+  std::unique_ptr<RunReport> report;
+  if (not args.reportJsonFile.empty())
+    {
+      report = std::make_unique<RunReport>();
+      report->setVersion(std::to_string(version) + "." +
+			 std::to_string(subversion));
+    }
+
   // Load configuration file.
   CoreConfig config;
   if (not args.configFile.empty())
@@ -3022,9 +7098,9 @@ main(int argc, char* argv[])
   try
     {
       if (regWidth == 32)
-	ok = session<uint32_t>(args, config);
+	ok = session<uint32_t>(args, config, report.get());
       else if (regWidth == 64)
-	ok = session<uint64_t>(args, config);
+	ok = session<uint64_t>(args, config, report.get());
       else
 	{
 	  std::cerr << "Invalid register width: " << regWidth;